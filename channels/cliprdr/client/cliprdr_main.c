@@ -30,6 +30,7 @@
 #include <freerdp/types.h>
 #include <freerdp/constants.h>
 #include <freerdp/client/cliprdr.h>
+#include <freerdp/channels/channels.h>
 
 #include "cliprdr_main.h"
 #include "cliprdr_format.h"
@@ -544,7 +545,7 @@ static UINT cliprdr_order_recv(cliprdrPlugin* cliprdr, wStream* s)
 			break;
 	}
 
-	Stream_Free(s, TRUE);
+	freerdp_channels_release_stream(s);
 	return error;
 }
 
@@ -931,6 +932,23 @@ static VOID VCAPITYPE cliprdr_virtual_channel_open_event_ex(LPVOID lpUserParam,
 
 			break;
 
+		case CHANNEL_EVENT_STREAM_RECEIVED:
+			if (!cliprdr || (cliprdr->OpenHandle != openHandle))
+			{
+				WLog_ERR(TAG, "error no match");
+				freerdp_channels_release_stream((wStream*)pData);
+				return;
+			}
+
+			if (!MessageQueue_Post(cliprdr->queue, NULL, 0, pData, NULL))
+			{
+				WLog_ERR(TAG, "MessageQueue_Post failed!");
+				freerdp_channels_release_stream((wStream*)pData);
+				error = ERROR_INTERNAL_ERROR;
+			}
+
+			break;
+
 		case CHANNEL_EVENT_WRITE_CANCELLED:
 		case CHANNEL_EVENT_WRITE_COMPLETE:
 		{
@@ -1001,7 +1019,7 @@ static void cliprdr_free_msg(void* obj)
 	if (msg)
 	{
 		wStream* s = (wStream*)msg->wParam;
-		Stream_Free(s, TRUE);
+		freerdp_channels_release_stream(s);
 	}
 }
 
@@ -1026,6 +1044,12 @@ static UINT cliprdr_virtual_channel_event_connected(cliprdrPlugin* cliprdr, LPVO
 		return status;
 	}
 
+	/* let the channel manager reassemble messages, data_in is only used without it */
+	if (cliprdr->context->rdpcontext &&
+	    !freerdp_channels_set_receive_stream(cliprdr->context->rdpcontext->channels,
+	                                         cliprdr->OpenHandle, TRUE))
+		WLog_WARN(TAG, "freerdp_channels_set_receive_stream failed");
+
 	obj.fnObjectFree = cliprdr_free_msg;
 	cliprdr->queue = MessageQueue_New(&obj);
 
@@ -31,6 +31,8 @@
 #include <winpr/crt.h>
 #include <winpr/stream.h>
 
+#include <freerdp/channels/channels.h>
+
 #include "rdpdr_main.h"
 #include "devman.h"
 #include "irp.h"
@@ -45,7 +47,7 @@ static UINT irp_free(IRP* irp)
 	if (!irp)
 		return CHANNEL_RC_OK;
 
-	Stream_Free(irp->input, TRUE);
+	freerdp_channels_release_stream(irp->input);
 	Stream_Free(irp->output, TRUE);
 
 	_aligned_free(irp);
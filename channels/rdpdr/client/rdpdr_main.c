@@ -37,6 +37,7 @@
 #include <freerdp/constants.h>
 #include <freerdp/channels/log.h>
 #include <freerdp/channels/rdpdr.h>
+#include <freerdp/channels/channels.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -1308,7 +1309,9 @@ static UINT rdpdr_process_irp(rdpdrPlugin* rdpdr, wStream* s)
 
 		if (error == CHANNEL_RC_OK)
 		{
-			return dummy_irp_response(rdpdr, s);
+			error = dummy_irp_response(rdpdr, s);
+			freerdp_channels_release_stream(s);
+			return error;
 		}
 
 		return error;
@@ -1507,7 +1510,7 @@ static UINT rdpdr_process_receive(rdpdrPlugin* rdpdr, wStream* s)
 		}
 	}
 
-	Stream_Free(s, TRUE);
+	freerdp_channels_release_stream(s);
 	return error;
 }
 
@@ -1641,6 +1644,23 @@ static VOID VCAPITYPE rdpdr_virtual_channel_open_event_ex(LPVOID lpUserParam, DW
 
 			break;
 
+		case CHANNEL_EVENT_STREAM_RECEIVED:
+			if (!rdpdr || !pData || (rdpdr->OpenHandle != openHandle))
+			{
+				WLog_ERR(TAG, "error no match");
+				freerdp_channels_release_stream((wStream*)pData);
+				return;
+			}
+
+			if (!MessageQueue_Post(rdpdr->queue, NULL, 0, pData, NULL))
+			{
+				WLog_ERR(TAG, "MessageQueue_Post failed!");
+				freerdp_channels_release_stream((wStream*)pData);
+				error = ERROR_INTERNAL_ERROR;
+			}
+
+			break;
+
 		case CHANNEL_EVENT_WRITE_CANCELLED:
 		case CHANNEL_EVENT_WRITE_COMPLETE:
 		{
@@ -1720,8 +1740,10 @@ static DWORD WINAPI rdpdr_virtual_channel_client_thread(LPVOID arg)
 
 static void queue_free(void* obj)
 {
-	wStream* s = obj;
-	Stream_Free(s, TRUE);
+	wMessage* msg = (wMessage*)obj;
+
+	if (msg && (msg->id == 0))
+		freerdp_channels_release_stream((wStream*)msg->wParam);
 }
 
 /**
@@ -1744,6 +1766,11 @@ static UINT rdpdr_virtual_channel_event_connected(rdpdrPlugin* rdpdr, LPVOID pDa
 		return status;
 	}
 
+	/* let the channel manager reassemble messages, data_in is only used without it */
+	if (rdpdr->rdpcontext &&
+	    !freerdp_channels_set_receive_stream(rdpdr->rdpcontext->channels, rdpdr->OpenHandle, TRUE))
+		WLog_WARN(TAG, "freerdp_channels_set_receive_stream failed");
+
 	rdpdr->queue = MessageQueue_New(NULL);
 
 	if (!rdpdr->queue)
@@ -96,6 +96,7 @@
 #include "xf_input.h"
 #include "xf_cliprdr.h"
 #include "xf_disp.h"
+#include "xf_shm.h"
 #include "xf_video.h"
 #include "xf_monitor.h"
 #include "xf_graphics.h"
@@ -334,7 +335,7 @@ static BOOL xf_sw_end_paint(rdpContext* context)
 				return TRUE;
 
 			xf_lock_x11(xfc);
-			XPutImage(xfc->display, xfc->primary, xfc->gc, xfc->image, x, y, x, y, w, h);
+			xf_shm_put_image(xfc, xfc->primary, xfc->gc, xfc->image, x, y, x, y, w, h);
 			xf_draw_screen(xfc, x, y, w, h);
 			xf_unlock_x11(xfc);
 		}
@@ -351,7 +352,7 @@ static BOOL xf_sw_end_paint(rdpContext* context)
 				y = cinvalid[i].y;
 				w = cinvalid[i].w;
 				h = cinvalid[i].h;
-				XPutImage(xfc->display, xfc->primary, xfc->gc, xfc->image, x, y, x, y, w, h);
+				xf_shm_put_image(xfc, xfc->primary, xfc->gc, xfc->image, x, y, x, y, w, h);
 				xf_draw_screen(xfc, x, y, w, h);
 			}
 
@@ -379,19 +380,43 @@ static BOOL xf_sw_desktop_resize(rdpContext* context)
 	rdpGdi* gdi = context->gdi;
 	xfContext* xfc = (xfContext*)context;
 	rdpSettings* settings = context->settings;
+	const UINT32 stride = settings->DesktopWidth * GetBytesPerPixel(gdi->dstFormat);
 	BOOL ret = FALSE;
+	XImage* image;
 	xf_lock_x11(xfc);
+	image = xf_shm_image_new(xfc, stride, settings->DesktopHeight);
 
-	if (!gdi_resize(gdi, settings->DesktopWidth, settings->DesktopHeight))
-		goto out;
-
-	if (xfc->image)
+	if (image)
 	{
-		xfc->image->data = NULL;
-		XDestroyImage(xfc->image);
+		if (!gdi_resize_ex(gdi, settings->DesktopWidth, settings->DesktopHeight, stride, 0,
+		                   (BYTE*)image->data, NULL))
+		{
+			xf_shm_image_free(xfc, image);
+			goto out;
+		}
 	}
+	else if (xf_shm_image_is_shared(xfc->image))
+	{
+		/* gdi still draws into the old segment, even if the size did not change.
+		 * Move it to a buffer of its own before the segment is detached. */
+		BYTE* buffer = _aligned_malloc(1ull * stride * settings->DesktopHeight, 16);
+
+		if (!buffer)
+			goto out;
 
-	if (!(xfc->image = XCreateImage(xfc->display, xfc->visual, xfc->depth, ZPixmap, 0,
+		/* On failure the buffer may already be owned by the freed primary bitmap */
+		if (!gdi_resize_ex(gdi, settings->DesktopWidth, settings->DesktopHeight, stride, 0,
+		                   buffer, _aligned_free))
+			goto out;
+	}
+	else if (!gdi_resize(gdi, settings->DesktopWidth, settings->DesktopHeight))
+		goto out;
+
+	xf_shm_image_free(xfc, xfc->image);
+	xfc->image = image;
+
+	if (!xfc->image &&
+	    !(xfc->image = XCreateImage(xfc->display, xfc->visual, xfc->depth, ZPixmap, 0,
 	                                (char*)gdi->primary_buffer, gdi->width, gdi->height,
 	                                xfc->scanline_pad, gdi->stride)))
 	{
@@ -684,8 +709,7 @@ static void xf_window_free(xfContext* xfc)
 
 	if (xfc->image)
 	{
-		xfc->image->data = NULL;
-		XDestroyImage(xfc->image);
+		xf_shm_image_free(xfc, xfc->image);
 		xfc->image = NULL;
 	}
 
@@ -1260,11 +1284,23 @@ static BOOL xf_post_connect(freerdp* instance)
 	rdpSettings* settings;
 	ResizeWindowEventArgs e;
 	xfContext* xfc = (xfContext*)instance->context;
+	const UINT32 format = xf_get_local_color_format(xfc, TRUE);
 	context = instance->context;
 	settings = instance->settings;
 	update = context->update;
 
-	if (!gdi_init(instance, xf_get_local_color_format(xfc, TRUE)))
+	/* With shared memory the X server reads the software framebuffer directly */
+	if (settings->SoftwareGdi)
+		xfc->image = xf_shm_image_new(xfc, settings->DesktopWidth * GetBytesPerPixel(format),
+		                              settings->DesktopHeight);
+
+	if (xfc->image)
+	{
+		if (!gdi_init_ex(instance, format, xfc->image->bytes_per_line, (BYTE*)xfc->image->data,
+		                 NULL))
+			return FALSE;
+	}
+	else if (!gdi_init(instance, format))
 		return FALSE;
 
 	if (!xf_register_pointer(context->graphics))
@@ -1947,6 +1983,8 @@ static BOOL xfreerdp_client_new(freerdp* instance, rdpContext* context)
 		goto fail_pixmap_info;
 	}
 
+	xf_shm_init(xfc);
+
 	xfc->vscreen.monitors = calloc(16, sizeof(MONITOR_INFO));
 
 	if (!xfc->vscreen.monitors)
@@ -33,6 +33,7 @@
 #include "xf_disp.h"
 #include "xf_input.h"
 #include "xf_gfx.h"
+#include "xf_shm.h"
 
 #include "xf_event.h"
 #include "xf_input.h"
@@ -1101,6 +1102,9 @@ BOOL xf_event_process(freerdp* instance, const XEvent* event)
 			break;
 
 		default:
+			if (xf_shm_handle_xevent(xfc, event))
+				break;
+
 			if (settings->SupportDisplayControl)
 				xf_disp_handle_xevent(xfc, event);
 
@@ -26,6 +26,7 @@
 #include <freerdp/log.h>
 #include "xf_gfx.h"
 #include "xf_rail.h"
+#include "xf_shm.h"
 
 #include <X11/Xutil.h>
 
@@ -79,8 +80,8 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 
 		if (xfc->remote_app)
 		{
-			XPutImage(xfc->display, xfc->primary, xfc->gc, surface->image, nXSrc, nYSrc, nXDst,
-			          nYDst, dwidth, dheight);
+			xf_shm_put_image(xfc, xfc->primary, xfc->gc, surface->image, nXSrc, nYSrc, nXDst,
+			                 nYDst, dwidth, dheight);
 			xf_lock_x11(xfc);
 			xf_rail_paint(xfc, nXDst, nYDst, nXDst + dwidth, nYDst + dheight);
 			xf_unlock_x11(xfc);
@@ -89,15 +90,15 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 #ifdef WITH_XRENDER
 		    if (xfc->context.settings->SmartSizing || xfc->context.settings->MultiTouchGestures)
 		{
-			XPutImage(xfc->display, xfc->primary, xfc->gc, surface->image, nXSrc, nYSrc, nXDst,
-			          nYDst, dwidth, dheight);
+			xf_shm_put_image(xfc, xfc->primary, xfc->gc, surface->image, nXSrc, nYSrc, nXDst,
+			                 nYDst, dwidth, dheight);
 			xf_draw_screen(xfc, nXDst, nYDst, dwidth, dheight);
 		}
 		else
 #endif
 		{
-			XPutImage(xfc->display, xfc->drawable, xfc->gc, surface->image, nXSrc, nYSrc, nXDst,
-			          nYDst, dwidth, dheight);
+			xf_shm_put_image(xfc, xfc->drawable, xfc->gc, surface->image, nXSrc, nYSrc, nXDst,
+			                 nYDst, dwidth, dheight);
 		}
 	}
 
@@ -240,6 +241,21 @@ UINT32 x11_pad_scanline(UINT32 scanline, UINT32 inPad)
  *
  * @return 0 on success, otherwise a Win32 error code
  */
+static void xf_gfx_surface_free_image(xfContext* xfc, xfGfxSurface* surface)
+{
+	/* A shared image owns the buffer it was created for */
+	if (xf_shm_image_is_shared(surface->image))
+	{
+		if (surface->stage == (BYTE*)surface->image->data)
+			surface->stage = NULL;
+		else if (surface->gdi.data == (BYTE*)surface->image->data)
+			surface->gdi.data = NULL;
+	}
+
+	xf_shm_image_free(xfc, surface->image);
+	surface->image = NULL;
+}
+
 static UINT xf_CreateSurface(RdpgfxClientContext* context,
                              const RDPGFX_CREATE_SURFACE_PDU* createSurface)
 {
@@ -289,17 +305,34 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 	surface->gdi.scanline = surface->gdi.width * GetBytesPerPixel(surface->gdi.format);
 	surface->gdi.scanline = x11_pad_scanline(surface->gdi.scanline, xfc->scanline_pad);
 	size = surface->gdi.scanline * surface->gdi.height * 1ULL;
-	surface->gdi.data = (BYTE*)_aligned_malloc(size, 16);
 
-	if (!surface->gdi.data)
+	if (AreColorFormatsEqualNoAlpha(gdi->dstFormat, surface->gdi.format))
 	{
-		WLog_ERR(TAG, "%s: unable to allocate GDI data", __FUNCTION__);
-		goto out_free;
+		/* Let the X server read the surface directly if shared memory is available */
+		surface->image = xf_shm_image_new(xfc, surface->gdi.scanline, surface->gdi.height);
+
+		if (surface->image)
+			surface->gdi.data = (BYTE*)surface->image->data;
 	}
 
-	ZeroMemory(surface->gdi.data, size);
+	if (!surface->gdi.data)
+	{
+		surface->gdi.data = (BYTE*)_aligned_malloc(size, 16);
 
-	if (AreColorFormatsEqualNoAlpha(gdi->dstFormat, surface->gdi.format))
+		if (!surface->gdi.data)
+		{
+			WLog_ERR(TAG, "%s: unable to allocate GDI data", __FUNCTION__);
+			goto out_free;
+		}
+
+		ZeroMemory(surface->gdi.data, size);
+	}
+
+	if (surface->image)
+	{
+		/* The surface data is shared already */
+	}
+	else if (AreColorFormatsEqualNoAlpha(gdi->dstFormat, surface->gdi.format))
 	{
 		surface->image =
 		    XCreateImage(xfc->display, xfc->visual, xfc->depth, ZPixmap, 0,
@@ -312,20 +345,27 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 		UINT32 bytes = GetBytesPerPixel(gdi->dstFormat);
 		surface->stageScanline = width * bytes;
 		surface->stageScanline = x11_pad_scanline(surface->stageScanline, xfc->scanline_pad);
-		size = surface->stageScanline * surface->gdi.height * 1ULL;
-		surface->stage = (BYTE*)_aligned_malloc(size, 16);
+		surface->image = xf_shm_image_new(xfc, surface->stageScanline, surface->gdi.height);
 
-		if (!surface->stage)
+		if (surface->image)
+			surface->stage = (BYTE*)surface->image->data;
+		else
 		{
-			WLog_ERR(TAG, "%s: unable to allocate stage buffer", __FUNCTION__);
-			goto out_free_gdidata;
+			size = surface->stageScanline * surface->gdi.height * 1ULL;
+			surface->stage = (BYTE*)_aligned_malloc(size, 16);
+
+			if (!surface->stage)
+			{
+				WLog_ERR(TAG, "%s: unable to allocate stage buffer", __FUNCTION__);
+				goto out_free_gdidata;
+			}
+
+			ZeroMemory(surface->stage, size);
+			surface->image = XCreateImage(xfc->display, xfc->visual, xfc->depth, ZPixmap, 0,
+			                              (char*)surface->stage, surface->gdi.mappedWidth,
+			                              surface->gdi.mappedHeight, xfc->scanline_pad,
+			                              surface->stageScanline);
 		}
-
-		ZeroMemory(surface->stage, size);
-		surface->image =
-		    XCreateImage(xfc->display, xfc->visual, xfc->depth, ZPixmap, 0, (char*)surface->stage,
-		                 surface->gdi.mappedWidth, surface->gdi.mappedHeight, xfc->scanline_pad,
-		                 surface->stageScanline);
 	}
 
 	if (!surface->image)
@@ -347,8 +387,7 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 
 	return CHANNEL_RC_OK;
 error_set_surface_data:
-	surface->image->data = NULL;
-	XDestroyImage(surface->image);
+	xf_gfx_surface_free_image(xfc, surface);
 error_surface_image:
 	_aligned_free(surface->stage);
 out_free_gdidata:
@@ -368,8 +407,16 @@ static UINT xf_DeleteSurface(RdpgfxClientContext* context,
 {
 	rdpCodecs* codecs = NULL;
 	xfGfxSurface* surface = NULL;
+	rdpGdi* gdi = (rdpGdi*)context->custom;
+	xfContext* xfc = (xfContext*)gdi->context;
 	UINT status;
 	EnterCriticalSection(&context->mux);
+	/* Pipelined surface commands may still be decoding into this surface */
+	status = gdi_graphics_pipeline_flush(gdi);
+
+	if (status != CHANNEL_RC_OK)
+		WLog_WARN(TAG, "pipelined SurfaceCommand failed with error %" PRIu32 "", status);
+
 	surface = (xfGfxSurface*)context->GetSurfaceData(context, deleteSurface->surfaceId);
 
 	if (surface)
@@ -380,8 +427,7 @@ static UINT xf_DeleteSurface(RdpgfxClientContext* context,
 #ifdef WITH_GFX_H264
 		h264_context_free(surface->gdi.h264);
 #endif
-		surface->image->data = NULL;
-		XDestroyImage(surface->image);
+		xf_gfx_surface_free_image(xfc, surface);
 		_aligned_free(surface->gdi.data);
 		_aligned_free(surface->stage);
 		region16_uninit(&surface->gdi.invalidRegion);
@@ -0,0 +1,287 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * X11 Shared Memory Presentation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+
+#include <winpr/crt.h>
+#include <winpr/interlocked.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#ifdef WITH_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif
+
+#include <freerdp/log.h>
+
+#include "xf_graphics.h"
+#include "xf_shm.h"
+
+#define TAG CLIENT_TAG("x11.shm")
+
+#ifdef WITH_XSHM
+static BOOL xf_shm_attach_failed = FALSE;
+
+static int xf_shm_error_handler(Display* display, XErrorEvent* event)
+{
+	WINPR_UNUSED(display);
+	WINPR_UNUSED(event);
+	xf_shm_attach_failed = TRUE;
+	return 0;
+}
+
+static void xf_shm_segment_free(xfContext* xfc, XShmSegmentInfo* shminfo, BOOL attached)
+{
+	if (!shminfo)
+		return;
+
+	if (attached)
+	{
+		XShmDetach(xfc->display, shminfo);
+		/* The server must have processed the detach before the memory goes away */
+		XSync(xfc->display, False);
+	}
+
+	if (shminfo->shmaddr != (char*)-1)
+		shmdt(shminfo->shmaddr);
+
+	if (shminfo->shmid != -1)
+		shmctl(shminfo->shmid, IPC_RMID, NULL);
+
+	free(shminfo);
+}
+
+static XShmSegmentInfo* xf_shm_segment_new(xfContext* xfc, size_t size)
+{
+	Status status;
+	int (*handler)(Display*, XErrorEvent*);
+	XShmSegmentInfo* shminfo = (XShmSegmentInfo*)calloc(1, sizeof(XShmSegmentInfo));
+
+	if (!shminfo)
+		return NULL;
+
+	shminfo->shmaddr = (char*)-1;
+	shminfo->readOnly = True;
+	shminfo->shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+
+	if (shminfo->shmid == -1)
+	{
+		WLog_DBG(TAG, "shmget failed: %s", strerror(errno));
+		goto fail;
+	}
+
+	shminfo->shmaddr = shmat(shminfo->shmid, NULL, 0);
+
+	if (shminfo->shmaddr == (char*)-1)
+	{
+		WLog_DBG(TAG, "shmat failed: %s", strerror(errno));
+		goto fail;
+	}
+
+	/* A remote X server accepts the request but fails the attach asynchronously */
+	XSync(xfc->display, False);
+	xf_shm_attach_failed = FALSE;
+	handler = XSetErrorHandler(xf_shm_error_handler);
+	status = XShmAttach(xfc->display, shminfo);
+	XSync(xfc->display, False);
+	XSetErrorHandler(handler);
+
+	if (!status || xf_shm_attach_failed)
+	{
+		WLog_DBG(TAG, "XShmAttach failed");
+		goto fail;
+	}
+
+	/* Destroyed once both sides detached */
+	shmctl(shminfo->shmid, IPC_RMID, NULL);
+	shminfo->shmid = -1;
+	return shminfo;
+fail:
+	xf_shm_segment_free(xfc, shminfo, FALSE);
+	return NULL;
+}
+#endif
+
+BOOL xf_shm_init(xfContext* xfc)
+{
+#ifdef WITH_XSHM
+	int major, minor;
+	Bool pixmaps;
+	XShmSegmentInfo* shminfo;
+	xfc->xshm_available = FALSE;
+	xfc->xshm_pending = 0;
+
+	if (!XShmQueryExtension(xfc->display))
+		return FALSE;
+
+	if (!XShmQueryVersion(xfc->display, &major, &minor, &pixmaps))
+		return FALSE;
+
+	/* Probe with a single page whether the server can attach our segments */
+	shminfo = xf_shm_segment_new(xfc, 4096);
+
+	if (!shminfo)
+	{
+		WLog_INFO(TAG, "XShm not usable on this display, using XPutImage");
+		return FALSE;
+	}
+
+	xf_shm_segment_free(xfc, shminfo, TRUE);
+	xfc->xshm_completion_event = XShmGetEventBase(xfc->display) + ShmCompletion;
+	xfc->xshm_available = TRUE;
+	WLog_DBG(TAG, "XShm %d.%d enabled", major, minor);
+	return TRUE;
+#else
+	WINPR_UNUSED(xfc);
+	return FALSE;
+#endif
+}
+
+/**
+ * Create an image backed by a shared memory segment of stride * height bytes.
+ * The image data can be used as a regular framebuffer. Returns NULL if shared
+ * memory is not available, the caller then falls back to XCreateImage.
+ */
+XImage* xf_shm_image_new(xfContext* xfc, UINT32 stride, UINT32 height)
+{
+#ifdef WITH_XSHM
+	XImage* image;
+	XShmSegmentInfo* shminfo;
+	const UINT32 bpp = GetBytesPerPixel(xf_get_local_color_format(xfc, TRUE));
+
+	if (!xfc->xshm_available || (bpp == 0) || (stride % bpp) || (stride == 0) || (height == 0))
+		return NULL;
+
+	/* The server derives the stride from the image width, so it has to match ours */
+	image = XShmCreateImage(xfc->display, xfc->visual, xfc->depth, ZPixmap, NULL, NULL,
+	                        stride / bpp, height);
+
+	if (!image)
+		return NULL;
+
+	if ((UINT32)image->bytes_per_line != stride)
+	{
+		XDestroyImage(image);
+		return NULL;
+	}
+
+	shminfo = xf_shm_segment_new(xfc, 1ull * stride * height);
+
+	if (!shminfo)
+	{
+		XDestroyImage(image);
+		return NULL;
+	}
+
+	image->obdata = (char*)shminfo;
+	image->data = shminfo->shmaddr;
+	image->byte_order = LSBFirst;
+	image->bitmap_bit_order = LSBFirst;
+	return image;
+#else
+	WINPR_UNUSED(xfc);
+	WINPR_UNUSED(stride);
+	WINPR_UNUSED(height);
+	return NULL;
+#endif
+}
+
+BOOL xf_shm_image_is_shared(const XImage* image)
+{
+#ifdef WITH_XSHM
+	return image && image->obdata;
+#else
+	WINPR_UNUSED(image);
+	return FALSE;
+#endif
+}
+
+/**
+ * Free an image. Shared images release their segment, the data of other
+ * images is owned by the caller and left alone.
+ */
+void xf_shm_image_free(xfContext* xfc, XImage* image)
+{
+	if (!image)
+		return;
+
+#ifdef WITH_XSHM
+
+	if (image->obdata)
+	{
+		xf_shm_segment_free(xfc, (XShmSegmentInfo*)image->obdata, TRUE);
+		image->obdata = NULL;
+	}
+
+#else
+	WINPR_UNUSED(xfc);
+#endif
+	image->data = NULL;
+	XDestroyImage(image);
+}
+
+void xf_shm_put_image(xfContext* xfc, Drawable drawable, GC gc, XImage* image, int src_x,
+                      int src_y, int dst_x, int dst_y, UINT32 width, UINT32 height)
+{
+#ifdef WITH_XSHM
+
+	if (image->obdata)
+	{
+		/* Bound the puts the server has not read yet, the buffer keeps changing */
+		if (xfc->xshm_pending >= XF_SHM_MAX_PENDING)
+		{
+			XSync(xfc->display, False);
+			InterlockedExchange(&xfc->xshm_pending, 0);
+		}
+
+		if (XShmPutImage(xfc->display, drawable, gc, image, src_x, src_y, dst_x, dst_y, width,
+		                 height, True))
+		{
+			InterlockedIncrement(&xfc->xshm_pending);
+			return;
+		}
+	}
+
+#endif
+	XPutImage(xfc->display, drawable, gc, image, src_x, src_y, dst_x, dst_y, width, height);
+}
+
+BOOL xf_shm_handle_xevent(xfContext* xfc, const XEvent* event)
+{
+#ifdef WITH_XSHM
+
+	if (xfc->xshm_available && (event->type == xfc->xshm_completion_event))
+	{
+		if (InterlockedDecrement(&xfc->xshm_pending) < 0)
+			InterlockedExchange(&xfc->xshm_pending, 0);
+
+		return TRUE;
+	}
+
+#else
+	WINPR_UNUSED(xfc);
+	WINPR_UNUSED(event);
+#endif
+	return FALSE;
+}
@@ -0,0 +1,38 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * X11 Shared Memory Presentation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CLIENT_X11_SHM_H
+#define FREERDP_CLIENT_X11_SHM_H
+
+#include "xf_client.h"
+#include "xfreerdp.h"
+
+/* Maximum number of shared memory puts the X server may not have completed yet */
+#define XF_SHM_MAX_PENDING 16
+
+BOOL xf_shm_init(xfContext* xfc);
+
+XImage* xf_shm_image_new(xfContext* xfc, UINT32 stride, UINT32 height);
+BOOL xf_shm_image_is_shared(const XImage* image);
+void xf_shm_image_free(xfContext* xfc, XImage* image);
+
+void xf_shm_put_image(xfContext* xfc, Drawable drawable, GC gc, XImage* image, int src_x,
+                      int src_y, int dst_x, int dst_y, UINT32 width, UINT32 height);
+
+BOOL xf_shm_handle_xevent(xfContext* xfc, const XEvent* event);
+
+#endif /* FREERDP_CLIENT_X11_SHM_H */
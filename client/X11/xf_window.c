@@ -53,6 +53,7 @@
 #endif
 
 #include "xf_rail.h"
+#include "xf_shm.h"
 #include "xf_input.h"
 
 #define TAG CLIENT_TAG("x11")
@@ -1064,8 +1065,8 @@ void xf_UpdateWindowArea(xfContext* xfc, xfAppWindow* appWindow, int x, int y, i
 
 	if (xfc->context.settings->SoftwareGdi)
 	{
-		XPutImage(xfc->display, xfc->primary, appWindow->gc, xfc->image, ax, ay, ax, ay, width,
-		          height);
+		xf_shm_put_image(xfc, xfc->primary, appWindow->gc, xfc->image, ax, ay, ax, ay, width,
+		                 height);
 	}
 
 	XCopyArea(xfc->display, xfc->primary, appWindow->handle, appWindow->gc, ax, ay, width, height,
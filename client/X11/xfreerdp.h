@@ -177,6 +177,12 @@ struct xf_context
 	int savedPosX;
 	int savedPosY;
 
+#ifdef WITH_XSHM
+	BOOL xshm_available;
+	int xshm_completion_event;
+	LONG xshm_pending;
+#endif
+
 #ifdef WITH_XRENDER
 	int scaledWidth;
 	int scaledHeight;
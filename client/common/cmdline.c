@@ -38,6 +38,7 @@
 #include <freerdp/locale/keyboard.h>
 #include <freerdp/utils/passphrase.h>
 #include <freerdp/channels/urbdrc.h>
+#include <freerdp/codec/ncrush.h>
 
 #include <freerdp/client/cmdline.h>
 #include <freerdp/version.h>
@@ -2068,6 +2069,15 @@ int freerdp_client_settings_parse_command_line_arguments(rdpSettings* settings,
 
 			settings->KeyboardFunctionKey = (UINT32)val;
 		}
+		CommandLineSwitchCase(arg, "input-batch")
+		{
+			LONGLONG val;
+
+			if (!value_to_int(arg->Value, &val, 0, UINT32_MAX))
+				return COMMAND_LINE_ERROR_UNEXPECTED_VALUE;
+
+			settings->FastPathInputBatchWindow = (UINT32)val;
+		}
 		CommandLineSwitchCase(arg, "u")
 		{
 			user = _strdup(arg->Value);
@@ -2370,6 +2380,10 @@ int freerdp_client_settings_parse_command_line_arguments(rdpSettings* settings,
 		{
 			settings->CompressionEnabled = enable;
 		}
+		CommandLineSwitchCase(arg, "compression-adaptive")
+		{
+			settings->CompressionAdaptive = enable;
+		}
 		CommandLineSwitchCase(arg, "compression-level")
 		{
 			LONGLONG val;
@@ -2379,6 +2393,15 @@ int freerdp_client_settings_parse_command_line_arguments(rdpSettings* settings,
 
 			settings->CompressionLevel = (UINT32)val;
 		}
+		CommandLineSwitchCase(arg, "compression-ncrush-mode")
+		{
+			LONGLONG val;
+
+			if (!value_to_int(arg->Value, &val, NCRUSH_MODE_FAST, NCRUSH_MODE_BEST))
+				return COMMAND_LINE_ERROR_UNEXPECTED_VALUE;
+
+			settings->CompressionNCrushMode = (UINT32)val;
+		}
 		CommandLineSwitchCase(arg, "drives")
 		{
 			settings->RedirectDrives = enable;
@@ -2619,6 +2642,13 @@ int freerdp_client_settings_parse_command_line_arguments(rdpSettings* settings,
 			if (enable)
 				settings->SupportGraphicsPipeline = TRUE;
 		}
+		CommandLineSwitchCase(arg, "gfx-parallel-decode")
+		{
+			settings->GfxParallelDecode = enable;
+
+			if (enable)
+				settings->SupportGraphicsPipeline = TRUE;
+		}
 		CommandLineSwitchCase(arg, "gfx-progressive")
 		{
 			settings->GfxProgressive = enable;
@@ -2881,6 +2911,10 @@ int freerdp_client_settings_parse_command_line_arguments(rdpSettings* settings,
 
 			settings->TlsSecLevel = (UINT32)val;
 		}
+		CommandLineSwitchCase(arg, "tls-kernel-offload")
+		{
+			settings->TlsKernelOffload = enable;
+		}
 		CommandLineSwitchCase(arg, "cert")
 		{
 			int rc = 0;
@@ -3,8 +3,251 @@
 #include <winpr/crt.h>
 #include <winpr/windows.h>
 
+#include <freerdp/freerdp.h>
+#include <freerdp/svc.h>
+#include <freerdp/channels/channels.h>
 #include <freerdp/client/channels.h>
 
+#include "../../../libfreerdp/core/rdp.h"
+#include "../../../libfreerdp/core/client.h"
+
+#define TEST_CHANNEL_NAME "teststr"
+#define TEST_CHANNEL_ID 1004
+
+typedef struct
+{
+	CHANNEL_ENTRY_POINTS_FREERDP_EX entryPoints;
+	LPVOID initHandle;
+	DWORD openHandle;
+	wStream* received;
+	size_t messages;
+} TestChannelState;
+
+static BYTE test_channel_byte(size_t offset, BYTE id)
+{
+	return (BYTE)(offset * 13 + id);
+}
+
+static VOID VCAPITYPE test_channel_init_event(LPVOID lpUserParam, LPVOID pInitHandle, UINT event,
+                                              LPVOID pData, UINT dataLength)
+{
+	WINPR_UNUSED(lpUserParam);
+	WINPR_UNUSED(pInitHandle);
+	WINPR_UNUSED(event);
+	WINPR_UNUSED(pData);
+	WINPR_UNUSED(dataLength);
+}
+
+static VOID VCAPITYPE test_channel_open_event(LPVOID lpUserParam, DWORD openHandle, UINT event,
+                                              LPVOID pData, UINT32 dataLength,
+                                              UINT32 totalLength, UINT32 dataFlags)
+{
+	TestChannelState* state = (TestChannelState*)lpUserParam;
+	WINPR_UNUSED(openHandle);
+	WINPR_UNUSED(dataLength);
+	WINPR_UNUSED(totalLength);
+	WINPR_UNUSED(dataFlags);
+
+	if (event != CHANNEL_EVENT_STREAM_RECEIVED)
+		return;
+
+	/* only the last message is kept, the test checks each one before sending the next */
+	freerdp_channels_release_stream(state->received);
+
+	state->received = (wStream*)pData;
+	state->messages++;
+}
+
+static BOOL VCAPITYPE test_channel_entry(PCHANNEL_ENTRY_POINTS_EX pEntryPoints, PVOID pInitHandle)
+{
+	CHANNEL_DEF channelDef = { 0 };
+	PCHANNEL_ENTRY_POINTS_FREERDP_EX pEntryPointsEx;
+	TestChannelState* state;
+	pEntryPointsEx = (PCHANNEL_ENTRY_POINTS_FREERDP_EX)pEntryPoints;
+	state = (TestChannelState*)pEntryPointsEx->pExtendedData;
+
+	state->entryPoints = *pEntryPointsEx;
+	state->initHandle = pInitHandle;
+	strcpy(channelDef.name, TEST_CHANNEL_NAME);
+	return pEntryPointsEx->pVirtualChannelInitEx(state, NULL, pInitHandle, &channelDef, 1,
+	                                             VIRTUAL_CHANNEL_VERSION_WIN2000,
+	                                             test_channel_init_event) == CHANNEL_RC_OK;
+}
+
+/* sends size bytes in chunks of at most chunkSize, announcing totalSize */
+static BOOL test_channel_send(freerdp* instance, BYTE id, size_t size, size_t totalSize,
+                              size_t chunkSize, BOOL first)
+{
+	BOOL rc = TRUE;
+	size_t offset = 0;
+	BYTE* data = malloc(size);
+
+	if (!data)
+		return FALSE;
+
+	for (offset = 0; offset < size; offset++)
+		data[offset] = test_channel_byte(offset, id);
+
+	for (offset = 0; rc && (offset < size); offset += chunkSize)
+	{
+		UINT32 flags = 0;
+		const size_t length = MIN(chunkSize, size - offset);
+
+		if ((offset == 0) && first)
+			flags |= CHANNEL_FLAG_FIRST;
+
+		if (offset + length == size)
+			flags |= CHANNEL_FLAG_LAST;
+
+		rc = freerdp_channels_data(instance, TEST_CHANNEL_ID, &data[offset], length, flags,
+		                           totalSize);
+	}
+
+	free(data);
+	return rc;
+}
+
+/* a complete message arrives as one stream, pooled for sizes the receive pool holds */
+static BOOL test_channel_message(freerdp* instance, TestChannelState* state, BYTE id,
+                                 size_t size, BOOL pooled)
+{
+	size_t offset;
+	const size_t messages = state->messages;
+
+	if (!test_channel_send(instance, id, size, size, CHANNEL_CHUNK_LENGTH, TRUE))
+		return FALSE;
+
+	if ((state->messages != messages + 1) || (Stream_Length(state->received) != size) ||
+	    (Stream_GetPosition(state->received) != 0) || ((state->received->pool != NULL) != pooled))
+	{
+		fprintf(stderr, "message of %" PRIuz " bytes was not delivered as expected\n", size);
+		return FALSE;
+	}
+
+	for (offset = 0; offset < size; offset++)
+	{
+		if (Stream_Buffer(state->received)[offset] != test_channel_byte(offset, id))
+		{
+			fprintf(stderr, "message of %" PRIuz " bytes differs at %" PRIuz "\n", size, offset);
+			return FALSE;
+		}
+	}
+
+	freerdp_channels_release_stream(state->received);
+	state->received = NULL;
+	return TRUE;
+}
+
+static BOOL test_channel_receive_stream(void)
+{
+	BOOL rc = FALSE;
+	freerdp* instance;
+	rdpContext* context = NULL;
+	rdpMcs* mcs;
+	TestChannelState state = { 0 };
+	rdpChannelStatistics statistics = { 0 };
+	const size_t messages[] = { 3000, 20000, 200000 };
+	UINT64 bytes = 0;
+	UINT64 chunks = 0;
+	size_t index;
+
+	if (!(instance = freerdp_new()) || !freerdp_context_new(instance))
+		goto fail;
+
+	context = instance->context;
+
+	if (!freerdp_settings_set_string(context->settings, FreeRDP_ServerHostname, "localhost"))
+		goto fail;
+
+	if (freerdp_channels_client_load_ex(context->channels, context->settings, test_channel_entry,
+	                                    &state) != 0)
+		goto fail;
+
+	mcs = context->rdp->mcs;
+	mcs->channelCount = 1;
+	strcpy(mcs->channels[0].Name, TEST_CHANNEL_NAME);
+	mcs->channels[0].ChannelId = TEST_CHANNEL_ID;
+
+	if ((freerdp_channels_post_connect(context->channels, instance) != CHANNEL_RC_OK) ||
+	    (state.entryPoints.pVirtualChannelOpenEx(state.initHandle, &state.openHandle,
+	                                             TEST_CHANNEL_NAME,
+	                                             test_channel_open_event) != CHANNEL_RC_OK) ||
+	    !freerdp_channels_set_receive_stream(context->channels, state.openHandle, TRUE))
+		goto fail;
+
+	/* below the pool, from the pool and above it */
+	for (index = 0; index < ARRAYSIZE(messages); index++)
+	{
+		if (!test_channel_message(instance, &state, (BYTE)index, messages[index], index == 1))
+			goto fail;
+
+		bytes += messages[index];
+		chunks += (messages[index] + CHANNEL_CHUNK_LENGTH - 1) / CHANNEL_CHUNK_LENGTH;
+	}
+
+	/* a message ending before the announced total size */
+	if (test_channel_send(instance, 0x10, 3000, 4000, CHANNEL_CHUNK_LENGTH, TRUE))
+		goto fail;
+
+	/* a message longer than announced */
+	if (test_channel_send(instance, 0x11, 5000, 4000, CHANNEL_CHUNK_LENGTH, TRUE))
+		goto fail;
+
+	/* chunks of a message whose first chunk got lost */
+	if (test_channel_send(instance, 0x12, 3000, 4000, CHANNEL_CHUNK_LENGTH, FALSE))
+		goto fail;
+
+	if (state.messages != ARRAYSIZE(messages))
+	{
+		fprintf(stderr, "a broken message was delivered\n");
+		goto fail;
+	}
+
+	/* the channel recovers at the next first chunk */
+	if (!test_channel_message(instance, &state, 0x13, 3000, FALSE))
+		goto fail;
+
+	bytes += 3000;
+	chunks += 2;
+
+	if (!freerdp_channels_get_statistics(context->channels, TEST_CHANNEL_NAME, &statistics))
+		goto fail;
+
+	/*
+	 * The short message is received and copied completely, the long one up to the chunk that
+	 * overflows it, the chunk without a first one is received but not copied.
+	 */
+	if ((statistics.ChunksReceived != chunks + 2 + 3 + 1) ||
+	    (statistics.MessagesReceived != ARRAYSIZE(messages) + 1 + 1) ||
+	    (statistics.BytesReceived != bytes + 3000 + 4800 + 1600) ||
+	    (statistics.BytesCopied != bytes + 3000 + 3200))
+	{
+		fprintf(stderr,
+		        "statistics: chunks %" PRIu64 " messages %" PRIu64 " received %" PRIu64
+		        " copied %" PRIu64 "\n",
+		        statistics.ChunksReceived, statistics.MessagesReceived, statistics.BytesReceived,
+		        statistics.BytesCopied);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+
+	if (!rc)
+		fprintf(stderr, "channel receive stream failed\n");
+
+	freerdp_channels_release_stream(state.received);
+
+	if (context)
+	{
+		freerdp_channels_close(context->channels, instance);
+		freerdp_context_free(instance);
+	}
+
+	freerdp_free(instance);
+	return rc;
+}
+
 int TestClientChannels(int argc, char* argv[])
 {
 	int index;
@@ -84,5 +327,8 @@ int TestClientChannels(int argc, char* argv[])
 
 	freerdp_channels_addin_list_free(ppAddins);
 
+	if (!test_channel_receive_stream())
+		return -1;
+
 	return 0;
 }
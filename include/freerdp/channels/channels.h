@@ -33,6 +33,17 @@ extern "C"
 {
 #endif
 
+	struct rdp_channel_statistics
+	{
+		UINT64 ChunksReceived;
+		UINT64 MessagesReceived;
+		UINT64 BytesReceived;
+		UINT64 BytesCopied; /* copied into reassembly buffers by the channel manager */
+		UINT64 MessagesSent;
+		UINT64 BytesSent;
+	};
+	typedef struct rdp_channel_statistics rdpChannelStatistics;
+
 	FREERDP_API int freerdp_channels_client_load(rdpChannels* channels, rdpSettings* settings,
 	                                             PVIRTUALCHANNELENTRY entry, void* data);
 	FREERDP_API int freerdp_channels_client_load_ex(rdpChannels* channels, rdpSettings* settings,
@@ -53,6 +64,12 @@ extern "C"
 	FREERDP_API BOOL freerdp_channels_data(freerdp* instance, UINT16 channelId, const BYTE* data,
 	                                       size_t dataSize, UINT32 flags, size_t totalSize);
 
+	FREERDP_API BOOL freerdp_channels_set_receive_stream(rdpChannels* channels, DWORD openHandle,
+	                                                     BOOL enable);
+	FREERDP_API void freerdp_channels_release_stream(wStream* s);
+	FREERDP_API BOOL freerdp_channels_get_statistics(rdpChannels* channels, const char* name,
+	                                                 rdpChannelStatistics* statistics);
+
 	FREERDP_API UINT16 freerdp_channels_get_id_by_name(freerdp* instance, const char* channel_name);
 	FREERDP_API const char* freerdp_channels_get_name_by_id(freerdp* instance, UINT16 channelId);
 
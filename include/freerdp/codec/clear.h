@@ -33,8 +33,15 @@ extern "C"
 {
 #endif
 
-	FREERDP_API int clear_compress(CLEAR_CONTEXT* clear, const BYTE* pSrcData, UINT32 SrcSize,
-	                               BYTE** ppDstData, UINT32* pDstSize);
+#if !defined(DEFINE_NO_DEPRECATED)
+	FREERDP_API WINPR_DEPRECATED(int clear_compress(CLEAR_CONTEXT* clear, const BYTE* pSrcData,
+	                                                UINT32 SrcSize, BYTE** ppDstData,
+	                                                UINT32* pDstSize));
+#endif
+
+	FREERDP_API int clear_compress_ex(CLEAR_CONTEXT* clear, const BYTE* pSrcData,
+	                                  UINT32 SrcFormat, UINT32 nSrcStep, UINT32 nWidth,
+	                                  UINT32 nHeight, BYTE** ppDstData, UINT32* pDstSize);
 
 	FREERDP_API INT32 clear_decompress(CLEAR_CONTEXT* clear, const BYTE* pSrcData, UINT32 SrcSize,
 	                                   UINT32 nWidth, UINT32 nHeight, BYTE* pDstData,
@@ -23,6 +23,7 @@
 #define FREERDP_CODEC_COLOR_H
 
 #include <freerdp/api.h>
+#include <freerdp/types.h>
 #include <winpr/wlog.h>
 #include <freerdp/log.h>
 #define CTAG FREERDP_TAG("codec.color")
@@ -1000,6 +1001,33 @@ extern "C"
 	                                     UINT32 nSrcStep, UINT32 nXSrc, UINT32 nYSrc,
 	                                     UINT32 nSrcWidth, UINT32 nSrcHeight);
 
+	/***
+	 *
+	 * Updates the part of a scaled image that depends on a changed rectangle of the source,
+	 * scaling changes of a source rectangle by rectangle yields the same image as scaling all
+	 * of it. Both images must use the same 32 bpp format (alpha may differ).
+	 *
+	 * @param pDstData   destination buffer
+	 * @param DstFormat  destination buffer format
+	 * @param nDstStep   destination buffer stride (line in bytes) 0 for default
+	 * @param nDstWidth  width of destination in pixels
+	 * @param nDstHeight height of destination in pixels
+	 * @param pSrcData   source buffer
+	 * @param SrcFormat  source buffer format
+	 * @param nSrcStep   source buffer stride (line in bytes) 0 for default
+	 * @param nSrcWidth  width of source in pixels
+	 * @param nSrcHeight height of source in pixels
+	 * @param rect       in: changed rectangle of the source, out: updated rectangle of the
+	 *                   destination
+	 *
+	 * @return          TRUE if success, FALSE otherwise
+	 */
+	FREERDP_API BOOL freerdp_image_scale_rect(BYTE* pDstData, DWORD DstFormat, UINT32 nDstStep,
+	                                          UINT32 nDstWidth, UINT32 nDstHeight,
+	                                          const BYTE* pSrcData, DWORD SrcFormat,
+	                                          UINT32 nSrcStep, UINT32 nSrcWidth,
+	                                          UINT32 nSrcHeight, RECTANGLE_16* rect);
+
 	/***
 	 *
 	 * @param pDstData  destionation buffer
@@ -25,6 +25,7 @@
 #include <freerdp/api.h>
 #include <freerdp/types.h>
 #include <freerdp/channels/rdpgfx.h>
+#include <freerdp/codec/region.h>
 
 typedef struct _H264_CONTEXT H264_CONTEXT;
 
@@ -48,7 +49,8 @@ typedef struct _H264_CONTEXT_SUBSYSTEM H264_CONTEXT_SUBSYSTEM;
 enum _H264_RATECONTROL_MODE
 {
 	H264_RATECONTROL_VBR = 0,
-	H264_RATECONTROL_CQP
+	H264_RATECONTROL_CQP,
+	H264_RATECONTROL_CBR
 };
 typedef enum _H264_RATECONTROL_MODE H264_RATECONTROL_MODE;
 
@@ -78,6 +80,23 @@ struct _H264_CONTEXT
 
 	void* lumaData;
 	wLog* log;
+
+	/* Splits the RGB to YUV conversion of the compressor into slices */
+	struct _YUV_CONTEXT* yuv;
+
+	/* Kind of frame the YUV planes hold from the last compress call, 0 if none */
+	UINT32 yuvContent;
+
+	/* Macroblock aligned rectangles that changed since the previous frame, set while the
+	 * subsystem compresses a frame. Subsystems may use them as region of interest or skip
+	 * hints, a frame without any change has numChangedRects 0. */
+	const RECTANGLE_16* changedRects;
+	UINT32 numChangedRects;
+
+	/* Highest QP the bitrate modes may use, 0 leaves it to the encoder */
+	UINT32 MaxQP;
+	/* Encode the next frame as IDR frame, the subsystem resets it once done */
+	BOOL ForceIDR;
 };
 #ifdef __cplusplus
 extern "C"
@@ -88,6 +107,11 @@ extern "C"
 	                                  UINT32 nSrcStep, UINT32 nSrcWidth, UINT32 nSrcHeight,
 	                                  BYTE** ppDstData, UINT32* pDstSize);
 
+	FREERDP_API INT32 avc420_compress_region(H264_CONTEXT* h264, const BYTE* pSrcData,
+	                                         DWORD SrcFormat, UINT32 nSrcStep, UINT32 nSrcWidth,
+	                                         UINT32 nSrcHeight, const REGION16* region,
+	                                         BYTE** ppDstData, UINT32* pDstSize);
+
 	FREERDP_API INT32 avc420_decompress(H264_CONTEXT* h264, const BYTE* pSrcData, UINT32 SrcSize,
 	                                    BYTE* pDstData, DWORD DstFormat, UINT32 nDstStep,
 	                                    UINT32 nDstWidth, UINT32 nDstHeight,
@@ -98,6 +122,13 @@ extern "C"
 	                                  BYTE version, BYTE* op, BYTE** pDstData, UINT32* pDstSize,
 	                                  BYTE** pAuxDstData, UINT32* pAuxDstSize);
 
+	FREERDP_API INT32 avc444_compress_region(H264_CONTEXT* h264, const BYTE* pSrcData,
+	                                         DWORD SrcFormat, UINT32 nSrcStep, UINT32 nSrcWidth,
+	                                         UINT32 nSrcHeight, BYTE version,
+	                                         const REGION16* region, BYTE* op, BYTE** pDstData,
+	                                         UINT32* pDstSize, BYTE** pAuxDstData,
+	                                         UINT32* pAuxDstSize);
+
 	FREERDP_API INT32 avc444_decompress(H264_CONTEXT* h264, BYTE op, RECTANGLE_16* regionRects,
 	                                    UINT32 numRegionRect, const BYTE* pSrcData, UINT32 SrcSize,
 	                                    RECTANGLE_16* auxRegionRects, UINT32 numAuxRegionRect,
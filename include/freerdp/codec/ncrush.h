@@ -29,6 +29,14 @@
 
 typedef struct _NCRUSH_CONTEXT NCRUSH_CONTEXT;
 
+enum _NCRUSH_MODE
+{
+	NCRUSH_MODE_FAST,    /** only the most recent match candidate */
+	NCRUSH_MODE_DEFAULT, /** a few match candidates */
+	NCRUSH_MODE_BEST     /** many match candidates and lazy matching */
+};
+typedef enum _NCRUSH_MODE NCRUSH_MODE;
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -40,6 +48,7 @@ extern "C"
 	                                  BYTE** ppDstData, UINT32* pDstSize, UINT32 flags);
 
 	FREERDP_API void ncrush_context_reset(NCRUSH_CONTEXT* ncrush, BOOL flush);
+	FREERDP_API BOOL ncrush_context_set_mode(NCRUSH_CONTEXT* ncrush, NCRUSH_MODE mode);
 
 	FREERDP_API NCRUSH_CONTEXT* ncrush_context_new(BOOL Compressor);
 	FREERDP_API void ncrush_context_free(NCRUSH_CONTEXT* ncrush);
@@ -47,6 +47,14 @@ extern "C"
 	};
 	typedef enum _RLGR_MODE RLGR_MODE;
 
+	enum _RFX_SIMD_LEVEL
+	{
+		RFX_SIMD_GENERIC,  /** plain C routines only */
+		RFX_SIMD_BASELINE, /** SSE2 or NEON routines */
+		RFX_SIMD_AVX2      /** AVX2 routines */
+	};
+	typedef enum _RFX_SIMD_LEVEL RFX_SIMD_LEVEL;
+
 	struct _RFX_RECT
 	{
 		UINT16 x;
@@ -174,10 +182,27 @@ extern "C"
 
 	FREERDP_API void rfx_context_set_pixel_format(RFX_CONTEXT* context, UINT32 pixel_format);
 
+	/**
+	 * Selects the quantization and DWT routines of the context, using the best ones available
+	 * up to the given level. New contexts use the best routines the CPU supports.
+	 *
+	 * @return FALSE if the requested level is not supported by this build or CPU
+	 */
+	FREERDP_API BOOL rfx_context_set_simd_level(RFX_CONTEXT* context, RFX_SIMD_LEVEL level);
+
 	FREERDP_API BOOL rfx_process_message(RFX_CONTEXT* context, const BYTE* data, UINT32 length,
 	                                     UINT32 left, UINT32 top, BYTE* dst, UINT32 dstFormat,
 	                                     UINT32 dstStride, UINT32 dstHeight,
 	                                     REGION16* invalidRegion);
+
+	/**
+	 * Appends the header blocks (sync, codec versions, channels and context) of a message
+	 * to headers. Servers send them only once, a context created later can be set up by
+	 * passing the collected blocks to rfx_process_message.
+	 *
+	 * @return FALSE if the message is malformed or headers could not be grown
+	 */
+	FREERDP_API BOOL rfx_copy_header_blocks(const BYTE* data, UINT32 length, wStream* headers);
 	FREERDP_API UINT16 rfx_message_get_tile_count(RFX_MESSAGE* message);
 	FREERDP_API UINT16 rfx_message_get_rect_count(RFX_MESSAGE* message);
 	FREERDP_API void rfx_message_free(RFX_CONTEXT* context, RFX_MESSAGE* message);
@@ -36,6 +36,19 @@ extern "C"
 	                                    UINT32 iStride[3], DWORD DstFormat, BYTE* dest,
 	                                    UINT32 nDstStep);
 
+	FREERDP_API BOOL yuv420_context_encode(YUV_CONTEXT* context, const BYTE* pSrcData,
+	                                       UINT32 nSrcStep, DWORD SrcFormat,
+	                                       const UINT32 iStride[3], BYTE* pYUVData[3],
+	                                       const RECTANGLE_16* regionRects,
+	                                       UINT32 numRegionRects);
+
+	FREERDP_API BOOL yuv444_context_encode(YUV_CONTEXT* context, BYTE version,
+	                                       const BYTE* pSrcData, UINT32 nSrcStep, DWORD SrcFormat,
+	                                       const UINT32 iStride[3], BYTE* pYUVLumaData[3],
+	                                       BYTE* pYUVChromaData[3],
+	                                       const RECTANGLE_16* regionRects,
+	                                       UINT32 numRegionRects);
+
 	FREERDP_API void yuv_context_reset(YUV_CONTEXT* context, UINT32 width, UINT32 height);
 
 	FREERDP_API YUV_CONTEXT* yuv_context_new(BOOL encoder);
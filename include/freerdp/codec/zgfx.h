@@ -34,6 +34,13 @@
 
 typedef struct _ZGFX_CONTEXT ZGFX_CONTEXT;
 
+typedef enum
+{
+	ZGFX_COMPRESSION_NONE,
+	ZGFX_COMPRESSION_FAST,
+	ZGFX_COMPRESSION_BEST
+} ZGFX_COMPRESSION_MODE;
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -48,6 +55,8 @@ extern "C"
 	                                        UINT32* pFlags);
 
 	FREERDP_API void zgfx_context_reset(ZGFX_CONTEXT* zgfx, BOOL flush);
+	FREERDP_API BOOL zgfx_context_set_compression_mode(ZGFX_CONTEXT* zgfx,
+	                                                   ZGFX_COMPRESSION_MODE mode);
 
 	FREERDP_API ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor);
 	FREERDP_API void zgfx_context_free(ZGFX_CONTEXT* zgfx);
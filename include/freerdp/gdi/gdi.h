@@ -495,6 +495,8 @@ struct gdi_glyph
 };
 typedef struct gdi_glyph gdiGlyph;
 
+typedef struct gdi_gfx_decoder gdiGfxDecoder;
+
 struct rdp_gdi
 {
 	rdpContext* context;
@@ -528,6 +530,7 @@ struct rdp_gdi
 
 	wLog* log;
 	UINT32 frameId;
+	gdiGfxDecoder* gfxDecoder;
 };
 
 #ifdef __cplusplus
@@ -67,6 +67,7 @@ extern "C"
 	                                               pcRdpgfxUnmapWindowForSurface unmap,
 	                                               pcRdpgfxUpdateSurfaceArea update);
 	FREERDP_API void gdi_graphics_pipeline_uninit(rdpGdi* gdi, RdpgfxClientContext* gfx);
+	FREERDP_API UINT gdi_graphics_pipeline_flush(rdpGdi* gdi);
 
 #ifdef __cplusplus
 }
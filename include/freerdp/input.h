@@ -61,6 +61,7 @@ typedef struct rdp_input rdpInput;
 
 /* defined inside libfreerdp-core */
 typedef struct rdp_input_proxy rdpInputProxy;
+typedef struct rdp_input_batch rdpInputBatch;
 
 /* Input Interface */
 
@@ -93,6 +94,7 @@ struct rdp_input
 	BOOL asynchronous;
 	rdpInputProxy* proxy;
 	wMessageQueue* queue;
+	rdpInputBatch* batch;
 };
 
 #ifdef __cplusplus
@@ -113,6 +115,13 @@ extern "C"
 	                                                         UINT16 x, UINT16 y);
 	FREERDP_API BOOL freerdp_input_send_focus_in_event(rdpInput* input, UINT16 toggleStates);
 
+	/**
+	 * Counters of the fast-path input batching (FreeRDP_FastPathInputBatchWindow):
+	 * events sent, mouse moves merged into a later one and PDUs used to send them.
+	 */
+	FREERDP_API BOOL freerdp_input_get_batch_statistics(rdpInput* input, UINT64* events,
+	                                                    UINT64* merged, UINT64* pdus);
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,6 +22,9 @@
 
 #include <freerdp/api.h>
 
+/* indexed by PACKET_COMPR_TYPE_8K ... PACKET_COMPR_TYPE_RDP8 */
+#define METRICS_COMPRESSION_TYPES 5
+
 struct rdp_metrics
 {
 	rdpContext* context;
@@ -29,6 +32,12 @@ struct rdp_metrics
 	UINT64 TotalCompressedBytes;
 	UINT64 TotalUncompressedBytes;
 	double TotalCompressionRatio;
+
+	/* outgoing bulk compression, per compression type */
+	UINT64 CompressPackets[METRICS_COMPRESSION_TYPES];
+	UINT64 CompressUncompressedBytes[METRICS_COMPRESSION_TYPES];
+	UINT64 CompressCompressedBytes[METRICS_COMPRESSION_TYPES];
+	UINT64 CompressTime[METRICS_COMPRESSION_TYPES]; /* microseconds */
 };
 
 #ifdef __cplusplus
@@ -38,6 +47,12 @@ extern "C"
 
 	FREERDP_API double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes,
 	                                       UINT32 CompressedBytes);
+	FREERDP_API double metrics_compress_bytes(rdpMetrics* metrics, UINT32 type,
+	                                          UINT32 UncompressedBytes, UINT32 CompressedBytes,
+	                                          UINT64 usec);
+
+	FREERDP_API double metrics_get_compression_ratio(rdpMetrics* metrics, UINT32 type);
+	FREERDP_API double metrics_get_compression_throughput(rdpMetrics* metrics, UINT32 type);
 
 	FREERDP_API rdpMetrics* metrics_new(rdpContext* context);
 	FREERDP_API void metrics_free(rdpMetrics* metrics);
@@ -140,8 +140,26 @@ typedef pstatus_t (*__RGBToAVC444YUV_t)(const BYTE* pSrc, UINT32 srcFormat, UINT
                                         BYTE* pMainDst[3], const UINT32 dstMainStep[3],
                                         BYTE* pAuxDst[3], const UINT32 dstAuxStep[3],
                                         const prim_size_t* roi);
+typedef pstatus_t (*__RGBToPlanar_8u_AC4P4R_t)(const BYTE* pSrc, INT32 srcStep, UINT32 SrcFormat,
+                                               BYTE* pDst[4], const prim_size_t* roi);
+typedef pstatus_t (*__PlanarToRGB_8u_P4AC4R_t)(const BYTE* const pSrc[4], BYTE* pDst,
+                                               INT32 dstStep, UINT32 DstFormat,
+                                               const prim_size_t* roi);
+typedef pstatus_t (*__planarDeltaEncode_8u_C1R_t)(const BYTE* pSrc, BYTE* pDst, UINT32 width,
+                                                  UINT32 height);
+typedef pstatus_t (*__planarDeltaDecode_8u_C1IR_t)(BYTE* pSrcDst, UINT32 width, UINT32 height);
 typedef pstatus_t (*__andC_32u_t)(const UINT32* pSrc, UINT32 val, UINT32* pDst, INT32 len);
 typedef pstatus_t (*__orC_32u_t)(const UINT32* pSrc, UINT32 val, UINT32* pDst, INT32 len);
+typedef pstatus_t (*__colorFormatConverter_t)(const BYTE* pSrc, UINT32 SrcFormat, INT32 srcStep,
+                                              BYTE* pDst, UINT32 DstFormat, INT32 dstStep,
+                                              UINT32 width, UINT32 height,
+                                              const gdiPalette* palette);
+typedef __colorFormatConverter_t (*__getColorFormatConverter_t)(UINT32 SrcFormat,
+                                                                UINT32 DstFormat);
+typedef pstatus_t (*__bilinearScale_8u_C4R_t)(const BYTE* pSrc, UINT32 srcStep, UINT32 srcWidth,
+                                              UINT32 srcHeight, BYTE* pDst, UINT32 dstStep,
+                                              UINT32 dstWidth, UINT32 dstHeight,
+                                              const RECTANGLE_16* roi);
 typedef pstatus_t (*primitives_uninit_t)(void);
 
 typedef struct
@@ -188,6 +206,16 @@ typedef struct
 	/* flags */
 	DWORD flags;
 	primitives_uninit_t uninit;
+	/* Members added later are appended here to keep the layout of the ones above */
+	/* Planar codec, planes are ordered R, G, B, A */
+	__RGBToPlanar_8u_AC4P4R_t RGBToPlanar_8u_AC4P4R;
+	__PlanarToRGB_8u_P4AC4R_t PlanarToRGB_8u_P4AC4R;
+	__planarDeltaEncode_8u_C1R_t planarDeltaEncode_8u_C1R;
+	__planarDeltaDecode_8u_C1IR_t planarDeltaDecode_8u_C1IR;
+	/* Pixel format conversion of whole images, NULL for unsupported format pairs */
+	__getColorFormatConverter_t getColorFormatConverter;
+	/* Scaling of 32 bpp images, roi is the part of the destination to update */
+	__bilinearScale_8u_C4R_t bilinearScale_8u_C4R;
 } primitives_t;
 
 typedef enum
@@ -48,6 +48,7 @@ typedef struct rdp_shadow_screen rdpShadowScreen;
 typedef struct rdp_shadow_surface rdpShadowSurface;
 typedef struct rdp_shadow_encoder rdpShadowEncoder;
 typedef struct rdp_shadow_capture rdpShadowCapture;
+typedef struct rdp_shadow_encode_cache rdpShadowEncodeCache;
 typedef struct rdp_shadow_subsystem rdpShadowSubsystem;
 typedef struct rdp_shadow_multiclient_event rdpShadowMultiClientEvent;
 
@@ -107,6 +108,10 @@ struct rdp_shadow_client
 	UINT32 pointerX;
 	UINT32 pointerY;
 
+	/* FREERDP_CODEC_* mask usable on the graphics pipeline without H.264 */
+	UINT32 gfxCodecs;
+	BOOL gfxCapsConfirmed;
+
 	HANDLE vcm;
 	EncomspServerContext* encomsp;
 	RemdeskServerContext* remdesk;
@@ -127,6 +132,7 @@ struct rdp_shadow_server
 	rdpShadowSurface* lobby;
 	rdpShadowCapture* capture;
 	rdpShadowSubsystem* subsystem;
+	rdpShadowEncodeCache* encodeCache;
 
 	DWORD port;
 	BOOL mayView;
@@ -142,6 +148,7 @@ struct rdp_shadow_server
 	UINT32 h264BitRate;
 	FLOAT h264FrameRate;
 	UINT32 h264QP;
+	UINT32 gfxCodecs;
 
 	char* ipcSocket;
 	char* ConfigPath;
@@ -165,6 +172,7 @@ struct rdp_shadow_surface
 
 	CRITICAL_SECTION lock;
 	REGION16 invalidRegion;
+	UINT32 generation; /* Incremented for every published frame */
 };
 
 struct _RDP_SHADOW_ENTRY_POINTS
@@ -307,9 +315,15 @@ extern "C"
 	FREERDP_API void shadow_server_free(rdpShadowServer* server);
 
 	FREERDP_API int shadow_capture_align_clip_rect(RECTANGLE_16* rect, RECTANGLE_16* clip);
-	FREERDP_API int shadow_capture_compare(BYTE* pData1, UINT32 nStep1, UINT32 nWidth,
-	                                       UINT32 nHeight, BYTE* pData2, UINT32 nStep2,
-	                                       RECTANGLE_16* rect);
+#if !defined(DEFINE_NO_DEPRECATED)
+	FREERDP_API WINPR_DEPRECATED(int shadow_capture_compare(BYTE* pData1, UINT32 nStep1,
+	                                                        UINT32 nWidth, UINT32 nHeight,
+	                                                        BYTE* pData2, UINT32 nStep2,
+	                                                        RECTANGLE_16* rect));
+#endif
+	FREERDP_API int shadow_capture_compare_ex(const BYTE* pData1, UINT32 nStep1, UINT32 nWidth,
+	                                          UINT32 nHeight, const BYTE* pData2, UINT32 nStep2,
+	                                          BOOL multithreaded, REGION16* region);
 
 	FREERDP_API void shadow_subsystem_frame_update(rdpShadowSubsystem* subsystem);
 
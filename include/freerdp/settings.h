@@ -609,6 +609,8 @@ typedef struct _RDPDR_PARALLEL RDPDR_PARALLEL;
 #define FreeRDP_ForceEncryptedCsPdu (719)
 #define FreeRDP_HiDefRemoteApp (720)
 #define FreeRDP_CompressionLevel (721)
+#define FreeRDP_CompressionAdaptive (722)
+#define FreeRDP_CompressionNCrushMode (723)
 #define FreeRDP_IPv6Enabled (768)
 #define FreeRDP_ClientAddress (769)
 #define FreeRDP_ClientDir (770)
@@ -656,6 +658,7 @@ typedef struct _RDPDR_PARALLEL RDPDR_PARALLEL;
 #define FreeRDP_NtlmSamFile (1103)
 #define FreeRDP_FIPSMode (1104)
 #define FreeRDP_TlsSecLevel (1105)
+#define FreeRDP_TlsKernelOffload (1106)
 #define FreeRDP_MstscCookieMode (1152)
 #define FreeRDP_CookieMaxLength (1153)
 #define FreeRDP_PreconnectionId (1154)
@@ -817,6 +820,7 @@ typedef struct _RDPDR_PARALLEL RDPDR_PARALLEL;
 #define FreeRDP_KeyboardHook (2633)
 #define FreeRDP_HasHorizontalWheel (2634)
 #define FreeRDP_HasExtendedMouseEvent (2635)
+#define FreeRDP_FastPathInputBatchWindow (2636)
 #define FreeRDP_BrushSupportLevel (2688)
 #define FreeRDP_GlyphSupportLevel (2752)
 #define FreeRDP_GlyphCache (2753)
@@ -857,6 +861,7 @@ typedef struct _RDPDR_PARALLEL RDPDR_PARALLEL;
 #define FreeRDP_GfxSendQoeAck (3846)
 #define FreeRDP_GfxAVC444v2 (3847)
 #define FreeRDP_GfxCapsFilter (3848)
+#define FreeRDP_GfxParallelDecode (3849)
 #define FreeRDP_BitmapCacheV3CodecId (3904)
 #define FreeRDP_DrawNineGridEnabled (3968)
 #define FreeRDP_DrawNineGridCacheSize (3969)
@@ -1038,7 +1043,9 @@ struct rdp_settings
 	ALIGN64 BOOL ForceEncryptedCsPdu;    /* 719 */
 	ALIGN64 BOOL HiDefRemoteApp;         /* 720 */
 	ALIGN64 UINT32 CompressionLevel;     /* 721 */
-	UINT64 padding0768[768 - 722];       /* 722 */
+	ALIGN64 BOOL CompressionAdaptive;    /* 722 */
+	ALIGN64 UINT32 CompressionNCrushMode; /* 723 */
+	UINT64 padding0768[768 - 724];       /* 724 */
 
 	/* Client Info (Extra) */
 	ALIGN64 BOOL IPv6Enabled;      /* 768 */
@@ -1107,7 +1114,8 @@ struct rdp_settings
 	ALIGN64 char* NtlmSamFile;                 /* 1103 */
 	ALIGN64 BOOL FIPSMode;                     /* 1104 */
 	ALIGN64 UINT32 TlsSecLevel;                /* 1105 */
-	UINT64 padding1152[1152 - 1106];           /* 1106 */
+	ALIGN64 BOOL TlsKernelOffload;             /* 1106 */
+	UINT64 padding1152[1152 - 1107];           /* 1107 */
 
 	/* Connection Cookie */
 	ALIGN64 BOOL MstscCookieMode;      /* 1152 */
@@ -1341,21 +1349,22 @@ struct rdp_settings
 	UINT64 padding2624[2622 - 2562]; /* 2562 */
 
 	/* Input Capabilities */
-	ALIGN64 char* KeyboardRemappingList; /* 2622 */
-	ALIGN64 UINT32 KeyboardCodePage;    /* 2623 */
-	ALIGN64 UINT32 KeyboardLayout;      /* 2624 */
-	ALIGN64 UINT32 KeyboardType;        /* 2625 */
-	ALIGN64 UINT32 KeyboardSubType;     /* 2626 */
-	ALIGN64 UINT32 KeyboardFunctionKey; /* 2627 */
-	ALIGN64 char* ImeFileName;          /* 2628 */
-	ALIGN64 BOOL UnicodeInput;          /* 2629 */
-	ALIGN64 BOOL FastPathInput;         /* 2630 */
-	ALIGN64 BOOL MultiTouchInput;       /* 2631 */
-	ALIGN64 BOOL MultiTouchGestures;    /* 2632 */
-	ALIGN64 UINT32 KeyboardHook;        /* 2633 */
-	ALIGN64 BOOL HasHorizontalWheel;    /* 2634 */
-	ALIGN64 BOOL HasExtendedMouseEvent; /* 2635 */
-	UINT64 padding2688[2688 - 2636];    /* 2636 */
+	ALIGN64 char* KeyboardRemappingList;     /* 2622 */
+	ALIGN64 UINT32 KeyboardCodePage;         /* 2623 */
+	ALIGN64 UINT32 KeyboardLayout;           /* 2624 */
+	ALIGN64 UINT32 KeyboardType;             /* 2625 */
+	ALIGN64 UINT32 KeyboardSubType;          /* 2626 */
+	ALIGN64 UINT32 KeyboardFunctionKey;      /* 2627 */
+	ALIGN64 char* ImeFileName;               /* 2628 */
+	ALIGN64 BOOL UnicodeInput;               /* 2629 */
+	ALIGN64 BOOL FastPathInput;              /* 2630 */
+	ALIGN64 BOOL MultiTouchInput;            /* 2631 */
+	ALIGN64 BOOL MultiTouchGestures;         /* 2632 */
+	ALIGN64 UINT32 KeyboardHook;             /* 2633 */
+	ALIGN64 BOOL HasHorizontalWheel;         /* 2634 */
+	ALIGN64 BOOL HasExtendedMouseEvent;      /* 2635 */
+	ALIGN64 UINT32 FastPathInputBatchWindow; /* 2636 */
+	UINT64 padding2688[2688 - 2637];         /* 2637 */
 
 	/* Brush Capabilities */
 	ALIGN64 UINT32 BrushSupportLevel; /* 2688 */
@@ -1455,7 +1464,8 @@ struct rdp_settings
 	ALIGN64 BOOL GfxSendQoeAck;      /* 3846 */
 	ALIGN64 BOOL GfxAVC444v2;        /* 3847 */
 	ALIGN64 UINT32 GfxCapsFilter;    /* 3848 */
-	UINT64 padding3904[3904 - 3849]; /* 3849 */
+	ALIGN64 BOOL GfxParallelDecode;  /* 3849 */
+	UINT64 padding3904[3904 - 3850]; /* 3850 */
 
 	/**
 	 * Caches
@@ -30,6 +30,11 @@
 
 #define CHANNEL_EVENT_USER 1000
 
+/* A complete message in a wStream, only sent to channels that enabled it with
+ * freerdp_channels_set_receive_stream. The receiver owns it and returns it with
+ * freerdp_channels_release_stream. */
+#define CHANNEL_EVENT_STREAM_RECEIVED 1001
+
 #define CHANNEL_EXPORT_FUNC_NAME "VirtualChannelEntry"
 #define CHANNEL_EXPORT_FUNC_NAME_EX "VirtualChannelEntryEx"
 
@@ -39,12 +39,45 @@
 
 #define CLEARCODEC_VBAR_SIZE 32768
 #define CLEARCODEC_VBAR_SHORT_SIZE 16384
+#define CLEARCODEC_GLYPH_SIZE 4000
+#define CLEARCODEC_GLYPH_MAX_PIXELS 1024
+#define CLEARCODEC_VBAR_MAX_HEIGHT 52
+
+/* Encoder tiles are at most one vBar high so a tile row maps to a single band */
+#define CLEAR_TILE_WIDTH 64
+#define CLEAR_TILE_HEIGHT CLEARCODEC_VBAR_MAX_HEIGHT
+#define CLEAR_LOOKUP_SIZE 65536
+#define CLEAR_RLEX_MAX_PALETTE 127
+
+enum CLEAR_TILE_MODE
+{
+	CLEAR_TILE_RESIDUAL,
+	CLEAR_TILE_BAND,
+	CLEAR_TILE_RLEX,
+	CLEAR_TILE_NSCODEC,
+	CLEAR_TILE_UNCOMPRESSED
+};
+
+struct _CLEAR_TILE
+{
+	UINT32 x;
+	UINT32 y;
+	UINT32 width;
+	UINT32 height;
+	UINT32 mode;
+	UINT32 background;
+	UINT32 paletteCount;
+	UINT32 palette[CLEAR_RLEX_MAX_PALETTE];
+};
+typedef struct _CLEAR_TILE CLEAR_TILE;
 
 struct _CLEAR_GLYPH_ENTRY
 {
 	UINT32 size;
 	UINT32 count;
 	UINT32* pixels;
+	UINT32 width;
+	UINT32 height;
 };
 typedef struct _CLEAR_GLYPH_ENTRY CLEAR_GLYPH_ENTRY;
 
@@ -66,11 +99,26 @@ struct _CLEAR_CONTEXT
 	UINT32 nTempStep;
 	UINT32 TempFormat;
 	UINT32 format;
-	CLEAR_GLYPH_ENTRY GlyphCache[4000];
+	CLEAR_GLYPH_ENTRY GlyphCache[CLEARCODEC_GLYPH_SIZE];
 	UINT32 VBarStorageCursor;
 	CLEAR_VBAR_ENTRY VBarStorage[CLEARCODEC_VBAR_SIZE];
 	UINT32 ShortVBarStorageCursor;
 	CLEAR_VBAR_ENTRY ShortVBarStorage[CLEARCODEC_VBAR_SHORT_SIZE];
+
+	/* Compressor state, the caches above mirror the decoder side */
+	BYTE* EncodeBuffer;
+	UINT32 EncodeSize;
+	CLEAR_TILE* Tiles;
+	UINT32 TileCount;
+	UINT16* VBarLookup;
+	UINT16* ShortVBarLookup;
+	UINT16* GlyphLookup;
+	UINT32 GlyphCursor;
+	BOOL CacheReset;
+	wStream* ResidualStream;
+	wStream* BandsStream;
+	wStream* SubcodecStream;
+	wStream* NSCodecStream;
 };
 
 static const UINT32 CLEAR_LOG2_FLOOR[256] = {
@@ -932,7 +980,7 @@ static BOOL clear_decompress_glyph_data(CLEAR_CONTEXT* clear, wStream* s, UINT32
 
 	Stream_Read_UINT16(s, glyphIndex);
 
-	if (glyphIndex >= 4000)
+	if (glyphIndex >= CLEARCODEC_GLYPH_SIZE)
 	{
 		WLog_ERR(TAG, "Invalid glyphIndex %" PRIu16 "", glyphIndex);
 		return FALSE;
@@ -1149,18 +1197,873 @@ fail:
 	return rc;
 }
 
+static INLINE UINT32 clear_read_pixel(const BYTE* pixel)
+{
+	return (UINT32)pixel[0] | ((UINT32)pixel[1] << 8) | ((UINT32)pixel[2] << 16);
+}
+
+static INLINE UINT32 clear_get_pixel(const CLEAR_CONTEXT* clear, UINT32 nWidth, UINT32 x, UINT32 y)
+{
+	return clear_read_pixel(&clear->EncodeBuffer[(y * nWidth + x) * 4]);
+}
+
+static INLINE void clear_write_color(wStream* s, UINT32 color)
+{
+	Stream_Write_UINT8(s, color & 0xFF);         /* blue */
+	Stream_Write_UINT8(s, (color >> 8) & 0xFF);  /* green */
+	Stream_Write_UINT8(s, (color >> 16) & 0xFF); /* red */
+}
+
+static INLINE void clear_write_run_length(wStream* s, UINT32 runLength)
+{
+	if (runLength < 0xFF)
+	{
+		Stream_Write_UINT8(s, runLength);
+		return;
+	}
+
+	Stream_Write_UINT8(s, 0xFF);
+
+	if (runLength < 0xFFFF)
+	{
+		Stream_Write_UINT16(s, runLength);
+		return;
+	}
+
+	Stream_Write_UINT16(s, 0xFFFF);
+	Stream_Write_UINT32(s, runLength);
+}
+
+static UINT16 clear_hash_pixels(const UINT32* pixels, UINT32 count, UINT32 seed)
+{
+	UINT32 i;
+	UINT32 hash = 2166136261UL ^ seed;
+
+	for (i = 0; i < count; i++)
+	{
+		hash ^= pixels[i];
+		hash *= 16777619UL;
+	}
+
+	return (UINT16)((hash >> 16) ^ hash);
+}
+
+static BOOL clear_store_vbar(CLEAR_CONTEXT* clear, CLEAR_VBAR_ENTRY* entry, const UINT32* pixels,
+                             UINT32 count)
+{
+	entry->count = count;
+
+	if (!resize_vbar_entry(clear, entry))
+		return FALSE;
+
+	if (count > 0)
+		CopyMemory(entry->pixels, pixels, count * sizeof(UINT32));
+
+	return TRUE;
+}
+
+static INLINE BOOL clear_vbar_equal(const CLEAR_VBAR_ENTRY* entry, const UINT32* pixels,
+                                    UINT32 count)
+{
+	if (entry->count != count)
+		return FALSE;
+
+	return (count == 0) || (memcmp(entry->pixels, pixels, count * sizeof(UINT32)) == 0);
+}
+
+/**
+ * Split rows [yStart, yStart + height) into bands that each start with a text line,
+ * so that repeated glyphs produce identical vBars.
+ */
+static UINT32 clear_split_band_rows(const CLEAR_CONTEXT* clear, UINT32 nWidth, UINT32 xStart,
+                                    UINT32 xEnd, UINT32 yStart, UINT32 height, UINT32 background,
+                                    UINT32* starts)
+{
+	UINT32 x, y;
+	UINT32 count = 0;
+	BOOL prevBlank = FALSE;
+
+	for (y = 0; y < height; y++)
+	{
+		BOOL blank = TRUE;
+
+		for (x = xStart; (x <= xEnd) && blank; x++)
+			blank = (clear_get_pixel(clear, nWidth, x, yStart + y) == background);
+
+		if ((y == 0) || (prevBlank && !blank))
+			starts[count++] = y;
+
+		prevBlank = blank;
+	}
+
+	starts[count] = height;
+	return count;
+}
+
+static void clear_analyze_tile(const CLEAR_CONTEXT* clear, CLEAR_TILE* tile, UINT32 nWidth,
+                               BOOL allowNSCodec)
+{
+	UINT32 x, y, i;
+	UINT32 runs = 0;
+	UINT32 colors = 0;
+	UINT32 bandCost;
+	UINT32 bestCount = 0;
+	UINT32 keys[256];
+	UINT32 band;
+	UINT32 bandCount;
+	UINT32 hashCount;
+	UINT32 bandStarts[CLEAR_TILE_HEIGHT + 1];
+	UINT16 columnHashes[CLEAR_TILE_WIDTH * CLEAR_TILE_HEIGHT];
+	UINT32 counts[256] = { 0 };
+	BOOL used[256] = { 0 };
+	const UINT32 pixelCount = tile->width * tile->height;
+
+	/* Count distinct colors (up to the RLEX limit) and the horizontal runs */
+	for (y = tile->y; y < tile->y + tile->height; y++)
+	{
+		UINT32 prev = 0;
+
+		for (x = tile->x; x < tile->x + tile->width; x++)
+		{
+			const UINT32 color = clear_get_pixel(clear, nWidth, x, y);
+
+			if ((x == tile->x) || (color != prev))
+				runs++;
+
+			prev = color;
+
+			if (colors > CLEAR_RLEX_MAX_PALETTE)
+				continue;
+
+			i = (UINT32)(color * 2654435761U) >> 24;
+
+			while (used[i] && (keys[i] != color))
+				i = (i + 1) & 0xFF;
+
+			if (!used[i])
+			{
+				used[i] = TRUE;
+				keys[i] = color;
+
+				if (colors < CLEAR_RLEX_MAX_PALETTE)
+					tile->palette[colors] = color;
+
+				colors++;
+			}
+
+			if (++counts[i] > bestCount)
+			{
+				bestCount = counts[i];
+				tile->background = color;
+			}
+		}
+	}
+
+	if (colors > CLEAR_RLEX_MAX_PALETTE)
+	{
+		/* Natural image content, only NSCodec is effective here */
+		tile->paletteCount = 0;
+
+		if (allowNSCodec && (runs > pixelCount / 2))
+			tile->mode = CLEAR_TILE_NSCODEC;
+		else if (runs * 4 > pixelCount * 3)
+			tile->mode = CLEAR_TILE_UNCOMPRESSED;
+		else
+			tile->mode = CLEAR_TILE_RESIDUAL;
+
+		return;
+	}
+
+	tile->paletteCount = colors;
+
+	/* Text on a uniform background: vBars only carry the non background span,
+	 * columns already known to the decoder cost a cache index only */
+	bandCount = clear_split_band_rows(clear, nWidth, tile->x, tile->x + tile->width - 1, tile->y,
+	                                  tile->height, tile->background, bandStarts);
+	bandCost = 11 * bandCount;
+	hashCount = 0;
+
+	for (band = 0; band < bandCount; band++)
+	{
+		const UINT32 height = bandStarts[band + 1] - bandStarts[band];
+
+		for (x = tile->x; x < tile->x + tile->width; x++)
+		{
+			UINT32 yOn = height;
+			UINT32 yOff = 0;
+			UINT16 hash;
+			UINT16 vBarIndex;
+			UINT32 column[CLEARCODEC_VBAR_MAX_HEIGHT];
+
+			for (y = 0; y < height; y++)
+			{
+				column[y] = clear_get_pixel(clear, nWidth, x, tile->y + bandStarts[band] + y);
+
+				if (column[y] != tile->background)
+				{
+					yOn = MIN(yOn, y);
+					yOff = y + 1;
+				}
+			}
+
+			hash = clear_hash_pixels(column, height, height);
+			vBarIndex = clear->VBarLookup[hash];
+
+			for (i = 0; i < hashCount; i++)
+			{
+				if (columnHashes[i] == hash)
+					break;
+			}
+
+			if ((i < hashCount) ||
+			    ((vBarIndex > 0) &&
+			     clear_vbar_equal(&clear->VBarStorage[vBarIndex - 1], column, height)))
+				bandCost += 2;
+			else
+			{
+				bandCost += 2 + ((yOff > yOn) ? 3 * (yOff - yOn) : 0);
+				columnHashes[hashCount++] = hash;
+			}
+		}
+	}
+
+	{
+		const UINT32 residualCost = runs * 4;
+		const UINT32 rlexCost = 14 + 3 * colors + 2 * runs;
+
+		if ((residualCost <= bandCost) && (residualCost <= rlexCost))
+			tile->mode = CLEAR_TILE_RESIDUAL;
+		else if (bandCost <= rlexCost)
+			tile->mode = CLEAR_TILE_BAND;
+		else
+			tile->mode = CLEAR_TILE_RLEX;
+	}
+}
+
+static BOOL clear_compress_residual_data(CLEAR_CONTEXT* clear, wStream* s, UINT32 nWidth,
+                                         UINT32 nHeight, UINT32 tilesX)
+{
+	UINT32 x, y;
+	UINT32 runLength = 0;
+	UINT32 runColor = 0;
+
+	for (y = 0; y < nHeight; y++)
+	{
+		const CLEAR_TILE* tiles = &clear->Tiles[(y / CLEAR_TILE_HEIGHT) * tilesX];
+
+		for (x = 0; x < nWidth; x++)
+		{
+			UINT32 color;
+
+			/* Pixels painted by other layers just extend the current run */
+			if ((runLength > 0) && (tiles[x / CLEAR_TILE_WIDTH].mode != CLEAR_TILE_RESIDUAL))
+				color = runColor;
+			else
+				color = clear_get_pixel(clear, nWidth, x, y);
+
+			if ((runLength > 0) && (color == runColor))
+			{
+				runLength++;
+				continue;
+			}
+
+			if (runLength > 0)
+			{
+				if (!Stream_EnsureRemainingCapacity(s, 10))
+					return FALSE;
+
+				clear_write_color(s, runColor);
+				clear_write_run_length(s, runLength);
+			}
+
+			runColor = color;
+			runLength = 1;
+		}
+	}
+
+	if (!Stream_EnsureRemainingCapacity(s, 10))
+		return FALSE;
+
+	clear_write_color(s, runColor);
+	clear_write_run_length(s, runLength);
+	return TRUE;
+}
+
+static BOOL clear_compress_vbar(CLEAR_CONTEXT* clear, wStream* s, const UINT32* column,
+                                UINT32 height, UINT32 background)
+{
+	UINT32 y;
+	UINT16 vBarIndex;
+	UINT32 yOn = 0;
+	UINT32 yOff = 0;
+	UINT16 hash = clear_hash_pixels(column, height, height);
+	CLEAR_VBAR_ENTRY* vBarEntry;
+	CLEAR_VBAR_ENTRY* vBarShortEntry;
+
+	if (!Stream_EnsureRemainingCapacity(s, 3 + height * 3))
+		return FALSE;
+
+	vBarIndex = clear->VBarLookup[hash];
+
+	if ((vBarIndex > 0) && clear_vbar_equal(&clear->VBarStorage[vBarIndex - 1], column, height))
+	{
+		Stream_Write_UINT16(s, 0x8000 | (vBarIndex - 1)); /* VBAR_CACHE_HIT */
+		return TRUE;
+	}
+
+	for (y = 0; y < height; y++)
+	{
+		if (column[y] != background)
+		{
+			if (yOff == 0)
+				yOn = y;
+
+			yOff = y + 1;
+		}
+	}
+
+	if (yOff == 0)
+		yOn = 0;
+
+	hash = clear_hash_pixels(&column[yOn], yOff - yOn, 0);
+	vBarIndex = clear->ShortVBarLookup[hash];
+
+	if ((vBarIndex > 0) &&
+	    clear_vbar_equal(&clear->ShortVBarStorage[vBarIndex - 1], &column[yOn], yOff - yOn))
+	{
+		Stream_Write_UINT16(s, 0x4000 | (vBarIndex - 1)); /* SHORT_VBAR_CACHE_HIT */
+		Stream_Write_UINT8(s, yOn);
+	}
+	else
+	{
+		Stream_Write_UINT16(s, yOn | (yOff << 8)); /* SHORT_VBAR_CACHE_MISS */
+
+		for (y = yOn; y < yOff; y++)
+			clear_write_color(s, column[y]);
+
+		vBarShortEntry = &clear->ShortVBarStorage[clear->ShortVBarStorageCursor];
+
+		if (!clear_store_vbar(clear, vBarShortEntry, &column[yOn], yOff - yOn))
+			return FALSE;
+
+		clear->ShortVBarLookup[hash] = clear->ShortVBarStorageCursor + 1;
+		clear->ShortVBarStorageCursor =
+		    (clear->ShortVBarStorageCursor + 1) % CLEARCODEC_VBAR_SHORT_SIZE;
+	}
+
+	/* Both short vBar variants make the decoder store the full vBar */
+	vBarEntry = &clear->VBarStorage[clear->VBarStorageCursor];
+
+	if (!clear_store_vbar(clear, vBarEntry, column, height))
+		return FALSE;
+
+	clear->VBarLookup[clear_hash_pixels(column, height, height)] = clear->VBarStorageCursor + 1;
+	clear->VBarStorageCursor = (clear->VBarStorageCursor + 1) % CLEARCODEC_VBAR_SIZE;
+	return TRUE;
+}
+
+static BOOL clear_compress_band(CLEAR_CONTEXT* clear, wStream* s, UINT32 nWidth, UINT32 xStart,
+                                UINT32 xEnd, UINT32 yStart, UINT32 yEnd, UINT32 background)
+{
+	UINT32 x, y;
+	UINT32 column[CLEARCODEC_VBAR_MAX_HEIGHT];
+	const UINT32 height = yEnd - yStart + 1;
+
+	if (!Stream_EnsureRemainingCapacity(s, 11))
+		return FALSE;
+
+	Stream_Write_UINT16(s, xStart);
+	Stream_Write_UINT16(s, xEnd);
+	Stream_Write_UINT16(s, yStart);
+	Stream_Write_UINT16(s, yEnd);
+	clear_write_color(s, background);
+
+	for (x = xStart; x <= xEnd; x++)
+	{
+		for (y = 0; y < height; y++)
+			column[y] = clear_get_pixel(clear, nWidth, x, yStart + y);
+
+		if (!clear_compress_vbar(clear, s, column, height, background))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL clear_compress_bands_data(CLEAR_CONTEXT* clear, wStream* s, UINT32 nWidth,
+                                      UINT32 tilesX, UINT32 tilesY)
+{
+	UINT32 tx, ty;
+
+	for (ty = 0; ty < tilesY; ty++)
+	{
+		const CLEAR_TILE* tiles = &clear->Tiles[ty * tilesX];
+
+		for (tx = 0; tx < tilesX; tx++)
+		{
+			UINT32 last = tx;
+
+			if (tiles[tx].mode != CLEAR_TILE_BAND)
+				continue;
+
+			/* Neighbouring band tiles with a common background form one band */
+			while ((last + 1 < tilesX) && (tiles[last + 1].mode == CLEAR_TILE_BAND) &&
+			       (tiles[last + 1].background == tiles[tx].background))
+				last++;
+
+			{
+				UINT32 band;
+				UINT32 bandStarts[CLEAR_TILE_HEIGHT + 1];
+				const UINT32 xStart = tiles[tx].x;
+				const UINT32 xEnd = tiles[last].x + tiles[last].width - 1;
+				const UINT32 bandCount =
+				    clear_split_band_rows(clear, nWidth, xStart, xEnd, tiles[tx].y,
+				                          tiles[tx].height, tiles[tx].background, bandStarts);
+
+				for (band = 0; band < bandCount; band++)
+				{
+					if (!clear_compress_band(clear, s, nWidth, xStart, xEnd,
+					                         tiles[tx].y + bandStarts[band],
+					                         tiles[tx].y + bandStarts[band + 1] - 1,
+					                         tiles[tx].background))
+						return FALSE;
+				}
+			}
+
+			tx = last;
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL clear_compress_subcode_rlex(const CLEAR_CONTEXT* clear, wStream* s,
+                                        const CLEAR_TILE* tile, UINT32 nWidth)
+{
+	UINT32 i;
+	UINT32 x, y;
+	UINT32 pixelIndex = 0;
+	BYTE* indices;
+	BYTE keys[256];
+	BOOL used[256] = { 0 };
+	const UINT32 pixelCount = tile->width * tile->height;
+	const UINT32 numBits = CLEAR_LOG2_FLOOR[tile->paletteCount - 1] + 1;
+	const UINT32 maxSuiteDepth = (1UL << (8 - numBits)) - 1;
+	UINT32 palette[256];
+
+	if (!Stream_EnsureRemainingCapacity(s, 1 + 3 * tile->paletteCount + 8 * pixelCount))
+		return FALSE;
+
+	indices = (BYTE*)malloc(pixelCount);
+
+	if (!indices)
+		return FALSE;
+
+	for (i = 0; i < tile->paletteCount; i++)
+	{
+		UINT32 slot = (UINT32)(tile->palette[i] * 2654435761U) >> 24;
+
+		while (used[slot])
+			slot = (slot + 1) & 0xFF;
+
+		used[slot] = TRUE;
+		palette[slot] = tile->palette[i];
+		keys[slot] = (BYTE)i;
+	}
+
+	for (y = tile->y; y < tile->y + tile->height; y++)
+	{
+		for (x = tile->x; x < tile->x + tile->width; x++)
+		{
+			const UINT32 color = clear_get_pixel(clear, nWidth, x, y);
+			UINT32 slot = (UINT32)(color * 2654435761U) >> 24;
+
+			while (!used[slot] || (palette[slot] != color))
+				slot = (slot + 1) & 0xFF;
+
+			indices[pixelIndex++] = keys[slot];
+		}
+	}
+
+	Stream_Write_UINT8(s, tile->paletteCount);
+
+	for (i = 0; i < tile->paletteCount; i++)
+		clear_write_color(s, tile->palette[i]);
+
+	/* Each segment is a run of the start index followed by an ascending suite */
+	for (pixelIndex = 0; pixelIndex < pixelCount;)
+	{
+		UINT32 runLength = 1;
+		UINT32 suiteDepth = 0;
+		const BYTE startIndex = indices[pixelIndex];
+
+		while ((pixelIndex + runLength < pixelCount) &&
+		       (indices[pixelIndex + runLength] == startIndex))
+			runLength++;
+
+		pixelIndex += runLength;
+
+		while ((suiteDepth < maxSuiteDepth) && (pixelIndex < pixelCount) &&
+		       (indices[pixelIndex] == startIndex + suiteDepth + 1))
+		{
+			suiteDepth++;
+			pixelIndex++;
+		}
+
+		Stream_Write_UINT8(s, (suiteDepth << numBits) | (startIndex + suiteDepth));
+		clear_write_run_length(s, runLength - 1);
+	}
+
+	free(indices);
+	return TRUE;
+}
+
+static BOOL clear_compress_subcodecs_data(CLEAR_CONTEXT* clear, wStream* s, UINT32 nWidth,
+                                          UINT32 tilesX, UINT32 tilesY)
+{
+	UINT32 tx, ty;
+
+	for (ty = 0; ty < tilesY; ty++)
+	{
+		const CLEAR_TILE* tiles = &clear->Tiles[ty * tilesX];
+
+		for (tx = 0; tx < tilesX; tx++)
+		{
+			size_t posHeader;
+			size_t posData;
+			size_t posEnd;
+			BYTE subcodecId;
+			CLEAR_TILE rect = tiles[tx];
+
+			if ((rect.mode == CLEAR_TILE_RESIDUAL) || (rect.mode == CLEAR_TILE_BAND))
+				continue;
+
+			/* NSCodec handles arbitrary sizes, so merge horizontal neighbours */
+			while ((rect.mode == CLEAR_TILE_NSCODEC) && (tx + 1 < tilesX) &&
+			       (tiles[tx + 1].mode == CLEAR_TILE_NSCODEC))
+				rect.width += tiles[++tx].width;
+
+			if (!Stream_EnsureRemainingCapacity(s, 13))
+				return FALSE;
+
+			posHeader = Stream_GetPosition(s);
+			Stream_Seek(s, 13);
+			posData = Stream_GetPosition(s);
+
+			switch (rect.mode)
+			{
+				case CLEAR_TILE_RLEX:
+					subcodecId = 2; /* CLEARCODEC_SUBCODEC_RLEX */
+
+					if (!clear_compress_subcode_rlex(clear, s, &rect, nWidth))
+						return FALSE;
+
+					break;
+
+				case CLEAR_TILE_NSCODEC:
+				{
+					const BYTE* pSrc = &clear->EncodeBuffer[(rect.y * nWidth + rect.x) * 4];
+					Stream_SetPosition(clear->NSCodecStream, 0);
+
+					/* The NSCodec encoder expects bottom-up input */
+					if (!clear_resize_buffer(clear, rect.width, rect.height))
+						return FALSE;
+
+					if (!freerdp_image_copy(clear->TempBuffer, PIXEL_FORMAT_BGRX32, rect.width * 4,
+					                        0, 0, rect.width, rect.height, pSrc,
+					                        PIXEL_FORMAT_BGRX32, nWidth * 4, 0, 0, NULL,
+					                        FREERDP_FLIP_VERTICAL))
+						return FALSE;
+
+					if (!nsc_compose_message(clear->nsc, clear->NSCodecStream, clear->TempBuffer,
+					                         rect.width, rect.height, rect.width * 4))
+						return FALSE;
+
+					if (Stream_GetPosition(clear->NSCodecStream) < rect.width * rect.height * 3)
+					{
+						subcodecId = 1; /* NSCodec */
+
+						if (!Stream_EnsureRemainingCapacity(
+						        s, Stream_GetPosition(clear->NSCodecStream)))
+							return FALSE;
+
+						Stream_Write(s, Stream_Buffer(clear->NSCodecStream),
+						             Stream_GetPosition(clear->NSCodecStream));
+						break;
+					}
+				}
+					/* fallthrough */
+
+				default:
+				{
+					UINT32 x, y;
+					subcodecId = 0; /* Uncompressed */
+
+					if (!Stream_EnsureRemainingCapacity(s, rect.width * rect.height * 3))
+						return FALSE;
+
+					for (y = rect.y; y < rect.y + rect.height; y++)
+					{
+						for (x = rect.x; x < rect.x + rect.width; x++)
+							clear_write_color(s, clear_get_pixel(clear, nWidth, x, y));
+					}
+				}
+				break;
+			}
+
+			posEnd = Stream_GetPosition(s);
+			Stream_SetPosition(s, posHeader);
+			Stream_Write_UINT16(s, rect.x);
+			Stream_Write_UINT16(s, rect.y);
+			Stream_Write_UINT16(s, rect.width);
+			Stream_Write_UINT16(s, rect.height);
+			Stream_Write_UINT32(s, (UINT32)(posEnd - posData)); /* bitmapDataByteCount */
+			Stream_Write_UINT8(s, subcodecId);
+			Stream_SetPosition(s, posEnd);
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL clear_compress_glyph_lookup(CLEAR_CONTEXT* clear, UINT32 nWidth, UINT32 nHeight,
+                                        UINT16* pGlyphIndex)
+{
+	UINT16 glyphIndex;
+	const UINT32* pixels = (const UINT32*)clear->EncodeBuffer;
+	const UINT16 hash = clear_hash_pixels(pixels, nWidth * nHeight, (nWidth << 16) | nHeight);
+	glyphIndex = clear->GlyphLookup[hash];
+
+	if (glyphIndex > 0)
+	{
+		const CLEAR_GLYPH_ENTRY* glyphEntry = &clear->GlyphCache[glyphIndex - 1];
+
+		if ((glyphEntry->width == nWidth) && (glyphEntry->height == nHeight) &&
+		    (memcmp(glyphEntry->pixels, pixels, nWidth * nHeight * sizeof(UINT32)) == 0))
+		{
+			*pGlyphIndex = glyphIndex - 1;
+			return TRUE;
+		}
+	}
+
+	*pGlyphIndex = clear->GlyphCursor;
+	return FALSE;
+}
+
+static BOOL clear_compress_glyph_store(CLEAR_CONTEXT* clear, UINT32 nWidth, UINT32 nHeight,
+                                       UINT16 glyphIndex)
+{
+	const UINT32* pixels = (const UINT32*)clear->EncodeBuffer;
+	CLEAR_GLYPH_ENTRY* glyphEntry = &clear->GlyphCache[glyphIndex];
+	glyphEntry->count = nWidth * nHeight;
+
+	if (glyphEntry->count > glyphEntry->size)
+	{
+		UINT32* tmp = (UINT32*)realloc(glyphEntry->pixels, glyphEntry->count * sizeof(UINT32));
+
+		if (!tmp)
+			return FALSE;
+
+		glyphEntry->size = glyphEntry->count;
+		glyphEntry->pixels = tmp;
+	}
+
+	glyphEntry->width = nWidth;
+	glyphEntry->height = nHeight;
+	CopyMemory(glyphEntry->pixels, pixels, glyphEntry->count * sizeof(UINT32));
+	clear->GlyphLookup[clear_hash_pixels(pixels, nWidth * nHeight, (nWidth << 16) | nHeight)] =
+	    glyphIndex + 1;
+	clear->GlyphCursor = (glyphIndex + 1) % CLEARCODEC_GLYPH_SIZE;
+	return TRUE;
+}
+
+static BOOL clear_compress_prepare(CLEAR_CONTEXT* clear, const BYTE* pSrcData, UINT32 SrcFormat,
+                                   UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight)
+{
+	UINT32 x, y;
+	const UINT32 size = nWidth * nHeight * 4;
+	const UINT32 tileCount = ((nWidth + CLEAR_TILE_WIDTH - 1) / CLEAR_TILE_WIDTH) *
+	                         ((nHeight + CLEAR_TILE_HEIGHT - 1) / CLEAR_TILE_HEIGHT);
+
+	if (size > clear->EncodeSize)
+	{
+		BYTE* tmp = (BYTE*)realloc(clear->EncodeBuffer, size);
+
+		if (!tmp)
+			return FALSE;
+
+		clear->EncodeBuffer = tmp;
+		clear->EncodeSize = size;
+	}
+
+	if (tileCount > clear->TileCount)
+	{
+		CLEAR_TILE* tmp = (CLEAR_TILE*)realloc(clear->Tiles, tileCount * sizeof(CLEAR_TILE));
+
+		if (!tmp)
+			return FALSE;
+
+		clear->Tiles = tmp;
+		clear->TileCount = tileCount;
+	}
+
+	if (!freerdp_image_copy(clear->EncodeBuffer, PIXEL_FORMAT_BGRX32, nWidth * 4, 0, 0, nWidth,
+	                        nHeight, pSrcData, SrcFormat, nSrcStep, 0, 0, NULL, FREERDP_FLIP_NONE))
+		return FALSE;
+
+	/* Clear the unused byte so cache entries can be compared as UINT32 */
+	for (y = 0; y < nHeight; y++)
+	{
+		BYTE* line = &clear->EncodeBuffer[y * nWidth * 4];
+
+		for (x = 0; x < nWidth; x++)
+			line[x * 4 + 3] = 0;
+	}
+
+	return TRUE;
+}
+
 int clear_compress(CLEAR_CONTEXT* clear, const BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData,
                    UINT32* pDstSize)
 {
-	WLog_ERR(TAG, "TODO: %s not implemented!", __FUNCTION__);
+	WLog_ERR(TAG, "%s is deprecated, use clear_compress_ex", __FUNCTION__);
+	return -1;
+}
+
+int clear_compress_ex(CLEAR_CONTEXT* clear, const BYTE* pSrcData, UINT32 SrcFormat,
+                      UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight, BYTE** ppDstData,
+                      UINT32* pDstSize)
+{
+	int rc = -1;
+	UINT32 tx, ty;
+	UINT32 tilesX, tilesY;
+	BYTE glyphFlags = 0;
+	UINT16 glyphIndex = 0;
+	BOOL glyph;
+	BOOL residual = FALSE;
+	wStream* s = NULL;
+
+	if (!clear || !clear->Compressor || !pSrcData || !ppDstData || !pDstSize)
+		return -1;
+
+	if ((nWidth == 0) || (nHeight == 0) || (nWidth > 0xFFFF) || (nHeight > 0xFFFF))
+		return -1;
+
+	if (!clear_compress_prepare(clear, pSrcData, SrcFormat, nSrcStep, nWidth, nHeight))
+		return -1;
+
+	s = Stream_New(NULL, 32 + nWidth * nHeight);
+
+	if (!s)
+		return -1;
+
+	if (clear->CacheReset)
+		glyphFlags |= CLEARCODEC_FLAG_CACHE_RESET;
+
+	glyph = (nWidth * nHeight <= CLEARCODEC_GLYPH_MAX_PIXELS);
+
+	if (glyph)
+	{
+		glyphFlags |= CLEARCODEC_FLAG_GLYPH_INDEX;
+
+		if (clear_compress_glyph_lookup(clear, nWidth, nHeight, &glyphIndex))
+		{
+			glyphFlags |= CLEARCODEC_FLAG_GLYPH_HIT;
+			Stream_Write_UINT8(s, glyphFlags);
+			Stream_Write_UINT8(s, clear->seqNumber);
+			Stream_Write_UINT16(s, glyphIndex);
+			goto finish;
+		}
+	}
+
+	Stream_Write_UINT8(s, glyphFlags);
+	Stream_Write_UINT8(s, clear->seqNumber);
+
+	if (glyph)
+		Stream_Write_UINT16(s, glyphIndex);
+
+	tilesX = (nWidth + CLEAR_TILE_WIDTH - 1) / CLEAR_TILE_WIDTH;
+	tilesY = (nHeight + CLEAR_TILE_HEIGHT - 1) / CLEAR_TILE_HEIGHT;
+
+	for (ty = 0; ty < tilesY; ty++)
+	{
+		for (tx = 0; tx < tilesX; tx++)
+		{
+			CLEAR_TILE* tile = &clear->Tiles[ty * tilesX + tx];
+			tile->x = tx * CLEAR_TILE_WIDTH;
+			tile->y = ty * CLEAR_TILE_HEIGHT;
+			tile->width = MIN(CLEAR_TILE_WIDTH, nWidth - tile->x);
+			tile->height = MIN(CLEAR_TILE_HEIGHT, nHeight - tile->y);
+			/* A cached glyph must decode exactly, so keep glyphs lossless */
+			clear_analyze_tile(clear, tile, nWidth, !glyph);
+
+			if (tile->mode == CLEAR_TILE_RESIDUAL)
+				residual = TRUE;
+		}
+	}
+
+	Stream_SetPosition(clear->ResidualStream, 0);
+	Stream_SetPosition(clear->BandsStream, 0);
+	Stream_SetPosition(clear->SubcodecStream, 0);
+
+	if (residual &&
+	    !clear_compress_residual_data(clear, clear->ResidualStream, nWidth, nHeight, tilesX))
+		goto fail;
+
+	if (!clear_compress_bands_data(clear, clear->BandsStream, nWidth, tilesX, tilesY))
+		goto fail;
+
+	if (!clear_compress_subcodecs_data(clear, clear->SubcodecStream, nWidth, tilesX, tilesY))
+		goto fail;
+
+	if (!Stream_EnsureRemainingCapacity(s, 12 + Stream_GetPosition(clear->ResidualStream) +
+	                                           Stream_GetPosition(clear->BandsStream) +
+	                                           Stream_GetPosition(clear->SubcodecStream)))
+		goto fail;
+
+	Stream_Write_UINT32(s, Stream_GetPosition(clear->ResidualStream)); /* residualByteCount */
+	Stream_Write_UINT32(s, Stream_GetPosition(clear->BandsStream));    /* bandsByteCount */
+	Stream_Write_UINT32(s, Stream_GetPosition(clear->SubcodecStream)); /* subcodecByteCount */
+	Stream_Write(s, Stream_Buffer(clear->ResidualStream),
+	             Stream_GetPosition(clear->ResidualStream));
+	Stream_Write(s, Stream_Buffer(clear->BandsStream), Stream_GetPosition(clear->BandsStream));
+	Stream_Write(s, Stream_Buffer(clear->SubcodecStream),
+	             Stream_GetPosition(clear->SubcodecStream));
+
+	if (glyph && !clear_compress_glyph_store(clear, nWidth, nHeight, glyphIndex))
+		goto fail;
+
+finish:
+	clear->seqNumber = (clear->seqNumber + 1) % 256;
+	clear->CacheReset = FALSE;
+	*pDstSize = (UINT32)Stream_GetPosition(s);
+	*ppDstData = Stream_Buffer(s);
+	Stream_Free(s, FALSE);
 	return 1;
+fail:
+	Stream_Free(s, TRUE);
+	return rc;
 }
+
 BOOL clear_context_reset(CLEAR_CONTEXT* clear)
 {
 	if (!clear)
 		return FALSE;
 
 	clear->seqNumber = 0;
+
+	if (clear->Compressor)
+	{
+		/* Restart both cache cursors and tell the decoder to do the same */
+		clear->VBarStorageCursor = 0;
+		clear->ShortVBarStorageCursor = 0;
+		clear->GlyphCursor = 0;
+		clear->CacheReset = TRUE;
+		ZeroMemory(clear->VBarLookup, CLEAR_LOOKUP_SIZE * sizeof(UINT16));
+		ZeroMemory(clear->ShortVBarLookup, CLEAR_LOOKUP_SIZE * sizeof(UINT16));
+		ZeroMemory(clear->GlyphLookup, CLEAR_LOOKUP_SIZE * sizeof(UINT16));
+	}
+
 	return TRUE;
 }
 CLEAR_CONTEXT* clear_context_new(BOOL Compressor)
@@ -1186,6 +2089,22 @@ CLEAR_CONTEXT* clear_context_new(BOOL Compressor)
 	if (!clear->TempBuffer)
 		goto error_nsc;
 
+	if (Compressor)
+	{
+		clear->VBarLookup = (UINT16*)calloc(CLEAR_LOOKUP_SIZE, sizeof(UINT16));
+		clear->ShortVBarLookup = (UINT16*)calloc(CLEAR_LOOKUP_SIZE, sizeof(UINT16));
+		clear->GlyphLookup = (UINT16*)calloc(CLEAR_LOOKUP_SIZE, sizeof(UINT16));
+		clear->ResidualStream = Stream_New(NULL, 1024);
+		clear->BandsStream = Stream_New(NULL, 1024);
+		clear->SubcodecStream = Stream_New(NULL, 1024);
+		clear->NSCodecStream = Stream_New(NULL, 1024);
+
+		if (!clear->VBarLookup || !clear->ShortVBarLookup || !clear->GlyphLookup ||
+		    !clear->ResidualStream || !clear->BandsStream || !clear->SubcodecStream ||
+		    !clear->NSCodecStream)
+			goto error_nsc;
+	}
+
 	if (!clear_context_reset(clear))
 		goto error_nsc;
 
@@ -1203,14 +2122,23 @@ void clear_context_free(CLEAR_CONTEXT* clear)
 
 	nsc_context_free(clear->nsc);
 	free(clear->TempBuffer);
-
-	for (i = 0; i < 4000; i++)
+	free(clear->EncodeBuffer);
+	free(clear->Tiles);
+	free(clear->VBarLookup);
+	free(clear->ShortVBarLookup);
+	free(clear->GlyphLookup);
+	Stream_Free(clear->ResidualStream, TRUE);
+	Stream_Free(clear->BandsStream, TRUE);
+	Stream_Free(clear->SubcodecStream, TRUE);
+	Stream_Free(clear->NSCodecStream, TRUE);
+
+	for (i = 0; i < CLEARCODEC_GLYPH_SIZE; i++)
 		free(clear->GlyphCache[i].pixels);
 
-	for (i = 0; i < 32768; i++)
+	for (i = 0; i < CLEARCODEC_VBAR_SIZE; i++)
 		free(clear->VBarStorage[i].pixels);
 
-	for (i = 0; i < 16384; i++)
+	for (i = 0; i < CLEARCODEC_VBAR_SHORT_SIZE; i++)
 		free(clear->ShortVBarStorage[i].pixels);
 
 	free(clear);
@@ -28,6 +28,7 @@
 #include <stdlib.h>
 
 #include <winpr/crt.h>
+#include <winpr/synch.h>
 
 #include <freerdp/log.h>
 #include <freerdp/freerdp.h>
@@ -695,6 +696,21 @@ BOOL freerdp_image_copy(BYTE* pDstData, DWORD DstFormat, UINT32 nDstStep, UINT32
 	else
 	{
 		UINT32 x, y;
+		const primitives_t* prims = primitives_get();
+		const __colorFormatConverter_t convert =
+		    prims->getColorFormatConverter(SrcFormat, DstFormat);
+
+		/* Format pairs with a specialized converter are handled as a whole */
+		if (convert && (nSrcStep <= INT32_MAX) && (nDstStep <= INT32_MAX))
+		{
+			const BYTE* srcLine = &pSrcData[nYSrc * nSrcStep * srcVMultiplier + srcVOffset];
+			BYTE* dstLine = &pDstData[nYDst * nDstStep * dstVMultiplier + dstVOffset];
+
+			if (convert(&srcLine[xSrcOffset], SrcFormat, (INT32)nSrcStep * srcVMultiplier,
+			            &dstLine[xDstOffset], DstFormat, (INT32)nDstStep * dstVMultiplier, nWidth,
+			            nHeight, palette) == PRIMITIVES_SUCCESS)
+				return TRUE;
+		}
 
 		for (y = 0; y < nHeight; y++)
 		{
@@ -769,6 +785,215 @@ static int av_format_for_buffer(UINT32 format)
 			return AV_PIX_FMT_NONE;
 	}
 }
+
+/**
+ * Scaler contexts are expensive to set up and callers like the cursor or the output update
+ * paths scale the same sizes over and over again. A context is taken out of the cache while
+ * it is in use, so concurrent callers with equal parameters each get their own one.
+ */
+#define SWS_CONTEXT_CACHE_SIZE 4
+
+typedef struct
+{
+	struct SwsContext* context;
+	int srcWidth;
+	int srcHeight;
+	int srcFormat;
+	int dstWidth;
+	int dstHeight;
+	int dstFormat;
+} SWS_CONTEXT_CACHE_ENTRY;
+
+static INIT_ONCE sws_cache_InitOnce = INIT_ONCE_STATIC_INIT;
+static CRITICAL_SECTION sws_cache_lock;
+static SWS_CONTEXT_CACHE_ENTRY sws_cache[SWS_CONTEXT_CACHE_SIZE];
+static size_t sws_cache_next = 0;
+static BOOL sws_cache_initialized = FALSE;
+
+#if !defined(_WIN32)
+static void sws_cache_uninit(void) __attribute__((destructor));
+#endif
+
+/* Release the cached contexts when the library is unloaded */
+static void sws_cache_uninit(void)
+{
+	size_t x;
+
+	if (!sws_cache_initialized)
+		return;
+
+	for (x = 0; x < ARRAYSIZE(sws_cache); x++)
+	{
+		sws_freeContext(sws_cache[x].context);
+		sws_cache[x].context = NULL;
+	}
+
+	DeleteCriticalSection(&sws_cache_lock);
+	sws_cache_initialized = FALSE;
+}
+
+static BOOL CALLBACK sws_cache_init_cb(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+
+	if (!InitializeCriticalSectionAndSpinCount(&sws_cache_lock, 4000))
+		return FALSE;
+
+	sws_cache_initialized = TRUE;
+#if defined(_WIN32)
+	atexit(sws_cache_uninit);
+#endif
+	return TRUE;
+}
+
+static BOOL sws_cache_entry_equal(const SWS_CONTEXT_CACHE_ENTRY* a,
+                                  const SWS_CONTEXT_CACHE_ENTRY* b)
+{
+	return (a->srcWidth == b->srcWidth) && (a->srcHeight == b->srcHeight) &&
+	       (a->srcFormat == b->srcFormat) && (a->dstWidth == b->dstWidth) &&
+	       (a->dstHeight == b->dstHeight) && (a->dstFormat == b->dstFormat);
+}
+
+static struct SwsContext* sws_cache_take(const SWS_CONTEXT_CACHE_ENTRY* key)
+{
+	size_t x;
+
+	if (!InitOnceExecuteOnce(&sws_cache_InitOnce, sws_cache_init_cb, NULL, NULL))
+		return NULL;
+
+	EnterCriticalSection(&sws_cache_lock);
+
+	for (x = 0; x < ARRAYSIZE(sws_cache); x++)
+	{
+		SWS_CONTEXT_CACHE_ENTRY* entry = &sws_cache[x];
+
+		if (entry->context && sws_cache_entry_equal(entry, key))
+		{
+			struct SwsContext* context = entry->context;
+			entry->context = NULL;
+			LeaveCriticalSection(&sws_cache_lock);
+			return context;
+		}
+	}
+
+	LeaveCriticalSection(&sws_cache_lock);
+	return sws_getContext(key->srcWidth, key->srcHeight, key->srcFormat, key->dstWidth,
+	                      key->dstHeight, key->dstFormat, SWS_BILINEAR, NULL, NULL, NULL);
+}
+
+static void sws_cache_put(const SWS_CONTEXT_CACHE_ENTRY* key, struct SwsContext* context)
+{
+	size_t x;
+	SWS_CONTEXT_CACHE_ENTRY* entry = NULL;
+	struct SwsContext* evicted;
+
+	EnterCriticalSection(&sws_cache_lock);
+
+	for (x = 0; x < ARRAYSIZE(sws_cache); x++)
+	{
+		if (!sws_cache[x].context)
+		{
+			entry = &sws_cache[x];
+			break;
+		}
+	}
+
+	if (!entry)
+	{
+		entry = &sws_cache[sws_cache_next];
+		sws_cache_next = (sws_cache_next + 1) % ARRAYSIZE(sws_cache);
+	}
+
+	evicted = entry->context;
+	*entry = *key;
+	entry->context = context;
+	LeaveCriticalSection(&sws_cache_lock);
+	sws_freeContext(evicted);
+}
+#endif
+
+/* The built in scaler handles 32 bpp images that only differ in alpha */
+static BOOL freerdp_image_scale_native(UINT32 DstFormat, UINT32 SrcFormat)
+{
+	return (GetBytesPerPixel(DstFormat) == 4) && AreColorFormatsEqualNoAlpha(DstFormat, SrcFormat);
+}
+
+#if defined(SWSCALE_FOUND)
+static BOOL freerdp_image_scale_swscale(BYTE* dst, DWORD DstFormat, UINT32 nDstStep,
+                                        UINT32 nDstWidth, UINT32 nDstHeight, const BYTE* src,
+                                        DWORD SrcFormat, UINT32 nSrcStep, UINT32 nSrcWidth,
+                                        UINT32 nSrcHeight)
+{
+	int res;
+	struct SwsContext* resize;
+	const int srcStep[1] = { (int)nSrcStep };
+	const int dstStep[1] = { (int)nDstStep };
+	const SWS_CONTEXT_CACHE_ENTRY key = { NULL,
+		                                  (int)nSrcWidth,
+		                                  (int)nSrcHeight,
+		                                  av_format_for_buffer(SrcFormat),
+		                                  (int)nDstWidth,
+		                                  (int)nDstHeight,
+		                                  av_format_for_buffer(DstFormat) };
+
+	if ((key.srcFormat == AV_PIX_FMT_NONE) || (key.dstFormat == AV_PIX_FMT_NONE))
+		return FALSE;
+
+	resize = sws_cache_take(&key);
+
+	if (!resize)
+		return FALSE;
+
+	res = sws_scale(resize, &src, srcStep, 0, (int)nSrcHeight, &dst, dstStep);
+	sws_cache_put(&key, resize);
+	return res == ((int)nDstHeight);
+}
+#endif
+
+#if defined(CAIRO_FOUND)
+static BOOL freerdp_image_scale_cairo(BYTE* dst, UINT32 nDstStep, UINT32 nDstWidth,
+                                      UINT32 nDstHeight, const BYTE* src, UINT32 nSrcStep,
+                                      UINT32 nSrcWidth, UINT32 nSrcHeight)
+{
+	BOOL rc = FALSE;
+	const double sx = (double)nDstWidth / (double)nSrcWidth;
+	const double sy = (double)nDstHeight / (double)nSrcHeight;
+	cairo_t* cairo_context;
+	cairo_surface_t *csrc, *cdst;
+
+	if ((nSrcWidth > INT_MAX) || (nSrcHeight > INT_MAX) || (nSrcStep > INT_MAX))
+		return FALSE;
+
+	if ((nDstWidth > INT_MAX) || (nDstHeight > INT_MAX) || (nDstStep > INT_MAX))
+		return FALSE;
+
+	csrc = cairo_image_surface_create_for_data((void*)src, CAIRO_FORMAT_ARGB32, (int)nSrcWidth,
+	                                           (int)nSrcHeight, (int)nSrcStep);
+	cdst = cairo_image_surface_create_for_data(dst, CAIRO_FORMAT_ARGB32, (int)nDstWidth,
+	                                           (int)nDstHeight, (int)nDstStep);
+
+	if (!csrc || !cdst)
+		goto fail;
+
+	cairo_context = cairo_create(cdst);
+
+	if (!cairo_context)
+		goto fail2;
+
+	cairo_scale(cairo_context, sx, sy);
+	cairo_set_operator(cairo_context, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cairo_context, csrc, 0, 0);
+	cairo_paint(cairo_context);
+	rc = TRUE;
+fail2:
+	cairo_destroy(cairo_context);
+fail:
+	cairo_surface_destroy(csrc);
+	cairo_surface_destroy(cdst);
+	return rc;
+}
 #endif
 
 BOOL freerdp_image_scale(BYTE* pDstData, DWORD DstFormat, UINT32 nDstStep, UINT32 nXDst,
@@ -776,7 +1001,8 @@ BOOL freerdp_image_scale(BYTE* pDstData, DWORD DstFormat, UINT32 nDstStep, UINT3
                          DWORD SrcFormat, UINT32 nSrcStep, UINT32 nXSrc, UINT32 nYSrc,
                          UINT32 nSrcWidth, UINT32 nSrcHeight)
 {
-	BOOL rc = FALSE;
+	const BYTE* src;
+	BYTE* dst;
 
 	if (nDstStep == 0)
 		nDstStep = nDstWidth * GetBytesPerPixel(DstFormat);
@@ -784,10 +1010,8 @@ BOOL freerdp_image_scale(BYTE* pDstData, DWORD DstFormat, UINT32 nDstStep, UINT3
 	if (nSrcStep == 0)
 		nSrcStep = nSrcWidth * GetBytesPerPixel(SrcFormat);
 
-#if defined(SWSCALE_FOUND) || defined(CAIRO_FOUND)
-	const BYTE* src = &pSrcData[nXSrc * GetBytesPerPixel(SrcFormat) + nYSrc * nSrcStep];
-	BYTE* dst = &pDstData[nXDst * GetBytesPerPixel(DstFormat) + nYDst * nDstStep];
-#endif
+	src = &pSrcData[nXSrc * GetBytesPerPixel(SrcFormat) + nYSrc * nSrcStep];
+	dst = &pDstData[nXDst * GetBytesPerPixel(DstFormat) + nYDst * nDstStep];
 
 	/* direct copy is much faster than scaling, so check if we can simply copy... */
 	if ((nDstWidth == nSrcWidth) && (nDstHeight == nSrcHeight))
@@ -796,72 +1020,88 @@ BOOL freerdp_image_scale(BYTE* pDstData, DWORD DstFormat, UINT32 nDstStep, UINT3
 		                          nDstHeight, pSrcData, SrcFormat, nSrcStep, nXSrc, nYSrc, NULL,
 		                          FREERDP_FLIP_NONE);
 	}
-	else
+
 #if defined(SWSCALE_FOUND)
+	return freerdp_image_scale_swscale(dst, DstFormat, nDstStep, nDstWidth, nDstHeight, src,
+	                                   SrcFormat, nSrcStep, nSrcWidth, nSrcHeight);
+#else
+
+	if (freerdp_image_scale_native(DstFormat, SrcFormat))
 	{
-		int res;
-		struct SwsContext* resize;
-		int srcFormat = av_format_for_buffer(SrcFormat);
-		int dstFormat = av_format_for_buffer(DstFormat);
-		const int srcStep[1] = { (int)nSrcStep };
-		const int dstStep[1] = { (int)nDstStep };
-
-		if ((srcFormat == AV_PIX_FMT_NONE) || (dstFormat == AV_PIX_FMT_NONE))
-			return FALSE;
+		const primitives_t* prims = primitives_get();
+		return prims->bilinearScale_8u_C4R(src, nSrcStep, nSrcWidth, nSrcHeight, dst, nDstStep,
+		                                   nDstWidth, nDstHeight, NULL) == PRIMITIVES_SUCCESS;
+	}
 
-		resize = sws_getContext((int)nSrcWidth, (int)nSrcHeight, srcFormat, (int)nDstWidth,
-		                        (int)nDstHeight, dstFormat, SWS_BILINEAR, NULL, NULL, NULL);
+#if defined(CAIRO_FOUND)
+	return freerdp_image_scale_cairo(dst, nDstStep, nDstWidth, nDstHeight, src, nSrcStep,
+	                                 nSrcWidth, nSrcHeight);
+#else
+	WLog_WARN(TAG, "Scaling from %s to %s requires libswscale or libcairo support!",
+	          FreeRDPGetColorFormatName(SrcFormat), FreeRDPGetColorFormatName(DstFormat));
+	return FALSE;
+#endif
+#endif
+}
 
-		if (!resize)
-			goto fail;
+/* Destination pixels [*dstStart, *dstEnd) that sample source pixels [srcStart, srcEnd) */
+static void freerdp_image_scale_span(UINT32 srcStart, UINT32 srcEnd, UINT32 srcSize,
+                                     UINT32 dstSize, UINT32* dstStart, UINT32* dstEnd)
+{
+	/* a destination pixel samples two neighbours, one pixel of margin covers the rounding */
+	const UINT64 start = (srcStart > 0) ? (srcStart - 1ULL) * dstSize / srcSize : 0;
+	const UINT64 end = ((srcEnd + 1ULL) * dstSize + srcSize - 1) / srcSize + 1;
+	*dstStart = (start > 0) ? (UINT32)(start - 1) : 0;
+	*dstEnd = (UINT32)MIN(end, dstSize);
+}
 
-		res = sws_scale(resize, &src, srcStep, 0, (int)nSrcHeight, &dst, dstStep);
-		rc = (res == ((int)nDstHeight));
-	fail:
-		sws_freeContext(resize);
-	}
+BOOL freerdp_image_scale_rect(BYTE* pDstData, DWORD DstFormat, UINT32 nDstStep, UINT32 nDstWidth,
+                              UINT32 nDstHeight, const BYTE* pSrcData, DWORD SrcFormat,
+                              UINT32 nSrcStep, UINT32 nSrcWidth, UINT32 nSrcHeight,
+                              RECTANGLE_16* rect)
+{
+	UINT32 left, top, right, bottom;
+	RECTANGLE_16 roi;
+	const primitives_t* prims = primitives_get();
 
-#elif defined(CAIRO_FOUND)
-	{
-		const double sx = (double)nDstWidth / (double)nSrcWidth;
-		const double sy = (double)nDstHeight / (double)nSrcHeight;
-		cairo_t* cairo_context;
-		cairo_surface_t *csrc, *cdst;
+	if (!pDstData || !pSrcData || !rect || !freerdp_image_scale_native(DstFormat, SrcFormat))
+		return FALSE;
 
-		if ((nSrcWidth > INT_MAX) || (nSrcHeight > INT_MAX) || (nSrcStep > INT_MAX))
-			return FALSE;
+	if ((nSrcWidth == 0) || (nSrcHeight == 0) || (nDstWidth > UINT16_MAX) ||
+	    (nDstHeight > UINT16_MAX))
+		return FALSE;
 
-		if ((nDstWidth > INT_MAX) || (nDstHeight > INT_MAX) || (nDstStep > INT_MAX))
-			return FALSE;
+	if ((rect->left >= rect->right) || (rect->top >= rect->bottom) ||
+	    (rect->right > nSrcWidth) || (rect->bottom > nSrcHeight))
+		return FALSE;
 
-		csrc = cairo_image_surface_create_for_data((void*)src, CAIRO_FORMAT_ARGB32, (int)nSrcWidth,
-		                                           (int)nSrcHeight, (int)nSrcStep);
-		cdst = cairo_image_surface_create_for_data(dst, CAIRO_FORMAT_ARGB32, (int)nDstWidth,
-		                                           (int)nDstHeight, (int)nDstStep);
-
-		if (!csrc || !cdst)
-			goto fail;
-
-		cairo_context = cairo_create(cdst);
-
-		if (!cairo_context)
-			goto fail2;
-
-		cairo_scale(cairo_context, sx, sy);
-		cairo_set_operator(cairo_context, CAIRO_OPERATOR_SOURCE);
-		cairo_set_source_surface(cairo_context, csrc, 0, 0);
-		cairo_paint(cairo_context);
-		rc = TRUE;
-	fail2:
-		cairo_destroy(cairo_context);
-	fail:
-		cairo_surface_destroy(csrc);
-		cairo_surface_destroy(cdst);
-	}
-#else
-	{
-		WLog_WARN(TAG, "SmartScaling requested but compiled without libcairo support!");
-	}
-#endif
-	return rc;
+	if (nDstStep == 0)
+		nDstStep = nDstWidth * 4;
+
+	if (nSrcStep == 0)
+		nSrcStep = nSrcWidth * 4;
+
+	if ((nDstWidth == nSrcWidth) && (nDstHeight == nSrcHeight))
+		return freerdp_image_copy(pDstData, DstFormat, nDstStep, rect->left, rect->top,
+		                          rect->right - rect->left, rect->bottom - rect->top, pSrcData,
+		                          SrcFormat, nSrcStep, rect->left, rect->top, NULL,
+		                          FREERDP_FLIP_NONE);
+
+	freerdp_image_scale_span(rect->left, rect->right, nSrcWidth, nDstWidth, &left, &right);
+	freerdp_image_scale_span(rect->top, rect->bottom, nSrcHeight, nDstHeight, &top, &bottom);
+
+	if ((left >= right) || (top >= bottom))
+		return FALSE;
+
+	roi.left = (UINT16)left;
+	roi.top = (UINT16)top;
+	roi.right = (UINT16)right;
+	roi.bottom = (UINT16)bottom;
+
+	if (prims->bilinearScale_8u_C4R(pSrcData, nSrcStep, nSrcWidth, nSrcHeight, pDstData, nDstStep,
+	                                nDstWidth, nDstHeight, &roi) != PRIMITIVES_SUCCESS)
+		return FALSE;
+
+	*rect = roi;
+	return TRUE;
 }
@@ -30,12 +30,22 @@
 
 #include <freerdp/primitives.h>
 #include <freerdp/codec/h264.h>
+#include <freerdp/codec/yuv.h>
 #include <freerdp/log.h>
 
 #include "h264.h"
 
 #define TAG FREERDP_TAG("codec")
 
+/* What the YUV planes hold after a compress call, a region only updates the same kind */
+enum
+{
+	H264_YUV_CONTENT_NONE = 0,
+	H264_YUV_CONTENT_AVC420,
+	H264_YUV_CONTENT_AVC444v1,
+	H264_YUV_CONTENT_AVC444v2
+};
+
 static BOOL avc444_ensure_buffer(H264_CONTEXT* h264, DWORD nDstHeight);
 
 BOOL avc420_ensure_buffer(H264_CONTEXT* h264, UINT32 stride, UINT32 width, UINT32 height)
@@ -60,6 +70,7 @@ BOOL avc420_ensure_buffer(H264_CONTEXT* h264, UINT32 stride, UINT32 width, UINT3
 		h264->iStride[2] = (stride + 1) / 2;
 		h264->width = width;
 		h264->height = height;
+		h264->yuvContent = H264_YUV_CONTENT_NONE;
 		_aligned_free(h264->pYUVData[0]);
 		_aligned_free(h264->pYUVData[1]);
 		_aligned_free(h264->pYUVData[2]);
@@ -189,11 +200,84 @@ INT32 avc420_decompress(H264_CONTEXT* h264, const BYTE* pSrcData, UINT32 SrcSize
 	return 1;
 }
 
+/**
+ * Collects the macroblocks touched by region, clamped to the frame, in changed.
+ * Without a region or when the YUV planes do not hold the previous frame of the
+ * same kind all of the frame has changed. fullRows extends every rectangle to
+ * the complete macroblock rows it touches. So does a width that is no multiple of
+ * 16: the optimized RGB to YUV primitives leave such rows to the generic ones,
+ * which round slightly different, and a partial row would not match a full one.
+ */
+static BOOL h264_get_changed_region(const H264_CONTEXT* h264, UINT32 content,
+                                    const REGION16* region, UINT32 width, UINT32 height,
+                                    BOOL fullRows, REGION16* changed)
+{
+	UINT32 x;
+	UINT32 nbRects = 0;
+	const RECTANGLE_16* rects;
+
+	if (!region || (h264->yuvContent != content))
+	{
+		const RECTANGLE_16 frame = { 0, 0, (UINT16)width, (UINT16)height };
+		return region16_union_rect(changed, changed, &frame);
+	}
+
+	rects = region16_rects(region, &nbRects);
+	fullRows = fullRows || (width % 16 != 0);
+
+	for (x = 0; x < nbRects; x++)
+	{
+		const RECTANGLE_16* rect = &rects[x];
+		RECTANGLE_16 mb;
+		mb.left = fullRows ? 0 : (rect->left & ~15);
+		mb.top = rect->top & ~15;
+		mb.right = (UINT16)(fullRows ? width : MIN(width, (rect->right + 15UL) & ~15UL));
+		mb.bottom = (UINT16)MIN(height, (rect->bottom + 15UL) & ~15UL);
+
+		/* rectangles outside of the frame */
+		if ((mb.left >= mb.right) || (mb.top >= mb.bottom))
+			continue;
+
+		if (!region16_union_rect(changed, changed, &mb))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static INT32 h264_compress_changed(H264_CONTEXT* h264, BYTE** pYUVData, const REGION16* changed,
+                                   BYTE** ppDstData, UINT32* pDstSize)
+{
+	INT32 rc;
+	const BYTE* pSrcYUV[3] = { pYUVData[0], pYUVData[1], pYUVData[2] };
+	h264->changedRects = region16_rects(changed, &h264->numChangedRects);
+	rc = h264->subsystem->Compress(h264, pSrcYUV, h264->iStride, ppDstData, pDstSize);
+	h264->changedRects = NULL;
+	h264->numChangedRects = 0;
+	return rc;
+}
+
 INT32 avc420_compress(H264_CONTEXT* h264, const BYTE* pSrcData, DWORD SrcFormat, UINT32 nSrcStep,
                       UINT32 nSrcWidth, UINT32 nSrcHeight, BYTE** ppDstData, UINT32* pDstSize)
 {
-	prim_size_t roi;
-	primitives_t* prims = primitives_get();
+	return avc420_compress_region(h264, pSrcData, SrcFormat, nSrcStep, nSrcWidth, nSrcHeight,
+	                              NULL, ppDstData, pDstSize);
+}
+
+/**
+ * Compresses a frame of which only region changed since the previous call with
+ * the same context. The YUV planes keep the previous frame, so only the
+ * macroblocks touched by region are converted again. A NULL region converts
+ * all of the frame.
+ */
+INT32 avc420_compress_region(H264_CONTEXT* h264, const BYTE* pSrcData, DWORD SrcFormat,
+                             UINT32 nSrcStep, UINT32 nSrcWidth, UINT32 nSrcHeight,
+                             const REGION16* region, BYTE** ppDstData, UINT32* pDstSize)
+{
+	INT32 rc = -1;
+	UINT32 nbRects;
+	const RECTANGLE_16* rects;
+	REGION16 changed;
 
 	if (!h264)
 		return -1;
@@ -204,25 +288,50 @@ INT32 avc420_compress(H264_CONTEXT* h264, const BYTE* pSrcData, DWORD SrcFormat,
 	if (!avc420_ensure_buffer(h264, nSrcStep, nSrcWidth, nSrcHeight))
 		return -1;
 
-	roi.width = nSrcWidth;
-	roi.height = nSrcHeight;
+	region16_init(&changed);
 
-	if (prims->RGBToYUV420_8u_P3AC4R(pSrcData, SrcFormat, nSrcStep, h264->pYUVData, h264->iStride,
-	                                 &roi) != PRIMITIVES_SUCCESS)
-		return -1;
+	if (!h264_get_changed_region(h264, H264_YUV_CONTENT_AVC420, region, nSrcWidth, nSrcHeight,
+	                             FALSE, &changed))
+		goto fail;
 
-	{
-		const BYTE* pYUVData[3] = { h264->pYUVData[0], h264->pYUVData[1], h264->pYUVData[2] };
-		return h264->subsystem->Compress(h264, pYUVData, h264->iStride, ppDstData, pDstSize);
-	}
+	/* The planes are only partially up to date until all rectangles are converted */
+	h264->yuvContent = H264_YUV_CONTENT_NONE;
+	rects = region16_rects(&changed, &nbRects);
+	yuv_context_reset(h264->yuv, nSrcWidth, nSrcHeight);
+
+	if (!yuv420_context_encode(h264->yuv, pSrcData, nSrcStep, SrcFormat, h264->iStride,
+	                           h264->pYUVData, rects, nbRects))
+		goto fail;
+
+	h264->yuvContent = H264_YUV_CONTENT_AVC420;
+	rc = h264_compress_changed(h264, h264->pYUVData, &changed, ppDstData, pDstSize);
+fail:
+	region16_uninit(&changed);
+	return rc;
 }
 
 INT32 avc444_compress(H264_CONTEXT* h264, const BYTE* pSrcData, DWORD SrcFormat, UINT32 nSrcStep,
                       UINT32 nSrcWidth, UINT32 nSrcHeight, BYTE version, BYTE* op, BYTE** ppDstData,
                       UINT32* pDstSize, BYTE** ppAuxDstData, UINT32* pAuxDstSize)
 {
-	prim_size_t roi;
-	primitives_t* prims = primitives_get();
+	return avc444_compress_region(h264, pSrcData, SrcFormat, nSrcStep, nSrcWidth, nSrcHeight,
+	                              version, NULL, op, ppDstData, pDstSize, ppAuxDstData,
+	                              pAuxDstSize);
+}
+
+/**
+ * AVC444 counterpart of avc420_compress_region, both views are updated
+ * from the macroblocks touched by region.
+ */
+INT32 avc444_compress_region(H264_CONTEXT* h264, const BYTE* pSrcData, DWORD SrcFormat,
+                             UINT32 nSrcStep, UINT32 nSrcWidth, UINT32 nSrcHeight, BYTE version,
+                             const REGION16* region, BYTE* op, BYTE** ppDstData, UINT32* pDstSize,
+                             BYTE** ppAuxDstData, UINT32* pAuxDstSize)
+{
+	INT32 rc = -1;
+	UINT32 nbRects, content;
+	const RECTANGLE_16* rects;
+	REGION16 changed;
 	BYTE* coded;
 	UINT32 codedSize;
 
@@ -232,58 +341,59 @@ INT32 avc444_compress(H264_CONTEXT* h264, const BYTE* pSrcData, DWORD SrcFormat,
 	if (!h264->subsystem->Compress)
 		return -1;
 
-	if (!avc420_ensure_buffer(h264, nSrcStep, nSrcWidth, nSrcHeight))
-		return -1;
-
-	if (!avc444_ensure_buffer(h264, nSrcHeight))
-		return -1;
-
-	roi.width = nSrcWidth;
-	roi.height = nSrcHeight;
-
 	switch (version)
 	{
 		case 1:
-			if (prims->RGBToAVC444YUV(pSrcData, SrcFormat, nSrcStep, h264->pYUV444Data,
-			                          h264->iStride, h264->pYUVData, h264->iStride,
-			                          &roi) != PRIMITIVES_SUCCESS)
-				return -1;
-
+			content = H264_YUV_CONTENT_AVC444v1;
 			break;
 
 		case 2:
-			if (prims->RGBToAVC444YUVv2(pSrcData, SrcFormat, nSrcStep, h264->pYUV444Data,
-			                            h264->iStride, h264->pYUVData, h264->iStride,
-			                            &roi) != PRIMITIVES_SUCCESS)
-				return -1;
-
+			content = H264_YUV_CONTENT_AVC444v2;
 			break;
 
 		default:
 			return -1;
 	}
 
-	{
-		const BYTE* pYUV444Data[3] = { h264->pYUV444Data[0], h264->pYUV444Data[1],
-			                           h264->pYUV444Data[2] };
+	if (!avc420_ensure_buffer(h264, nSrcStep, nSrcWidth, nSrcHeight))
+		return -1;
 
-		if (h264->subsystem->Compress(h264, pYUV444Data, h264->iStride, &coded, &codedSize) < 0)
-			return -1;
-	}
+	if (!avc444_ensure_buffer(h264, nSrcHeight))
+		return -1;
+
+	region16_init(&changed);
+
+	if (!h264_get_changed_region(h264, content, region, nSrcWidth, nSrcHeight, version == 2,
+	                             &changed))
+		goto fail;
+
+	h264->yuvContent = H264_YUV_CONTENT_NONE;
+	rects = region16_rects(&changed, &nbRects);
+	yuv_context_reset(h264->yuv, nSrcWidth, nSrcHeight);
+
+	if (!yuv444_context_encode(h264->yuv, version, pSrcData, nSrcStep, SrcFormat, h264->iStride,
+	                           h264->pYUV444Data, h264->pYUVData, rects, nbRects))
+		goto fail;
+
+	h264->yuvContent = content;
+
+	if (h264_compress_changed(h264, h264->pYUV444Data, &changed, &coded, &codedSize) < 0)
+		goto fail;
 
 	memcpy(h264->lumaData, coded, codedSize);
 	*ppDstData = h264->lumaData;
 	*pDstSize = codedSize;
-	{
-		const BYTE* pYUVData[3] = { h264->pYUVData[0], h264->pYUVData[1], h264->pYUVData[2] };
 
-		if (h264->subsystem->Compress(h264, pYUVData, h264->iStride, &coded, &codedSize) < 0)
-			return -1;
-	}
+	if (h264_compress_changed(h264, h264->pYUVData, &changed, &coded, &codedSize) < 0)
+		goto fail;
+
 	*ppAuxDstData = coded;
 	*pAuxDstSize = codedSize;
 	*op = 0;
-	return 0;
+	rc = 0;
+fail:
+	region16_uninit(&changed);
+	return rc;
 }
 
 static BOOL avc444_ensure_buffer(H264_CONTEXT* h264, DWORD nDstHeight)
@@ -301,6 +411,8 @@ static BOOL avc444_ensure_buffer(H264_CONTEXT* h264, DWORD nDstHeight)
 
 	if ((piMainStride[0] != piDstStride[0]) || (piDstSize[0] != piMainStride[0] * padDstHeight))
 	{
+		h264->yuvContent = H264_YUV_CONTENT_NONE;
+
 		for (x = 0; x < 3; x++)
 		{
 			piDstStride[x] = piMainStride[0];
@@ -563,6 +675,7 @@ BOOL h264_context_reset(H264_CONTEXT* h264, UINT32 width, UINT32 height)
 
 	h264->width = width;
 	h264->height = height;
+	h264->yuvContent = H264_YUV_CONTENT_NONE;
 	return TRUE;
 }
 
@@ -580,10 +693,20 @@ H264_CONTEXT* h264_context_new(BOOL Compressor)
 			/* Default compressor settings, may be changed by caller */
 			h264->BitRate = 1000000;
 			h264->FrameRate = 30;
+			h264->yuv = yuv_context_new(TRUE);
+
+			if (!h264->yuv)
+			{
+				free(h264);
+				return NULL;
+			}
 		}
 
 		if (!h264_context_init(h264))
 		{
+			if (h264->yuv)
+				yuv_context_free(h264->yuv);
+
 			free(h264);
 			return NULL;
 		}
@@ -601,6 +724,10 @@ void h264_context_free(H264_CONTEXT* h264)
 		_aligned_free(h264->pYUV444Data[1]);
 		_aligned_free(h264->pYUV444Data[2]);
 		_aligned_free(h264->lumaData);
+
+		if (h264->yuv)
+			yuv_context_free(h264->yuv);
+
 		free(h264);
 	}
 }
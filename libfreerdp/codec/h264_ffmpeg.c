@@ -78,6 +78,9 @@ struct _H264_CONTEXT_LIBAVCODEC
 	AVCodecParserContext* codecParser;
 	AVFrame* videoFrame;
 	AVPacket packet;
+	H264_RATECONTROL_MODE RateControlMode;
+	UINT32 QP;
+	UINT32 MaxQP;
 #ifdef WITH_VAAPI
 	AVBufferRef* hwctx;
 	AVFrame* hwVideoFrame;
@@ -112,6 +115,39 @@ static void libavcodec_destroy_encoder(H264_CONTEXT* h264)
 	sys->codecEncoderContext = NULL;
 }
 
+/* Bitrate changes are picked up by the running encoder, everything else needs a new one */
+static void libavcodec_set_rate_control(H264_CONTEXT* h264, AVCodecContext* codecContext)
+{
+	switch (h264->RateControlMode)
+	{
+		case H264_RATECONTROL_VBR:
+			codecContext->bit_rate = h264->BitRate;
+			break;
+
+		case H264_RATECONTROL_CBR:
+			codecContext->bit_rate = h264->BitRate;
+			codecContext->rc_max_rate = h264->BitRate;
+
+			/* A buffer of one frame keeps the encoder from queueing up bursts */
+			if (h264->FrameRate >= 1.0f)
+				codecContext->rc_buffer_size = (int)(h264->BitRate / h264->FrameRate);
+
+			break;
+
+		case H264_RATECONTROL_CQP:
+			codecContext->qmin = (int)h264->QP;
+			codecContext->qmax = (int)h264->QP;
+			av_opt_set_int(codecContext, "qp", h264->QP, AV_OPT_SEARCH_CHILDREN);
+			break;
+
+		default:
+			break;
+	}
+
+	if ((h264->RateControlMode != H264_RATECONTROL_CQP) && (h264->MaxQP != 0))
+		codecContext->qmax = (int)h264->MaxQP;
+}
+
 static BOOL libavcodec_create_encoder(H264_CONTEXT* h264)
 {
 	BOOL recreate = FALSE;
@@ -123,6 +159,9 @@ static BOOL libavcodec_create_encoder(H264_CONTEXT* h264)
 	if ((h264->width > INT_MAX) || (h264->height > INT_MAX))
 		return FALSE;
 
+	if ((h264->BitRate > INT_MAX) || (h264->QP > INT_MAX) || (h264->MaxQP > INT_MAX))
+		return FALSE;
+
 	sys = (H264_CONTEXT_LIBAVCODEC*)h264->pSystemData;
 	recreate = !sys->codecEncoder || !sys->codecEncoderContext;
 
@@ -131,10 +170,19 @@ static BOOL libavcodec_create_encoder(H264_CONTEXT* h264)
 		if ((sys->codecEncoderContext->width != (int)h264->width) ||
 		    (sys->codecEncoderContext->height != (int)h264->height))
 			recreate = TRUE;
+
+		if ((sys->RateControlMode != h264->RateControlMode) || (sys->MaxQP != h264->MaxQP))
+			recreate = TRUE;
+
+		if ((h264->RateControlMode == H264_RATECONTROL_CQP) && (sys->QP != h264->QP))
+			recreate = TRUE;
 	}
 
 	if (!recreate)
+	{
+		libavcodec_set_rate_control(h264, sys->codecEncoderContext);
 		return TRUE;
+	}
 
 	libavcodec_destroy_encoder(h264);
 	sys->codecEncoder = avcodec_find_encoder(AV_CODEC_ID_H264);
@@ -147,20 +195,9 @@ static BOOL libavcodec_create_encoder(H264_CONTEXT* h264)
 	if (!sys->codecEncoderContext)
 		goto EXCEPTION;
 
-	switch (h264->RateControlMode)
-	{
-		case H264_RATECONTROL_VBR:
-			sys->codecEncoderContext->bit_rate = h264->BitRate;
-			break;
-
-		case H264_RATECONTROL_CQP:
-			/* TODO: sys->codecEncoderContext-> = h264->QP; */
-			break;
-
-		default:
-			break;
-	}
-
+	sys->RateControlMode = h264->RateControlMode;
+	sys->QP = h264->QP;
+	sys->MaxQP = h264->MaxQP;
 	sys->codecEncoderContext->width = h264->width;
 	sys->codecEncoderContext->height = h264->height;
 	sys->codecEncoderContext->delay = 0;
@@ -170,6 +207,8 @@ static BOOL libavcodec_create_encoder(H264_CONTEXT* h264)
 	sys->codecEncoderContext->time_base = (AVRational){ 1, h264->FrameRate };
 	av_opt_set(sys->codecEncoderContext, "preset", "medium", AV_OPT_SEARCH_CHILDREN);
 	av_opt_set(sys->codecEncoderContext, "tune", "zerolatency", AV_OPT_SEARCH_CHILDREN);
+	av_opt_set(sys->codecEncoderContext, "forced-idr", "1", AV_OPT_SEARCH_CHILDREN);
+	libavcodec_set_rate_control(h264, sys->codecEncoderContext);
 	sys->codecEncoderContext->flags |= AV_CODEC_FLAG_LOOP_FILTER;
 	sys->codecEncoderContext->pix_fmt = AV_PIX_FMT_YUV420P;
 
@@ -284,6 +323,42 @@ static int libavcodec_decompress(H264_CONTEXT* h264, const BYTE* pSrcData, UINT3
 	return 1;
 }
 
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(56, 29, 100)
+/* Spend more bits on the changed macroblocks, encoders without ROI support ignore this */
+static BOOL libavcodec_set_regions_of_interest(H264_CONTEXT* h264, AVFrame* frame)
+{
+	UINT32 x;
+	AVFrameSideData* sd;
+	AVRegionOfInterest* roi;
+
+	av_frame_remove_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+
+	if (h264->numChangedRects == 0)
+		return TRUE;
+
+	sd = av_frame_new_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST,
+	                            h264->numChangedRects * sizeof(AVRegionOfInterest));
+
+	if (!sd)
+		return FALSE;
+
+	roi = (AVRegionOfInterest*)sd->data;
+
+	for (x = 0; x < h264->numChangedRects; x++)
+	{
+		const RECTANGLE_16* rect = &h264->changedRects[x];
+		roi[x].self_size = sizeof(AVRegionOfInterest);
+		roi[x].top = rect->top;
+		roi[x].bottom = rect->bottom;
+		roi[x].left = rect->left;
+		roi[x].right = rect->right;
+		roi[x].qoffset = av_make_q(-1, 10);
+	}
+
+	return TRUE;
+}
+#endif
+
 static int libavcodec_compress(H264_CONTEXT* h264, const BYTE** pSrcYuv, const UINT32* pStride,
                                BYTE** ppDstData, UINT32* pDstSize)
 {
@@ -318,6 +393,14 @@ static int libavcodec_compress(H264_CONTEXT* h264, const BYTE** pSrcYuv, const U
 	sys->videoFrame->linesize[1] = (int)pStride[1];
 	sys->videoFrame->linesize[2] = (int)pStride[2];
 	sys->videoFrame->pts++;
+	sys->videoFrame->pict_type = h264->ForceIDR ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+	h264->ForceIDR = FALSE;
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(56, 29, 100)
+
+	if (!libavcodec_set_regions_of_interest(h264, sys->videoFrame))
+		return -1;
+
+#endif
 	/* avcodec_encode_video2 is deprecated with libavcodec 57.48.101 */
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 48, 101)
 	status = avcodec_send_frame(sys->codecEncoderContext, sys->videoFrame);
@@ -52,6 +52,8 @@ struct _H264_CONTEXT_OPENH264
 	ISVCDecoder* pDecoder;
 	ISVCEncoder* pEncoder;
 	SEncParamExt EncParamExt;
+	H264_RATECONTROL_MODE RateControlMode;
+	UINT32 MaxQP;
 };
 typedef struct _H264_CONTEXT_OPENH264 H264_CONTEXT_OPENH264;
 
@@ -171,11 +173,13 @@ static int openh264_compress(H264_CONTEXT* h264, const BYTE** pYUVData, const UI
 		return -1;
 
 	if ((h264->FrameRate > INT_MAX) || (h264->NumberOfThreads > INT_MAX) ||
-	    (h264->BitRate > INT_MAX) || (h264->QP > INT_MAX))
+	    (h264->BitRate > INT_MAX) || (h264->QP > INT_MAX) || (h264->MaxQP > INT_MAX))
 		return -1;
 
+	/* Switching the rate control mode or the QP limit needs a new encoder setup */
 	if ((sys->EncParamExt.iPicWidth != (int)h264->width) ||
-	    (sys->EncParamExt.iPicHeight != (int)h264->height))
+	    (sys->EncParamExt.iPicHeight != (int)h264->height) ||
+	    (sys->RateControlMode != h264->RateControlMode) || (sys->MaxQP != h264->MaxQP))
 	{
 		status = (*sys->pEncoder)->GetDefaultParams(sys->pEncoder, &sys->EncParamExt);
 
@@ -203,11 +207,20 @@ static int openh264_compress(H264_CONTEXT* h264, const BYTE** pYUVData, const UI
 
 		switch (h264->RateControlMode)
 		{
+			case H264_RATECONTROL_CBR:
+				sys->EncParamExt.iMaxBitrate = (int)h264->BitRate;
+				sys->EncParamExt.sSpatialLayers[0].iMaxSpatialBitrate = (int)h264->BitRate;
+				/* fallthrough */
+
 			case H264_RATECONTROL_VBR:
 				sys->EncParamExt.iRCMode = RC_BITRATE_MODE;
 				sys->EncParamExt.iTargetBitrate = (int)h264->BitRate;
 				sys->EncParamExt.sSpatialLayers[0].iSpatialBitrate =
 				    sys->EncParamExt.iTargetBitrate;
+
+				if (h264->MaxQP != 0)
+					sys->EncParamExt.iMaxQp = (int)h264->MaxQP;
+
 				break;
 
 			case H264_RATECONTROL_CQP:
@@ -216,6 +229,9 @@ static int openh264_compress(H264_CONTEXT* h264, const BYTE** pYUVData, const UI
 				break;
 		}
 
+		sys->RateControlMode = h264->RateControlMode;
+		sys->MaxQP = h264->MaxQP;
+
 		if (sys->EncParamExt.iMultipleThreadIdc > 1)
 		{
 #if (OPENH264_MAJOR == 1) && (OPENH264_MINOR <= 5)
@@ -249,6 +265,25 @@ static int openh264_compress(H264_CONTEXT* h264, const BYTE** pYUVData, const UI
 	{
 		switch (h264->RateControlMode)
 		{
+			case H264_RATECONTROL_CBR:
+				if (sys->EncParamExt.iMaxBitrate != (int)h264->BitRate)
+				{
+					sys->EncParamExt.iMaxBitrate = (int)h264->BitRate;
+					bitrate.iLayer = SPATIAL_LAYER_ALL;
+					bitrate.iBitrate = (int)h264->BitRate;
+					status = (*sys->pEncoder)
+					             ->SetOption(sys->pEncoder, ENCODER_OPTION_MAX_BITRATE, &bitrate);
+
+					if (status < 0)
+					{
+						WLog_Print(h264->log, WLOG_ERROR,
+						           "Failed to set encoder max bitrate (status=%d)", status);
+						return status;
+					}
+				}
+
+				/* fallthrough */
+
 			case H264_RATECONTROL_VBR:
 				if (sys->EncParamExt.iTargetBitrate != (int)h264->BitRate)
 				{
@@ -314,6 +349,25 @@ static int openh264_compress(H264_CONTEXT* h264, const BYTE** pYUVData, const UI
 	pic.pData[0] = (unsigned char*)pYUVData[0];
 	pic.pData[1] = (unsigned char*)pYUVData[1];
 	pic.pData[2] = (unsigned char*)pYUVData[2];
+
+	if (h264->ForceIDR)
+	{
+		/* OpenH264 2.x takes the spatial layer to refresh, -1 for all of them */
+#if (OPENH264_MAJOR == 1)
+		status = (*sys->pEncoder)->ForceIntraFrame(sys->pEncoder, true);
+#else
+		status = (*sys->pEncoder)->ForceIntraFrame(sys->pEncoder, true, -1);
+#endif
+
+		if (status < 0)
+		{
+			WLog_Print(h264->log, WLOG_ERROR, "Failed to force an IDR frame (status=%d)", status);
+			return status;
+		}
+
+		h264->ForceIDR = FALSE;
+	}
+
 	status = (*sys->pEncoder)->EncodeFrame(sys->pEncoder, &pic, &info);
 
 	if (status < 0)
@@ -86,11 +86,90 @@ static const UINT32 MPPC_MATCH_TABLE[256] = {
 
 //#define DEBUG_MPPC	1
 
+struct _MPPC_COPY_OFFSET_CODE
+{
+	BYTE prefix; /* length of the code prefix, 0 for literals */
+	BYTE bits;   /* number of CopyOffset bits following the prefix */
+	UINT16 base;
+};
+typedef struct _MPPC_COPY_OFFSET_CODE MPPC_COPY_OFFSET_CODE;
+
+/* CopyOffset codes by the 5 leading bits of a symbol, for RDP4 and RDP5 */
+static const MPPC_COPY_OFFSET_CODE MPPC_COPY_OFFSET_CODES[2][32] = {
+	{ /* RDP4 */
+	  { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },
+	  { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },
+	  { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },
+	  { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },
+	  { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 3, 13, 320 },
+	  { 3, 13, 320 },  { 3, 13, 320 },  { 3, 13, 320 },  { 4, 8, 64 },    { 4, 8, 64 },
+	  { 4, 6, 0 },     { 4, 6, 0 } },
+	{ /* RDP5 */
+	  { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },
+	  { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },
+	  { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },
+	  { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },
+	  { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 0, 0, 0 },     { 3, 16, 2368 },
+	  { 3, 16, 2368 }, { 3, 16, 2368 }, { 3, 16, 2368 }, { 4, 11, 320 },  { 4, 11, 320 },
+	  { 5, 8, 64 },    { 5, 6, 0 } }
+};
+
+/* number of leading 1 bits of a byte, the LengthOfMatch prefix */
+static const BYTE MPPC_LEADING_ONES[256] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+	4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 7, 8
+};
+
+/**
+ * The bits of the packet are kept MSB first in a 64 bit reservoir that holds at least
+ * 57 bits after a refill. Bits past the end of the packet read as 0.
+ */
+static INLINE void mppc_refill_bits(const BYTE** SrcPtr, const BYTE* SrcEnd, UINT64* bits,
+                                    UINT32* nbits)
+{
+	if ((*nbits <= 32) && (SrcEnd - *SrcPtr >= 4))
+	{
+		UINT32 value;
+		Data_Read_UINT32_BE(*SrcPtr, value);
+		*bits |= ((UINT64)value) << (32 - *nbits);
+		*SrcPtr += 4;
+		*nbits += 32;
+	}
+
+	while (*nbits <= 56)
+	{
+		if (*SrcPtr < SrcEnd)
+			*bits |= ((UINT64) * (*SrcPtr)++) << (56 - *nbits);
+
+		*nbits += 8;
+	}
+}
+
 int mppc_decompress(MPPC_CONTEXT* mppc, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData,
                     UINT32* pDstSize, UINT32 flags)
 {
-	BYTE Literal;
 	BYTE* SrcPtr;
+	const BYTE* pSrc;
+	const BYTE* pSrcEnd;
+	UINT64 bits = 0;
+	UINT32 nbits = 0;
+	UINT32 position = 0;
+	UINT32 length;
+	UINT32 prefix;
 	UINT32 CopyOffset;
 	UINT32 LengthOfMatch;
 	UINT32 accumulator;
@@ -99,13 +178,14 @@ int mppc_decompress(MPPC_CONTEXT* mppc, BYTE* pSrcData, UINT32 SrcSize, BYTE** p
 	BYTE* HistoryBufferEnd;
 	UINT32 HistoryBufferSize;
 	UINT32 CompressionLevel;
-	wBitStream* bs = mppc->bs;
+	const MPPC_COPY_OFFSET_CODE* CopyOffsetCode;
 	HistoryBuffer = mppc->HistoryBuffer;
 	HistoryBufferSize = mppc->HistoryBufferSize;
 	HistoryBufferEnd = &HistoryBuffer[HistoryBufferSize - 1];
 	CompressionLevel = mppc->CompressionLevel;
-	BitStream_Attach(bs, pSrcData, SrcSize);
-	BitStream_Fetch(bs);
+	pSrc = pSrcData;
+	pSrcEnd = &pSrcData[SrcSize];
+	length = SrcSize * 8;
 
 	if (flags & PACKET_AT_FRONT)
 	{
@@ -129,9 +209,11 @@ int mppc_decompress(MPPC_CONTEXT* mppc, BYTE* pSrcData, UINT32 SrcSize, BYTE** p
 		return 1;
 	}
 
-	while ((bs->length - bs->position) >= 8)
+	/* the remaining length wraps around when the last symbol was read past the end */
+	while ((length - position) >= 8)
 	{
-		accumulator = bs->accumulator;
+		mppc_refill_bits(&pSrc, pSrcEnd, &bits, &nbits);
+		accumulator = (UINT32)(bits >> 32);
 
 		/**
 		 * Literal Encoding
@@ -148,11 +230,24 @@ int mppc_decompress(MPPC_CONTEXT* mppc, BYTE* pSrcData, UINT32 SrcSize, BYTE** p
 			/**
 			 * Literal, less than 0x80
 			 * bit 0 followed by the lower 7 bits of the literal
+			 *
+			 * Such literals are frequent, decode a second one right away.
 			 */
-			Literal = ((accumulator & 0x7F000000) >> 24);
-			*(HistoryPtr) = Literal;
-			HistoryPtr++;
-			BitStream_Shift(bs, 8);
+			*HistoryPtr++ = (BYTE)((accumulator & 0x7F000000) >> 24);
+
+			if (((accumulator & 0x00800000) == 0) && ((length - position) >= 16) &&
+			    (HistoryPtr <= HistoryBufferEnd))
+			{
+				*HistoryPtr++ = (BYTE)((accumulator & 0x007F0000) >> 16);
+				bits <<= 16;
+				nbits -= 16;
+				position += 16;
+				continue;
+			}
+
+			bits <<= 8;
+			nbits -= 8;
+			position += 8;
 			continue;
 		}
 		else if ((accumulator & 0xC0000000) == 0x80000000)
@@ -161,240 +256,62 @@ int mppc_decompress(MPPC_CONTEXT* mppc, BYTE* pSrcData, UINT32 SrcSize, BYTE** p
 			 * Literal, greater than 0x7F
 			 * bits 10 followed by the lower 7 bits of the literal
 			 */
-			Literal = ((accumulator & 0x3F800000) >> 23) + 0x80;
-			*(HistoryPtr) = Literal;
-			HistoryPtr++;
-			BitStream_Shift(bs, 9);
+			*HistoryPtr++ = (BYTE)(((accumulator & 0x3F800000) >> 23) + 0x80);
+			bits <<= 9;
+			nbits -= 9;
+			position += 9;
 			continue;
 		}
 
 		/**
 		 * CopyOffset Encoding
 		 */
-		if (CompressionLevel) /* RDP5 */
-		{
-			if ((accumulator & 0xF8000000) == 0xF8000000)
-			{
-				/**
-				 * CopyOffset, range [0, 63]
-				 * bits 11111 + lower 6 bits of CopyOffset
-				 */
-				CopyOffset = ((accumulator >> 21) & 0x3F);
-				BitStream_Shift(bs, 11);
-			}
-			else if ((accumulator & 0xF8000000) == 0xF0000000)
-			{
-				/**
-				 * CopyOffset, range [64, 319]
-				 * bits 11110 + lower 8 bits of (CopyOffset - 64)
-				 */
-				CopyOffset = ((accumulator >> 19) & 0xFF) + 64;
-				BitStream_Shift(bs, 13);
-			}
-			else if ((accumulator & 0xF0000000) == 0xE0000000)
-			{
-				/**
-				 * CopyOffset, range [320, 2367]
-				 * bits 1110 + lower 11 bits of (CopyOffset - 320)
-				 */
-				CopyOffset = ((accumulator >> 17) & 0x7FF) + 320;
-				BitStream_Shift(bs, 15);
-			}
-			else if ((accumulator & 0xE0000000) == 0xC0000000)
-			{
-				/**
-				 * CopyOffset, range [2368, ]
-				 * bits 110 + lower 16 bits of (CopyOffset - 2368)
-				 */
-				CopyOffset = ((accumulator >> 13) & 0xFFFF) + 2368;
-				BitStream_Shift(bs, 19);
-			}
-			else
-			{
-				/* Invalid CopyOffset Encoding */
-				return -1001;
-			}
-		}
-		else /* RDP4 */
+		CopyOffsetCode = &MPPC_COPY_OFFSET_CODES[CompressionLevel ? 1 : 0][accumulator >> 27];
+
+		if (!CopyOffsetCode->prefix)
 		{
-			if ((accumulator & 0xF0000000) == 0xF0000000)
-			{
-				/**
-				 * CopyOffset, range [0, 63]
-				 * bits 1111 + lower 6 bits of CopyOffset
-				 */
-				CopyOffset = ((accumulator >> 22) & 0x3F);
-				BitStream_Shift(bs, 10);
-			}
-			else if ((accumulator & 0xF0000000) == 0xE0000000)
-			{
-				/**
-				 * CopyOffset, range [64, 319]
-				 * bits 1110 + lower 8 bits of (CopyOffset - 64)
-				 */
-				CopyOffset = ((accumulator >> 20) & 0xFF) + 64;
-				BitStream_Shift(bs, 12);
-			}
-			else if ((accumulator & 0xE0000000) == 0xC0000000)
-			{
-				/**
-				 * CopyOffset, range [320, 8191]
-				 * bits 110 + lower 13 bits of (CopyOffset - 320)
-				 */
-				CopyOffset = ((accumulator >> 16) & 0x1FFF) + 320;
-				BitStream_Shift(bs, 16);
-			}
-			else
-			{
-				/* Invalid CopyOffset Encoding */
-				return -1002;
-			}
+			/* Invalid CopyOffset Encoding */
+			return CompressionLevel ? -1001 : -1002;
 		}
 
+		CopyOffset = ((accumulator << CopyOffsetCode->prefix) >> (32 - CopyOffsetCode->bits)) +
+		             CopyOffsetCode->base;
+		bits <<= CopyOffsetCode->prefix + CopyOffsetCode->bits;
+		nbits -= CopyOffsetCode->prefix + CopyOffsetCode->bits;
+		position += CopyOffsetCode->prefix + CopyOffsetCode->bits;
+
 		/**
 		 * LengthOfMatch Encoding
+		 *
+		 * 0 for 3, otherwise n bits 1 and a bit 0 followed by the lower n + 1 bits
+		 * of LengthOfMatch. RDP4 has up to 11 bits 1, RDP5 up to 14.
 		 */
-		accumulator = bs->accumulator;
+		mppc_refill_bits(&pSrc, pSrcEnd, &bits, &nbits);
+		accumulator = (UINT32)(bits >> 32);
+		prefix = MPPC_LEADING_ONES[accumulator >> 24];
 
-		if ((accumulator & 0x80000000) == 0x00000000)
-		{
-			/**
-			 * LengthOfMatch [3]
-			 * bit 0 + 0 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = 3;
-			BitStream_Shift(bs, 1);
-		}
-		else if ((accumulator & 0xC0000000) == 0x80000000)
-		{
-			/**
-			 * LengthOfMatch [4, 7]
-			 * bits 10 + 2 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = ((accumulator >> 28) & 0x0003) + 0x0004;
-			BitStream_Shift(bs, 4);
-		}
-		else if ((accumulator & 0xE0000000) == 0xC0000000)
-		{
-			/**
-			 * LengthOfMatch [8, 15]
-			 * bits 110 + 3 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = ((accumulator >> 26) & 0x0007) + 0x0008;
-			BitStream_Shift(bs, 6);
-		}
-		else if ((accumulator & 0xF0000000) == 0xE0000000)
-		{
-			/**
-			 * LengthOfMatch [16, 31]
-			 * bits 1110 + 4 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = ((accumulator >> 24) & 0x000F) + 0x0010;
-			BitStream_Shift(bs, 8);
-		}
-		else if ((accumulator & 0xF8000000) == 0xF0000000)
-		{
-			/**
-			 * LengthOfMatch [32, 63]
-			 * bits 11110 + 5 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = ((accumulator >> 22) & 0x001F) + 0x0020;
-			BitStream_Shift(bs, 10);
-		}
-		else if ((accumulator & 0xFC000000) == 0xF8000000)
-		{
-			/**
-			 * LengthOfMatch [64, 127]
-			 * bits 111110 + 6 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = ((accumulator >> 20) & 0x003F) + 0x0040;
-			BitStream_Shift(bs, 12);
-		}
-		else if ((accumulator & 0xFE000000) == 0xFC000000)
-		{
-			/**
-			 * LengthOfMatch [128, 255]
-			 * bits 1111110 + 7 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = ((accumulator >> 18) & 0x007F) + 0x0080;
-			BitStream_Shift(bs, 14);
-		}
-		else if ((accumulator & 0xFF000000) == 0xFE000000)
-		{
-			/**
-			 * LengthOfMatch [256, 511]
-			 * bits 11111110 + 8 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = ((accumulator >> 16) & 0x00FF) + 0x0100;
-			BitStream_Shift(bs, 16);
-		}
-		else if ((accumulator & 0xFF800000) == 0xFF000000)
-		{
-			/**
-			 * LengthOfMatch [512, 1023]
-			 * bits 111111110 + 9 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = ((accumulator >> 14) & 0x01FF) + 0x0200;
-			BitStream_Shift(bs, 18);
-		}
-		else if ((accumulator & 0xFFC00000) == 0xFF800000)
-		{
-			/**
-			 * LengthOfMatch [1024, 2047]
-			 * bits 1111111110 + 10 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = ((accumulator >> 12) & 0x03FF) + 0x0400;
-			BitStream_Shift(bs, 20);
-		}
-		else if ((accumulator & 0xFFE00000) == 0xFFC00000)
-		{
-			/**
-			 * LengthOfMatch [2048, 4095]
-			 * bits 11111111110 + 11 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = ((accumulator >> 10) & 0x07FF) + 0x0800;
-			BitStream_Shift(bs, 22);
-		}
-		else if ((accumulator & 0xFFF00000) == 0xFFE00000)
-		{
-			/**
-			 * LengthOfMatch [4096, 8191]
-			 * bits 111111111110 + 12 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = ((accumulator >> 8) & 0x0FFF) + 0x1000;
-			BitStream_Shift(bs, 24);
-		}
-		else if (((accumulator & 0xFFF80000) == 0xFFF00000) && CompressionLevel) /* RDP5 */
-		{
-			/**
-			 * LengthOfMatch [8192, 16383]
-			 * bits 1111111111110 + 13 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = ((accumulator >> 6) & 0x1FFF) + 0x2000;
-			BitStream_Shift(bs, 26);
-		}
-		else if (((accumulator & 0xFFFC0000) == 0xFFF80000) && CompressionLevel) /* RDP5 */
+		if (prefix == 8)
+			prefix += MPPC_LEADING_ONES[(accumulator >> 16) & 0xFF];
+
+		if (prefix > (CompressionLevel ? 14U : 11U))
 		{
-			/**
-			 * LengthOfMatch [16384, 32767]
-			 * bits 11111111111110 + 14 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = ((accumulator >> 4) & 0x3FFF) + 0x4000;
-			BitStream_Shift(bs, 28);
+			/* Invalid LengthOfMatch Encoding */
+			return -1003;
 		}
-		else if (((accumulator & 0xFFFE0000) == 0xFFFC0000) && CompressionLevel) /* RDP5 */
+
+		if (prefix == 0)
 		{
-			/**
-			 * LengthOfMatch [32768, 65535]
-			 * bits 111111111111110 + 15 lower bits of LengthOfMatch
-			 */
-			LengthOfMatch = ((accumulator >> 2) & 0x7FFF) + 0x8000;
-			BitStream_Shift(bs, 30);
+			LengthOfMatch = 3;
+			bits <<= 1;
+			nbits -= 1;
+			position += 1;
 		}
 		else
 		{
-			/* Invalid LengthOfMatch Encoding */
-			return -1003;
+			LengthOfMatch = ((accumulator << (prefix + 1)) >> (31 - prefix)) + (1U << (prefix + 1));
+			bits <<= 2 * (prefix + 1);
+			nbits -= 2 * (prefix + 1);
+			position += 2 * (prefix + 1);
 		}
 
 #ifdef DEBUG_MPPC
@@ -410,10 +327,19 @@ int mppc_decompress(MPPC_CONTEXT* mppc, BYTE* pSrcData, UINT32 SrcSize, BYTE** p
 		SrcPtr = &HistoryBuffer[(HistoryPtr - HistoryBuffer - CopyOffset) &
 		                        (CompressionLevel ? 0xFFFF : 0x1FFF)];
 
-		do
+		/* overlapping copies repeat the bytes already copied */
+		if (SrcPtr + LengthOfMatch <= HistoryPtr)
 		{
-			*HistoryPtr++ = *SrcPtr++;
-		} while (--LengthOfMatch);
+			CopyMemory(HistoryPtr, SrcPtr, LengthOfMatch);
+			HistoryPtr += LengthOfMatch;
+		}
+		else
+		{
+			do
+			{
+				*HistoryPtr++ = *SrcPtr++;
+			} while (--LengthOfMatch);
+		}
 	}
 
 	*pDstSize = (UINT32)(HistoryPtr - mppc->HistoryPtr);
@@ -32,6 +32,15 @@
 
 #define TAG FREERDP_TAG("codec")
 
+/* the longest match the length of match codes can express */
+#define NCRUSH_MAX_MATCH_LENGTH 16385
+
+/* hash chain entries NCRUSH_MODE_BEST looks at for a match */
+#define NCRUSH_BEST_CHAIN_DEPTH 64
+
+/* NCRUSH_MODE_BEST takes longer matches without looking one byte ahead */
+#define NCRUSH_BEST_LAZY_LENGTH 32
+
 struct _NCRUSH_CONTEXT
 {
 	BOOL Compressor;
@@ -46,6 +55,7 @@ struct _NCRUSH_CONTEXT
 	UINT16 MatchTable[65536];
 	BYTE HuffTableCopyOffset[1024];
 	BYTE HuffTableLOM[4096];
+	NCRUSH_MODE Mode;
 };
 
 static const UINT16 HuffTableLEC[8192] = {
@@ -780,48 +790,6 @@ static const UINT16 HuffTableLOM[512] = {
 	0x2001, 0x4003, 0x3002, 0x5009, 0x2001, 0x4006, 0x3004, 0x901F
 };
 
-static const BYTE HuffTableMask[39] = {
-	0x11, /* 0 */
-	0x9E, /* 1 */
-	0xA1, /* 2 */
-	0x00, /* 3 */
-	0x00, /* 4 */
-	0x01, /* 5 */
-	0x00, /* 6 */
-	0x03, /* 7 */
-	0x00, /* 8 */
-	0x07, /* 9 */
-	0x00, /* 10 */
-	0x0F, /* 11 */
-	0x00, /* 12 */
-	0x1F, /* 13 */
-	0x00, /* 14 */
-	0x3F, /* 15 */
-	0x00, /* 16 */
-	0x7F, /* 17 */
-	0x00, /* 18 */
-	0xFF, /* 19 */
-	0x00, /* 20 */
-	0xFF, /* 21 */
-	0x01, /* 22 */
-	0xFF, /* 23 */
-	0x03, /* 24 */
-	0xFF, /* 25 */
-	0x07, /* 26 */
-	0xFF, /* 27 */
-	0x0F, /* 28 */
-	0xFF, /* 29 */
-	0x1F, /* 30 */
-	0xFF, /* 31 */
-	0x3F, /* 32 */
-	0xFF, /* 33 */
-	0x7F, /* 34 */
-	0xFF, /* 35 */
-	0xFF, /* 36 */
-	0x00, /* 37 */
-	0x00  /* 38 */
-};
-
 static const BYTE HuffLengthLEC[294] = {
 	6,  /* 0 */
 	6,  /* 1 */
@@ -1923,43 +1891,32 @@ static INLINE UINT16 get_word(const BYTE* data)
 	return tmp;
 }
 
-static INLINE UINT32 get_dword(const BYTE* data)
-{
-	UINT32 tmp = *data++;
-	tmp |= (UINT32)*data++ << 8U;
-	tmp |= (UINT32)*data++ << 16U;
-	tmp |= (UINT32)*data++ << 24U;
-	return tmp;
-}
-
-static INLINE BOOL NCrushFetchBits(const BYTE** SrcPtr, const BYTE** SrcEnd, INT32* nbits,
-                                   UINT32* bits)
+/**
+ * The bits of the packet are kept LSB first in a 64 bit reservoir that holds at least
+ * 57 bits after a refill, enough for a whole copy symbol. Bits past the end of the
+ * packet read as 0, the caller keeps track of how many bits really are left.
+ */
+static INLINE void NCrushFetchBits(const BYTE** SrcPtr, const BYTE* SrcEnd, UINT32* nbits,
+                                   UINT64* bits)
 {
-	if (*nbits < 16)
+	if ((*nbits <= 32) && (SrcEnd - *SrcPtr >= 4))
 	{
-		if ((*SrcPtr + 1) >= *SrcEnd)
-		{
-			if (*SrcPtr >= *SrcEnd)
-			{
-				if (*nbits < 0)
-					return FALSE;
-			}
-			else
-			{
-				*bits += *(*SrcPtr)++ << *nbits;
-				*nbits += 8;
-			}
-		}
-		else
-		{
-			UINT16 tmp = *(*SrcPtr)++;
-			tmp |= (*(*SrcPtr)++) << 8;
-			*bits += tmp << *nbits;
-			*nbits += 16;
-		}
+		UINT32 tmp = (*SrcPtr)[0];
+		tmp |= (UINT32)(*SrcPtr)[1] << 8U;
+		tmp |= (UINT32)(*SrcPtr)[2] << 16U;
+		tmp |= (UINT32)(*SrcPtr)[3] << 24U;
+		*bits |= (UINT64)tmp << *nbits;
+		*SrcPtr += 4;
+		*nbits += 32;
 	}
 
-	return TRUE;
+	while (*nbits <= 56)
+	{
+		if (*SrcPtr < SrcEnd)
+			*bits |= (UINT64) * (*SrcPtr)++ << *nbits;
+
+		*nbits += 8;
+	}
 }
 
 static INLINE void NCrushWriteStart(UINT32* bits, UINT32* offset, UINT32* accumulator)
@@ -1990,16 +1947,51 @@ static INLINE void NCrushWriteFinish(BYTE** DstPtr, UINT32 accumulator)
 	*(*DstPtr)++ = (accumulator >> 8) & 0xFF;
 }
 
+/**
+ * Copies a match that does not overlap its source, short ones with two possibly
+ * overlapping loads and stores instead of a call to memcpy. Nothing is written past
+ * the end of the match, the history beyond it may still be referenced.
+ */
+static INLINE void ncrush_copy_match(BYTE* dst, const BYTE* src, UINT32 length)
+{
+	if (length > 16)
+	{
+		CopyMemory(dst, src, length);
+	}
+	else if (length >= 8)
+	{
+		UINT64 head, tail;
+		memcpy(&head, src, sizeof(head));
+		memcpy(&tail, &src[length - 8], sizeof(tail));
+		memcpy(dst, &head, sizeof(head));
+		memcpy(&dst[length - 8], &tail, sizeof(tail));
+	}
+	else if (length >= 4)
+	{
+		UINT32 head, tail;
+		memcpy(&head, src, sizeof(head));
+		memcpy(&tail, &src[length - 4], sizeof(tail));
+		memcpy(dst, &head, sizeof(head));
+		memcpy(&dst[length - 4], &tail, sizeof(tail));
+	}
+	else
+	{
+		/* matches are at least 2 bytes long */
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[length - 1] = src[length - 1];
+	}
+}
+
 int ncrush_decompress(NCRUSH_CONTEXT* ncrush, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData,
                       UINT32* pDstSize, UINT32 flags)
 {
 	UINT32 index;
-	UINT32 bits;
-	INT32 nbits;
+	UINT64 bits;
+	UINT32 nbits;
+	INT64 BitsLeft;
 	const BYTE* SrcPtr;
 	const BYTE* SrcEnd;
-	UINT16 Mask;
-	BYTE Literal;
 	UINT32 IndexLEC;
 	UINT32 BitLength;
 	UINT32 MaskedBits;
@@ -2050,28 +2042,27 @@ int ncrush_decompress(NCRUSH_CONTEXT* ncrush, BYTE* pSrcData, UINT32 SrcSize, BY
 		return 1;
 	}
 
+	SrcPtr = pSrcData;
 	SrcEnd = &pSrcData[SrcSize];
-	nbits = 32;
-	bits = get_dword(pSrcData);
-	SrcPtr = pSrcData + 4;
+	bits = 0;
+	nbits = 0;
+	BitsLeft = 8LL * SrcSize;
 
 	while (1)
 	{
-		while (1)
-		{
-			Mask = get_word(&HuffTableMask[29]);
-			MaskedBits = bits & Mask;
-			IndexLEC = HuffTableLEC[MaskedBits] & 0xFFF;
-			BitLength = HuffTableLEC[MaskedBits] >> 12;
-			bits >>= BitLength;
-			nbits -= BitLength;
-
-			if (!NCrushFetchBits(&SrcPtr, &SrcEnd, &nbits, &bits))
-				return -1;
-
-			if (IndexLEC >= 256)
-				break;
+		NCrushFetchBits(&SrcPtr, SrcEnd, &nbits, &bits);
+		MaskedBits = bits & 0x1FFF;
+		IndexLEC = HuffTableLEC[MaskedBits] & 0xFFF;
+		BitLength = HuffTableLEC[MaskedBits] >> 12;
+		bits >>= BitLength;
+		nbits -= BitLength;
+		BitsLeft -= BitLength;
+
+		if (BitsLeft < 0)
+			return -1;
 
+		if (IndexLEC < 256)
+		{
 			if (HistoryPtr >= HistoryBufferEnd)
 			{
 				WLog_ERR(TAG, "ncrush_decompress error: HistoryPtr (%p) >= HistoryBufferEnd (%p)",
@@ -2079,8 +2070,8 @@ int ncrush_decompress(NCRUSH_CONTEXT* ncrush, BYTE* pSrcData, UINT32 SrcSize, BY
 				return -1003;
 			}
 
-			Literal = (HuffTableLEC[MaskedBits] & 0xFF);
-			*HistoryPtr++ = Literal;
+			*HistoryPtr++ = (BYTE)IndexLEC;
+			continue;
 		}
 
 		if (IndexLEC == 256)
@@ -2096,30 +2087,27 @@ int ncrush_decompress(NCRUSH_CONTEXT* ncrush, BYTE* pSrcData, UINT32 SrcSize, BY
 				return -1004;
 
 			CopyOffset = ncrush->OffsetCache[OffsetCacheIndex];
-			Mask = get_word(&HuffTableMask[21]);
-			MaskedBits = bits & Mask;
+			MaskedBits = bits & 0x1FF;
 			LengthOfMatch = HuffTableLOM[MaskedBits] & 0xFFF;
 			BitLength = HuffTableLOM[MaskedBits] >> 12;
 			bits >>= BitLength;
 			nbits -= BitLength;
+			BitsLeft -= BitLength;
 
-			if (!NCrushFetchBits(&SrcPtr, &SrcEnd, &nbits, &bits))
+			if (BitsLeft < 0)
 				return -1;
 
+			/* codes without extra bits mask and consume 0 bits */
 			LengthOfMatchBits = LOMBitsLUT[LengthOfMatch];
 			LengthOfMatchBase = LOMBaseLUT[LengthOfMatch];
+			MaskedBits = bits & ((1U << LengthOfMatchBits) - 1);
+			bits >>= LengthOfMatchBits;
+			nbits -= LengthOfMatchBits;
+			BitsLeft -= LengthOfMatchBits;
+			LengthOfMatchBase += MaskedBits;
 
-			if (LengthOfMatchBits)
-			{
-				Mask = get_word(&HuffTableMask[(2 * LengthOfMatchBits) + 3]);
-				MaskedBits = bits & Mask;
-				bits >>= LengthOfMatchBits;
-				nbits -= LengthOfMatchBits;
-				LengthOfMatchBase += MaskedBits;
-
-				if (!NCrushFetchBits(&SrcPtr, &SrcEnd, &nbits, &bits))
-					return -1;
-			}
+			if (BitsLeft < 0)
+				return -1;
 
 			OldCopyOffset = ncrush->OffsetCache[OffsetCacheIndex];
 			ncrush->OffsetCache[OffsetCacheIndex] = ncrush->OffsetCache[0];
@@ -2129,44 +2117,36 @@ int ncrush_decompress(NCRUSH_CONTEXT* ncrush, BYTE* pSrcData, UINT32 SrcSize, BY
 		{
 			CopyOffsetBits = CopyOffsetBitsLUT[CopyOffsetIndex];
 			CopyOffsetBase = CopyOffsetBaseLUT[CopyOffsetIndex];
-			CopyOffset = CopyOffsetBase - 1;
-
-			if (CopyOffsetBits)
-			{
-				Mask = get_word(&HuffTableMask[(2 * CopyOffsetBits) + 3]);
-				MaskedBits = bits & Mask;
-				CopyOffset = CopyOffsetBase + MaskedBits - 1;
-				bits >>= CopyOffsetBits;
-				nbits -= CopyOffsetBits;
+			MaskedBits = bits & ((1U << CopyOffsetBits) - 1);
+			CopyOffset = CopyOffsetBase + MaskedBits - 1;
+			bits >>= CopyOffsetBits;
+			nbits -= CopyOffsetBits;
+			BitsLeft -= CopyOffsetBits;
 
-				if (!NCrushFetchBits(&SrcPtr, &SrcEnd, &nbits, &bits))
-					return -1;
-			}
+			if (BitsLeft < 0)
+				return -1;
 
-			Mask = get_word(&HuffTableMask[21]);
-			MaskedBits = bits & Mask;
+			MaskedBits = bits & 0x1FF;
 			LengthOfMatch = HuffTableLOM[MaskedBits] & 0xFFF;
 			BitLength = HuffTableLOM[MaskedBits] >> 12;
 			bits >>= BitLength;
 			nbits -= BitLength;
+			BitsLeft -= BitLength;
 
-			if (!NCrushFetchBits(&SrcPtr, &SrcEnd, &nbits, &bits))
+			if (BitsLeft < 0)
 				return -1;
 
+			/* codes without extra bits mask and consume 0 bits */
 			LengthOfMatchBits = LOMBitsLUT[LengthOfMatch];
 			LengthOfMatchBase = LOMBaseLUT[LengthOfMatch];
+			MaskedBits = bits & ((1U << LengthOfMatchBits) - 1);
+			bits >>= LengthOfMatchBits;
+			nbits -= LengthOfMatchBits;
+			BitsLeft -= LengthOfMatchBits;
+			LengthOfMatchBase += MaskedBits;
 
-			if (LengthOfMatchBits)
-			{
-				Mask = get_word(&HuffTableMask[(2 * LengthOfMatchBits) + 3]);
-				MaskedBits = bits & Mask;
-				bits >>= LengthOfMatchBits;
-				nbits -= LengthOfMatchBits;
-				LengthOfMatchBase += MaskedBits;
-
-				if (!NCrushFetchBits(&SrcPtr, &SrcEnd, &nbits, &bits))
-					return -1;
-			}
+			if (BitsLeft < 0)
+				return -1;
 
 			ncrush->OffsetCache[3] = ncrush->OffsetCache[2];
 			ncrush->OffsetCache[2] = ncrush->OffsetCache[1];
@@ -2190,6 +2170,14 @@ int ncrush_decompress(NCRUSH_CONTEXT* ncrush, BYTE* pSrcData, UINT32 SrcSize, BY
 
 		if (CopyOffsetPtr >= HistoryBuffer)
 		{
+			if (LengthOfMatch <= CopyOffset)
+			{
+				/* source and destination do not overlap */
+				ncrush_copy_match(HistoryPtr, CopyOffsetPtr, LengthOfMatch);
+				HistoryPtr += LengthOfMatch;
+				continue;
+			}
+
 			while (CopyLength > 0)
 			{
 				*HistoryPtr++ = *CopyOffsetPtr++;
@@ -2223,16 +2211,8 @@ int ncrush_decompress(NCRUSH_CONTEXT* ncrush, BYTE* pSrcData, UINT32 SrcSize, BY
 				LengthOfMatch--;
 			}
 		}
-
-		LengthOfMatch = LengthOfMatchBase;
-
-		if (LengthOfMatch == 2)
-			continue;
 	}
 
-	if (IndexLEC != 256)
-		return -1;
-
 	if (ncrush->HistoryBufferFence != 0xABABABAB)
 	{
 		WLog_ERR(TAG, "NCrushDecompress: history buffer fence was overwritten, potential buffer "
@@ -2269,21 +2249,33 @@ static int ncrush_hash_table_add(NCRUSH_CONTEXT* ncrush, const BYTE* pSrcData, U
 	return 1;
 }
 
+/* number of equal bytes at Ptr1 and Ptr2, the match ends at HistoryPtr */
 static int ncrush_find_match_length(const BYTE* Ptr1, const BYTE* Ptr2, BYTE* HistoryPtr)
 {
-	BYTE val1, val2;
-	const BYTE* Ptr = Ptr1;
+	size_t length = 0;
+	size_t limit;
 
-	do
+	if (Ptr1 >= HistoryPtr)
+		return 0;
+
+	limit = (size_t)(HistoryPtr - Ptr1);
+
+	while (length + 8 <= limit)
 	{
-		if (Ptr1 > HistoryPtr)
+		UINT64 val1, val2;
+		memcpy(&val1, &Ptr1[length], sizeof(val1));
+		memcpy(&val2, &Ptr2[length], sizeof(val2));
+
+		if (val1 != val2)
 			break;
 
-		val1 = *Ptr1++;
-		val2 = *Ptr2++;
-	} while (val1 == val2);
+		length += 8;
+	}
+
+	while ((length < limit) && (Ptr1[length] == Ptr2[length]))
+		length++;
 
-	return Ptr1 - (Ptr + 1);
+	return (int)length;
 }
 
 static int ncrush_find_best_match(NCRUSH_CONTEXT* ncrush, UINT16 HistoryOffset,
@@ -2375,8 +2367,8 @@ static int ncrush_find_best_match(NCRUSH_CONTEXT* ncrush, UINT16 HistoryOffset,
 				if (Length < 2)
 					return -1;
 
-				if (Length > 16)
-					break;
+				if (Length > NCRUSH_MAX_MATCH_LENGTH)
+					Length = NCRUSH_MAX_MATCH_LENGTH;
 
 				if (Length > MatchLength)
 				{
@@ -2384,6 +2376,10 @@ static int ncrush_find_best_match(NCRUSH_CONTEXT* ncrush, UINT16 HistoryOffset,
 					MatchOffset = Offset;
 				}
 
+				/* long enough, stop looking */
+				if (Length > 16)
+					break;
+
 				if ((Length <= MatchLength) ||
 				    (&HistoryBuffer[HistoryOffset + 2] < ncrush->HistoryPtr))
 				{
@@ -2402,6 +2398,79 @@ static int ncrush_find_best_match(NCRUSH_CONTEXT* ncrush, UINT16 HistoryOffset,
 	return MatchLength;
 }
 
+/* NCRUSH_MODE_FAST: the most recent occurrence of the next two bytes only */
+static int ncrush_find_first_match(NCRUSH_CONTEXT* ncrush, UINT16 HistoryOffset,
+                                   UINT32* pMatchOffset)
+{
+	int Length;
+	const UINT16 Offset = ncrush->MatchTable[HistoryOffset];
+	const BYTE* HistoryBuffer = ncrush->HistoryBuffer;
+
+	if (!Offset || (Offset == HistoryOffset))
+		return -1;
+
+	Length = ncrush_find_match_length(&HistoryBuffer[HistoryOffset + 2], &HistoryBuffer[Offset + 2],
+	                                  ncrush->HistoryPtr) +
+	         2;
+	*pMatchOffset = Offset;
+	return MIN(Length, NCRUSH_MAX_MATCH_LENGTH);
+}
+
+/* NCRUSH_MODE_BEST: the longest match within NCRUSH_BEST_CHAIN_DEPTH occurrences */
+static int ncrush_find_longest_match(NCRUSH_CONTEXT* ncrush, UINT16 HistoryOffset,
+                                     UINT32* pMatchOffset)
+{
+	UINT32 depth;
+	int Length;
+	int MatchLength = 0;
+	UINT16 Offset = ncrush->MatchTable[HistoryOffset];
+	const BYTE* HistoryBuffer = ncrush->HistoryBuffer;
+	const BYTE* MatchPtr = &HistoryBuffer[HistoryOffset];
+	const int MaxLength = (int)MIN(ncrush->HistoryPtr - MatchPtr, NCRUSH_MAX_MATCH_LENGTH);
+
+	for (depth = 0; Offset && (depth < NCRUSH_BEST_CHAIN_DEPTH); depth++)
+	{
+		if (Offset >= HistoryOffset)
+			return -1;
+
+		/* a longer match has to continue where the current one ends */
+		if ((MatchLength == 0) || (HistoryBuffer[Offset + MatchLength] == MatchPtr[MatchLength]))
+		{
+			Length = ncrush_find_match_length(&MatchPtr[2], &HistoryBuffer[Offset + 2],
+			                                  ncrush->HistoryPtr) +
+			         2;
+
+			if (Length > MatchLength)
+			{
+				MatchLength = MIN(Length, MaxLength);
+				*pMatchOffset = Offset;
+
+				if (MatchLength >= MaxLength)
+					break;
+			}
+		}
+
+		Offset = ncrush->MatchTable[Offset];
+	}
+
+	return (MatchLength > 0) ? MatchLength : -1;
+}
+
+static int ncrush_find_match(NCRUSH_CONTEXT* ncrush, UINT16 HistoryOffset, UINT32* pMatchOffset)
+{
+	switch (ncrush->Mode)
+	{
+		case NCRUSH_MODE_FAST:
+			return ncrush_find_first_match(ncrush, HistoryOffset, pMatchOffset);
+
+		case NCRUSH_MODE_BEST:
+			return ncrush_find_longest_match(ncrush, HistoryOffset, pMatchOffset);
+
+		default:
+			return ncrush_find_best_match(ncrush, HistoryOffset, pMatchOffset);
+	}
+}
+
 static int ncrush_move_encoder_windows(NCRUSH_CONTEXT* ncrush, BYTE* HistoryPtr)
 {
 	int i, j;
@@ -2553,7 +2622,7 @@ int ncrush_compress(NCRUSH_CONTEXT* ncrush, BYTE* pSrcData, UINT32 SrcSize, BYTE
 			int rc;
 
 			MatchOffset = 0;
-			rc = ncrush_find_best_match(ncrush, HistoryOffset, &MatchOffset);
+			rc = ncrush_find_match(ncrush, HistoryOffset, &MatchOffset);
 
 			if (rc < 0)
 				return -1005;
@@ -2566,6 +2635,18 @@ int ncrush_compress(NCRUSH_CONTEXT* ncrush, BYTE* pSrcData, UINT32 SrcSize, BYTE
 		if ((MatchLength == 2) && (CopyOffset >= 64))
 			MatchLength = 0;
 
+		/* lazy matching: a literal followed by a longer match is usually shorter */
+		if ((ncrush->Mode == NCRUSH_MODE_BEST) && (MatchLength > 0) &&
+		    (MatchLength < NCRUSH_BEST_LAZY_LENGTH) && (SrcPtr + 1 < SrcEndPtr - 2) &&
+		    ncrush->MatchTable[HistoryOffset + 1])
+		{
+			UINT32 NextMatchOffset = 0;
+			const int rc = ncrush_find_match(ncrush, HistoryOffset + 1, &NextMatchOffset);
+
+			if ((rc > 0) && ((UINT32)rc > MatchLength + 1))
+				MatchLength = 0;
+		}
+
 		if (MatchLength == 0)
 		{
 			/* Literal */
@@ -2879,6 +2960,7 @@ NCRUSH_CONTEXT* ncrush_context_new(BOOL Compressor)
 		ncrush->HistoryBufferFence = 0xABABABAB;
 		ncrush->HistoryOffset = 0;
 		ncrush->HistoryPtr = &(ncrush->HistoryBuffer[ncrush->HistoryOffset]);
+		ncrush->Mode = NCRUSH_MODE_DEFAULT;
 
 		if (ncrush_generate_tables(ncrush) < 0)
 			WLog_DBG(TAG, "ncrush_context_new: failed to initialize tables");
@@ -2889,6 +2971,24 @@ NCRUSH_CONTEXT* ncrush_context_new(BOOL Compressor)
 	return ncrush;
 }
 
+BOOL ncrush_context_set_mode(NCRUSH_CONTEXT* ncrush, NCRUSH_MODE mode)
+{
+	if (!ncrush)
+		return FALSE;
+
+	switch (mode)
+	{
+		case NCRUSH_MODE_FAST:
+		case NCRUSH_MODE_DEFAULT:
+		case NCRUSH_MODE_BEST:
+			ncrush->Mode = mode;
+			return TRUE;
+
+		default:
+			return FALSE;
+	}
+}
+
 void ncrush_context_free(NCRUSH_CONTEXT* ncrush)
 {
 	free(ncrush);
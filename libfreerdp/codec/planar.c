@@ -156,174 +156,37 @@ static INLINE INT32 planar_skip_plane_rle(const BYTE* pSrcData, UINT32 SrcSize,
 static INLINE INT32 planar_decompress_plane_rle_only(const BYTE* pSrcData, UINT32 SrcSize,
                                                      BYTE* pDstData, UINT32 nWidth, UINT32 nHeight)
 {
-	INT32 x, y;
-	UINT32 pixel;
+	UINT32 x, y;
+	BYTE pixel;
 	UINT32 cRawBytes;
 	UINT32 nRunLength;
-	INT32 deltaValue;
 	BYTE controlByte;
-	BYTE* currentScanline;
-	BYTE* previousScanline;
 	const BYTE* srcp = pSrcData;
+	const BYTE* srcEnd = &pSrcData[SrcSize];
+	const primitives_t* prims = primitives_get();
 
 	if ((nHeight > INT32_MAX) || (nWidth > INT32_MAX))
 		return -1;
 
-	previousScanline = NULL;
-
-	for (y = 0; y < (INT32)nHeight; y++)
+	/* Expand the runs first, the first scanline then holds absolute values and
+	 * every other one the delta codes relative to the scanline above. A run
+	 * repeats the last value of its scanline, which for a delta scanline is
+	 * the same as repeating its code. */
+	for (y = 0; y < nHeight; y++)
 	{
-		BYTE* dstp = &pDstData[((y) * (INT32)nWidth)];
+		BYTE* dstp = &pDstData[(size_t)y * nWidth];
 		pixel = 0;
-		currentScanline = dstp;
 
-		for (x = 0; x < (INT32)nWidth;)
+		for (x = 0; x < nWidth;)
 		{
-			controlByte = *srcp;
-			srcp++;
-
-			if ((srcp - pSrcData) > SrcSize)
+			if (srcp >= srcEnd)
 			{
 				WLog_ERR(TAG, "error reading input buffer");
 				return -1;
 			}
 
-			nRunLength = PLANAR_CONTROL_BYTE_RUN_LENGTH(controlByte);
-			cRawBytes = PLANAR_CONTROL_BYTE_RAW_BYTES(controlByte);
-
-			if (nRunLength == 1)
-			{
-				nRunLength = cRawBytes + 16;
-				cRawBytes = 0;
-			}
-			else if (nRunLength == 2)
-			{
-				nRunLength = cRawBytes + 32;
-				cRawBytes = 0;
-			}
-
-			if (((dstp + (cRawBytes + nRunLength)) - currentScanline) > nWidth)
-			{
-				WLog_ERR(TAG, "too many pixels in scanline");
-				return -1;
-			}
-
-			if (!previousScanline)
-			{
-				/* first scanline, absolute values */
-				while (cRawBytes > 0)
-				{
-					pixel = *srcp;
-					srcp++;
-					*dstp = pixel;
-					dstp++;
-					x++;
-					cRawBytes--;
-				}
-
-				while (nRunLength > 0)
-				{
-					*dstp = pixel;
-					dstp++;
-					x++;
-					nRunLength--;
-				}
-			}
-			else
-			{
-				/* delta values relative to previous scanline */
-				while (cRawBytes > 0)
-				{
-					deltaValue = *srcp;
-					srcp++;
-
-					if (deltaValue & 1)
-					{
-						deltaValue = deltaValue >> 1;
-						deltaValue = deltaValue + 1;
-						pixel = -deltaValue;
-					}
-					else
-					{
-						deltaValue = deltaValue >> 1;
-						pixel = deltaValue;
-					}
-
-					deltaValue = previousScanline[x] + pixel;
-					*dstp = deltaValue;
-					dstp++;
-					x++;
-					cRawBytes--;
-				}
-
-				while (nRunLength > 0)
-				{
-					deltaValue = previousScanline[x] + pixel;
-					*dstp = deltaValue;
-					dstp++;
-					x++;
-					nRunLength--;
-				}
-			}
-		}
-
-		previousScanline = currentScanline;
-	}
-
-	return (INT32)(srcp - pSrcData);
-}
-
-static INLINE INT32 planar_decompress_plane_rle(const BYTE* pSrcData, UINT32 SrcSize,
-                                                BYTE* pDstData, INT32 nDstStep, UINT32 nXDst,
-                                                UINT32 nYDst, UINT32 nWidth, UINT32 nHeight,
-                                                UINT32 nChannel, BOOL vFlip)
-{
-	INT32 x, y;
-	UINT32 pixel;
-	UINT32 cRawBytes;
-	UINT32 nRunLength;
-	INT32 deltaValue;
-	INT32 beg, end, inc;
-	BYTE controlByte;
-	BYTE* currentScanline;
-	BYTE* previousScanline;
-	const BYTE* srcp = pSrcData;
-
-	if ((nHeight > INT32_MAX) || (nWidth > INT32_MAX) || (nDstStep > INT32_MAX))
-		return -1;
-
-	previousScanline = NULL;
-
-	if (vFlip)
-	{
-		beg = (INT32)nHeight - 1;
-		end = -1;
-		inc = -1;
-	}
-	else
-	{
-		beg = 0;
-		end = (INT32)nHeight;
-		inc = 1;
-	}
-
-	for (y = beg; y != end; y += inc)
-	{
-		BYTE* dstp = &pDstData[((nYDst + y) * (INT32)nDstStep) + (nXDst * 4) + nChannel];
-		pixel = 0;
-		currentScanline = dstp;
-
-		for (x = 0; x < (INT32)nWidth;)
-		{
 			controlByte = *srcp;
 			srcp++;
-
-			if ((srcp - pSrcData) > SrcSize)
-			{
-				WLog_ERR(TAG, "error reading input buffer");
-				return -1;
-			}
-
 			nRunLength = PLANAR_CONTROL_BYTE_RUN_LENGTH(controlByte);
 			cRawBytes = PLANAR_CONTROL_BYTE_RAW_BYTES(controlByte);
 
@@ -338,173 +201,38 @@ static INLINE INT32 planar_decompress_plane_rle(const BYTE* pSrcData, UINT32 Src
 				cRawBytes = 0;
 			}
 
-			if (((dstp + (cRawBytes + nRunLength)) - currentScanline) > nWidth * 4)
+			if ((cRawBytes + nRunLength) > (nWidth - x))
 			{
 				WLog_ERR(TAG, "too many pixels in scanline");
 				return -1;
 			}
 
-			if (!previousScanline)
+			if (cRawBytes > 0)
 			{
-				/* first scanline, absolute values */
-				while (cRawBytes > 0)
+				if ((size_t)(srcEnd - srcp) < cRawBytes)
 				{
-					pixel = *srcp;
-					srcp++;
-					*dstp = pixel;
-					dstp += 4;
-					x++;
-					cRawBytes--;
+					WLog_ERR(TAG, "error reading input buffer");
+					return -1;
 				}
 
-				while (nRunLength > 0)
-				{
-					*dstp = pixel;
-					dstp += 4;
-					x++;
-					nRunLength--;
-				}
+				CopyMemory(&dstp[x], srcp, cRawBytes);
+				srcp += cRawBytes;
+				x += cRawBytes;
+				pixel = dstp[x - 1];
 			}
-			else
-			{
-				/* delta values relative to previous scanline */
-				while (cRawBytes > 0)
-				{
-					deltaValue = *srcp;
-					srcp++;
-
-					if (deltaValue & 1)
-					{
-						deltaValue = deltaValue >> 1;
-						deltaValue = deltaValue + 1;
-						pixel = -deltaValue;
-					}
-					else
-					{
-						deltaValue = deltaValue >> 1;
-						pixel = deltaValue;
-					}
-
-					deltaValue = previousScanline[x * 4] + pixel;
-					*dstp = deltaValue;
-					dstp += 4;
-					x++;
-					cRawBytes--;
-				}
 
-				while (nRunLength > 0)
-				{
-					deltaValue = previousScanline[x * 4] + pixel;
-					*dstp = deltaValue;
-					dstp += 4;
-					x++;
-					nRunLength--;
-				}
+			if (nRunLength > 0)
+			{
+				FillMemory(&dstp[x], nRunLength, pixel);
+				x += nRunLength;
 			}
 		}
-
-		previousScanline = currentScanline;
 	}
 
-	return (INT32)(srcp - pSrcData);
-}
-
-static INLINE INT32 planar_set_plane(BYTE bValue, BYTE* pDstData, INT32 nDstStep, UINT32 nXDst,
-                                     UINT32 nYDst, UINT32 nWidth, UINT32 nHeight, UINT32 nChannel,
-                                     BOOL vFlip)
-{
-	INT32 x, y;
-	INT32 beg, end, inc;
-
-	if ((nHeight > INT32_MAX) || (nWidth > INT32_MAX) || (nDstStep > INT32_MAX))
+	if (prims->planarDeltaDecode_8u_C1IR(pDstData, nWidth, nHeight) != PRIMITIVES_SUCCESS)
 		return -1;
 
-	if (vFlip)
-	{
-		beg = (INT32)nHeight - 1;
-		end = -1;
-		inc = -1;
-	}
-	else
-	{
-		beg = 0;
-		end = (INT32)nHeight;
-		inc = 1;
-	}
-
-	for (y = beg; y != end; y += inc)
-	{
-		BYTE* dstp = &pDstData[((nYDst + y) * (INT32)nDstStep) + (nXDst * 4) + nChannel];
-
-		for (x = 0; x < (INT32)nWidth; ++x)
-		{
-			*dstp = bValue;
-			dstp += 4;
-		}
-	}
-
-	return 0;
-}
-
-static INLINE BOOL writeLine(BYTE** ppRgba, UINT32 DstFormat, UINT32 width, const BYTE** ppR,
-                             const BYTE** ppG, const BYTE** ppB, const BYTE** ppA)
-{
-	UINT32 x;
-
-	if (!ppRgba || !ppR || !ppG || !ppB)
-		return FALSE;
-
-	switch (DstFormat)
-	{
-		case PIXEL_FORMAT_BGRA32:
-			for (x = 0; x < width; x++)
-			{
-				*(*ppRgba)++ = *(*ppB)++;
-				*(*ppRgba)++ = *(*ppG)++;
-				*(*ppRgba)++ = *(*ppR)++;
-				*(*ppRgba)++ = *(*ppA)++;
-			}
-
-			return TRUE;
-
-		case PIXEL_FORMAT_BGRX32:
-			for (x = 0; x < width; x++)
-			{
-				*(*ppRgba)++ = *(*ppB)++;
-				*(*ppRgba)++ = *(*ppG)++;
-				*(*ppRgba)++ = *(*ppR)++;
-				*(*ppRgba)++ = 0xFF;
-			}
-
-			return TRUE;
-
-		default:
-			if (ppA)
-			{
-				for (x = 0; x < width; x++)
-				{
-					BYTE alpha = *(*ppA)++;
-					UINT32 color =
-					    FreeRDPGetColor(DstFormat, *(*ppR)++, *(*ppG)++, *(*ppB)++, alpha);
-					WriteColor(*ppRgba, DstFormat, color);
-					*ppRgba += GetBytesPerPixel(DstFormat);
-				}
-			}
-			else
-			{
-				const BYTE alpha = 0xFF;
-
-				for (x = 0; x < width; x++)
-				{
-					UINT32 color =
-					    FreeRDPGetColor(DstFormat, *(*ppR)++, *(*ppG)++, *(*ppB)++, alpha);
-					WriteColor(*ppRgba, DstFormat, color);
-					*ppRgba += GetBytesPerPixel(DstFormat);
-				}
-			}
-
-			return TRUE;
-	}
+	return (INT32)(srcp - pSrcData);
 }
 
 static INLINE BOOL planar_decompress_planes_raw(const BYTE* pSrcData[4], BYTE* pDstData,
@@ -512,26 +240,11 @@ static INLINE BOOL planar_decompress_planes_raw(const BYTE* pSrcData[4], BYTE* p
                                                 UINT32 nYDst, UINT32 nWidth, UINT32 nHeight,
                                                 BOOL vFlip, UINT32 totalHeight)
 {
-	INT32 y;
-	INT32 beg, end, inc;
-	const BYTE* pR = pSrcData[0];
-	const BYTE* pG = pSrcData[1];
-	const BYTE* pB = pSrcData[2];
-	const BYTE* pA = pSrcData[3];
+	BYTE* pRGB;
+	INT32 step;
 	const UINT32 bpp = GetBytesPerPixel(DstFormat);
-
-	if (vFlip)
-	{
-		beg = nHeight - 1;
-		end = -1;
-		inc = -1;
-	}
-	else
-	{
-		beg = 0;
-		end = nHeight;
-		inc = 1;
-	}
+	const primitives_t* prims = primitives_get();
+	const prim_size_t roi = { nWidth, nHeight };
 
 	if (nYDst + nHeight > totalHeight)
 		return FALSE;
@@ -539,20 +252,23 @@ static INLINE BOOL planar_decompress_planes_raw(const BYTE* pSrcData[4], BYTE* p
 	if ((nXDst + nWidth) * bpp > nDstStep)
 		return FALSE;
 
-	for (y = beg; y != end; y += inc)
-	{
-		BYTE* pRGB;
+	if (nDstStep > INT32_MAX)
+		return FALSE;
 
-		if (y > (INT64)nHeight)
-			return FALSE;
+	if (nHeight == 0)
+		return TRUE;
 
-		pRGB = &pDstData[((nYDst + y) * nDstStep) + (nXDst * bpp)];
+	pRGB = &pDstData[(nYDst * nDstStep) + (nXDst * bpp)];
+	step = (INT32)nDstStep;
 
-		if (!writeLine(&pRGB, DstFormat, nWidth, &pR, &pG, &pB, &pA))
-			return FALSE;
+	if (vFlip)
+	{
+		pRGB += (size_t)(nHeight - 1) * nDstStep;
+		step = -step;
 	}
 
-	return TRUE;
+	return prims->PlanarToRGB_8u_P4AC4R(pSrcData, pRGB, step, DstFormat, &roi) ==
+	       PRIMITIVES_SUCCESS;
 }
 
 static BOOL planar_subsample_expand(const BYTE* plane, size_t planeLength, UINT32 nWidth,
@@ -713,6 +429,15 @@ BOOL planar_decompress(BITMAP_PLANAR_CONTEXT* planar, const BYTE* pSrcData, UINT
 	}
 	else /* RLE */
 	{
+		/* RLE planes are decoded into the context buffers first */
+		if ((nSrcWidth > planar->maxWidth) || (nSrcHeight > planar->maxHeight))
+		{
+			WLog_ERR(TAG, "planar size %" PRIu32 "x%" PRIu32 " exceeds context size %" PRIu32
+			              "x%" PRIu32,
+			         nSrcWidth, nSrcHeight, planar->maxWidth, planar->maxHeight);
+			return FALSE;
+		}
+
 		if (alpha)
 		{
 			planes[3] = srcp;
@@ -754,6 +479,8 @@ BOOL planar_decompress(BITMAP_PLANAR_CONTEXT* planar, const BYTE* pSrcData, UINT
 		BYTE* pTempData = pDstData;
 		UINT32 nTempStep = nDstStep;
 		UINT32 nTotalHeight = nYDst + nDstHeight;
+		UINT32 nXTemp = nXDst;
+		UINT32 nYTemp = nYDst;
 
 		if (useAlpha)
 			TempFormat = PIXEL_FORMAT_BGRA32;
@@ -765,12 +492,15 @@ BOOL planar_decompress(BITMAP_PLANAR_CONTEXT* planar, const BYTE* pSrcData, UINT
 			pTempData = planar->pTempData;
 			nTempStep = planar->nTempStep;
 			nTotalHeight = planar->maxHeight;
+			/* The temporary buffer only needs to hold the bitmap itself */
+			nXTemp = 0;
+			nYTemp = 0;
 		}
 
 		if (!rle) /* RAW */
 		{
-			if (!planar_decompress_planes_raw(planes, pTempData, TempFormat, nTempStep, nXDst,
-			                                  nYDst, nSrcWidth, nSrcHeight, vFlip, nTotalHeight))
+			if (!planar_decompress_planes_raw(planes, pTempData, TempFormat, nTempStep, nXTemp,
+			                                  nYTemp, nSrcWidth, nSrcHeight, vFlip, nTotalHeight))
 				return FALSE;
 
 			if (alpha)
@@ -783,23 +513,27 @@ BOOL planar_decompress(BITMAP_PLANAR_CONTEXT* planar, const BYTE* pSrcData, UINT
 		}
 		else /* RLE */
 		{
-			status =
-			    planar_decompress_plane_rle(planes[0], rleSizes[0], pTempData, nTempStep, nXDst,
-			                                nYDst, nSrcWidth, nSrcHeight, 2, vFlip); /* RedPlane */
+			BYTE* rleBuffer[4] = { 0 };
+
+			rleBuffer[3] = planar->rlePlanesBuffer;  /* AlphaPlane */
+			rleBuffer[0] = rleBuffer[3] + planeSize; /* RedPlane */
+			rleBuffer[1] = rleBuffer[0] + planeSize; /* GreenPlane */
+			rleBuffer[2] = rleBuffer[1] + planeSize; /* BluePlane */
+
+			status = planar_decompress_plane_rle_only(planes[0], rleSizes[0], rleBuffer[0],
+			                                          rawWidths[0], rawHeights[0]); /* RedPlane */
 
 			if (status < 0)
 				return FALSE;
 
-			status = planar_decompress_plane_rle(planes[1], rleSizes[1], pTempData, nTempStep,
-			                                     nXDst, nYDst, nSrcWidth, nSrcHeight, 1,
-			                                     vFlip); /* GreenPlane */
+			status = planar_decompress_plane_rle_only(planes[1], rleSizes[1], rleBuffer[1],
+			                                          rawWidths[1], rawHeights[1]); /* GreenPlane */
 
 			if (status < 0)
 				return FALSE;
 
-			status =
-			    planar_decompress_plane_rle(planes[2], rleSizes[2], pTempData, nTempStep, nXDst,
-			                                nYDst, nSrcWidth, nSrcHeight, 0, vFlip); /* BluePlane */
+			status = planar_decompress_plane_rle_only(planes[2], rleSizes[2], rleBuffer[2],
+			                                          rawWidths[2], rawHeights[2]); /* BluePlane */
 
 			if (status < 0)
 				return FALSE;
@@ -808,25 +542,33 @@ BOOL planar_decompress(BITMAP_PLANAR_CONTEXT* planar, const BYTE* pSrcData, UINT
 
 			if (useAlpha)
 			{
-				status = planar_decompress_plane_rle(planes[3], rleSizes[3], pTempData, nTempStep,
-				                                     nXDst, nYDst, nSrcWidth, nSrcHeight, 3,
-				                                     vFlip); /* AlphaPlane */
+				status =
+				    planar_decompress_plane_rle_only(planes[3], rleSizes[3], rleBuffer[3],
+				                                     rawWidths[3], rawHeights[3]); /* AlphaPlane */
+
+				if (status < 0)
+					return FALSE;
 			}
 			else
-				status = planar_set_plane(0xFF, pTempData, nTempStep, nXDst, nYDst, nSrcWidth,
-				                          nSrcHeight, 3, vFlip);
-
-			if (status < 0)
-				return FALSE;
+				rleBuffer[3] = NULL; /* Opaque */
 
 			if (alpha)
 				srcp += rleSizes[3];
+
+			planes[0] = rleBuffer[0];
+			planes[1] = rleBuffer[1];
+			planes[2] = rleBuffer[2];
+			planes[3] = rleBuffer[3];
+
+			if (!planar_decompress_planes_raw(planes, pTempData, TempFormat, nTempStep, nXTemp,
+			                                  nYTemp, nSrcWidth, nSrcHeight, vFlip, nTotalHeight))
+				return FALSE;
 		}
 
 		if (pTempData != pDstData)
 		{
 			if (!freerdp_image_copy(pDstData, DstFormat, nDstStep, nXDst, nYDst, w, h, pTempData,
-			                        TempFormat, nTempStep, nXDst, nYDst, NULL, FREERDP_FLIP_NONE))
+			                        TempFormat, nTempStep, nXTemp, nYTemp, NULL, FREERDP_FLIP_NONE))
 				return FALSE;
 		}
 	}
@@ -941,30 +683,24 @@ BOOL planar_decompress(BITMAP_PLANAR_CONTEXT* planar, const BYTE* pSrcData, UINT
 static INLINE BOOL freerdp_split_color_planes(const BYTE* data, UINT32 format, UINT32 width,
                                               UINT32 height, UINT32 scanline, BYTE* planes[4])
 {
-	INT32 i, j, k;
+	const primitives_t* prims = primitives_get();
+	const prim_size_t roi = { width, height };
+	/* planes[] is ordered A, R, G, B as on the wire */
+	BYTE* pDst[4] = { planes[1], planes[2], planes[3], planes[0] };
+
 	if ((width > INT32_MAX) || (height > INT32_MAX) || (scanline > INT32_MAX))
 		return FALSE;
 
-	k = 0;
-
 	if (scanline == 0)
 		scanline = width * GetBytesPerPixel(format);
 
-	for (i = (INT32)height - 1; i >= 0; i--)
-	{
-		const BYTE* pixel = &data[(INT32)scanline * i];
-
-		for (j = 0; j < (INT32)width; j++)
-		{
-			const UINT32 color = ReadColor(pixel, format);
-			pixel += GetBytesPerPixel(format);
-			SplitColor(color, format, &planes[1][k], &planes[2][k], &planes[3][k], &planes[0][k],
-			           NULL);
-			k++;
-		}
-	}
+	if (height == 0)
+		return TRUE;
 
-	return TRUE;
+	/* The planes are stored bottom up */
+	return prims->RGBToPlanar_8u_AC4P4R(&data[(size_t)scanline * (height - 1)],
+	                                    -(INT32)scanline, format, pDst,
+	                                    &roi) == PRIMITIVES_SUCCESS;
 }
 
 static INLINE UINT32 freerdp_bitmap_planar_write_rle_bytes(const BYTE* pInBuffer, UINT32 cRawBytes,
@@ -1255,10 +991,7 @@ static INLINE BOOL freerdp_bitmap_planar_compress_planes_rle(BYTE* inPlanes[4],
 BYTE* freerdp_bitmap_planar_delta_encode_plane(const BYTE* inPlane, UINT32 width, UINT32 height,
                                                BYTE* outPlane)
 {
-	char s2c;
-	UINT32 y, x;
-	BYTE* outPtr;
-	const BYTE *srcPtr, *prevLinePtr;
+	const primitives_t* prims = primitives_get();
 
 	if (!outPlane)
 	{
@@ -1269,23 +1002,8 @@ BYTE* freerdp_bitmap_planar_delta_encode_plane(const BYTE* inPlane, UINT32 width
 			return NULL;
 	}
 
-	// first line is copied as is
-	CopyMemory(outPlane, inPlane, width);
-	outPtr = outPlane + width;
-	srcPtr = inPlane + width;
-	prevLinePtr = inPlane;
-
-	for (y = 1; y < height; y++)
-	{
-		for (x = 0; x < width; x++, outPtr++, srcPtr++, prevLinePtr++)
-		{
-			INT32 delta = *srcPtr - *prevLinePtr;
-			s2c = (delta >= 0) ? (char)delta : (char)(~((BYTE)(-delta)) + 1);
-			s2c = (s2c >= 0) ? (char)((UINT32)s2c << 1)
-			                 : (char)(((UINT32)(~((BYTE)s2c) + 1) << 1) - 1);
-			*outPtr = (BYTE)s2c;
-		}
-	}
+	if (prims->planarDeltaEncode_8u_C1R(inPlane, outPlane, width, height) != PRIMITIVES_SUCCESS)
+		return NULL;
 
 	return outPlane;
 }
@@ -51,6 +51,7 @@
 #include "rfx_rlgr.h"
 
 #include "rfx_sse2.h"
+#include "rfx_avx2.h"
 #include "rfx_neon.h"
 
 #define TAG FREERDP_TAG("codec")
@@ -322,13 +323,9 @@ RFX_CONTEXT* rfx_context_new(BOOL encoder)
 	/* create profilers for default decoding routines */
 	rfx_profiler_create(context);
 	/* set up default routines */
-	context->quantization_decode = rfx_quantization_decode;
-	context->quantization_encode = rfx_quantization_encode;
-	context->dwt_2d_decode = rfx_dwt_2d_decode;
-	context->dwt_2d_encode = rfx_dwt_2d_encode;
 	context->rlgr_decode = rfx_rlgr_decode;
 	context->rlgr_encode = rfx_rlgr_encode;
-	RFX_INIT_SIMD(context);
+	rfx_context_set_simd_level(context, RFX_SIMD_AVX2);
 	context->state = RFX_STATE_SEND_HEADERS;
 	context->expectedDataBlockType = WBT_FRAME_BEGIN;
 	return context;
@@ -401,6 +398,42 @@ void rfx_context_set_pixel_format(RFX_CONTEXT* context, UINT32 pixel_format)
 	context->bits_per_pixel = GetBitsPerPixel(pixel_format);
 }
 
+BOOL rfx_context_set_simd_level(RFX_CONTEXT* context, RFX_SIMD_LEVEL level)
+{
+	if (!context)
+		return FALSE;
+
+	PROFILER_RENAME(context->priv->prof_rfx_quantization_decode, "rfx_quantization_decode");
+	PROFILER_RENAME(context->priv->prof_rfx_quantization_encode, "rfx_quantization_encode");
+	PROFILER_RENAME(context->priv->prof_rfx_dwt_2d_decode, "rfx_dwt_2d_decode");
+	PROFILER_RENAME(context->priv->prof_rfx_dwt_2d_encode, "rfx_dwt_2d_encode");
+	context->quantization_decode = rfx_quantization_decode;
+	context->quantization_encode = rfx_quantization_encode;
+	context->dwt_2d_decode = rfx_dwt_2d_decode;
+	context->dwt_2d_encode = rfx_dwt_2d_encode;
+
+	if (level == RFX_SIMD_GENERIC)
+		return TRUE;
+
+	RFX_INIT_SIMD(context);
+
+	if (context->dwt_2d_decode == rfx_dwt_2d_decode)
+		return FALSE;
+
+	if (level == RFX_SIMD_BASELINE)
+		return TRUE;
+
+#if defined(WITH_SSE2)
+	/* rfx_avx2.c is compiled for AVX2 as a whole, check before calling into it */
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		rfx_init_avx2(context);
+		return TRUE;
+	}
+#endif
+	return FALSE;
+}
+
 BOOL rfx_context_reset(RFX_CONTEXT* context, UINT32 width, UINT32 height)
 {
 	if (!context)
@@ -1229,6 +1262,40 @@ BOOL rfx_process_message(RFX_CONTEXT* context, const BYTE* data, UINT32 length,
 	return FALSE;
 }
 
+BOOL rfx_copy_header_blocks(const BYTE* data, UINT32 length, wStream* headers)
+{
+	wStream inStream, *s = &inStream;
+
+	if (!data || !headers)
+		return FALSE;
+
+	Stream_StaticInit(s, (BYTE*)data, length);
+
+	while (Stream_GetRemainingLength(s) > 6)
+	{
+		UINT16 blockType;
+		UINT32 blockLen;
+		const BYTE* block = Stream_Pointer(s);
+		Stream_Read_UINT16(s, blockType); /* blockType (2 bytes) */
+		Stream_Read_UINT32(s, blockLen);  /* blockLen (4 bytes) */
+
+		if ((blockLen < 6) || (Stream_GetRemainingLength(s) < blockLen - 6))
+			return FALSE;
+
+		Stream_Seek(s, blockLen - 6);
+
+		if ((blockType < WBT_SYNC) || (blockType > WBT_CONTEXT))
+			continue;
+
+		if (!Stream_EnsureRemainingCapacity(headers, blockLen))
+			return FALSE;
+
+		Stream_Write(headers, block, blockLen);
+	}
+
+	return TRUE;
+}
+
 UINT16 rfx_message_get_tile_count(RFX_MESSAGE* message)
 {
 	return message->numTiles;
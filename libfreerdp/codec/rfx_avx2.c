@@ -0,0 +1,450 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RemoteFX Codec Library - AVX2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <immintrin.h>
+
+#include "rfx_types.h"
+#include "rfx_avx2.h"
+
+/*
+ * The AVX2 routines process 16 coefficients per vector. The 32x32 and 16x16
+ * sub-bands are handled one row at a time, the 8x8 sub-bands of the last DWT
+ * level two rows at a time with one row per 128 bit lane.
+ *
+ * The SSE2 routines read one element in front of or beyond a row at the
+ * sub-band borders. Here the neighbour element is shifted in explicitly, so
+ * all loads and stores stay within the rows being processed.
+ */
+
+/* { first, a[0], a[1], ..., a[14] } */
+static INLINE __m256i mm256_shift_in_first_epi16(__m256i a, INT16 first)
+{
+	const __m256i t = _mm256_permute2x128_si256(a, a, 0x08);
+	return _mm256_insert_epi16(_mm256_alignr_epi8(a, t, 14), first, 0);
+}
+
+/* { a[1], ..., a[14], a[15], last } */
+static INLINE __m256i mm256_shift_in_last_epi16(__m256i a, INT16 last)
+{
+	const __m256i t = _mm256_permute2x128_si256(a, a, 0x81);
+	return _mm256_insert_epi16(_mm256_alignr_epi8(t, a, 2), last, 15);
+}
+
+/* Per 128 bit lane: { a[0], a[0], a[1], ..., a[6] } */
+static INLINE __m256i mm256_lane_prev_epi16(__m256i a)
+{
+	return _mm256_blend_epi16(_mm256_bslli_epi128(a, 2), a, 0x01);
+}
+
+/* Per 128 bit lane: { a[1], ..., a[7], a[7] } */
+static INLINE __m256i mm256_lane_next_epi16(__m256i a)
+{
+	return _mm256_blend_epi16(_mm256_bsrli_epi128(a, 2), a, 0x80);
+}
+
+/* dst[2n] = even[n], dst[2n + 1] = odd[n] for n = 0..15 */
+static INLINE void mm256_store_interleaved_epi16(INT16* dst, __m256i even, __m256i odd)
+{
+	const __m256i lo = _mm256_unpacklo_epi16(even, odd);
+	const __m256i hi = _mm256_unpackhi_epi16(even, odd);
+	_mm256_storeu_si256((__m256i*)dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+	_mm256_storeu_si256((__m256i*)(dst + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+/* even[n] = src[2n], odd[n] = src[2n + 1] for n = 0..15 */
+static INLINE void mm256_load_deinterleaved_epi16(const INT16* src, __m256i* even, __m256i* odd)
+{
+	const __m256i shuffle =
+	    _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15, 0, 1, 4, 5, 8, 9,
+	                     12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+	__m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)src), shuffle);
+	__m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + 16)), shuffle);
+	a = _mm256_permute4x64_epi64(a, 0xD8);
+	b = _mm256_permute4x64_epi64(b, 0xD8);
+	*even = _mm256_permute2x128_si256(a, b, 0x20);
+	*odd = _mm256_permute2x128_si256(a, b, 0x31);
+}
+
+static INLINE void rfx_quantization_decode_block_avx2(INT16* buffer, const size_t buffer_size,
+                                                      const UINT32 factor)
+{
+	__m256i* ptr = (__m256i*)buffer;
+	const __m256i* buf_end = (const __m256i*)(buffer + buffer_size);
+	const __m128i count = _mm_cvtsi32_si128((int)factor);
+
+	if (factor == 0)
+		return;
+
+	do
+	{
+		__m256i a = _mm256_loadu_si256(ptr);
+		a = _mm256_sll_epi16(a, count);
+		_mm256_storeu_si256(ptr, a);
+		ptr++;
+	} while (ptr < buf_end);
+}
+
+static void rfx_quantization_decode_avx2(INT16* buffer, const UINT32* quantVals)
+{
+	rfx_quantization_decode_block_avx2(&buffer[0], 1024, quantVals[8] - 1);    /* HL1 */
+	rfx_quantization_decode_block_avx2(&buffer[1024], 1024, quantVals[7] - 1); /* LH1 */
+	rfx_quantization_decode_block_avx2(&buffer[2048], 1024, quantVals[9] - 1); /* HH1 */
+	rfx_quantization_decode_block_avx2(&buffer[3072], 256, quantVals[5] - 1);  /* HL2 */
+	rfx_quantization_decode_block_avx2(&buffer[3328], 256, quantVals[4] - 1);  /* LH2 */
+	rfx_quantization_decode_block_avx2(&buffer[3584], 256, quantVals[6] - 1);  /* HH2 */
+	rfx_quantization_decode_block_avx2(&buffer[3840], 64, quantVals[2] - 1);   /* HL3 */
+	rfx_quantization_decode_block_avx2(&buffer[3904], 64, quantVals[1] - 1);   /* LH3 */
+	rfx_quantization_decode_block_avx2(&buffer[3968], 64, quantVals[3] - 1);   /* HH3 */
+	rfx_quantization_decode_block_avx2(&buffer[4032], 64, quantVals[0] - 1);   /* LL3 */
+}
+
+static INLINE void rfx_quantization_encode_block_avx2(INT16* buffer, const size_t buffer_size,
+                                                      const UINT32 factor)
+{
+	__m256i* ptr = (__m256i*)buffer;
+	const __m256i* buf_end = (const __m256i*)(buffer + buffer_size);
+	const __m128i count = _mm_cvtsi32_si128((int)factor);
+	__m256i half;
+
+	if (factor == 0)
+		return;
+
+	half = _mm256_set1_epi16((INT16)(1 << (factor - 1)));
+
+	do
+	{
+		__m256i a = _mm256_loadu_si256(ptr);
+		a = _mm256_add_epi16(a, half);
+		a = _mm256_sra_epi16(a, count);
+		_mm256_storeu_si256(ptr, a);
+		ptr++;
+	} while (ptr < buf_end);
+}
+
+static void rfx_quantization_encode_avx2(INT16* buffer, const UINT32* quantization_values)
+{
+	rfx_quantization_encode_block_avx2(buffer, 1024, quantization_values[8] - 6);        /* HL1 */
+	rfx_quantization_encode_block_avx2(buffer + 1024, 1024, quantization_values[7] - 6); /* LH1 */
+	rfx_quantization_encode_block_avx2(buffer + 2048, 1024, quantization_values[9] - 6); /* HH1 */
+	rfx_quantization_encode_block_avx2(buffer + 3072, 256, quantization_values[5] - 6);  /* HL2 */
+	rfx_quantization_encode_block_avx2(buffer + 3328, 256, quantization_values[4] - 6);  /* LH2 */
+	rfx_quantization_encode_block_avx2(buffer + 3584, 256, quantization_values[6] - 6);  /* HH2 */
+	rfx_quantization_encode_block_avx2(buffer + 3840, 64, quantization_values[2] - 6);   /* HL3 */
+	rfx_quantization_encode_block_avx2(buffer + 3904, 64, quantization_values[1] - 6);   /* LH3 */
+	rfx_quantization_encode_block_avx2(buffer + 3968, 64, quantization_values[3] - 6);   /* HH3 */
+	rfx_quantization_encode_block_avx2(buffer + 4032, 64, quantization_values[0] - 6);   /* LL3 */
+	rfx_quantization_encode_block_avx2(buffer, 4096, 5);
+}
+
+static INLINE void rfx_dwt_2d_decode_block_horiz_avx2(INT16* l, const INT16* h, INT16* dst,
+                                                      size_t subband_width)
+{
+	size_t y, n;
+	const __m256i one = _mm256_set1_epi16(1);
+
+	if (subband_width == 8)
+	{
+		for (y = 0; y < subband_width; y += 2)
+		{
+			/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+			const __m256i l_n = _mm256_loadu_si256((const __m256i*)l);
+			const __m256i h_n = _mm256_loadu_si256((const __m256i*)h);
+			const __m256i h_n_m = mm256_lane_prev_epi16(h_n);
+			__m256i tmp_n = _mm256_add_epi16(_mm256_add_epi16(h_n, h_n_m), one);
+			const __m256i dst_n = _mm256_sub_epi16(l_n, _mm256_srai_epi16(tmp_n, 1));
+			/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+			const __m256i dst_n_p = mm256_lane_next_epi16(dst_n);
+			tmp_n = _mm256_srai_epi16(_mm256_add_epi16(dst_n_p, dst_n), 1);
+			tmp_n = _mm256_add_epi16(tmp_n, _mm256_slli_epi16(h_n, 1));
+			mm256_store_interleaved_epi16(dst, dst_n, tmp_n);
+			l += 16;
+			h += 16;
+			dst += 32;
+		}
+
+		return;
+	}
+
+	for (y = 0; y < subband_width; y++)
+	{
+		/* Even coefficients */
+		for (n = 0; n < subband_width; n += 16)
+		{
+			/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+			const __m256i l_n = _mm256_loadu_si256((const __m256i*)&l[n]);
+			const __m256i h_n = _mm256_loadu_si256((const __m256i*)&h[n]);
+			const __m256i h_n_m = mm256_shift_in_first_epi16(h_n, (n == 0) ? h[0] : h[n - 1]);
+			__m256i tmp_n = _mm256_add_epi16(_mm256_add_epi16(h_n, h_n_m), one);
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+			_mm256_storeu_si256((__m256i*)&l[n], _mm256_sub_epi16(l_n, tmp_n));
+		}
+
+		/* Odd coefficients */
+		for (n = 0; n < subband_width; n += 16)
+		{
+			/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+			const __m256i h_n = _mm256_slli_epi16(_mm256_loadu_si256((const __m256i*)&h[n]), 1);
+			const __m256i dst_n = _mm256_loadu_si256((const __m256i*)&l[n]);
+			const __m256i dst_n_p = mm256_shift_in_last_epi16(
+			    dst_n, (n + 16 < subband_width) ? l[n + 16] : l[n + 15]);
+			__m256i tmp_n = _mm256_srai_epi16(_mm256_add_epi16(dst_n_p, dst_n), 1);
+			tmp_n = _mm256_add_epi16(tmp_n, h_n);
+			mm256_store_interleaved_epi16(&dst[2 * n], dst_n, tmp_n);
+		}
+
+		l += subband_width;
+		h += subband_width;
+		dst += 2 * subband_width;
+	}
+}
+
+static INLINE void rfx_dwt_2d_decode_block_vert_avx2(const INT16* l, const INT16* h, INT16* dst,
+                                                     size_t subband_width)
+{
+	size_t x, n;
+	const INT16* l_ptr = l;
+	const INT16* h_ptr = h;
+	INT16* dst_ptr = dst;
+	const size_t total_width = subband_width + subband_width;
+	const __m256i one = _mm256_set1_epi16(1);
+
+	/* Even coefficients */
+	for (n = 0; n < subband_width; n++)
+	{
+		for (x = 0; x < total_width; x += 16)
+		{
+			/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+			const __m256i l_n = _mm256_loadu_si256((const __m256i*)l_ptr);
+			const __m256i h_n = _mm256_loadu_si256((const __m256i*)h_ptr);
+			__m256i tmp_n = _mm256_add_epi16(h_n, one);
+
+			if (n == 0)
+				tmp_n = _mm256_add_epi16(tmp_n, h_n);
+			else
+				tmp_n = _mm256_add_epi16(
+				    tmp_n, _mm256_loadu_si256((const __m256i*)(h_ptr - total_width)));
+
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+			_mm256_storeu_si256((__m256i*)dst_ptr, _mm256_sub_epi16(l_n, tmp_n));
+			l_ptr += 16;
+			h_ptr += 16;
+			dst_ptr += 16;
+		}
+
+		dst_ptr += total_width;
+	}
+
+	h_ptr = h;
+	dst_ptr = dst + total_width;
+
+	/* Odd coefficients */
+	for (n = 0; n < subband_width; n++)
+	{
+		for (x = 0; x < total_width; x += 16)
+		{
+			/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+			const __m256i h_n = _mm256_slli_epi16(_mm256_loadu_si256((const __m256i*)h_ptr), 1);
+			const __m256i dst_n_m = _mm256_loadu_si256((const __m256i*)(dst_ptr - total_width));
+			__m256i tmp_n;
+
+			if (n == subband_width - 1)
+				tmp_n = _mm256_add_epi16(dst_n_m, dst_n_m);
+			else
+				tmp_n = _mm256_add_epi16(
+				    dst_n_m, _mm256_loadu_si256((const __m256i*)(dst_ptr + total_width)));
+
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+			_mm256_storeu_si256((__m256i*)dst_ptr, _mm256_add_epi16(tmp_n, h_n));
+			h_ptr += 16;
+			dst_ptr += 16;
+		}
+
+		dst_ptr += total_width;
+	}
+}
+
+static INLINE void rfx_dwt_2d_decode_block_avx2(INT16* buffer, INT16* idwt, size_t subband_width)
+{
+	INT16 *hl, *lh, *hh, *ll;
+	INT16 *l_dst, *h_dst;
+	/* Inverse DWT in horizontal direction, results in 2 sub-bands in L, H order in tmp buffer idwt.
+	 */
+	/* The 4 sub-bands are stored in HL(0), LH(1), HH(2), LL(3) order. */
+	/* The lower part L uses LL(3) and HL(0). */
+	/* The higher part H uses LH(1) and HH(2). */
+	ll = buffer + subband_width * subband_width * 3;
+	hl = buffer;
+	l_dst = idwt;
+	rfx_dwt_2d_decode_block_horiz_avx2(ll, hl, l_dst, subband_width);
+	lh = buffer + subband_width * subband_width;
+	hh = buffer + subband_width * subband_width * 2;
+	h_dst = idwt + subband_width * subband_width * 2;
+	rfx_dwt_2d_decode_block_horiz_avx2(lh, hh, h_dst, subband_width);
+	/* Inverse DWT in vertical direction, results are stored in original buffer. */
+	rfx_dwt_2d_decode_block_vert_avx2(l_dst, h_dst, buffer, subband_width);
+}
+
+static void rfx_dwt_2d_decode_avx2(INT16* buffer, INT16* dwt_buffer)
+{
+	rfx_dwt_2d_decode_block_avx2(&buffer[3840], dwt_buffer, 8);
+	rfx_dwt_2d_decode_block_avx2(&buffer[3072], dwt_buffer, 16);
+	rfx_dwt_2d_decode_block_avx2(&buffer[0], dwt_buffer, 32);
+}
+
+static INLINE void rfx_dwt_2d_encode_block_vert_avx2(const INT16* src, INT16* l, INT16* h,
+                                                     size_t subband_width)
+{
+	size_t x, n;
+	const size_t total_width = subband_width << 1;
+
+	for (n = 0; n < subband_width; n++)
+	{
+		for (x = 0; x < total_width; x += 16)
+		{
+			const __m256i src_2n = _mm256_loadu_si256((const __m256i*)src);
+			const __m256i src_2n_1 = _mm256_loadu_si256((const __m256i*)(src + total_width));
+			__m256i src_2n_2 = src_2n;
+			__m256i h_n_m;
+			__m256i h_n;
+			__m256i l_n;
+
+			if (n < subband_width - 1)
+				src_2n_2 = _mm256_loadu_si256((const __m256i*)(src + 2 * total_width));
+
+			/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+			h_n = _mm256_srai_epi16(_mm256_add_epi16(src_2n, src_2n_2), 1);
+			h_n = _mm256_srai_epi16(_mm256_sub_epi16(src_2n_1, h_n), 1);
+			_mm256_storeu_si256((__m256i*)h, h_n);
+
+			if (n == 0)
+				h_n_m = h_n;
+			else
+				h_n_m = _mm256_loadu_si256((const __m256i*)(h - total_width));
+
+			/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+			l_n = _mm256_srai_epi16(_mm256_add_epi16(h_n_m, h_n), 1);
+			l_n = _mm256_add_epi16(l_n, src_2n);
+			_mm256_storeu_si256((__m256i*)l, l_n);
+			src += 16;
+			l += 16;
+			h += 16;
+		}
+
+		src += total_width;
+	}
+}
+
+static INLINE void rfx_dwt_2d_encode_block_horiz_avx2(const INT16* src, INT16* l, INT16* h,
+                                                      size_t subband_width)
+{
+	size_t y, n;
+	__m256i src_2n;
+	__m256i src_2n_1;
+	__m256i src_2n_2;
+	__m256i h_n;
+	__m256i h_n_m;
+	__m256i l_n;
+
+	if (subband_width == 8)
+	{
+		for (y = 0; y < subband_width; y += 2)
+		{
+			mm256_load_deinterleaved_epi16(src, &src_2n, &src_2n_1);
+			src_2n_2 = mm256_lane_next_epi16(src_2n);
+			/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+			h_n = _mm256_srai_epi16(_mm256_add_epi16(src_2n, src_2n_2), 1);
+			h_n = _mm256_srai_epi16(_mm256_sub_epi16(src_2n_1, h_n), 1);
+			_mm256_storeu_si256((__m256i*)h, h_n);
+			/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+			h_n_m = mm256_lane_prev_epi16(h_n);
+			l_n = _mm256_srai_epi16(_mm256_add_epi16(h_n_m, h_n), 1);
+			l_n = _mm256_add_epi16(l_n, src_2n);
+			_mm256_storeu_si256((__m256i*)l, l_n);
+			src += 32;
+			l += 16;
+			h += 16;
+		}
+
+		return;
+	}
+
+	for (y = 0; y < subband_width; y++)
+	{
+		for (n = 0; n < subband_width; n += 16)
+		{
+			mm256_load_deinterleaved_epi16(&src[2 * n], &src_2n, &src_2n_1);
+			src_2n_2 = mm256_shift_in_last_epi16(
+			    src_2n, (n + 16 < subband_width) ? src[2 * n + 32] : src[2 * n + 30]);
+			/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+			h_n = _mm256_srai_epi16(_mm256_add_epi16(src_2n, src_2n_2), 1);
+			h_n = _mm256_srai_epi16(_mm256_sub_epi16(src_2n_1, h_n), 1);
+			_mm256_storeu_si256((__m256i*)&h[n], h_n);
+			/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+			h_n_m = mm256_shift_in_first_epi16(h_n, (n == 0) ? h[0] : h[n - 1]);
+			l_n = _mm256_srai_epi16(_mm256_add_epi16(h_n_m, h_n), 1);
+			l_n = _mm256_add_epi16(l_n, src_2n);
+			_mm256_storeu_si256((__m256i*)&l[n], l_n);
+		}
+
+		src += 2 * subband_width;
+		l += subband_width;
+		h += subband_width;
+	}
+}
+
+static INLINE void rfx_dwt_2d_encode_block_avx2(INT16* buffer, INT16* dwt, size_t subband_width)
+{
+	INT16 *hl, *lh, *hh, *ll;
+	INT16 *l_src, *h_src;
+	/* DWT in vertical direction, results in 2 sub-bands in L, H order in tmp buffer dwt. */
+	l_src = dwt;
+	h_src = dwt + subband_width * subband_width * 2;
+	rfx_dwt_2d_encode_block_vert_avx2(buffer, l_src, h_src, subband_width);
+	/* DWT in horizontal direction, results in 4 sub-bands in HL(0), LH(1), HH(2), LL(3) order,
+	 * stored in original buffer. */
+	/* The lower part L generates LL(3) and HL(0). */
+	/* The higher part H generates LH(1) and HH(2). */
+	ll = buffer + subband_width * subband_width * 3;
+	hl = buffer;
+	lh = buffer + subband_width * subband_width;
+	hh = buffer + subband_width * subband_width * 2;
+	rfx_dwt_2d_encode_block_horiz_avx2(l_src, ll, hl, subband_width);
+	rfx_dwt_2d_encode_block_horiz_avx2(h_src, lh, hh, subband_width);
+}
+
+static void rfx_dwt_2d_encode_avx2(INT16* buffer, INT16* dwt_buffer)
+{
+	rfx_dwt_2d_encode_block_avx2(buffer, dwt_buffer, 32);
+	rfx_dwt_2d_encode_block_avx2(buffer + 3072, dwt_buffer, 16);
+	rfx_dwt_2d_encode_block_avx2(buffer + 3840, dwt_buffer, 8);
+}
+
+void rfx_init_avx2(RFX_CONTEXT* context)
+{
+	PROFILER_RENAME(context->priv->prof_rfx_quantization_decode, "rfx_quantization_decode_avx2");
+	PROFILER_RENAME(context->priv->prof_rfx_quantization_encode, "rfx_quantization_encode_avx2");
+	PROFILER_RENAME(context->priv->prof_rfx_dwt_2d_decode, "rfx_dwt_2d_decode_avx2");
+	PROFILER_RENAME(context->priv->prof_rfx_dwt_2d_encode, "rfx_dwt_2d_encode_avx2");
+	context->quantization_decode = rfx_quantization_decode_avx2;
+	context->quantization_encode = rfx_quantization_encode_avx2;
+	context->dwt_2d_decode = rfx_dwt_2d_decode_avx2;
+	context->dwt_2d_encode = rfx_dwt_2d_encode_avx2;
+}
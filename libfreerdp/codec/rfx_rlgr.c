@@ -33,7 +33,6 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
 #include <winpr/sysinfo.h>
-#include <winpr/bitstream.h>
 #include <winpr/intrin.h>
 
 #include "rfx_bitstream.h"
@@ -78,12 +77,6 @@ static BOOL g_LZCNT = FALSE;
 
 static INIT_ONCE rfx_rlgr_init_once = INIT_ONCE_STATIC_INIT;
 
-static BOOL CALLBACK rfx_rlgr_init(PINIT_ONCE once, PVOID param, PVOID* context)
-{
-	g_LZCNT = IsProcessorFeaturePresentEx(PF_EX_LZCNT);
-	return TRUE;
-}
-
 static INLINE UINT32 lzcnt_s(UINT32 x)
 {
 	if (!x)
@@ -126,14 +119,171 @@ static INLINE UINT32 lzcnt_s(UINT32 x)
 	return __lzcnt(x);
 }
 
+static INLINE UINT32 lzcnt64_s(UINT64 x)
+{
+	const UINT32 hi = (UINT32)(x >> 32);
+
+	if (hi)
+		return lzcnt_s(hi);
+
+	return 32 + lzcnt_s((UINT32)x);
+}
+
+/*
+ * The decoder reads from a 64 bit window holding the next input bits MSB
+ * aligned, so a complete code word (unary prefix, terminating bit and
+ * remainder) is normally extracted from the window without touching the
+ * input again.
+ */
+typedef struct
+{
+	const BYTE* src;
+	const BYTE* end;
+	UINT64 window;
+	UINT32 bits;      /* valid bits in window */
+	size_t remaining; /* bits left in the input, including the ones in window */
+} RFX_RLGR_READER;
+
+/* Refills the window, callers only do so with less than 32 valid bits left */
+static INLINE void rfx_rlgr_reader_fill(RFX_RLGR_READER* r)
+{
+	if (r->end - r->src >= 8)
+	{
+		const BYTE* s = r->src;
+		const UINT32 nbytes = (64 - r->bits) >> 3;
+		const UINT64 val = ((UINT64)s[0] << 56) | ((UINT64)s[1] << 48) | ((UINT64)s[2] << 40) |
+		                   ((UINT64)s[3] << 32) | ((UINT64)s[4] << 24) | ((UINT64)s[5] << 16) |
+		                   ((UINT64)s[6] << 8) | ((UINT64)s[7]);
+
+		/* only take the whole bytes that fit, the window stays zero behind the valid bits */
+		if (r->bits + nbytes * 8 < 64)
+			r->window |= (val >> r->bits) & ~(UINT64_MAX >> (r->bits + nbytes * 8));
+		else
+			r->window |= val >> r->bits;
+
+		r->src += nbytes;
+		r->bits += nbytes * 8;
+		return;
+	}
+
+	while ((r->bits <= 56) && (r->src < r->end))
+	{
+		r->window |= ((UINT64)*r->src++) << (56 - r->bits);
+		r->bits += 8;
+	}
+}
+
+/* Returns the next nbits (0 to 32) bits, the caller checks that enough bits are remaining */
+static INLINE UINT32 rfx_rlgr_reader_get(RFX_RLGR_READER* r, UINT32 nbits)
+{
+	UINT32 val;
+
+	if (nbits == 0)
+		return 0;
+
+	if (r->bits < nbits)
+		rfx_rlgr_reader_fill(r);
+
+	val = (UINT32)(r->window >> (64 - nbits));
+	r->window <<= nbits;
+	r->bits -= nbits;
+	r->remaining -= nbits;
+	return val;
+}
+
+/* Consumes and counts the leading 0s (or 1s), stops at the end of the input */
+static INLINE size_t rfx_rlgr_reader_count(RFX_RLGR_READER* r, BOOL ones)
+{
+	size_t count = 0;
+
+	for (;;)
+	{
+		UINT32 cnt;
+
+		if (r->bits < 32)
+			rfx_rlgr_reader_fill(r);
+
+		if (r->bits == 0)
+			return count;
+
+		cnt = lzcnt64_s(ones ? ~r->window : r->window);
+
+		if (cnt < r->bits)
+		{
+			r->window <<= cnt;
+			r->bits -= cnt;
+			r->remaining -= cnt;
+			return count + cnt;
+		}
+
+		count += r->bits;
+		r->remaining -= r->bits;
+		r->window = 0;
+		r->bits = 0;
+	}
+}
+
+/*
+ * Number of 0 flags in RL mode after which kp is at KPMAX for any start value.
+ * g_RunLength[kp][n] is the zero run length encoded by n flags starting at kp,
+ * every further flag adds (1 << (KPMAX >> LSGR)).
+ */
+#define RL_SATURATION_STEPS ((KPMAX + UP_GR - 1) / UP_GR)
+
+static UINT32 g_RunLength[KPMAX + 1][RL_SATURATION_STEPS + 1];
+
+static INLINE size_t rfx_rlgr_run_length(INT32* kp, size_t vk)
+{
+	size_t run;
+
+	if (vk >= RL_SATURATION_STEPS)
+	{
+		run = g_RunLength[*kp][RL_SATURATION_STEPS];
+		run += (vk - RL_SATURATION_STEPS) << (KPMAX >> LSGR);
+		*kp = KPMAX;
+		return run;
+	}
+
+	run = g_RunLength[*kp][vk];
+	*kp += (INT32)vk * UP_GR;
+
+	if (*kp > KPMAX)
+		*kp = KPMAX;
+
+	return run;
+}
+
+static BOOL CALLBACK rfx_rlgr_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	INT32 kp;
+	size_t n;
+
+	g_LZCNT = IsProcessorFeaturePresentEx(PF_EX_LZCNT);
+
+	for (kp = 0; kp <= KPMAX; kp++)
+	{
+		INT32 p = kp;
+		g_RunLength[kp][0] = 0;
+
+		for (n = 1; n <= RL_SATURATION_STEPS; n++)
+		{
+			g_RunLength[kp][n] = g_RunLength[kp][n - 1] + (1 << (p >> LSGR));
+			p += UP_GR;
+
+			if (p > KPMAX)
+				p = KPMAX;
+		}
+	}
+
+	return TRUE;
+}
+
 int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData,
                     UINT32 DstSize)
 {
-	int vk;
-	int run;
-	int cnt;
-	int size;
-	int nbits;
+	size_t vk;
+	size_t run;
+	size_t size;
 	size_t offset;
 	INT16 mag;
 	UINT32 k;
@@ -141,13 +291,14 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 	UINT32 kr;
 	INT32 krp;
 	UINT16 code;
+	UINT32 bits;
 	UINT32 sign;
 	UINT32 nIdx;
 	UINT32 val1;
 	UINT32 val2;
 	INT16* pOutput;
-	wBitStream* bs;
-	wBitStream s_bs;
+	const INT16* pEnd;
+	RFX_RLGR_READER r;
 
 	InitOnceExecuteOnce(&rfx_rlgr_init_once, rfx_rlgr_init, NULL, NULL);
 
@@ -167,130 +318,51 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 		return -1;
 
 	pOutput = pDstData;
+	pEnd = pDstData + DstSize;
 
-	bs = &s_bs;
+	r.src = pSrcData;
+	r.end = pSrcData + SrcSize;
+	r.window = 0;
+	r.bits = 0;
+	r.remaining = SrcSize * 8ull;
 
-	BitStream_Attach(bs, pSrcData, SrcSize);
-	BitStream_Fetch(bs);
-
-	while ((BitStream_GetRemainingLength(bs) > 0) && ((pOutput - pDstData) < DstSize))
+	while ((r.remaining > 0) && (pOutput < pEnd))
 	{
 		if (k)
 		{
 			/* Run-Length (RL) Mode */
 
-			run = 0;
-
 			/* count number of leading 0s */
 
-			cnt = lzcnt_s(bs->accumulator);
-
-			nbits = BitStream_GetRemainingLength(bs);
-
-			if (cnt > nbits)
-				cnt = nbits;
-
-			vk = cnt;
-
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
-			{
-				BitStream_Shift32(bs);
-
-				cnt = lzcnt_s(bs->accumulator);
-
-				nbits = BitStream_GetRemainingLength(bs);
-
-				if (cnt > nbits)
-					cnt = nbits;
-
-				vk += cnt;
-			}
-
-			BitStream_Shift(bs, (vk % 32));
-
-			if (BitStream_GetRemainingLength(bs) < 1)
-				break;
+			vk = rfx_rlgr_reader_count(&r, FALSE);
 
-			BitStream_Shift(bs, 1);
+			/* add (1 << k) to run length for each 0, updating k, kp params */
 
-			while (vk--)
-			{
-				run += (1 << k); /* add (1 << k) to run length */
-
-				/* update k, kp params */
-
-				kp += UP_GR;
-
-				if (kp > KPMAX)
-					kp = KPMAX;
-
-				k = kp >> LSGR;
-			}
-
-			/* next k bits contain run length remainder */
-
-			if (BitStream_GetRemainingLength(bs) < k)
-				break;
-
-			bs->mask = ((1 << k) - 1);
-			run += ((bs->accumulator >> (32 - k)) & bs->mask);
-			BitStream_Shift(bs, k);
+			run = rfx_rlgr_run_length(&kp, vk);
+			k = kp >> LSGR;
 
-			/* read sign bit */
+			/* terminating 1, k bits run length remainder and the sign bit */
 
-			if (BitStream_GetRemainingLength(bs) < 1)
+			if (r.remaining < k + 2)
 				break;
 
-			sign = (bs->accumulator & 0x80000000) ? 1 : 0;
-			BitStream_Shift(bs, 1);
+			bits = rfx_rlgr_reader_get(&r, k + 2);
+			run += (bits >> 1) & ((1 << k) - 1);
+			sign = bits & 1;
 
 			/* count number of leading 1s */
 
-			cnt = lzcnt_s(~(bs->accumulator));
-
-			nbits = BitStream_GetRemainingLength(bs);
-
-			if (cnt > nbits)
-				cnt = nbits;
-
-			vk = cnt;
-
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
-			{
-				BitStream_Shift32(bs);
-
-				cnt = lzcnt_s(~(bs->accumulator));
+			vk = rfx_rlgr_reader_count(&r, TRUE);
 
-				nbits = BitStream_GetRemainingLength(bs);
+			/* terminating 0 and kr bits code remainder */
 
-				if (cnt > nbits)
-					cnt = nbits;
-
-				vk += cnt;
-			}
-
-			BitStream_Shift(bs, (vk % 32));
-
-			if (BitStream_GetRemainingLength(bs) < 1)
+			if (r.remaining < kr + 1)
 				break;
 
-			BitStream_Shift(bs, 1);
-
-			/* next kr bits contain code remainder */
-
-			if (BitStream_GetRemainingLength(bs) < kr)
-				break;
-
-			bs->mask = ((1 << kr) - 1);
-			if (kr > 0)
-				code = (UINT16)((bs->accumulator >> (32 - kr)) & bs->mask);
-			else
-				code = 0;
-			BitStream_Shift(bs, kr);
-
 			/* add (vk << kr) to code */
 
-			code |= (vk << kr);
+			bits = rfx_rlgr_reader_get(&r, kr + 1);
+			code = (UINT16)((bits & ((1 << kr) - 1)) | ((UINT32)vk << kr));
 
 			if (!vk)
 			{
@@ -307,7 +379,10 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 			{
 				/* update kr, krp params */
 
-				krp += vk;
+				if (vk > KPMAX)
+					krp = KPMAX;
+				else
+					krp += (INT32)vk;
 
 				if (krp > KPMAX)
 					krp = KPMAX;
@@ -333,7 +408,7 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 
 			/* write to output stream */
 
-			offset = (pOutput - pDstData);
+			offset = (size_t)(pOutput - pDstData);
 			size = run;
 
 			if ((offset + size) > DstSize)
@@ -345,7 +420,7 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 				pOutput += size;
 			}
 
-			if ((pOutput - pDstData) < DstSize)
+			if (pOutput < pEnd)
 			{
 				*pOutput = mag;
 				pOutput++;
@@ -357,51 +432,17 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 
 			/* count number of leading 1s */
 
-			cnt = lzcnt_s(~(bs->accumulator));
-
-			nbits = BitStream_GetRemainingLength(bs);
-
-			if (cnt > nbits)
-				cnt = nbits;
-
-			vk = cnt;
-
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
-			{
-				BitStream_Shift32(bs);
-
-				cnt = lzcnt_s(~(bs->accumulator));
-
-				nbits = BitStream_GetRemainingLength(bs);
-
-				if (cnt > nbits)
-					cnt = nbits;
-
-				vk += cnt;
-			}
-
-			BitStream_Shift(bs, (vk % 32));
-
-			if (BitStream_GetRemainingLength(bs) < 1)
-				break;
-
-			BitStream_Shift(bs, 1);
+			vk = rfx_rlgr_reader_count(&r, TRUE);
 
-			/* next kr bits contain code remainder */
+			/* terminating 0 and kr bits code remainder */
 
-			if (BitStream_GetRemainingLength(bs) < kr)
+			if (r.remaining < kr + 1)
 				break;
 
-			bs->mask = ((1 << kr) - 1);
-			if (kr > 0)
-				code = (UINT16)((bs->accumulator >> (32 - kr)) & bs->mask);
-			else
-				code = 0;
-			BitStream_Shift(bs, kr);
-
 			/* add (vk << kr) to code */
 
-			code |= (vk << kr);
+			bits = rfx_rlgr_reader_get(&r, kr + 1);
+			code = (UINT16)((bits & ((1 << kr) - 1)) | ((UINT32)vk << kr));
 
 			if (!vk)
 			{
@@ -418,7 +459,10 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 			{
 				/* update kr, krp params */
 
-				krp += vk;
+				if (vk > KPMAX)
+					krp = KPMAX;
+				else
+					krp += (INT32)vk;
 
 				if (krp > KPMAX)
 					krp = KPMAX;
@@ -463,7 +507,7 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 						mag = (INT16)(code >> 1);
 				}
 
-				if ((pOutput - pDstData) < DstSize)
+				if (pOutput < pEnd)
 				{
 					*pOutput = mag;
 					pOutput++;
@@ -474,21 +518,12 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 				nIdx = 0;
 
 				if (code)
-				{
-					mag = (UINT32)code;
-					nIdx = 32 - lzcnt_s(mag);
-				}
+					nIdx = 32 - lzcnt_s(code);
 
-				if (BitStream_GetRemainingLength(bs) < nIdx)
+				if (r.remaining < nIdx)
 					break;
 
-				bs->mask = ((1 << nIdx) - 1);
-				if (nIdx > 0)
-					val1 = ((bs->accumulator >> (32 - nIdx)) & bs->mask);
-				else
-					val1 = 0;
-				BitStream_Shift(bs, nIdx);
-
+				val1 = rfx_rlgr_reader_get(&r, nIdx);
 				val2 = code - val1;
 
 				if (val1 && val2)
@@ -519,7 +554,7 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 				else
 					mag = (INT16)(val1 >> 1);
 
-				if ((pOutput - pDstData) < DstSize)
+				if (pOutput < pEnd)
 				{
 					*pOutput = mag;
 					pOutput++;
@@ -530,7 +565,7 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 				else
 					mag = (INT16)(val2 >> 1);
 
-				if ((pOutput - pDstData) < DstSize)
+				if (pOutput < pEnd)
 				{
 					*pOutput = mag;
 					pOutput++;
@@ -539,7 +574,7 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 		}
 	}
 
-	offset = (pOutput - pDstData);
+	offset = (size_t)(pOutput - pDstData);
 
 	if (offset < DstSize)
 	{
@@ -548,7 +583,7 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 		pOutput += size;
 	}
 
-	offset = (pOutput - pDstData);
+	offset = (size_t)(pOutput - pDstData);
 
 	if (offset != DstSize)
 		return -1;
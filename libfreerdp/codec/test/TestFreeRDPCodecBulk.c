@@ -0,0 +1,387 @@
+#include <winpr/crt.h>
+#include <winpr/path.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/settings.h>
+#include <freerdp/codec/bulk.h>
+#include <freerdp/utils/pcap.h>
+#include <freerdp/utils/stopwatch.h>
+
+#include "../../core/bulk.h"
+
+/**
+ * Bulk compression benchmark.
+ *
+ * Every record of the traffic goes through bulk_compress of a sender and bulk_decompress of a
+ * receiver, once per compression type with that type negotiated as CompressionLevel. Records
+ * larger than a type takes in one packet are compressed in chunks sharing the history, like
+ * fast-path fragments. The report shows the bytes saved and the time spent per compression
+ * type and per record size class: up to 50 bytes bulk_compress sends packets as they are,
+ * from 16384 bytes on XCrush takes them in chunks.
+ *
+ * TestFreeRDPCodec TestFreeRDPCodecBulk [capture.pcap]
+ *
+ * The traffic is read from a pcap file as written by libfreerdp/utils/pcap.c (/rfx-dump), without
+ * one a bitmap of the test directory is cut into records of mixed sizes.
+ */
+
+#define BULK_SIZE_CLASSES 3
+
+static const char* BULK_SIZE_CLASS_NAMES[BULK_SIZE_CLASSES] = { "<= 50", "51 - 16383",
+	                                                            ">= 16384" };
+
+struct _BULK_RECORD
+{
+	BYTE* data;
+	UINT32 length;
+};
+typedef struct _BULK_RECORD BULK_RECORD;
+
+struct _BULK_TRAFFIC
+{
+	BULK_RECORD* records;
+	size_t count;
+	size_t capacity;
+};
+typedef struct _BULK_TRAFFIC BULK_TRAFFIC;
+
+struct _BULK_RESULT
+{
+	UINT64 packets;
+	UINT64 uncompressed[BULK_SIZE_CLASSES];
+	UINT64 compressed[BULK_SIZE_CLASSES];
+	STOPWATCH compressTime;
+	STOPWATCH decompressTime;
+};
+typedef struct _BULK_RESULT BULK_RESULT;
+
+struct _BULK_CODEC
+{
+	const char* name;
+	UINT32 type;
+	UINT32 maxSize;
+};
+typedef struct _BULK_CODEC BULK_CODEC;
+
+/* one end of a connection that negotiated the compression type of the codec */
+struct _BULK_PEER
+{
+	freerdp* instance;
+	rdpBulk* bulk;
+};
+typedef struct _BULK_PEER BULK_PEER;
+
+static BOOL bulk_traffic_add(BULK_TRAFFIC* traffic, const BYTE* data, UINT32 length)
+{
+	BULK_RECORD* record;
+
+	if (traffic->count == traffic->capacity)
+	{
+		const size_t capacity = traffic->capacity ? traffic->capacity * 2 : 256;
+		BULK_RECORD* records = realloc(traffic->records, capacity * sizeof(BULK_RECORD));
+
+		if (!records)
+			return FALSE;
+
+		traffic->records = records;
+		traffic->capacity = capacity;
+	}
+
+	record = &traffic->records[traffic->count];
+	record->data = malloc(length);
+
+	if (!record->data)
+		return FALSE;
+
+	CopyMemory(record->data, data, length);
+	record->length = length;
+	traffic->count++;
+	return TRUE;
+}
+
+static void bulk_traffic_free(BULK_TRAFFIC* traffic)
+{
+	size_t index;
+
+	for (index = 0; index < traffic->count; index++)
+		free(traffic->records[index].data);
+
+	free(traffic->records);
+}
+
+static BOOL bulk_traffic_load_pcap(BULK_TRAFFIC* traffic, const char* name)
+{
+	BOOL rc = FALSE;
+	BYTE* buffer = NULL;
+	pcap_record record;
+	rdpPcap* pcap = pcap_open((char*)name, FALSE);
+
+	if (!pcap)
+		return FALSE;
+
+	while (pcap_has_next_record(pcap))
+	{
+		BYTE* tmp;
+
+		if (!pcap_get_next_record_header(pcap, &record))
+			goto fail;
+
+		tmp = realloc(buffer, record.length ? record.length : 1);
+
+		if (!tmp)
+			goto fail;
+
+		buffer = tmp;
+		record.data = buffer;
+
+		if (!pcap_get_next_record_content(pcap, &record))
+			goto fail;
+
+		if (!bulk_traffic_add(traffic, buffer, record.length))
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	free(buffer);
+	pcap_close(pcap);
+	return rc;
+}
+
+static BOOL bulk_traffic_load_bitmap(BULK_TRAFFIC* traffic, const char* name)
+{
+	/* a mix of small orders, single fast-path fragments and large surface commands */
+	static const UINT32 sizes[] = { 24, 40, 120, 1500, 4096, 9000, 16383, 24000, 60000 };
+	BOOL rc = FALSE;
+	size_t index = 0;
+	size_t offset = 0;
+	size_t length;
+	BYTE* data = NULL;
+	FILE* fp = winpr_fopen(name, "rb");
+
+	if (!fp)
+		return FALSE;
+
+	if ((_fseeki64(fp, 0, SEEK_END) != 0) || ((length = (size_t)_ftelli64(fp)) == 0) ||
+	    (_fseeki64(fp, 0, SEEK_SET) != 0))
+		goto fail;
+
+	data = malloc(length);
+
+	if (!data || (fread(data, 1, length, fp) != length))
+		goto fail;
+
+	while (offset < length)
+	{
+		const UINT32 size = (UINT32)MIN(sizes[index++ % ARRAYSIZE(sizes)], length - offset);
+
+		if (!bulk_traffic_add(traffic, &data[offset], size))
+			goto fail;
+
+		offset += size;
+	}
+
+	rc = TRUE;
+fail:
+	free(data);
+	fclose(fp);
+	return rc;
+}
+
+static BOOL bulk_peer_new(BULK_PEER* peer, UINT32 type, BOOL server)
+{
+	rdpSettings* settings;
+
+	if (!(peer->instance = freerdp_new()) || !freerdp_context_new(peer->instance))
+		return FALSE;
+
+	settings = peer->instance->context->settings;
+	settings->ServerMode = server;
+	settings->CompressionEnabled = TRUE;
+	settings->CompressionLevel = type;
+	peer->bulk = bulk_new(peer->instance->context);
+	return peer->bulk != NULL;
+}
+
+static void bulk_peer_free(BULK_PEER* peer)
+{
+	bulk_free(peer->bulk);
+	peer->bulk = NULL;
+
+	if (peer->instance)
+	{
+		freerdp_context_free(peer->instance);
+		freerdp_free(peer->instance);
+		peer->instance = NULL;
+	}
+}
+
+static BOOL bulk_codec_run(const BULK_CODEC* codec, const BULK_TRAFFIC* traffic,
+                           BULK_RESULT* result)
+{
+	BOOL rc = FALSE;
+	size_t index;
+	BULK_PEER sender = { 0 };
+	BULK_PEER receiver = { 0 };
+	ZeroMemory(result, sizeof(BULK_RESULT));
+
+	if (!bulk_peer_new(&sender, codec->type, TRUE) || !bulk_peer_new(&receiver, codec->type, FALSE))
+		goto fail;
+
+	for (index = 0; index < traffic->count; index++)
+	{
+		const BULK_RECORD* record = &traffic->records[index];
+		const size_t sizeClass = (record->length <= 50) ? 0 : (record->length < 16384) ? 1 : 2;
+		UINT32 offset = 0;
+
+		/* larger records are streamed through the history in chunks */
+		while (offset < record->length)
+		{
+			int status;
+			BYTE* pSrcData = &record->data[offset];
+			UINT32 SrcSize = MIN(record->length - offset, codec->maxSize);
+			BYTE* pDstData = NULL;
+			UINT32 DstSize = 0;
+			BYTE* pDecompressed = NULL;
+			UINT32 DecompressedSize = 0;
+			UINT32 flags = 0;
+			BOOL match;
+
+			stopwatch_start(&result->compressTime);
+			status = bulk_compress(sender.bulk, pSrcData, SrcSize, &pDstData, &DstSize, &flags);
+			stopwatch_stop(&result->compressTime);
+
+			if (status < 0)
+			{
+				printf("%s: compression failed (%d)\n", codec->name, status);
+				goto fail;
+			}
+
+			/* chunks fit the negotiated type, small ones are sent as they are */
+			if ((flags & BULK_COMPRESSION_FLAGS_MASK) &&
+			    ((flags & BULK_COMPRESSION_TYPE_MASK) != codec->type))
+			{
+				printf("%s: compressed with type %" PRIu32 "\n", codec->name,
+				       flags & BULK_COMPRESSION_TYPE_MASK);
+				goto fail;
+			}
+
+			stopwatch_start(&result->decompressTime);
+			status = bulk_decompress(receiver.bulk, pDstData, DstSize, &pDecompressed,
+			                         &DecompressedSize, flags);
+			stopwatch_stop(&result->decompressTime);
+
+			if (status < 0)
+			{
+				printf("%s: decompression failed (%d)\n", codec->name, status);
+				goto fail;
+			}
+
+			match = (DecompressedSize == SrcSize) &&
+			        (memcmp(pDecompressed, pSrcData, SrcSize) == 0);
+
+			if (!match)
+			{
+				printf("%s: round trip mismatch in record %" PRIuz "\n", codec->name, index);
+				goto fail;
+			}
+
+			result->packets++;
+			result->uncompressed[sizeClass] += SrcSize;
+			result->compressed[sizeClass] += DstSize;
+			offset += SrcSize;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	bulk_peer_free(&sender);
+	bulk_peer_free(&receiver);
+	return rc;
+}
+
+static void bulk_codec_report(const BULK_CODEC* codec, const BULK_RESULT* result)
+{
+	size_t sizeClass;
+	UINT64 uncompressed = 0;
+	UINT64 compressed = 0;
+
+	for (sizeClass = 0; sizeClass < BULK_SIZE_CLASSES; sizeClass++)
+	{
+		uncompressed += result->uncompressed[sizeClass];
+		compressed += result->compressed[sizeClass];
+	}
+
+	printf("%-10s packets %8" PRIu64 " in %10" PRIu64 " out %10" PRIu64 " saved %10" PRId64
+	       " (%5.1f%%) compress %8" PRIu64 " us decompress %8" PRIu64 " us",
+	       codec->name, result->packets, uncompressed, compressed,
+	       (INT64)uncompressed - (INT64)compressed,
+	       uncompressed ? 100.0 - 100.0 * (double)compressed / (double)uncompressed : 0.0,
+	       result->compressTime.elapsed, result->decompressTime.elapsed);
+
+	if (result->compressTime.elapsed > 0)
+		printf(" (%.1f MiB/s)", (double)uncompressed / 1024.0 / 1024.0 /
+		                            stopwatch_get_elapsed_time_in_seconds(
+		                                (STOPWATCH*)&result->compressTime));
+
+	printf("\n");
+
+	for (sizeClass = 0; sizeClass < BULK_SIZE_CLASSES; sizeClass++)
+	{
+		printf("%-10s   %-10s in %10" PRIu64 " saved %10" PRId64 "\n", "",
+		       BULK_SIZE_CLASS_NAMES[sizeClass], result->uncompressed[sizeClass],
+		       (INT64)result->uncompressed[sizeClass] - (INT64)result->compressed[sizeClass]);
+	}
+}
+
+int TestFreeRDPCodecBulk(int argc, char* argv[])
+{
+	int rc = -1;
+	size_t index;
+	BULK_TRAFFIC traffic = { 0 };
+	const BULK_CODEC codecs[] = {
+		{ "MPPC 8K", PACKET_COMPR_TYPE_8K, 8192 },
+		{ "MPPC 64K", PACKET_COMPR_TYPE_64K, 65535 },
+		{ "NCrush", PACKET_COMPR_TYPE_RDP6, 32760 },
+		{ "XCrush", PACKET_COMPR_TYPE_RDP61, 16384 },
+		{ "RDP8", PACKET_COMPR_TYPE_RDP8, 65534 },
+	};
+
+	if (argc > 1)
+	{
+		if (!bulk_traffic_load_pcap(&traffic, argv[1]))
+		{
+			printf("failed to read %s\n", argv[1]);
+			goto fail;
+		}
+	}
+	else
+	{
+		char* name = GetCombinedPath(CMAKE_CURRENT_SOURCE_DIR, "progressive.bmp");
+
+		if (!name || !bulk_traffic_load_bitmap(&traffic, name))
+		{
+			free(name);
+			goto fail;
+		}
+
+		free(name);
+	}
+
+	printf("%" PRIuz " records\n", traffic.count);
+
+	for (index = 0; index < ARRAYSIZE(codecs); index++)
+	{
+		BULK_RESULT result;
+
+		if (!bulk_codec_run(&codecs[index], &traffic, &result))
+			goto fail;
+
+		bulk_codec_report(&codecs[index], &result);
+	}
+
+	rc = 0;
+fail:
+	bulk_traffic_free(&traffic);
+	return rc;
+}
@@ -67,6 +67,182 @@ fail:
 	return rc;
 }
 
+/* The natural image part starts on an encoder tile boundary */
+#define TEST_CLEAR_LOSSY_X 192
+#define TEST_CLEAR_LOSSY_Y 104
+
+static void test_ClearFillImage(BYTE* data, UINT32 width, UINT32 height, UINT32 seed)
+{
+	UINT32 x, y;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			BYTE* pixel = &data[(y * width + x) * 4];
+			UINT32 color = 0xFFFFFF;
+
+			if (y < TEST_CLEAR_LOSSY_Y)
+			{
+				/* Text like: lines of repeated 8x13 glyph cells on a white background */
+				const UINT32 gx = x % 8;
+				const UINT32 gy = y % 13;
+				const UINT32 glyph = ((x / 8) * 7 + (y / 13) + seed) % 5;
+
+				if ((gy > 2) && (gy < 11) && (((gx * 7 + gy * 3 + glyph) % 5) == 0))
+					color = 0x202020 + glyph * 0x101010;
+			}
+			else if (x < TEST_CLEAR_LOSSY_X)
+			{
+				/* Few colors, UI widgets */
+				color = ((x / 16 + y / 16) % 3) * 0x3F5F7F;
+			}
+			else
+			{
+				/* Natural image */
+				seed = seed * 1103515245 + 12345;
+				color = ((x * 3) & 0xFF) | (((y * 5) & 0xFF) << 8) | (((seed >> 16) & 0x0F) << 16);
+			}
+
+			pixel[0] = color & 0xFF;
+			pixel[1] = (color >> 8) & 0xFF;
+			pixel[2] = (color >> 16) & 0xFF;
+			pixel[3] = 0xFF;
+		}
+	}
+}
+
+static BOOL test_ClearCompareImage(const BYTE* expected, const BYTE* actual, UINT32 width,
+                                   UINT32 height, UINT32 lossyX, UINT32 lossyY)
+{
+	UINT32 x, y, i;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			const BYTE* a = &expected[(y * width + x) * 4];
+			const BYTE* b = &actual[(y * width + x) * 4];
+			/* NSCodec is lossy, allow some deviation in the natural image area */
+			const int tolerance = ((x >= lossyX) && (y >= lossyY)) ? 32 : 0;
+
+			for (i = 0; i < 3; i++)
+			{
+				if (abs((int)a[i] - (int)b[i]) > tolerance)
+				{
+					printf("pixel mismatch at %" PRIu32 "x%" PRIu32 "\n", x, y);
+					return FALSE;
+				}
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL test_ClearCompressRoundTrip(void)
+{
+	BOOL rc = FALSE;
+	UINT32 frame;
+	UINT32 lastSize = 0;
+	const UINT32 width = 300;
+	const UINT32 height = 180;
+	BYTE* pSrcData = calloc(width * height, 4);
+	BYTE* pDstData = calloc(width * height, 4);
+	CLEAR_CONTEXT* encoder = clear_context_new(TRUE);
+	CLEAR_CONTEXT* decoder = clear_context_new(FALSE);
+
+	if (!pSrcData || !pDstData || !encoder || !decoder)
+		goto fail;
+
+	for (frame = 0; frame < 4; frame++)
+	{
+		int status;
+		BYTE* pData = NULL;
+		UINT32 size = 0;
+		/* Frames 0 and 1 are identical, the second one has to hit the vBar cache */
+		test_ClearFillImage(pSrcData, width, height, (frame < 2) ? 0 : frame);
+		status = clear_compress_ex(encoder, pSrcData, PIXEL_FORMAT_BGRA32, width * 4, width,
+		                           height, &pData, &size);
+
+		if (status < 0)
+			goto fail;
+
+		status = clear_decompress(decoder, pData, size, width, height, pDstData,
+		                          PIXEL_FORMAT_BGRA32, width * 4, 0, 0, width, height, NULL);
+		free(pData);
+		printf("clear_compress_ex frame %" PRIu32 ": %" PRIu32 " bytes, status %d\n", frame, size,
+		       status);
+
+		if (status != 0)
+			goto fail;
+
+		if (!test_ClearCompareImage(pSrcData, pDstData, width, height, TEST_CLEAR_LOSSY_X,
+		                            TEST_CLEAR_LOSSY_Y))
+			goto fail;
+
+		if ((frame == 1) && (size >= lastSize))
+			goto fail;
+
+		lastSize = size;
+	}
+
+	rc = TRUE;
+fail:
+	clear_context_free(encoder);
+	clear_context_free(decoder);
+	free(pSrcData);
+	free(pDstData);
+	return rc;
+}
+
+static BOOL test_ClearCompressGlyph(void)
+{
+	BOOL rc = FALSE;
+	UINT32 i;
+	const UINT32 width = 8;
+	const UINT32 height = 12;
+	BYTE pSrcData[8 * 12 * 4];
+	BYTE pDstData[8 * 12 * 4];
+	CLEAR_CONTEXT* encoder = clear_context_new(TRUE);
+	CLEAR_CONTEXT* decoder = clear_context_new(FALSE);
+
+	if (!encoder || !decoder)
+		goto fail;
+
+	test_ClearFillImage(pSrcData, width, height, 3);
+
+	for (i = 0; i < 2; i++)
+	{
+		int status;
+		BYTE* pData = NULL;
+		UINT32 size = 0;
+		memset(pDstData, 0, sizeof(pDstData));
+		status = clear_compress_ex(encoder, pSrcData, PIXEL_FORMAT_BGRA32, width * 4, width,
+		                           height, &pData, &size);
+
+		if (status < 0)
+			goto fail;
+
+		status = clear_decompress(decoder, pData, size, width, height, pDstData,
+		                          PIXEL_FORMAT_BGRA32, width * 4, 0, 0, width, height, NULL);
+		free(pData);
+
+		/* The second time only the glyph cache index is sent */
+		if ((status != 0) || ((i == 1) && (size != 4)))
+			goto fail;
+
+		if (!test_ClearCompareImage(pSrcData, pDstData, width, height, width, height))
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	clear_context_free(encoder);
+	clear_context_free(decoder);
+	return rc;
+}
+
 int TestFreeRDPCodecClear(int argc, char* argv[])
 {
 	WINPR_UNUSED(argc);
@@ -86,5 +262,11 @@ int TestFreeRDPCodecClear(int argc, char* argv[])
 	if (!test_ClearDecompressExample(4, 7, 15, TEST_CLEAR_EXAMPLE_4, sizeof(TEST_CLEAR_EXAMPLE_4)))
 		return -1;
 
+	if (!test_ClearCompressRoundTrip())
+		return -1;
+
+	if (!test_ClearCompressGlyph())
+		return -1;
+
 	return 0;
 }
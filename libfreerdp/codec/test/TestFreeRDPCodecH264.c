@@ -0,0 +1,309 @@
+#include <winpr/crt.h>
+#include <winpr/print.h>
+
+#include <freerdp/log.h>
+#include <freerdp/codec/h264.h>
+#include <freerdp/codec/yuv.h>
+#include <freerdp/codec/color.h>
+
+/* no multiple of 16, the planes are padded to full macroblock rows */
+#define TEST_H264_HEIGHT 70
+#define TEST_H264_MAX_WIDTH 128
+#define TEST_H264_STEP (TEST_H264_MAX_WIDTH * 4)
+
+/* what the stand in encoder saw of the last frame */
+static BOOL test_h264_aligned = TRUE;
+static BOOL test_h264_full_rows = FALSE;
+static UINT32 test_h264_width = 0;
+static UINT32 test_h264_changed = 0;
+
+/*
+ * Stand in for the encoder, the test only looks at the YUV planes and does not need an
+ * encoder to be built. It checks the changed rectangles handed to the subsystem.
+ */
+static int test_h264_compress(H264_CONTEXT* h264, const BYTE** pSrcYuv, const UINT32* pStride,
+                              BYTE** ppDstData, UINT32* pDstSize)
+{
+	UINT32 index;
+	static BYTE frame[1];
+	WINPR_UNUSED(pSrcYuv);
+	WINPR_UNUSED(pStride);
+
+	for (index = 0; index < h264->numChangedRects; index++)
+	{
+		const RECTANGLE_16* rect = &h264->changedRects[index];
+
+		if ((rect->left % 16) || (rect->top % 16) ||
+		    ((rect->right % 16) && (rect->right != test_h264_width)) ||
+		    ((rect->bottom % 16) && (rect->bottom != TEST_H264_HEIGHT)))
+			test_h264_aligned = FALSE;
+
+		if (test_h264_full_rows && ((rect->left != 0) || (rect->right != test_h264_width)))
+			test_h264_aligned = FALSE;
+	}
+
+	test_h264_changed = h264->numChangedRects;
+	*ppDstData = frame;
+	*pDstSize = sizeof(frame);
+	return 1;
+}
+
+static void test_h264_uninit(H264_CONTEXT* h264)
+{
+	WINPR_UNUSED(h264);
+}
+
+static H264_CONTEXT_SUBSYSTEM test_h264_subsystem = { "test", NULL, test_h264_uninit, NULL,
+	                                                  test_h264_compress };
+
+/* without an encoder h264_context_new fails, the context is then set up like it does */
+static H264_CONTEXT* test_h264_context_new(H264_CONTEXT_SUBSYSTEM** subsystem)
+{
+	H264_CONTEXT* h264 = h264_context_new(TRUE);
+
+	if (!h264)
+	{
+		h264 = (H264_CONTEXT*)calloc(1, sizeof(H264_CONTEXT));
+
+		if (!h264)
+			return NULL;
+
+		h264->Compressor = TRUE;
+		h264->log = WLog_Get(FREERDP_TAG("codec.test"));
+		h264->subsystem = &test_h264_subsystem;
+
+		if (!(h264->yuv = yuv_context_new(TRUE)))
+		{
+			free(h264);
+			return NULL;
+		}
+	}
+
+	*subsystem = h264->subsystem;
+	h264->subsystem = &test_h264_subsystem;
+	return h264;
+}
+
+static void test_h264_context_free(H264_CONTEXT* h264, H264_CONTEXT_SUBSYSTEM* subsystem)
+{
+	UINT32 index;
+
+	if (!h264)
+		return;
+
+	for (index = 0; index < 3; index++)
+	{
+		_aligned_free(h264->pYUVData[index]);
+		h264->pYUVData[index] = NULL;
+	}
+
+	h264->subsystem = subsystem;
+	h264_context_free(h264);
+}
+
+static void test_h264_clear_planes(H264_CONTEXT* h264)
+{
+	UINT32 index;
+
+	for (index = 0; index < 3; index++)
+	{
+		ZeroMemory(h264->pYUVData[index], h264->iStride[index] * h264->height);
+
+		if (h264->pYUV444Data[index])
+			ZeroMemory(h264->pYUV444Data[index], h264->iYUV444Size[index]);
+	}
+}
+
+static void test_h264_fill(BYTE* image, const RECTANGLE_16* rect, UINT32 seed)
+{
+	UINT32 x;
+	UINT32 y;
+
+	for (y = rect->top; y < rect->bottom; y++)
+	{
+		for (x = rect->left; x < rect->right; x++)
+		{
+			const UINT32 value = (x * 7 + y * 13 + seed) * 2654435761U;
+			WriteColor(&image[y * TEST_H264_STEP + x * 4], PIXEL_FORMAT_BGRX32,
+			           FreeRDPGetColor(PIXEL_FORMAT_BGRX32, (BYTE)(value >> 8),
+			                           (BYTE)(value >> 16), (BYTE)(value >> 24), 0xFF));
+		}
+	}
+}
+
+/* the visible part of the planes, laid out like a 4:2:0 frame in both views */
+static BOOL test_h264_compare_planes(const char* name, BYTE* const a[3], BYTE* const b[3],
+                                     const UINT32 stride[3])
+{
+	UINT32 plane;
+
+	for (plane = 0; plane < 3; plane++)
+	{
+		UINT32 y;
+		const UINT32 width = plane ? (test_h264_width + 1) / 2 : test_h264_width;
+		const UINT32 height = plane ? (TEST_H264_HEIGHT + 1) / 2 : TEST_H264_HEIGHT;
+
+		for (y = 0; y < height; y++)
+		{
+			if (memcmp(&a[plane][y * stride[plane]], &b[plane][y * stride[plane]], width) != 0)
+			{
+				fprintf(stderr, "%s: plane %" PRIu32 " differs in row %" PRIu32 "\n", name,
+				        plane, y);
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static INT32 test_h264_compress_frame(H264_CONTEXT* h264, const BYTE* image, BYTE version,
+                                      const REGION16* region)
+{
+	BYTE op;
+	BYTE* pDstData;
+	UINT32 DstSize;
+	BYTE* pAuxDstData;
+	UINT32 AuxDstSize;
+
+	if (version == 0)
+		return avc420_compress_region(h264, image, PIXEL_FORMAT_BGRX32, TEST_H264_STEP,
+		                              test_h264_width, TEST_H264_HEIGHT, region, &pDstData,
+		                              &DstSize);
+
+	return avc444_compress_region(h264, image, PIXEL_FORMAT_BGRX32, TEST_H264_STEP,
+	                              test_h264_width, TEST_H264_HEIGHT, version, region, &op,
+	                              &pDstData, &DstSize, &pAuxDstData, &AuxDstSize);
+}
+
+/**
+ * Updates the planes of one context with the changed regions and converts each frame
+ * completely with another one, the planes have to be the same after every frame.
+ * version 0 is AVC420.
+ */
+static BOOL test_h264_region(const char* name, BYTE version, UINT32 width)
+{
+	BOOL rc = FALSE;
+	UINT32 frame;
+	UINT32 index;
+	BYTE* image = NULL;
+	H264_CONTEXT* region = NULL;
+	H264_CONTEXT* full = NULL;
+	H264_CONTEXT_SUBSYSTEM* regionSubsystem = NULL;
+	H264_CONTEXT_SUBSYSTEM* fullSubsystem = NULL;
+	const RECTANGLE_16 all = { 0, 0, (UINT16)width, TEST_H264_HEIGHT };
+	/* odd positions and sizes, the last partial macroblock row and column, one outside */
+	const RECTANGLE_16 changes[] = { { 5, 3, 21, 9 },     { 40, 33, 41, 34 }, { 17, 17, 18, 47 },
+		                             { 90, 60, 100, 70 }, { 0, 65, 3, 70 },   { 99, 0, 100, 1 },
+		                             { 31, 31, 50, 50 },  { 60, 20, 95, 29 } };
+
+	/* the optimized primitives need aligned lines */
+	if (!(image = _aligned_malloc(TEST_H264_HEIGHT * TEST_H264_STEP, 16)))
+		goto fail;
+
+	test_h264_width = width;
+
+	if (!(region = test_h264_context_new(&regionSubsystem)) ||
+	    !(full = test_h264_context_new(&fullSubsystem)))
+		goto fail;
+
+	test_h264_fill(image, &all, 0);
+	test_h264_full_rows = (version == 2) || (width % 16 != 0);
+
+	/*
+	 * The conversions leave some rows of the padded planes alone, like the B45 rows of a
+	 * partial macroblock row. Clear them in both contexts once the planes are allocated.
+	 */
+	for (index = 0; index < 2; index++)
+	{
+		if ((test_h264_compress_frame(region, image, version, NULL) < 0) ||
+		    (test_h264_compress_frame(full, image, version, NULL) < 0))
+			goto fail;
+
+		if (index == 0)
+		{
+			test_h264_clear_planes(region);
+			test_h264_clear_planes(full);
+		}
+	}
+
+	for (frame = 0; frame < ARRAYSIZE(changes); frame++)
+	{
+		REGION16 invalid;
+		region16_init(&invalid);
+
+		/* the changes of two frames overlap, later frames change more at once */
+		for (index = frame / 2; index <= frame; index++)
+		{
+			test_h264_fill(image, &changes[index], frame + 1);
+			region16_union_rect(&invalid, &invalid, &changes[index]);
+		}
+
+		if (frame == ARRAYSIZE(changes) - 1)
+		{
+			const RECTANGLE_16 outside = { 200, 200, 210, 210 };
+			region16_union_rect(&invalid, &invalid, &outside);
+		}
+
+		test_h264_aligned = TRUE;
+		test_h264_changed = 0;
+
+		if (test_h264_compress_frame(region, image, version, &invalid) < 0)
+		{
+			region16_uninit(&invalid);
+			goto fail;
+		}
+
+		region16_uninit(&invalid);
+
+		if (!test_h264_aligned || (test_h264_changed == 0))
+		{
+			fprintf(stderr, "%s: frame %" PRIu32 " changed rectangles are not aligned\n", name,
+			        frame);
+			goto fail;
+		}
+
+		if (test_h264_compress_frame(full, image, version, NULL) < 0)
+			goto fail;
+
+		if (!test_h264_compare_planes(name, region->pYUVData, full->pYUVData, full->iStride))
+			goto fail;
+
+		if ((version != 0) && !test_h264_compare_planes(name, region->pYUV444Data,
+		                                                full->pYUV444Data, full->iStride))
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+
+	if (!rc)
+		fprintf(stderr, "%s: region update of a %" PRIu32 " pixel wide frame failed\n", name,
+		        width);
+
+	test_h264_context_free(region, regionSubsystem);
+	test_h264_context_free(full, fullSubsystem);
+	_aligned_free(image);
+	return rc;
+}
+
+int TestFreeRDPCodecH264(int argc, char* argv[])
+{
+	UINT32 width;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	for (width = 100; width <= TEST_H264_MAX_WIDTH; width += TEST_H264_MAX_WIDTH - 100)
+	{
+		if (!test_h264_region("AVC420", 0, width))
+			return -1;
+
+		if (!test_h264_region("AVC444v1", 1, width))
+			return -1;
+
+		if (!test_h264_region("AVC444v2", 2, width))
+			return -1;
+	}
+
+	return 0;
+}
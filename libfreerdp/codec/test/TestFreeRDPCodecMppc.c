@@ -5,6 +5,9 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/codec/mppc.h>
 #include <freerdp/log.h>
+#include <freerdp/utils/stopwatch.h>
+
+#include "bulk_corpus.h"
 
 static const BYTE TEST_RDP5_COMPRESSED_DATA[] = {
 	0x24, 0x02, 0x03, 0x09, 0x00, 0x20, 0x0c, 0x05, 0x10, 0x01, 0x40, 0x0a, 0xbf, 0xdf, 0xc3, 0x20,
@@ -1084,10 +1087,105 @@ fail:
 	return rc;
 }
 
+/**
+ * Benchmark on the bulk_corpus data sent in packets of mixed sizes. Every packet is
+ * decompressed again and compared, compression and decompression are timed separately.
+ *
+ * TestFreeRDPCodec TestFreeRDPCodecMppc [corpus size in KiB]
+ */
+static BOOL test_MppcBenchmark(UINT32 CompressionLevel, const char* name, size_t size)
+{
+	BOOL rc = FALSE;
+	size_t offset = 0;
+	UINT64 packets = 0;
+	UINT64 compressed = 0;
+	UINT32 state = 0x1F123BB5;
+	STOPWATCH compression = { 0 };
+	STOPWATCH decompression = { 0 };
+	BYTE* corpus = bulk_corpus_new(size);
+	BYTE* OutputBuffer = malloc(65536);
+	MPPC_CONTEXT* compressor = mppc_context_new(CompressionLevel, TRUE);
+	MPPC_CONTEXT* decompressor = mppc_context_new(CompressionLevel, FALSE);
+
+	if (!corpus || !OutputBuffer || !compressor || !decompressor || (size == 0))
+		goto fail;
+
+	while (offset < size)
+	{
+		int status;
+		const UINT32 length = 1 + bulk_corpus_random(&state) % 8000;
+		const UINT32 SrcSize = (UINT32)MIN(length, size - offset);
+		const BYTE* pSrcData = &corpus[offset];
+		BYTE* pDstData = OutputBuffer;
+		UINT32 DstSize = 65536;
+		BYTE* pDecompressed = NULL;
+		UINT32 DecompressedSize = 0;
+		UINT32 Flags = 0;
+
+		stopwatch_start(&compression);
+		status = mppc_compress(compressor, (BYTE*)pSrcData, SrcSize, &pDstData, &DstSize, &Flags);
+		stopwatch_stop(&compression);
+
+		if (status < 0)
+		{
+			printf("MppcBenchmark %s: compression failed (%d)\n", name, status);
+			goto fail;
+		}
+
+		stopwatch_start(&decompression);
+		status = mppc_decompress(decompressor, pDstData, DstSize, &pDecompressed,
+		                         &DecompressedSize, Flags);
+		stopwatch_stop(&decompression);
+
+		if (status < 0)
+		{
+			printf("MppcBenchmark %s: decompression failed (%d)\n", name, status);
+			goto fail;
+		}
+
+		if ((DecompressedSize != SrcSize) || (memcmp(pDecompressed, pSrcData, SrcSize) != 0))
+		{
+			printf("MppcBenchmark %s: round trip mismatch in packet %" PRIu64 "\n", name,
+			       packets);
+			goto fail;
+		}
+
+		packets++;
+		compressed += DstSize;
+		offset += SrcSize;
+	}
+
+	printf("MppcBenchmark %s: packets %" PRIu64 " in %" PRIuz " out %" PRIu64
+	       " ratio %.3f compress %" PRIu64 " us",
+	       name, packets, size, compressed, (double)compressed / (double)size,
+	       compression.elapsed);
+
+	if (compression.elapsed > 0)
+		printf(" (%.1f MB/s)", (double)size / 1000.0 / 1000.0 /
+		                           stopwatch_get_elapsed_time_in_seconds(&compression));
+
+	printf(" decompress %" PRIu64 " us", decompression.elapsed);
+
+	if (decompression.elapsed > 0)
+		printf(" (%.1f MB/s)", (double)size / 1000.0 / 1000.0 /
+		                           stopwatch_get_elapsed_time_in_seconds(&decompression));
+
+	printf("\n");
+	rc = TRUE;
+fail:
+	mppc_context_free(compressor);
+	mppc_context_free(decompressor);
+	free(OutputBuffer);
+	free(corpus);
+	return rc;
+}
+
 int TestFreeRDPCodecMppc(int argc, char* argv[])
 {
-	WINPR_UNUSED(argc);
-	WINPR_UNUSED(argv);
+	size_t size = 1024 * 1024;
+
+	if (argc > 1)
+		size = strtoul(argv[1], NULL, 0) * 1024;
 
 	if (test_MppcCompressIslandRdp5() < 0)
 		return -1;
@@ -1110,5 +1208,11 @@ int TestFreeRDPCodecMppc(int argc, char* argv[])
 	if (test_MppcDecompressBufferRdp5() < 0)
 		return -1;
 
+	if (!test_MppcBenchmark(0, "RDP4", size))
+		return -1;
+
+	if (!test_MppcBenchmark(1, "RDP5", size))
+		return -1;
+
 	return 0;
 }
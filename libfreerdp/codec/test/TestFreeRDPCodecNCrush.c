@@ -2,6 +2,9 @@
 #include <winpr/print.h>
 
 #include <freerdp/codec/ncrush.h>
+#include <freerdp/utils/stopwatch.h>
+
+#include "bulk_corpus.h"
 
 static const BYTE TEST_BELLS_DATA[] = "for.whom.the.bell.tolls,.the.bell.tolls.for.thee!";
 
@@ -113,10 +116,118 @@ fail:
 	return rc;
 }
 
+/**
+ * Benchmark of the compression modes on the bulk_corpus data, sent in packets of mixed sizes
+ * up to the 32760 bytes bulk_compress hands to NCrush. Every packet is decompressed again and
+ * compared, compression and decompression are timed separately.
+ *
+ * TestFreeRDPCodec TestFreeRDPCodecNCrush [corpus size in KiB]
+ */
+static BOOL test_NCrushBenchmark(NCRUSH_MODE mode, const char* name, const BYTE* corpus,
+                                 size_t size)
+{
+	BOOL rc = FALSE;
+	size_t offset = 0;
+	UINT64 packets = 0;
+	UINT64 compressed = 0;
+	UINT32 state = 0x1F123BB5;
+	STOPWATCH stopwatch = { 0 };
+	STOPWATCH decompression = { 0 };
+	BYTE* OutputBuffer = malloc(65536);
+	NCRUSH_CONTEXT* compressor = ncrush_context_new(TRUE);
+	NCRUSH_CONTEXT* decompressor = ncrush_context_new(FALSE);
+
+	if (!OutputBuffer || !compressor || !decompressor)
+		goto fail;
+
+	if (!ncrush_context_set_mode(compressor, mode))
+		goto fail;
+
+	while (offset < size)
+	{
+		int status;
+		const UINT32 length = 1 + bulk_corpus_random(&state) % 32760;
+		const UINT32 SrcSize = (UINT32)MIN(length, size - offset);
+		const BYTE* pSrcData = &corpus[offset];
+		BYTE* pDstData = OutputBuffer;
+		UINT32 DstSize = 65536;
+		BYTE* pDecompressed = NULL;
+		UINT32 DecompressedSize = 0;
+		UINT32 Flags = 0;
+
+		stopwatch_start(&stopwatch);
+		status = ncrush_compress(compressor, (BYTE*)pSrcData, SrcSize, &pDstData, &DstSize, &Flags);
+		stopwatch_stop(&stopwatch);
+
+		if (status < 0)
+		{
+			printf("NCrushBenchmark %s: compression failed (%d)\n", name, status);
+			goto fail;
+		}
+
+		if (Flags & PACKET_COMPRESSED)
+		{
+			stopwatch_start(&decompression);
+			status = ncrush_decompress(decompressor, pDstData, DstSize, &pDecompressed,
+			                           &DecompressedSize, Flags);
+			stopwatch_stop(&decompression);
+
+			if (status < 0)
+			{
+				printf("NCrushBenchmark %s: decompression failed (%d)\n", name, status);
+				goto fail;
+			}
+		}
+		else
+		{
+			pDecompressed = (BYTE*)pSrcData;
+			DecompressedSize = SrcSize;
+			DstSize = SrcSize;
+		}
+
+		if ((DecompressedSize != SrcSize) || (memcmp(pDecompressed, pSrcData, SrcSize) != 0))
+		{
+			printf("NCrushBenchmark %s: round trip mismatch in packet %" PRIu64 "\n", name,
+			       packets);
+			goto fail;
+		}
+
+		packets++;
+		compressed += DstSize;
+		offset += SrcSize;
+	}
+
+	printf("NCrushBenchmark %-7s: packets %" PRIu64 " in %" PRIuz " out %" PRIu64
+	       " ratio %.3f compress %" PRIu64 " us",
+	       name, packets, size, compressed, (double)compressed / (double)size, stopwatch.elapsed);
+
+	if (stopwatch.elapsed > 0)
+		printf(" (%.1f MB/s)",
+		       (double)size / 1000.0 / 1000.0 / stopwatch_get_elapsed_time_in_seconds(&stopwatch));
+
+	printf(" decompress %" PRIu64 " us", decompression.elapsed);
+
+	if (decompression.elapsed > 0)
+		printf(" (%.1f MB/s)", (double)size / 1000.0 / 1000.0 /
+		                           stopwatch_get_elapsed_time_in_seconds(&decompression));
+
+	printf("\n");
+	rc = TRUE;
+fail:
+	ncrush_context_free(compressor);
+	ncrush_context_free(decompressor);
+	free(OutputBuffer);
+	return rc;
+}
+
 int TestFreeRDPCodecNCrush(int argc, char* argv[])
 {
-	WINPR_UNUSED(argc);
-	WINPR_UNUSED(argv);
+	BOOL rc;
+	BYTE* corpus;
+	size_t size = 1024 * 1024;
+
+	if (argc > 1)
+		size = strtoul(argv[1], NULL, 0) * 1024;
 
 	if (!test_NCrushCompressBells())
 		return -1;
@@ -124,5 +235,17 @@ int TestFreeRDPCodecNCrush(int argc, char* argv[])
 	if (!test_NCrushDecompressBells())
 		return -1;
 
-	return 0;
+	corpus = bulk_corpus_new(size);
+
+	if (!corpus || (size == 0))
+	{
+		free(corpus);
+		return -1;
+	}
+
+	rc = test_NCrushBenchmark(NCRUSH_MODE_FAST, "fast", corpus, size) &&
+	     test_NCrushBenchmark(NCRUSH_MODE_DEFAULT, "default", corpus, size) &&
+	     test_NCrushBenchmark(NCRUSH_MODE_BEST, "best", corpus, size);
+	free(corpus);
+	return rc ? 0 : -1;
 }
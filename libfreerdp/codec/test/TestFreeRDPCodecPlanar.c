@@ -4,11 +4,13 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
 #include <winpr/crypto.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/freerdp.h>
 #include <freerdp/codec/color.h>
 #include <freerdp/codec/bitmap.h>
 #include <freerdp/codec/planar.h>
+#include <freerdp/primitives.h>
 
 /**
  * Experimental Case 01: 64x64 (32bpp)
@@ -5763,11 +5765,127 @@ fail:
 	return rc;
 }
 
+#define BENCH_FRAMES 2000
+
+static double MegabytesPerSecond(UINT64 start, size_t bytes)
+{
+	const UINT64 elapsed = GetTickCount64() - start;
+	return bytes * 1000.0 / MAX(elapsed, 1) / (1024.0 * 1024.0);
+}
+
+static BOOL BenchPlanarImage(BITMAP_PLANAR_CONTEXT* planar, const char* name, const BYTE* srcBitmap,
+                             size_t frames, BYTE** pCompressed, UINT32* pCompressedSize,
+                             BYTE* decompressed)
+{
+	size_t n;
+	UINT64 start;
+	double encodeRate, decodeRate;
+	const UINT32 width = 64;
+	const UINT32 height = 64;
+	const size_t frameSize = width * height * 4;
+	UINT32 dstSize = 0;
+	BYTE* compressed = freerdp_bitmap_compress_planar(planar, srcBitmap, PIXEL_FORMAT_BGRX32, width,
+	                                                  height, 0, NULL, &dstSize);
+
+	if (!compressed)
+		return FALSE;
+
+	start = GetTickCount64();
+
+	for (n = 0; n < frames; n++)
+	{
+		UINT32 size = dstSize;
+
+		if (!freerdp_bitmap_compress_planar(planar, srcBitmap, PIXEL_FORMAT_BGRX32, width, height,
+		                                    0, compressed, &size))
+			goto fail;
+	}
+
+	encodeRate = MegabytesPerSecond(start, frames * frameSize);
+	start = GetTickCount64();
+
+	for (n = 0; n < frames; n++)
+	{
+		if (!planar_decompress(planar, compressed, dstSize, width, height, decompressed,
+		                       PIXEL_FORMAT_BGRX32, 0, 0, 0, width, height, TRUE))
+			goto fail;
+	}
+
+	decodeRate = MegabytesPerSecond(start, frames * frameSize);
+	printf("%-8s %s: %" PRIu32 " -> %" PRIu32 " bytes, encode %.1f MB/s, decode %.1f MB/s\n",
+	       name, "64x64", (UINT32)frameSize, dstSize, encodeRate, decodeRate);
+	*pCompressed = compressed;
+	*pCompressedSize = dstSize;
+	return TRUE;
+fail:
+	free(compressed);
+	return FALSE;
+}
+
+/* Encodes and decodes the sample bitmaps once with the generic and once with
+ * the optimized primitives, checks both produce the same data and reports the
+ * throughput in megabytes of BGRX32 pixel data per second. Pass "benchmark"
+ * as argument for a longer run. */
+static BOOL BenchPlanar(size_t frames)
+{
+	size_t x;
+	BOOL rc = FALSE;
+	const DWORD planarFlags = PLANAR_FORMAT_HEADER_NA | PLANAR_FORMAT_HEADER_RLE;
+	const BYTE* images[] = { TEST_RLE_BITMAP_EXPERIMENTAL_01, TEST_RLE_BITMAP_EXPERIMENTAL_02,
+		                     TEST_RLE_BITMAP_EXPERIMENTAL_03 };
+	primitives_t* prims = primitives_get();
+	const primitives_t optimized = *prims;
+	BITMAP_PLANAR_CONTEXT* planar = freerdp_bitmap_planar_context_new(planarFlags, 64, 64);
+	BYTE* genericPixels = calloc(64 * 64, 4);
+	BYTE* optimizedPixels = calloc(64 * 64, 4);
+
+	if (!planar || !genericPixels || !optimizedPixels)
+		goto fail;
+
+	for (x = 0; x < ARRAYSIZE(images); x++)
+	{
+		BOOL same;
+		BYTE* genericData = NULL;
+		BYTE* optimizedData = NULL;
+		UINT32 genericSize = 0;
+		UINT32 optimizedSize = 0;
+
+		printf("%s: image %" PRIuz "\n", __FUNCTION__, x + 1);
+		*prims = *primitives_get_generic();
+		same = BenchPlanarImage(planar, "generic", images[x], frames, &genericData, &genericSize,
+		                        genericPixels);
+		*prims = optimized;
+		same = same && BenchPlanarImage(planar, "opt", images[x], frames, &optimizedData,
+		                                &optimizedSize, optimizedPixels);
+		same = same && (genericSize == optimizedSize) &&
+		       (memcmp(genericData, optimizedData, genericSize) == 0) &&
+		       (memcmp(genericPixels, optimizedPixels, 64 * 64 * 4) == 0);
+		free(genericData);
+		free(optimizedData);
+
+		if (!same)
+		{
+			printf("%s: generic and optimized primitives differ\n", __FUNCTION__);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	*prims = optimized;
+	free(genericPixels);
+	free(optimizedPixels);
+	freerdp_bitmap_planar_context_free(planar);
+	return rc;
+}
+
 int TestFreeRDPCodecPlanar(int argc, char* argv[])
 {
 	UINT32 x;
-	WINPR_UNUSED(argc);
-	WINPR_UNUSED(argv);
+	size_t frames = BENCH_FRAMES;
+
+	if ((argc > 1) && (strcmp(argv[1], "benchmark") == 0))
+		frames *= 50;
 
 	if (!FuzzPlanar())
 		return -2;
@@ -5778,5 +5896,8 @@ int TestFreeRDPCodecPlanar(int argc, char* argv[])
 			return -1;
 	}
 
+	if (!BenchPlanar(frames))
+		return -3;
+
 	return 0;
 }
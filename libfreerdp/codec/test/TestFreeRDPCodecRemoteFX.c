@@ -1,5 +1,6 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/freerdp.h>
 #include <freerdp/codec/rfx.h>
@@ -843,6 +844,147 @@ static BOOL fuzzyCompareImage(const UINT32* refImage, const BYTE* img, size_t np
 	return TRUE;
 }
 
+#define BENCH_TILES 5000
+
+static const UINT32 benchQuantVals[10] = { 6, 6, 6, 6, 7, 7, 8, 8, 8, 9 };
+
+static void test_RemoteFXFillTile(INT16* buffer, UINT32 seed)
+{
+	size_t x;
+
+	/* Smooth gradients with some noise, scaled like the encoder's YCbCr input */
+	for (x = 0; x < 4096; x++)
+	{
+		seed = seed * 1103515245 + 12345;
+		buffer[x] = (INT16)((((x % 64) * 2 + (x / 64) * 3 + ((seed >> 16) & 0x0F)) - 128) << 5);
+	}
+}
+
+static void test_RemoteFXForward(RFX_CONTEXT* context, const INT16* tile, INT16* buffer,
+                                 INT16* dwt)
+{
+	CopyMemory(buffer, tile, 4096 * sizeof(INT16));
+	context->dwt_2d_encode(buffer, dwt);
+	context->quantization_encode(buffer, benchQuantVals);
+}
+
+static void test_RemoteFXInverse(RFX_CONTEXT* context, const INT16* coefficients, INT16* buffer,
+                                 INT16* dwt)
+{
+	CopyMemory(buffer, coefficients, 4096 * sizeof(INT16));
+	context->quantization_decode(buffer, benchQuantVals);
+	context->dwt_2d_decode(buffer, dwt);
+}
+
+static UINT64 test_RemoteFXTilesPerSecond(UINT64 start)
+{
+	/* The loops run once per component, three per tile */
+	const UINT64 elapsed = GetTickCount64() - start;
+	return BENCH_TILES * 1000ull / MAX(elapsed, 1);
+}
+
+static int test_RemoteFXSimd(void)
+{
+	int rc = -1;
+	size_t i;
+	size_t n;
+	int size;
+	UINT64 start;
+	const RFX_SIMD_LEVEL levels[] = { RFX_SIMD_GENERIC, RFX_SIMD_BASELINE, RFX_SIMD_AVX2 };
+	const char* names[] = { "generic", "baseline", "avx2" };
+	RFX_CONTEXT* context = rfx_context_new(TRUE);
+	INT16* tile = _aligned_malloc(4096 * sizeof(INT16), 32);
+	INT16* coefficients = _aligned_malloc(4096 * sizeof(INT16), 32);
+	INT16* samples = _aligned_malloc(4096 * sizeof(INT16), 32);
+	INT16* buffer = _aligned_malloc(4096 * sizeof(INT16), 32);
+	INT16* dwt = _aligned_malloc(4096 * sizeof(INT16), 32);
+	BYTE* data = calloc(4096, sizeof(INT16));
+
+	if (!context || !tile || !coefficients || !samples || !buffer || !dwt || !data)
+		goto fail;
+
+	test_RemoteFXFillTile(tile, 42);
+
+	for (i = 0; i < ARRAYSIZE(levels); i++)
+	{
+		UINT64 encodeRate;
+		UINT64 decodeRate;
+
+		if (!rfx_context_set_simd_level(context, levels[i]))
+		{
+			printf("RemoteFX %-8s: not available\n", names[i]);
+			continue;
+		}
+
+		/* All levels must produce exactly the output of the generic routines */
+		test_RemoteFXForward(context, tile, buffer, dwt);
+
+		if (levels[i] == RFX_SIMD_GENERIC)
+			CopyMemory(coefficients, buffer, 4096 * sizeof(INT16));
+		else if (memcmp(coefficients, buffer, 4096 * sizeof(INT16)) != 0)
+		{
+			printf("RemoteFX %-8s: coefficients differ from generic\n", names[i]);
+			goto fail;
+		}
+
+		test_RemoteFXInverse(context, coefficients, buffer, dwt);
+
+		if (levels[i] == RFX_SIMD_GENERIC)
+			CopyMemory(samples, buffer, 4096 * sizeof(INT16));
+		else if (memcmp(samples, buffer, 4096 * sizeof(INT16)) != 0)
+		{
+			printf("RemoteFX %-8s: samples differ from generic\n", names[i]);
+			goto fail;
+		}
+
+		start = GetTickCount64();
+
+		for (n = 0; n < 3 * BENCH_TILES; n++)
+			test_RemoteFXForward(context, tile, buffer, dwt);
+
+		encodeRate = test_RemoteFXTilesPerSecond(start);
+		start = GetTickCount64();
+
+		for (n = 0; n < 3 * BENCH_TILES; n++)
+			test_RemoteFXInverse(context, coefficients, buffer, dwt);
+
+		decodeRate = test_RemoteFXTilesPerSecond(start);
+		printf("RemoteFX %-8s: dwt+quantization encode %" PRIu64 " tiles/s, decode %" PRIu64
+		       " tiles/s\n",
+		       names[i], encodeRate, decodeRate);
+	}
+
+	/* The entropy coder is shared by all levels */
+	size = context->rlgr_encode(RLGR3, coefficients, 4096, data, 4096 * sizeof(INT16));
+
+	if (size <= 0)
+		goto fail;
+
+	if ((context->rlgr_decode(RLGR3, data, (UINT32)size, buffer, 4096) < 0) ||
+	    (memcmp(coefficients, buffer, 4096 * sizeof(INT16)) != 0))
+	{
+		printf("RemoteFX rlgr: round trip mismatch\n");
+		goto fail;
+	}
+
+	start = GetTickCount64();
+
+	for (n = 0; n < 3 * BENCH_TILES; n++)
+		context->rlgr_decode(RLGR3, data, (UINT32)size, buffer, 4096);
+
+	printf("RemoteFX rlgr3   : decode %" PRIu64 " tiles/s\n", test_RemoteFXTilesPerSecond(start));
+	rc = 0;
+fail:
+	_aligned_free(tile);
+	_aligned_free(coefficients);
+	_aligned_free(samples);
+	_aligned_free(buffer);
+	_aligned_free(dwt);
+	free(data);
+	rfx_context_free(context);
+	return rc;
+}
+
 int TestFreeRDPCodecRemoteFX(int argc, char* argv[])
 {
 	int rc = -1;
@@ -879,6 +1021,9 @@ int TestFreeRDPCodecRemoteFX(int argc, char* argv[])
 	if (!fuzzyCompareImage(refImage, dest, IMG_WIDTH * IMG_HEIGHT))
 		goto fail;
 
+	if (test_RemoteFXSimd() < 0)
+		goto fail;
+
 	rc = 0;
 fail:
 	region16_uninit(&region);
@@ -2,6 +2,9 @@
 #include <winpr/print.h>
 
 #include <freerdp/codec/xcrush.h>
+#include <freerdp/utils/stopwatch.h>
+
+#include "bulk_corpus.h"
 
 static const BYTE TEST_BELLS_DATA[] = "for.whom.the.bell.tolls,.the.bell.tolls.for.thee!";
 
@@ -136,15 +139,191 @@ int test_XCrushCompressIsland()
 	return 1;
 }
 
+/**
+ * Benchmark on the bulk_corpus data sent in packets of mixed sizes up to the 16384 bytes
+ * XCrush takes. Every packet is decompressed again and compared.
+ *
+ * TestFreeRDPCodec TestFreeRDPCodecXCrush [corpus size in KiB]
+ */
+static int test_XCrushBenchmark(size_t size)
+{
+	int rc = -1;
+	size_t offset = 0;
+	UINT64 packets = 0;
+	UINT64 compressed = 0;
+	UINT32 state = 0x1F123BB5;
+	STOPWATCH stopwatch = { 0 };
+	BYTE* OutputBuffer = malloc(65536);
+	BYTE* corpus = bulk_corpus_new(size);
+	XCRUSH_CONTEXT* compressor = xcrush_context_new(TRUE);
+	XCRUSH_CONTEXT* decompressor = xcrush_context_new(FALSE);
+
+	if (!OutputBuffer || !corpus || !compressor || !decompressor)
+		goto fail;
+
+	while (offset < size)
+	{
+		int status;
+		const UINT32 value = bulk_corpus_random(&state);
+		/* one packet in four is a small update */
+		const UINT32 length = (value & 3) ? 1 + (value >> 2) % 16384 : 1 + (value >> 2) % 256;
+		const UINT32 SrcSize = (UINT32)MIN(length, size - offset);
+		BYTE* pSrcData = &corpus[offset];
+		BYTE* pDstData = OutputBuffer;
+		UINT32 DstSize = 65536;
+		BYTE* pDecompressed = NULL;
+		UINT32 DecompressedSize = 0;
+		UINT32 Flags = 0;
+
+		stopwatch_start(&stopwatch);
+		status = xcrush_compress(compressor, pSrcData, SrcSize, &pDstData, &DstSize, &Flags);
+		stopwatch_stop(&stopwatch);
+
+		if (status < 0)
+		{
+			printf("XCrushBenchmark: compression failed (%d)\n", status);
+			goto fail;
+		}
+
+		if (Flags & PACKET_COMPRESSED)
+		{
+			status = xcrush_decompress(decompressor, pDstData, DstSize, &pDecompressed,
+			                           &DecompressedSize, Flags);
+
+			if (status < 0)
+			{
+				printf("XCrushBenchmark: decompression failed (%d)\n", status);
+				goto fail;
+			}
+		}
+		else
+		{
+			pDecompressed = pDstData;
+			DecompressedSize = DstSize;
+		}
+
+		if ((DecompressedSize != SrcSize) || (memcmp(pDecompressed, pSrcData, SrcSize) != 0))
+		{
+			printf("XCrushBenchmark: round trip mismatch in packet %" PRIu64 "\n", packets);
+			goto fail;
+		}
+
+		packets++;
+		compressed += DstSize;
+		offset += SrcSize;
+	}
+
+	printf("XCrushBenchmark: packets %" PRIu64 " in %" PRIuz " out %" PRIu64
+	       " ratio %.3f compress %" PRIu64 " us",
+	       packets, size, compressed, (double)compressed / (double)size, stopwatch.elapsed);
+
+	if (stopwatch.elapsed > 0)
+		printf(" (%.1f MB/s)",
+		       (double)size / 1000.0 / 1000.0 / stopwatch_get_elapsed_time_in_seconds(&stopwatch));
+
+	printf("\n");
+	rc = 1;
+fail:
+	xcrush_context_free(compressor);
+	xcrush_context_free(decompressor);
+	free(corpus);
+	free(OutputBuffer);
+	return rc;
+}
+
+/**
+ * A packet the inner MPPC coder cannot compress resets its history, the next one it compresses
+ * is flagged flushed. That packet has to carry the MPPC output, not the level 1 data.
+ */
+static int test_XCrushCompressAfterFlush(void)
+{
+	int rc = -1;
+	UINT32 index;
+	UINT32 state = BULK_CORPUS_SEED;
+	BYTE data[4000];
+	BYTE OutputBuffer[65536];
+	static const char* words[] = { "for ", "whom ", "the ", "bell ", "tolls, ", "thee! " };
+	XCRUSH_CONTEXT* compressor = xcrush_context_new(TRUE);
+	XCRUSH_CONTEXT* decompressor = xcrush_context_new(FALSE);
+
+	if (!compressor || !decompressor)
+		goto fail;
+
+	for (index = 0; index < 2; index++)
+	{
+		int status;
+		UINT32 SrcSize = 0;
+		BYTE* pDstData = OutputBuffer;
+		UINT32 DstSize = sizeof(OutputBuffer);
+		BYTE* pDecompressed = NULL;
+		UINT32 DecompressedSize = 0;
+		UINT32 Flags = 0;
+
+		while (SrcSize + 8 < sizeof(data))
+		{
+			const UINT32 value = bulk_corpus_random(&state);
+
+			if (index == 0)
+				data[SrcSize++] = (BYTE)value;
+			else
+			{
+				/* MPPC sends bytes below 0x80 as they are, those would hide a mixup */
+				const char* word = words[value % ARRAYSIZE(words)];
+
+				while (*word)
+					data[SrcSize++] = (BYTE)(*word++ | 0x80);
+			}
+		}
+
+		status = xcrush_compress(compressor, data, SrcSize, &pDstData, &DstSize, &Flags);
+
+		if (status < 0)
+			goto fail;
+
+		if (Flags & PACKET_COMPRESSED)
+		{
+			if (xcrush_decompress(decompressor, pDstData, DstSize, &pDecompressed,
+			                      &DecompressedSize, Flags) < 0)
+				goto fail;
+		}
+		else
+		{
+			pDecompressed = pDstData;
+			DecompressedSize = DstSize;
+		}
+
+		if ((DecompressedSize != SrcSize) || (memcmp(pDecompressed, data, SrcSize) != 0))
+		{
+			printf("XCrushCompressAfterFlush: round trip mismatch in packet %" PRIu32 "\n",
+			       index);
+			goto fail;
+		}
+	}
+
+	rc = 1;
+fail:
+	xcrush_context_free(compressor);
+	xcrush_context_free(decompressor);
+	return rc;
+}
+
 int TestFreeRDPCodecXCrush(int argc, char* argv[])
 {
-	WINPR_UNUSED(argc);
-	WINPR_UNUSED(argv);
+	size_t size = 1024;
+
+	if (argc > 1)
+		size = strtoul(argv[1], NULL, 0);
 
 	// if (test_XCrushCompressBells() < 0)
 	//	return -1;
 	if (test_XCrushCompressIsland() < 0)
 		return -1;
 
+	if (test_XCrushCompressAfterFlush() < 0)
+		return -1;
+
+	if ((size == 0) || (test_XCrushBenchmark(size * 1024) < 0))
+		return -1;
+
 	return 0;
 }
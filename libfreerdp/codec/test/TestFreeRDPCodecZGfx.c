@@ -252,6 +252,91 @@ fail:
 	return rc;
 }
 
+static void test_ZGfxFillBuffer(BYTE* buffer, size_t size, UINT32 seed)
+{
+	size_t x;
+
+	/* Repetitive rows with some noise, similar to surface command payloads */
+	for (x = 0; x < size; x++)
+	{
+		seed = seed * 1103515245 + 12345;
+
+		if ((seed >> 24) < 16)
+			buffer[x] = (BYTE)(seed >> 16);
+		else
+			buffer[x] = (BYTE)((x % 1024) / 16);
+	}
+}
+
+static int test_ZGfxCompressRoundTrip(ZGFX_COMPRESSION_MODE mode)
+{
+	int rc = -1;
+	UINT32 run;
+	UINT64 totalIn = 0;
+	UINT64 totalOut = 0;
+	BYTE* buffer = NULL;
+	const UINT32 sizes[] = { 1, 3, 100, 4096, 65535, 65536, 200000 };
+	ZGFX_CONTEXT* compressor = zgfx_context_new(TRUE);
+	ZGFX_CONTEXT* decompressor = zgfx_context_new(FALSE);
+
+	if (!compressor || !decompressor)
+		goto fail;
+
+	if (!zgfx_context_set_compression_mode(compressor, mode))
+		goto fail;
+
+	buffer = (BYTE*)malloc(sizes[ARRAYSIZE(sizes) - 1]);
+
+	if (!buffer)
+		goto fail;
+
+	for (run = 0; run < 3 * ARRAYSIZE(sizes); run++)
+	{
+		int status;
+		UINT32 Flags = 0;
+		UINT32 DstSize = 0;
+		UINT32 PlainSize = 0;
+		BYTE* pDstData = NULL;
+		BYTE* pPlainData = NULL;
+		const UINT32 SrcSize = sizes[run % ARRAYSIZE(sizes)];
+		test_ZGfxFillBuffer(buffer, SrcSize, run / ARRAYSIZE(sizes));
+		status = zgfx_compress(compressor, buffer, SrcSize, &pDstData, &DstSize, &Flags);
+
+		if (status >= 0)
+			status = zgfx_decompress(decompressor, pDstData, DstSize, &pPlainData, &PlainSize, 0);
+
+		if ((status < 0) || (PlainSize != SrcSize) || (memcmp(pPlainData, buffer, SrcSize) != 0))
+		{
+			printf("test_ZGfxCompressRoundTrip: mode %d run %" PRIu32 " size %" PRIu32
+			       " mismatch\n",
+			       mode, run, SrcSize);
+			free(pDstData);
+			free(pPlainData);
+			goto fail;
+		}
+
+		totalIn += SrcSize;
+		totalOut += DstSize;
+		free(pDstData);
+		free(pPlainData);
+	}
+
+	printf("RoundTrip: mode %d %" PRIu64 " -> %" PRIu64 " bytes\n", mode, totalIn, totalOut);
+
+	if ((mode != ZGFX_COMPRESSION_NONE) && (totalOut * 2 > totalIn))
+	{
+		printf("test_ZGfxCompressRoundTrip: mode %d did not compress\n", mode);
+		goto fail;
+	}
+
+	rc = 0;
+fail:
+	free(buffer);
+	zgfx_context_free(compressor);
+	zgfx_context_free(decompressor);
+	return rc;
+}
+
 int TestFreeRDPCodecZGfx(int argc, char* argv[])
 {
 	WINPR_UNUSED(argc);
@@ -269,5 +354,14 @@ int TestFreeRDPCodecZGfx(int argc, char* argv[])
 	if (test_ZGfxCompressConsistent() < 0)
 		return -1;
 
+	if (test_ZGfxCompressRoundTrip(ZGFX_COMPRESSION_NONE) < 0)
+		return -1;
+
+	if (test_ZGfxCompressRoundTrip(ZGFX_COMPRESSION_FAST) < 0)
+		return -1;
+
+	if (test_ZGfxCompressRoundTrip(ZGFX_COMPRESSION_BEST) < 0)
+		return -1;
+
 	return 0;
 }
@@ -0,0 +1,99 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Bulk Compression Test Corpus
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/crt.h>
+
+#include <freerdp/types.h>
+
+#include "bulk_corpus.h"
+
+static const char BULK_CORPUS_TEXT[] = "No man is an island entire of itself; every man "
+                                       "is a piece of the continent, a part of the main; "
+                                       "if a clod be washed away by the sea, Europe "
+                                       "is the less, as well as if a promontory were, as"
+                                       "well as any manner of thy friends or of thine "
+                                       "own were; any man's death diminishes me, "
+                                       "because I am involved in mankind. "
+                                       "And therefore never send to know for whom "
+                                       "the bell tolls; it tolls for thee.";
+
+static const char* BULK_CORPUS_WORDS[] = { "for ",     "whom ",    "the ",     "bell ",
+	                                       "tolls ",   "window ",  "cursor ",  "surface ",
+	                                       "bitmap ",  "glyph ",   "channel ", "input ",
+	                                       "palette ", "pointer ", "update " };
+
+UINT32 bulk_corpus_random(UINT32* state)
+{
+	*state = *state * 1103515245 + 12345;
+	return *state >> 8;
+}
+
+BYTE* bulk_corpus_new(size_t size)
+{
+	size_t offset = 0;
+	UINT32 state = BULK_CORPUS_SEED;
+	const size_t textSize = sizeof(BULK_CORPUS_TEXT) - 1;
+	BYTE* corpus = malloc(size);
+
+	if (!corpus)
+		return NULL;
+
+	while (offset < size)
+	{
+		size_t index;
+		size_t length;
+		const UINT32 value = bulk_corpus_random(&state);
+
+		switch (value % 8)
+		{
+			case 0:
+				length = MIN(4 + (value >> 8) % 28, size - offset);
+
+				for (index = 0; index < length; index++)
+					corpus[offset + index] = (BYTE)bulk_corpus_random(&state);
+
+				break;
+
+			case 1:
+				length = MIN(8 + (value >> 8) % 120, size - offset);
+				FillMemory(&corpus[offset], length, (BYTE)(value >> 16));
+				break;
+
+			case 2:
+			case 3:
+			case 4:
+			{
+				const size_t start = (value >> 8) % textSize;
+				length = MIN(MIN(8 + (value >> 16) % 56, textSize - start), size - offset);
+				CopyMemory(&corpus[offset], &BULK_CORPUS_TEXT[start], length);
+			}
+			break;
+
+			default:
+			{
+				const char* word = BULK_CORPUS_WORDS[(value >> 8) % ARRAYSIZE(BULK_CORPUS_WORDS)];
+				length = MIN(strlen(word), size - offset);
+				CopyMemory(&corpus[offset], word, length);
+			}
+			break;
+		}
+
+		offset += length;
+	}
+
+	return corpus;
+}
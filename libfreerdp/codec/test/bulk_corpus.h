@@ -0,0 +1,35 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Bulk Compression Test Corpus
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_TEST_BULK_CORPUS_H
+#define FREERDP_LIB_CODEC_TEST_BULK_CORPUS_H
+
+#include <winpr/wtypes.h>
+
+#define BULK_CORPUS_SEED 0x2545F491
+
+/* next value of a pseudo random sequence, the same on every platform */
+UINT32 bulk_corpus_random(UINT32* state);
+
+/**
+ * Allocates size bytes of compressible data for the bulk compressor benchmarks: slices of a
+ * text, words, runs of a repeated byte and short runs of noise. The content only depends on
+ * size, free it with free().
+ */
+BYTE* bulk_corpus_new(size_t size);
+
+#endif /* FREERDP_LIB_CODEC_TEST_BULK_CORPUS_H */
@@ -30,6 +30,11 @@
 #include <freerdp/log.h>
 #include <freerdp/codec/xcrush.h>
 
+#if defined(WITH_SSE2) && (defined(__SSE2__) || defined(_M_X64))
+#define XCRUSH_SSE2
+#include <emmintrin.h>
+#endif
+
 #define TAG FREERDP_TAG("codec")
 
 #pragma pack(push, 1)
@@ -216,65 +221,100 @@ static int xcrush_append_chunk(XCRUSH_CONTEXT* xcrush, const BYTE* data, UINT32*
 	return 1;
 }
 
+/**
+ * The rolling hash xors every byte in and, 32 positions later, out again with the
+ * same rotation, so the accumulator after position i only depends on data[i + 1]
+ * to data[i + 32]. Its low 7 bits, which decide the chunk boundaries, are
+ * data[i + 32 - k] << k for 0 <= k < 7 xored with data[i + k] >> k for 0 < k < 8.
+ */
+
+static INLINE BYTE xcrush_chunk_mask(const BYTE* data)
+{
+	const UINT32 mask = data[32] ^ (data[31] << 1) ^ (data[30] << 2) ^ (data[29] << 3) ^
+	                    (data[28] << 4) ^ (data[27] << 5) ^ (data[26] << 6) ^ (data[1] >> 1) ^
+	                    (data[2] >> 2) ^ (data[3] >> 3) ^ (data[4] >> 4) ^ (data[5] >> 5) ^
+	                    (data[6] >> 6) ^ (data[7] >> 7);
+	return mask & 0x7F;
+}
+
+#if defined(XCRUSH_SSE2)
+#define XCRUSH_MASK_SHL(_acc, _data, _k)                                                      \
+	_acc = _mm_xor_si128(                                                                      \
+	    _acc, _mm_slli_epi16(_mm_and_si128(_mm_loadu_si128((const __m128i*)&(_data)[32 - (_k)]), \
+	                                       _mm_set1_epi8(0x7F >> (_k))),                         \
+	                         (_k)))
+
+#define XCRUSH_MASK_SHR(_acc, _data, _k)                                                    \
+	_acc = _mm_xor_si128(                                                                    \
+	    _acc, _mm_and_si128(_mm_srli_epi16(_mm_loadu_si128((const __m128i*)&(_data)[_k]), (_k)), \
+	                        _mm_set1_epi8(0xFF >> (_k))))
+
+/* xcrush_chunk_mask for 16 consecutive positions, bit n is set for a boundary at n */
+static INLINE UINT32 xcrush_chunk_boundaries(const BYTE* data)
+{
+	__m128i acc = _mm_loadu_si128((const __m128i*)&data[32]);
+	XCRUSH_MASK_SHL(acc, data, 1);
+	XCRUSH_MASK_SHL(acc, data, 2);
+	XCRUSH_MASK_SHL(acc, data, 3);
+	XCRUSH_MASK_SHL(acc, data, 4);
+	XCRUSH_MASK_SHL(acc, data, 5);
+	XCRUSH_MASK_SHL(acc, data, 6);
+	XCRUSH_MASK_SHR(acc, data, 1);
+	XCRUSH_MASK_SHR(acc, data, 2);
+	XCRUSH_MASK_SHR(acc, data, 3);
+	XCRUSH_MASK_SHR(acc, data, 4);
+	XCRUSH_MASK_SHR(acc, data, 5);
+	XCRUSH_MASK_SHR(acc, data, 6);
+	XCRUSH_MASK_SHR(acc, data, 7);
+	acc = _mm_and_si128(acc, _mm_set1_epi8(0x7F));
+	return (UINT32)_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128()));
+}
+#endif
+
 static int xcrush_compute_chunks(XCRUSH_CONTEXT* xcrush, const BYTE* data, UINT32 size,
                                  UINT32* pIndex)
 {
 	UINT32 i = 0;
+	UINT32 count = 0;
 	UINT32 offset = 0;
-	UINT32 rotation = 0;
-	UINT32 accumulator = 0;
 	*pIndex = 0;
 	xcrush->SignatureIndex = 0;
 
 	if (size < 128)
 		return 0;
 
-	for (i = 0; i < 32; i++)
-	{
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i] ^ rotation;
-	}
+	/* the hash has always been computed 4 positions at a time */
+	count = (size - 64 + 3) & ~3U;
 
-	for (i = 0; i < size - 64; i++)
+	while (i < count)
 	{
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i + 32] ^ data[i] ^ rotation;
-
-		if (!(accumulator & 0x7F))
+#if defined(XCRUSH_SSE2)
+		if (i + 48 <= size)
 		{
-			if (!xcrush_append_chunk(xcrush, data, &offset, i + 32))
-				return 0;
-		}
+			UINT32 n;
+			UINT32 bits = xcrush_chunk_boundaries(&data[i]);
 
-		i++;
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i + 32] ^ data[i] ^ rotation;
+			if (count - i < 16)
+				bits &= (1U << (count - i)) - 1;
 
-		if (!(accumulator & 0x7F))
-		{
-			if (!xcrush_append_chunk(xcrush, data, &offset, i + 32))
-				return 0;
-		}
+			for (n = 0; bits; n++, bits >>= 1)
+			{
+				if ((bits & 1) && !xcrush_append_chunk(xcrush, data, &offset, i + n + 32))
+					return 0;
+			}
 
-		i++;
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i + 32] ^ data[i] ^ rotation;
+			i += 16;
+			continue;
+		}
+#endif
 
-		if (!(accumulator & 0x7F))
+		if (!xcrush_chunk_mask(&data[i]))
 		{
 			if (!xcrush_append_chunk(xcrush, data, &offset, i + 32))
 				return 0;
 		}
 
 		i++;
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i + 32] ^ data[i] ^ rotation;
-
-		if (!(accumulator & 0x7F))
-		{
-			if (!xcrush_append_chunk(xcrush, data, &offset, i + 32))
-				return 0;
-		}
 	}
 
 	if ((size == offset) || xcrush_append_chunk(xcrush, data, &offset, size))
@@ -394,19 +434,91 @@ static int xcrush_insert_chunk(XCRUSH_CONTEXT* xcrush, XCRUSH_SIGNATURE* signatu
 	return 1;
 }
 
+/* number of equal bytes at the start of a and b, at most limit */
+static INLINE UINT32 xcrush_forward_match_length(const BYTE* a, const BYTE* b, UINT32 limit)
+{
+	UINT32 length = 0;
+#if defined(XCRUSH_SSE2)
+
+	while (length + 16 <= limit)
+	{
+		const __m128i va = _mm_loadu_si128((const __m128i*)&a[length]);
+		const __m128i vb = _mm_loadu_si128((const __m128i*)&b[length]);
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xFFFF)
+			break;
+
+		length += 16;
+	}
+
+#else
+
+	while (length + 8 <= limit)
+	{
+		UINT64 va, vb;
+		memcpy(&va, &a[length], sizeof(va));
+		memcpy(&vb, &b[length], sizeof(vb));
+
+		if (va != vb)
+			break;
+
+		length += 8;
+	}
+
+#endif
+
+	while ((length < limit) && (a[length] == b[length]))
+		length++;
+
+	return length;
+}
+
+/* number of equal bytes right before a and b, at most limit */
+static INLINE UINT32 xcrush_reverse_match_length(const BYTE* a, const BYTE* b, UINT32 limit)
+{
+	UINT32 length = 0;
+#if defined(XCRUSH_SSE2)
+
+	while (length + 16 <= limit)
+	{
+		const __m128i va = _mm_loadu_si128((const __m128i*)&a[-(INT64)length - 16]);
+		const __m128i vb = _mm_loadu_si128((const __m128i*)&b[-(INT64)length - 16]);
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xFFFF)
+			break;
+
+		length += 16;
+	}
+
+#else
+
+	while (length + 8 <= limit)
+	{
+		UINT64 va, vb;
+		memcpy(&va, &a[-(INT64)length - 8], sizeof(va));
+		memcpy(&vb, &b[-(INT64)length - 8], sizeof(vb));
+
+		if (va != vb)
+			break;
+
+		length += 8;
+	}
+
+#endif
+
+	while ((length < limit) && (a[-(INT64)length - 1] == b[-(INT64)length - 1]))
+		length++;
+
+	return length;
+}
+
 static int xcrush_find_match_length(XCRUSH_CONTEXT* xcrush, UINT32 MatchOffset, UINT32 ChunkOffset,
                                     UINT32 HistoryOffset, UINT32 SrcSize, UINT32 MaxMatchLength,
                                     XCRUSH_MATCH_INFO* MatchInfo)
 {
-	UINT32 MatchSymbol;
-	UINT32 ChunkSymbol;
 	BYTE* ChunkBuffer;
 	BYTE* MatchBuffer;
 	BYTE* MatchStartPtr;
-	BYTE* ForwardChunkPtr;
-	BYTE* ReverseChunkPtr;
-	BYTE* ForwardMatchPtr;
-	BYTE* ReverseMatchPtr;
 	BYTE* HistoryBufferEnd;
 	UINT32 ReverseMatchLength;
 	UINT32 ForwardMatchLength;
@@ -438,38 +550,23 @@ static int xcrush_find_match_length(XCRUSH_CONTEXT* xcrush, UINT32 MatchOffset,
 	if (ChunkBuffer < HistoryBuffer)
 		return -2005; /* error */
 
-	ForwardMatchPtr = &HistoryBuffer[MatchOffset];
-	ForwardChunkPtr = &HistoryBuffer[ChunkOffset];
-
 	if ((&MatchBuffer[MaxMatchLength + 1] < HistoryBufferEnd) &&
 	    (MatchBuffer[MaxMatchLength + 1] != ChunkBuffer[MaxMatchLength + 1]))
 	{
 		return 0;
 	}
 
-	while (1)
-	{
-		MatchSymbol = *ForwardMatchPtr++;
-		ChunkSymbol = *ForwardChunkPtr++;
+	/* the match may extend up to the end of the current packet */
+	ForwardMatchLength = xcrush_forward_match_length(MatchBuffer, ChunkBuffer,
+	                                                 (UINT32)(HistoryBufferEnd - MatchBuffer));
 
-		if (MatchSymbol != ChunkSymbol)
-			break;
-
-		if (ForwardMatchPtr > HistoryBufferEnd)
-			break;
-
-		ForwardMatchLength++;
-	}
-
-	ReverseMatchPtr = MatchBuffer - 1;
-	ReverseChunkPtr = ChunkBuffer - 1;
-
-	while ((ReverseMatchPtr > &HistoryBuffer[HistoryOffset]) && (ReverseChunkPtr > HistoryBuffer) &&
-	       (*ReverseMatchPtr == *ReverseChunkPtr))
+	/* and back to (but excluding) the first byte of the packet and of the history */
+	if ((MatchBuffer - 1 > &HistoryBuffer[HistoryOffset]) && (ChunkBuffer - 1 > HistoryBuffer))
 	{
-		ReverseMatchLength++;
-		ReverseMatchPtr--;
-		ReverseChunkPtr--;
+		ReverseMatchLength = xcrush_reverse_match_length(
+		    MatchBuffer, ChunkBuffer,
+		    MIN((UINT32)(MatchBuffer - 1 - &HistoryBuffer[HistoryOffset]),
+		        (UINT32)(ChunkBuffer - 1 - HistoryBuffer)));
 	}
 
 	MatchStartPtr = MatchBuffer - ReverseMatchLength;
@@ -1038,17 +1135,14 @@ int xcrush_compress(XCRUSH_CONTEXT* xcrush, BYTE* pSrcData, UINT32 SrcSize, BYTE
 	if (status < 0)
 		return status;
 
-	if (!status || (Level2ComprFlags & PACKET_FLUSHED))
+	/**
+	 * Without level 2 compression the level 1 data is sent as is, even if that is up to
+	 * 2 bytes larger than the input: sending the packet uncompressed would require a flush
+	 * of the whole level 1 history, which costs a lot more on the following packets.
+	 * A level 2 packet that restarted the MPPC history (flushed, but compressed) is kept.
+	 */
+	if (!status || !(Level2ComprFlags & PACKET_COMPRESSED))
 	{
-		if (CompressedDataSize > DstSize)
-		{
-			xcrush_context_reset(xcrush, TRUE);
-			*ppDstData = pSrcData;
-			*pDstSize = SrcSize;
-			*pFlags = 0;
-			return 1;
-		}
-
 		DstSize = CompressedDataSize;
 		CopyMemory(&OriginalData[2], CompressedData, CompressedDataSize);
 	}
@@ -3,6 +3,7 @@
 
 #include <freerdp/primitives.h>
 #include <freerdp/log.h>
+#include <freerdp/codec/color.h>
 #include <freerdp/codec/yuv.h>
 
 #define TAG FREERDP_TAG("codec")
@@ -10,6 +11,7 @@
 struct _YUV_CONTEXT
 {
 	UINT32 width, height;
+	BOOL encoder;
 	BOOL useThreads;
 	UINT32 nthreads;
 	UINT32 heightStep;
@@ -31,6 +33,20 @@ struct _YUV_PROCESS_WORK_PARAM
 };
 typedef struct _YUV_PROCESS_WORK_PARAM YUV_PROCESS_WORK_PARAM;
 
+struct _YUV_ENCODE_WORK_PARAM
+{
+	BYTE version;
+	const BYTE* pSrcData;
+	DWORD SrcFormat;
+	UINT32 nSrcStep;
+	const UINT32* iStride;
+	BYTE** pYUVLumaData;
+	BYTE** pYUVChromaData;
+	RECTANGLE_16 rect;
+	BOOL success;
+};
+typedef struct _YUV_ENCODE_WORK_PARAM YUV_ENCODE_WORK_PARAM;
+
 static void CALLBACK yuv_process_work_callback(PTP_CALLBACK_INSTANCE instance, void* context,
                                                PTP_WORK work)
 {
@@ -64,6 +80,7 @@ YUV_CONTEXT* yuv_context_new(BOOL encoder)
 	/** do it here to avoid a race condition between threads */
 	primitives_get();
 
+	ret->encoder = encoder;
 	GetNativeSystemInfo(&sysInfos);
 	ret->useThreads = (sysInfos.dwNumberOfProcessors > 1);
 	if (ret->useThreads)
@@ -175,3 +192,174 @@ BOOL yuv_context_decode(YUV_CONTEXT* context, const BYTE* pYUVData[3], UINT32 iS
 
 	return ret;
 }
+
+/**
+ * Converts a macroblock aligned rectangle. Both AVC444 layouts interleave B45
+ * in blocks of 8 chroma lines, so offsets match the ones of the main view.
+ * Version 2 places the odd columns in the right half of the auxiliary view
+ * which requires rectangles spanning the full width.
+ */
+static BOOL yuv_encode_rect(const YUV_ENCODE_WORK_PARAM* param)
+{
+	prim_size_t roi;
+	primitives_t* prims = primitives_get();
+	const UINT32* iStride = param->iStride;
+	const UINT32 x = param->rect.left;
+	const UINT32 y = param->rect.top;
+	const BYTE* pSrc =
+	    &param->pSrcData[y * param->nSrcStep + x * GetBytesPerPixel(param->SrcFormat)];
+	BYTE* pLuma[3];
+	BYTE* pChroma[3];
+	pLuma[0] = &param->pYUVLumaData[0][y * iStride[0] + x];
+	pLuma[1] = &param->pYUVLumaData[1][(y / 2) * iStride[1] + x / 2];
+	pLuma[2] = &param->pYUVLumaData[2][(y / 2) * iStride[2] + x / 2];
+	roi.width = param->rect.right - param->rect.left;
+	roi.height = param->rect.bottom - param->rect.top;
+
+	if (param->version == 0)
+		return prims->RGBToYUV420_8u_P3AC4R(pSrc, param->SrcFormat, param->nSrcStep, pLuma,
+		                                    (UINT32*)iStride, &roi) == PRIMITIVES_SUCCESS;
+
+	pChroma[0] = &param->pYUVChromaData[0][y * iStride[0] + x];
+	pChroma[1] = &param->pYUVChromaData[1][(y / 2) * iStride[1] + x / 2];
+	pChroma[2] = &param->pYUVChromaData[2][(y / 2) * iStride[2] + x / 2];
+
+	switch (param->version)
+	{
+		case 1:
+			return prims->RGBToAVC444YUV(pSrc, param->SrcFormat, param->nSrcStep, pLuma, iStride,
+			                             pChroma, iStride, &roi) == PRIMITIVES_SUCCESS;
+
+		case 2:
+			return prims->RGBToAVC444YUVv2(pSrc, param->SrcFormat, param->nSrcStep, pLuma, iStride,
+			                               pChroma, iStride, &roi) == PRIMITIVES_SUCCESS;
+
+		default:
+			return FALSE;
+	}
+}
+
+static void CALLBACK yuv_encode_work_callback(PTP_CALLBACK_INSTANCE instance, void* context,
+                                              PTP_WORK work)
+{
+	YUV_ENCODE_WORK_PARAM* param = (YUV_ENCODE_WORK_PARAM*)context;
+	WINPR_UNUSED(instance);
+	WINPR_UNUSED(work);
+	param->success = yuv_encode_rect(param);
+
+	if (!param->success)
+		WLog_ERR(TAG, "error when encoding lines");
+}
+
+static BOOL yuv_context_encode(YUV_CONTEXT* context, BYTE version, const BYTE* pSrcData,
+                               UINT32 nSrcStep, DWORD SrcFormat, const UINT32 iStride[3],
+                               BYTE* pYUVLumaData[3], BYTE* pYUVChromaData[3],
+                               const RECTANGLE_16* regionRects, UINT32 numRegionRects)
+{
+	UINT32 x, y, i, nobjects = 0;
+	UINT32 waitCount = 0;
+	PTP_WORK* work_objects;
+	YUV_ENCODE_WORK_PARAM* params;
+	BOOL ret = TRUE;
+	primitives_t* prims = primitives_get();
+	/* Slices stay macroblock aligned, this keeps the B45 interleave of AVC444 in place */
+	const UINT32 step = MAX(16, (context->heightStep + 15) & ~15U);
+
+	if (!context->encoder)
+		return FALSE;
+
+	for (x = 0; x < numRegionRects; x++)
+	{
+		const UINT32 height = regionRects[x].bottom - regionRects[x].top;
+		nobjects += (height + step - 1) / step;
+	}
+
+	params = (YUV_ENCODE_WORK_PARAM*)calloc(nobjects, sizeof(*params));
+	work_objects = (PTP_WORK*)calloc(nobjects, sizeof(PTP_WORK));
+
+	if (!params || !work_objects)
+	{
+		free(params);
+		free(work_objects);
+		return nobjects == 0;
+	}
+
+	for (x = 0, i = 0; x < numRegionRects; x++)
+	{
+		const RECTANGLE_16* rect = &regionRects[x];
+
+		for (y = rect->top; y < rect->bottom; y += step, i++)
+		{
+			params[i].version = version;
+			params[i].pSrcData = pSrcData;
+			params[i].SrcFormat = SrcFormat;
+			params[i].nSrcStep = nSrcStep;
+			params[i].iStride = iStride;
+			params[i].pYUVLumaData = pYUVLumaData;
+			params[i].pYUVChromaData = pYUVChromaData;
+			params[i].rect.left = rect->left;
+			params[i].rect.top = (UINT16)y;
+			params[i].rect.right = rect->right;
+			params[i].rect.bottom = (UINT16)MIN(rect->bottom, y + step);
+		}
+	}
+
+	/* A single slice is not worth the round trip through the pool */
+	if (!context->useThreads || (nobjects == 1) ||
+	    (primitives_flags(prims) & PRIM_FLAGS_HAVE_EXTGPU))
+	{
+		for (i = 0; (i < nobjects) && ret; i++)
+			ret = yuv_encode_rect(&params[i]);
+
+		free(work_objects);
+		free(params);
+		return ret;
+	}
+
+	for (i = 0; i < nobjects; i++, waitCount++)
+	{
+		work_objects[i] = CreateThreadpoolWork(yuv_encode_work_callback, (void*)&params[i],
+		                                       &context->ThreadPoolEnv);
+
+		if (!work_objects[i])
+		{
+			ret = FALSE;
+			break;
+		}
+
+		SubmitThreadpoolWork(work_objects[i]);
+	}
+
+	for (i = 0; i < waitCount; i++)
+	{
+		WaitForThreadpoolWorkCallbacks(work_objects[i], FALSE);
+		CloseThreadpoolWork(work_objects[i]);
+
+		if (!params[i].success)
+			ret = FALSE;
+	}
+
+	free(work_objects);
+	free(params);
+	return ret;
+}
+
+BOOL yuv420_context_encode(YUV_CONTEXT* context, const BYTE* pSrcData, UINT32 nSrcStep,
+                           DWORD SrcFormat, const UINT32 iStride[3], BYTE* pYUVData[3],
+                           const RECTANGLE_16* regionRects, UINT32 numRegionRects)
+{
+	return yuv_context_encode(context, 0, pSrcData, nSrcStep, SrcFormat, iStride, pYUVData, NULL,
+	                          regionRects, numRegionRects);
+}
+
+BOOL yuv444_context_encode(YUV_CONTEXT* context, BYTE version, const BYTE* pSrcData,
+                           UINT32 nSrcStep, DWORD SrcFormat, const UINT32 iStride[3],
+                           BYTE* pYUVLumaData[3], BYTE* pYUVChromaData[3],
+                           const RECTANGLE_16* regionRects, UINT32 numRegionRects)
+{
+	if ((version != 1) && (version != 2))
+		return FALSE;
+
+	return yuv_context_encode(context, version, pSrcData, nSrcStep, SrcFormat, iStride,
+	                          pYUVLumaData, pYUVChromaData, regionRects, numRegionRects);
+}
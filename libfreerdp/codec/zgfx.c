@@ -52,9 +52,22 @@ struct _ZGFX_TOKEN
 };
 typedef struct _ZGFX_TOKEN ZGFX_TOKEN;
 
+#define ZGFX_HASH_BITS 16
+#define ZGFX_HASH_SIZE (1 << ZGFX_HASH_BITS)
+#define ZGFX_MIN_MATCH 3
+
+struct _ZGFX_MATCH_PARAMS
+{
+	UINT32 maxChain;
+	UINT32 niceLength;
+	BOOL lazy;
+};
+typedef struct _ZGFX_MATCH_PARAMS ZGFX_MATCH_PARAMS;
+
 struct _ZGFX_CONTEXT
 {
 	BOOL Compressor;
+	ZGFX_COMPRESSION_MODE CompressionMode;
 
 	const BYTE* pbInputCurrent;
 	const BYTE* pbInputEnd;
@@ -70,8 +83,19 @@ struct _ZGFX_CONTEXT
 	BYTE HistoryBuffer[2500000];
 	UINT32 HistoryIndex;
 	UINT32 HistoryBufferSize;
+
+	/* Compressor state: hash chains over the history buffer */
+	UINT32* HashHead;
+	UINT32* HashChain;
+	UINT16 LiteralCode[256];
+	BYTE LiteralBits[256];
+	UINT32 HistoryPosition;
+	UINT32 HistoryFill;
 };
 
+static const ZGFX_MATCH_PARAMS ZGFX_MATCH_PARAMS_FAST = { 8, 32, FALSE };
+static const ZGFX_MATCH_PARAMS ZGFX_MATCH_PARAMS_BEST = { 512, 1024, TRUE };
+
 static const ZGFX_TOKEN ZGFX_TOKEN_TABLE[] = {
 	// len code vbits type  vbase
 	{ 1, 0, 8, 0, 0 },           // 0
@@ -452,19 +476,311 @@ fail:
 	return status;
 }
 
+static INLINE BOOL zgfx_PutBits(ZGFX_CONTEXT* zgfx, UINT32 bits, UINT32 nbits)
+{
+	zgfx->BitsCurrent = (zgfx->BitsCurrent << nbits) | (bits & ((1UL << nbits) - 1));
+	zgfx->cBitsCurrent += nbits;
+
+	while (zgfx->cBitsCurrent >= 8)
+	{
+		if (zgfx->OutputCount >= sizeof(zgfx->OutputBuffer))
+			return FALSE;
+
+		zgfx->cBitsCurrent -= 8;
+		zgfx->OutputBuffer[zgfx->OutputCount++] = (BYTE)(zgfx->BitsCurrent >> zgfx->cBitsCurrent);
+	}
+
+	zgfx->BitsCurrent &= ((1UL << zgfx->cBitsCurrent) - 1);
+	return TRUE;
+}
+
+static void zgfx_init_literal_codes(ZGFX_CONTEXT* zgfx)
+{
+	UINT32 c;
+	UINT32 opIndex;
+
+	for (c = 0; c < 256; c++)
+	{
+		zgfx->LiteralCode[c] = (UINT16)((ZGFX_TOKEN_TABLE[0].prefixCode << 8) | c);
+		zgfx->LiteralBits[c] = (BYTE)(ZGFX_TOKEN_TABLE[0].prefixLength + 8);
+	}
+
+	/* Frequent literals have a dedicated token without value bits */
+	for (opIndex = 1; ZGFX_TOKEN_TABLE[opIndex].prefixLength != 0; opIndex++)
+	{
+		const ZGFX_TOKEN* token = &ZGFX_TOKEN_TABLE[opIndex];
+
+		if ((token->tokenType == 0) && (token->valueBits == 0))
+		{
+			zgfx->LiteralCode[token->valueBase] = (UINT16)token->prefixCode;
+			zgfx->LiteralBits[token->valueBase] = (BYTE)token->prefixLength;
+		}
+	}
+}
+
+static INLINE BOOL zgfx_write_literal(ZGFX_CONTEXT* zgfx, BYTE c)
+{
+	return zgfx_PutBits(zgfx, zgfx->LiteralCode[c], zgfx->LiteralBits[c]);
+}
+
+static INLINE BOOL zgfx_write_match(ZGFX_CONTEXT* zgfx, UINT32 distance, UINT32 count)
+{
+	UINT32 opIndex;
+	UINT32 extra;
+	const ZGFX_TOKEN* token = NULL;
+
+	for (opIndex = 0; ZGFX_TOKEN_TABLE[opIndex].prefixLength != 0; opIndex++)
+	{
+		const ZGFX_TOKEN* cur = &ZGFX_TOKEN_TABLE[opIndex];
+
+		if ((cur->tokenType == 1) && (distance >= cur->valueBase) &&
+		    (distance - cur->valueBase < (1UL << cur->valueBits)))
+		{
+			token = cur;
+			break;
+		}
+	}
+
+	if (!token)
+		return FALSE;
+
+	if (!zgfx_PutBits(zgfx, token->prefixCode, token->prefixLength))
+		return FALSE;
+
+	if (!zgfx_PutBits(zgfx, distance - token->valueBase, token->valueBits))
+		return FALSE;
+
+	if (count == 3)
+		return zgfx_PutBits(zgfx, 0, 1);
+
+	/* 2^extra <= count < 2^(extra + 1): (extra - 1) one bits, a zero bit, then extra bits */
+	for (extra = 2; (count >> (extra + 1)) != 0; extra++)
+		;
+
+	if (!zgfx_PutBits(zgfx, ((1UL << (extra - 1)) - 1) << 1, extra))
+		return FALSE;
+
+	return zgfx_PutBits(zgfx, count - (1UL << extra), extra);
+}
+
+static INLINE UINT32 zgfx_hash(const BYTE* src)
+{
+	const UINT32 value = ((UINT32)src[0] << 16) | ((UINT32)src[1] << 8) | src[2];
+	return (UINT32)(value * 2654435761U) >> (32 - ZGFX_HASH_BITS);
+}
+
+static INLINE void zgfx_hash_insert(ZGFX_CONTEXT* zgfx, const BYTE* src, UINT32 position,
+                                    UINT32 index)
+{
+	const UINT32 hash = zgfx_hash(src);
+	zgfx->HashChain[index] = zgfx->HashHead[hash];
+	zgfx->HashHead[hash] = position;
+}
+
+static UINT32 zgfx_match_length(const ZGFX_CONTEXT* zgfx, UINT32 index, const BYTE* src,
+                                UINT32 maxLength)
+{
+	UINT32 length = 0;
+
+	while (length < maxLength)
+	{
+		UINT32 count = 0;
+		const BYTE* history = &zgfx->HistoryBuffer[index];
+		const UINT32 run = MIN(maxLength - length, zgfx->HistoryBufferSize - index);
+
+		while ((count < run) && (history[count] == src[length + count]))
+			count++;
+
+		length += count;
+
+		if (count < run)
+			break;
+
+		index = 0;
+	}
+
+	return length;
+}
+
+static UINT32 zgfx_find_match(const ZGFX_CONTEXT* zgfx, const BYTE* src, UINT32 maxLength,
+                              UINT32 position, UINT32 index, UINT32 maxDistance,
+                              const ZGFX_MATCH_PARAMS* params, UINT32* pDistance)
+{
+	UINT32 chain;
+	UINT32 bestLength = 0;
+	UINT32 lastDistance = 0;
+	UINT32 candidate = zgfx->HashHead[zgfx_hash(src)];
+
+	for (chain = 0; chain < params->maxChain; chain++)
+	{
+		UINT32 length;
+		UINT32 candidateIndex;
+		const UINT32 distance = position - candidate;
+
+		/* Chains only ever point further back, anything else is a stale entry */
+		if ((distance <= lastDistance) || (distance > maxDistance))
+			break;
+
+		lastDistance = distance;
+		candidateIndex = (index + zgfx->HistoryBufferSize - distance) % zgfx->HistoryBufferSize;
+
+		if ((bestLength == 0) || (candidateIndex + bestLength >= zgfx->HistoryBufferSize) ||
+		    (zgfx->HistoryBuffer[candidateIndex + bestLength] == src[bestLength]))
+		{
+			length = zgfx_match_length(zgfx, candidateIndex, src, maxLength);
+
+			if (length > bestLength)
+			{
+				bestLength = length;
+				*pDistance = distance;
+
+				if ((length >= params->niceLength) || (length == maxLength))
+					break;
+			}
+		}
+
+		candidate = zgfx->HashChain[candidateIndex];
+	}
+
+	return (bestLength >= ZGFX_MIN_MATCH) ? bestLength : 0;
+}
+
+/**
+ * Encode a segment that has already been appended to the history buffer at index start.
+ * Returns FALSE if the encoded form would not be smaller than the raw segment.
+ */
+static BOOL zgfx_compress_tokens(ZGFX_CONTEXT* zgfx, const BYTE* pSrcData, UINT32 SrcSize,
+                                 UINT32 start)
+{
+	UINT32 offset = 0;
+	UINT32 prevLength = 0;
+	UINT32 prevDistance = 0;
+	BOOL pending = FALSE;
+	const UINT32 windowSize = zgfx->HistoryBufferSize - ZGFX_SEGMENTED_MAXSIZE;
+	const ZGFX_MATCH_PARAMS* params = (zgfx->CompressionMode == ZGFX_COMPRESSION_BEST)
+	                                      ? &ZGFX_MATCH_PARAMS_BEST
+	                                      : &ZGFX_MATCH_PARAMS_FAST;
+	zgfx->OutputCount = 0;
+	zgfx->BitsCurrent = 0;
+	zgfx->cBitsCurrent = 0;
+
+	while (offset < SrcSize)
+	{
+		UINT32 length = 0;
+		UINT32 distance = 0;
+		UINT32 matchStart;
+		UINT32 matchLength;
+		UINT32 matchDistance;
+		const UINT32 position = zgfx->HistoryPosition + offset;
+
+		if (SrcSize - offset >= ZGFX_MIN_MATCH)
+		{
+			const UINT32 index = (start + offset) % zgfx->HistoryBufferSize;
+			const UINT32 maxDistance = MIN(zgfx->HistoryFill + offset, windowSize);
+			length = zgfx_find_match(zgfx, &pSrcData[offset], SrcSize - offset, position, index,
+			                         maxDistance, params, &distance);
+			zgfx_hash_insert(zgfx, &pSrcData[offset], position, index);
+		}
+
+		if (!params->lazy)
+		{
+			if (length == 0)
+			{
+				if (!zgfx_write_literal(zgfx, pSrcData[offset]))
+					return FALSE;
+
+				offset++;
+				continue;
+			}
+
+			matchStart = offset;
+			matchLength = length;
+			matchDistance = distance;
+		}
+		else
+		{
+			/* Defer each match by one byte and keep the longer one */
+			if ((prevLength == 0) || (length > prevLength))
+			{
+				if (pending && !zgfx_write_literal(zgfx, pSrcData[offset - 1]))
+					return FALSE;
+
+				pending = TRUE;
+				prevLength = length;
+				prevDistance = distance;
+				offset++;
+				continue;
+			}
+
+			matchStart = offset - 1;
+			matchLength = prevLength;
+			matchDistance = prevDistance;
+			pending = FALSE;
+			prevLength = 0;
+		}
+
+		if (!zgfx_write_match(zgfx, matchDistance, matchLength))
+			return FALSE;
+
+		for (offset++; offset < matchStart + matchLength; offset++)
+		{
+			if (SrcSize - offset >= ZGFX_MIN_MATCH)
+				zgfx_hash_insert(zgfx, &pSrcData[offset], zgfx->HistoryPosition + offset,
+				                 (start + offset) % zgfx->HistoryBufferSize);
+		}
+
+		if (zgfx->OutputCount >= SrcSize)
+			return FALSE;
+	}
+
+	if (pending && !zgfx_write_literal(zgfx, pSrcData[SrcSize - 1]))
+		return FALSE;
+
+	/* Flush the remaining bits, the last byte holds the number of unused bits */
+	if (zgfx->cBitsCurrent > 0)
+	{
+		const UINT32 padding = 8 - zgfx->cBitsCurrent;
+
+		if (!zgfx_PutBits(zgfx, 0, padding) || !zgfx_PutBits(zgfx, padding, 8))
+			return FALSE;
+	}
+	else if (!zgfx_PutBits(zgfx, 0, 8))
+		return FALSE;
+
+	return zgfx->OutputCount < SrcSize;
+}
+
 static BOOL zgfx_compress_segment(ZGFX_CONTEXT* zgfx, wStream* s, const BYTE* pSrcData,
                                   UINT32 SrcSize, UINT32* pFlags)
 {
-	/* FIXME: Currently compression not implemented. Just copy the raw source */
+	BYTE flags = ZGFX_PACKET_COMPR_TYPE_RDP8; /* RDP 8.0 compression format */
+	const UINT32 start = zgfx->HistoryIndex;
+
 	if (!Stream_EnsureRemainingCapacity(s, SrcSize + 1))
 	{
 		WLog_ERR(TAG, "Stream_EnsureRemainingCapacity failed!");
 		return FALSE;
 	}
 
-	(*pFlags) |= ZGFX_PACKET_COMPR_TYPE_RDP8; /* RDP 8.0 compression format */
-	Stream_Write_UINT8(s, (*pFlags));         /* header (1 byte) */
-	Stream_Write(s, pSrcData, SrcSize);
+	/* The decompressor adds every segment to its history, compressed or not */
+	zgfx_history_buffer_ring_write(zgfx, pSrcData, SrcSize);
+
+	if (zgfx->HashHead && (zgfx->CompressionMode != ZGFX_COMPRESSION_NONE) && (SrcSize > 0))
+	{
+		if (zgfx_compress_tokens(zgfx, pSrcData, SrcSize, start))
+			flags |= PACKET_COMPRESSED;
+	}
+
+	zgfx->HistoryPosition += SrcSize;
+	zgfx->HistoryFill = MIN(zgfx->HistoryFill + SrcSize, zgfx->HistoryBufferSize);
+	(*pFlags) |= flags;
+	Stream_Write_UINT8(s, flags); /* header (1 byte) */
+
+	if (flags & PACKET_COMPRESSED)
+		Stream_Write(s, zgfx->OutputBuffer, zgfx->OutputCount);
+	else
+		Stream_Write(s, pSrcData, SrcSize);
+
 	return TRUE;
 }
 
@@ -565,6 +881,29 @@ int zgfx_compress(ZGFX_CONTEXT* zgfx, const BYTE* pSrcData, UINT32 SrcSize, BYTE
 void zgfx_context_reset(ZGFX_CONTEXT* zgfx, BOOL flush)
 {
 	zgfx->HistoryIndex = 0;
+	zgfx->HistoryPosition = 0;
+	zgfx->HistoryFill = 0;
+
+	if (zgfx->HashHead)
+		ZeroMemory(zgfx->HashHead, ZGFX_HASH_SIZE * sizeof(UINT32));
+}
+
+BOOL zgfx_context_set_compression_mode(ZGFX_CONTEXT* zgfx, ZGFX_COMPRESSION_MODE mode)
+{
+	if (!zgfx || !zgfx->Compressor)
+		return FALSE;
+
+	switch (mode)
+	{
+		case ZGFX_COMPRESSION_NONE:
+		case ZGFX_COMPRESSION_FAST:
+		case ZGFX_COMPRESSION_BEST:
+			zgfx->CompressionMode = mode;
+			return TRUE;
+
+		default:
+			return FALSE;
+	}
 }
 
 ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
@@ -576,6 +915,21 @@ ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
 	{
 		zgfx->Compressor = Compressor;
 		zgfx->HistoryBufferSize = sizeof(zgfx->HistoryBuffer);
+
+		if (Compressor)
+		{
+			zgfx->CompressionMode = ZGFX_COMPRESSION_FAST;
+			zgfx_init_literal_codes(zgfx);
+			zgfx->HashHead = (UINT32*)calloc(ZGFX_HASH_SIZE, sizeof(UINT32));
+			zgfx->HashChain = (UINT32*)calloc(zgfx->HistoryBufferSize, sizeof(UINT32));
+
+			if (!zgfx->HashHead || !zgfx->HashChain)
+			{
+				zgfx_context_free(zgfx);
+				return NULL;
+			}
+		}
+
 		zgfx_context_reset(zgfx, FALSE);
 	}
 
@@ -584,5 +938,10 @@ ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
 
 void zgfx_context_free(ZGFX_CONTEXT* zgfx)
 {
+	if (!zgfx)
+		return;
+
+	free(zgfx->HashHead);
+	free(zgfx->HashChain);
 	free(zgfx);
 }
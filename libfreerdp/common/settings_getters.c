@@ -75,6 +75,9 @@ BOOL freerdp_settings_get_bool(const rdpSettings* settings, size_t id)
 		case FreeRDP_ColorPointerFlag:
 			return settings->ColorPointerFlag;
 
+		case FreeRDP_CompressionAdaptive:
+			return settings->CompressionAdaptive;
+
 		case FreeRDP_CompressionEnabled:
 			return settings->CompressionEnabled;
 
@@ -213,6 +216,9 @@ BOOL freerdp_settings_get_bool(const rdpSettings* settings, size_t id)
 		case FreeRDP_GfxH264:
 			return settings->GfxH264;
 
+		case FreeRDP_GfxParallelDecode:
+			return settings->GfxParallelDecode;
+
 		case FreeRDP_GfxProgressive:
 			return settings->GfxProgressive;
 
@@ -471,6 +477,9 @@ BOOL freerdp_settings_get_bool(const rdpSettings* settings, size_t id)
 		case FreeRDP_TcpKeepAlive:
 			return settings->TcpKeepAlive;
 
+		case FreeRDP_TlsKernelOffload:
+			return settings->TlsKernelOffload;
+
 		case FreeRDP_TlsSecurity:
 			return settings->TlsSecurity;
 
@@ -601,6 +610,10 @@ BOOL freerdp_settings_set_bool(rdpSettings* settings, size_t id, BOOL val)
 			settings->ColorPointerFlag = val;
 			break;
 
+		case FreeRDP_CompressionAdaptive:
+			settings->CompressionAdaptive = val;
+			break;
+
 		case FreeRDP_CompressionEnabled:
 			settings->CompressionEnabled = val;
 			break;
@@ -785,6 +798,10 @@ BOOL freerdp_settings_set_bool(rdpSettings* settings, size_t id, BOOL val)
 			settings->GfxH264 = val;
 			break;
 
+		case FreeRDP_GfxParallelDecode:
+			settings->GfxParallelDecode = val;
+			break;
+
 		case FreeRDP_GfxProgressive:
 			settings->GfxProgressive = val;
 			break;
@@ -1129,6 +1146,10 @@ BOOL freerdp_settings_set_bool(rdpSettings* settings, size_t id, BOOL val)
 			settings->TcpKeepAlive = val;
 			break;
 
+		case FreeRDP_TlsKernelOffload:
+			settings->TlsKernelOffload = val;
+			break;
+
 		case FreeRDP_TlsSecurity:
 			settings->TlsSecurity = val;
 			break;
@@ -1300,6 +1321,9 @@ UINT32 freerdp_settings_get_uint32(const rdpSettings* settings, size_t id)
 		case FreeRDP_CompressionLevel:
 			return settings->CompressionLevel;
 
+		case FreeRDP_CompressionNCrushMode:
+			return settings->CompressionNCrushMode;
+
 		case FreeRDP_ConnectionType:
 			return settings->ConnectionType;
 
@@ -1360,6 +1384,9 @@ UINT32 freerdp_settings_get_uint32(const rdpSettings* settings, size_t id)
 		case FreeRDP_ExtEncryptionMethods:
 			return settings->ExtEncryptionMethods;
 
+		case FreeRDP_FastPathInputBatchWindow:
+			return settings->FastPathInputBatchWindow;
+
 		case FreeRDP_FrameAcknowledge:
 			return settings->FrameAcknowledge;
 
@@ -1661,6 +1688,10 @@ BOOL freerdp_settings_set_uint32(rdpSettings* settings, size_t id, UINT32 val)
 			settings->CompressionLevel = val;
 			break;
 
+		case FreeRDP_CompressionNCrushMode:
+			settings->CompressionNCrushMode = val;
+			break;
+
 		case FreeRDP_ConnectionType:
 			settings->ConnectionType = val;
 			break;
@@ -1741,6 +1772,10 @@ BOOL freerdp_settings_set_uint32(rdpSettings* settings, size_t id, UINT32 val)
 			settings->ExtEncryptionMethods = val;
 			break;
 
+		case FreeRDP_FastPathInputBatchWindow:
+			settings->FastPathInputBatchWindow = val;
+			break;
+
 		case FreeRDP_FrameAcknowledge:
 			settings->FrameAcknowledge = val;
 			break;
@@ -35,6 +35,7 @@ static const struct settings_str_entry settings_map[] = {
 	{ FreeRDP_BitmapCacheV3Enabled, 0, "FreeRDP_BitmapCacheV3Enabled" },
 	{ FreeRDP_BitmapCompressionDisabled, 0, "FreeRDP_BitmapCompressionDisabled" },
 	{ FreeRDP_ColorPointerFlag, 0, "FreeRDP_ColorPointerFlag" },
+	{ FreeRDP_CompressionAdaptive, 0, "FreeRDP_CompressionAdaptive" },
 	{ FreeRDP_CompressionEnabled, 0, "FreeRDP_CompressionEnabled" },
 	{ FreeRDP_ConsoleSession, 0, "FreeRDP_ConsoleSession" },
 	{ FreeRDP_CredentialsFromStdin, 0, "FreeRDP_CredentialsFromStdin" },
@@ -81,6 +82,7 @@ static const struct settings_str_entry settings_map[] = {
 	{ FreeRDP_GfxAVC444, 0, "FreeRDP_GfxAVC444" },
 	{ FreeRDP_GfxAVC444v2, 0, "FreeRDP_GfxAVC444v2" },
 	{ FreeRDP_GfxH264, 0, "FreeRDP_GfxH264" },
+	{ FreeRDP_GfxParallelDecode, 0, "FreeRDP_GfxParallelDecode" },
 	{ FreeRDP_GfxProgressive, 0, "FreeRDP_GfxProgressive" },
 	{ FreeRDP_GfxProgressiveV2, 0, "FreeRDP_GfxProgressiveV2" },
 	{ FreeRDP_GfxSendQoeAck, 0, "FreeRDP_GfxSendQoeAck" },
@@ -167,6 +169,7 @@ static const struct settings_str_entry settings_map[] = {
 	{ FreeRDP_SurfaceCommandsEnabled, 0, "FreeRDP_SurfaceCommandsEnabled" },
 	{ FreeRDP_SurfaceFrameMarkerEnabled, 0, "FreeRDP_SurfaceFrameMarkerEnabled" },
 	{ FreeRDP_TcpKeepAlive, 0, "FreeRDP_TcpKeepAlive" },
+	{ FreeRDP_TlsKernelOffload, 0, "FreeRDP_TlsKernelOffload" },
 	{ FreeRDP_TlsSecurity, 0, "FreeRDP_TlsSecurity" },
 	{ FreeRDP_ToggleFullscreen, 0, "FreeRDP_ToggleFullscreen" },
 	{ FreeRDP_UnicodeInput, 0, "FreeRDP_UnicodeInput" },
@@ -195,6 +198,7 @@ static const struct settings_str_entry settings_map[] = {
 	{ FreeRDP_ColorDepth, 3, "FreeRDP_ColorDepth" },
 	{ FreeRDP_CompDeskSupportLevel, 3, "FreeRDP_CompDeskSupportLevel" },
 	{ FreeRDP_CompressionLevel, 3, "FreeRDP_CompressionLevel" },
+	{ FreeRDP_CompressionNCrushMode, 3, "FreeRDP_CompressionNCrushMode" },
 	{ FreeRDP_ConnectionType, 3, "FreeRDP_ConnectionType" },
 	{ FreeRDP_CookieMaxLength, 3, "FreeRDP_CookieMaxLength" },
 	{ FreeRDP_DesktopHeight, 3, "FreeRDP_DesktopHeight" },
@@ -215,6 +219,7 @@ static const struct settings_str_entry settings_map[] = {
 	{ FreeRDP_EncryptionLevel, 3, "FreeRDP_EncryptionLevel" },
 	{ FreeRDP_EncryptionMethods, 3, "FreeRDP_EncryptionMethods" },
 	{ FreeRDP_ExtEncryptionMethods, 3, "FreeRDP_ExtEncryptionMethods" },
+	{ FreeRDP_FastPathInputBatchWindow, 3, "FreeRDP_FastPathInputBatchWindow" },
 	{ FreeRDP_FrameAcknowledge, 3, "FreeRDP_FrameAcknowledge" },
 	{ FreeRDP_GatewayAcceptedCertLength, 3, "FreeRDP_GatewayAcceptedCertLength" },
 	{ FreeRDP_GatewayCredentialsSource, 3, "FreeRDP_GatewayCredentialsSource" },
@@ -21,10 +21,52 @@
 #include "config.h"
 #endif
 
+#include <freerdp/utils/stopwatch.h>
+
 #include "bulk.h"
 
 #define TAG "com.freerdp.core"
 
+/**
+ * The sender may use any compression type up to the negotiated one, the type is part of every
+ * packet and each type has its own history on both ends. bulk_compress uses the negotiated
+ * type, or the highest type below it taking the packet. With FreeRDP_CompressionAdaptive it
+ * picks the type per packet from moving averages of the ratio and the time each compressor
+ * needed, the output then depends on timing.
+ */
+
+/* weight of a new measurement in the moving averages */
+#define BULK_ESTIMATE_WEIGHT 0.125
+
+/* every BULK_PROBE_INTERVAL packets another compressor is used to refresh its estimate */
+#define BULK_PROBE_INTERVAL 64
+
+/* compressors needing more microseconds per KiB (about 25 MiB/s) are used only if all do */
+#define BULK_CPU_BUDGET 40.0
+
+/* smaller packets gain less than the compression headers cost */
+#define BULK_MIN_SIZE 50
+
+/**
+ * Largest packet each compression type takes, indexed by type. The history of the receiver
+ * has to hold the whole packet, larger PDUs are compressed with the types that can take them.
+ */
+static const UINT32 BULK_MAX_SIZE[METRICS_COMPRESSION_TYPES] = {
+	8192,  /* PACKET_COMPR_TYPE_8K */
+	65535, /* PACKET_COMPR_TYPE_64K */
+	32760, /* PACKET_COMPR_TYPE_RDP6, NCrush keeps 32 KiB of history when the window moves */
+	16384, /* PACKET_COMPR_TYPE_RDP61, XCrush block size */
+	65534  /* PACKET_COMPR_TYPE_RDP8, a single ZGFX segment in the output buffer */
+};
+
+struct _BULK_ESTIMATE
+{
+	BOOL Valid;
+	double Ratio; /* compressed / uncompressed size */
+	double Cost;  /* microseconds per KiB of input */
+};
+typedef struct _BULK_ESTIMATE BULK_ESTIMATE;
+
 //#define WITH_BULK_DEBUG		1
 struct rdp_bulk
 {
@@ -37,7 +79,15 @@ struct rdp_bulk
 	NCRUSH_CONTEXT* ncrushSend;
 	XCRUSH_CONTEXT* xcrushRecv;
 	XCRUSH_CONTEXT* xcrushSend;
+	ZGFX_CONTEXT* zgfxRecv;
+	ZGFX_CONTEXT* zgfxSend;
+	BYTE* zgfxOutput;
 	BYTE OutputBuffer[65536];
+
+	STOPWATCH Stopwatch;
+	BULK_ESTIMATE Estimates[METRICS_COMPRESSION_TYPES];
+	UINT32 PacketCount;
+	UINT32 ProbeIndex;
 };
 
 #if WITH_BULK_DEBUG
@@ -69,8 +119,8 @@ static INLINE const char* bulk_get_compression_flags_string(UINT32 flags)
 static UINT32 bulk_compression_level(rdpBulk* bulk)
 {
 	rdpSettings* settings = bulk->context->settings;
-	bulk->CompressionLevel = (settings->CompressionLevel >= PACKET_COMPR_TYPE_RDP61)
-	                             ? PACKET_COMPR_TYPE_RDP61
+	bulk->CompressionLevel = (settings->CompressionLevel >= PACKET_COMPR_TYPE_RDP8)
+	                             ? PACKET_COMPR_TYPE_RDP8
 	                             : settings->CompressionLevel;
 	return bulk->CompressionLevel;
 }
@@ -94,7 +144,7 @@ static INLINE int bulk_compress_validate(rdpBulk* bulk, BYTE* pSrcData, UINT32 S
 	UINT32 _Flags = 0;
 	_pSrcData = *ppDstData;
 	_SrcSize = *pDstSize;
-	_Flags = *pFlags | bulk->CompressionLevel;
+	_Flags = *pFlags;
 	status = bulk_decompress(bulk, _pSrcData, _SrcSize, &_pDstData, &_DstSize, _Flags);
 
 	if (status < 0)
@@ -169,10 +219,20 @@ int bulk_decompress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstD
 				break;
 
 			case PACKET_COMPR_TYPE_RDP8:
-				WLog_ERR(TAG, "Unsupported bulk compression type %08" PRIx32,
-				         bulk->CompressionLevel);
-				status = -1;
+				/* the RDP8 history is large, only allocated when the peer uses it */
+				if (!bulk->zgfxRecv)
+					bulk->zgfxRecv = zgfx_context_new(FALSE);
+
+				if (!bulk->zgfxRecv)
+					break;
+
+				free(bulk->zgfxOutput);
+				bulk->zgfxOutput = NULL;
+				status = zgfx_decompress(bulk->zgfxRecv, pSrcData, SrcSize, &bulk->zgfxOutput,
+				                         pDstSize, flags);
+				*ppDstData = bulk->zgfxOutput;
 				break;
+
 			default:
 				WLog_ERR(TAG, "Unknown bulk compression type %08" PRIx32, bulk->CompressionLevel);
 				status = -1;
@@ -213,68 +273,219 @@ int bulk_decompress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstD
 	return status;
 }
 
-int bulk_compress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize,
-                  UINT32* pFlags)
+/**
+ * Compression types usable for a packet: MPPC and every type up to the negotiated one that
+ * takes packets of that size. MPPC 8K and 64K share one decompressor on the receiving end,
+ * so only one of them is used.
+ */
+static UINT32 bulk_compression_candidates(rdpBulk* bulk, UINT32 SrcSize, UINT32 types[4])
 {
-	int status = -1;
-	rdpMetrics* metrics;
-	UINT32 CompressedBytes;
-	UINT32 UncompressedBytes;
-	double CompressionRatio;
-	metrics = bulk->context->metrics;
+	UINT32 type;
+	UINT32 count = 0;
+	type = (bulk->CompressionLevel >= PACKET_COMPR_TYPE_64K) ? PACKET_COMPR_TYPE_64K
+	                                                         : PACKET_COMPR_TYPE_8K;
+
+	if (SrcSize <= BULK_MAX_SIZE[type])
+		types[count++] = type;
 
-	if ((SrcSize <= 50) || (SrcSize >= 16384))
+	for (type = PACKET_COMPR_TYPE_RDP6; type <= bulk->CompressionLevel; type++)
 	{
-		*ppDstData = pSrcData;
-		*pDstSize = SrcSize;
-		return 0;
+		if (SrcSize <= BULK_MAX_SIZE[type])
+			types[count++] = type;
 	}
 
-	*ppDstData = bulk->OutputBuffer;
-	*pDstSize = sizeof(bulk->OutputBuffer);
-	bulk_compression_level(bulk);
-	bulk_compression_max_size(bulk);
+	return count;
+}
+
+static BOOL bulk_select_compressor(rdpBulk* bulk, UINT32 SrcSize, UINT32* pType)
+{
+	UINT32 index;
+	UINT32 types[4];
+	UINT32 selected;
+	const BULK_ESTIMATE* best;
+	const UINT32 count = bulk_compression_candidates(bulk, SrcSize, types);
+
+	if (count == 0)
+		return FALSE;
+
+	*pType = types[0];
+
+	if (count == 1)
+		return TRUE;
+
+	if (!bulk->context->settings->CompressionAdaptive)
+	{
+		*pType = types[count - 1];
+		return TRUE;
+	}
 
-	switch (bulk->CompressionLevel)
+	/* every compressor is measured before choosing between them */
+	for (index = 0; index < count; index++)
+	{
+		if (!bulk->Estimates[types[index]].Valid)
+		{
+			*pType = types[index];
+			return TRUE;
+		}
+	}
+
+	/* and later measured again now and then, the data sent changes over time */
+	if ((++bulk->PacketCount % BULK_PROBE_INTERVAL) == 0)
+	{
+		bulk->ProbeIndex = (bulk->ProbeIndex + 1) % count;
+		*pType = types[bulk->ProbeIndex];
+		return TRUE;
+	}
+
+	/* the best ratio within the CPU budget, the cheapest if none meets it */
+	selected = types[0];
+	best = &bulk->Estimates[selected];
+
+	for (index = 1; index < count; index++)
+	{
+		const BULK_ESTIMATE* estimate = &bulk->Estimates[types[index]];
+		const BOOL inBudget = (estimate->Cost <= BULK_CPU_BUDGET);
+		const BOOL bestInBudget = (best->Cost <= BULK_CPU_BUDGET);
+		BOOL better;
+
+		if (inBudget != bestInBudget)
+			better = inBudget;
+		else if (inBudget)
+			better = (estimate->Ratio < best->Ratio);
+		else
+			better = (estimate->Cost < best->Cost);
+
+		if (better)
+		{
+			selected = types[index];
+			best = estimate;
+		}
+	}
+
+	*pType = selected;
+	return TRUE;
+}
+
+static void bulk_update_estimate(rdpBulk* bulk, UINT32 type, UINT32 SrcSize, UINT32 DstSize,
+                                 UINT64 usec)
+{
+	BULK_ESTIMATE* estimate = &bulk->Estimates[type];
+	const double ratio = ((double)DstSize) / ((double)SrcSize);
+	const double cost = ((double)usec) * 1024.0 / ((double)SrcSize);
+
+	if (!estimate->Valid)
+	{
+		estimate->Ratio = ratio;
+		estimate->Cost = cost;
+		estimate->Valid = TRUE;
+		return;
+	}
+
+	estimate->Ratio += (ratio - estimate->Ratio) * BULK_ESTIMATE_WEIGHT;
+	estimate->Cost += (cost - estimate->Cost) * BULK_ESTIMATE_WEIGHT;
+}
+
+static int bulk_compress_type(rdpBulk* bulk, UINT32 type, BYTE* pSrcData, UINT32 SrcSize,
+                              BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags)
+{
+	int status;
+
+	switch (type)
 	{
 		case PACKET_COMPR_TYPE_8K:
 		case PACKET_COMPR_TYPE_64K:
-			mppc_set_compression_level(bulk->mppcSend, bulk->CompressionLevel);
+			mppc_set_compression_level(bulk->mppcSend, type);
 			status = mppc_compress(bulk->mppcSend, pSrcData, SrcSize, ppDstData, pDstSize, pFlags);
 			break;
+
 		case PACKET_COMPR_TYPE_RDP6:
 			status =
 			    ncrush_compress(bulk->ncrushSend, pSrcData, SrcSize, ppDstData, pDstSize, pFlags);
 			break;
+
 		case PACKET_COMPR_TYPE_RDP61:
 			status =
 			    xcrush_compress(bulk->xcrushSend, pSrcData, SrcSize, ppDstData, pDstSize, pFlags);
 			break;
+
 		case PACKET_COMPR_TYPE_RDP8:
-			WLog_ERR(TAG, "Unsupported bulk compression type %08" PRIx32, bulk->CompressionLevel);
-			status = -1;
-			break;
+		{
+			wStream sbuffer = { 0 };
+			wStream* s = &sbuffer;
+			Stream_StaticInit(s, *ppDstData, *pDstSize);
+
+			if (!bulk->zgfxSend)
+				bulk->zgfxSend = zgfx_context_new(TRUE);
+
+			if (!bulk->zgfxSend)
+			{
+				status = -1;
+				break;
+			}
+
+			/* the segment header tells whether the data could be compressed, the receiver
+			 * has to see every packet to keep its history in sync */
+			*pFlags = 0;
+			status = zgfx_compress_to_stream(bulk->zgfxSend, s, pSrcData, SrcSize, pFlags);
+			*pDstSize = (UINT32)Stream_GetPosition(s);
+			*pFlags = PACKET_COMPRESSED | PACKET_COMPR_TYPE_RDP8;
+		}
+		break;
+
 		default:
-			WLog_ERR(TAG, "Unknown bulk compression type %08" PRIx32, bulk->CompressionLevel);
+			WLog_ERR(TAG, "Unknown bulk compression type %08" PRIx32, type);
 			status = -1;
 			break;
 	}
 
+	return status;
+}
+
+int bulk_compress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize,
+                  UINT32* pFlags)
+{
+	int status = -1;
+	UINT32 type;
+	rdpMetrics* metrics;
+	UINT32 CompressedBytes;
+	UINT32 UncompressedBytes;
+	double CompressionRatio;
+	metrics = bulk->context->metrics;
+
+	bulk_compression_max_size(bulk);
+
+	if ((SrcSize <= BULK_MIN_SIZE) || !bulk_select_compressor(bulk, SrcSize, &type))
+	{
+		*ppDstData = pSrcData;
+		*pDstSize = SrcSize;
+		return 0;
+	}
+
+	*ppDstData = bulk->OutputBuffer;
+	*pDstSize = sizeof(bulk->OutputBuffer);
+
+	stopwatch_reset(&bulk->Stopwatch);
+	stopwatch_start(&bulk->Stopwatch);
+	status = bulk_compress_type(bulk, type, pSrcData, SrcSize, ppDstData, pDstSize, pFlags);
+	stopwatch_stop(&bulk->Stopwatch);
+
 	if (status >= 0)
 	{
 		CompressedBytes = *pDstSize;
 		UncompressedBytes = SrcSize;
-		CompressionRatio = metrics_write_bytes(metrics, UncompressedBytes, CompressedBytes);
+		bulk_update_estimate(bulk, type, UncompressedBytes, CompressedBytes,
+		                     bulk->Stopwatch.elapsed);
+		CompressionRatio = metrics_compress_bytes(metrics, type, UncompressedBytes,
+		                                          CompressedBytes, bulk->Stopwatch.elapsed);
 #ifdef WITH_BULK_DEBUG
 		{
 			WLog_DBG(TAG,
 			         "Compress Type: %" PRIu32 " Flags: %s (0x%08" PRIX32
 			         ") Compression Ratio: %f (%" PRIu32 " / %" PRIu32 "), Total: %f (%" PRIu64
 			         " / %" PRIu64 ")",
-			         bulk->CompressionLevel, bulk_get_compression_flags_string(*pFlags), *pFlags,
-			         CompressionRatio, CompressedBytes, UncompressedBytes,
-			         metrics->TotalCompressionRatio, metrics->TotalCompressedBytes,
-			         metrics->TotalUncompressedBytes);
+			         type, bulk_get_compression_flags_string(*pFlags), *pFlags, CompressionRatio,
+			         CompressedBytes, UncompressedBytes, metrics->TotalCompressionRatio,
+			         metrics->TotalCompressedBytes, metrics->TotalUncompressedBytes);
 		}
 #else
 		WINPR_UNUSED(CompressionRatio);
@@ -290,14 +501,32 @@ int bulk_compress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstDat
 	return status;
 }
 
+/* The match search of the NCrush compressor trades speed for ratio */
+static void bulk_set_ncrush_mode(rdpBulk* bulk)
+{
+	const UINT32 mode = bulk->context->settings->CompressionNCrushMode;
+
+	if (!ncrush_context_set_mode(bulk->ncrushSend, (NCRUSH_MODE)mode))
+		WLog_WARN(TAG, "invalid NCrush mode %" PRIu32 ", keeping the current one", mode);
+}
+
 void bulk_reset(rdpBulk* bulk)
 {
 	mppc_context_reset(bulk->mppcSend, FALSE);
 	mppc_context_reset(bulk->mppcRecv, FALSE);
 	ncrush_context_reset(bulk->ncrushRecv, FALSE);
 	ncrush_context_reset(bulk->ncrushSend, FALSE);
+	bulk_set_ncrush_mode(bulk);
 	xcrush_context_reset(bulk->xcrushRecv, FALSE);
 	xcrush_context_reset(bulk->xcrushSend, FALSE);
+
+	if (bulk->zgfxRecv)
+		zgfx_context_reset(bulk->zgfxRecv, FALSE);
+
+	if (bulk->zgfxSend)
+		zgfx_context_reset(bulk->zgfxSend, FALSE);
+
+	ZeroMemory(bulk->Estimates, sizeof(bulk->Estimates));
 }
 
 rdpBulk* bulk_new(rdpContext* context)
@@ -312,6 +541,7 @@ rdpBulk* bulk_new(rdpContext* context)
 		bulk->mppcRecv = mppc_context_new(1, FALSE);
 		bulk->ncrushRecv = ncrush_context_new(FALSE);
 		bulk->ncrushSend = ncrush_context_new(TRUE);
+		bulk_set_ncrush_mode(bulk);
 		bulk->xcrushRecv = xcrush_context_new(FALSE);
 		bulk->xcrushSend = xcrush_context_new(TRUE);
 		bulk->CompressionLevel = context->settings->CompressionLevel;
@@ -331,5 +561,8 @@ void bulk_free(rdpBulk* bulk)
 	ncrush_context_free(bulk->ncrushSend);
 	xcrush_context_free(bulk->xcrushRecv);
 	xcrush_context_free(bulk->xcrushSend);
+	zgfx_context_free(bulk->zgfxRecv);
+	zgfx_context_free(bulk->zgfxSend);
+	free(bulk->zgfxOutput);
 	free(bulk);
 }
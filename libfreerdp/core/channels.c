@@ -77,12 +77,16 @@ BOOL freerdp_channel_send(rdpRdp* rdp, UINT16 channelId, const BYTE* data, size_
 	flags = CHANNEL_FLAG_FIRST;
 	left = size;
 
+	/* all chunks of the channel PDU are written at once */
+	if (!transport_cork(rdp->transport))
+		return FALSE;
+
 	while (left > 0)
 	{
 		s = rdp_send_stream_init(rdp);
 
 		if (!s)
-			return FALSE;
+			goto fail;
 
 		if (left > rdp->settings->VirtualChannelChunkSize)
 		{
@@ -105,21 +109,24 @@ BOOL freerdp_channel_send(rdpRdp* rdp, UINT16 channelId, const BYTE* data, size_
 		if (!Stream_EnsureCapacity(s, chunkSize))
 		{
 			Stream_Release(s);
-			return FALSE;
+			goto fail;
 		}
 
 		Stream_Write(s, data, chunkSize);
 
 		/* WLog_DBG(TAG, "%s: sending data (flags=0x%x size=%d)", __FUNCTION__, flags, size); */
 		if (!rdp_send(rdp, s, channelId))
-			return FALSE;
+			goto fail;
 
 		data += chunkSize;
 		left -= chunkSize;
 		flags = 0;
 	}
 
-	return TRUE;
+	return transport_uncork(rdp->transport);
+fail:
+	transport_uncork(rdp->transport);
+	return FALSE;
 }
 
 BOOL freerdp_channel_process(freerdp* instance, wStream* s, UINT16 channelId, size_t packetLength)
@@ -31,6 +31,11 @@
 
 #define TAG FREERDP_TAG("core.client")
 
+/* Only messages of this size are reassembled in pooled buffers. Small buffers are cheaper to
+ * allocate than to take from the pool, larger ones would grow the pool for good. */
+#define CHANNEL_RECEIVE_POOL_MIN_SIZE (4 * 1024)
+#define CHANNEL_RECEIVE_POOL_MAX_SIZE (128 * 1024)
+
 static WINPR_TLS void* g_pInterface = NULL;
 static WINPR_TLS rdpChannels* g_channels = NULL; /* use only for VirtualChannelInit hack */
 
@@ -124,6 +129,12 @@ static void channel_queue_free(void* obj)
 	channel_queue_message_free(msg);
 }
 
+static void channel_receive_data_free(CHANNEL_OPEN_DATA* pChannelOpenData)
+{
+	freerdp_channels_release_stream(pChannelOpenData->receiveData);
+	pChannelOpenData->receiveData = NULL;
+}
+
 rdpChannels* freerdp_channels_new(freerdp* instance)
 {
 	rdpChannels* channels;
@@ -147,6 +158,11 @@ rdpChannels* freerdp_channels_new(freerdp* instance)
 	if (!channels->openHandles)
 		goto error;
 
+	channels->receivePool = StreamPool_New(TRUE, CHANNEL_RECEIVE_POOL_MIN_SIZE);
+
+	if (!channels->receivePool)
+		goto error;
+
 	return channels;
 error:
 	freerdp_channels_free(channels);
@@ -169,6 +185,7 @@ void freerdp_channels_free(rdpChannels* channels)
 	if (channels->openHandles)
 		HashTable_Free(channels->openHandles);
 
+	StreamPool_Free(channels->receivePool);
 	free(channels);
 }
 
@@ -419,6 +436,94 @@ fail:
 	return error;
 }
 
+/**
+ * Reassembles the chunks of a message in a buffer taken from the receive pool and hands the
+ * complete message to the channel, which then owns it. This is the only copy of the data, the
+ * channel does not need a reassembly buffer of its own.
+ */
+static BOOL freerdp_channels_receive_stream(rdpChannels* channels,
+                                            CHANNEL_OPEN_DATA* pChannelOpenData, const BYTE* data,
+                                            size_t dataSize, UINT32 flags, size_t totalSize)
+{
+	wStream* s;
+
+	if ((flags & CHANNEL_FLAG_SUSPEND) || (flags & CHANNEL_FLAG_RESUME))
+		return TRUE;
+
+	if (flags & CHANNEL_FLAG_FIRST)
+	{
+		channel_receive_data_free(pChannelOpenData);
+
+		if ((totalSize >= CHANNEL_RECEIVE_POOL_MIN_SIZE) &&
+		    (totalSize <= CHANNEL_RECEIVE_POOL_MAX_SIZE))
+			s = StreamPool_Take(channels->receivePool, totalSize);
+		else
+			s = Stream_New(NULL, totalSize);
+
+		if (!s)
+		{
+			WLog_ERR(TAG, "%s: no buffer for %" PRIuz " bytes", pChannelOpenData->name, totalSize);
+			return FALSE;
+		}
+
+		pChannelOpenData->receiveData = s;
+	}
+
+	s = pChannelOpenData->receiveData;
+
+	if (!s)
+	{
+		WLog_ERR(TAG, "%s: chunk without a first chunk", pChannelOpenData->name);
+		return FALSE;
+	}
+
+	if ((totalSize - Stream_GetPosition(s) < dataSize) ||
+	    !Stream_EnsureRemainingCapacity(s, dataSize))
+	{
+		WLog_ERR(TAG, "%s: more than %" PRIuz " bytes received", pChannelOpenData->name,
+		         totalSize);
+		channel_receive_data_free(pChannelOpenData);
+		return FALSE;
+	}
+
+	Stream_Write(s, data, dataSize);
+	pChannelOpenData->statistics.BytesCopied += dataSize;
+
+	if (!(flags & CHANNEL_FLAG_LAST))
+		return TRUE;
+
+	if (Stream_GetPosition(s) != totalSize)
+	{
+		WLog_ERR(TAG, "%s: %" PRIuz " of %" PRIuz " bytes received", pChannelOpenData->name,
+		         Stream_GetPosition(s), totalSize);
+		channel_receive_data_free(pChannelOpenData);
+		return FALSE;
+	}
+
+	pChannelOpenData->receiveData = NULL;
+	Stream_SealLength(s);
+	Stream_SetPosition(s, 0);
+
+	if (pChannelOpenData->pChannelOpenEventProc)
+	{
+		pChannelOpenData->pChannelOpenEventProc(pChannelOpenData->OpenHandle,
+		                                        CHANNEL_EVENT_STREAM_RECEIVED, s, totalSize,
+		                                        totalSize, CHANNEL_FLAG_ONLY);
+	}
+	else if (pChannelOpenData->pChannelOpenEventProcEx)
+	{
+		pChannelOpenData->pChannelOpenEventProcEx(
+		    pChannelOpenData->lpUserParam, pChannelOpenData->OpenHandle,
+		    CHANNEL_EVENT_STREAM_RECEIVED, s, totalSize, totalSize, CHANNEL_FLAG_ONLY);
+	}
+	else
+	{
+		freerdp_channels_release_stream(s);
+	}
+
+	return TRUE;
+}
+
 BOOL freerdp_channels_data(freerdp* instance, UINT16 channelId, const BYTE* cdata, size_t dataSize,
                            UINT32 flags, size_t totalSize)
 {
@@ -469,6 +574,18 @@ BOOL freerdp_channels_data(freerdp* instance, UINT16 channelId, const BYTE* cdat
 		return FALSE;
 	}
 
+	pChannelOpenData->statistics.ChunksReceived++;
+	pChannelOpenData->statistics.BytesReceived += dataSize;
+
+	if (flags & CHANNEL_FLAG_LAST)
+		pChannelOpenData->statistics.MessagesReceived++;
+
+	if (pChannelOpenData->receiveStream)
+	{
+		return freerdp_channels_receive_stream(channels, pChannelOpenData, data.pcb, dataSize,
+		                                       flags, totalSize);
+	}
+
 	if (pChannelOpenData->pChannelOpenEventProc)
 	{
 		pChannelOpenData->pChannelOpenEventProc(pChannelOpenData->OpenHandle,
@@ -485,6 +602,58 @@ BOOL freerdp_channels_data(freerdp* instance, UINT16 channelId, const BYTE* cdat
 	return TRUE;
 }
 
+/**
+ * Lets an open channel receive complete messages as CHANNEL_EVENT_STREAM_RECEIVED instead of
+ * the chunks as CHANNEL_EVENT_DATA_RECEIVED.
+ */
+BOOL freerdp_channels_set_receive_stream(rdpChannels* channels, DWORD openHandle, BOOL enable)
+{
+	CHANNEL_OPEN_DATA* pChannelOpenData;
+
+	if (!channels)
+		return FALSE;
+
+	pChannelOpenData = HashTable_GetItemValue(channels->openHandles, (void*)(UINT_PTR)openHandle);
+
+	if (!pChannelOpenData)
+		return FALSE;
+
+	if (!enable)
+		channel_receive_data_free(pChannelOpenData);
+
+	pChannelOpenData->receiveStream = enable;
+	return TRUE;
+}
+
+/**
+ * Returns a stream received with CHANNEL_EVENT_STREAM_RECEIVED. It comes from the channel
+ * manager's pool, or was allocated by the channel itself when it took it from data_in.
+ */
+void freerdp_channels_release_stream(wStream* s)
+{
+	if (s && s->pool)
+		Stream_Release(s);
+	else
+		Stream_Free(s, TRUE);
+}
+
+BOOL freerdp_channels_get_statistics(rdpChannels* channels, const char* name,
+                                     rdpChannelStatistics* statistics)
+{
+	CHANNEL_OPEN_DATA* pChannelOpenData;
+
+	if (!channels || !name || !statistics)
+		return FALSE;
+
+	pChannelOpenData = freerdp_channels_find_channel_open_data_by_name(channels, name);
+
+	if (!pChannelOpenData)
+		return FALSE;
+
+	*statistics = pChannelOpenData->statistics;
+	return TRUE;
+}
+
 UINT16 freerdp_channels_get_id_by_name(freerdp* instance, const char* channel_name)
 {
 	rdpMcsChannel* mcsChannel;
@@ -566,7 +735,11 @@ static BOOL freerdp_channels_process_message(freerdp* instance, wMessage* messag
 		    freerdp_channels_find_channel_by_name(instance->context->rdp, pChannelOpenData->name);
 
 		if (channel)
+		{
 			instance->SendChannelData(instance, channel->ChannelId, item->Data, item->DataLength);
+			pChannelOpenData->statistics.MessagesSent++;
+			pChannelOpenData->statistics.BytesSent += item->DataLength;
+		}
 	}
 
 	if (!freerdp_channels_process_message_free(message, CHANNEL_EVENT_WRITE_COMPLETE))
@@ -732,6 +905,7 @@ void freerdp_channels_close(rdpChannels* channels, freerdp* instance)
 	for (index = 0; index < channels->openDataCount; index++)
 	{
 		pChannelOpenData = &channels->openDataList[index];
+		channel_receive_data_free(pChannelOpenData);
 		freerdp_channel_remove_open_handle_data(&g_ChannelHandles, pChannelOpenData->OpenHandle);
 
 		if (channels->openHandles)
@@ -809,6 +983,8 @@ static UINT VCAPITYPE FreeRDP_VirtualChannelInitEx(
 		HashTable_Add(channels->openHandles, (void*)(UINT_PTR)pChannelOpenData->OpenHandle,
 		              (void*)pChannelOpenData);
 		pChannelOpenData->flags = 1; /* init */
+		pChannelOpenData->receiveStream = FALSE;
+		ZeroMemory(&pChannelOpenData->statistics, sizeof(rdpChannelStatistics));
 		strncpy(pChannelOpenData->name, pChannelDef->name, CHANNEL_NAME_LEN);
 		pChannelOpenData->options = pChannelDef->options;
 
@@ -896,6 +1072,8 @@ static UINT VCAPITYPE FreeRDP_VirtualChannelInit(LPVOID* ppInitHandle, PCHANNEL_
 		HashTable_Add(channels->openHandles, (void*)(UINT_PTR)pChannelOpenData->OpenHandle,
 		              (void*)pChannelOpenData);
 		pChannelOpenData->flags = 1; /* init */
+		pChannelOpenData->receiveStream = FALSE;
+		ZeroMemory(&pChannelOpenData->statistics, sizeof(rdpChannelStatistics));
 		strncpy(pChannelOpenData->name, pChannelDef->name, CHANNEL_NAME_LEN);
 		pChannelOpenData->options = pChannelDef->options;
 
@@ -1009,6 +1187,8 @@ static UINT VCAPITYPE FreeRDP_VirtualChannelCloseEx(LPVOID pInitHandle, DWORD op
 		return CHANNEL_RC_NOT_OPEN;
 
 	pChannelOpenData->flags = 0;
+	pChannelOpenData->receiveStream = FALSE;
+	channel_receive_data_free(pChannelOpenData);
 	return CHANNEL_RC_OK;
 }
 
@@ -1030,6 +1210,8 @@ static UINT VCAPITYPE FreeRDP_VirtualChannelClose(DWORD openHandle)
 		return CHANNEL_RC_NOT_OPEN;
 
 	pChannelOpenData->flags = 0;
+	pChannelOpenData->receiveStream = FALSE;
+	channel_receive_data_free(pChannelOpenData);
 	return CHANNEL_RC_OK;
 }
 
@@ -61,6 +61,9 @@ struct rdp_channel_open_data
 	void* lpUserParam;
 	PCHANNEL_OPEN_EVENT_FN pChannelOpenEventProc;
 	PCHANNEL_OPEN_EVENT_EX_FN pChannelOpenEventProcEx;
+	BOOL receiveStream;
+	wStream* receiveData;
+	rdpChannelStatistics statistics;
 };
 typedef struct rdp_channel_open_data CHANNEL_OPEN_DATA;
 
@@ -114,6 +117,7 @@ struct rdp_channels
 	CRITICAL_SECTION channelsLock;
 
 	wHashTable* openHandles;
+	wStreamPool* receivePool;
 };
 
 FREERDP_LOCAL rdpChannels* freerdp_channels_new(freerdp* instance);
@@ -1125,6 +1125,10 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 		return FALSE;
 	}
 
+	/* the bulk history is shared with slow-path data PDUs, packets have to be sent in the
+	 * order they were compressed */
+	EnterCriticalSection(&rdp->transport->WriteLock);
+
 	if (rdp->do_crypt)
 	{
 		rdp->sec_flags |= SEC_ENCRYPT;
@@ -1133,6 +1137,13 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 			rdp->sec_flags |= SEC_SECURE_CHECKSUM;
 	}
 
+	/* all fragments of the update are written at once */
+	if (!transport_cork(rdp->transport))
+	{
+		LeaveCriticalSection(&rdp->transport->WriteLock);
+		return FALSE;
+	}
+
 	for (fragment = 0; (totalLength > 0) || (fragment == 0); fragment++)
 	{
 		BYTE* pSrcData;
@@ -1225,7 +1236,10 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 			if (rdp->settings->EncryptionMethods == ENCRYPTION_METHOD_FIPS)
 			{
 				if (!security_hmac_signature(data, dataSize - pad, pSignature, rdp))
-					return FALSE;
+				{
+					status = FALSE;
+					break;
+				}
 
 				security_fips_encrypt(data, dataSize, rdp);
 			}
@@ -1237,7 +1251,10 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 					status = security_mac_signature(rdp, data, dataSize, pSignature);
 
 				if (!status || !security_encrypt(data, dataSize, rdp))
-					return FALSE;
+				{
+					status = FALSE;
+					break;
+				}
 			}
 		}
 
@@ -1252,7 +1269,11 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 		Stream_Seek(s, SrcSize);
 	}
 
+	if (!transport_uncork(rdp->transport))
+		status = FALSE;
+
 	rdp->sec_flags = 0;
+	LeaveCriticalSection(&rdp->transport->WriteLock);
 	return status;
 }
 
@@ -374,6 +374,14 @@ DWORD freerdp_get_event_handles(rdpContext* context, HANDLE* events, DWORD count
 		    freerdp_get_message_queue_event_handle(context->instance, FREERDP_INPUT_MESSAGE_QUEUE);
 	}
 
+	if (input_get_event_handles(context->input, NULL, 0) > 0)
+	{
+		if (nCount >= count)
+			return 0;
+
+		nCount += input_get_event_handles(context->input, &events[nCount], count - nCount);
+	}
+
 	return nCount;
 }
 
@@ -421,6 +429,10 @@ BOOL freerdp_check_event_handles(rdpContext* context)
 			status = TRUE;
 	}
 
+	/* batched input waits at most until the next check, failing to send it is not fatal */
+	if (!input_flush(context->input))
+		WLog_WARN(TAG, "input_flush() failed");
+
 	return status;
 }
 
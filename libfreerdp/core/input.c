@@ -41,6 +41,25 @@
 
 #define RDP_CLIENT_INPUT_PDU_HEADER_LENGTH 4
 
+/* A fast-path input PDU without the numEvents field carries at most 15 events */
+#define FASTPATH_INPUT_MAX_EVENTS 15
+#define FASTPATH_INPUT_MAX_EVENT_LENGTH 7
+
+struct rdp_input_batch
+{
+	CRITICAL_SECTION lock;
+	HANDLE timer;
+	UINT32 window;     /* microseconds, 0 when batching is disabled */
+	UINT64 quietUntil; /* events before this time are held back */
+	BYTE events[FASTPATH_INPUT_MAX_EVENTS * FASTPATH_INPUT_MAX_EVENT_LENGTH];
+	size_t length;
+	size_t count;
+	size_t lastMove; /* offset of the last pending event if it is a mouse move */
+	UINT64 sentEvents;
+	UINT64 mergedEvents;
+	UINT64 sentPdus;
+};
+
 static void rdp_write_client_input_pdu_header(wStream* s, UINT16 number)
 {
 	Stream_Write_UINT16(s, 1); /* numberEvents (2 bytes) */
@@ -263,51 +282,147 @@ static BOOL input_send_keyboard_pause_event(rdpInput* input)
 	                                 RDP_SCANCODE_CODE(RDP_SCANCODE_NUMLOCK));
 }
 
-static BOOL input_send_fastpath_synchronize_event(rdpInput* input, UINT32 flags)
+static UINT64 input_batch_time(void)
 {
-	wStream* s;
-	rdpRdp* rdp;
+#ifdef _WIN32
+	LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (count.QuadPart / freq.QuadPart) * 1000000ULL +
+	       (count.QuadPart % freq.QuadPart) * 1000000ULL / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000ULL;
+#endif
+}
 
-	if (!input || !input->context)
+static BOOL input_send_fastpath_pdu(rdpRdp* rdp, const BYTE* events, size_t length, size_t count)
+{
+	wStream* s = fastpath_input_pdu_init_header(rdp->fastpath);
+
+	if (!s)
 		return FALSE;
 
-	rdp = input->context->rdp;
-	/* The FastPath Synchronization eventFlags has identical values as SlowPath */
-	s = fastpath_input_pdu_init(rdp->fastpath, (BYTE)flags, FASTPATH_INPUT_EVENT_SYNC);
+	Stream_Write(s, events, length);
+	return fastpath_send_multiple_input_pdu(rdp->fastpath, s, count);
+}
 
-	if (!s)
+/* Must be called with the batch lock held */
+static BOOL input_batch_flush(rdpInput* input, UINT64 now)
+{
+	BOOL rc;
+	rdpInputBatch* batch = input->batch;
+
+	if (batch->count == 0)
+		return TRUE;
+
+	rc = input_send_fastpath_pdu(input->context->rdp, batch->events, batch->length,
+	                             batch->count);
+	batch->sentEvents += batch->count;
+	batch->sentPdus++;
+	batch->length = 0;
+	batch->count = 0;
+	batch->lastMove = SIZE_MAX;
+	batch->quietUntil = now + batch->window;
+	return rc;
+}
+
+/**
+ * Sends fast-path input events, or queues them when input batching is enabled.
+ *
+ * An event that follows a quiet period of at least the batch window is sent right away.
+ * Events within the window after it are queued and sent together, in one fast-path PDU,
+ * when the window is over (the batch timer wakes up the event loop), at the next
+ * freerdp_check_event_handles or when 15 events are pending. A mouse move following a
+ * queued mouse move replaces it.
+ */
+static BOOL input_send_fastpath_events(rdpInput* input, const BYTE* events, size_t length,
+                                       size_t count, BOOL move)
+{
+	BOOL rc = TRUE;
+	UINT64 now;
+	rdpInputBatch* batch = input->batch;
+
+	if (!batch || (batch->window == 0))
+		return input_send_fastpath_pdu(input->context->rdp, events, length, count);
+
+	EnterCriticalSection(&batch->lock);
+	now = input_batch_time();
+
+	if ((batch->count == 0) && (now >= batch->quietUntil))
+	{
+		rc = input_send_fastpath_pdu(input->context->rdp, events, length, count);
+		batch->sentEvents += count;
+		batch->sentPdus++;
+		batch->quietUntil = now + batch->window;
+		LeaveCriticalSection(&batch->lock);
+		return rc;
+	}
+
+	if (move && (batch->lastMove != SIZE_MAX))
+	{
+		CopyMemory(&batch->events[batch->lastMove], events, length);
+		batch->mergedEvents++;
+	}
+	else
+	{
+		if (batch->count + count > FASTPATH_INPUT_MAX_EVENTS)
+			rc = input_batch_flush(input, now);
+
+		if ((batch->count == 0) && (now < batch->quietUntil))
+		{
+			LARGE_INTEGER due;
+			due.QuadPart = -10LL * (LONGLONG)(batch->quietUntil - now);
+			SetWaitableTimer(batch->timer, &due, 0, NULL, NULL, FALSE);
+		}
+
+		batch->lastMove = move ? batch->length : SIZE_MAX;
+		CopyMemory(&batch->events[batch->length], events, length);
+		batch->length += length;
+		batch->count += count;
+	}
+
+	if ((batch->count == FASTPATH_INPUT_MAX_EVENTS) || (now >= batch->quietUntil))
+		rc = input_batch_flush(input, now) && rc;
+
+	LeaveCriticalSection(&batch->lock);
+	return rc;
+}
+
+static BOOL input_send_fastpath_synchronize_event(rdpInput* input, UINT32 flags)
+{
+	BYTE event[1];
+
+	if (!input || !input->context)
 		return FALSE;
 
-	return fastpath_send_input_pdu(rdp->fastpath, s);
+	/* The FastPath Synchronization eventFlags has identical values as SlowPath */
+	event[0] = (BYTE)flags | (FASTPATH_INPUT_EVENT_SYNC << 5); /* eventHeader (1 byte) */
+	return input_send_fastpath_events(input, event, sizeof(event), 1, FALSE);
 }
 
 static BOOL input_send_fastpath_keyboard_event(rdpInput* input, UINT16 flags, UINT16 code)
 {
-	wStream* s;
+	BYTE event[2];
 	BYTE eventFlags = 0;
-	rdpRdp* rdp;
 
 	if (!input || !input->context)
 		return FALSE;
 
-	rdp = input->context->rdp;
 	eventFlags |= (flags & KBD_FLAGS_RELEASE) ? FASTPATH_INPUT_KBDFLAGS_RELEASE : 0;
 	eventFlags |= (flags & KBD_FLAGS_EXTENDED) ? FASTPATH_INPUT_KBDFLAGS_EXTENDED : 0;
 	eventFlags |= (flags & KBD_FLAGS_EXTENDED1) ? FASTPATH_INPUT_KBDFLAGS_PREFIX_E1 : 0;
-	s = fastpath_input_pdu_init(rdp->fastpath, eventFlags, FASTPATH_INPUT_EVENT_SCANCODE);
-
-	if (!s)
-		return FALSE;
-
-	Stream_Write_UINT8(s, code); /* keyCode (1 byte) */
-	return fastpath_send_input_pdu(rdp->fastpath, s);
+	event[0] = eventFlags | (FASTPATH_INPUT_EVENT_SCANCODE << 5); /* eventHeader (1 byte) */
+	event[1] = (BYTE)code;                                        /* keyCode (1 byte) */
+	return input_send_fastpath_events(input, event, sizeof(event), 1, FALSE);
 }
 
 static BOOL input_send_fastpath_unicode_keyboard_event(rdpInput* input, UINT16 flags, UINT16 code)
 {
-	wStream* s;
+	BYTE event[3];
 	BYTE eventFlags = 0;
-	rdpRdp* rdp;
 
 	if (!input || !input->context)
 		return FALSE;
@@ -318,27 +433,21 @@ static BOOL input_send_fastpath_unicode_keyboard_event(rdpInput* input, UINT16 f
 		return FALSE;
 	}
 
-	rdp = input->context->rdp;
 	eventFlags |= (flags & KBD_FLAGS_RELEASE) ? FASTPATH_INPUT_KBDFLAGS_RELEASE : 0;
-	s = fastpath_input_pdu_init(rdp->fastpath, eventFlags, FASTPATH_INPUT_EVENT_UNICODE);
-
-	if (!s)
-		return FALSE;
-
-	Stream_Write_UINT16(s, code); /* unicodeCode (2 bytes) */
-	return fastpath_send_input_pdu(rdp->fastpath, s);
+	event[0] = eventFlags | (FASTPATH_INPUT_EVENT_UNICODE << 5); /* eventHeader (1 byte) */
+	Data_Write_UINT16(&event[1], code);                          /* unicodeCode (2 bytes) */
+	return input_send_fastpath_events(input, event, sizeof(event), 1, FALSE);
 }
 
 static BOOL input_send_fastpath_mouse_event(rdpInput* input, UINT16 flags, UINT16 x, UINT16 y)
 {
-	wStream* s;
-	rdpRdp* rdp;
+	wStream sbuffer;
+	wStream* s = &sbuffer;
+	BYTE event[FASTPATH_INPUT_MAX_EVENT_LENGTH];
 
 	if (!input || !input->context || !input->context->settings)
 		return FALSE;
 
-	rdp = input->context->rdp;
-
 	if (!input->context->settings->HasHorizontalWheel)
 	{
 		if (flags & PTR_FLAGS_HWHEEL)
@@ -351,20 +460,18 @@ static BOOL input_send_fastpath_mouse_event(rdpInput* input, UINT16 flags, UINT1
 		}
 	}
 
-	s = fastpath_input_pdu_init(rdp->fastpath, 0, FASTPATH_INPUT_EVENT_MOUSE);
-
-	if (!s)
-		return FALSE;
-
+	Stream_StaticInit(s, event, sizeof(event));
+	Stream_Write_UINT8(s, FASTPATH_INPUT_EVENT_MOUSE << 5); /* eventHeader (1 byte) */
 	input_write_mouse_event(s, flags, x, y);
-	return fastpath_send_input_pdu(rdp->fastpath, s);
+	return input_send_fastpath_events(input, event, sizeof(event), 1, flags == PTR_FLAGS_MOVE);
 }
 
 static BOOL input_send_fastpath_extended_mouse_event(rdpInput* input, UINT16 flags, UINT16 x,
                                                      UINT16 y)
 {
-	wStream* s;
-	rdpRdp* rdp;
+	wStream sbuffer;
+	wStream* s = &sbuffer;
+	BYTE event[FASTPATH_INPUT_MAX_EVENT_LENGTH];
 
 	if (!input || !input->context)
 		return FALSE;
@@ -378,30 +485,23 @@ static BOOL input_send_fastpath_extended_mouse_event(rdpInput* input, UINT16 fla
 		return TRUE;
 	}
 
-	rdp = input->context->rdp;
-	s = fastpath_input_pdu_init(rdp->fastpath, 0, FASTPATH_INPUT_EVENT_MOUSEX);
-
-	if (!s)
-		return FALSE;
-
+	Stream_StaticInit(s, event, sizeof(event));
+	Stream_Write_UINT8(s, FASTPATH_INPUT_EVENT_MOUSEX << 5); /* eventHeader (1 byte) */
 	input_write_extended_mouse_event(s, flags, x, y);
-	return fastpath_send_input_pdu(rdp->fastpath, s);
+	return input_send_fastpath_events(input, event, sizeof(event), 1, FALSE);
 }
 
 static BOOL input_send_fastpath_focus_in_event(rdpInput* input, UINT16 toggleStates)
 {
-	wStream* s;
+	wStream sbuffer;
+	wStream* s = &sbuffer;
+	BYTE events[5];
 	BYTE eventFlags = 0;
-	rdpRdp* rdp;
 
 	if (!input || !input->context)
 		return FALSE;
 
-	rdp = input->context->rdp;
-	s = fastpath_input_pdu_init_header(rdp->fastpath);
-
-	if (!s)
-		return FALSE;
+	Stream_StaticInit(s, events, sizeof(events));
 
 	/* send a tab up like mstsc.exe */
 	eventFlags = FASTPATH_INPUT_KBDFLAGS_RELEASE | FASTPATH_INPUT_EVENT_SCANCODE << 5;
@@ -414,7 +514,7 @@ static BOOL input_send_fastpath_focus_in_event(rdpInput* input, UINT16 toggleSta
 	eventFlags = FASTPATH_INPUT_KBDFLAGS_RELEASE | FASTPATH_INPUT_EVENT_SCANCODE << 5;
 	Stream_Write_UINT8(s, eventFlags); /* Key Release event (1 byte) */
 	Stream_Write_UINT8(s, 0x0f);       /* keyCode (1 byte) */
-	return fastpath_send_multiple_input_pdu(rdp->fastpath, s, 3);
+	return input_send_fastpath_events(input, events, sizeof(events), 3, FALSE);
 }
 
 static BOOL input_send_fastpath_keyboard_pause_event(rdpInput* input)
@@ -423,19 +523,16 @@ static BOOL input_send_fastpath_keyboard_pause_event(rdpInput* input)
 	 * and pause-up sent nothing.  However, reverse engineering mstsc shows
 	 * it sending the following sequence:
 	 */
-	wStream* s;
+	wStream sbuffer;
+	wStream* s = &sbuffer;
+	BYTE events[8];
 	const BYTE keyDownEvent = FASTPATH_INPUT_EVENT_SCANCODE << 5;
 	const BYTE keyUpEvent = (FASTPATH_INPUT_EVENT_SCANCODE << 5) | FASTPATH_INPUT_KBDFLAGS_RELEASE;
-	rdpRdp* rdp;
 
 	if (!input || !input->context)
 		return FALSE;
 
-	rdp = input->context->rdp;
-	s = fastpath_input_pdu_init_header(rdp->fastpath);
-
-	if (!s)
-		return FALSE;
+	Stream_StaticInit(s, events, sizeof(events));
 
 	/* Control down (0x1D) */
 	Stream_Write_UINT8(s, keyDownEvent | FASTPATH_INPUT_KBDFLAGS_PREFIX_E1);
@@ -449,7 +546,7 @@ static BOOL input_send_fastpath_keyboard_pause_event(rdpInput* input)
 	/* Numlock down (0x45) */
 	Stream_Write_UINT8(s, keyUpEvent);
 	Stream_Write_UINT8(s, RDP_SCANCODE_CODE(RDP_SCANCODE_NUMLOCK));
-	return fastpath_send_multiple_input_pdu(rdp->fastpath, s, 4);
+	return input_send_fastpath_events(input, events, sizeof(events), 4, FALSE);
 }
 
 static BOOL input_recv_sync_event(rdpInput* input, wStream* s)
@@ -622,6 +719,84 @@ BOOL input_recv(rdpInput* input, wStream* s)
 	return TRUE;
 }
 
+static rdpInputBatch* input_batch_new(void)
+{
+	LARGE_INTEGER due;
+	rdpInputBatch* batch = (rdpInputBatch*)calloc(1, sizeof(rdpInputBatch));
+
+	if (!batch)
+		return NULL;
+
+	if (!InitializeCriticalSectionAndSpinCount(&batch->lock, 4000))
+	{
+		free(batch);
+		return NULL;
+	}
+
+	batch->timer = CreateWaitableTimerA(NULL, FALSE, NULL);
+
+	/* arm it once, the timer has no descriptor to wait on before */
+	due.QuadPart = -1;
+
+	if (!batch->timer || !SetWaitableTimer(batch->timer, &due, 0, NULL, NULL, FALSE))
+	{
+		if (batch->timer)
+			CloseHandle(batch->timer);
+
+		DeleteCriticalSection(&batch->lock);
+		free(batch);
+		return NULL;
+	}
+
+	batch->lastMove = SIZE_MAX;
+	return batch;
+}
+
+static void input_batch_free(rdpInputBatch* batch)
+{
+	if (!batch)
+		return;
+
+	WLog_DBG(TAG,
+	         "input batching: %" PRIu64 " events in %" PRIu64 " PDUs, %" PRIu64
+	         " mouse moves merged",
+	         batch->sentEvents, batch->sentPdus, batch->mergedEvents);
+	CloseHandle(batch->timer);
+	DeleteCriticalSection(&batch->lock);
+	free(batch);
+}
+
+/* Without events returns the number of handles needed */
+DWORD input_get_event_handles(rdpInput* input, HANDLE* events, DWORD count)
+{
+	if (!input || !input->batch || (input->batch->window == 0))
+		return 0;
+
+	if (!events)
+		return 1;
+
+	if (count < 1)
+		return 0;
+
+	events[0] = input->batch->timer;
+	return 1;
+}
+
+BOOL input_flush(rdpInput* input)
+{
+	BOOL rc;
+	rdpInputBatch* batch;
+
+	if (!input || !input->batch)
+		return TRUE;
+
+	batch = input->batch;
+	EnterCriticalSection(&batch->lock);
+	rc = input_batch_flush(input, input_batch_time());
+	LeaveCriticalSection(&batch->lock);
+	return rc;
+}
+
 BOOL input_register_client_callbacks(rdpInput* input)
 {
 	rdpSettings* settings;
@@ -655,6 +830,26 @@ BOOL input_register_client_callbacks(rdpInput* input)
 		input->FocusInEvent = input_send_focus_in_event;
 	}
 
+	if (settings->FastPathInput && (settings->FastPathInputBatchWindow > 0) && !input->batch)
+	{
+		input->batch = input_batch_new();
+
+		if (!input->batch)
+			return FALSE;
+	}
+
+	if (input->batch)
+	{
+		/* events queued before a reactivation are dropped */
+		EnterCriticalSection(&input->batch->lock);
+		input->batch->window = settings->FastPathInput ? settings->FastPathInputBatchWindow : 0;
+		input->batch->quietUntil = 0;
+		input->batch->length = 0;
+		input->batch->count = 0;
+		input->batch->lastMove = SIZE_MAX;
+		LeaveCriticalSection(&input->batch->lock);
+	}
+
 	input->asynchronous = settings->AsyncInput;
 
 	if (input->asynchronous)
@@ -733,6 +928,30 @@ BOOL freerdp_input_send_keyboard_pause_event(rdpInput* input)
 	return IFCALLRESULT(TRUE, input->KeyboardPauseEvent, input);
 }
 
+BOOL freerdp_input_get_batch_statistics(rdpInput* input, UINT64* events, UINT64* merged,
+                                        UINT64* pdus)
+{
+	rdpInputBatch* batch;
+
+	if (!input || !events || !merged || !pdus)
+		return FALSE;
+
+	batch = input->batch;
+
+	if (!batch)
+	{
+		*events = *merged = *pdus = 0;
+		return TRUE;
+	}
+
+	EnterCriticalSection(&batch->lock);
+	*events = batch->sentEvents;
+	*merged = batch->mergedEvents;
+	*pdus = batch->sentPdus;
+	LeaveCriticalSection(&batch->lock);
+	return TRUE;
+}
+
 int input_process_events(rdpInput* input)
 {
 	if (!input)
@@ -774,6 +993,7 @@ void input_free(rdpInput* input)
 		if (input->asynchronous)
 			input_message_proxy_free(input->proxy);
 
+		input_batch_free(input->batch);
 		MessageQueue_Free(input->queue);
 		free(input);
 	}
@@ -35,6 +35,9 @@ FREERDP_LOCAL BOOL input_recv(rdpInput* input, wStream* s);
 FREERDP_LOCAL int input_process_events(rdpInput* input);
 FREERDP_LOCAL BOOL input_register_client_callbacks(rdpInput* input);
 
+FREERDP_LOCAL DWORD input_get_event_handles(rdpInput* input, HANDLE* events, DWORD count);
+FREERDP_LOCAL BOOL input_flush(rdpInput* input);
+
 FREERDP_LOCAL rdpInput* input_new(rdpRdp* rdp);
 FREERDP_LOCAL void input_free(rdpInput* input);
 
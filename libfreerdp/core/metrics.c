@@ -39,6 +39,51 @@ double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes, UINT32
 	return CompressionRatio;
 }
 
+/**
+ * Account a packet compressed with the given bulk compression type and the time spent on it.
+ * Returns the compression ratio of the packet.
+ */
+double metrics_compress_bytes(rdpMetrics* metrics, UINT32 type, UINT32 UncompressedBytes,
+                              UINT32 CompressedBytes, UINT64 usec)
+{
+	if (type < METRICS_COMPRESSION_TYPES)
+	{
+		metrics->CompressPackets[type]++;
+		metrics->CompressUncompressedBytes[type] += UncompressedBytes;
+		metrics->CompressCompressedBytes[type] += CompressedBytes;
+		metrics->CompressTime[type] += usec;
+	}
+
+	return metrics_write_bytes(metrics, UncompressedBytes, CompressedBytes);
+}
+
+/**
+ * Compressed / uncompressed size of everything sent with the given compression type,
+ * 0.0 if the type was not used.
+ */
+double metrics_get_compression_ratio(rdpMetrics* metrics, UINT32 type)
+{
+	if (!metrics || (type >= METRICS_COMPRESSION_TYPES) ||
+	    (metrics->CompressUncompressedBytes[type] == 0))
+		return 0.0;
+
+	return ((double)metrics->CompressCompressedBytes[type]) /
+	       ((double)metrics->CompressUncompressedBytes[type]);
+}
+
+/**
+ * Uncompressed bytes per second the given compression type processed,
+ * 0.0 if the type was not used or too fast to measure.
+ */
+double metrics_get_compression_throughput(rdpMetrics* metrics, UINT32 type)
+{
+	if (!metrics || (type >= METRICS_COMPRESSION_TYPES) || (metrics->CompressTime[type] == 0))
+		return 0.0;
+
+	return ((double)metrics->CompressUncompressedBytes[type]) * 1000000.0 /
+	       ((double)metrics->CompressTime[type]);
+}
+
 rdpMetrics* metrics_new(rdpContext* context)
 {
 	rdpMetrics* metrics;
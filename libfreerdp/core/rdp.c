@@ -112,7 +112,8 @@ const char* data_pdu_type_to_string(UINT8 type)
 static BOOL rdp_read_flow_control_pdu(wStream* s, UINT16* type, UINT16* channel_id);
 static BOOL rdp_write_share_control_header(wStream* s, UINT16 length, UINT16 type,
                                            UINT16 channel_id);
-static BOOL rdp_write_share_data_header(wStream* s, UINT16 length, BYTE type, UINT32 share_id);
+static BOOL rdp_write_share_data_header(wStream* s, UINT16 length, BYTE type, UINT32 share_id,
+                                        BYTE compressedType, UINT16 compressedLength);
 
 /**
  * Read RDP Security Header.\n
@@ -230,7 +231,8 @@ BOOL rdp_read_share_data_header(wStream* s, UINT16* length, BYTE* type, UINT32*
 	return TRUE;
 }
 
-BOOL rdp_write_share_data_header(wStream* s, UINT16 length, BYTE type, UINT32 share_id)
+BOOL rdp_write_share_data_header(wStream* s, UINT16 length, BYTE type, UINT32 share_id,
+                                 BYTE compressedType, UINT16 compressedLength)
 {
 	const size_t headerLen = RDP_PACKET_HEADER_MAX_LENGTH + RDP_SHARE_CONTROL_HEADER_LENGTH +
 	                         RDP_SHARE_DATA_HEADER_LENGTH;
@@ -246,8 +248,8 @@ BOOL rdp_write_share_data_header(wStream* s, UINT16 length, BYTE type, UINT32 sh
 	Stream_Write_UINT8(s, STREAM_LOW); /* streamId (1 byte) */
 	Stream_Write_UINT16(s, length);    /* uncompressedLength (2 bytes) */
 	Stream_Write_UINT8(s, type);       /* pduType2, Data PDU Type (1 byte) */
-	Stream_Write_UINT8(s, 0);          /* compressedType (1 byte) */
-	Stream_Write_UINT16(s, 0);         /* compressedLength (2 bytes) */
+	Stream_Write_UINT8(s, compressedType);    /* compressedType (1 byte) */
+	Stream_Write_UINT16(s, compressedLength); /* compressedLength (2 bytes) */
 	return TRUE;
 }
 
@@ -697,10 +699,62 @@ BOOL rdp_send_pdu(rdpRdp* rdp, wStream* s, UINT16 type, UINT16 channel_id)
 	return TRUE;
 }
 
+/**
+ * Bulk compress the data of a slow-path data PDU in place, the data follows the share data header.
+ * Packets the compressor leaves alone keep compressedType 0.
+ */
+static BOOL rdp_compress_data_pdu(rdpRdp* rdp, wStream* s, UINT32 sec_bytes, size_t* pLength,
+                                  BYTE* pCompressedType, UINT16* pCompressedLength)
+{
+	BYTE* pSrcData;
+	BYTE* pDstData;
+	UINT32 SrcSize;
+	UINT32 DstSize;
+	UINT32 compressionFlags = 0;
+	const size_t offset = RDP_PACKET_HEADER_MAX_LENGTH + sec_bytes +
+	                      RDP_SHARE_CONTROL_HEADER_LENGTH + RDP_SHARE_DATA_HEADER_LENGTH;
+
+	*pCompressedType = 0;
+	*pCompressedLength = 0;
+
+	if (!rdp->settings->ServerMode || !rdp->settings->CompressionEnabled || (*pLength <= offset))
+		return TRUE;
+
+	/* RDP8 and XCrush may add 2 bytes to incompressible data */
+	if (*pLength > UINT16_MAX - 2)
+		return TRUE;
+
+	pSrcData = pDstData = Stream_Buffer(s) + offset;
+	SrcSize = DstSize = (UINT32)(*pLength - offset);
+
+	if ((bulk_compress(rdp->bulk, pSrcData, SrcSize, &pDstData, &DstSize, &compressionFlags) < 0) ||
+	    !compressionFlags)
+		return TRUE;
+
+	if (!Stream_EnsureCapacity(s, offset + DstSize))
+		return FALSE;
+
+	/* the compressor output is not in the stream, unless it returned the data as is */
+	if (pDstData != pSrcData)
+	{
+		Stream_SetPosition(s, offset);
+		Stream_Write(s, pDstData, DstSize);
+	}
+
+	*pLength = offset + DstSize;
+	*pCompressedType = (BYTE)compressionFlags;
+	*pCompressedLength =
+	    (UINT16)(DstSize + RDP_SHARE_CONTROL_HEADER_LENGTH + RDP_SHARE_DATA_HEADER_LENGTH);
+	return TRUE;
+}
+
 BOOL rdp_send_data_pdu(rdpRdp* rdp, wStream* s, BYTE type, UINT16 channel_id)
 {
 	BOOL rc = FALSE;
 	size_t length;
+	size_t uncompressedLength;
+	BYTE compressedType;
+	UINT16 compressedLength;
 	UINT32 sec_bytes;
 	size_t sec_hold;
 	UINT32 pad;
@@ -711,20 +765,29 @@ BOOL rdp_send_data_pdu(rdpRdp* rdp, wStream* s, BYTE type, UINT16 channel_id)
 	if (!rdp)
 		goto fail;
 
-	length = Stream_GetPosition(s);
+	length = uncompressedLength = Stream_GetPosition(s);
+	sec_bytes = rdp_get_sec_bytes(rdp, 0);
+
+	/* the bulk history is shared with fast-path, packets have to be sent in the order they
+	 * were compressed */
+	EnterCriticalSection(&rdp->transport->WriteLock);
+
+	if (!rdp_compress_data_pdu(rdp, s, sec_bytes, &length, &compressedType, &compressedLength))
+		goto out;
+
 	Stream_SetPosition(s, 0);
 	rdp_write_header(rdp, s, length, MCS_GLOBAL_CHANNEL_ID);
-	sec_bytes = rdp_get_sec_bytes(rdp, 0);
 	sec_hold = Stream_GetPosition(s);
 	Stream_Seek(s, sec_bytes);
 	if (!rdp_write_share_control_header(s, length - sec_bytes, PDU_TYPE_DATA, channel_id))
-		goto fail;
-	if (!rdp_write_share_data_header(s, length - sec_bytes, type, rdp->settings->ShareId))
-		goto fail;
+		goto out;
+	if (!rdp_write_share_data_header(s, uncompressedLength - sec_bytes, type,
+	                                 rdp->settings->ShareId, compressedType, compressedLength))
+		goto out;
 	Stream_SetPosition(s, sec_hold);
 
 	if (!rdp_security_stream_out(rdp, s, length, 0, &pad))
-		goto fail;
+		goto out;
 
 	length += pad;
 	Stream_SetPosition(s, length);
@@ -734,9 +797,11 @@ BOOL rdp_send_data_pdu(rdpRdp* rdp, wStream* s, BYTE type, UINT16 channel_id)
 
 	rdp->outPackets++;
 	if (transport_write(rdp->transport, s) < 0)
-		goto fail;
+		goto out;
 
 	rc = TRUE;
+out:
+	LeaveCriticalSection(&rdp->transport->WriteLock);
 fail:
 	Stream_Release(s);
 	return rc;
@@ -918,7 +983,7 @@ int rdp_recv_data_pdu(rdpRdp* rdp, wStream* s)
 		}
 
 		if (bulk_decompress(rdp->bulk, Stream_Pointer(s), SrcSize, &pDstData, &DstSize,
-		                    compressedType))
+		                    compressedType) >= 0)
 		{
 			if (!(cs = StreamPool_Take(rdp->transport->ReceivePool, DstSize)))
 			{
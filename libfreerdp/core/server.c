@@ -476,6 +476,10 @@ BOOL WTSVirtualChannelManagerCheckFileDescriptor(HANDLE hServer)
 		}
 	}
 
+	/* the queued messages (e.g. a complete graphics pipeline frame) are written at once */
+	if (!transport_cork(vcm->rdp->transport))
+		return FALSE;
+
 	while (MessageQueue_Peek(vcm->queue, &message, TRUE))
 	{
 		BYTE* buffer;
@@ -496,6 +500,9 @@ BOOL WTSVirtualChannelManagerCheckFileDescriptor(HANDLE hServer)
 			break;
 	}
 
+	if (!transport_uncork(vcm->rdp->transport))
+		status = FALSE;
+
 	return status;
 }
 
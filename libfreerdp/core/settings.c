@@ -38,6 +38,7 @@
 
 #include <freerdp/settings.h>
 #include <freerdp/build-config.h>
+#include <freerdp/codec/ncrush.h>
 #include <ctype.h>
 
 #include "settings.h"
@@ -359,6 +360,8 @@ rdpSettings* freerdp_settings_new(DWORD flags)
 	settings->LogonNotify = TRUE;
 	settings->BrushSupportLevel = BRUSH_COLOR_FULL;
 	settings->CompressionLevel = PACKET_COMPR_TYPE_RDP61;
+	settings->CompressionAdaptive = FALSE;
+	settings->CompressionNCrushMode = NCRUSH_MODE_DEFAULT;
 	settings->Authentication = TRUE;
 	settings->AuthenticationOnly = FALSE;
 	settings->CredentialsFromStdin = FALSE;
@@ -493,6 +496,7 @@ rdpSettings* freerdp_settings_new(DWORD flags)
 	settings->GatewayHttpTransport = TRUE;
 	settings->GatewayUdpTransport = TRUE;
 	settings->FastPathInput = TRUE;
+	settings->FastPathInputBatchWindow = 0;
 	settings->FastPathOutput = TRUE;
 	settings->LongCredentialsSupported = TRUE;
 	settings->FrameAcknowledge = 2;
@@ -509,6 +513,7 @@ rdpSettings* freerdp_settings_new(DWORD flags)
 	settings->GfxH264 = FALSE;
 	settings->GfxAVC444 = FALSE;
 	settings->GfxSendQoeAck = FALSE;
+	settings->GfxParallelDecode = FALSE;
 	settings->ClientAutoReconnectCookie =
 	    (ARC_CS_PRIVATE_PACKET*)calloc(1, sizeof(ARC_CS_PRIVATE_PACKET));
 
@@ -598,6 +603,7 @@ rdpSettings* freerdp_settings_new(DWORD flags)
 	settings->XSelectionAtom = NULL;
 	settings->SmartcardLogon = FALSE;
 	settings->TlsSecLevel = 1;
+	settings->TlsKernelOffload = FALSE;
 	settings->OrderSupport = calloc(1, 32);
 
 	if (!settings->OrderSupport)
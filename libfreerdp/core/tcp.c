@@ -477,20 +477,11 @@ static int transport_bio_buffered_write(BIO* bio, const char* buf, int num)
 	ret = num;
 	ptr->writeBlocked = FALSE;
 	BIO_clear_flags(bio, BIO_FLAGS_WRITE);
-
-	/* we directly append extra bytes in the xmit buffer, this could be prevented
-	 * but for now it makes the code more simple.
-	 */
-	if (buf && num && !ringbuffer_write(&ptr->xmitBuffer, (const BYTE*)buf, num))
-	{
-		WLog_ERR(TAG, "an error occurred when writing (num: %d)", num);
-		return -1;
-	}
-
 	committedBytes = 0;
 	nchunks = ringbuffer_peek(&ptr->xmitBuffer, chunks, ringbuffer_used(&ptr->xmitBuffer));
 	next_bio = BIO_next(bio);
 
+	/* data still pending in the xmit buffer goes first */
 	for (i = 0; i < nchunks; i++)
 	{
 		while (chunks[i].size)
@@ -520,8 +511,41 @@ static int transport_bio_buffered_write(BIO* bio, const char* buf, int num)
 		}
 	}
 
+	/* the new data is written directly, only what the socket does not take
+	 * right away is copied to the xmit buffer.
+	 */
+	while (buf && (num > 0))
+	{
+		status = BIO_write(next_bio, buf, num);
+
+		if (status <= 0)
+		{
+			if (!BIO_should_retry(next_bio))
+			{
+				BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
+				ret = -1; /* fatal error */
+				goto out;
+			}
+
+			BIO_set_flags(bio, BIO_FLAGS_WRITE);
+			ptr->writeBlocked = TRUE;
+			break; /* EWOULDBLOCK */
+		}
+
+		buf += status;
+		num -= status;
+	}
+
 out:
 	ringbuffer_commit_read_bytes(&ptr->xmitBuffer, committedBytes);
+
+	if ((ret >= 0) && buf && (num > 0) &&
+	    !ringbuffer_write(&ptr->xmitBuffer, (const BYTE*)buf, num))
+	{
+		WLog_ERR(TAG, "an error occurred when writing (num: %d)", num);
+		return -1;
+	}
+
 	return ret;
 }
 
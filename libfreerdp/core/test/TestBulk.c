@@ -0,0 +1,399 @@
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/metrics.h>
+#include <freerdp/codec/bulk.h>
+
+#include "../bulk.h"
+
+#define TEST_BULK_PACKETS 400
+
+typedef struct
+{
+	freerdp* instance;
+	rdpBulk* bulk;
+} TestBulkPeer;
+
+static BOOL test_bulk_peer_new(TestBulkPeer* peer, UINT32 level, BOOL adaptive, BOOL server)
+{
+	rdpSettings* settings;
+	ZeroMemory(peer, sizeof(TestBulkPeer));
+
+	if (!(peer->instance = freerdp_new()) || !freerdp_context_new(peer->instance))
+		return FALSE;
+
+	settings = peer->instance->context->settings;
+	settings->ServerMode = server;
+	settings->CompressionEnabled = TRUE;
+	settings->CompressionLevel = level;
+	settings->CompressionAdaptive = adaptive;
+	peer->bulk = bulk_new(peer->instance->context);
+	return peer->bulk != NULL;
+}
+
+static void test_bulk_peer_free(TestBulkPeer* peer)
+{
+	bulk_free(peer->bulk);
+
+	if (peer->instance)
+	{
+		freerdp_context_free(peer->instance);
+		freerdp_free(peer->instance);
+	}
+}
+
+/**
+ * Packets as a server sends them: text like data, repeated drawing orders and noise, of sizes
+ * from just above the minimum up to the largest fast-path fragment.
+ */
+static UINT32 test_bulk_packet(BYTE* data, UINT32 index, UINT32* state)
+{
+	UINT32 pos;
+	static const char text[] = "The quick brown fox jumps over the lazy dog. 0123456789 ";
+	const UINT32 sizes[] = { 60, 200, 1500, 4000, 8192, 12000, 16384, 24000, 32000, 65000 };
+	const UINT32 size = sizes[index % ARRAYSIZE(sizes)];
+
+	for (pos = 0; pos < size; pos++)
+	{
+		*state = *state * 1664525 + 1013904223;
+
+		switch ((index / ARRAYSIZE(sizes)) % 3)
+		{
+			case 0:
+				data[pos] = (BYTE)text[(pos + index) % (ARRAYSIZE(text) - 1)];
+				break;
+
+			case 1:
+				data[pos] = (BYTE)((pos % 64 < 48) ? (pos / 64 + index) : (*state >> 24));
+				break;
+
+			default:
+				data[pos] = (BYTE)(*state >> 24);
+				break;
+		}
+	}
+
+	return size;
+}
+
+/**
+ * Compresses packets with the sending end and decompresses them with the receiving end like
+ * fast-path does. pTypes receives a mask of the compression types used, pDigest a checksum
+ * of everything sent.
+ */
+static BOOL test_bulk_round_trip(UINT32 level, BOOL adaptive, UINT32* pTypes, UINT32* pDigest)
+{
+	BOOL rc = FALSE;
+	UINT32 index;
+	UINT32 state = 1;
+	BYTE* data = NULL;
+	TestBulkPeer server = { 0 };
+	TestBulkPeer client = { 0 };
+	*pTypes = 0;
+	*pDigest = 0;
+
+	if (!test_bulk_peer_new(&server, level, adaptive, TRUE) ||
+	    !test_bulk_peer_new(&client, level, adaptive, FALSE))
+		goto fail;
+
+	if (!(data = malloc(65536)))
+		goto fail;
+
+	for (index = 0; index < TEST_BULK_PACKETS; index++)
+	{
+		UINT32 pos;
+		BYTE* pDstData = NULL;
+		BYTE* pOutData = NULL;
+		UINT32 DstSize = 0;
+		UINT32 OutSize = 0;
+		UINT32 flags = 0;
+		const UINT32 size = test_bulk_packet(data, index, &state);
+
+		if (bulk_compress(server.bulk, data, size, &pDstData, &DstSize, &flags) < 0)
+		{
+			fprintf(stderr, "bulk_compress failed, level %" PRIu32 " packet %" PRIu32 "\n", level,
+			        index);
+			goto fail;
+		}
+
+		if (!flags)
+		{
+			pDstData = data;
+			DstSize = size;
+		}
+		else
+		{
+			const UINT32 type = flags & BULK_COMPRESSION_TYPE_MASK;
+
+			/* 8K and 64K share a decompressor, only the one matching the level is used */
+			if ((type > level) ||
+			    ((type == PACKET_COMPR_TYPE_8K) && (level != PACKET_COMPR_TYPE_8K)))
+			{
+				fprintf(stderr, "type %" PRIu32 " used with level %" PRIu32 "\n", type, level);
+				goto fail;
+			}
+
+			if (flags & PACKET_COMPRESSED)
+				*pTypes |= 1 << type;
+		}
+
+		*pDigest = *pDigest * 31 + flags;
+
+		for (pos = 0; pos < DstSize; pos++)
+			*pDigest = *pDigest * 31 + pDstData[pos];
+
+		if ((bulk_decompress(client.bulk, pDstData, DstSize, &pOutData, &OutSize, flags) < 0) ||
+		    (OutSize != size) || (memcmp(pOutData, data, size) != 0))
+		{
+			fprintf(stderr,
+			        "round trip failed, level %" PRIu32 " packet %" PRIu32 " flags 0x%02" PRIX32
+			        "\n",
+			        level, index, flags);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	free(data);
+	test_bulk_peer_free(&client);
+	test_bulk_peer_free(&server);
+	return rc;
+}
+
+static BOOL test_bulk_rdp8(void)
+{
+	UINT32 types;
+	UINT32 digest;
+
+	if (!test_bulk_round_trip(PACKET_COMPR_TYPE_RDP8, FALSE, &types, &digest))
+		return FALSE;
+
+	if (!(types & (1 << PACKET_COMPR_TYPE_RDP8)))
+	{
+		fprintf(stderr, "RDP8 was never used\n");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * By default the negotiated type is used, packets it cannot take fall back to the highest
+ * type taking them. The same packets are always sent the same way.
+ */
+static BOOL test_bulk_negotiated_type(void)
+{
+	UINT32 level;
+	const UINT32 expected[] = {
+		1 << PACKET_COMPR_TYPE_8K,
+		1 << PACKET_COMPR_TYPE_64K,
+		(1 << PACKET_COMPR_TYPE_64K) | (1 << PACKET_COMPR_TYPE_RDP6),
+		(1 << PACKET_COMPR_TYPE_64K) | (1 << PACKET_COMPR_TYPE_RDP6) |
+		    (1 << PACKET_COMPR_TYPE_RDP61),
+		1 << PACKET_COMPR_TYPE_RDP8,
+	};
+
+	for (level = PACKET_COMPR_TYPE_8K; level <= PACKET_COMPR_TYPE_RDP8; level++)
+	{
+		UINT32 types;
+		UINT32 digest;
+		UINT32 again;
+
+		if (!test_bulk_round_trip(level, FALSE, &types, &digest) ||
+		    !test_bulk_round_trip(level, FALSE, &types, &again))
+			return FALSE;
+
+		if (types != expected[level])
+		{
+			fprintf(stderr, "level %" PRIu32 " used types 0x%02" PRIX32 ", expected 0x%02" PRIX32
+			                "\n",
+			        level, types, expected[level]);
+			return FALSE;
+		}
+
+		if (digest != again)
+		{
+			fprintf(stderr, "level %" PRIu32 " compressed the same packets differently\n", level);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* adaptively every type up to the negotiated one is measured, so more than one gets used */
+static BOOL test_bulk_compressor_choice(void)
+{
+	UINT32 level;
+
+	for (level = PACKET_COMPR_TYPE_8K; level <= PACKET_COMPR_TYPE_RDP8; level++)
+	{
+		UINT32 types;
+		UINT32 digest;
+		UINT32 expected = 1 << ((level == PACKET_COMPR_TYPE_8K) ? PACKET_COMPR_TYPE_8K
+		                                                        : PACKET_COMPR_TYPE_64K);
+		UINT32 type;
+
+		for (type = PACKET_COMPR_TYPE_RDP6; type <= level; type++)
+			expected |= 1 << type;
+
+		if (!test_bulk_round_trip(level, TRUE, &types, &digest))
+			return FALSE;
+
+		if (types != expected)
+		{
+			fprintf(stderr, "level %" PRIu32 " used types 0x%02" PRIX32 ", expected 0x%02" PRIX32
+			                "\n",
+			        level, types, expected);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* NCrush output of some packets, the compressor takes its mode from the settings */
+static BOOL test_bulk_ncrush_size(TestBulkPeer* server, BOOL reset, UINT32 mode, UINT64* pSize)
+{
+	UINT32 index;
+	UINT32 state = 3;
+	BYTE* data = NULL;
+	rdpContext* context = server->instance->context;
+	*pSize = 0;
+	context->settings->CompressionNCrushMode = mode;
+
+	if (reset)
+		bulk_reset(server->bulk);
+	else
+	{
+		bulk_free(server->bulk);
+
+		if (!(server->bulk = bulk_new(context)))
+			return FALSE;
+	}
+
+	if (!(data = malloc(65536)))
+		return FALSE;
+
+	for (index = 0; index < 30; index++)
+	{
+		BYTE* pDstData = NULL;
+		UINT32 DstSize = 0;
+		UINT32 flags = 0;
+		const UINT32 size = test_bulk_packet(data, index, &state);
+
+		if (bulk_compress(server->bulk, data, size, &pDstData, &DstSize, &flags) < 0)
+		{
+			free(data);
+			return FALSE;
+		}
+
+		*pSize += DstSize;
+	}
+
+	free(data);
+	return TRUE;
+}
+
+/* the NCrush mode setting is applied when the contexts are created and reset */
+static BOOL test_bulk_ncrush_mode(void)
+{
+	BOOL rc = FALSE;
+	UINT64 fast, best, created;
+	TestBulkPeer server = { 0 };
+
+	if (!test_bulk_peer_new(&server, PACKET_COMPR_TYPE_RDP6, FALSE, TRUE))
+		goto fail;
+
+	if (!test_bulk_ncrush_size(&server, TRUE, NCRUSH_MODE_FAST, &fast) ||
+	    !test_bulk_ncrush_size(&server, TRUE, NCRUSH_MODE_BEST, &best) ||
+	    !test_bulk_ncrush_size(&server, FALSE, NCRUSH_MODE_BEST, &created))
+		goto fail;
+
+	rc = (best < fast) && (created == best);
+fail:
+
+	if (!rc)
+		fprintf(stderr, "NCrush mode not applied\n");
+
+	test_bulk_peer_free(&server);
+	return rc;
+}
+
+/* the per type metrics follow what was sent, adaptively every type gets used */
+static BOOL test_bulk_metrics(void)
+{
+	BOOL rc = FALSE;
+	UINT32 index;
+	UINT32 state = 7;
+	UINT64 packets = 0;
+	BYTE* data = NULL;
+	rdpMetrics* metrics;
+	TestBulkPeer server = { 0 };
+
+	if (!test_bulk_peer_new(&server, PACKET_COMPR_TYPE_RDP8, TRUE, TRUE))
+		goto fail;
+
+	if (!(data = malloc(65536)))
+		goto fail;
+
+	metrics = server.instance->context->metrics;
+
+	for (index = 0; index < 50; index++)
+	{
+		BYTE* pDstData = NULL;
+		UINT32 DstSize = 0;
+		UINT32 flags = 0;
+		const UINT32 size = test_bulk_packet(data, index, &state);
+
+		if (bulk_compress(server.bulk, data, size, &pDstData, &DstSize, &flags) < 0)
+			goto fail;
+	}
+
+	for (index = 0; index < METRICS_COMPRESSION_TYPES; index++)
+	{
+		packets += metrics->CompressPackets[index];
+
+		if ((index != PACKET_COMPR_TYPE_8K) && (metrics->CompressPackets[index] == 0))
+			goto fail;
+
+		if (metrics->CompressPackets[index] &&
+		    ((metrics_get_compression_ratio(metrics, index) <= 0.0) ||
+		     (metrics->CompressUncompressedBytes[index] == 0)))
+			goto fail;
+	}
+
+	rc = (packets == 50);
+fail:
+
+	if (!rc)
+		fprintf(stderr, "compression metrics mismatch\n");
+
+	free(data);
+	test_bulk_peer_free(&server);
+	return rc;
+}
+
+int TestBulk(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_bulk_rdp8())
+		return -1;
+
+	if (!test_bulk_negotiated_type())
+		return -1;
+
+	if (!test_bulk_compressor_choice())
+		return -1;
+
+	if (!test_bulk_ncrush_mode())
+		return -1;
+
+	if (!test_bulk_metrics())
+		return -1;
+
+	return 0;
+}
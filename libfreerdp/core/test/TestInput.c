@@ -0,0 +1,317 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/stream.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/input.h>
+
+#include "../rdp.h"
+#include "../input.h"
+#include "../fastpath.h"
+#include "../transport.h"
+
+/* microseconds, long enough for the events of one step to fall into the same window */
+#define TEST_INPUT_WINDOW 500000
+
+#define TEST_INPUT_MAX_PDUS 8
+#define TEST_INPUT_MAX_EVENTS 16
+
+typedef struct
+{
+	BYTE code;
+	UINT16 flags;
+	UINT16 x;
+	UINT16 y;
+} TestInputEvent;
+
+typedef struct
+{
+	size_t count;
+	TestInputEvent events[TEST_INPUT_MAX_EVENTS];
+} TestInputPdu;
+
+typedef struct
+{
+	freerdp* instance;
+	rdpInput* input;
+	int peer;
+} TestInputClient;
+
+/* reads the fast-path input PDUs sent so far, returns how many or -1 on a malformed one */
+static int test_input_receive(int fd, TestInputPdu* pdus, size_t count)
+{
+	BYTE buffer[4096];
+	wStream sbuffer;
+	wStream* s = &sbuffer;
+	size_t received = 0;
+	ssize_t length = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+	if (length <= 0)
+		return 0;
+
+	Stream_StaticInit(s, buffer, (size_t)length);
+
+	while (Stream_GetRemainingLength(s) > 0)
+	{
+		size_t index;
+		BYTE header;
+		UINT16 pduLength;
+		TestInputPdu* pdu = &pdus[received];
+
+		if ((received == count) || (Stream_GetRemainingLength(s) < 3))
+			return -1;
+
+		Stream_Read_UINT8(s, header);
+		Stream_Read_UINT16_BE(s, pduLength);
+		pduLength &= 0x7FFF;
+
+		if (((header & 0x03) != FASTPATH_INPUT_ACTION_FASTPATH) || (pduLength < 3) ||
+		    (Stream_GetRemainingLength(s) < pduLength - 3U))
+			return -1;
+
+		pdu->count = (header >> 2) & 0x0F;
+
+		for (index = 0; index < pdu->count; index++)
+		{
+			BYTE eventHeader;
+			TestInputEvent* event = &pdu->events[index];
+			ZeroMemory(event, sizeof(TestInputEvent));
+
+			if (Stream_GetRemainingLength(s) < 1)
+				return -1;
+
+			Stream_Read_UINT8(s, eventHeader);
+			event->code = eventHeader >> 5;
+
+			switch (event->code)
+			{
+				case FASTPATH_INPUT_EVENT_SCANCODE:
+					if (Stream_GetRemainingLength(s) < 1)
+						return -1;
+
+					Stream_Read_UINT8(s, event->x);
+					break;
+
+				case FASTPATH_INPUT_EVENT_MOUSE:
+					if (Stream_GetRemainingLength(s) < 6)
+						return -1;
+
+					Stream_Read_UINT16(s, event->flags);
+					Stream_Read_UINT16(s, event->x);
+					Stream_Read_UINT16(s, event->y);
+					break;
+
+				default:
+					return -1;
+			}
+		}
+
+		received++;
+	}
+
+	return (int)received;
+}
+
+static BOOL test_input_statistics(rdpInput* input, UINT64 events, UINT64 merged, UINT64 pdus)
+{
+	UINT64 sentEvents;
+	UINT64 mergedEvents;
+	UINT64 sentPdus;
+
+	if (!freerdp_input_get_batch_statistics(input, &sentEvents, &mergedEvents, &sentPdus))
+		return FALSE;
+
+	if ((sentEvents != events) || (mergedEvents != merged) || (sentPdus != pdus))
+	{
+		fprintf(stderr,
+		        "statistics: events %" PRIu64 " merged %" PRIu64 " PDUs %" PRIu64
+		        ", expected %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+		        sentEvents, mergedEvents, sentPdus, events, merged, pdus);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL test_input_mouse_event(const TestInputEvent* event, UINT16 flags, UINT16 x, UINT16 y)
+{
+	return (event->code == FASTPATH_INPUT_EVENT_MOUSE) && (event->flags == flags) &&
+	       (event->x == x) && (event->y == y);
+}
+
+/* an event after a quiet period goes out on its own */
+static BOOL test_input_quiet(TestInputClient* client, UINT64* pdus)
+{
+	TestInputPdu received[TEST_INPUT_MAX_PDUS];
+	Sleep(TEST_INPUT_WINDOW / 1000 + 100);
+
+	if (!freerdp_input_send_mouse_event(client->input, PTR_FLAGS_MOVE, 10, 20))
+		return FALSE;
+
+	if ((test_input_receive(client->peer, received, ARRAYSIZE(received)) != 1) ||
+	    (received[0].count != 1) ||
+	    !test_input_mouse_event(&received[0].events[0], PTR_FLAGS_MOVE, 10, 20))
+	{
+		fprintf(stderr, "event after a quiet period was not sent right away\n");
+		return FALSE;
+	}
+
+	(*pdus)++;
+	return TRUE;
+}
+
+/* mouse moves within the window replace the pending move, but never one before a button */
+static BOOL test_input_merge(TestInputClient* client)
+{
+	UINT16 x;
+	TestInputPdu received[TEST_INPUT_MAX_PDUS];
+	const UINT16 down = PTR_FLAGS_DOWN | PTR_FLAGS_BUTTON1;
+
+	for (x = 11; x <= 13; x++)
+	{
+		if (!freerdp_input_send_mouse_event(client->input, PTR_FLAGS_MOVE, x, 20))
+			return FALSE;
+	}
+
+	if (!freerdp_input_send_mouse_event(client->input, down, 13, 20))
+		return FALSE;
+
+	for (x = 14; x <= 16; x++)
+	{
+		if (!freerdp_input_send_mouse_event(client->input, PTR_FLAGS_MOVE, x, 20))
+			return FALSE;
+	}
+
+	if (test_input_receive(client->peer, received, ARRAYSIZE(received)) != 0)
+	{
+		fprintf(stderr, "events within the window were not held back\n");
+		return FALSE;
+	}
+
+	if (!input_flush(client->input))
+		return FALSE;
+
+	if ((test_input_receive(client->peer, received, ARRAYSIZE(received)) != 1) ||
+	    (received[0].count != 3) ||
+	    !test_input_mouse_event(&received[0].events[0], PTR_FLAGS_MOVE, 13, 20) ||
+	    !test_input_mouse_event(&received[0].events[1], down, 13, 20) ||
+	    !test_input_mouse_event(&received[0].events[2], PTR_FLAGS_MOVE, 16, 20))
+	{
+		fprintf(stderr, "mouse moves were not merged up to the button event\n");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* a batch is sent as soon as it holds the 15 events a PDU takes */
+static BOOL test_input_full(TestInputClient* client)
+{
+	UINT16 code;
+	TestInputPdu received[TEST_INPUT_MAX_PDUS];
+
+	for (code = 0; code < 20; code++)
+	{
+		const UINT16 flags = (code & 1) ? KBD_FLAGS_RELEASE : KBD_FLAGS_DOWN;
+
+		if (!freerdp_input_send_keyboard_event(client->input, flags, 0x10 + code / 2))
+			return FALSE;
+	}
+
+	if ((test_input_receive(client->peer, received, ARRAYSIZE(received)) != 1) ||
+	    (received[0].count != 15) || (received[0].events[14].x != 0x10 + 7))
+	{
+		fprintf(stderr, "a full batch was not sent\n");
+		return FALSE;
+	}
+
+	if (!input_flush(client->input))
+		return FALSE;
+
+	if ((test_input_receive(client->peer, received, ARRAYSIZE(received)) != 1) ||
+	    (received[0].count != 5) || (received[0].events[4].x != 0x10 + 9))
+	{
+		fprintf(stderr, "the rest of a full batch was not sent\n");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL test_input_batching(void)
+{
+	BOOL rc = FALSE;
+	UINT64 pdus = 0;
+	int sv[2] = { -1, -1 };
+	rdpContext* context;
+	TestInputClient client = { 0 };
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+		return FALSE;
+
+	if (!(client.instance = freerdp_new()) || !freerdp_context_new(client.instance))
+		goto fail;
+
+	context = client.instance->context;
+	context->settings->FastPathInput = TRUE;
+	context->settings->FastPathInputBatchWindow = TEST_INPUT_WINDOW;
+	context->rdp->state = CONNECTION_STATE_ACTIVE;
+	client.input = context->input;
+	client.peer = sv[1];
+
+	if (!transport_attach(context->rdp->transport, sv[0]))
+		goto fail;
+
+	sv[0] = -1;
+
+	if (!input_register_client_callbacks(client.input) ||
+	    (input_get_event_handles(client.input, NULL, 0) != 1))
+		goto fail;
+
+	if (!test_input_quiet(&client, &pdus) || !test_input_statistics(client.input, 1, 0, pdus))
+		goto fail;
+
+	if (!test_input_merge(&client) || !test_input_statistics(client.input, 4, 4, ++pdus))
+		goto fail;
+
+	pdus += 2;
+
+	if (!test_input_full(&client) || !test_input_statistics(client.input, 24, 4, pdus))
+		goto fail;
+
+	if (!test_input_quiet(&client, &pdus) || !test_input_statistics(client.input, 25, 4, pdus))
+		goto fail;
+
+	rc = TRUE;
+fail:
+
+	if (!rc)
+		fprintf(stderr, "input batching failed\n");
+
+	if (client.instance)
+	{
+		freerdp_context_free(client.instance);
+		freerdp_free(client.instance);
+	}
+
+	if (sv[0] >= 0)
+		close(sv[0]);
+
+	close(sv[1]);
+	return rc;
+}
+
+int TestInput(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_input_batching())
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,595 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <openssl/ssl.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/stream.h>
+
+#include <freerdp/freerdp.h>
+
+#include "../rdp.h"
+#include "../transport.h"
+
+#define TEST_MAX_PDUS 64
+#define TEST_TLS_PDU_SIZE 16000
+#define TEST_TLS_PDU_COUNT 256
+
+typedef struct
+{
+	int peer;
+	size_t count;
+	BYTE ids[TEST_MAX_PDUS];
+	size_t lengths[TEST_MAX_PDUS];
+	BOOL nested;
+	BYTE nestedData[64];
+	size_t nestedLength;
+	int nestedStatus;
+	BYTE nestedId;
+} TestTransportState;
+
+/* fast-path PDU of length bytes, the byte after the header identifies the PDU */
+static size_t test_fastpath_pdu(BYTE* buffer, BYTE id, size_t length)
+{
+	size_t index;
+	buffer[0] = 0x04;
+	buffer[1] = (BYTE)length;
+	buffer[2] = id;
+
+	for (index = 3; index < length; index++)
+		buffer[index] = (BYTE)(id + index);
+
+	return length;
+}
+
+/* tpkt PDU of length bytes, the byte after the header identifies the PDU */
+static size_t test_tpkt_pdu(BYTE* buffer, BYTE id, size_t length)
+{
+	size_t index;
+	buffer[0] = 0x03;
+	buffer[1] = 0x00;
+	buffer[2] = (BYTE)(length >> 8);
+	buffer[3] = (BYTE)length;
+	buffer[4] = id;
+
+	for (index = 5; index < length; index++)
+		buffer[index] = (BYTE)(id ^ index);
+
+	return length;
+}
+
+static BOOL test_send(int fd, const BYTE* data, size_t length)
+{
+	while (length > 0)
+	{
+		const ssize_t rc = send(fd, data, length, 0);
+
+		if (rc <= 0)
+			return FALSE;
+
+		data += rc;
+		length -= (size_t)rc;
+	}
+
+	return TRUE;
+}
+
+static int test_transport_recv(rdpTransport* transport, wStream* s, void* extra)
+{
+	TestTransportState* state = (TestTransportState*)extra;
+	const BYTE* data = Stream_Buffer(s);
+	const size_t length = Stream_Length(s);
+
+	if (state->count >= TEST_MAX_PDUS)
+		return -1;
+
+	state->ids[state->count] = (data[0] == 0x03) ? data[4] : data[2];
+	state->lengths[state->count] = length;
+	state->count++;
+
+	if (state->nested)
+	{
+		wStream* pdu = Stream_New(NULL, 64);
+
+		if (!pdu)
+			return -1;
+
+		state->nested = FALSE;
+
+		/* data arriving while the PDU is processed */
+		if ((state->nestedLength > 0) &&
+		    !test_send(state->peer, state->nestedData, state->nestedLength))
+			return -1;
+
+		state->nestedStatus = transport_read_pdu(transport, pdu);
+
+		if (state->nestedStatus > 0)
+			state->nestedId = Stream_Buffer(pdu)[2];
+
+		Stream_Free(pdu, TRUE);
+	}
+
+	return 0;
+}
+
+static BOOL test_expect(const TestTransportState* state, const BYTE* ids, size_t count)
+{
+	size_t index;
+
+	if (state->count != count)
+	{
+		fprintf(stderr, "received %" PRIuz " PDUs, expected %" PRIuz "\n", state->count, count);
+		return FALSE;
+	}
+
+	for (index = 0; index < count; index++)
+	{
+		if (state->ids[index] != ids[index])
+		{
+			fprintf(stderr, "PDU %" PRIuz " is %" PRIu8 ", expected %" PRIu8 "\n", index,
+			        state->ids[index], ids[index]);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL test_multiple_pdus(rdpTransport* transport, TestTransportState* state)
+{
+	BYTE data[1024];
+	size_t length = 0;
+	const BYTE ids[] = { 1, 2, 3, 4, 5 };
+
+	length += test_fastpath_pdu(&data[length], 1, 3);
+	length += test_tpkt_pdu(&data[length], 2, 7);
+	length += test_fastpath_pdu(&data[length], 3, 100);
+	length += test_tpkt_pdu(&data[length], 4, 300);
+	length += test_fastpath_pdu(&data[length], 5, 20);
+
+	if (!test_send(state->peer, data, length))
+		return FALSE;
+
+	if (transport_check_fds(transport) != 0)
+		return FALSE;
+
+	if (!test_expect(state, ids, ARRAYSIZE(ids)))
+		return FALSE;
+
+	return (state->lengths[2] == 100) && (state->lengths[3] == 300);
+}
+
+static BOOL test_partial_pdus(rdpTransport* transport, TestTransportState* state)
+{
+	BYTE data[1024];
+	size_t length = 0;
+	size_t split;
+	const BYTE ids[] = { 6, 7, 8 };
+
+	length += test_fastpath_pdu(&data[length], 6, 50);
+	length += test_tpkt_pdu(&data[length], 7, 400);
+	length += test_fastpath_pdu(&data[length], 8, 30);
+
+	/* single byte of a header */
+	if (!test_send(state->peer, data, 1))
+		return FALSE;
+
+	if ((transport_check_fds(transport) != 0) || (state->count != 0))
+		return FALSE;
+
+	/* the first PDU and a part of the tpkt header of the second one */
+	split = 50 + 3;
+
+	if (!test_send(state->peer, &data[1], split - 1))
+		return FALSE;
+
+	if ((transport_check_fds(transport) != 0) || !test_expect(state, ids, 1))
+		return FALSE;
+
+	/* the second PDU but the last byte */
+	if (!test_send(state->peer, &data[split], 50 + 400 - 1 - split))
+		return FALSE;
+
+	if ((transport_check_fds(transport) != 0) || !test_expect(state, ids, 1))
+		return FALSE;
+
+	if (!test_send(state->peer, &data[50 + 400 - 1], length - (50 + 400 - 1)))
+		return FALSE;
+
+	if ((transport_check_fds(transport) != 0) || !test_expect(state, ids, 3))
+		return FALSE;
+
+	return (state->lengths[1] == 400) && (state->lengths[2] == 30);
+}
+
+static BOOL test_nested_read(rdpTransport* transport, TestTransportState* state)
+{
+	BYTE data[1024];
+	size_t length = 0;
+	const BYTE ids[] = { 9, 10, 11 };
+	const BYTE last[] = { 12 };
+
+	/* a nested read while PDUs of the batch are unprocessed must fail */
+	length += test_fastpath_pdu(&data[length], 9, 10);
+	length += test_fastpath_pdu(&data[length], 10, 11);
+	length += test_fastpath_pdu(&data[length], 11, 12);
+	state->nested = TRUE;
+
+	if (!test_send(state->peer, data, length))
+		return FALSE;
+
+	if (transport_check_fds(transport) != 0)
+		return FALSE;
+
+	if (!test_expect(state, ids, ARRAYSIZE(ids)) || (state->nestedStatus >= 0))
+		return FALSE;
+
+	/* it is fine once the whole batch was taken */
+	state->count = 0;
+	state->nested = TRUE;
+	state->nestedLength = test_fastpath_pdu(state->nestedData, 13, 41);
+	length = test_fastpath_pdu(data, 12, 40);
+
+	if (!test_send(state->peer, data, length))
+		return FALSE;
+
+	if (transport_check_fds(transport) != 0)
+		return FALSE;
+
+	return test_expect(state, last, ARRAYSIZE(last)) && (state->nestedStatus == 41) &&
+	       (state->nestedId == 13);
+}
+
+static BOOL test_write_pdu(rdpTransport* transport, BYTE id)
+{
+	BYTE data[32];
+	const size_t length = test_fastpath_pdu(data, id, sizeof(data));
+	wStream* s = transport_send_stream_init(transport, (int)length);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write(s, data, length);
+	return transport_write(transport, s) == (int)length;
+}
+
+static DWORD WINAPI test_cork_writer_thread(LPVOID arg)
+{
+	rdpTransport* transport = (rdpTransport*)arg;
+	return test_write_pdu(transport, 2) ? 0 : 1;
+}
+
+/* corking collects the PDUs of the calling thread only, other threads wait for the uncork */
+static BOOL test_corked_writes(rdpTransport* transport, TestTransportState* state)
+{
+	size_t received = 0;
+	DWORD exitCode = 1;
+	HANDLE thread = NULL;
+	BYTE data[64];
+
+	if (!transport_cork(transport) || !test_write_pdu(transport, 1))
+		return FALSE;
+
+	if (!(thread = CreateThread(NULL, 0, test_cork_writer_thread, transport, 0, NULL)))
+	{
+		transport_uncork(transport);
+		return FALSE;
+	}
+
+	if ((WaitForSingleObject(thread, 200) != WAIT_TIMEOUT) ||
+	    (recv(state->peer, data, sizeof(data), MSG_DONTWAIT) >= 0))
+	{
+		fprintf(stderr, "a PDU of another thread was not held back while corked\n");
+		transport_uncork(transport);
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+		return FALSE;
+	}
+
+	if (!transport_uncork(transport) || (WaitForSingleObject(thread, 5000) != WAIT_OBJECT_0) ||
+	    !GetExitCodeThread(thread, &exitCode))
+		exitCode = 1;
+
+	CloseHandle(thread);
+
+	while ((exitCode == 0) && (received < sizeof(data)))
+	{
+		const ssize_t rc = recv(state->peer, &data[received], sizeof(data) - received, 0);
+
+		if (rc <= 0)
+			return FALSE;
+
+		received += (size_t)rc;
+	}
+
+	/* the corked PDU first, then the one that waited */
+	return (exitCode == 0) && (data[2] == 1) && (data[32 + 2] == 2);
+}
+
+typedef BOOL (*TestTransportCase)(rdpTransport* transport, TestTransportState* state);
+
+static BOOL test_transport_run(const char* name, TestTransportCase test)
+{
+	BOOL rc = FALSE;
+	int sv[2] = { -1, -1 };
+	freerdp* instance = NULL;
+	rdpTransport* transport;
+	TestTransportState state = { 0 };
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+		return FALSE;
+
+	if (!(instance = freerdp_new()) || !freerdp_context_new(instance))
+		goto fail;
+
+	transport = instance->context->rdp->transport;
+
+	if (!transport_attach(transport, sv[0]))
+	{
+		sv[0] = -1;
+		goto fail;
+	}
+
+	sv[0] = -1;
+
+	if (!transport_set_blocking_mode(transport, FALSE))
+		goto fail;
+
+	state.peer = sv[1];
+	transport->ReceiveCallback = test_transport_recv;
+	transport->ReceiveExtra = &state;
+	rc = test(transport, &state);
+fail:
+
+	if (!rc)
+		fprintf(stderr, "%s failed\n", name);
+
+	if (instance)
+	{
+		freerdp_context_free(instance);
+		freerdp_free(instance);
+	}
+
+	if (sv[0] >= 0)
+		close(sv[0]);
+
+	close(sv[1]);
+	return rc;
+}
+
+typedef struct
+{
+	rdpTransport* transport;
+	HANDLE writing;
+	BOOL accepted;
+	size_t received;
+	BOOL valid;
+} TestTransportTlsPeer;
+
+static BYTE test_tls_byte(size_t offset)
+{
+	return (BYTE)((offset * 7) ^ (offset >> 11));
+}
+
+static DWORD WINAPI test_tls_peer_thread(LPVOID arg)
+{
+	BYTE buffer[8192];
+	TestTransportTlsPeer* peer = (TestTransportTlsPeer*)arg;
+	const size_t total = TEST_TLS_PDU_SIZE * TEST_TLS_PDU_COUNT;
+
+	peer->accepted = transport_accept_tls(peer->transport);
+
+	if (!peer->accepted)
+		return 0;
+
+	/* let the other side run into a full socket before reading anything */
+	WaitForSingleObject(peer->writing, INFINITE);
+	Sleep(200);
+	peer->valid = TRUE;
+
+	while (peer->received < total)
+	{
+		int index;
+		const int status = BIO_read(peer->transport->frontBio, buffer, sizeof(buffer));
+
+		if (status <= 0)
+		{
+			if (BIO_should_retry(peer->transport->frontBio))
+				continue;
+
+			break;
+		}
+
+		for (index = 0; index < status; index++)
+		{
+			if (buffer[index] != test_tls_byte(peer->received + (size_t)index))
+				peer->valid = FALSE;
+		}
+
+		peer->received += (size_t)status;
+	}
+
+	return 0;
+}
+
+static freerdp* test_tls_instance(int fd, BOOL server)
+{
+	char path[1024];
+	freerdp* instance = freerdp_new();
+
+	if (!instance)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	if (!freerdp_context_new(instance))
+	{
+		freerdp_free(instance);
+		close(fd);
+		return NULL;
+	}
+
+	if (!transport_attach(instance->context->rdp->transport, fd) ||
+	    !freerdp_settings_set_bool(instance->context->settings, FreeRDP_TlsKernelOffload, TRUE))
+		goto fail;
+
+	if (server)
+	{
+		sprintf_s(path, sizeof(path), "%s/server/Sample/server.key", TESTING_SRC_DIRECTORY);
+
+		if (!freerdp_settings_set_string(instance->context->settings, FreeRDP_PrivateKeyFile,
+		                                 path))
+			goto fail;
+
+		sprintf_s(path, sizeof(path), "%s/server/Sample/server.crt", TESTING_SRC_DIRECTORY);
+
+		if (!freerdp_settings_set_string(instance->context->settings, FreeRDP_CertificateFile,
+		                                 path))
+			goto fail;
+	}
+	else
+	{
+		if (!freerdp_settings_set_string(instance->context->settings, FreeRDP_ServerHostname,
+		                                 "localhost") ||
+		    !freerdp_settings_set_bool(instance->context->settings, FreeRDP_IgnoreCertificate,
+		                               TRUE))
+			goto fail;
+	}
+
+	return instance;
+fail:
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+	return NULL;
+}
+
+/* a non blocking writer on a (kernel) TLS connection must survive a peer that reads slowly */
+static BOOL test_tls_backpressure(void)
+{
+	BOOL rc = FALSE;
+	size_t index;
+	size_t offset = 0;
+	int sv[2] = { -1, -1 };
+	HANDLE thread = NULL;
+	freerdp* client = NULL;
+	freerdp* server = NULL;
+	rdpTransport* transport;
+	TestTransportTlsPeer peer = { 0 };
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+		return FALSE;
+
+	server = test_tls_instance(sv[1], TRUE);
+	client = test_tls_instance(sv[0], FALSE);
+
+	if (!server || !client)
+		goto fail;
+
+	if (!(peer.writing = CreateEvent(NULL, TRUE, FALSE, NULL)))
+		goto fail;
+
+	peer.transport = server->context->rdp->transport;
+
+	if (!(thread = CreateThread(NULL, 0, test_tls_peer_thread, &peer, 0, NULL)))
+		goto fail;
+
+	transport = client->context->rdp->transport;
+
+	if (!transport_connect_tls(transport))
+		goto fail;
+
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+	/* the SSL must write to the socket itself, with or without kernel support */
+	if (BIO_method_type(SSL_get_wbio(transport->tls->ssl)) != BIO_TYPE_SOCKET)
+		goto fail;
+#endif
+
+	if (!transport_set_blocking_mode(transport, FALSE))
+		goto fail;
+
+	SetEvent(peer.writing);
+
+	for (index = 0; index < TEST_TLS_PDU_COUNT; index++)
+	{
+		size_t pos;
+		wStream* s = transport_send_stream_init(transport, TEST_TLS_PDU_SIZE);
+
+		if (!s)
+			goto fail;
+
+		for (pos = 0; pos < TEST_TLS_PDU_SIZE; pos++)
+			Stream_Write_UINT8(s, test_tls_byte(offset + pos));
+
+		if (transport_write(transport, s) != TEST_TLS_PDU_SIZE)
+		{
+			fprintf(stderr, "write of PDU %" PRIuz " failed\n", index);
+			goto fail;
+		}
+
+		offset += TEST_TLS_PDU_SIZE;
+	}
+
+	WaitForSingleObject(thread, INFINITE);
+	rc = peer.accepted && peer.valid && (peer.received == offset);
+fail:
+
+	if (!rc)
+		fprintf(stderr, "TLS backpressure failed\n");
+
+	if (thread)
+	{
+		if (!rc)
+			shutdown(sv[0], SHUT_RDWR);
+
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+	}
+
+	if (peer.writing)
+		CloseHandle(peer.writing);
+
+	if (client)
+	{
+		freerdp_context_free(client);
+		freerdp_free(client);
+	}
+
+	if (server)
+	{
+		freerdp_context_free(server);
+		freerdp_free(server);
+	}
+
+	return rc;
+}
+
+int TestTransport(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_transport_run("multiple PDUs", test_multiple_pdus))
+		return -1;
+
+	if (!test_transport_run("partial PDUs", test_partial_pdus))
+		return -1;
+
+	if (!test_transport_run("nested read", test_nested_read))
+		return -1;
+
+	if (!test_transport_run("corked writes", test_corked_writes))
+		return -1;
+
+	/* a failing peer must not kill the test */
+	signal(SIGPIPE, SIG_IGN);
+
+	if (!test_tls_backpressure())
+		return -1;
+
+	return 0;
+}
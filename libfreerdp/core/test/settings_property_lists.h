@@ -24,6 +24,7 @@ static const size_t bool_list_indices[] = {
 	FreeRDP_BitmapCacheV3Enabled,
 	FreeRDP_BitmapCompressionDisabled,
 	FreeRDP_ColorPointerFlag,
+	FreeRDP_CompressionAdaptive,
 	FreeRDP_CompressionEnabled,
 	FreeRDP_ConsoleSession,
 	FreeRDP_CredentialsFromStdin,
@@ -70,6 +71,7 @@ static const size_t bool_list_indices[] = {
 	FreeRDP_GfxAVC444,
 	FreeRDP_GfxAVC444v2,
 	FreeRDP_GfxH264,
+	FreeRDP_GfxParallelDecode,
 	FreeRDP_GfxProgressive,
 	FreeRDP_GfxProgressiveV2,
 	FreeRDP_GfxSendQoeAck,
@@ -156,6 +158,7 @@ static const size_t bool_list_indices[] = {
 	FreeRDP_SurfaceCommandsEnabled,
 	FreeRDP_SurfaceFrameMarkerEnabled,
 	FreeRDP_TcpKeepAlive,
+	FreeRDP_TlsKernelOffload,
 	FreeRDP_TlsSecurity,
 	FreeRDP_ToggleFullscreen,
 	FreeRDP_UnicodeInput,
@@ -192,6 +195,7 @@ static const size_t uint32_list_indices[] = {
 	FreeRDP_ColorDepth,
 	FreeRDP_CompDeskSupportLevel,
 	FreeRDP_CompressionLevel,
+	FreeRDP_CompressionNCrushMode,
 	FreeRDP_ConnectionType,
 	FreeRDP_CookieMaxLength,
 	FreeRDP_DesktopHeight,
@@ -212,6 +216,7 @@ static const size_t uint32_list_indices[] = {
 	FreeRDP_EncryptionLevel,
 	FreeRDP_EncryptionMethods,
 	FreeRDP_ExtEncryptionMethods,
+	FreeRDP_FastPathInputBatchWindow,
 	FreeRDP_FrameAcknowledge,
 	FreeRDP_GatewayAcceptedCertLength,
 	FreeRDP_GatewayCredentialsSource,
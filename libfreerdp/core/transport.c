@@ -57,6 +57,8 @@
 #define TAG FREERDP_TAG("core.transport")
 
 #define BUFFER_SIZE 16384
+#define READ_AHEAD_SIZE (8 * BUFFER_SIZE)
+#define CORK_BUFFER_SIZE (4 * BUFFER_SIZE)
 
 #ifdef WITH_GSSAPI
 
@@ -259,6 +261,18 @@ BOOL transport_connect_rdp(rdpTransport* transport)
 	return TRUE;
 }
 
+static BOOL transport_read_ahead_empty(rdpTransport* transport)
+{
+	const size_t unread = transport->ReadAheadLength - transport->ReadAheadOffset;
+
+	if (unread == 0)
+		return TRUE;
+
+	WLog_Print(transport->log, WLOG_ERROR,
+	           "%" PRIuz " bytes received before the security layer was established", unread);
+	return FALSE;
+}
+
 BOOL transport_connect_tls(rdpTransport* transport)
 {
 	int tlsStatus;
@@ -266,6 +280,9 @@ BOOL transport_connect_tls(rdpTransport* transport)
 	rdpContext* context = transport->context;
 	rdpSettings* settings = transport->settings;
 
+	if (!transport_read_ahead_empty(transport))
+		return FALSE;
+
 	if (!(tls = tls_new(settings)))
 		return FALSE;
 
@@ -452,6 +469,9 @@ BOOL transport_accept_tls(rdpTransport* transport)
 {
 	rdpSettings* settings = transport->settings;
 
+	if (!transport_read_ahead_empty(transport))
+		return FALSE;
+
 	if (!transport->tls)
 		transport->tls = tls_new(transport->settings);
 
@@ -474,6 +494,9 @@ BOOL transport_accept_nla(rdpTransport* transport)
 
 	transport->layer = TRANSPORT_LAYER_TLS;
 
+	if (!transport_read_ahead_empty(transport))
+		return FALSE;
+
 	if (!tls_accept(transport->tls, transport->frontBio, settings))
 		return FALSE;
 
@@ -548,12 +571,22 @@ static void transport_bio_error_log(rdpTransport* transport, LPCSTR biofunc, BIO
 	}
 }
 
-static SSIZE_T transport_read_layer(rdpTransport* transport, BYTE* data, size_t bytes)
+/**
+ * @brief Reads between bytes and available bytes from the transport layer
+ *
+ * In blocking mode the function does not return before at least bytes were read, in non
+ * blocking mode it might return less. Every read asks the layer for all of the remaining
+ * available space so that a single call picks up everything that is already pending.
+ *
+ * @return < 0 on error; the number of bytes read otherwise
+ */
+static SSIZE_T transport_read_layer(rdpTransport* transport, BYTE* data, size_t bytes,
+                                    size_t available)
 {
 	SSIZE_T read = 0;
 	rdpRdp* rdp = transport->context->rdp;
 
-	if (!transport->frontBio || (bytes > SSIZE_MAX))
+	if (!transport->frontBio || (available > SSIZE_MAX) || (bytes > available))
 	{
 		transport->layer = TRANSPORT_LAYER_CLOSED;
 		freerdp_set_last_error_if_not(transport->context, FREERDP_ERROR_CONNECT_TRANSPORT_FAILED);
@@ -562,7 +595,7 @@ static SSIZE_T transport_read_layer(rdpTransport* transport, BYTE* data, size_t
 
 	while (read < (SSIZE_T)bytes)
 	{
-		const SSIZE_T tr = (SSIZE_T)bytes - read;
+		const SSIZE_T tr = (SSIZE_T)available - read;
 		int r = (int)((tr > INT_MAX) ? INT_MAX : tr);
 		int status = BIO_read(transport->frontBio, data + read, r);
 
@@ -600,7 +633,7 @@ static SSIZE_T transport_read_layer(rdpTransport* transport, BYTE* data, size_t
 		}
 
 #ifdef HAVE_VALGRIND_MEMCHECK_H
-		VALGRIND_MAKE_MEM_DEFINED(data + read, bytes - read);
+		VALGRIND_MAKE_MEM_DEFINED(data + read, status);
 #endif
 		read += status;
 		rdp->inBytes += status;
@@ -610,77 +643,111 @@ static SSIZE_T transport_read_layer(rdpTransport* transport, BYTE* data, size_t
 }
 
 /**
- * @brief Tries to read toRead bytes from the specified transport
- *
- * Try to read toRead bytes from the transport to the stream.
- * In case it was not possible to read toRead bytes 0 is returned. The stream is always advanced by
- * the number of bytes read.
+ * @brief Makes room for at least bytes unread bytes in the read-ahead buffer
  *
- * The function assumes that the stream has enough capacity to hold the data.
- *
- * @param[in] transport rdpTransport
- * @param[in] s wStream
- * @param[in] toRead number of bytes to read
- * @return < 0 on error; 0 if not enough data is available (non blocking mode); 1 toRead bytes read
+ * The unread data is moved to the start of the buffer once the free space at the end gets
+ * small. While a batch of PDUs is handed out (the buffer is pinned) the data must not move, so
+ * a new buffer is allocated instead and the pinned one is kept until the batch is released.
  */
-static SSIZE_T transport_read_layer_bytes(rdpTransport* transport, wStream* s, size_t toRead)
+static BOOL transport_read_ahead_reserve(rdpTransport* transport, size_t bytes)
 {
-	SSIZE_T status;
-	if (toRead > SSIZE_MAX)
-		return 0;
+	BYTE* buffer;
+	size_t capacity;
+	const size_t unread = transport->ReadAheadLength - transport->ReadAheadOffset;
+	const size_t wanted = MAX(bytes - unread, BUFFER_SIZE);
+	const BOOL pinned =
+	    transport->ReadAheadBuffer && (transport->ReadAheadBuffer == transport->ReadAheadPinned);
+
+	if (!pinned && (unread == 0))
+	{
+		transport->ReadAheadOffset = 0;
+		transport->ReadAheadLength = 0;
+	}
 
-	status = transport_read_layer(transport, Stream_Pointer(s), toRead);
+	if (transport->ReadAheadCapacity - transport->ReadAheadLength >= wanted)
+		return TRUE;
 
-	if (status <= 0)
-		return status;
+	capacity = MAX(transport->ReadAheadCapacity, READ_AHEAD_SIZE);
+
+	if (capacity < unread + wanted)
+		capacity = unread + wanted;
+
+	if (!pinned && (capacity == transport->ReadAheadCapacity))
+	{
+		MoveMemory(transport->ReadAheadBuffer,
+		           &transport->ReadAheadBuffer[transport->ReadAheadOffset], unread);
+	}
+	else
+	{
+		buffer = (BYTE*)malloc(capacity);
+
+		if (!buffer)
+			return FALSE;
+
+		if (unread > 0)
+			CopyMemory(buffer, &transport->ReadAheadBuffer[transport->ReadAheadOffset], unread);
+
+		if (pinned)
+			transport->ReadAheadRetired = transport->ReadAheadBuffer;
+		else
+			free(transport->ReadAheadBuffer);
+
+		transport->ReadAheadBuffer = buffer;
+		transport->ReadAheadCapacity = capacity;
+	}
 
-	Stream_Seek(s, (size_t)status);
-	return status == (SSIZE_T)toRead ? 1 : 0;
+	transport->ReadAheadOffset = 0;
+	transport->ReadAheadLength = unread;
+	return TRUE;
 }
 
 /**
- * @brief Try to read a complete PDU (NLA, fast-path or tpkt) from the underlying transport.
+ * @brief Makes sure at least bytes unread bytes are available in the read-ahead buffer
  *
- * If possible a complete PDU is read, in case of non blocking transport this might not succeed.
- * Except in case of an error the passed stream will point to the last byte read (correct
- * position). When the pdu read is completed the stream is sealed and the pointer set to 0
+ * If fill is set and the buffer holds less than bytes unread bytes the transport layer is read
+ * with all the free space of the buffer, otherwise only the buffered data is considered.
  *
- * @param[in] transport rdpTransport
- * @param[in] s wStream
- * @return < 0 on error; 0 if not enough data is available (non blocking mode); > 0 number of
- * bytes of the *complete* pdu read
+ * @return < 0 on error; 0 if not enough data is available (non blocking mode); 1 on success
  */
-int transport_read_pdu(rdpTransport* transport, wStream* s)
+static int transport_read_ahead(rdpTransport* transport, size_t bytes, BOOL fill)
 {
-	int status;
-	size_t position;
-	size_t pduLength;
-	BYTE* header;
-	pduLength = 0;
+	BYTE* data;
+	SSIZE_T status;
+	size_t unread = transport->ReadAheadLength - transport->ReadAheadOffset;
 
-	if (!transport)
-		return -1;
+	if (unread >= bytes)
+		return 1;
 
-	if (!s)
+	if (!fill)
+		return 0;
+
+	if (!transport_read_ahead_reserve(transport, bytes))
 		return -1;
 
-	position = Stream_GetPosition(s);
+	unread = transport->ReadAheadLength - transport->ReadAheadOffset;
+	data = &transport->ReadAheadBuffer[transport->ReadAheadLength];
+	status = transport_read_layer(transport, data, bytes - unread,
+	                              transport->ReadAheadCapacity - transport->ReadAheadLength);
 
-	/* Make sure there is enough space for the longest header within the stream */
-	if (!Stream_EnsureCapacity(s, 4))
+	if (status < 0)
 		return -1;
 
-	/* Make sure at least two bytes are read for further processing */
-	if (position < 2 && (status = transport_read_layer_bytes(transport, s, 2 - position)) != 1)
-	{
-		/* No data available at the moment */
-		return status;
-	}
-
-	/* update position value for further checks */
-	position = Stream_GetPosition(s);
-	header = Stream_Buffer(s);
+	transport->ReadAheadLength += (size_t)status;
+	return (transport->ReadAheadLength - transport->ReadAheadOffset >= bytes) ? 1 : 0;
+}
 
+/**
+ * @brief Parses the length of a PDU (NLA, fast-path or tpkt) from its header
+ *
+ * @param[in] transport rdpTransport
+ * @param[in] header start of the PDU
+ * @param[in] available number of header bytes available
+ * @param[out] pduLength length of the PDU or the number of header bytes required
+ * @return < 0 on error; 0 if more header bytes are required; 1 on success
+ */
+static int transport_parse_pdu_length(rdpTransport* transport, const BYTE* header,
+                                      size_t available, size_t* pduLength)
+{
 	if (transport->NlaMode)
 	{
 		/*
@@ -689,61 +756,64 @@ int transport_read_pdu(rdpTransport* transport, wStream* s)
 		 * bit 6 P/C constructed
 		 * bit 5 tag number - sequence
 		 */
-		if (header[0] == 0x30)
+		if (header[0] != 0x30)
 		{
-			/* TSRequest (NLA) */
-			if (header[1] & 0x80)
+			WLog_Print(transport->log, WLOG_ERROR, "Error reading TSRequest!");
+			return -1;
+		}
+
+		/* TSRequest (NLA) */
+		if (header[1] & 0x80)
+		{
+			if ((header[1] & ~(0x80)) == 1)
 			{
-				if ((header[1] & ~(0x80)) == 1)
-				{
-					/* check for header bytes already was readed in previous calls */
-					if (position < 3 &&
-					    (status = transport_read_layer_bytes(transport, s, 3 - position)) != 1)
-						return status;
+				*pduLength = 3;
 
-					pduLength = header[2];
-					pduLength += 3;
-				}
-				else if ((header[1] & ~(0x80)) == 2)
-				{
-					/* check for header bytes already was readed in previous calls */
-					if (position < 4 &&
-					    (status = transport_read_layer_bytes(transport, s, 4 - position)) != 1)
-						return status;
+				if (available < 3)
+					return 0;
 
-					pduLength = (header[2] << 8) | header[3];
-					pduLength += 4;
-				}
-				else
-				{
-					WLog_Print(transport->log, WLOG_ERROR, "Error reading TSRequest!");
-					return -1;
-				}
+				*pduLength = header[2];
+				*pduLength += 3;
+			}
+			else if ((header[1] & ~(0x80)) == 2)
+			{
+				*pduLength = 4;
+
+				if (available < 4)
+					return 0;
+
+				*pduLength = (header[2] << 8) | header[3];
+				*pduLength += 4;
 			}
 			else
 			{
-				pduLength = header[1];
-				pduLength += 2;
+				WLog_Print(transport->log, WLOG_ERROR, "Error reading TSRequest!");
+				return -1;
 			}
 		}
+		else
+		{
+			*pduLength = header[1];
+			*pduLength += 2;
+		}
 	}
 	else
 	{
 		if (header[0] == 0x03)
 		{
 			/* TPKT header */
-			/* check for header bytes already was readed in previous calls */
-			if (position < 4 &&
-			    (status = transport_read_layer_bytes(transport, s, 4 - position)) != 1)
-				return status;
+			*pduLength = 4;
 
-			pduLength = (header[2] << 8) | header[3];
+			if (available < 4)
+				return 0;
+
+			*pduLength = (header[2] << 8) | header[3];
 
 			/* min and max values according to ITU-T Rec. T.123 (01/2007) section 8 */
-			if (pduLength < 7 || pduLength > 0xFFFF)
+			if (*pduLength < 7 || *pduLength > 0xFFFF)
 			{
 				WLog_Print(transport->log, WLOG_ERROR, "tpkt - invalid pduLength: %" PRIdz,
-				           pduLength);
+				           *pduLength);
 				return -1;
 			}
 		}
@@ -752,80 +822,230 @@ int transport_read_pdu(rdpTransport* transport, wStream* s)
 			/* Fast-Path Header */
 			if (header[1] & 0x80)
 			{
-				/* check for header bytes already was readed in previous calls */
-				if (position < 3 &&
-				    (status = transport_read_layer_bytes(transport, s, 3 - position)) != 1)
-					return status;
+				*pduLength = 3;
+
+				if (available < 3)
+					return 0;
 
-				pduLength = ((header[1] & 0x7F) << 8) | header[2];
+				*pduLength = ((header[1] & 0x7F) << 8) | header[2];
 			}
 			else
-				pduLength = header[1];
+				*pduLength = header[1];
 
 			/*
 			 * fast-path has 7 bits for length so the maximum size, including headers is 0x8000
 			 * The theoretical minimum fast-path PDU consists only of two header bytes plus one
 			 * byte for data (e.g. fast-path input synchronize pdu)
 			 */
-			if (pduLength < 3 || pduLength > 0x8000)
+			if (*pduLength < 3 || *pduLength > 0x8000)
 			{
 				WLog_Print(transport->log, WLOG_ERROR, "fast path - invalid pduLength: %" PRIdz,
-				           pduLength);
+				           *pduLength);
 				return -1;
 			}
 		}
 	}
 
-	if (!Stream_EnsureCapacity(s, Stream_GetPosition(s) + pduLength))
+	return 1;
+}
+
+/**
+ * @brief Carves the next complete PDU out of the read-ahead buffer
+ *
+ * The stream is statically initialized to point into the read-ahead buffer, no data is copied.
+ * It stays valid until the buffer is read again, unless the buffer is pinned by a batch.
+ *
+ * @return < 0 on error; 0 if no complete PDU is available; > 0 length of the PDU
+ */
+static int transport_carve_pdu(rdpTransport* transport, wStream* s, BOOL fill)
+{
+	int status;
+	const BYTE* header;
+	size_t pduLength = 2;
+
+	/* Make sure at least two bytes are read for further processing */
+	do
+	{
+		if ((status = transport_read_ahead(transport, pduLength, fill)) != 1)
+			return status;
+
+		header = &transport->ReadAheadBuffer[transport->ReadAheadOffset];
+		status = transport_parse_pdu_length(transport, header, pduLength, &pduLength);
+
+		if (status < 0)
+			return status;
+	} while (status == 0);
+
+	if ((status = transport_read_ahead(transport, pduLength, fill)) != 1)
+		return status;
+
+	header = &transport->ReadAheadBuffer[transport->ReadAheadOffset];
+	WLog_Packet(transport->log, WLOG_TRACE, header, pduLength, WLOG_PACKET_INBOUND);
+	Stream_StaticInit(s, &transport->ReadAheadBuffer[transport->ReadAheadOffset], pduLength);
+	transport->ReadAheadOffset += pduLength;
+	return (int)pduLength;
+}
+
+/**
+ * @brief Try to read a complete PDU (NLA, fast-path or tpkt) from the underlying transport.
+ *
+ * If possible a complete PDU is read, in case of non blocking transport this might not succeed.
+ * Incomplete data is kept in the read-ahead buffer of the transport and the stream is left
+ * untouched. When the pdu read is completed it is copied to the start of the stream, the stream
+ * is sealed and the pointer set to 0
+ *
+ * @param[in] transport rdpTransport
+ * @param[in] s wStream
+ * @return < 0 on error; 0 if not enough data is available (non blocking mode); > 0 number of
+ * bytes of the *complete* pdu read
+ */
+int transport_read_pdu(rdpTransport* transport, wStream* s)
+{
+	int status;
+	wStream pdu;
+
+	if (!transport)
 		return -1;
 
-	status = transport_read_layer_bytes(transport, s, pduLength - Stream_GetPosition(s));
+	if (!s)
+		return -1;
+
+	/* reading past the end of a batch while PDUs of it are still to be processed would
+	 * hand out the PDUs out of order */
+	if (transport->ReadAheadPinned &&
+	    (transport->ReadAheadBatchNext != transport->ReadAheadBatchEnd))
+	{
+		WLog_Print(transport->log, WLOG_ERROR,
+		           "PDU read while %" PRIuz " bytes of the current batch are unprocessed",
+		           transport->ReadAheadBatchEnd - transport->ReadAheadBatchNext);
+		return -1;
+	}
 
-	if (status != 1)
+	if ((status = transport_carve_pdu(transport, &pdu, TRUE)) <= 0)
 		return status;
 
-	if (Stream_GetPosition(s) >= pduLength)
-		WLog_Packet(transport->log, WLOG_TRACE, Stream_Buffer(s), pduLength, WLOG_PACKET_INBOUND);
+	Stream_SetPosition(s, 0);
+
+	if (!Stream_EnsureCapacity(s, Stream_Length(&pdu)))
+		return -1;
 
+	Stream_Write(s, Stream_Buffer(&pdu), Stream_Length(&pdu));
 	Stream_SealLength(s);
 	Stream_SetPosition(s, 0);
-	return Stream_Length(s);
+	return status;
 }
 
-int transport_write(rdpTransport* transport, wStream* s)
+/**
+ * @brief Reads all complete PDUs available from the underlying transport
+ *
+ * The transport layer is read at most once, all complete PDUs then buffered (but no more than
+ * count) are returned as streams pointing into the read-ahead buffer. In NLA mode only a single
+ * PDU is returned as the receiver might leave NLA mode after processing it.
+ *
+ * The buffer is pinned until transport_release_pdu_batch is called, the streams are valid until
+ * then. A stream that grows while processing allocates its own buffer and must be freed with
+ * Stream_Free.
+ *
+ * @param[in] transport rdpTransport
+ * @param[out] pdus array of count streams
+ * @param[in] count number of streams available
+ * @return < 0 on error; 0 if no complete PDU is available (non blocking mode); > 0 number of
+ * PDUs returned
+ */
+int transport_read_pdu_batch(rdpTransport* transport, wStream* pdus, size_t count)
 {
-	size_t length;
-	int status = -1;
-	int writtenlength = 0;
-	rdpRdp* rdp = transport->context->rdp;
+	int status;
+	size_t index;
 
-	if (!s)
+	if (!transport || !pdus || (count == 0) || (count > INT_MAX))
 		return -1;
 
-	if (!transport)
-		goto fail;
+	if (transport->ReadAheadPinned)
+	{
+		WLog_Print(transport->log, WLOG_ERROR, "previous PDU batch was not released");
+		return -1;
+	}
 
-	if (!transport->frontBio)
+	if ((status = transport_carve_pdu(transport, &pdus[0], TRUE)) <= 0)
+		return status;
+
+	for (index = 1; (index < count) && !transport->NlaMode; index++)
 	{
-		transport->layer = TRANSPORT_LAYER_CLOSED;
-		freerdp_set_last_error_if_not(transport->context, FREERDP_ERROR_CONNECT_TRANSPORT_FAILED);
-		goto fail;
+		if ((status = transport_carve_pdu(transport, &pdus[index], FALSE)) < 0)
+			return status;
+
+		if (status == 0)
+			break;
 	}
 
-	EnterCriticalSection(&(transport->WriteLock));
-	length = Stream_GetPosition(s);
-	writtenlength = length;
-	Stream_SetPosition(s, 0);
+	transport->ReadAheadPinned = transport->ReadAheadBuffer;
+	transport->ReadAheadBatchEnd = transport->ReadAheadOffset;
+	transport->ReadAheadBatchNext = (size_t)(Stream_Buffer(&pdus[0]) - transport->ReadAheadBuffer);
+	return (int)index;
+}
 
-	if (length > 0)
+/**
+ * @brief Marks a PDU of the pinned batch as taken for processing
+ *
+ * PDUs of a batch must be processed in order. As long as not all of them were taken a nested
+ * transport_read_pdu fails instead of reading the PDUs following the batch.
+ */
+static void transport_take_batch_pdu(rdpTransport* transport, wStream* pdu)
+{
+	const BYTE* buffer = transport->ReadAheadPinned;
+
+	if (buffer)
+		transport->ReadAheadBatchNext = (size_t)(Stream_Buffer(pdu) - buffer) + Stream_Length(pdu);
+}
+
+/**
+ * @brief Releases a batch returned by transport_read_pdu_batch
+ *
+ * If unprocessed is not NULL that PDU and all following ones of the batch are returned to the
+ * read-ahead buffer and will be read again. This fails if the read-ahead buffer was read in
+ * the meantime.
+ */
+BOOL transport_release_pdu_batch(rdpTransport* transport, wStream* unprocessed)
+{
+	BOOL rc = TRUE;
+
+	if (!transport)
+		return FALSE;
+
+	if (unprocessed)
 	{
-		rdp->outBytes += length;
-		WLog_Packet(transport->log, WLOG_TRACE, Stream_Buffer(s), length, WLOG_PACKET_OUTBOUND);
+		const BYTE* buffer = transport->ReadAheadPinned;
+		const BYTE* pdu = Stream_Buffer(unprocessed);
+
+		if (!buffer || (buffer != transport->ReadAheadBuffer) ||
+		    (transport->ReadAheadOffset != transport->ReadAheadBatchEnd) || (pdu < buffer) ||
+		    (pdu > &buffer[transport->ReadAheadOffset]))
+		{
+			WLog_Print(transport->log, WLOG_ERROR, "unable to return PDUs to the receive buffer");
+			rc = FALSE;
+		}
+		else
+			transport->ReadAheadOffset = (size_t)(pdu - buffer);
 	}
 
+	free(transport->ReadAheadRetired);
+	transport->ReadAheadRetired = NULL;
+	transport->ReadAheadPinned = NULL;
+	return rc;
+}
+
+/**
+ * @brief Writes length bytes to the transport layer
+ *
+ * @return <= 0 on error; the status of the last BIO_write otherwise
+ */
+static int transport_write_layer(rdpTransport* transport, const BYTE* data, size_t length)
+{
+	int status = -1;
+
 	while (length > 0)
 	{
-		status = BIO_write(transport->frontBio, Stream_Pointer(s), length);
+		status = BIO_write(transport->frontBio, data, (int)MIN(length, INT_MAX));
 
 		if (status <= 0)
 		{
@@ -836,21 +1056,22 @@ int transport_write(rdpTransport* transport, wStream* s)
 			if (!BIO_should_retry(transport->frontBio))
 			{
 				WLog_ERR_BIO(transport, "BIO_should_retry", transport->frontBio);
-				goto out_cleanup;
+				return status;
 			}
 
-			/* non-blocking can live with blocked IOs */
-			if (!transport->blocking)
+			/* non-blocking can live with blocked IOs, except a partially sent TLS record:
+			 * with kernel TLS offload the SSL writes to the socket itself and SSL_write must
+			 * be repeated with the same data once the socket is writable again */
+			if (!transport->blocking && !BIO_should_write(transport->frontBio))
 			{
 				WLog_ERR_BIO(transport, "BIO_write", transport->frontBio);
-				goto out_cleanup;
+				return status;
 			}
 
 			if (BIO_wait_write(transport->frontBio, 100) < 0)
 			{
 				WLog_ERR_BIO(transport, "BIO_wait_write", transport->frontBio);
-				status = -1;
-				goto out_cleanup;
+				return -1;
 			}
 
 			continue;
@@ -863,24 +1084,89 @@ int transport_write(rdpTransport* transport, wStream* s)
 				if (BIO_wait_write(transport->frontBio, 100) < 0)
 				{
 					WLog_Print(transport->log, WLOG_ERROR, "error when selecting for write");
-					status = -1;
-					goto out_cleanup;
+					return -1;
 				}
 
 				if (BIO_flush(transport->frontBio) < 1)
 				{
 					WLog_Print(transport->log, WLOG_ERROR, "error when flushing outputBuffer");
-					status = -1;
-					goto out_cleanup;
+					return -1;
 				}
 			}
 		}
 
-		length -= status;
-		Stream_Seek(s, status);
+		length -= (size_t)status;
+		data += status;
 	}
 
-	transport->written += writtenlength;
+	return status;
+}
+
+/**
+ * @brief Writes the PDUs collected while the transport was corked in a single write
+ */
+static int transport_write_corked(rdpTransport* transport)
+{
+	int status;
+	const size_t length = Stream_GetPosition(transport->CorkBuffer);
+
+	if (length == 0)
+		return 1;
+
+	status = transport_write_layer(transport, Stream_Buffer(transport->CorkBuffer), length);
+	Stream_SetPosition(transport->CorkBuffer, 0);
+	return status;
+}
+
+int transport_write(rdpTransport* transport, wStream* s)
+{
+	size_t length;
+	int status = -1;
+	int writtenlength = 0;
+	rdpRdp* rdp = transport->context->rdp;
+
+	if (!s)
+		return -1;
+
+	if (!transport)
+		goto fail;
+
+	if (!transport->frontBio)
+	{
+		transport->layer = TRANSPORT_LAYER_CLOSED;
+		freerdp_set_last_error_if_not(transport->context, FREERDP_ERROR_CONNECT_TRANSPORT_FAILED);
+		goto fail;
+	}
+
+	EnterCriticalSection(&(transport->WriteLock));
+	length = Stream_GetPosition(s);
+	writtenlength = length;
+	Stream_SetPosition(s, 0);
+
+	if (length > 0)
+	{
+		rdp->outBytes += length;
+		WLog_Packet(transport->log, WLOG_TRACE, Stream_Buffer(s), length, WLOG_PACKET_OUTBOUND);
+	}
+
+	if (transport->CorkDepth > 0)
+	{
+		/* collect the PDU, it is sent with the others when the transport is uncorked */
+		if (!Stream_EnsureRemainingCapacity(transport->CorkBuffer, length))
+			goto out_cleanup;
+
+		Stream_Write(transport->CorkBuffer, Stream_Buffer(s), length);
+		status = (int)length;
+
+		if (Stream_GetPosition(transport->CorkBuffer) >= CORK_BUFFER_SIZE)
+			status = transport_write_corked(transport);
+	}
+	else
+		status = transport_write_layer(transport, Stream_Buffer(s), length);
+
+	if (status > 0)
+		transport->written += writtenlength;
+
 out_cleanup:
 
 	if (status < 0)
@@ -896,6 +1182,63 @@ fail:
 	return status;
 }
 
+/**
+ * @brief Starts collecting outgoing PDUs instead of writing them one by one
+ *
+ * Calls can be nested, the PDUs are written when the last transport_uncork is called or when
+ * enough data was collected. Uncorking writes everything in a single TLS record run / socket
+ * write, which saves the per PDU SSL_write and syscall overhead for bursts of small PDUs.
+ *
+ * The write lock is held until the matching transport_uncork, so only PDUs of the calling
+ * thread are collected. Other threads writing meanwhile wait and are sent after them.
+ */
+BOOL transport_cork(rdpTransport* transport)
+{
+	if (!transport)
+		return FALSE;
+
+	EnterCriticalSection(&(transport->WriteLock));
+	transport->CorkDepth++;
+	return TRUE;
+}
+
+BOOL transport_uncork(rdpTransport* transport)
+{
+	int status = 1;
+
+	if (!transport)
+		return FALSE;
+
+	EnterCriticalSection(&(transport->WriteLock));
+
+	if (transport->CorkDepth == 0)
+	{
+		WLog_Print(transport->log, WLOG_WARN, "transport_uncork: transport is not corked");
+		LeaveCriticalSection(&(transport->WriteLock));
+		return TRUE;
+	}
+
+	if (--transport->CorkDepth == 0)
+	{
+		if (transport->frontBio)
+			status = transport_write_corked(transport);
+		else
+			Stream_SetPosition(transport->CorkBuffer, 0);
+
+		if (status < 0)
+		{
+			transport->layer = TRANSPORT_LAYER_CLOSED;
+			freerdp_set_last_error_if_not(transport->context,
+			                              FREERDP_ERROR_CONNECT_TRANSPORT_FAILED);
+		}
+	}
+
+	/* once for this call and once for the matching transport_cork */
+	LeaveCriticalSection(&(transport->WriteLock));
+	LeaveCriticalSection(&(transport->WriteLock));
+	return status >= 0;
+}
+
 DWORD transport_get_event_handles(rdpTransport* transport, HANDLE* events, DWORD count)
 {
 	DWORD nCount = 1; /* always the reread Event */
@@ -1000,8 +1343,9 @@ int transport_drain_output_buffer(rdpTransport* transport)
 int transport_check_fds(rdpTransport* transport)
 {
 	int status;
-	int recv_status;
-	wStream* received;
+	int index;
+	int recv_status = 0;
+	wStream received[32];
 	UINT64 now = GetTickCount64();
 	UINT64 dueDate = 0;
 
@@ -1025,42 +1369,65 @@ int transport_check_fds(rdpTransport* transport)
 
 	while (now < dueDate)
 	{
+		BIO* frontBio = transport->frontBio;
+
 		if (freerdp_shall_disconnect(transport->context->instance))
 		{
 			return -1;
 		}
 
 		/**
-		 * Note: transport_read_pdu tries to read one PDU from
-		 * the transport layer.
-		 * The ReceiveBuffer might have a position > 0 in case of a non blocking
-		 * transport. If transport_read_pdu returns 0 the pdu couldn't be read at
-		 * this point.
-		 * Note that transport->ReceiveBuffer is replaced after each iteration
-		 * of this loop with a fresh stream instance from a pool.
+		 * Note: transport_read_pdu_batch reads the transport layer once and
+		 * returns all complete PDUs buffered. Incomplete data stays in the
+		 * read-ahead buffer of the transport until the next call.
 		 */
-		if ((status = transport_read_pdu(transport, transport->ReceiveBuffer)) <= 0)
+		if ((status = transport_read_pdu_batch(transport, received, ARRAYSIZE(received))) <= 0)
 		{
 			if (status < 0)
 				WLog_Print(transport->log, WLOG_DEBUG,
-				           "transport_check_fds: transport_read_pdu() - %i", status);
+				           "transport_check_fds: transport_read_pdu_batch() - %i", status);
 
 			return status;
 		}
 
-		received = transport->ReceiveBuffer;
+		for (index = 0; index < status; index++)
+		{
+			/**
+			 * status:
+			 * 	-1: error
+			 * 	 0: success
+			 * 	 1: redirection
+			 */
+			transport_take_batch_pdu(transport, &received[index]);
+			recv_status =
+			    transport->ReceiveCallback(transport, &received[index], transport->ReceiveExtra);
+			Stream_Free(&received[index], TRUE);
+
+			if ((recv_status < 0) || (recv_status == 1) || (recv_status == 2))
+				break;
 
-		if (!(transport->ReceiveBuffer = StreamPool_Take(transport->ReceivePool, 0)))
-			return -1;
+			now = GetTickCount64();
 
-		/**
-		 * status:
-		 * 	-1: error
-		 * 	 0: success
-		 * 	 1: redirection
-		 */
-		recv_status = transport->ReceiveCallback(transport, received, transport->ReceiveExtra);
-		Stream_Release(received);
+			if (now >= dueDate)
+				break;
+		}
+
+		if ((recv_status >= 0) && (index + 1 < status) && (transport->frontBio == frontBio))
+		{
+			/* the remaining PDUs are processed with the next call */
+			if (!transport_release_pdu_batch(transport, &received[index + 1]))
+			{
+				WLog_Print(transport->log, WLOG_ERROR,
+				           "transport_check_fds: receive buffer changed while processing");
+				transport_release_pdu_batch(transport, NULL);
+				return -1;
+			}
+
+			SetEvent(transport->rereadEvent);
+			transport->haveMoreBytesToRead = TRUE;
+		}
+		else
+			transport_release_pdu_batch(transport, NULL);
 
 		/* session redirection or activation */
 		if (recv_status == 1 || recv_status == 2)
@@ -1139,6 +1506,9 @@ BOOL transport_disconnect(rdpTransport* transport)
 
 	transport->frontBio = NULL;
 	transport->layer = TRANSPORT_LAYER_TCP;
+	/* drop unread data, PDUs of a pinned batch might still be in use */
+	transport->ReadAheadOffset = transport->ReadAheadLength;
+	Stream_SetPosition(transport->CorkBuffer, 0);
 	return status;
 }
 
@@ -1162,16 +1532,15 @@ rdpTransport* transport_new(rdpContext* context)
 	if (!transport->ReceivePool)
 		goto out_free_transport;
 
-	/* receive buffer for non-blocking read. */
-	transport->ReceiveBuffer = StreamPool_Take(transport->ReceivePool, 0);
+	transport->CorkBuffer = Stream_New(NULL, CORK_BUFFER_SIZE);
 
-	if (!transport->ReceiveBuffer)
+	if (!transport->CorkBuffer)
 		goto out_free_receivepool;
 
 	transport->connectedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
 
 	if (!transport->connectedEvent || transport->connectedEvent == INVALID_HANDLE_VALUE)
-		goto out_free_receivebuffer;
+		goto out_free_corkbuffer;
 
 	transport->rereadEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
 
@@ -1196,8 +1565,8 @@ out_free_rereadEvent:
 	CloseHandle(transport->rereadEvent);
 out_free_connectedEvent:
 	CloseHandle(transport->connectedEvent);
-out_free_receivebuffer:
-	StreamPool_Return(transport->ReceivePool, transport->ReceiveBuffer);
+out_free_corkbuffer:
+	Stream_Free(transport->CorkBuffer, TRUE);
 out_free_receivepool:
 	StreamPool_Free(transport->ReceivePool);
 out_free_transport:
@@ -1211,10 +1580,9 @@ void transport_free(rdpTransport* transport)
 		return;
 
 	transport_disconnect(transport);
-
-	if (transport->ReceiveBuffer)
-		Stream_Release(transport->ReceiveBuffer);
-
+	free(transport->ReadAheadRetired);
+	free(transport->ReadAheadBuffer);
+	Stream_Free(transport->CorkBuffer, TRUE);
 	nla_free(transport->nla);
 	StreamPool_Free(transport->ReceivePool);
 	CloseHandle(transport->connectedEvent);
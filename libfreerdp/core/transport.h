@@ -64,7 +64,6 @@ struct rdp_transport
 	rdpNla* nla;
 	rdpSettings* settings;
 	void* ReceiveExtra;
-	wStream* ReceiveBuffer;
 	TransportRecv ReceiveCallback;
 	wStreamPool* ReceivePool;
 	HANDLE connectedEvent;
@@ -76,6 +75,16 @@ struct rdp_transport
 	ULONG written;
 	HANDLE rereadEvent;
 	BOOL haveMoreBytesToRead;
+	BYTE* ReadAheadBuffer;
+	size_t ReadAheadCapacity;
+	size_t ReadAheadOffset;
+	size_t ReadAheadLength;
+	BYTE* ReadAheadPinned;
+	BYTE* ReadAheadRetired;
+	size_t ReadAheadBatchEnd;
+	size_t ReadAheadBatchNext;
+	DWORD CorkDepth;
+	wStream* CorkBuffer;
 	wLog* log;
 };
 
@@ -92,7 +101,12 @@ FREERDP_LOCAL BOOL transport_accept_tls(rdpTransport* transport);
 FREERDP_LOCAL BOOL transport_accept_nla(rdpTransport* transport);
 
 FREERDP_LOCAL int transport_read_pdu(rdpTransport* transport, wStream* s);
+FREERDP_LOCAL int transport_read_pdu_batch(rdpTransport* transport, wStream* pdus, size_t count);
+FREERDP_LOCAL BOOL transport_release_pdu_batch(rdpTransport* transport, wStream* unprocessed);
 FREERDP_LOCAL int transport_write(rdpTransport* transport, wStream* s);
+/* A corked transport holds its write lock, uncork from the thread that corked it */
+FREERDP_LOCAL BOOL transport_cork(rdpTransport* transport);
+FREERDP_LOCAL BOOL transport_uncork(rdpTransport* transport);
 
 FREERDP_LOCAL void transport_get_fds(rdpTransport* transport, void** rfds, int* rcount);
 FREERDP_LOCAL int transport_check_fds(rdpTransport* transport);
@@ -429,7 +429,9 @@ static long bio_rdp_tls_ctrl(BIO* bio, int cmd, long num, void* ptr)
 			break;
 
 		default:
-			status = BIO_ctrl(ssl_rbio, cmd, num, ptr);
+			/* with kernel TLS offload the SSL does not use the underlying BIO for I/O,
+			 * but that is still the one that knows how to wait for the socket */
+			status = BIO_ctrl(next_bio ? next_bio : ssl_rbio, cmd, num, ptr);
 			break;
 	}
 
@@ -643,6 +645,71 @@ out_free:
 	return NULL;
 }
 
+/**
+ * Kernel TLS (Linux kTLS) offload.
+ *
+ * OpenSSL only moves the record encryption into the kernel when it does the I/O on one of its
+ * own socket BIOs, as installing the keys uses BIO controls private to OpenSSL. So instead of the
+ * buffered socket BIO the SSL gets a plain socket BIO on the same descriptor, the buffered BIO
+ * chain stays below the TLS BIO for waiting and event handling.
+ * OpenSSL enables kTLS for each direction when the handshake completes if the kernel and the
+ * negotiated cipher support it, and silently keeps encrypting in user space otherwise.
+ * Writes are no longer queued by the buffered BIO, a full socket makes SSL_write fail with
+ * SSL_ERROR_WANT_WRITE and the transport repeats the write once the socket is writable.
+ */
+static BOOL tls_prepare_kernel_offload(rdpTls* tls, BIO* underlying)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+	int fd = -1;
+	BIO* socketBio;
+	BIO* next_bio = BIO_next(underlying);
+
+	/* only a direct TCP connection can be offloaded, not a gateway tunnel */
+	if ((BIO_method_type(underlying) != BIO_TYPE_BUFFERED) || !next_bio ||
+	    (BIO_method_type(next_bio) != BIO_TYPE_SIMPLE))
+	{
+		WLog_DBG(TAG, "kernel TLS offload is only available on TCP connections");
+		return FALSE;
+	}
+
+	/* the SSL writes to the socket directly, nothing may be left in the buffered BIO */
+	if ((BIO_flush(underlying) < 1) || (BIO_wpending(underlying) > 0))
+	{
+		WLog_WARN(TAG, "output pending, kernel TLS offload disabled");
+		return FALSE;
+	}
+
+	if ((BIO_get_fd(next_bio, &fd) < 0) || (fd < 0))
+		return FALSE;
+
+	socketBio = BIO_new_socket(fd, BIO_NOCLOSE);
+
+	if (!socketBio)
+		return FALSE;
+
+	SSL_set_bio(tls->ssl, socketBio, socketBio);
+	SSL_set_options(tls->ssl, SSL_OP_ENABLE_KTLS);
+	/* records read ahead by OpenSSL prevent switching the receive direction */
+	SSL_set_read_ahead(tls->ssl, 0);
+	return TRUE;
+#else
+	WLog_WARN(TAG, "kernel TLS offload is not supported by this OpenSSL build");
+	return FALSE;
+#endif
+}
+
+static void tls_log_kernel_offload(rdpTls* tls)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+	if (!(SSL_get_options(tls->ssl) & SSL_OP_ENABLE_KTLS))
+		return;
+
+	WLog_INFO(TAG, "kernel TLS offload: send %s, receive %s",
+	          BIO_get_ktls_send(SSL_get_wbio(tls->ssl)) ? "enabled" : "not available",
+	          BIO_get_ktls_recv(SSL_get_rbio(tls->ssl)) ? "enabled" : "not available");
+#endif
+}
+
 #if OPENSSL_VERSION_NUMBER >= 0x010000000L
 static BOOL tls_prepare(rdpTls* tls, BIO* underlying, const SSL_METHOD* method, int options,
                         BOOL clientMode)
@@ -690,6 +757,10 @@ static BOOL tls_prepare(rdpTls* tls, BIO* underlying, SSL_METHOD* method, int op
 
 	BIO_push(tls->bio, underlying);
 	tls->underlying = underlying;
+
+	if (settings->TlsKernelOffload && !tls->isGatewayTransport)
+		tls_prepare_kernel_offload(tls, underlying);
+
 	return TRUE;
 }
 
@@ -780,6 +851,7 @@ static int tls_do_handshake(rdpTls* tls, BOOL clientMode)
 #endif
 	} while (TRUE);
 
+	tls_log_kernel_offload(tls);
 	cert = tls_get_certificate(tls, clientMode);
 
 	if (!cert)
@@ -25,6 +25,10 @@
 
 #include "../core/update.h"
 
+#include <winpr/collections.h>
+#include <winpr/pool.h>
+#include <winpr/sysinfo.h>
+
 #include <freerdp/log.h>
 #include <freerdp/gdi/gfx.h>
 #include <freerdp/gdi/region.h>
@@ -75,6 +79,17 @@ static DWORD gfx_align_scanline(DWORD widthInBytes, DWORD alignment)
 	return scanline;
 }
 
+/* Surface commands decoded in parallel must have finished before the surfaces are touched otherwise */
+static void gdi_gfx_wait_pending(RdpgfxClientContext* context)
+{
+	rdpGdi* gdi = (rdpGdi*)context->custom;
+	const UINT rc = gdi_graphics_pipeline_flush(gdi);
+
+	if (rc != CHANNEL_RC_OK)
+		WLog_Print(gdi->log, WLOG_WARN, "pipelined SurfaceCommand failed with error %" PRIu32 "",
+		           rc);
+}
+
 /**
  * Function description
  *
@@ -94,6 +109,7 @@ static UINT gdi_ResetGraphics(RdpgfxClientContext* context,
 	rdpUpdate* update = gdi->context->update;
 	rdpSettings* settings = gdi->context->settings;
 	EnterCriticalSection(&context->mux);
+	gdi_gfx_wait_pending(context);
 	DesktopWidth = resetGraphics->width;
 	DesktopHeight = resetGraphics->height;
 
@@ -159,27 +175,58 @@ static UINT gdi_OutputUpdate(rdpGdi* gdi, gdiGfxSurface* surface)
 	if (!update_begin_paint(update))
 		goto fail;
 
-	for (i = 0; i < nbRects; i++)
+	/* Scaled surfaces that fit the primary are only rescaled where they changed, all of the
+	 * surface is the scaling source so there are no seams along the rectangle edges. */
+	if (((sx != 1.0) || (sy != 1.0)) &&
+	    (surfaceX + surface->outputTargetWidth <= (UINT32)gdi->width) &&
+	    (surfaceY + surface->outputTargetHeight <= (UINT32)gdi->height) &&
+	    AreColorFormatsEqualNoAlpha(surface->format, gdi->dstFormat) &&
+	    (GetBytesPerPixel(gdi->dstFormat) == 4))
 	{
-		const UINT32 nXSrc = rects[i].left;
-		const UINT32 nYSrc = rects[i].top;
-		const UINT32 nXDst = (UINT32)MIN(surfaceX + nXSrc * sx, gdi->width - 1);
-		const UINT32 nYDst = (UINT32)MIN(surfaceY + nYSrc * sy, gdi->height - 1);
-		const UINT32 swidth = rects[i].right - rects[i].left;
-		const UINT32 sheight = rects[i].bottom - rects[i].top;
-		const UINT32 dwidth = MIN((UINT32)(swidth * sx), (UINT32)gdi->width - nXDst);
-		const UINT32 dheight = MIN((UINT32)(sheight * sy), (UINT32)gdi->height - nYDst);
-
-		if (!freerdp_image_scale(gdi->primary_buffer, gdi->dstFormat, gdi->stride, nXDst, nYDst,
-		                         dwidth, dheight, surface->data, surface->format, surface->scanline,
-		                         nXSrc, nYSrc, swidth, sheight))
+		BYTE* pDstData = &gdi->primary_buffer[surfaceY * gdi->stride + surfaceX * 4];
+
+		for (i = 0; i < nbRects; i++)
 		{
-			rc = CHANNEL_RC_NULL_DATA;
-			goto fail;
+			RECTANGLE_16 rect = rects[i];
+
+			if (!freerdp_image_scale_rect(pDstData, gdi->dstFormat, gdi->stride,
+			                              surface->outputTargetWidth, surface->outputTargetHeight,
+			                              surface->data, surface->format, surface->scanline,
+			                              surface->mappedWidth, surface->mappedHeight, &rect))
+			{
+				rc = CHANNEL_RC_NULL_DATA;
+				goto fail;
+			}
+
+			gdi_InvalidateRegion(gdi->primary->hdc, (INT32)(surfaceX + rect.left),
+			                     (INT32)(surfaceY + rect.top), rect.right - rect.left,
+			                     rect.bottom - rect.top);
 		}
+	}
+	else
+	{
+		for (i = 0; i < nbRects; i++)
+		{
+			const UINT32 nXSrc = rects[i].left;
+			const UINT32 nYSrc = rects[i].top;
+			const UINT32 nXDst = (UINT32)MIN(surfaceX + nXSrc * sx, gdi->width - 1);
+			const UINT32 nYDst = (UINT32)MIN(surfaceY + nYSrc * sy, gdi->height - 1);
+			const UINT32 swidth = rects[i].right - rects[i].left;
+			const UINT32 sheight = rects[i].bottom - rects[i].top;
+			const UINT32 dwidth = MIN((UINT32)(swidth * sx), (UINT32)gdi->width - nXDst);
+			const UINT32 dheight = MIN((UINT32)(sheight * sy), (UINT32)gdi->height - nYDst);
+
+			if (!freerdp_image_scale(gdi->primary_buffer, gdi->dstFormat, gdi->stride, nXDst,
+			                         nYDst, dwidth, dheight, surface->data, surface->format,
+			                         surface->scanline, nXSrc, nYSrc, swidth, sheight))
+			{
+				rc = CHANNEL_RC_NULL_DATA;
+				goto fail;
+			}
 
-		gdi_InvalidateRegion(gdi->primary->hdc, (INT32)nXDst, (INT32)nYDst, (INT32)dwidth,
-		                     (INT32)dheight);
+			gdi_InvalidateRegion(gdi->primary->hdc, (INT32)nXDst, (INT32)nYDst, (INT32)dwidth,
+			                     (INT32)dheight);
+		}
 	}
 
 	rc = CHANNEL_RC_OK;
@@ -234,55 +281,91 @@ static UINT gdi_UpdateSurfaces(RdpgfxClientContext* context)
 }
 
 /**
- * Function description
+ * Frame level decode pipeline
  *
- * @return 0 on success, otherwise a Win32 error code
+ * Surface commands received between StartFrame and EndFrame are queued on
+ * lanes that are drained by a private thread pool. Commands on one lane
+ * are decoded in order, different lanes run concurrently.
+ * Uncompressed, alpha and H.264 with its per surface context get one
+ * lane per surface, as do planar, RemoteFX and progressive with lane
+ * local contexts. ClearCodec shares a single lane since its glyph and
+ * vbar caches are filled by commands of any surface and used by later
+ * ones, these have to be decoded in the order they were sent.
+ *
+ * Workers only write the surface pixel data, the invalid regions and the
+ * UpdateSurfaceArea callbacks are applied on the channel thread once the
+ * work is finished (gdi_graphics_pipeline_flush).
  */
-static UINT gdi_StartFrame(RdpgfxClientContext* context, const RDPGFX_START_FRAME_PDU* startFrame)
+typedef struct gdi_gfx_decode_lane gdiGfxDecodeLane;
+typedef struct gdi_gfx_decode_job gdiGfxDecodeJob;
+
+struct gdi_gfx_decode_job
 {
-	rdpGdi* gdi = (rdpGdi*)context->custom;
-	gdi->inGfxFrame = TRUE;
-	gdi->frameId = startFrame->frameId;
-	return CHANNEL_RC_OK;
-}
+	gdiGfxDecodeJob* next;
+	gdiGfxDecodeJob* laneNext;
+	gdiGfxDecodeLane* lane;
+	rdpGdi* gdi;
+	gdiGfxSurface* surface;
+	BITMAP_PLANAR_CONTEXT* planar;
+	RFX_CONTEXT* rfx;
+	PROGRESSIVE_CONTEXT* progressive;
+	UINT32 frameId;
+	RDPGFX_SURFACE_COMMAND cmd;
+	RDPGFX_AVC444_BITMAP_STREAM bitstream;
+	REGION16 invalidRegion;
+	UINT status;
+};
 
-/**
- * Function description
- *
- * @return 0 on success, otherwise a Win32 error code
- */
-static UINT gdi_EndFrame(RdpgfxClientContext* context, const RDPGFX_END_FRAME_PDU* endFrame)
+struct gdi_gfx_decode_lane
 {
-	UINT status = CHANNEL_RC_NOT_INITIALIZED;
-	rdpGdi* gdi = (rdpGdi*)context->custom;
-	IFCALLRET(context->UpdateSurfaces, status, context);
-	gdi->inGfxFrame = FALSE;
-	return status;
-}
+	gdiGfxDecoder* decoder;
+	UINT16 surfaceId;
+	PTP_WORK work;
+	BOOL running;
+	gdiGfxDecodeJob* head;
+	gdiGfxDecodeJob* tail;
+	BITMAP_PLANAR_CONTEXT* planar;
+	UINT32 planarWidth;
+	UINT32 planarHeight;
+	RFX_CONTEXT* rfx;
+	UINT32 rfxGeneration;
+	PROGRESSIVE_CONTEXT* progressive;
+};
+
+struct gdi_gfx_decoder
+{
+	PTP_POOL pool;
+	TP_CALLBACK_ENVIRON environment;
+	CRITICAL_SECTION lock;
+	HANDLE idle;
+	UINT32 pending;
+	gdiGfxDecodeLane* shared;
+	wArrayList* lanes;
+	gdiGfxDecodeJob* first;
+	gdiGfxDecodeJob* last;
+	wStream* rfxHeaders;
+	wStream* rfxMessageHeaders;
+	UINT32 rfxGeneration;
+};
 
 /**
  * Function description
  *
  * @return 0 on success, otherwise a Win32 error code
  */
-static UINT gdi_SurfaceCommand_Uncompressed(rdpGdi* gdi, RdpgfxClientContext* context,
-                                            const RDPGFX_SURFACE_COMMAND* cmd)
+static UINT gdi_SurfaceCommand_Uncompressed(rdpGdi* gdi, gdiGfxDecodeJob* job)
 {
-	UINT status = CHANNEL_RC_OK;
-	gdiGfxSurface* surface;
 	RECTANGLE_16 invalidRect;
-	surface = (gdiGfxSurface*)context->GetSurfaceData(context, cmd->surfaceId);
-
-	if (!surface)
-	{
-		WLog_ERR(TAG, "%s: unable to retrieve surfaceData for surfaceId=%" PRIu32 "", __FUNCTION__,
-		         cmd->surfaceId);
-		return ERROR_NOT_FOUND;
-	}
+	gdiGfxSurface* surface = job->surface;
+	const RDPGFX_SURFACE_COMMAND* cmd = &job->cmd;
+	WINPR_UNUSED(gdi);
 
 	if (!is_within_surface(surface, cmd))
 		return ERROR_INVALID_DATA;
 
+	if (cmd->length < 1ULL * cmd->width * cmd->height * GetBytesPerPixel(cmd->format))
+		return ERROR_INVALID_DATA;
+
 	if (!freerdp_image_copy(surface->data, surface->format, surface->scanline, cmd->left, cmd->top,
 	                        cmd->width, cmd->height, cmd->data, cmd->format, 0, 0, 0, NULL,
 	                        FREERDP_FLIP_NONE))
@@ -292,21 +375,8 @@ static UINT gdi_SurfaceCommand_Uncompressed(rdpGdi* gdi, RdpgfxClientContext* co
 	invalidRect.top = cmd->top;
 	invalidRect.right = cmd->right;
 	invalidRect.bottom = cmd->bottom;
-	region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion), &invalidRect);
-	status = IFCALLRESULT(CHANNEL_RC_OK, context->UpdateSurfaceArea, context, surface->surfaceId, 1,
-	                      &invalidRect);
-
-	if (status != CHANNEL_RC_OK)
-		goto fail;
-
-	if (!gdi->inGfxFrame)
-	{
-		status = CHANNEL_RC_NOT_INITIALIZED;
-		IFCALLRET(context->UpdateSurfaces, status, context);
-	}
-
-fail:
-	return status;
+	region16_union_rect(&job->invalidRegion, &job->invalidRegion, &invalidRect);
+	return CHANNEL_RC_OK;
 }
 
 /**
@@ -314,53 +384,23 @@ fail:
  *
  * @return 0 on success, otherwise a Win32 error code
  */
-static UINT gdi_SurfaceCommand_RemoteFX(rdpGdi* gdi, RdpgfxClientContext* context,
-                                        const RDPGFX_SURFACE_COMMAND* cmd)
+static UINT gdi_SurfaceCommand_RemoteFX(rdpGdi* gdi, gdiGfxDecodeJob* job)
 {
-	UINT status = ERROR_INTERNAL_ERROR;
-	gdiGfxSurface* surface;
-	REGION16 invalidRegion;
-	const RECTANGLE_16* rects;
-	UINT32 nrRects, x;
-	surface = (gdiGfxSurface*)context->GetSurfaceData(context, cmd->surfaceId);
-
-	if (!surface)
-	{
-		WLog_ERR(TAG, "%s: unable to retrieve surfaceData for surfaceId=%" PRIu32 "", __FUNCTION__,
-		         cmd->surfaceId);
-		return ERROR_NOT_FOUND;
-	}
+	gdiGfxSurface* surface = job->surface;
+	const RDPGFX_SURFACE_COMMAND* cmd = &job->cmd;
+	WINPR_UNUSED(gdi);
 
-	rfx_context_set_pixel_format(surface->codecs->rfx, cmd->format);
-	region16_init(&invalidRegion);
+	rfx_context_set_pixel_format(job->rfx, cmd->format);
 
-	if (!rfx_process_message(surface->codecs->rfx, cmd->data, cmd->length, cmd->left, cmd->top,
+	if (!rfx_process_message(job->rfx, cmd->data, cmd->length, cmd->left, cmd->top,
 	                         surface->data, surface->format, surface->scanline, surface->height,
-	                         &invalidRegion))
+	                         &job->invalidRegion))
 	{
 		WLog_ERR(TAG, "Failed to process RemoteFX message");
-		goto fail;
-	}
-
-	rects = region16_rects(&invalidRegion, &nrRects);
-	status = IFCALLRESULT(CHANNEL_RC_OK, context->UpdateSurfaceArea, context, surface->surfaceId,
-	                      nrRects, rects);
-
-	if (status != CHANNEL_RC_OK)
-		goto fail;
-
-	for (x = 0; x < nrRects; x++)
-		region16_union_rect(&surface->invalidRegion, &surface->invalidRegion, &rects[x]);
-
-	if (!gdi->inGfxFrame)
-	{
-		status = CHANNEL_RC_NOT_INITIALIZED;
-		IFCALLRET(context->UpdateSurfaces, status, context);
+		return ERROR_INTERNAL_ERROR;
 	}
 
-fail:
-	region16_uninit(&invalidRegion);
-	return status;
+	return CHANNEL_RC_OK;
 }
 
 /**
@@ -368,22 +408,12 @@ fail:
  *
  * @return 0 on success, otherwise a Win32 error code
  */
-static UINT gdi_SurfaceCommand_ClearCodec(rdpGdi* gdi, RdpgfxClientContext* context,
-                                          const RDPGFX_SURFACE_COMMAND* cmd)
+static UINT gdi_SurfaceCommand_ClearCodec(rdpGdi* gdi, gdiGfxDecodeJob* job)
 {
 	INT32 rc;
-	UINT status = CHANNEL_RC_OK;
-	gdiGfxSurface* surface;
 	RECTANGLE_16 invalidRect;
-	surface = (gdiGfxSurface*)context->GetSurfaceData(context, cmd->surfaceId);
-
-	if (!surface)
-	{
-		WLog_ERR(TAG, "%s: unable to retrieve surfaceData for surfaceId=%" PRIu32 "", __FUNCTION__,
-		         cmd->surfaceId);
-		return ERROR_NOT_FOUND;
-	}
-
+	gdiGfxSurface* surface = job->surface;
+	const RDPGFX_SURFACE_COMMAND* cmd = &job->cmd;
 	rc = clear_decompress(surface->codecs->clear, cmd->data, cmd->length, cmd->width, cmd->height,
 	                      surface->data, surface->format, surface->scanline, cmd->left, cmd->top,
 	                      surface->width, surface->height, &gdi->palette);
@@ -398,21 +428,8 @@ static UINT gdi_SurfaceCommand_ClearCodec(rdpGdi* gdi, RdpgfxClientContext* cont
 	invalidRect.top = cmd->top;
 	invalidRect.right = cmd->right;
 	invalidRect.bottom = cmd->bottom;
-	region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion), &invalidRect);
-	status = IFCALLRESULT(CHANNEL_RC_OK, context->UpdateSurfaceArea, context, surface->surfaceId, 1,
-	                      &invalidRect);
-
-	if (status != CHANNEL_RC_OK)
-		goto fail;
-
-	if (!gdi->inGfxFrame)
-	{
-		status = CHANNEL_RC_NOT_INITIALIZED;
-		IFCALLRET(context->UpdateSurfaces, status, context);
-	}
-
-fail:
-	return status;
+	region16_union_rect(&job->invalidRegion, &job->invalidRegion, &invalidRect);
+	return CHANNEL_RC_OK;
 }
 
 /**
@@ -420,29 +437,18 @@ fail:
  *
  * @return 0 on success, otherwise a Win32 error code
  */
-static UINT gdi_SurfaceCommand_Planar(rdpGdi* gdi, RdpgfxClientContext* context,
-                                      const RDPGFX_SURFACE_COMMAND* cmd)
+static UINT gdi_SurfaceCommand_Planar(rdpGdi* gdi, gdiGfxDecodeJob* job)
 {
-	UINT status = CHANNEL_RC_OK;
-	BYTE* DstData = NULL;
-	gdiGfxSurface* surface;
 	RECTANGLE_16 invalidRect;
-	surface = (gdiGfxSurface*)context->GetSurfaceData(context, cmd->surfaceId);
-
-	if (!surface)
-	{
-		WLog_ERR(TAG, "%s: unable to retrieve surfaceData for surfaceId=%" PRIu32 "", __FUNCTION__,
-		         cmd->surfaceId);
-		return ERROR_NOT_FOUND;
-	}
-
-	DstData = surface->data;
+	gdiGfxSurface* surface = job->surface;
+	const RDPGFX_SURFACE_COMMAND* cmd = &job->cmd;
+	WINPR_UNUSED(gdi);
 
 	if (!is_within_surface(surface, cmd))
 		return ERROR_INVALID_DATA;
 
-	if (!planar_decompress(surface->codecs->planar, cmd->data, cmd->length, cmd->width, cmd->height,
-	                       DstData, surface->format, surface->scanline, cmd->left, cmd->top,
+	if (!planar_decompress(job->planar, cmd->data, cmd->length, cmd->width, cmd->height,
+	                       surface->data, surface->format, surface->scanline, cmd->left, cmd->top,
 	                       cmd->width, cmd->height, FALSE))
 		return ERROR_INTERNAL_ERROR;
 
@@ -450,64 +456,59 @@ static UINT gdi_SurfaceCommand_Planar(rdpGdi* gdi, RdpgfxClientContext* context,
 	invalidRect.top = cmd->top;
 	invalidRect.right = cmd->right;
 	invalidRect.bottom = cmd->bottom;
-	region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion), &invalidRect);
-	status = IFCALLRESULT(CHANNEL_RC_OK, context->UpdateSurfaceArea, context, surface->surfaceId, 1,
-	                      &invalidRect);
-
-	if (status != CHANNEL_RC_OK)
-		goto fail;
+	region16_union_rect(&job->invalidRegion, &job->invalidRegion, &invalidRect);
+	return CHANNEL_RC_OK;
+}
 
-	if (!gdi->inGfxFrame)
+#ifdef WITH_GFX_H264
+static UINT gdi_SurfaceCommand_PrepareH264(gdiGfxSurface* surface)
+{
+	if (!surface->h264)
 	{
-		status = CHANNEL_RC_NOT_INITIALIZED;
-		IFCALLRET(context->UpdateSurfaces, status, context);
+		surface->h264 = h264_context_new(FALSE);
+
+		if (!surface->h264)
+		{
+			WLog_ERR(TAG, "%s: unable to create h264 context", __FUNCTION__);
+			return ERROR_NOT_ENOUGH_MEMORY;
+		}
+
+		if (!h264_context_reset(surface->h264, surface->width, surface->height))
+			return ERROR_INTERNAL_ERROR;
 	}
 
-fail:
-	return status;
+	return CHANNEL_RC_OK;
+}
+
+static void gdi_SurfaceCommand_AddMetaRects(gdiGfxDecodeJob* job, const RDPGFX_H264_METABLOCK* meta)
+{
+	UINT32 i;
+
+	for (i = 0; i < meta->numRegionRects; i++)
+		region16_union_rect(&job->invalidRegion, &job->invalidRegion, &meta->regionRects[i]);
 }
+#endif
 
 /**
  * Function description
  *
  * @return 0 on success, otherwise a Win32 error code
  */
-static UINT gdi_SurfaceCommand_AVC420(rdpGdi* gdi, RdpgfxClientContext* context,
-                                      const RDPGFX_SURFACE_COMMAND* cmd)
+static UINT gdi_SurfaceCommand_AVC420(rdpGdi* gdi, gdiGfxDecodeJob* job)
 {
 #ifdef WITH_GFX_H264
 	INT32 rc;
-	UINT status = CHANNEL_RC_OK;
-	UINT32 i;
-	gdiGfxSurface* surface;
+	UINT status;
 	RDPGFX_H264_METABLOCK* meta;
 	RDPGFX_AVC420_BITMAP_STREAM* bs;
+	gdiGfxSurface* surface = job->surface;
+	const RDPGFX_SURFACE_COMMAND* cmd = &job->cmd;
+	WINPR_UNUSED(gdi);
 
-	surface = (gdiGfxSurface*)context->GetSurfaceData(context, cmd->surfaceId);
-
-	if (!surface)
-	{
-		WLog_ERR(TAG, "%s: unable to retrieve surfaceData for surfaceId=%" PRIu32 "", __FUNCTION__,
-		         cmd->surfaceId);
-		return ERROR_NOT_FOUND;
-	}
-
-	if (!surface->h264)
-	{
-		surface->h264 = h264_context_new(FALSE);
-
-		if (!surface->h264)
-		{
-			WLog_ERR(TAG, "%s: unable to create h264 context", __FUNCTION__);
-			return ERROR_NOT_ENOUGH_MEMORY;
-		}
-
-		if (!h264_context_reset(surface->h264, surface->width, surface->height))
-			return ERROR_INTERNAL_ERROR;
-	}
+	status = gdi_SurfaceCommand_PrepareH264(surface);
 
-	if (!surface->h264)
-		return ERROR_NOT_SUPPORTED;
+	if (status != CHANNEL_RC_OK)
+		return status;
 
 	bs = (RDPGFX_AVC420_BITMAP_STREAM*)cmd->extra;
 
@@ -525,26 +526,8 @@ static UINT gdi_SurfaceCommand_AVC420(rdpGdi* gdi, RdpgfxClientContext* context,
 		return CHANNEL_RC_OK;
 	}
 
-	for (i = 0; i < meta->numRegionRects; i++)
-	{
-		region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion),
-		                    (RECTANGLE_16*)&(meta->regionRects[i]));
-	}
-
-	status = IFCALLRESULT(CHANNEL_RC_OK, context->UpdateSurfaceArea, context, surface->surfaceId,
-	                      meta->numRegionRects, meta->regionRects);
-
-	if (status != CHANNEL_RC_OK)
-		goto fail;
-
-	if (!gdi->inGfxFrame)
-	{
-		status = CHANNEL_RC_NOT_INITIALIZED;
-		IFCALLRET(context->UpdateSurfaces, status, context);
-	}
-
-fail:
-	return status;
+	gdi_SurfaceCommand_AddMetaRects(job, meta);
+	return CHANNEL_RC_OK;
 #else
 	return ERROR_NOT_SUPPORTED;
 #endif
@@ -555,44 +538,24 @@ fail:
  *
  * @return 0 on success, otherwise a Win32 error code
  */
-static UINT gdi_SurfaceCommand_AVC444(rdpGdi* gdi, RdpgfxClientContext* context,
-                                      const RDPGFX_SURFACE_COMMAND* cmd)
+static UINT gdi_SurfaceCommand_AVC444(rdpGdi* gdi, gdiGfxDecodeJob* job)
 {
 #ifdef WITH_GFX_H264
 	INT32 rc;
-	UINT status = CHANNEL_RC_OK;
-	UINT32 i;
-	gdiGfxSurface* surface;
+	UINT status;
 	RDPGFX_AVC444_BITMAP_STREAM* bs;
 	RDPGFX_AVC420_BITMAP_STREAM* avc1;
 	RDPGFX_H264_METABLOCK* meta1;
 	RDPGFX_AVC420_BITMAP_STREAM* avc2;
 	RDPGFX_H264_METABLOCK* meta2;
-	surface = (gdiGfxSurface*)context->GetSurfaceData(context, cmd->surfaceId);
-
-	if (!surface)
-	{
-		WLog_ERR(TAG, "%s: unable to retrieve surfaceData for surfaceId=%" PRIu32 "", __FUNCTION__,
-		         cmd->surfaceId);
-		return ERROR_NOT_FOUND;
-	}
-
-	if (!surface->h264)
-	{
-		surface->h264 = h264_context_new(FALSE);
-
-		if (!surface->h264)
-		{
-			WLog_ERR(TAG, "%s: unable to create h264 context", __FUNCTION__);
-			return ERROR_NOT_ENOUGH_MEMORY;
-		}
+	gdiGfxSurface* surface = job->surface;
+	const RDPGFX_SURFACE_COMMAND* cmd = &job->cmd;
+	WINPR_UNUSED(gdi);
 
-		if (!h264_context_reset(surface->h264, surface->width, surface->height))
-			return ERROR_INTERNAL_ERROR;
-	}
+	status = gdi_SurfaceCommand_PrepareH264(surface);
 
-	if (!surface->h264)
-		return ERROR_NOT_SUPPORTED;
+	if (status != CHANNEL_RC_OK)
+		return status;
 
 	bs = (RDPGFX_AVC444_BITMAP_STREAM*)cmd->extra;
 
@@ -610,47 +573,17 @@ static UINT gdi_SurfaceCommand_AVC444(rdpGdi* gdi, RdpgfxClientContext* context,
 
 	if (rc < 0)
 	{
-		WLog_WARN(TAG, "avc444_decompress failure: %" PRIu32 ", ignoring update.", status);
+		WLog_WARN(TAG, "avc444_decompress failure: %" PRId32 ", ignoring update.", rc);
 		return CHANNEL_RC_OK;
 	}
 
-	for (i = 0; i < meta1->numRegionRects; i++)
-	{
-		region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion),
-		                    &(meta1->regionRects[i]));
-	}
-
-	status = IFCALLRESULT(CHANNEL_RC_OK, context->UpdateSurfaceArea, context, surface->surfaceId,
-	                      meta1->numRegionRects, meta1->regionRects);
-
-	if (status != CHANNEL_RC_OK)
-		goto fail;
-
-	for (i = 0; i < meta2->numRegionRects; i++)
-	{
-		region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion),
-		                    &(meta2->regionRects[i]));
-	}
-
-	status = IFCALLRESULT(CHANNEL_RC_OK, context->UpdateSurfaceArea, context, surface->surfaceId,
-	                      meta2->numRegionRects, meta2->regionRects);
-
-	if (status != CHANNEL_RC_OK)
-		goto fail;
-
-	if (!gdi->inGfxFrame)
-	{
-		status = CHANNEL_RC_NOT_INITIALIZED;
-		IFCALLRET(context->UpdateSurfaces, status, context);
-	}
-
-fail:
-	return status;
+	gdi_SurfaceCommand_AddMetaRects(job, meta1);
+	gdi_SurfaceCommand_AddMetaRects(job, meta2);
+	return CHANNEL_RC_OK;
 #else
 	return ERROR_NOT_SUPPORTED;
 #endif
 }
-
 static BOOL gdi_apply_alpha(BYTE* data, UINT32 format, UINT32 stride, RECTANGLE_16* rect,
                             UINT32 startOffsetX, UINT32 count, BYTE a)
 {
@@ -684,210 +617,840 @@ static BOOL gdi_apply_alpha(BYTE* data, UINT32 format, UINT32 stride, RECTANGLE_
 		first = FALSE;
 	}
 
-	return TRUE;
+	return TRUE;
+}
+/**
+ * Function description
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT gdi_SurfaceCommand_Alpha(rdpGdi* gdi, gdiGfxDecodeJob* job)
+{
+	UINT16 alphaSig, compressed;
+	RECTANGLE_16 invalidRect;
+	wStream s;
+	gdiGfxSurface* surface = job->surface;
+	const RDPGFX_SURFACE_COMMAND* cmd = &job->cmd;
+	WINPR_UNUSED(gdi);
+	Stream_StaticInit(&s, cmd->data, cmd->length);
+
+	if (Stream_GetRemainingLength(&s) < 4)
+		return ERROR_INVALID_DATA;
+
+	if (!is_within_surface(surface, cmd))
+		return ERROR_INVALID_DATA;
+
+	Stream_Read_UINT16(&s, alphaSig);
+	Stream_Read_UINT16(&s, compressed);
+
+	if (alphaSig != 0x414C)
+		return ERROR_INVALID_DATA;
+
+	if (compressed == 0)
+	{
+		UINT32 x, y;
+
+		if (Stream_GetRemainingLength(&s) < cmd->height * cmd->width * 1ULL)
+			return ERROR_INVALID_DATA;
+
+		for (y = cmd->top; y < cmd->top + cmd->height; y++)
+		{
+			BYTE* line = &surface->data[surface->scanline * y];
+
+			for (x = cmd->left; x < cmd->left + cmd->width; x++)
+			{
+				UINT32 color;
+				BYTE r, g, b, a;
+				BYTE* src = &line[x * GetBytesPerPixel(surface->format)];
+				Stream_Read_UINT8(&s, a);
+				color = ReadColor(src, surface->format);
+				SplitColor(color, surface->format, &r, &g, &b, NULL, NULL);
+				color = FreeRDPGetColor(surface->format, r, g, b, a);
+				WriteColor(src, surface->format, color);
+			}
+		}
+	}
+	else
+	{
+		UINT32 startOffsetX = 0;
+		RECTANGLE_16 rect;
+		rect.left = cmd->left;
+		rect.top = cmd->top;
+		rect.right = cmd->left + cmd->width;
+		rect.bottom = cmd->top + cmd->height;
+
+		while (rect.top < rect.bottom)
+		{
+			UINT32 count;
+			BYTE a;
+
+			if (Stream_GetRemainingLength(&s) < 2)
+				return ERROR_INVALID_DATA;
+
+			Stream_Read_UINT8(&s, a);
+			Stream_Read_UINT8(&s, count);
+
+			if (count >= 0xFF)
+			{
+				if (Stream_GetRemainingLength(&s) < 2)
+					return ERROR_INVALID_DATA;
+
+				Stream_Read_UINT16(&s, count);
+
+				if (count >= 0xFFFF)
+				{
+					if (Stream_GetRemainingLength(&s) < 4)
+						return ERROR_INVALID_DATA;
+
+					Stream_Read_UINT32(&s, count);
+				}
+			}
+
+			if (!gdi_apply_alpha(surface->data, surface->format, surface->scanline, &rect,
+			                     startOffsetX, count, a))
+				return ERROR_INTERNAL_ERROR;
+
+			startOffsetX += count;
+
+			while (startOffsetX >= cmd->width)
+			{
+				startOffsetX -= cmd->width;
+				rect.top++;
+			}
+		}
+	}
+
+	invalidRect.left = cmd->left;
+	invalidRect.top = cmd->top;
+	invalidRect.right = cmd->right;
+	invalidRect.bottom = cmd->bottom;
+	region16_union_rect(&job->invalidRegion, &job->invalidRegion, &invalidRect);
+	return CHANNEL_RC_OK;
+}
+
+/**
+ * Function description
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT gdi_SurfaceCommand_Progressive(rdpGdi* gdi, gdiGfxDecodeJob* job)
+{
+	INT32 rc;
+	gdiGfxSurface* surface = job->surface;
+	const RDPGFX_SURFACE_COMMAND* cmd = &job->cmd;
+	WINPR_UNUSED(gdi);
+
+	/**
+	 * Note: Since this comes via a Wire-To-Surface-2 PDU the
+	 * cmd's top/left/right/bottom/width/height members are always zero!
+	 * The update region is determined during decompression.
+	 */
+	if (!is_within_surface(surface, cmd))
+		return ERROR_INVALID_DATA;
+
+	rc = progressive_create_surface_context(job->progressive, cmd->surfaceId,
+	                                        surface->width, surface->height);
+
+	if (rc < 0)
+	{
+		WLog_ERR(TAG, "progressive_create_surface_context failure: %" PRId32 "", rc);
+		return ERROR_INTERNAL_ERROR;
+	}
+
+	rc = progressive_decompress_ex(job->progressive, cmd->data, cmd->length,
+	                               surface->data, surface->format, surface->scanline, cmd->left,
+	                               cmd->top, &job->invalidRegion, cmd->surfaceId, job->frameId);
+
+	if (rc < 0)
+	{
+		WLog_ERR(TAG, "progressive_decompress_ex failure: %" PRId32 "", rc);
+		return ERROR_INTERNAL_ERROR;
+	}
+
+	return CHANNEL_RC_OK;
+}
+
+/**
+ * Decodes a surface command into its target surface and collects the
+ * updated area in job->invalidRegion.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT gdi_SurfaceCommand_Decode(rdpGdi* gdi, gdiGfxDecodeJob* job)
+{
+	switch (job->cmd.codecId)
+	{
+		case RDPGFX_CODECID_UNCOMPRESSED:
+			return gdi_SurfaceCommand_Uncompressed(gdi, job);
+
+		case RDPGFX_CODECID_CAVIDEO:
+			return gdi_SurfaceCommand_RemoteFX(gdi, job);
+
+		case RDPGFX_CODECID_CLEARCODEC:
+			return gdi_SurfaceCommand_ClearCodec(gdi, job);
+
+		case RDPGFX_CODECID_PLANAR:
+			return gdi_SurfaceCommand_Planar(gdi, job);
+
+		case RDPGFX_CODECID_AVC420:
+			return gdi_SurfaceCommand_AVC420(gdi, job);
+
+		case RDPGFX_CODECID_AVC444v2:
+		case RDPGFX_CODECID_AVC444:
+			return gdi_SurfaceCommand_AVC444(gdi, job);
+
+		case RDPGFX_CODECID_ALPHA:
+			return gdi_SurfaceCommand_Alpha(gdi, job);
+
+		case RDPGFX_CODECID_CAPROGRESSIVE:
+			return gdi_SurfaceCommand_Progressive(gdi, job);
+
+		default:
+			return ERROR_NOT_SUPPORTED;
+	}
+}
+
+/**
+ * Applies the area updated by a decoded surface command to the surface.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT gdi_SurfaceCommand_Update(rdpGdi* gdi, RdpgfxClientContext* context,
+                                      gdiGfxDecodeJob* job)
+{
+	UINT32 nrRects, x;
+	UINT status = CHANNEL_RC_OK;
+	gdiGfxSurface* surface = job->surface;
+	const RECTANGLE_16* rects = region16_rects(&job->invalidRegion, &nrRects);
+
+	for (x = 0; x < nrRects; x++)
+		region16_union_rect(&surface->invalidRegion, &surface->invalidRegion, &rects[x]);
+
+	if (nrRects > 0)
+		status = IFCALLRESULT(CHANNEL_RC_OK, context->UpdateSurfaceArea, context,
+		                      surface->surfaceId, nrRects, rects);
+
+	if (status != CHANNEL_RC_OK)
+		return status;
+
+	if (!gdi->inGfxFrame)
+	{
+		status = CHANNEL_RC_NOT_INITIALIZED;
+		IFCALLRET(context->UpdateSurfaces, status, context);
+	}
+
+	return status;
+}
+
+static BOOL gdi_gfx_copy_bitstream(const RDPGFX_SURFACE_COMMAND* cmd, BYTE* data,
+                                   const RDPGFX_AVC420_BITMAP_STREAM* src,
+                                   RDPGFX_AVC420_BITMAP_STREAM* dst)
+{
+	const UINT32 count = src->meta.numRegionRects;
+
+	/* The bitstreams point into the command data which is copied alongside */
+	dst->length = src->length;
+
+	if (src->length > 0)
+	{
+		if ((src->data < cmd->data) || (src->data + src->length > cmd->data + cmd->length))
+			return FALSE;
+
+		dst->data = &data[src->data - cmd->data];
+	}
+
+	if (count > 0)
+	{
+		dst->meta.regionRects = (RECTANGLE_16*)calloc(count, sizeof(RECTANGLE_16));
+
+		if (!dst->meta.regionRects)
+			return FALSE;
+
+		CopyMemory(dst->meta.regionRects, src->meta.regionRects, count * sizeof(RECTANGLE_16));
+
+		if (src->meta.quantQualityVals)
+		{
+			dst->meta.quantQualityVals =
+			    (RDPGFX_H264_QUANT_QUALITY*)calloc(count, sizeof(RDPGFX_H264_QUANT_QUALITY));
+
+			if (!dst->meta.quantQualityVals)
+				return FALSE;
+
+			CopyMemory(dst->meta.quantQualityVals, src->meta.quantQualityVals,
+			           count * sizeof(RDPGFX_H264_QUANT_QUALITY));
+		}
+	}
+
+	dst->meta.numRegionRects = count;
+	return TRUE;
+}
+
+static void gdi_gfx_decode_job_free(gdiGfxDecodeJob* job)
+{
+	size_t x;
+
+	if (!job)
+		return;
+
+	for (x = 0; x < ARRAYSIZE(job->bitstream.bitstream); x++)
+	{
+		free(job->bitstream.bitstream[x].meta.regionRects);
+		free(job->bitstream.bitstream[x].meta.quantQualityVals);
+	}
+
+	region16_uninit(&job->invalidRegion);
+	free(job);
+}
+
+static gdiGfxDecodeJob* gdi_gfx_decode_job_new(rdpGdi* gdi, gdiGfxDecodeLane* lane,
+                                               gdiGfxSurface* surface,
+                                               const RDPGFX_SURFACE_COMMAND* cmd)
+{
+	BYTE* data;
+	gdiGfxDecodeJob* job;
+
+	/* The channel releases the PDU once SurfaceCommand returns, keep a private copy */
+	job = (gdiGfxDecodeJob*)calloc(1, sizeof(gdiGfxDecodeJob) + cmd->length);
+
+	if (!job)
+		return NULL;
+
+	data = (BYTE*)&job[1];
+	CopyMemory(data, cmd->data, cmd->length);
+	region16_init(&job->invalidRegion);
+	job->lane = lane;
+	job->gdi = gdi;
+	job->surface = surface;
+	job->planar = lane->planar;
+	job->rfx = lane->rfx;
+	job->progressive = lane->progressive;
+	job->frameId = gdi->frameId;
+	job->cmd = *cmd;
+	job->cmd.data = data;
+
+	switch (cmd->codecId)
+	{
+		case RDPGFX_CODECID_AVC420:
+			if (!cmd->extra || !gdi_gfx_copy_bitstream(cmd, data, cmd->extra,
+			                                           &job->bitstream.bitstream[0]))
+				goto fail;
+
+			job->cmd.extra = &job->bitstream.bitstream[0];
+			break;
+
+		case RDPGFX_CODECID_AVC444v2:
+		case RDPGFX_CODECID_AVC444:
+		{
+			const RDPGFX_AVC444_BITMAP_STREAM* bs = (const RDPGFX_AVC444_BITMAP_STREAM*)cmd->extra;
+
+			if (!bs)
+				goto fail;
+
+			job->bitstream.cbAvc420EncodedBitstream1 = bs->cbAvc420EncodedBitstream1;
+			job->bitstream.LC = bs->LC;
+
+			if (!gdi_gfx_copy_bitstream(cmd, data, &bs->bitstream[0],
+			                            &job->bitstream.bitstream[0]) ||
+			    !gdi_gfx_copy_bitstream(cmd, data, &bs->bitstream[1],
+			                            &job->bitstream.bitstream[1]))
+				goto fail;
+
+			job->cmd.extra = &job->bitstream;
+		}
+		break;
+
+		default:
+			job->cmd.extra = NULL;
+			break;
+	}
+
+	return job;
+fail:
+	gdi_gfx_decode_job_free(job);
+	return NULL;
+}
+
+static void CALLBACK gdi_gfx_decode_work_callback(PTP_CALLBACK_INSTANCE instance, void* context,
+                                                  PTP_WORK work)
+{
+	gdiGfxDecodeLane* lane = (gdiGfxDecodeLane*)context;
+	gdiGfxDecoder* decoder = lane->decoder;
+	WINPR_UNUSED(instance);
+	WINPR_UNUSED(work);
+
+	for (;;)
+	{
+		gdiGfxDecodeJob* job;
+		EnterCriticalSection(&decoder->lock);
+		job = lane->head;
+
+		if (job)
+		{
+			lane->head = job->laneNext;
+
+			if (!lane->head)
+				lane->tail = NULL;
+		}
+		else
+			lane->running = FALSE;
+
+		LeaveCriticalSection(&decoder->lock);
+
+		if (!job)
+			break;
+
+		job->status = gdi_SurfaceCommand_Decode(job->gdi, job);
+		EnterCriticalSection(&decoder->lock);
+
+		if (--decoder->pending == 0)
+			SetEvent(decoder->idle);
+
+		LeaveCriticalSection(&decoder->lock);
+	}
+}
+
+static void gdi_gfx_decode_lane_free(void* obj)
+{
+	gdiGfxDecodeLane* lane = (gdiGfxDecodeLane*)obj;
+
+	if (!lane)
+		return;
+
+	if (lane->work)
+	{
+		WaitForThreadpoolWorkCallbacks(lane->work, FALSE);
+		CloseThreadpoolWork(lane->work);
+	}
+
+	freerdp_bitmap_planar_context_free(lane->planar);
+	rfx_context_free(lane->rfx);
+	progressive_context_free(lane->progressive);
+	free(lane);
+}
+
+static gdiGfxDecodeLane* gdi_gfx_decode_lane_new(gdiGfxDecoder* decoder, UINT16 surfaceId)
+{
+	gdiGfxDecodeLane* lane = (gdiGfxDecodeLane*)calloc(1, sizeof(gdiGfxDecodeLane));
+
+	if (!lane)
+		return NULL;
+
+	lane->decoder = decoder;
+	lane->surfaceId = surfaceId;
+	lane->work = CreateThreadpoolWork(gdi_gfx_decode_work_callback, lane, &decoder->environment);
+
+	if (!lane->work)
+	{
+		gdi_gfx_decode_lane_free(lane);
+		return NULL;
+	}
+
+	return lane;
+}
+
+static gdiGfxDecodeLane* gdi_gfx_decoder_get_lane(gdiGfxDecoder* decoder,
+                                                  const gdiGfxSurface* surface, UINT32 codecId)
+{
+	int index;
+	gdiGfxDecodeLane* lane;
+
+	switch (codecId)
+	{
+		case RDPGFX_CODECID_UNCOMPRESSED:
+		case RDPGFX_CODECID_CAVIDEO:
+		case RDPGFX_CODECID_PLANAR:
+		case RDPGFX_CODECID_AVC420:
+		case RDPGFX_CODECID_AVC444v2:
+		case RDPGFX_CODECID_AVC444:
+		case RDPGFX_CODECID_ALPHA:
+		case RDPGFX_CODECID_CAPROGRESSIVE:
+			break;
+
+		default:
+			return decoder->shared;
+	}
+
+	for (index = 0; index < ArrayList_Count(decoder->lanes); index++)
+	{
+		lane = (gdiGfxDecodeLane*)ArrayList_GetItem(decoder->lanes, index);
+
+		if (lane->surfaceId == surface->surfaceId)
+			return lane;
+	}
+
+	lane = gdi_gfx_decode_lane_new(decoder, surface->surfaceId);
+
+	if (!lane)
+		return NULL;
+
+	if (ArrayList_Add(decoder->lanes, lane) < 0)
+	{
+		gdi_gfx_decode_lane_free(lane);
+		return NULL;
+	}
+
+	return lane;
+}
+
+/* Drop the lane of a deleted surface, the caller has waited for the pending commands */
+static void gdi_gfx_decoder_remove_lane(gdiGfxDecoder* decoder, UINT16 surfaceId)
+{
+	int index;
+
+	if (!decoder)
+		return;
+
+	for (index = 0; index < ArrayList_Count(decoder->lanes); index++)
+	{
+		const gdiGfxDecodeLane* lane = (gdiGfxDecodeLane*)ArrayList_GetItem(decoder->lanes, index);
+
+		if (lane->surfaceId == surfaceId)
+		{
+			ArrayList_RemoveAt(decoder->lanes, index);
+			return;
+		}
+	}
+}
+
+static void gdi_gfx_decoder_free(gdiGfxDecoder* decoder)
+{
+	gdiGfxDecodeJob* job;
+
+	if (!decoder)
+		return;
+
+	if (decoder->idle)
+		WaitForSingleObject(decoder->idle, INFINITE);
+
+	job = decoder->first;
+
+	while (job)
+	{
+		gdiGfxDecodeJob* next = job->next;
+		gdi_gfx_decode_job_free(job);
+		job = next;
+	}
+
+	ArrayList_Free(decoder->lanes);
+	gdi_gfx_decode_lane_free(decoder->shared);
+	Stream_Free(decoder->rfxHeaders, TRUE);
+	Stream_Free(decoder->rfxMessageHeaders, TRUE);
+
+	if (decoder->pool)
+	{
+		CloseThreadpool(decoder->pool);
+		DestroyThreadpoolEnvironment(&decoder->environment);
+	}
+
+	if (decoder->idle)
+		CloseHandle(decoder->idle);
+
+	DeleteCriticalSection(&decoder->lock);
+	free(decoder);
+}
+
+static gdiGfxDecoder* gdi_gfx_decoder_new(DWORD numberOfProcessors)
+{
+	gdiGfxDecoder* decoder;
+	decoder = (gdiGfxDecoder*)calloc(1, sizeof(gdiGfxDecoder));
+
+	if (!decoder)
+		return NULL;
+
+	InitializeCriticalSection(&decoder->lock);
+	decoder->idle = CreateEvent(NULL, TRUE, TRUE, NULL);
+
+	if (!decoder->idle)
+		goto fail;
+
+	decoder->pool = CreateThreadpool(NULL);
+
+	if (!decoder->pool)
+		goto fail;
+
+	InitializeThreadpoolEnvironment(&decoder->environment);
+	SetThreadpoolCallbackPool(&decoder->environment, decoder->pool);
+	/* A single worker still keeps the order of the commands of each lane */
+	SetThreadpoolThreadMaximum(decoder->pool, MAX(numberOfProcessors, 1));
+	decoder->lanes = ArrayList_New(FALSE);
+	decoder->rfxHeaders = Stream_New(NULL, 64);
+	decoder->rfxMessageHeaders = Stream_New(NULL, 64);
+
+	if (!decoder->lanes || !decoder->rfxHeaders || !decoder->rfxMessageHeaders)
+		goto fail;
+
+	ArrayList_Object(decoder->lanes)->fnObjectFree = gdi_gfx_decode_lane_free;
+	decoder->shared = gdi_gfx_decode_lane_new(decoder, 0);
+
+	if (!decoder->shared)
+		goto fail;
+
+	return decoder;
+fail:
+	gdi_gfx_decoder_free(decoder);
+	return NULL;
+}
+
+/**
+ * Keeps the RemoteFX header blocks of the connection. The server sends them
+ * once, lane contexts created later or before a change get them replayed.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT gdi_gfx_decoder_update_rfx_headers(gdiGfxDecoder* decoder,
+                                               const RDPGFX_SURFACE_COMMAND* cmd)
+{
+	wStream* headers = decoder->rfxMessageHeaders;
+	Stream_SetPosition(headers, 0);
+
+	if (!rfx_copy_header_blocks(cmd->data, cmd->length, headers))
+		return ERROR_INVALID_DATA;
+
+	if ((Stream_GetPosition(headers) == 0) ||
+	    ((Stream_GetPosition(headers) == Stream_GetPosition(decoder->rfxHeaders)) &&
+	     (memcmp(Stream_Buffer(headers), Stream_Buffer(decoder->rfxHeaders),
+	             Stream_GetPosition(headers)) == 0)))
+		return CHANNEL_RC_OK;
+
+	decoder->rfxMessageHeaders = decoder->rfxHeaders;
+	decoder->rfxHeaders = headers;
+	decoder->rfxGeneration++;
+	return CHANNEL_RC_OK;
 }
+
 /**
- * Function description
+ * Sets up the lane local codec context a surface command is decoded with.
  *
  * @return 0 on success, otherwise a Win32 error code
  */
-static UINT gdi_SurfaceCommand_Alpha(rdpGdi* gdi, RdpgfxClientContext* context,
-                                     const RDPGFX_SURFACE_COMMAND* cmd)
+static UINT gdi_gfx_decoder_prepare_lane(rdpGdi* gdi, gdiGfxDecodeLane* lane,
+                                         const gdiGfxSurface* surface,
+                                         const RDPGFX_SURFACE_COMMAND* cmd)
 {
-	UINT status = CHANNEL_RC_OK;
-	UINT16 alphaSig, compressed;
-	gdiGfxSurface* surface;
-	RECTANGLE_16 invalidRect;
-	wStream s;
-	Stream_StaticInit(&s, cmd->data, cmd->length);
-
-	if (Stream_GetRemainingLength(&s) < 4)
-		return ERROR_INVALID_DATA;
-
-	surface = (gdiGfxSurface*)context->GetSurfaceData(context, cmd->surfaceId);
+	UINT status;
+	gdiGfxDecoder* decoder = gdi->gfxDecoder;
 
-	if (!surface)
+	switch (cmd->codecId)
 	{
-		WLog_ERR(TAG, "%s: unable to retrieve surfaceData for surfaceId=%" PRIu32 "", __FUNCTION__,
-		         cmd->surfaceId);
-		return ERROR_NOT_FOUND;
-	}
+		case RDPGFX_CODECID_PLANAR:
+			if (!lane->planar || (lane->planarWidth < cmd->width) ||
+			    (lane->planarHeight < cmd->height))
+			{
+				const UINT32 width = MAX(lane->planarWidth, cmd->width);
+				const UINT32 height = MAX(lane->planarHeight, cmd->height);
 
-	if (!is_within_surface(surface, cmd))
-		return ERROR_INVALID_DATA;
+				/* The lane context may still be in use by queued commands */
+				gdi_gfx_wait_pending(gdi->gfx);
 
-	Stream_Read_UINT16(&s, alphaSig);
-	Stream_Read_UINT16(&s, compressed);
+				if (!lane->planar)
+					lane->planar = freerdp_bitmap_planar_context_new(FALSE, width, height);
+				else if (!freerdp_bitmap_planar_context_reset(lane->planar, width, height))
+					return ERROR_INTERNAL_ERROR;
 
-	if (alphaSig != 0x414C)
-		return ERROR_INVALID_DATA;
+				if (!lane->planar)
+					return CHANNEL_RC_NO_MEMORY;
 
-	if (compressed == 0)
-	{
-		UINT32 x, y;
+				lane->planarWidth = width;
+				lane->planarHeight = height;
+			}
 
-		if (Stream_GetRemainingLength(&s) < cmd->height * cmd->width * 1ULL)
-			return ERROR_INVALID_DATA;
+			break;
 
-		for (y = cmd->top; y < cmd->top + cmd->height; y++)
-		{
-			BYTE* line = &surface->data[surface->scanline * y];
+		case RDPGFX_CODECID_CAVIDEO:
+			status = gdi_gfx_decoder_update_rfx_headers(decoder, cmd);
 
-			for (x = cmd->left; x < cmd->left + cmd->width; x++)
-			{
-				UINT32 color;
-				BYTE r, g, b, a;
-				BYTE* src = &line[x * GetBytesPerPixel(surface->format)];
-				Stream_Read_UINT8(&s, a);
-				color = ReadColor(src, surface->format);
-				SplitColor(color, surface->format, &r, &g, &b, NULL, NULL);
-				color = FreeRDPGetColor(surface->format, r, g, b, a);
-				WriteColor(src, surface->format, color);
-			}
-		}
-	}
-	else
-	{
-		UINT32 startOffsetX = 0;
-		RECTANGLE_16 rect;
-		rect.left = cmd->left;
-		rect.top = cmd->top;
-		rect.right = cmd->left + cmd->width;
-		rect.bottom = cmd->top + cmd->height;
+			if (status != CHANNEL_RC_OK)
+				return status;
 
-		while (rect.top < rect.bottom)
-		{
-			UINT32 count;
-			BYTE a;
+			/* Headers are only applied to fresh contexts, replace an outdated one */
+			if (!lane->rfx || (lane->rfxGeneration != decoder->rfxGeneration))
+			{
+				gdi_gfx_wait_pending(gdi->gfx);
+				rfx_context_free(lane->rfx);
+				lane->rfx = rfx_context_new(FALSE);
 
-			if (Stream_GetRemainingLength(&s) < 2)
-				return ERROR_INVALID_DATA;
+				if (!lane->rfx)
+					return CHANNEL_RC_NO_MEMORY;
 
-			Stream_Read_UINT8(&s, a);
-			Stream_Read_UINT8(&s, count);
+				if (!rfx_context_reset(lane->rfx, surface->width, surface->height))
+					return ERROR_INTERNAL_ERROR;
 
-			if (count >= 0xFF)
-			{
-				if (Stream_GetRemainingLength(&s) < 2)
+				if ((Stream_GetPosition(decoder->rfxHeaders) > 0) &&
+				    !rfx_process_message(lane->rfx, Stream_Buffer(decoder->rfxHeaders),
+				                         (UINT32)Stream_GetPosition(decoder->rfxHeaders), 0, 0,
+				                         surface->data, surface->format, surface->scanline,
+				                         surface->height, NULL))
 					return ERROR_INVALID_DATA;
 
-				Stream_Read_UINT16(&s, count);
+				lane->rfxGeneration = decoder->rfxGeneration;
+			}
 
-				if (count >= 0xFFFF)
-				{
-					if (Stream_GetRemainingLength(&s) < 4)
-						return ERROR_INVALID_DATA;
+			break;
 
-					Stream_Read_UINT32(&s, count);
-				}
-			}
+		case RDPGFX_CODECID_CAPROGRESSIVE:
+			if (!lane->progressive && !(lane->progressive = progressive_context_new(FALSE)))
+				return CHANNEL_RC_NO_MEMORY;
 
-			if (!gdi_apply_alpha(surface->data, surface->format, surface->scanline, &rect,
-			                     startOffsetX, count, a))
-				return ERROR_INTERNAL_ERROR;
+			break;
 
-			startOffsetX += count;
+		default:
+			break;
+	}
 
-			while (startOffsetX >= cmd->width)
-			{
-				startOffsetX -= cmd->width;
-				rect.top++;
-			}
-		}
+	return CHANNEL_RC_OK;
+}
+
+/**
+ * Queues a surface command on the lane of its codec.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT gdi_gfx_decoder_submit(rdpGdi* gdi, gdiGfxSurface* surface,
+                                   const RDPGFX_SURFACE_COMMAND* cmd)
+{
+	UINT status;
+	gdiGfxDecodeJob* job;
+	gdiGfxDecodeLane* lane;
+	gdiGfxDecoder* decoder = gdi->gfxDecoder;
+	lane = gdi_gfx_decoder_get_lane(decoder, surface, cmd->codecId);
+
+	if (!lane)
+		return CHANNEL_RC_NO_MEMORY;
+
+	/* A surface must only be written by one lane at a time to keep the command order */
+	for (job = decoder->first; job; job = job->next)
+	{
+		if ((job->surface == surface) && (job->lane != lane))
+			break;
 	}
 
-	invalidRect.left = cmd->left;
-	invalidRect.top = cmd->top;
-	invalidRect.right = cmd->right;
-	invalidRect.bottom = cmd->bottom;
-	region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion), &invalidRect);
-	status = IFCALLRESULT(CHANNEL_RC_OK, context->UpdateSurfaceArea, context, surface->surfaceId, 1,
-	                      &invalidRect);
+	if (job)
+		gdi_gfx_wait_pending(gdi->gfx);
+
+	status = gdi_gfx_decoder_prepare_lane(gdi, lane, surface, cmd);
 
 	if (status != CHANNEL_RC_OK)
-		goto fail;
+		return status;
 
-	if (!gdi->inGfxFrame)
+	job = gdi_gfx_decode_job_new(gdi, lane, surface, cmd);
+
+	if (!job)
+		return CHANNEL_RC_NO_MEMORY;
+
+	EnterCriticalSection(&decoder->lock);
+
+	if (decoder->last)
+		decoder->last->next = job;
+	else
+		decoder->first = job;
+
+	decoder->last = job;
+
+	if (lane->tail)
+		lane->tail->laneNext = job;
+	else
+		lane->head = job;
+
+	lane->tail = job;
+
+	if (decoder->pending++ == 0)
+		ResetEvent(decoder->idle);
+
+	if (!lane->running)
 	{
-		status = CHANNEL_RC_NOT_INITIALIZED;
-		IFCALLRET(context->UpdateSurfaces, status, context);
+		lane->running = TRUE;
+		SubmitThreadpoolWork(lane->work);
 	}
 
-fail:
-	return status;
+	LeaveCriticalSection(&decoder->lock);
+	return CHANNEL_RC_OK;
 }
 
 /**
- * Function description
+ * Waits for all queued surface commands and applies their updates.
  *
- * @return 0 on success, otherwise a Win32 error code
+ * @return 0 on success, otherwise the first Win32 error code of the
+ *         finished commands
  */
-static UINT gdi_SurfaceCommand_Progressive(rdpGdi* gdi, RdpgfxClientContext* context,
-                                           const RDPGFX_SURFACE_COMMAND* cmd)
+UINT gdi_graphics_pipeline_flush(rdpGdi* gdi)
 {
-	INT32 rc;
 	UINT status = CHANNEL_RC_OK;
-	gdiGfxSurface* surface;
-	REGION16 invalidRegion;
-	const RECTANGLE_16* rects;
-	UINT32 nrRects, x;
-	/**
-	 * Note: Since this comes via a Wire-To-Surface-2 PDU the
-	 * cmd's top/left/right/bottom/width/height members are always zero!
-	 * The update region is determined during decompression.
-	 */
-	surface = (gdiGfxSurface*)context->GetSurfaceData(context, cmd->surfaceId);
+	gdiGfxDecodeJob* job;
+	gdiGfxDecoder* decoder;
+	RdpgfxClientContext* context;
 
-	if (!surface)
+	if (!gdi || !gdi->gfx || !gdi->gfxDecoder)
+		return CHANNEL_RC_OK;
+
+	context = gdi->gfx;
+	decoder = gdi->gfxDecoder;
+	EnterCriticalSection(&context->mux);
+
+	if (decoder->first)
 	{
-		WLog_ERR(TAG, "%s: unable to retrieve surfaceData for surfaceId=%" PRIu32 "", __FUNCTION__,
-		         cmd->surfaceId);
-		return ERROR_NOT_FOUND;
-	}
+		if (WaitForSingleObject(decoder->idle, INFINITE) != WAIT_OBJECT_0)
+		{
+			LeaveCriticalSection(&context->mux);
+			return ERROR_INTERNAL_ERROR;
+		}
 
-	if (!is_within_surface(surface, cmd))
-		return ERROR_INVALID_DATA;
+		EnterCriticalSection(&decoder->lock);
+		job = decoder->first;
+		decoder->first = NULL;
+		decoder->last = NULL;
+		LeaveCriticalSection(&decoder->lock);
 
-	rc = progressive_create_surface_context(surface->codecs->progressive, cmd->surfaceId,
-	                                        surface->width, surface->height);
+		while (job)
+		{
+			UINT rc = job->status;
+			gdiGfxDecodeJob* next = job->next;
 
-	if (rc < 0)
-	{
-		WLog_ERR(TAG, "progressive_create_surface_context failure: %" PRId32 "", rc);
-		return ERROR_INTERNAL_ERROR;
-	}
+			if (rc == CHANNEL_RC_OK)
+				rc = gdi_SurfaceCommand_Update(gdi, context, job);
 
-	region16_init(&invalidRegion);
-	rc = progressive_decompress_ex(surface->codecs->progressive, cmd->data, cmd->length,
-	                               surface->data, surface->format, surface->scanline, cmd->left,
-	                               cmd->top, &invalidRegion, cmd->surfaceId, gdi->frameId);
+			if (status == CHANNEL_RC_OK)
+				status = rc;
 
-	if (rc < 0)
-	{
-		WLog_ERR(TAG, "progressive_decompress_ex failure: %" PRId32 "", rc);
-		region16_uninit(&invalidRegion);
-		return ERROR_INTERNAL_ERROR;
+			gdi_gfx_decode_job_free(job);
+			job = next;
+		}
 	}
 
-	rects = region16_rects(&invalidRegion, &nrRects);
-	status = IFCALLRESULT(CHANNEL_RC_OK, context->UpdateSurfaceArea, context, surface->surfaceId,
-	                      nrRects, rects);
-
-	if (status != CHANNEL_RC_OK)
-		goto fail;
+	LeaveCriticalSection(&context->mux);
+	return status;
+}
 
-	for (x = 0; x < nrRects; x++)
-		region16_union_rect(&surface->invalidRegion, &surface->invalidRegion, &rects[x]);
+/**
+ * Function description
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT gdi_StartFrame(RdpgfxClientContext* context, const RDPGFX_START_FRAME_PDU* startFrame)
+{
+	rdpGdi* gdi = (rdpGdi*)context->custom;
+	gdi->inGfxFrame = TRUE;
+	gdi->frameId = startFrame->frameId;
+	return CHANNEL_RC_OK;
+}
 
-	region16_uninit(&invalidRegion);
+/**
+ * Function description
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT gdi_EndFrame(RdpgfxClientContext* context, const RDPGFX_END_FRAME_PDU* endFrame)
+{
+	UINT status;
+	rdpGdi* gdi = (rdpGdi*)context->custom;
+	status = gdi_graphics_pipeline_flush(gdi);
 
-	if (!gdi->inGfxFrame)
+	if (status == CHANNEL_RC_OK)
 	{
 		status = CHANNEL_RC_NOT_INITIALIZED;
 		IFCALLRET(context->UpdateSurfaces, status, context);
 	}
 
-fail:
+	gdi->inGfxFrame = FALSE;
 	return status;
 }
 
@@ -900,6 +1463,7 @@ static UINT gdi_SurfaceCommand(RdpgfxClientContext* context, const RDPGFX_SURFAC
 {
 	UINT status = CHANNEL_RC_OK;
 	rdpGdi* gdi;
+	gdiGfxSurface* surface;
 
 	if (!context || !cmd)
 		return ERROR_INVALID_PARAMETER;
@@ -919,47 +1483,88 @@ static UINT gdi_SurfaceCommand(RdpgfxClientContext* context, const RDPGFX_SURFAC
 	switch (cmd->codecId)
 	{
 		case RDPGFX_CODECID_UNCOMPRESSED:
-			status = gdi_SurfaceCommand_Uncompressed(gdi, context, cmd);
-			break;
-
 		case RDPGFX_CODECID_CAVIDEO:
-			status = gdi_SurfaceCommand_RemoteFX(gdi, context, cmd);
-			break;
-
 		case RDPGFX_CODECID_CLEARCODEC:
-			status = gdi_SurfaceCommand_ClearCodec(gdi, context, cmd);
-			break;
-
 		case RDPGFX_CODECID_PLANAR:
-			status = gdi_SurfaceCommand_Planar(gdi, context, cmd);
-			break;
-
 		case RDPGFX_CODECID_AVC420:
-			status = gdi_SurfaceCommand_AVC420(gdi, context, cmd);
-			break;
-
 		case RDPGFX_CODECID_AVC444v2:
 		case RDPGFX_CODECID_AVC444:
-			status = gdi_SurfaceCommand_AVC444(gdi, context, cmd);
-			break;
-
 		case RDPGFX_CODECID_ALPHA:
-			status = gdi_SurfaceCommand_Alpha(gdi, context, cmd);
-			break;
-
 		case RDPGFX_CODECID_CAPROGRESSIVE:
-			status = gdi_SurfaceCommand_Progressive(gdi, context, cmd);
 			break;
 
 		case RDPGFX_CODECID_CAPROGRESSIVE_V2:
 			WLog_WARN(TAG, "SurfaceCommand 0x%08" PRIX32 " not implemented", cmd->codecId);
-			break;
+			goto out;
 
 		default:
 			WLog_WARN(TAG, "Invalid SurfaceCommand 0x%08" PRIX32 "", cmd->codecId);
-			break;
+			goto out;
+	}
+
+	surface = (gdiGfxSurface*)context->GetSurfaceData(context, cmd->surfaceId);
+
+	if (!surface)
+	{
+		WLog_ERR(TAG, "%s: unable to retrieve surfaceData for surfaceId=%" PRIu32 "", __FUNCTION__,
+		         cmd->surfaceId);
+		status = ERROR_NOT_FOUND;
+		goto out;
+	}
+
+	if (gdi->inGfxFrame && gdi->gfxDecoder)
+		status = gdi_gfx_decoder_submit(gdi, surface, cmd);
+	else
+	{
+		gdiGfxDecodeJob job = { 0 };
+		status = gdi_graphics_pipeline_flush(gdi);
+
+		if (status != CHANNEL_RC_OK)
+			goto out;
+
+		job.gdi = gdi;
+		job.surface = surface;
+
+		/* With a decoder the lane contexts hold the codec state of the surface */
+		if (gdi->gfxDecoder)
+		{
+			gdiGfxDecodeLane* lane =
+			    gdi_gfx_decoder_get_lane(gdi->gfxDecoder, surface, cmd->codecId);
+
+			if (!lane)
+			{
+				status = CHANNEL_RC_NO_MEMORY;
+				goto out;
+			}
+
+			status = gdi_gfx_decoder_prepare_lane(gdi, lane, surface, cmd);
+
+			if (status != CHANNEL_RC_OK)
+				goto out;
+
+			job.planar = lane->planar;
+			job.rfx = lane->rfx;
+			job.progressive = lane->progressive;
+		}
+		else
+		{
+			job.planar = surface->codecs->planar;
+			job.rfx = surface->codecs->rfx;
+			job.progressive = surface->codecs->progressive;
+		}
+
+		job.frameId = gdi->frameId;
+		job.cmd = *cmd;
+		region16_init(&job.invalidRegion);
+		status = gdi_SurfaceCommand_Decode(gdi, &job);
+
+		if (status == CHANNEL_RC_OK)
+			status = gdi_SurfaceCommand_Update(gdi, context, &job);
+
+		region16_uninit(&job.invalidRegion);
 	}
 
+out:
 	LeaveCriticalSection(&context->mux);
 	return status;
 }
@@ -1052,7 +1657,10 @@ static UINT gdi_DeleteSurface(RdpgfxClientContext* context,
 	UINT rc = ERROR_INTERNAL_ERROR;
 	rdpCodecs* codecs = NULL;
 	gdiGfxSurface* surface = NULL;
+	rdpGdi* gdi = (rdpGdi*)context->custom;
 	EnterCriticalSection(&context->mux);
+	gdi_gfx_wait_pending(context);
+	gdi_gfx_decoder_remove_lane(gdi->gfxDecoder, deleteSurface->surfaceId);
 	surface = (gdiGfxSurface*)context->GetSurfaceData(context, deleteSurface->surfaceId);
 
 	if (surface)
@@ -1096,6 +1704,7 @@ static UINT gdi_SolidFill(RdpgfxClientContext* context, const RDPGFX_SOLID_FILL_
 	RECTANGLE_16 invalidRect;
 	rdpGdi* gdi = (rdpGdi*)context->custom;
 	EnterCriticalSection(&context->mux);
+	gdi_gfx_wait_pending(context);
 	surface = (gdiGfxSurface*)context->GetSurfaceData(context, solidFill->surfaceId);
 
 	if (!surface)
@@ -1164,6 +1773,7 @@ static UINT gdi_SurfaceToSurface(RdpgfxClientContext* context,
 	gdiGfxSurface* surfaceDst;
 	rdpGdi* gdi = (rdpGdi*)context->custom;
 	EnterCriticalSection(&context->mux);
+	gdi_gfx_wait_pending(context);
 	rectSrc = &(surfaceToSurface->rectSrc);
 	surfaceSrc = (gdiGfxSurface*)context->GetSurfaceData(context, surfaceToSurface->surfaceIdSrc);
 	sameSurface =
@@ -1236,6 +1846,7 @@ static UINT gdi_SurfaceToCache(RdpgfxClientContext* context,
 	gdiGfxCacheEntry* cacheEntry;
 	UINT rc = ERROR_INTERNAL_ERROR;
 	EnterCriticalSection(&context->mux);
+	gdi_gfx_wait_pending(context);
 	rect = &(surfaceToCache->rectSrc);
 	surface = (gdiGfxSurface*)context->GetSurfaceData(context, surfaceToCache->surfaceId);
 
@@ -1292,6 +1903,7 @@ static UINT gdi_CacheToSurface(RdpgfxClientContext* context,
 	RECTANGLE_16 invalidRect;
 	rdpGdi* gdi = (rdpGdi*)context->custom;
 	EnterCriticalSection(&context->mux);
+	gdi_gfx_wait_pending(context);
 	surface = (gdiGfxSurface*)context->GetSurfaceData(context, cacheToSurface->surfaceId);
 	cacheEntry = (gdiGfxCacheEntry*)context->GetCacheSlotData(context, cacheToSurface->cacheSlot);
 
@@ -1387,6 +1999,7 @@ static UINT gdi_MapSurfaceToOutput(RdpgfxClientContext* context,
 	UINT rc = ERROR_INTERNAL_ERROR;
 	gdiGfxSurface* surface;
 	EnterCriticalSection(&context->mux);
+	gdi_gfx_wait_pending(context);
 	surface = (gdiGfxSurface*)context->GetSurfaceData(context, surfaceToOutput->surfaceId);
 
 	if (!surface)
@@ -1411,6 +2024,7 @@ gdi_MapSurfaceToScaledOutput(RdpgfxClientContext* context,
 	UINT rc = ERROR_INTERNAL_ERROR;
 	gdiGfxSurface* surface;
 	EnterCriticalSection(&context->mux);
+	gdi_gfx_wait_pending(context);
 	surface = (gdiGfxSurface*)context->GetSurfaceData(context, surfaceToOutput->surfaceId);
 
 	if (!surface)
@@ -1439,6 +2053,7 @@ static UINT gdi_MapSurfaceToWindow(RdpgfxClientContext* context,
 	UINT rc = ERROR_INTERNAL_ERROR;
 	gdiGfxSurface* surface;
 	EnterCriticalSection(&context->mux);
+	gdi_gfx_wait_pending(context);
 	surface = (gdiGfxSurface*)context->GetSurfaceData(context, surfaceToWindow->surfaceId);
 
 	if (!surface)
@@ -1469,6 +2084,7 @@ gdi_MapSurfaceToScaledWindow(RdpgfxClientContext* context,
 	UINT rc = ERROR_INTERNAL_ERROR;
 	gdiGfxSurface* surface;
 	EnterCriticalSection(&context->mux);
+	gdi_gfx_wait_pending(context);
 	surface = (gdiGfxSurface*)context->GetSurfaceData(context, surfaceToWindow->surfaceId);
 
 	if (!surface)
@@ -1535,6 +2151,16 @@ BOOL gdi_graphics_pipeline_init_ex(rdpGdi* gdi, RdpgfxClientContext* gfx,
 	InitializeCriticalSection(&gfx->mux);
 	PROFILER_CREATE(gfx->SurfaceProfiler, "GFX-PROFILER");
 
+	if (freerdp_settings_get_bool(context->settings, FreeRDP_GfxParallelDecode))
+	{
+		SYSTEM_INFO sysInfos;
+		GetNativeSystemInfo(&sysInfos);
+
+		if (!(gdi->gfxDecoder = gdi_gfx_decoder_new(sysInfos.dwNumberOfProcessors)))
+			WLog_Print(gdi->log, WLOG_WARN,
+			           "parallel SurfaceCommand decoding not available, decoding sequentially");
+	}
+
 #if !defined(DEFINE_NO_DEPRECATED)
 	/**
 	 * gdi->graphicsReset will be removed in FreeRDP v3 from public headers,
@@ -1551,7 +2177,11 @@ BOOL gdi_graphics_pipeline_init_ex(rdpGdi* gdi, RdpgfxClientContext* gfx,
 void gdi_graphics_pipeline_uninit(rdpGdi* gdi, RdpgfxClientContext* gfx)
 {
 	if (gdi)
+	{
+		gdi_gfx_decoder_free(gdi->gfxDecoder);
+		gdi->gfxDecoder = NULL;
 		gdi->gfx = NULL;
+	}
 
 	if (!gfx)
 		return;
@@ -0,0 +1,474 @@
+#include <winpr/crt.h>
+#include <winpr/print.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/codecs.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/gdi/gfx.h>
+#include <freerdp/codec/clear.h>
+#include <freerdp/codec/planar.h>
+#include <freerdp/codec/rfx.h>
+#include <freerdp/codec/progressive.h>
+#include <freerdp/client/rdpgfx.h>
+
+#define TEST_GFX_WIDTH 128
+#define TEST_GFX_HEIGHT 128
+#define TEST_GFX_MAX_SURFACES 4
+#define TEST_GFX_MAX_UPDATES 32
+#define TEST_GFX_FRAMES 50
+
+typedef struct
+{
+	RdpgfxClientContext gfx;
+	CLEAR_CONTEXT* clear;
+	BITMAP_PLANAR_CONTEXT* planar;
+	RFX_CONTEXT* rfx;
+	wStream* rfxStream;
+	PROGRESSIVE_CONTEXT* progressive;
+	void* surfaces[TEST_GFX_MAX_SURFACES];
+	UINT32 numUpdates;
+	UINT16 updateIds[TEST_GFX_MAX_UPDATES];
+	RECTANGLE_16 updateRects[TEST_GFX_MAX_UPDATES];
+} TEST_GFX;
+
+/* A surface command and the color it fills its rectangle with */
+typedef struct
+{
+	UINT16 surfaceId;
+	UINT32 codecId;
+	RECTANGLE_16 rect;
+	UINT32 color;
+} TEST_GFX_COMMAND;
+
+/* A pixel and the color the commands above have to leave there, close to it for lossy codecs */
+typedef struct
+{
+	UINT16 surfaceId;
+	UINT32 x;
+	UINT32 y;
+	size_t command;
+} TEST_GFX_PIXEL;
+
+static UINT test_gfx_set_surface_data(RdpgfxClientContext* context, UINT16 surfaceId, void* pData)
+{
+	TEST_GFX* test = (TEST_GFX*)context;
+
+	if (surfaceId >= TEST_GFX_MAX_SURFACES)
+		return ERROR_INVALID_DATA;
+
+	test->surfaces[surfaceId] = pData;
+	return CHANNEL_RC_OK;
+}
+
+static void* test_gfx_get_surface_data(RdpgfxClientContext* context, UINT16 surfaceId)
+{
+	TEST_GFX* test = (TEST_GFX*)context;
+
+	if (surfaceId >= TEST_GFX_MAX_SURFACES)
+		return NULL;
+
+	return test->surfaces[surfaceId];
+}
+
+static UINT test_gfx_get_surface_ids(RdpgfxClientContext* context, UINT16** ppSurfaceIds,
+                                     UINT16* count_out)
+{
+	UINT16 index;
+	UINT16 count = 0;
+	UINT16* ids = calloc(TEST_GFX_MAX_SURFACES, sizeof(UINT16));
+	TEST_GFX* test = (TEST_GFX*)context;
+
+	if (!ids)
+		return CHANNEL_RC_NO_MEMORY;
+
+	for (index = 0; index < TEST_GFX_MAX_SURFACES; index++)
+	{
+		if (test->surfaces[index])
+			ids[count++] = index;
+	}
+
+	*ppSurfaceIds = ids;
+	*count_out = count;
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_gfx_update_surface_area(RdpgfxClientContext* context, UINT16 surfaceId,
+                                         UINT32 nrRects, const RECTANGLE_16* rects)
+{
+	TEST_GFX* test = (TEST_GFX*)context;
+
+	if ((nrRects != 1) || (test->numUpdates >= TEST_GFX_MAX_UPDATES))
+		return ERROR_INVALID_DATA;
+
+	test->updateIds[test->numUpdates] = surfaceId;
+	test->updateRects[test->numUpdates] = rects[0];
+	test->numUpdates++;
+	return CHANNEL_RC_OK;
+}
+
+static BOOL test_gfx_create_surface(TEST_GFX* test, UINT16 surfaceId)
+{
+	RDPGFX_CREATE_SURFACE_PDU pdu = { 0 };
+	pdu.surfaceId = surfaceId;
+	pdu.width = TEST_GFX_WIDTH;
+	pdu.height = TEST_GFX_HEIGHT;
+	pdu.pixelFormat = GFX_PIXEL_FORMAT_XRGB_8888;
+	return test->gfx.CreateSurface(&test->gfx, &pdu) == CHANNEL_RC_OK;
+}
+
+static BOOL test_gfx_delete_surface(TEST_GFX* test, UINT16 surfaceId)
+{
+	RDPGFX_DELETE_SURFACE_PDU pdu = { 0 };
+	pdu.surfaceId = surfaceId;
+	return test->gfx.DeleteSurface(&test->gfx, &pdu) == CHANNEL_RC_OK;
+}
+
+static BOOL test_gfx_send_command(TEST_GFX* test, const TEST_GFX_COMMAND* command)
+{
+	UINT rc;
+	UINT32 x;
+	BYTE* data = NULL;
+	UINT32* pixels;
+	RDPGFX_SURFACE_COMMAND cmd = { 0 };
+	const UINT32 width = command->rect.right - command->rect.left;
+	const UINT32 height = command->rect.bottom - command->rect.top;
+
+	pixels = calloc(width * height, sizeof(UINT32));
+
+	if (!pixels)
+		return FALSE;
+
+	for (x = 0; x < width * height; x++)
+		pixels[x] = command->color;
+
+	cmd.surfaceId = command->surfaceId;
+	cmd.codecId = command->codecId;
+	cmd.format = PIXEL_FORMAT_BGRX32;
+	cmd.left = command->rect.left;
+	cmd.top = command->rect.top;
+	cmd.right = command->rect.right;
+	cmd.bottom = command->rect.bottom;
+	cmd.width = width;
+	cmd.height = height;
+
+	if (command->codecId == RDPGFX_CODECID_CLEARCODEC)
+	{
+		/* The encoder caches stay in sync with the decoder only if the order is kept */
+		if (clear_compress_ex(test->clear, (const BYTE*)pixels, PIXEL_FORMAT_BGRX32,
+		                      width * 4, width, height, &data, &cmd.length) < 0)
+		{
+			free(pixels);
+			return FALSE;
+		}
+
+		cmd.data = data;
+	}
+	else if (command->codecId == RDPGFX_CODECID_PLANAR)
+	{
+		data = freerdp_bitmap_compress_planar(test->planar, (const BYTE*)pixels,
+		                                      PIXEL_FORMAT_BGRX32, width, height, width * 4, NULL,
+		                                      &cmd.length);
+
+		if (!data)
+		{
+			free(pixels);
+			return FALSE;
+		}
+
+		cmd.data = data;
+	}
+	else if (command->codecId == RDPGFX_CODECID_CAVIDEO)
+	{
+		/* The encoder sends the header blocks with its first message only */
+		RFX_MESSAGE* message;
+		const RFX_RECT rect = { 0, 0, (UINT16)width, (UINT16)height };
+		message = rfx_encode_message(test->rfx, &rect, 1, (const BYTE*)pixels, width, height,
+		                             width * 4);
+		Stream_SetPosition(test->rfxStream, 0);
+
+		if (!message || !rfx_write_message(test->rfx, test->rfxStream, message))
+		{
+			rfx_message_free(test->rfx, message);
+			free(pixels);
+			return FALSE;
+		}
+
+		rfx_message_free(test->rfx, message);
+		cmd.data = Stream_Buffer(test->rfxStream);
+		cmd.length = (UINT32)Stream_GetPosition(test->rfxStream);
+	}
+	else if (command->codecId == RDPGFX_CODECID_CAPROGRESSIVE)
+	{
+		/* The tiles carry the position, a Wire-To-Surface-2 PDU has no rectangle */
+		REGION16 region;
+		BYTE* image = calloc(TEST_GFX_WIDTH * TEST_GFX_HEIGHT, 4);
+		BYTE* pDstData = NULL;
+		int status = -1;
+
+		if (image)
+		{
+			for (x = 0; x < height; x++)
+			{
+				const size_t offset = (command->rect.top + x) * TEST_GFX_WIDTH + command->rect.left;
+				CopyMemory(&image[offset * 4], &pixels[x * width], width * 4);
+			}
+
+			region16_init(&region);
+			region16_union_rect(&region, &region, &command->rect);
+			status = progressive_compress_ex(
+			    test->progressive, image, TEST_GFX_WIDTH * TEST_GFX_HEIGHT * 4,
+			    PIXEL_FORMAT_BGRX32, TEST_GFX_WIDTH, TEST_GFX_HEIGHT, TEST_GFX_WIDTH * 4,
+			    &region, &pDstData, &cmd.length);
+			region16_uninit(&region);
+			free(image);
+		}
+
+		if (status < 0)
+		{
+			free(pixels);
+			return FALSE;
+		}
+
+		cmd.left = cmd.top = cmd.right = cmd.bottom = 0;
+		cmd.width = cmd.height = 0;
+		cmd.data = pDstData;
+	}
+	else
+	{
+		cmd.data = (BYTE*)pixels;
+		cmd.length = width * height * 4;
+	}
+
+	rc = test->gfx.SurfaceCommand(&test->gfx, &cmd);
+	free(data);
+	free(pixels);
+	return rc == CHANNEL_RC_OK;
+}
+
+static BOOL test_gfx_check_pixel(TEST_GFX* test, const TEST_GFX_PIXEL* pixel,
+                                  const TEST_GFX_COMMAND* command)
+{
+	size_t index;
+	const gdiGfxSurface* surface = test->surfaces[pixel->surfaceId];
+	const BYTE* data = &surface->data[pixel->y * surface->scanline + pixel->x * 4];
+	const UINT32 color = *(const UINT32*)data;
+	const UINT32 expected = command->color;
+	const BOOL lossy = (command->codecId == RDPGFX_CODECID_CAVIDEO) ||
+	                   (command->codecId == RDPGFX_CODECID_CAPROGRESSIVE);
+	BOOL match = TRUE;
+
+	for (index = 0; index < 3; index++)
+	{
+		const int actual = (color >> (index * 8)) & 0xFF;
+		const int wanted = (expected >> (index * 8)) & 0xFF;
+
+		if (abs(actual - wanted) > (lossy ? 8 : 0))
+			match = FALSE;
+	}
+
+	if (!match)
+	{
+		fprintf(stderr, "surface %" PRIu16 " pixel %" PRIu32 "x%" PRIu32 ": 0x%08" PRIx32
+		                " instead of 0x%08" PRIx32 "\n",
+		        pixel->surfaceId, pixel->x, pixel->y, color, expected);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Surface commands of one frame may be decoded in parallel, but commands
+ * touching the same surface have to be applied in the order they were sent,
+ * also when they switch between per surface and shared codec lanes. The
+ * UpdateSurfaceArea callbacks have to follow the same order. RemoteFX and
+ * progressive are decoded with per surface contexts.
+ */
+static BOOL test_gfx_frame(TEST_GFX* test, UINT32 frameId)
+{
+	size_t index;
+	RDPGFX_START_FRAME_PDU start = { 0 };
+	RDPGFX_END_FRAME_PDU end = { 0 };
+	const UINT32 seed = frameId * 0x00010203;
+	const TEST_GFX_COMMAND commands[] = {
+		{ 1, RDPGFX_CODECID_UNCOMPRESSED, { 0, 0, 64, 64 }, 0x00102030 ^ seed },
+		{ 2, RDPGFX_CODECID_UNCOMPRESSED, { 0, 0, 64, 64 }, 0x00405060 ^ seed },
+		{ 1, RDPGFX_CODECID_UNCOMPRESSED, { 32, 32, 96, 96 }, 0x00708090 ^ seed },
+		{ 1, RDPGFX_CODECID_CLEARCODEC, { 48, 48, 112, 112 }, 0x00A0B0C0 ^ seed },
+		{ 1, RDPGFX_CODECID_UNCOMPRESSED, { 80, 80, 128, 128 }, 0x00D0E0F0 ^ seed },
+		{ 2, RDPGFX_CODECID_CLEARCODEC, { 32, 0, 96, 64 }, 0x00112233 ^ seed },
+		{ 2, RDPGFX_CODECID_PLANAR, { 0, 32, 16, 48 }, 0x00445566 ^ seed },
+		{ 1, RDPGFX_CODECID_CAPROGRESSIVE, { 0, 64, 64, 128 }, 0x00778899 ^ seed },
+		{ 2, RDPGFX_CODECID_CAVIDEO, { 0, 64, 64, 128 }, 0x00AABBCC ^ seed },
+		{ 1, RDPGFX_CODECID_CAVIDEO, { 64, 0, 128, 64 }, 0x00DDEEFF ^ seed },
+		{ 2, RDPGFX_CODECID_CAPROGRESSIVE, { 64, 64, 128, 128 }, 0x00102938 ^ seed },
+		{ 1, RDPGFX_CODECID_UNCOMPRESSED, { 16, 96, 48, 112 }, 0x00475665 ^ seed },
+	};
+	const TEST_GFX_PIXEL pixels[] = {
+		{ 1, 10, 10, 0 },  { 1, 40, 40, 2 },  { 1, 50, 50, 3 }, { 1, 60, 60, 3 },
+		{ 1, 90, 90, 4 },  { 1, 120, 120, 4 }, { 2, 10, 10, 1 }, { 2, 40, 10, 5 },
+		{ 2, 8, 40, 6 },   { 2, 40, 40, 5 },   { 1, 10, 100, 7 }, { 1, 60, 70, 7 },
+		{ 2, 10, 100, 8 }, { 1, 100, 10, 9 },  { 2, 100, 100, 10 }, { 1, 30, 100, 11 },
+	};
+	start.frameId = frameId;
+	end.frameId = frameId;
+	test->numUpdates = 0;
+
+	if (test->gfx.StartFrame(&test->gfx, &start) != CHANNEL_RC_OK)
+		return FALSE;
+
+	for (index = 0; index < ARRAYSIZE(commands); index++)
+	{
+		if (!test_gfx_send_command(test, &commands[index]))
+		{
+			fprintf(stderr, "command %" PRIuz " of frame %" PRIu32 " failed\n", index, frameId);
+			return FALSE;
+		}
+	}
+
+	if (test->gfx.EndFrame(&test->gfx, &end) != CHANNEL_RC_OK)
+		return FALSE;
+
+	for (index = 0; index < ARRAYSIZE(pixels); index++)
+	{
+		const TEST_GFX_PIXEL* pixel = &pixels[index];
+
+		if (!test_gfx_check_pixel(test, pixel, &commands[pixel->command]))
+			return FALSE;
+	}
+
+	if (test->numUpdates != ARRAYSIZE(commands))
+	{
+		fprintf(stderr, "%" PRIu32 " surface area updates instead of %" PRIuz "\n",
+		        test->numUpdates, ARRAYSIZE(commands));
+		return FALSE;
+	}
+
+	for (index = 0; index < test->numUpdates; index++)
+	{
+		const RECTANGLE_16* r = &test->updateRects[index];
+		const TEST_GFX_COMMAND* command = &commands[index];
+
+		if ((test->updateIds[index] != command->surfaceId) || (r->left != command->rect.left) ||
+		    (r->top != command->rect.top) || (r->right != command->rect.right) ||
+		    (r->bottom != command->rect.bottom))
+		{
+			fprintf(stderr, "update %" PRIuz " of frame %" PRIu32 " out of order\n", index,
+			        frameId);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+int TestGdiGfx(int argc, char* argv[])
+{
+	int rc = -1;
+	UINT32 frame;
+	UINT16 surfaceId;
+	rdpGdi* gdi = NULL;
+	rdpSettings* settings;
+	freerdp* instance;
+	TEST_GFX test = { 0 };
+	BOOL pipeline = FALSE;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+	instance = freerdp_new();
+
+	if (!instance || !freerdp_context_new(instance))
+		goto fail;
+
+	settings = instance->context->settings;
+	settings->DesktopWidth = TEST_GFX_WIDTH;
+	settings->DesktopHeight = TEST_GFX_HEIGHT;
+
+	if (!freerdp_settings_set_bool(settings, FreeRDP_GfxParallelDecode, TRUE))
+		goto fail;
+
+	/* What the connection sequence would set up */
+	instance->context->codecs = codecs_new(instance->context);
+
+	if (!instance->context->codecs ||
+	    !freerdp_client_codecs_prepare(instance->context->codecs, FREERDP_CODEC_ALL,
+	                                   TEST_GFX_WIDTH, TEST_GFX_HEIGHT))
+		goto fail;
+
+	if (!gdi_init(instance, PIXEL_FORMAT_BGRX32))
+		goto fail;
+
+	gdi = instance->context->gdi;
+	test.clear = clear_context_new(TRUE);
+	test.planar = freerdp_bitmap_planar_context_new(
+	    PLANAR_FORMAT_HEADER_RLE | PLANAR_FORMAT_HEADER_NA, TEST_GFX_WIDTH, TEST_GFX_HEIGHT);
+
+	test.rfx = rfx_context_new(TRUE);
+	test.rfxStream = Stream_New(NULL, 1024);
+	test.progressive = progressive_context_new(TRUE);
+
+	if (!test.clear || !test.planar || !test.rfx || !test.rfxStream || !test.progressive ||
+	    !rfx_context_reset(test.rfx, TEST_GFX_WIDTH, TEST_GFX_HEIGHT))
+		goto fail;
+
+	rfx_context_set_pixel_format(test.rfx, PIXEL_FORMAT_BGRX32);
+
+	test.gfx.SetSurfaceData = test_gfx_set_surface_data;
+	test.gfx.GetSurfaceData = test_gfx_get_surface_data;
+	test.gfx.GetSurfaceIds = test_gfx_get_surface_ids;
+
+	if (!gdi_graphics_pipeline_init_ex(gdi, &test.gfx, NULL, NULL, test_gfx_update_surface_area))
+		goto fail;
+
+	pipeline = TRUE;
+
+	/* Also a single processor decodes in parallel */
+	if (!gdi->gfxDecoder)
+		goto fail;
+
+	for (frame = 1; frame <= TEST_GFX_FRAMES; frame++)
+	{
+		/* Surfaces come and go, their lanes with them */
+		if ((frame % 10) == 1)
+		{
+			for (surfaceId = 1; surfaceId <= 2; surfaceId++)
+			{
+				if (test.surfaces[surfaceId] && !test_gfx_delete_surface(&test, surfaceId))
+					goto fail;
+
+				if (!test_gfx_create_surface(&test, surfaceId))
+					goto fail;
+			}
+		}
+
+		if (!test_gfx_frame(&test, frame))
+			goto fail;
+	}
+
+	for (surfaceId = 1; surfaceId <= 2; surfaceId++)
+	{
+		if (!test_gfx_delete_surface(&test, surfaceId))
+			goto fail;
+	}
+
+	rc = 0;
+fail:
+	if (pipeline)
+		gdi_graphics_pipeline_uninit(gdi, &test.gfx);
+
+	clear_context_free(test.clear);
+	freerdp_bitmap_planar_context_free(test.planar);
+	rfx_context_free(test.rfx);
+	Stream_Free(test.rfxStream, TRUE);
+	progressive_context_free(test.progressive);
+
+	if (instance && instance->context)
+	{
+		gdi_free(instance);
+		codecs_free(instance->context->codecs);
+		instance->context->codecs = NULL;
+		freerdp_context_free(instance);
+	}
+
+	freerdp_free(instance);
+	return rc;
+}
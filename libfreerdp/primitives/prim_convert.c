@@ -0,0 +1,253 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * Pixel format conversion of whole images.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <freerdp/codec/color.h>
+
+#include "prim_internal.h"
+
+/* ----------------------------------------------------------------------------
+ * The converters produce exactly what the ReadColor, FreeRDPConvertColor and
+ * WriteColor loop in freerdp_image_copy produces for the same format pair.
+ * Both steps may be negative to walk an image bottom up.
+ */
+static pstatus_t general_convert_32_to_32(const BYTE* pSrc, UINT32 SrcFormat, INT32 srcStep,
+                                          BYTE* pDst, UINT32 DstFormat, INT32 dstStep,
+                                          UINT32 width, UINT32 height, const gdiPalette* palette)
+{
+	UINT32 x, y;
+	PRIM_PIXEL_LAYOUT src, dst;
+	const INT32 fill = getDstAlphaFill(SrcFormat, DstFormat);
+	WINPR_UNUSED(palette);
+
+	if (!getPixelLayout(SrcFormat, &src) || !getPixelLayout(DstFormat, &dst))
+		return -1;
+
+	for (y = 0; y < height; y++)
+	{
+		const BYTE* s = &pSrc[(INT64)y * srcStep];
+		BYTE* d = &pDst[(INT64)y * dstStep];
+
+		if (fill < 0)
+		{
+			for (x = 0; x < width; x++)
+			{
+				d[dst.r] = s[src.r];
+				d[dst.g] = s[src.g];
+				d[dst.b] = s[src.b];
+				d[dst.a] = s[src.a];
+				s += 4;
+				d += 4;
+			}
+		}
+		else
+		{
+			for (x = 0; x < width; x++)
+			{
+				d[dst.r] = s[src.r];
+				d[dst.g] = s[src.g];
+				d[dst.b] = s[src.b];
+				d[dst.a] = (BYTE)fill;
+				s += 4;
+				d += 4;
+			}
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t general_convert_32_to_24(const BYTE* pSrc, UINT32 SrcFormat, INT32 srcStep,
+                                          BYTE* pDst, UINT32 DstFormat, INT32 dstStep,
+                                          UINT32 width, UINT32 height, const gdiPalette* palette)
+{
+	UINT32 x, y;
+	PRIM_PIXEL_LAYOUT src, dst;
+	WINPR_UNUSED(palette);
+
+	if (!getPixelLayout(SrcFormat, &src) || !getPixelLayout(DstFormat, &dst))
+		return -1;
+
+	for (y = 0; y < height; y++)
+	{
+		const BYTE* s = &pSrc[(INT64)y * srcStep];
+		BYTE* d = &pDst[(INT64)y * dstStep];
+
+		for (x = 0; x < width; x++)
+		{
+			d[dst.r] = s[src.r];
+			d[dst.g] = s[src.g];
+			d[dst.b] = s[src.b];
+			s += 4;
+			d += 3;
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t general_convert_32_to_16(const BYTE* pSrc, UINT32 SrcFormat, INT32 srcStep,
+                                          BYTE* pDst, UINT32 DstFormat, INT32 dstStep,
+                                          UINT32 width, UINT32 height, const gdiPalette* palette)
+{
+	UINT32 x, y;
+	PRIM_PIXEL_LAYOUT src;
+	BYTE lo, hi;
+	const BOOL rgb565 = (DstFormat == PIXEL_FORMAT_RGB16) || (DstFormat == PIXEL_FORMAT_BGR16);
+	const BOOL alphaBit = ColorHasAlpha(DstFormat) && !rgb565;
+	const BOOL srcAlpha = ColorHasAlpha(SrcFormat);
+	WINPR_UNUSED(palette);
+
+	if (!getPixelLayout(SrcFormat, &src))
+		return -1;
+
+	/* The channel stored in the low bits, blue for the RGB formats */
+	if (FREERDP_PIXEL_FORMAT_TYPE(DstFormat) == FREERDP_PIXEL_FORMAT_TYPE_ABGR)
+	{
+		lo = src.r;
+		hi = src.b;
+	}
+	else
+	{
+		lo = src.b;
+		hi = src.r;
+	}
+
+	for (y = 0; y < height; y++)
+	{
+		const BYTE* s = &pSrc[(INT64)y * srcStep];
+		BYTE* d = &pDst[(INT64)y * dstStep];
+
+		for (x = 0; x < width; x++)
+		{
+			UINT32 color;
+
+			if (rgb565)
+				color = ((s[hi] >> 3) << 11) | ((s[src.g] >> 2) << 5) | (s[lo] >> 3);
+			else
+				color = ((s[hi] >> 3) << 10) | ((s[src.g] >> 3) << 5) | (s[lo] >> 3);
+
+			if (alphaBit && (!srcAlpha || s[src.a]))
+				color |= 0x8000;
+
+			d[0] = (BYTE)color;
+			d[1] = (BYTE)(color >> 8);
+			s += 4;
+			d += 2;
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t general_convert_8_to_32(const BYTE* pSrc, UINT32 SrcFormat, INT32 srcStep,
+                                         BYTE* pDst, UINT32 DstFormat, INT32 dstStep,
+                                         UINT32 width, UINT32 height, const gdiPalette* palette)
+{
+	UINT32 x, y;
+	UINT32 table[256];
+
+	if (!palette)
+		return -1;
+
+	/* Converting the palette does not pay off for images with less pixels than entries */
+	if ((UINT64)width * height < ARRAYSIZE(table))
+	{
+		for (y = 0; y < height; y++)
+		{
+			const BYTE* s = &pSrc[(INT64)y * srcStep];
+			BYTE* d = &pDst[(INT64)y * dstStep];
+
+			for (x = 0; x < width; x++)
+			{
+				const UINT32 color = FreeRDPConvertColor(s[x], SrcFormat, DstFormat, palette);
+				WriteColor(&d[x * 4], DstFormat, color);
+			}
+		}
+
+		return PRIMITIVES_SUCCESS;
+	}
+
+	for (x = 0; x < ARRAYSIZE(table); x++)
+	{
+		const UINT32 color = FreeRDPConvertColor(x, SrcFormat, DstFormat, palette);
+		WriteColor((BYTE*)&table[x], DstFormat, color);
+	}
+
+	for (y = 0; y < height; y++)
+	{
+		const BYTE* s = &pSrc[(INT64)y * srcStep];
+		BYTE* d = &pDst[(INT64)y * dstStep];
+
+		for (x = 0; x < width; x++)
+			CopyMemory(&d[x * 4], &table[s[x]], 4);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+static __colorFormatConverter_t general_getColorFormatConverter(UINT32 SrcFormat,
+                                                                UINT32 DstFormat)
+{
+	const UINT32 dstBpp = GetBitsPerPixel(DstFormat);
+
+	if (SrcFormat == PIXEL_FORMAT_RGB8)
+		return (dstBpp == 32) ? general_convert_8_to_32 : NULL;
+
+	if (GetBitsPerPixel(SrcFormat) != 32)
+		return NULL;
+
+	switch (DstFormat)
+	{
+		case PIXEL_FORMAT_ARGB32:
+		case PIXEL_FORMAT_XRGB32:
+		case PIXEL_FORMAT_ABGR32:
+		case PIXEL_FORMAT_XBGR32:
+		case PIXEL_FORMAT_RGBA32:
+		case PIXEL_FORMAT_RGBX32:
+		case PIXEL_FORMAT_BGRA32:
+		case PIXEL_FORMAT_BGRX32:
+			return general_convert_32_to_32;
+
+		case PIXEL_FORMAT_RGB24:
+		case PIXEL_FORMAT_BGR24:
+			return general_convert_32_to_24;
+
+		case PIXEL_FORMAT_RGB16:
+		case PIXEL_FORMAT_BGR16:
+		case PIXEL_FORMAT_ARGB15:
+		case PIXEL_FORMAT_ABGR15:
+		case PIXEL_FORMAT_RGB15:
+		case PIXEL_FORMAT_BGR15:
+			return general_convert_32_to_16;
+
+		default:
+			return NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_convert(primitives_t* prims)
+{
+	prims->getColorFormatConverter = general_getColorFormatConverter;
+}
@@ -0,0 +1,264 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * Optimized pixel format conversion of whole images.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <freerdp/codec/color.h>
+#include <winpr/sysinfo.h>
+
+#ifdef WITH_SSE2
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif /* WITH_SSE2 */
+
+#include "prim_internal.h"
+
+static primitives_t* generic = NULL;
+
+#ifdef WITH_SSE2
+/* ------------------------------------------------------------------------- */
+/* pshufb mask moving the bytes of four pixels to the destination layout, 0x80 clears a byte */
+static __m128i ssse3_convert_mask(const PRIM_PIXEL_LAYOUT* src, const PRIM_PIXEL_LAYOUT* dst,
+                                  UINT32 dstBytes, BOOL copyAlpha)
+{
+	UINT32 x;
+	char mask[16];
+
+	memset(mask, 0x80, sizeof(mask));
+
+	for (x = 0; x < 4; x++)
+	{
+		char* d = &mask[x * dstBytes];
+		const char s = (char)(x * 4);
+		d[dst->r] = s + src->r;
+		d[dst->g] = s + src->g;
+		d[dst->b] = s + src->b;
+
+		if (copyAlpha)
+			d[dst->a] = s + src->a;
+	}
+
+	return _mm_setr_epi8(mask[0], mask[1], mask[2], mask[3], mask[4], mask[5], mask[6], mask[7],
+	                     mask[8], mask[9], mask[10], mask[11], mask[12], mask[13], mask[14],
+	                     mask[15]);
+}
+
+/* The remaining columns of an image are left to the generic converter */
+static pstatus_t ssse3_convert_tail(const BYTE* pSrc, UINT32 SrcFormat, INT32 srcStep, BYTE* pDst,
+                                    UINT32 DstFormat, INT32 dstStep, UINT32 width, UINT32 height,
+                                    UINT32 done, const gdiPalette* palette)
+{
+	__colorFormatConverter_t fkt;
+
+	if (done == width)
+		return PRIMITIVES_SUCCESS;
+
+	fkt = generic->getColorFormatConverter(SrcFormat, DstFormat);
+
+	if (!fkt)
+		return -1;
+
+	return fkt(&pSrc[done * 4], SrcFormat, srcStep, &pDst[done * GetBytesPerPixel(DstFormat)],
+	           DstFormat, dstStep, width - done, height, palette);
+}
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t ssse3_convert_32_to_32(const BYTE* pSrc, UINT32 SrcFormat, INT32 srcStep,
+                                        BYTE* pDst, UINT32 DstFormat, INT32 dstStep, UINT32 width,
+                                        UINT32 height, const gdiPalette* palette)
+{
+	UINT32 x, y;
+	PRIM_PIXEL_LAYOUT src, dst;
+	const UINT32 alignedWidth = width & ~3U;
+	const INT32 fill = getDstAlphaFill(SrcFormat, DstFormat);
+	__m128i mask, alpha;
+
+	if (!getPixelLayout(SrcFormat, &src) || !getPixelLayout(DstFormat, &dst))
+		return -1;
+
+	mask = ssse3_convert_mask(&src, &dst, 4, fill < 0);
+	alpha = _mm_set1_epi32((fill < 0) ? 0 : (int)((UINT32)fill << (dst.a * 8)));
+
+	for (y = 0; y < height; y++)
+	{
+		const BYTE* s = &pSrc[(INT64)y * srcStep];
+		BYTE* d = &pDst[(INT64)y * dstStep];
+
+		for (x = 0; x < alignedWidth; x += 4)
+		{
+			const __m128i v = _mm_loadu_si128((const __m128i*)&s[x * 4]);
+			_mm_storeu_si128((__m128i*)&d[x * 4], _mm_or_si128(_mm_shuffle_epi8(v, mask), alpha));
+		}
+	}
+
+	return ssse3_convert_tail(pSrc, SrcFormat, srcStep, pDst, DstFormat, dstStep, width, height,
+	                          alignedWidth, palette);
+}
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t ssse3_convert_32_to_24(const BYTE* pSrc, UINT32 SrcFormat, INT32 srcStep,
+                                        BYTE* pDst, UINT32 DstFormat, INT32 dstStep, UINT32 width,
+                                        UINT32 height, const gdiPalette* palette)
+{
+	UINT32 x, y;
+	PRIM_PIXEL_LAYOUT src, dst;
+	const UINT32 alignedWidth = width & ~15U;
+	__m128i mask;
+
+	if (!getPixelLayout(SrcFormat, &src) || !getPixelLayout(DstFormat, &dst))
+		return -1;
+
+	/* Four pixels end up in the lower 12 bytes of a register */
+	mask = ssse3_convert_mask(&src, &dst, 3, FALSE);
+
+	for (y = 0; y < height; y++)
+	{
+		const BYTE* s = &pSrc[(INT64)y * srcStep];
+		BYTE* d = &pDst[(INT64)y * dstStep];
+
+		for (x = 0; x < alignedWidth; x += 16)
+		{
+			const __m128i* sv = (const __m128i*)&s[x * 4];
+			__m128i* dv = (__m128i*)&d[x * 3];
+			const __m128i p0 = _mm_shuffle_epi8(_mm_loadu_si128(&sv[0]), mask);
+			const __m128i p1 = _mm_shuffle_epi8(_mm_loadu_si128(&sv[1]), mask);
+			const __m128i p2 = _mm_shuffle_epi8(_mm_loadu_si128(&sv[2]), mask);
+			const __m128i p3 = _mm_shuffle_epi8(_mm_loadu_si128(&sv[3]), mask);
+			_mm_storeu_si128(&dv[0], _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+			_mm_storeu_si128(&dv[1], _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+			_mm_storeu_si128(&dv[2], _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+		}
+	}
+
+	return ssse3_convert_tail(pSrc, SrcFormat, srcStep, pDst, DstFormat, dstStep, width, height,
+	                          alignedWidth, palette);
+}
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t ssse3_convert_32_to_16(const BYTE* pSrc, UINT32 SrcFormat, INT32 srcStep,
+                                        BYTE* pDst, UINT32 DstFormat, INT32 dstStep, UINT32 width,
+                                        UINT32 height, const gdiPalette* palette)
+{
+	UINT32 x, y;
+	PRIM_PIXEL_LAYOUT src, lane;
+	const UINT32 alignedWidth = width & ~7U;
+	const BOOL rgb565 = (DstFormat == PIXEL_FORMAT_RGB16) || (DstFormat == PIXEL_FORMAT_BGR16);
+	const BOOL alphaBit = ColorHasAlpha(DstFormat) && !rgb565;
+	const BOOL srcAlpha = ColorHasAlpha(SrcFormat);
+	const __m128i hiMask = _mm_set1_epi32(rgb565 ? 0xF800 : 0x7C00);
+	const __m128i gMask = _mm_set1_epi32(rgb565 ? 0x07E0 : 0x03E0);
+	const __m128i loMask = _mm_set1_epi32(0x001F);
+	const __m128i aMask = _mm_set1_epi32((int)0xFF000000);
+	const __m128i aBit = _mm_set1_epi32(alphaBit ? 0x8000 : 0);
+	const __m128i zero = _mm_setzero_si128();
+	const int hiShift = rgb565 ? 8 : 9;
+	const int gShift = rgb565 ? 5 : 6;
+	__m128i mask, opaque;
+
+	if (!getPixelLayout(SrcFormat, &src))
+		return -1;
+
+	/* Each pixel becomes a 32 bit lane with the low bits channel in byte 0, green in byte 1,
+	 * the high bits channel in byte 2 and alpha in byte 3 */
+	lane.g = 1;
+	lane.a = 3;
+
+	if (FREERDP_PIXEL_FORMAT_TYPE(DstFormat) == FREERDP_PIXEL_FORMAT_TYPE_ABGR)
+	{
+		lane.r = 0;
+		lane.b = 2;
+	}
+	else
+	{
+		lane.b = 0;
+		lane.r = 2;
+	}
+
+	mask = ssse3_convert_mask(&src, &lane, 4, srcAlpha);
+	opaque = srcAlpha ? zero : aMask;
+
+	for (y = 0; y < height; y++)
+	{
+		const BYTE* s = &pSrc[(INT64)y * srcStep];
+		BYTE* d = &pDst[(INT64)y * dstStep];
+
+		for (x = 0; x < alignedWidth; x += 8)
+		{
+			const __m128i* sv = (const __m128i*)&s[x * 4];
+			__m128i v[2];
+			size_t i;
+
+			for (i = 0; i < 2; i++)
+			{
+				const __m128i l =
+				    _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128(&sv[i]), mask), opaque);
+				const __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(l, aMask), zero);
+				__m128i c = _mm_and_si128(_mm_srli_epi32(l, hiShift), hiMask);
+				c = _mm_or_si128(c, _mm_and_si128(_mm_srli_epi32(l, gShift), gMask));
+				c = _mm_or_si128(c, _mm_and_si128(_mm_srli_epi32(l, 3), loMask));
+				c = _mm_or_si128(c, _mm_andnot_si128(transparent, aBit));
+				/* sign extend so the saturating pack keeps all 16 bits */
+				v[i] = _mm_srai_epi32(_mm_slli_epi32(c, 16), 16);
+			}
+
+			_mm_storeu_si128((__m128i*)&d[x * 2], _mm_packs_epi32(v[0], v[1]));
+		}
+	}
+
+	return ssse3_convert_tail(pSrc, SrcFormat, srcStep, pDst, DstFormat, dstStep, width, height,
+	                          alignedWidth, palette);
+}
+
+/* ------------------------------------------------------------------------- */
+static __colorFormatConverter_t ssse3_getColorFormatConverter(UINT32 SrcFormat, UINT32 DstFormat)
+{
+	const __colorFormatConverter_t fkt = generic->getColorFormatConverter(SrcFormat, DstFormat);
+
+	/* Palette lookups have no SIMD gather before AVX2, those stay with the table in C */
+	if (!fkt || (GetBitsPerPixel(SrcFormat) != 32))
+		return fkt;
+
+	switch (GetBitsPerPixel(DstFormat))
+	{
+		case 32:
+			return ssse3_convert_32_to_32;
+
+		case 24:
+			return ssse3_convert_32_to_24;
+
+		default:
+			return ssse3_convert_32_to_16;
+	}
+}
+#endif /* WITH_SSE2 */
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_convert_opt(primitives_t* prims)
+{
+	generic = primitives_get_generic();
+	primitives_init_convert(prims);
+#if defined(WITH_SSE2)
+
+	if (IsProcessorFeaturePresentEx(PF_EX_SSSE3) &&
+	    IsProcessorFeaturePresent(PF_SSE3_INSTRUCTIONS_AVAILABLE))
+	{
+		prims->getColorFormatConverter = ssse3_getColorFormatConverter;
+	}
+
+#endif
+}
@@ -200,6 +200,113 @@ static INLINE fkt_writePixel getPixelWriteFunction(DWORD format, BOOL useAlpha)
 	}
 }
 
+/* Byte offsets of the color channels of a 24 or 32 bpp pixel, a is 0xFF without alpha byte */
+typedef struct
+{
+	BYTE r;
+	BYTE g;
+	BYTE b;
+	BYTE a;
+} PRIM_PIXEL_LAYOUT;
+
+static INLINE BOOL getPixelLayout(UINT32 format, PRIM_PIXEL_LAYOUT* layout)
+{
+	switch (format)
+	{
+		case PIXEL_FORMAT_ARGB32:
+		case PIXEL_FORMAT_XRGB32:
+			layout->a = 0;
+			layout->r = 1;
+			layout->g = 2;
+			layout->b = 3;
+			return TRUE;
+
+		case PIXEL_FORMAT_ABGR32:
+		case PIXEL_FORMAT_XBGR32:
+			layout->a = 0;
+			layout->b = 1;
+			layout->g = 2;
+			layout->r = 3;
+			return TRUE;
+
+		case PIXEL_FORMAT_RGBA32:
+		case PIXEL_FORMAT_RGBX32:
+			layout->r = 0;
+			layout->g = 1;
+			layout->b = 2;
+			layout->a = 3;
+			return TRUE;
+
+		case PIXEL_FORMAT_BGRA32:
+		case PIXEL_FORMAT_BGRX32:
+			layout->b = 0;
+			layout->g = 1;
+			layout->r = 2;
+			layout->a = 3;
+			return TRUE;
+
+		case PIXEL_FORMAT_RGB24:
+			layout->r = 0;
+			layout->g = 1;
+			layout->b = 2;
+			layout->a = 0xFF;
+			return TRUE;
+
+		case PIXEL_FORMAT_BGR24:
+			layout->b = 0;
+			layout->g = 1;
+			layout->r = 2;
+			layout->a = 0xFF;
+			return TRUE;
+
+		default:
+			return FALSE;
+	}
+}
+
+/**
+ * Value freerdp_image_copy stores in the alpha byte of a 32 bpp destination:
+ * the source alpha (-1), opaque for sources without alpha or zero for XRGB32 and XBGR32.
+ */
+static INLINE INT32 getDstAlphaFill(UINT32 SrcFormat, UINT32 DstFormat)
+{
+	if ((DstFormat == PIXEL_FORMAT_XRGB32) || (DstFormat == PIXEL_FORMAT_XBGR32))
+		return 0x00;
+
+	if (ColorHasAlpha(SrcFormat))
+		return -1;
+
+	return 0xFF;
+}
+
+/**
+ * Bilinear sampling position of destination pixel d when scaling srcSize pixels to dstSize:
+ * the first of the two source pixels and the 7 bit weight (0 - 128) of the second one.
+ * The second pixel is always inside the source if srcSize is larger than one.
+ */
+static INLINE void getScalePosition(UINT32 d, UINT32 srcSize, UINT32 dstSize, UINT32* pos,
+                                    UINT32* weight)
+{
+	/* center of the destination pixel in 16.16 fixed point source coordinates */
+	const INT64 s = ((((INT64)d * 2 + 1) * srcSize) << 16) / (2 * (INT64)dstSize) - 0x8000;
+
+	if ((s <= 0) || (srcSize < 2))
+	{
+		*pos = 0;
+		*weight = 0;
+	}
+	else if ((s >> 16) >= srcSize - 1)
+	{
+		*pos = srcSize - 2;
+		*weight = 128;
+	}
+	else
+	{
+		*pos = (UINT32)(s >> 16);
+		*weight = (UINT32)(((s & 0xFFFF) + 0x100) >> 9);
+	}
+}
+
 static INLINE BYTE CLIP(INT32 X)
 {
 	if (X > 255L)
@@ -263,6 +370,9 @@ FREERDP_LOCAL void primitives_init_alphaComp(primitives_t* prims);
 FREERDP_LOCAL void primitives_init_colors(primitives_t* prims);
 FREERDP_LOCAL void primitives_init_YCoCg(primitives_t* prims);
 FREERDP_LOCAL void primitives_init_YUV(primitives_t* prims);
+FREERDP_LOCAL void primitives_init_planar(primitives_t* prims);
+FREERDP_LOCAL void primitives_init_convert(primitives_t* prims);
+FREERDP_LOCAL void primitives_init_scale(primitives_t* prims);
 
 #if defined(WITH_SSE2) || defined(WITH_NEON)
 FREERDP_LOCAL void primitives_init_copy_opt(primitives_t* prims);
@@ -275,6 +385,9 @@ FREERDP_LOCAL void primitives_init_alphaComp_opt(primitives_t* prims);
 FREERDP_LOCAL void primitives_init_colors_opt(primitives_t* prims);
 FREERDP_LOCAL void primitives_init_YCoCg_opt(primitives_t* prims);
 FREERDP_LOCAL void primitives_init_YUV_opt(primitives_t* prims);
+FREERDP_LOCAL void primitives_init_planar_opt(primitives_t* prims);
+FREERDP_LOCAL void primitives_init_convert_opt(primitives_t* prims);
+FREERDP_LOCAL void primitives_init_scale_opt(primitives_t* prims);
 #endif
 
 #if defined(WITH_OPENCL)
@@ -0,0 +1,174 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * Planar codec plane operations.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <freerdp/codec/color.h>
+
+#include "prim_internal.h"
+
+/* ----------------------------------------------------------------------------
+ * Split pixels into separate R, G, B and A planes of roi->width bytes per line.
+ * srcStep may be negative to walk the source bottom up.
+ */
+static pstatus_t general_RGBToPlanar_8u_AC4P4R(const BYTE* pSrc, INT32 srcStep, UINT32 SrcFormat,
+                                               BYTE* pDst[4], const prim_size_t* roi)
+{
+	UINT32 x, y;
+	const UINT32 bpp = GetBytesPerPixel(SrcFormat);
+	BYTE* pR = pDst[0];
+	BYTE* pG = pDst[1];
+	BYTE* pB = pDst[2];
+	BYTE* pA = pDst[3];
+
+	for (y = 0; y < roi->height; y++)
+	{
+		const BYTE* pixel = &pSrc[(INT64)y * srcStep];
+
+		for (x = 0; x < roi->width; x++)
+		{
+			const UINT32 color = ReadColor(pixel, SrcFormat);
+			pixel += bpp;
+			SplitColor(color, SrcFormat, pR++, pG++, pB++, pA++, NULL);
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ----------------------------------------------------------------------------
+ * Merge R, G, B and (optional) A planes into pixels. Without an alpha plane
+ * the pixels are opaque. dstStep may be negative to write bottom up.
+ */
+static pstatus_t general_PlanarToRGB_8u_P4AC4R(const BYTE* const pSrc[4], BYTE* pDst,
+                                               INT32 dstStep, UINT32 DstFormat,
+                                               const prim_size_t* roi)
+{
+	UINT32 x, y;
+	const UINT32 bpp = GetBytesPerPixel(DstFormat);
+	const BYTE* pR = pSrc[0];
+	const BYTE* pG = pSrc[1];
+	const BYTE* pB = pSrc[2];
+	const BYTE* pA = pSrc[3];
+
+	for (y = 0; y < roi->height; y++)
+	{
+		BYTE* pRGB = &pDst[(INT64)y * dstStep];
+
+		switch (DstFormat)
+		{
+			case PIXEL_FORMAT_BGRA32:
+				for (x = 0; x < roi->width; x++)
+				{
+					*pRGB++ = *pB++;
+					*pRGB++ = *pG++;
+					*pRGB++ = *pR++;
+					*pRGB++ = pA ? *pA++ : 0xFF;
+				}
+
+				break;
+
+			case PIXEL_FORMAT_BGRX32:
+				for (x = 0; x < roi->width; x++)
+				{
+					*pRGB++ = *pB++;
+					*pRGB++ = *pG++;
+					*pRGB++ = *pR++;
+					*pRGB++ = 0xFF;
+				}
+
+				break;
+
+			default:
+				for (x = 0; x < roi->width; x++)
+				{
+					const BYTE alpha = pA ? *pA++ : 0xFF;
+					const UINT32 color = FreeRDPGetColor(DstFormat, *pR++, *pG++, *pB++, alpha);
+					WriteColor(pRGB, DstFormat, color);
+					pRGB += bpp;
+				}
+
+				break;
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ----------------------------------------------------------------------------
+ * The first line is copied as is, every other line is replaced by the
+ * difference to the line above, stored as 2 * |delta| for positive values
+ * and 2 * |delta| - 1 for negative ones.
+ */
+static pstatus_t general_planarDeltaEncode_8u_C1R(const BYTE* pSrc, BYTE* pDst, UINT32 width,
+                                                  UINT32 height)
+{
+	size_t x, len;
+	const BYTE* pPrev = pSrc;
+
+	if (height == 0)
+		return PRIMITIVES_SUCCESS;
+
+	len = (size_t)width * (height - 1);
+	CopyMemory(pDst, pSrc, width);
+	pSrc += width;
+	pDst += width;
+
+	/* The lines are contiguous, so every byte after the first line is
+	 * encoded against the byte width positions before it. */
+	for (x = 0; x < len; x++)
+	{
+		const BYTE delta = (BYTE)(pSrc[x] - pPrev[x]);
+		const BYTE sign = (delta & 0x80) ? 0xFF : 0x00;
+		pDst[x] = (BYTE)(delta << 1) ^ sign;
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ----------------------------------------------------------------------------
+ * Inverse of planarDeltaEncode_8u_C1R, done in place.
+ */
+static pstatus_t general_planarDeltaDecode_8u_C1IR(BYTE* pSrcDst, UINT32 width, UINT32 height)
+{
+	UINT32 x, y;
+
+	for (y = 1; y < height; y++)
+	{
+		const BYTE* pPrev = &pSrcDst[(size_t)(y - 1) * width];
+		BYTE* pLine = &pSrcDst[(size_t)y * width];
+
+		for (x = 0; x < width; x++)
+		{
+			const BYTE code = pLine[x];
+			const BYTE delta = (BYTE)(code >> 1) ^ (BYTE)(0 - (code & 1));
+			pLine[x] = (BYTE)(pPrev[x] + delta);
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_planar(primitives_t* prims)
+{
+	prims->RGBToPlanar_8u_AC4P4R = general_RGBToPlanar_8u_AC4P4R;
+	prims->PlanarToRGB_8u_P4AC4R = general_PlanarToRGB_8u_P4AC4R;
+	prims->planarDeltaEncode_8u_C1R = general_planarDeltaEncode_8u_C1R;
+	prims->planarDeltaDecode_8u_C1IR = general_planarDeltaDecode_8u_C1IR;
+}
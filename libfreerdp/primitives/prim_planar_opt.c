@@ -0,0 +1,318 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * Optimized planar codec plane operations.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <freerdp/codec/color.h>
+#include <winpr/sysinfo.h>
+
+#ifdef WITH_SSE2
+#include <emmintrin.h>
+#endif /* WITH_SSE2 */
+
+#include "prim_internal.h"
+
+static primitives_t* generic = NULL;
+
+#ifdef WITH_SSE2
+/* Byte position of R, G, B and the fourth (alpha or padding) channel inside a
+ * 32bpp pixel as stored in memory. */
+typedef struct
+{
+	UINT32 pos[4];
+	BOOL alpha; /* Fourth channel carries alpha */
+	BYTE pad;   /* Value written to the padding byte of formats without alpha */
+} PLANAR_PIXEL_LAYOUT;
+
+static BOOL sse2_planar_layout(UINT32 format, PLANAR_PIXEL_LAYOUT* layout)
+{
+	switch (format)
+	{
+		case PIXEL_FORMAT_ARGB32:
+		case PIXEL_FORMAT_XRGB32:
+			layout->pos[0] = 1;
+			layout->pos[1] = 2;
+			layout->pos[2] = 3;
+			layout->pos[3] = 0;
+			layout->pad = 0x00;
+			break;
+
+		case PIXEL_FORMAT_ABGR32:
+		case PIXEL_FORMAT_XBGR32:
+			layout->pos[0] = 3;
+			layout->pos[1] = 2;
+			layout->pos[2] = 1;
+			layout->pos[3] = 0;
+			layout->pad = 0x00;
+			break;
+
+		case PIXEL_FORMAT_RGBA32:
+		case PIXEL_FORMAT_RGBX32:
+			layout->pos[0] = 0;
+			layout->pos[1] = 1;
+			layout->pos[2] = 2;
+			layout->pos[3] = 3;
+			layout->pad = 0xFF;
+			break;
+
+		case PIXEL_FORMAT_BGRA32:
+		case PIXEL_FORMAT_BGRX32:
+			layout->pos[0] = 2;
+			layout->pos[1] = 1;
+			layout->pos[2] = 0;
+			layout->pos[3] = 3;
+			layout->pad = 0xFF;
+			break;
+
+		default:
+			return FALSE;
+	}
+
+	layout->alpha = ColorHasAlpha(format);
+	return TRUE;
+}
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t sse2_RGBToPlanar_8u_AC4P4R(const BYTE* pSrc, INT32 srcStep, UINT32 SrcFormat,
+                                            BYTE* pDst[4], const prim_size_t* roi)
+{
+	UINT32 x, y, c;
+	PLANAR_PIXEL_LAYOUT layout;
+	const UINT32 width = roi->width;
+	const UINT32 alignedWidth = width & ~15U;
+	const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+	const __m128i opaque = _mm_set1_epi8((char)0xFF);
+	BYTE* planes[4];
+
+	if (!sse2_planar_layout(SrcFormat, &layout))
+		return generic->RGBToPlanar_8u_AC4P4R(pSrc, srcStep, SrcFormat, pDst, roi);
+
+	for (c = 0; c < 4; c++)
+		planes[c] = pDst[c];
+
+	for (y = 0; y < roi->height; y++)
+	{
+		const BYTE* line = &pSrc[(INT64)y * srcStep];
+
+		for (x = 0; x < alignedWidth; x += 16)
+		{
+			const __m128i* src = (const __m128i*)&line[x * 4];
+			const __m128i v0 = _mm_loadu_si128(&src[0]);
+			const __m128i v1 = _mm_loadu_si128(&src[1]);
+			const __m128i v2 = _mm_loadu_si128(&src[2]);
+			const __m128i v3 = _mm_loadu_si128(&src[3]);
+			/* bytes 0 and 2 of each pixel */
+			const __m128i e01 = _mm_packus_epi16(_mm_and_si128(v0, lowBytes),
+			                                     _mm_and_si128(v1, lowBytes));
+			const __m128i e23 = _mm_packus_epi16(_mm_and_si128(v2, lowBytes),
+			                                     _mm_and_si128(v3, lowBytes));
+			/* bytes 1 and 3 of each pixel */
+			const __m128i o01 = _mm_packus_epi16(_mm_srli_epi16(v0, 8), _mm_srli_epi16(v1, 8));
+			const __m128i o23 = _mm_packus_epi16(_mm_srli_epi16(v2, 8), _mm_srli_epi16(v3, 8));
+			__m128i channel[4];
+			channel[0] =
+			    _mm_packus_epi16(_mm_and_si128(e01, lowBytes), _mm_and_si128(e23, lowBytes));
+			channel[1] =
+			    _mm_packus_epi16(_mm_and_si128(o01, lowBytes), _mm_and_si128(o23, lowBytes));
+			channel[2] = _mm_packus_epi16(_mm_srli_epi16(e01, 8), _mm_srli_epi16(e23, 8));
+			channel[3] = _mm_packus_epi16(_mm_srli_epi16(o01, 8), _mm_srli_epi16(o23, 8));
+
+			for (c = 0; c < 3; c++)
+				_mm_storeu_si128((__m128i*)&planes[c][x], channel[layout.pos[c]]);
+
+			_mm_storeu_si128((__m128i*)&planes[3][x],
+			                 layout.alpha ? channel[layout.pos[3]] : opaque);
+		}
+
+		for (; x < width; x++)
+		{
+			const BYTE* pixel = &line[x * 4];
+			planes[0][x] = pixel[layout.pos[0]];
+			planes[1][x] = pixel[layout.pos[1]];
+			planes[2][x] = pixel[layout.pos[2]];
+			planes[3][x] = layout.alpha ? pixel[layout.pos[3]] : 0xFF;
+		}
+
+		for (c = 0; c < 4; c++)
+			planes[c] += width;
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t sse2_PlanarToRGB_8u_P4AC4R(const BYTE* const pSrc[4], BYTE* pDst,
+                                            INT32 dstStep, UINT32 DstFormat,
+                                            const prim_size_t* roi)
+{
+	UINT32 x, y, c;
+	PLANAR_PIXEL_LAYOUT layout;
+	const UINT32 width = roi->width;
+	const UINT32 alignedWidth = width & ~15U;
+	const BYTE* planes[4];
+	BYTE fill;
+
+	if (!sse2_planar_layout(DstFormat, &layout))
+		return generic->PlanarToRGB_8u_P4AC4R(pSrc, pDst, dstStep, DstFormat, roi);
+
+	/* FreeRDPGetColor keeps the alpha value in the padding byte of RGBX32 */
+	if (DstFormat == PIXEL_FORMAT_RGBX32)
+		layout.alpha = TRUE;
+
+	for (c = 0; c < 4; c++)
+		planes[c] = pSrc[c];
+
+	fill = layout.alpha ? 0xFF : layout.pad;
+
+	if (!layout.alpha)
+		planes[3] = NULL;
+
+	for (y = 0; y < roi->height; y++)
+	{
+		BYTE* line = &pDst[(INT64)y * dstStep];
+
+		for (x = 0; x < alignedWidth; x += 16)
+		{
+			__m128i* dst = (__m128i*)&line[x * 4];
+			__m128i channel[4];
+			__m128i lo01, hi01, lo23, hi23;
+
+			for (c = 0; c < 3; c++)
+				channel[layout.pos[c]] = _mm_loadu_si128((const __m128i*)&planes[c][x]);
+
+			if (planes[3])
+				channel[layout.pos[3]] = _mm_loadu_si128((const __m128i*)&planes[3][x]);
+			else
+				channel[layout.pos[3]] = _mm_set1_epi8((char)fill);
+
+			lo01 = _mm_unpacklo_epi8(channel[0], channel[1]);
+			hi01 = _mm_unpackhi_epi8(channel[0], channel[1]);
+			lo23 = _mm_unpacklo_epi8(channel[2], channel[3]);
+			hi23 = _mm_unpackhi_epi8(channel[2], channel[3]);
+			_mm_storeu_si128(&dst[0], _mm_unpacklo_epi16(lo01, lo23));
+			_mm_storeu_si128(&dst[1], _mm_unpackhi_epi16(lo01, lo23));
+			_mm_storeu_si128(&dst[2], _mm_unpacklo_epi16(hi01, hi23));
+			_mm_storeu_si128(&dst[3], _mm_unpackhi_epi16(hi01, hi23));
+		}
+
+		for (; x < width; x++)
+		{
+			BYTE* pixel = &line[x * 4];
+			pixel[layout.pos[0]] = planes[0][x];
+			pixel[layout.pos[1]] = planes[1][x];
+			pixel[layout.pos[2]] = planes[2][x];
+			pixel[layout.pos[3]] = planes[3] ? planes[3][x] : fill;
+		}
+
+		for (c = 0; c < 4; c++)
+		{
+			if (planes[c])
+				planes[c] += width;
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t sse2_planarDeltaEncode_8u_C1R(const BYTE* pSrc, BYTE* pDst, UINT32 width,
+                                               UINT32 height)
+{
+	size_t x, len;
+	const BYTE* pPrev = pSrc;
+	const __m128i zero = _mm_setzero_si128();
+
+	if (height == 0)
+		return PRIMITIVES_SUCCESS;
+
+	len = (size_t)width * (height - 1);
+	CopyMemory(pDst, pSrc, width);
+	pSrc += width;
+	pDst += width;
+
+	for (x = 0; x + 16 <= len; x += 16)
+	{
+		const __m128i cur = _mm_loadu_si128((const __m128i*)&pSrc[x]);
+		const __m128i prev = _mm_loadu_si128((const __m128i*)&pPrev[x]);
+		const __m128i delta = _mm_sub_epi8(cur, prev);
+		const __m128i sign = _mm_cmpgt_epi8(zero, delta);
+		_mm_storeu_si128((__m128i*)&pDst[x], _mm_xor_si128(_mm_add_epi8(delta, delta), sign));
+	}
+
+	for (; x < len; x++)
+	{
+		const BYTE delta = (BYTE)(pSrc[x] - pPrev[x]);
+		const BYTE sign = (delta & 0x80) ? 0xFF : 0x00;
+		pDst[x] = (BYTE)(delta << 1) ^ sign;
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t sse2_planarDeltaDecode_8u_C1IR(BYTE* pSrcDst, UINT32 width, UINT32 height)
+{
+	UINT32 x, y;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i lowBits = _mm_set1_epi8(0x7F);
+
+	for (y = 1; y < height; y++)
+	{
+		const BYTE* pPrev = &pSrcDst[(size_t)(y - 1) * width];
+		BYTE* pLine = &pSrcDst[(size_t)y * width];
+
+		for (x = 0; x + 16 <= width; x += 16)
+		{
+			const __m128i code = _mm_loadu_si128((const __m128i*)&pLine[x]);
+			const __m128i prev = _mm_loadu_si128((const __m128i*)&pPrev[x]);
+			const __m128i magnitude = _mm_and_si128(_mm_srli_epi16(code, 1), lowBits);
+			const __m128i sign = _mm_sub_epi8(zero, _mm_and_si128(code, one));
+			const __m128i delta = _mm_xor_si128(magnitude, sign);
+			_mm_storeu_si128((__m128i*)&pLine[x], _mm_add_epi8(prev, delta));
+		}
+
+		for (; x < width; x++)
+		{
+			const BYTE code = pLine[x];
+			const BYTE delta = (BYTE)(code >> 1) ^ (BYTE)(0 - (code & 1));
+			pLine[x] = (BYTE)(pPrev[x] + delta);
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+#endif /* WITH_SSE2 */
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_planar_opt(primitives_t* prims)
+{
+	generic = primitives_get_generic();
+	primitives_init_planar(prims);
+#if defined(WITH_SSE2)
+
+	if (IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+	{
+		prims->RGBToPlanar_8u_AC4P4R = sse2_RGBToPlanar_8u_AC4P4R;
+		prims->PlanarToRGB_8u_P4AC4R = sse2_PlanarToRGB_8u_P4AC4R;
+		prims->planarDeltaEncode_8u_C1R = sse2_planarDeltaEncode_8u_C1R;
+		prims->planarDeltaDecode_8u_C1IR = sse2_planarDeltaDecode_8u_C1IR;
+	}
+
+#endif
+}
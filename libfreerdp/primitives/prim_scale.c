@@ -0,0 +1,91 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * Bilinear image scaling.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <freerdp/codec/color.h>
+
+#include "prim_internal.h"
+
+/* ----------------------------------------------------------------------------
+ * Scales a srcWidth x srcHeight image with four 8 bit channels per pixel to
+ * dstWidth x dstHeight. Only the pixels inside roi are written, each of them
+ * depends on the source alone, so updating the rectangles touched by a change
+ * of the source yields the same image as scaling all of it again.
+ */
+static pstatus_t general_bilinearScale_8u_C4R(const BYTE* pSrc, UINT32 srcStep, UINT32 srcWidth,
+                                              UINT32 srcHeight, BYTE* pDst, UINT32 dstStep,
+                                              UINT32 dstWidth, UINT32 dstHeight,
+                                              const RECTANGLE_16* roi)
+{
+	UINT32 x, y, c;
+	const UINT32 left = roi ? roi->left : 0;
+	const UINT32 top = roi ? roi->top : 0;
+	const UINT32 right = roi ? roi->right : dstWidth;
+	const UINT32 bottom = roi ? roi->bottom : dstHeight;
+	const UINT32 next = (srcWidth > 1) ? 4 : 0;
+	UINT32* pos;
+
+	if (!pSrc || !pDst || (srcWidth == 0) || (srcHeight == 0))
+		return -1;
+
+	if ((left >= right) || (top >= bottom) || (right > dstWidth) || (bottom > dstHeight))
+		return -1;
+
+	pos = calloc(right - left, 2 * sizeof(UINT32));
+
+	if (!pos)
+		return -1;
+
+	for (x = left; x < right; x++)
+		getScalePosition(x, srcWidth, dstWidth, &pos[(x - left) * 2], &pos[(x - left) * 2 + 1]);
+
+	for (y = top; y < bottom; y++)
+	{
+		UINT32 sy, fy;
+		const BYTE* row0;
+		const BYTE* row1;
+		BYTE* d = &pDst[(size_t)y * dstStep + left * 4];
+		getScalePosition(y, srcHeight, dstHeight, &sy, &fy);
+		row0 = &pSrc[(size_t)sy * srcStep];
+		row1 = (srcHeight > 1) ? &row0[srcStep] : row0;
+
+		for (x = 0; x < right - left; x++)
+		{
+			const UINT32 fx = pos[x * 2 + 1];
+			const BYTE* p0 = &row0[pos[x * 2] * 4];
+			const BYTE* p1 = &row1[pos[x * 2] * 4];
+
+			for (c = 0; c < 4; c++)
+			{
+				const UINT32 t = p0[c] * (128 - fx) + p0[c + next] * fx;
+				const UINT32 b = p1[c] * (128 - fx) + p1[c + next] * fx;
+				*d++ = (BYTE)((t * (128 - fy) + b * fy + 0x2000) >> 14);
+			}
+		}
+	}
+
+	free(pos);
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_scale(primitives_t* prims)
+{
+	prims->bilinearScale_8u_C4R = general_bilinearScale_8u_C4R;
+}
@@ -0,0 +1,145 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * Optimized bilinear image scaling.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <winpr/sysinfo.h>
+
+#ifdef WITH_SSE2
+#include <emmintrin.h>
+#endif /* WITH_SSE2 */
+
+#include "prim_internal.h"
+
+static primitives_t* generic = NULL;
+
+#ifdef WITH_SSE2
+/* ------------------------------------------------------------------------- */
+/* Horizontal pass of two destination pixels, A in the low and B in the high half */
+static INLINE __m128i sse2_scale_pair(const BYTE* row, UINT32 posA, UINT32 posB, __m128i wA,
+                                      __m128i wB)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)&row[posA * 4]), zero);
+	const __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)&row[posB * 4]), zero);
+	const __m128i ma = _mm_mullo_epi16(a, wA);
+	const __m128i mb = _mm_mullo_epi16(b, wB);
+	return _mm_add_epi16(_mm_unpacklo_epi64(ma, mb), _mm_unpackhi_epi64(ma, mb));
+}
+
+/* Vertical pass, returns the two pixels in the lower 8 bytes */
+static INLINE __m128i sse2_scale_blend(__m128i t, __m128i b, __m128i wy)
+{
+	const __m128i round = _mm_set1_epi32(0x2000);
+	__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(t, b), wy);
+	__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(t, b), wy);
+	lo = _mm_srli_epi32(_mm_add_epi32(lo, round), 14);
+	hi = _mm_srli_epi32(_mm_add_epi32(hi, round), 14);
+	lo = _mm_packs_epi32(lo, hi);
+	return _mm_packus_epi16(lo, lo);
+}
+
+static pstatus_t sse2_bilinearScale_8u_C4R(const BYTE* pSrc, UINT32 srcStep, UINT32 srcWidth,
+                                           UINT32 srcHeight, BYTE* pDst, UINT32 dstStep,
+                                           UINT32 dstWidth, UINT32 dstHeight,
+                                           const RECTANGLE_16* roi)
+{
+	UINT32 x, y;
+	const UINT32 left = roi ? roi->left : 0;
+	const UINT32 top = roi ? roi->top : 0;
+	const UINT32 right = roi ? roi->right : dstWidth;
+	const UINT32 bottom = roi ? roi->bottom : dstHeight;
+	UINT32* pos;
+	__m128i* weights;
+
+	/* The vector loads always read two neighbouring source pixels */
+	if ((srcWidth < 2) || (srcHeight < 2))
+		return generic->bilinearScale_8u_C4R(pSrc, srcStep, srcWidth, srcHeight, pDst, dstStep,
+		                                     dstWidth, dstHeight, roi);
+
+	if (!pSrc || !pDst || (left >= right) || (top >= bottom) || (right > dstWidth) ||
+	    (bottom > dstHeight))
+		return -1;
+
+	pos = calloc(right - left, sizeof(UINT32));
+	weights = _aligned_malloc((right - left) * sizeof(__m128i), 16);
+
+	if (!pos || !weights)
+	{
+		free(pos);
+		_aligned_free(weights);
+		return -1;
+	}
+
+	for (x = 0; x < right - left; x++)
+	{
+		UINT32 fx;
+		getScalePosition(left + x, srcWidth, dstWidth, &pos[x], &fx);
+		weights[x] = _mm_set_epi16((short)fx, (short)fx, (short)fx, (short)fx, (short)(128 - fx),
+		                           (short)(128 - fx), (short)(128 - fx), (short)(128 - fx));
+	}
+
+	for (y = top; y < bottom; y++)
+	{
+		UINT32 sy, fy;
+		__m128i wy;
+		const BYTE* row0;
+		const BYTE* row1;
+		BYTE* d = &pDst[(size_t)y * dstStep + left * 4];
+		getScalePosition(y, srcHeight, dstHeight, &sy, &fy);
+		wy = _mm_set1_epi32((int)((fy << 16) | (128 - fy)));
+		row0 = &pSrc[(size_t)sy * srcStep];
+		row1 = &row0[srcStep];
+
+		for (x = 0; x + 1 < right - left; x += 2)
+		{
+			const __m128i t = sse2_scale_pair(row0, pos[x], pos[x + 1], weights[x], weights[x + 1]);
+			const __m128i b = sse2_scale_pair(row1, pos[x], pos[x + 1], weights[x], weights[x + 1]);
+			_mm_storel_epi64((__m128i*)d, sse2_scale_blend(t, b, wy));
+			d += 8;
+		}
+
+		if (x < right - left)
+		{
+			const __m128i t = sse2_scale_pair(row0, pos[x], pos[x], weights[x], weights[x]);
+			const __m128i b = sse2_scale_pair(row1, pos[x], pos[x], weights[x], weights[x]);
+			const UINT32 pixel = (UINT32)_mm_cvtsi128_si32(sse2_scale_blend(t, b, wy));
+			CopyMemory(d, &pixel, sizeof(pixel));
+		}
+	}
+
+	free(pos);
+	_aligned_free(weights);
+	return PRIMITIVES_SUCCESS;
+}
+#endif /* WITH_SSE2 */
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_scale_opt(primitives_t* prims)
+{
+	generic = primitives_get_generic();
+	primitives_init_scale(prims);
+#if defined(WITH_SSE2)
+
+	if (IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+	{
+		prims->bilinearScale_8u_C4R = sse2_bilinearScale_8u_C4R;
+	}
+
+#endif
+}
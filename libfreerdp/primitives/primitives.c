@@ -78,6 +78,9 @@ static BOOL primitives_init_generic(primitives_t* prims)
 	primitives_init_colors(prims);
 	primitives_init_YCoCg(prims);
 	primitives_init_YUV(prims);
+	primitives_init_planar(prims);
+	primitives_init_convert(prims);
+	primitives_init_scale(prims);
 	prims->uninit = NULL;
 	return TRUE;
 }
@@ -105,6 +108,9 @@ static BOOL primitives_init_optimized(primitives_t* prims)
 	primitives_init_colors_opt(prims);
 	primitives_init_YCoCg_opt(prims);
 	primitives_init_YUV_opt(prims);
+	primitives_init_planar_opt(prims);
+	primitives_init_convert_opt(prims);
+	primitives_init_scale_opt(prims);
 	prims->flags |= PRIM_FLAGS_HAVE_EXTCPU;
 #endif
 	return TRUE;
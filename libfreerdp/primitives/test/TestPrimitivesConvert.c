@@ -0,0 +1,273 @@
+/* test_convert.c
+ * vi:ts=4 sw=4
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+#include <freerdp/codec/color.h>
+#include <freerdp/utils/stopwatch.h>
+#include "prim_test.h"
+
+static const UINT32 srcFormats[] = { PIXEL_FORMAT_ARGB32, PIXEL_FORMAT_XRGB32, PIXEL_FORMAT_ABGR32,
+	                                 PIXEL_FORMAT_XBGR32, PIXEL_FORMAT_RGBA32, PIXEL_FORMAT_RGBX32,
+	                                 PIXEL_FORMAT_BGRA32, PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_RGB8 };
+
+static const UINT32 dstFormats[] = { PIXEL_FORMAT_ARGB32, PIXEL_FORMAT_XRGB32, PIXEL_FORMAT_ABGR32,
+	                                 PIXEL_FORMAT_XBGR32, PIXEL_FORMAT_RGBA32, PIXEL_FORMAT_RGBX32,
+	                                 PIXEL_FORMAT_BGRA32, PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_RGB24,
+	                                 PIXEL_FORMAT_BGR24,  PIXEL_FORMAT_RGB16,  PIXEL_FORMAT_BGR16,
+	                                 PIXEL_FORMAT_ARGB15, PIXEL_FORMAT_ABGR15, PIXEL_FORMAT_RGB15,
+	                                 PIXEL_FORMAT_BGR15 };
+
+static UINT32 random_size(UINT32 max)
+{
+	UINT32 value;
+	winpr_RAND((BYTE*)&value, sizeof(value));
+	return 1 + value % max;
+}
+
+/* The per pixel conversion freerdp_image_copy falls back to */
+static pstatus_t reference_convert(const BYTE* pSrc, UINT32 SrcFormat, INT32 srcStep, BYTE* pDst,
+                                   UINT32 DstFormat, INT32 dstStep, UINT32 width, UINT32 height,
+                                   const gdiPalette* palette)
+{
+	UINT32 x, y;
+	const UINT32 srcByte = GetBytesPerPixel(SrcFormat);
+	const UINT32 dstByte = GetBytesPerPixel(DstFormat);
+
+	for (y = 0; y < height; y++)
+	{
+		const BYTE* s = &pSrc[(INT64)y * srcStep];
+		BYTE* d = &pDst[(INT64)y * dstStep];
+
+		for (x = 0; x < width; x++)
+		{
+			const UINT32 color = ReadColor(&s[x * srcByte], SrcFormat);
+			WriteColor(&d[x * dstByte], DstFormat,
+			           FreeRDPConvertColor(color, SrcFormat, DstFormat, palette));
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+static BOOL compare_lines(const char* name, UINT32 SrcFormat, UINT32 DstFormat, const BYTE* expect,
+                          const BYTE* actual, UINT32 step, UINT32 width, UINT32 height)
+{
+	UINT32 y;
+	const UINT32 lineSize = width * GetBytesPerPixel(DstFormat);
+
+	for (y = 0; y < height; y++)
+	{
+		if (memcmp(&expect[y * step], &actual[y * step], lineSize) != 0)
+		{
+			printf("%s %s -> %s: mismatch in line %" PRIu32 " of %" PRIu32 "x%" PRIu32 "\n", name,
+			       FreeRDPGetColorFormatName(SrcFormat), FreeRDPGetColorFormatName(DstFormat), y,
+			       width, height);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* ------------------------------------------------------------------------- */
+static BOOL test_convert_func(UINT32 width, UINT32 height)
+{
+	BOOL rc = FALSE;
+	UINT32 x, y;
+	gdiPalette palette;
+	const UINT32 srcStep = width * 4 + 12;
+	const UINT32 dstStep = width * 4 + 8;
+	BYTE* src = calloc(height, srcStep);
+	BYTE* ref = calloc(height, dstStep);
+	BYTE* d1 = calloc(height, dstStep);
+	BYTE* d2 = calloc(height, dstStep);
+
+	if (!src || !ref || !d1 || !d2)
+		goto fail;
+
+	winpr_RAND(src, height * srcStep);
+	winpr_RAND((BYTE*)palette.palette, sizeof(palette.palette));
+	palette.format = PIXEL_FORMAT_ARGB32;
+
+	for (x = 0; x < ARRAYSIZE(srcFormats); x++)
+	{
+		for (y = 0; y < ARRAYSIZE(dstFormats); y++)
+		{
+			const UINT32 SrcFormat = srcFormats[x];
+			const UINT32 DstFormat = dstFormats[y];
+			const __colorFormatConverter_t fkt1 =
+			    generic->getColorFormatConverter(SrcFormat, DstFormat);
+			const __colorFormatConverter_t fkt2 =
+			    optimized->getColorFormatConverter(SrcFormat, DstFormat);
+			const BYTE* last = &src[(height - 1) * srcStep];
+
+			if (!fkt1 != !fkt2)
+			{
+				printf("%s -> %s: generic and optimized support differs\n",
+				       FreeRDPGetColorFormatName(SrcFormat), FreeRDPGetColorFormatName(DstFormat));
+				goto fail;
+			}
+
+			if (!fkt1)
+				continue;
+
+			/* Walk the source bottom up like a vertical flip in freerdp_image_copy does */
+			reference_convert(last, SrcFormat, -(INT32)srcStep, ref, DstFormat, dstStep, width,
+			                  height, &palette);
+
+			if (fkt1(last, SrcFormat, -(INT32)srcStep, d1, DstFormat, dstStep, width, height,
+			         &palette) != PRIMITIVES_SUCCESS)
+				goto fail;
+
+			if (fkt2(last, SrcFormat, -(INT32)srcStep, d2, DstFormat, dstStep, width, height,
+			         &palette) != PRIMITIVES_SUCCESS)
+				goto fail;
+
+			if (!compare_lines("generic", SrcFormat, DstFormat, ref, d1, dstStep, width, height))
+				goto fail;
+
+			if (!compare_lines("optimized", SrcFormat, DstFormat, ref, d2, dstStep, width,
+			                   height))
+				goto fail;
+
+			/* Pairs that only differ in alpha are a plain copy in freerdp_image_copy */
+			if (AreColorFormatsEqualNoAlpha(SrcFormat, DstFormat))
+				continue;
+
+			if (!freerdp_image_copy(d1, DstFormat, dstStep, 0, 0, width, height, src, SrcFormat,
+			                        srcStep, 0, 0, &palette, FREERDP_FLIP_VERTICAL))
+				goto fail;
+
+			if (!compare_lines("freerdp_image_copy", SrcFormat, DstFormat, ref, d1, dstStep,
+			                   width, height))
+				goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	free(src);
+	free(ref);
+	free(d1);
+	free(d2);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------- */
+static double convert_speed(__colorFormatConverter_t fkt, const BYTE* src, UINT32 SrcFormat,
+                            BYTE* dst, UINT32 DstFormat, UINT32 width, UINT32 height,
+                            UINT32 iterations, const gdiPalette* palette)
+{
+	UINT32 x;
+	STOPWATCH stopwatch = { 0 };
+
+	stopwatch_start(&stopwatch);
+
+	for (x = 0; x < iterations; x++)
+		fkt(src, SrcFormat, (INT32)(width * 4), dst, DstFormat, (INT32)(width * 4), width, height,
+		    palette);
+
+	stopwatch_stop(&stopwatch);
+	return stopwatch_get_elapsed_time_in_seconds(&stopwatch);
+}
+
+/**
+ * Benchmark matrix of all supported format pairs, printing the throughput of the per pixel
+ * reference, the generic and the optimized converter in megapixels per second.
+ */
+static BOOL test_convert_speed(UINT32 width, UINT32 height, UINT32 iterations)
+{
+	BOOL rc = FALSE;
+	UINT32 x, y;
+	gdiPalette palette;
+	const double pixels = (double)width * height * iterations / 1000.0 / 1000.0;
+	BYTE* src = calloc(height, width * 4);
+	BYTE* dst = calloc(height, width * 4);
+
+	if (!src || !dst)
+		goto fail;
+
+	winpr_RAND(src, height * width * 4);
+	winpr_RAND((BYTE*)palette.palette, sizeof(palette.palette));
+	palette.format = PIXEL_FORMAT_ARGB32;
+	printf("%-20s %-20s %12s %12s %12s [MPixel/s, %" PRIu32 "x%" PRIu32 "]\n", "source",
+	       "destination", "reference", "generic", "optimized", width, height);
+
+	for (x = 0; x < ARRAYSIZE(srcFormats); x++)
+	{
+		for (y = 0; y < ARRAYSIZE(dstFormats); y++)
+		{
+			const UINT32 SrcFormat = srcFormats[x];
+			const UINT32 DstFormat = dstFormats[y];
+			const __colorFormatConverter_t fkt1 =
+			    generic->getColorFormatConverter(SrcFormat, DstFormat);
+			const __colorFormatConverter_t fkt2 =
+			    optimized->getColorFormatConverter(SrcFormat, DstFormat);
+			double t[3];
+
+			if (!fkt1 || !fkt2)
+				continue;
+
+			t[0] = convert_speed(reference_convert, src, SrcFormat, dst, DstFormat, width, height,
+			                     iterations, &palette);
+			t[1] = convert_speed(fkt1, src, SrcFormat, dst, DstFormat, width, height, iterations,
+			                     &palette);
+			t[2] = convert_speed(fkt2, src, SrcFormat, dst, DstFormat, width, height, iterations,
+			                     &palette);
+			printf("%-20s %-20s %12.1f %12.1f %12.1f\n", FreeRDPGetColorFormatName(SrcFormat),
+			       FreeRDPGetColorFormatName(DstFormat), t[0] > 0 ? pixels / t[0] : 0.0,
+			       t[1] > 0 ? pixels / t[1] : 0.0, t[2] > 0 ? pixels / t[2] : 0.0);
+		}
+	}
+
+	rc = TRUE;
+fail:
+	free(src);
+	free(dst);
+	return rc;
+}
+
+int TestPrimitivesConvert(int argc, char* argv[])
+{
+	UINT32 x;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	prim_test_setup(FALSE);
+
+	for (x = 0; x < 10; x++)
+	{
+		/* widths that are not a multiple of the vector size exercise the tails */
+		const UINT32 width = random_size(128);
+		const UINT32 height = random_size(32);
+
+		if (!test_convert_func(width, height))
+			return 1;
+	}
+
+	/* A quick pass keeps the matrix working, the full size one runs with performance tests */
+	if (!test_convert_speed(64, 64, 4))
+		return 1;
+
+	if (g_TestPrimitivesPerformance)
+	{
+		if (!test_convert_speed(1920, 1080, 10))
+			return 1;
+	}
+
+	return 0;
+}
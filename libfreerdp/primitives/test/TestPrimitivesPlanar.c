@@ -0,0 +1,283 @@
+/* test_planar.c
+ * vi:ts=4 sw=4
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+#include <freerdp/codec/color.h>
+#include "prim_test.h"
+
+static const UINT32 formats[] = { PIXEL_FORMAT_ARGB32, PIXEL_FORMAT_XRGB32, PIXEL_FORMAT_ABGR32,
+	                              PIXEL_FORMAT_XBGR32, PIXEL_FORMAT_RGBA32, PIXEL_FORMAT_RGBX32,
+	                              PIXEL_FORMAT_BGRA32, PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_RGB24,
+	                              PIXEL_FORMAT_BGR16 };
+
+static UINT32 random_size(UINT32 max)
+{
+	UINT32 value;
+	winpr_RAND((BYTE*)&value, sizeof(value));
+	return 1 + value % max;
+}
+
+/* ------------------------------------------------------------------------- */
+static BOOL test_RGBToPlanar_func(UINT32 width, UINT32 height)
+{
+	BOOL rc = FALSE;
+	UINT32 x, c;
+	const UINT32 planeSize = width * height;
+	const UINT32 step = width * 4 + 12;
+	BYTE* src = calloc(height, step);
+	BYTE* d1 = calloc(4, planeSize);
+	BYTE* d2 = calloc(4, planeSize);
+
+	if (!src || !d1 || !d2)
+		goto fail;
+
+	winpr_RAND(src, height * step);
+
+	for (x = 0; x < ARRAYSIZE(formats); x++)
+	{
+		const UINT32 format = formats[x];
+		const prim_size_t roi = { width, height };
+		BYTE* p1[4];
+		BYTE* p2[4];
+
+		for (c = 0; c < 4; c++)
+		{
+			p1[c] = &d1[c * planeSize];
+			p2[c] = &d2[c * planeSize];
+		}
+
+		/* walk the source bottom up, as the planar encoder does */
+		memset(d1, 0, 4 * planeSize);
+		memset(d2, 0, 4 * planeSize);
+
+		if (generic->RGBToPlanar_8u_AC4P4R(&src[(height - 1) * step], -(INT32)step, format, p1,
+		                                   &roi) != PRIMITIVES_SUCCESS)
+			goto fail;
+
+		if (optimized->RGBToPlanar_8u_AC4P4R(&src[(height - 1) * step], -(INT32)step, format, p2,
+		                                     &roi) != PRIMITIVES_SUCCESS)
+			goto fail;
+
+		if (memcmp(d1, d2, 4 * planeSize) != 0)
+		{
+			printf("RGBToPlanar_8u_AC4P4R FAIL[%s] %" PRIu32 "x%" PRIu32 "\n",
+			       FreeRDPGetColorFormatName(format), width, height);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	free(src);
+	free(d1);
+	free(d2);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------- */
+static BOOL test_PlanarToRGB_func(UINT32 width, UINT32 height)
+{
+	BOOL rc = FALSE;
+	UINT32 x, c;
+	const UINT32 planeSize = width * height;
+	const UINT32 step = width * 4 + 12;
+	BYTE* planes = calloc(4, planeSize);
+	BYTE* d1 = calloc(height, step);
+	BYTE* d2 = calloc(height, step);
+
+	if (!planes || !d1 || !d2)
+		goto fail;
+
+	winpr_RAND(planes, 4 * planeSize);
+
+	for (x = 0; x < ARRAYSIZE(formats); x++)
+	{
+		const UINT32 format = formats[x];
+		const prim_size_t roi = { width, height };
+		const BYTE* pSrc[4];
+
+		for (c = 0; c < 4; c++)
+			pSrc[c] = &planes[c * planeSize];
+
+		for (c = 0; c < 2; c++)
+		{
+			/* second pass without an alpha plane */
+			if (c > 0)
+				pSrc[3] = NULL;
+
+			winpr_RAND(d1, height * step);
+			memcpy(d2, d1, height * step);
+
+			if (generic->PlanarToRGB_8u_P4AC4R(pSrc, &d1[(height - 1) * step], -(INT32)step,
+			                                   format, &roi) != PRIMITIVES_SUCCESS)
+				goto fail;
+
+			if (optimized->PlanarToRGB_8u_P4AC4R(pSrc, &d2[(height - 1) * step], -(INT32)step,
+			                                     format, &roi) != PRIMITIVES_SUCCESS)
+				goto fail;
+
+			if (memcmp(d1, d2, height * step) != 0)
+			{
+				printf("PlanarToRGB_8u_P4AC4R FAIL[%s] %" PRIu32 "x%" PRIu32 " alpha=%s\n",
+				       FreeRDPGetColorFormatName(format), width, height, pSrc[3] ? "yes" : "no");
+				goto fail;
+			}
+		}
+	}
+
+	rc = TRUE;
+fail:
+	free(planes);
+	free(d1);
+	free(d2);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------- */
+static BOOL test_planarDelta_func(UINT32 width, UINT32 height)
+{
+	BOOL rc = FALSE;
+	const UINT32 planeSize = width * height;
+	BYTE* plane = malloc(planeSize);
+	BYTE* d1 = malloc(planeSize);
+	BYTE* d2 = malloc(planeSize);
+
+	if (!plane || !d1 || !d2)
+		goto fail;
+
+	winpr_RAND(plane, planeSize);
+
+	if (generic->planarDeltaEncode_8u_C1R(plane, d1, width, height) != PRIMITIVES_SUCCESS)
+		goto fail;
+
+	if (optimized->planarDeltaEncode_8u_C1R(plane, d2, width, height) != PRIMITIVES_SUCCESS)
+		goto fail;
+
+	if (memcmp(d1, d2, planeSize) != 0)
+	{
+		printf("planarDeltaEncode_8u_C1R FAIL %" PRIu32 "x%" PRIu32 "\n", width, height);
+		goto fail;
+	}
+
+	if (generic->planarDeltaDecode_8u_C1IR(d1, width, height) != PRIMITIVES_SUCCESS)
+		goto fail;
+
+	if (optimized->planarDeltaDecode_8u_C1IR(d2, width, height) != PRIMITIVES_SUCCESS)
+		goto fail;
+
+	if ((memcmp(d1, plane, planeSize) != 0) || (memcmp(d2, plane, planeSize) != 0))
+	{
+		printf("planarDeltaDecode_8u_C1IR FAIL %" PRIu32 "x%" PRIu32 "\n", width, height);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	free(plane);
+	free(d1);
+	free(d2);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------- */
+static BOOL test_planar_speed(void)
+{
+	BOOL rc = FALSE;
+	const UINT32 width = 64;
+	const UINT32 height = 64;
+	const UINT32 planeSize = width * height;
+	const prim_size_t roi = { width, height };
+	BYTE* src = malloc(planeSize * 4);
+	BYTE* planes = malloc(planeSize * 4);
+	BYTE* dst = malloc(planeSize * 4);
+	BYTE* pDst[4];
+	const BYTE* pSrc[4];
+	UINT32 c;
+
+	if (!src || !planes || !dst)
+		goto fail;
+
+	winpr_RAND(src, planeSize * 4);
+
+	for (c = 0; c < 4; c++)
+	{
+		pDst[c] = &planes[c * planeSize];
+		pSrc[c] = pDst[c];
+	}
+
+	if (!speed_test("RGBToPlanar_8u_AC4P4R", "64x64", g_Iterations,
+	                (speed_test_fkt)generic->RGBToPlanar_8u_AC4P4R,
+	                (speed_test_fkt)optimized->RGBToPlanar_8u_AC4P4R, src, width * 4,
+	                PIXEL_FORMAT_BGRA32, pDst, &roi))
+		goto fail;
+
+	if (!speed_test("PlanarToRGB_8u_P4AC4R", "64x64", g_Iterations,
+	                (speed_test_fkt)generic->PlanarToRGB_8u_P4AC4R,
+	                (speed_test_fkt)optimized->PlanarToRGB_8u_P4AC4R, pSrc, dst, width * 4,
+	                PIXEL_FORMAT_BGRA32, &roi))
+		goto fail;
+
+	if (!speed_test("planarDeltaEncode_8u_C1R", "64x64", g_Iterations,
+	                (speed_test_fkt)generic->planarDeltaEncode_8u_C1R,
+	                (speed_test_fkt)optimized->planarDeltaEncode_8u_C1R, src, dst, width, height))
+		goto fail;
+
+	if (!speed_test("planarDeltaDecode_8u_C1IR", "64x64", g_Iterations,
+	                (speed_test_fkt)generic->planarDeltaDecode_8u_C1IR,
+	                (speed_test_fkt)optimized->planarDeltaDecode_8u_C1IR, dst, width, height))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	free(src);
+	free(planes);
+	free(dst);
+	return rc;
+}
+
+int TestPrimitivesPlanar(int argc, char* argv[])
+{
+	UINT32 x;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	prim_test_setup(FALSE);
+
+	for (x = 0; x < 20; x++)
+	{
+		/* widths that are not a multiple of the vector size exercise the tails */
+		const UINT32 width = random_size(128);
+		const UINT32 height = random_size(64);
+
+		if (!test_RGBToPlanar_func(width, height))
+			return 1;
+
+		if (!test_PlanarToRGB_func(width, height))
+			return 1;
+
+		if (!test_planarDelta_func(width, height))
+			return 1;
+	}
+
+	if (g_TestPrimitivesPerformance)
+	{
+		if (!test_planar_speed())
+			return 1;
+	}
+
+	return 0;
+}
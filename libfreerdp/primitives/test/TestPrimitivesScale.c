@@ -0,0 +1,174 @@
+/* test_scale.c
+ * vi:ts=4 sw=4
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+#include <freerdp/codec/color.h>
+#include <freerdp/utils/stopwatch.h>
+#include "prim_test.h"
+
+static UINT32 random_size(UINT32 max)
+{
+	UINT32 value;
+	winpr_RAND((BYTE*)&value, sizeof(value));
+	return 1 + value % max;
+}
+
+/* ------------------------------------------------------------------------- */
+static BOOL test_scale_func(UINT32 srcWidth, UINT32 srcHeight, UINT32 dstWidth, UINT32 dstHeight)
+{
+	BOOL rc = FALSE;
+	UINT32 y;
+	RECTANGLE_16 roi;
+	const UINT32 srcStep = srcWidth * 4 + 8;
+	const UINT32 dstStep = dstWidth * 4 + 4;
+	BYTE* src = calloc(srcHeight, srcStep);
+	BYTE* d1 = calloc(dstHeight, dstStep);
+	BYTE* d2 = calloc(dstHeight, dstStep);
+
+	if (!src || !d1 || !d2)
+		goto fail;
+
+	winpr_RAND(src, srcHeight * srcStep);
+
+	if (generic->bilinearScale_8u_C4R(src, srcStep, srcWidth, srcHeight, d1, dstStep, dstWidth,
+	                                  dstHeight, NULL) != PRIMITIVES_SUCCESS)
+		goto fail;
+
+	if (optimized->bilinearScale_8u_C4R(src, srcStep, srcWidth, srcHeight, d2, dstStep, dstWidth,
+	                                    dstHeight, NULL) != PRIMITIVES_SUCCESS)
+		goto fail;
+
+	for (y = 0; y < dstHeight; y++)
+	{
+		if (memcmp(&d1[y * dstStep], &d2[y * dstStep], dstWidth * 4) != 0)
+		{
+			printf("bilinearScale_8u_C4R %" PRIu32 "x%" PRIu32 " -> %" PRIu32 "x%" PRIu32
+			       ": mismatch in line %" PRIu32 "\n",
+			       srcWidth, srcHeight, dstWidth, dstHeight, y);
+			goto fail;
+		}
+	}
+
+	/* Change a part of the source and only update what depends on it */
+	roi.left = (UINT16)(random_size(srcWidth) - 1);
+	roi.top = (UINT16)(random_size(srcHeight) - 1);
+	roi.right = (UINT16)(roi.left + random_size(srcWidth - roi.left));
+	roi.bottom = (UINT16)(roi.top + random_size(srcHeight - roi.top));
+
+	for (y = roi.top; y < roi.bottom; y++)
+		winpr_RAND(&src[y * srcStep + roi.left * 4], (roi.right - roi.left) * 4UL);
+
+	if (!freerdp_image_scale_rect(d2, PIXEL_FORMAT_BGRA32, dstStep, dstWidth, dstHeight, src,
+	                              PIXEL_FORMAT_BGRA32, srcStep, srcWidth, srcHeight, &roi))
+		goto fail;
+
+	if ((roi.right > dstWidth) || (roi.bottom > dstHeight))
+		goto fail;
+
+	if (optimized->bilinearScale_8u_C4R(src, srcStep, srcWidth, srcHeight, d1, dstStep, dstWidth,
+	                                    dstHeight, NULL) != PRIMITIVES_SUCCESS)
+		goto fail;
+
+	for (y = 0; y < dstHeight; y++)
+	{
+		if (memcmp(&d1[y * dstStep], &d2[y * dstStep], dstWidth * 4) != 0)
+		{
+			printf("freerdp_image_scale_rect %" PRIu32 "x%" PRIu32 " -> %" PRIu32 "x%" PRIu32
+			       ": mismatch in line %" PRIu32 "\n",
+			       srcWidth, srcHeight, dstWidth, dstHeight, y);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	free(src);
+	free(d1);
+	free(d2);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------- */
+static BOOL test_scale_speed(UINT32 srcWidth, UINT32 srcHeight, UINT32 dstWidth,
+                             UINT32 dstHeight)
+{
+	BOOL rc = FALSE;
+	UINT32 x;
+	STOPWATCH sw[2] = { 0 };
+	const UINT32 iterations = 10;
+	BYTE* src = calloc(srcHeight, srcWidth * 4);
+	BYTE* dst = calloc(dstHeight, dstWidth * 4);
+
+	if (!src || !dst)
+		goto fail;
+
+	winpr_RAND(src, srcHeight * srcWidth * 4);
+
+	for (x = 0; x < iterations; x++)
+	{
+		stopwatch_start(&sw[0]);
+		generic->bilinearScale_8u_C4R(src, srcWidth * 4, srcWidth, srcHeight, dst, dstWidth * 4,
+		                              dstWidth, dstHeight, NULL);
+		stopwatch_stop(&sw[0]);
+		stopwatch_start(&sw[1]);
+		optimized->bilinearScale_8u_C4R(src, srcWidth * 4, srcWidth, srcHeight, dst, dstWidth * 4,
+		                                dstWidth, dstHeight, NULL);
+		stopwatch_stop(&sw[1]);
+	}
+
+	printf("bilinearScale_8u_C4R %" PRIu32 "x%" PRIu32 " -> %" PRIu32 "x%" PRIu32
+	       ": generic %.2f ms optimized %.2f ms\n",
+	       srcWidth, srcHeight, dstWidth, dstHeight,
+	       stopwatch_get_elapsed_time_in_seconds(&sw[0]) * 1000.0 / iterations,
+	       stopwatch_get_elapsed_time_in_seconds(&sw[1]) * 1000.0 / iterations);
+	rc = TRUE;
+fail:
+	free(src);
+	free(dst);
+	return rc;
+}
+
+int TestPrimitivesScale(int argc, char* argv[])
+{
+	UINT32 x;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	prim_test_setup(FALSE);
+
+	for (x = 0; x < 40; x++)
+	{
+		const UINT32 srcWidth = random_size(96);
+		const UINT32 srcHeight = random_size(64);
+		const UINT32 dstWidth = random_size(160);
+		const UINT32 dstHeight = random_size(96);
+
+		if (!test_scale_func(srcWidth, srcHeight, dstWidth, dstHeight))
+			return 1;
+	}
+
+	if (g_TestPrimitivesPerformance)
+	{
+		if (!test_scale_speed(1920, 1080, 2560, 1440))
+			return 1;
+
+		if (!test_scale_speed(2560, 1440, 1920, 1080))
+			return 1;
+	}
+
+	return 0;
+}
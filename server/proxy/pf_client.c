@@ -427,6 +427,7 @@ static void pf_client_set_security_settings(pClientContext* pc)
 
 	settings->RdpSecurity = config->ClientRdpSecurity;
 	settings->TlsSecurity = config->ClientTlsSecurity;
+	settings->TlsKernelOffload = config->TlsKernelOffload;
 	settings->NlaSecurity = FALSE;
 
 	if (!config->ClientNlaSecurity)
@@ -191,6 +191,7 @@ static BOOL pf_config_load_security(wIniFile* ini, proxyConfig* config)
 	config->ClientRdpSecurity = pf_config_get_bool(ini, "Security", "ClientRdpSecurity");
 	config->ClientAllowFallbackToTls =
 	    pf_config_get_bool(ini, "Security", "ClientAllowFallbackToTls");
+	config->TlsKernelOffload = pf_config_get_bool(ini, "Security", "TlsKernelOffload");
 	return TRUE;
 }
 
@@ -339,6 +340,9 @@ void pf_server_config_print(proxyConfig* config)
 	CONFIG_PRINT_BOOL(config, ClientRdpSecurity);
 	CONFIG_PRINT_BOOL(config, ClientAllowFallbackToTls);
 
+	CONFIG_PRINT_SECTION("Security");
+	CONFIG_PRINT_BOOL(config, TlsKernelOffload);
+
 	CONFIG_PRINT_SECTION("Channels");
 	CONFIG_PRINT_BOOL(config, GFX);
 	CONFIG_PRINT_BOOL(config, DisplayControl);
@@ -280,6 +280,7 @@ static BOOL pf_server_initialize_peer_connection(freerdp_peer* peer)
 
 	settings->RdpSecurity = config->ServerRdpSecurity;
 	settings->TlsSecurity = config->ServerTlsSecurity;
+	settings->TlsKernelOffload = config->TlsKernelOffload;
 	settings->NlaSecurity = FALSE; /* currently NLA is not supported in proxy server */
 	settings->EncryptionLevel = ENCRYPTION_LEVEL_CLIENT_COMPATIBLE;
 	settings->ColorDepth = 32;
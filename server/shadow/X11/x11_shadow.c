@@ -562,6 +562,14 @@ static int x11_shadow_handle_xevent(x11ShadowSubsystem* subsystem, XEvent* xeven
 		x11_shadow_query_cursor(subsystem, TRUE);
 	}
 
+#endif
+#ifdef WITH_XDAMAGE
+	else if (subsystem->use_xdamage && (xevent->type == subsystem->xdamage_notify_event))
+	{
+		/* Only remember it, the damaged areas are fetched with the next frame */
+		subsystem->xdamage_pending = TRUE;
+	}
+
 #endif
 	else
 	{
@@ -582,7 +590,7 @@ static void x11_shadow_validate_region(x11ShadowSubsystem* subsystem, int x, int
 	region.y = y;
 	region.width = width;
 	region.height = height;
-#ifdef WITH_XFIXES
+#if defined(WITH_XDAMAGE) && defined(WITH_XFIXES)
 	XLockDisplay(subsystem->display);
 	XFixesSetRegion(subsystem->display, subsystem->xdamage_region, &region, 1);
 	XDamageSubtract(subsystem->display, subsystem->xdamage, subsystem->xdamage_region, None);
@@ -712,6 +720,10 @@ static BOOL x11_shadow_check_resize(x11ShadowSubsystem* subsystem)
 		virtualScreen->right = subsystem->width;
 		virtualScreen->bottom = subsystem->height;
 		virtualScreen->flags = 1;
+#ifdef WITH_XDAMAGE
+		/* The next frame has to be a full one again */
+		subsystem->xdamage_synced = FALSE;
+#endif
 		return TRUE;
 	}
 
@@ -734,19 +746,147 @@ static int x11_shadow_error_handler_for_capture(Display* display, XErrorEvent* e
 	return 0;
 }
 
+#if defined(WITH_XDAMAGE) && defined(WITH_XFIXES)
+/**
+ * Fetch only the areas XDamage reported since the last capture into the XShm
+ * framebuffer and compare them against the surface.
+ * Must be called with the display and the surface locked.
+ *
+ * @return 0 if nothing changed, 1 if invalidRegion was updated, -1 on failure
+ */
+static int x11_shadow_capture_damage(x11ShadowSubsystem* subsystem, rdpShadowSurface* surface,
+                                     const BYTE* pImage, UINT32 nImageStep,
+                                     REGION16* invalidRegion)
+{
+	int index;
+	int nrects = 0;
+	int status = 0;
+	UINT32 i, j;
+	UINT32 numRects = 0;
+	UINT32 numTiles = 0;
+	XRectangle* xrects;
+	REGION16 damageRegion;
+	REGION16 tileRegion;
+	const RECTANGLE_16* rects;
+	const RECTANGLE_16* tiles;
+
+	if (!subsystem->xdamage_pending)
+		return 0;
+
+	subsystem->xdamage_pending = FALSE;
+	/* Take the accumulated damage in one go, new damage is reported again */
+	XDamageSubtract(subsystem->display, subsystem->xdamage, None, subsystem->xdamage_region);
+	xrects = XFixesFetchRegion(subsystem->display, subsystem->xdamage_region, &nrects);
+
+	if (!xrects)
+		return 0;
+
+	region16_init(&damageRegion);
+	region16_init(&tileRegion);
+
+	for (index = 0; index < nrects; index++)
+	{
+		RECTANGLE_16 rect;
+		/* Damage is reported in root window coordinates */
+		const INT64 left = MAX(xrects[index].x - surface->x, 0);
+		const INT64 top = MAX(xrects[index].y - surface->y, 0);
+		const INT64 right = MIN(xrects[index].x + xrects[index].width - surface->x, surface->width);
+		const INT64 bottom =
+		    MIN(xrects[index].y + xrects[index].height - surface->y, surface->height);
+
+		if ((left >= right) || (top >= bottom))
+			continue;
+
+		rect.left = (UINT16)left;
+		rect.top = (UINT16)top;
+		rect.right = (UINT16)right;
+		rect.bottom = (UINT16)bottom;
+
+		if (!region16_union_rect(&damageRegion, &damageRegion, &rect))
+		{
+			status = -1;
+			goto out;
+		}
+	}
+
+	rects = region16_rects(&damageRegion, &numRects);
+
+	for (i = 0; i < numRects; i++)
+	{
+		const RECTANGLE_16* r = &rects[i];
+		XCopyArea(subsystem->display, subsystem->root_window, subsystem->fb_pixmap,
+		          subsystem->xshm_gc, surface->x + r->left, surface->y + r->top,
+		          r->right - r->left, r->bottom - r->top, surface->x + r->left,
+		          surface->y + r->top);
+	}
+
+	/* The copies have to land in the shared memory before we read it */
+	XSync(subsystem->display, False);
+
+	/* Damage is often reported for unchanged pixels, keep only real changes */
+	for (i = 0; i < numRects; i++)
+	{
+		int rc;
+		const RECTANGLE_16* r = &rects[i];
+		region16_clear(&tileRegion);
+		rc = shadow_capture_compare_ex(&surface->data[(r->top * surface->scanline) + (r->left * 4)],
+		                               surface->scanline, r->right - r->left, r->bottom - r->top,
+		                               &pImage[(r->top * nImageStep) + (r->left * 4)], nImageStep,
+		                               TRUE, &tileRegion);
+
+		if (rc < 0)
+		{
+			status = -1;
+			goto out;
+		}
+
+		if (rc == 0)
+			continue;
+
+		tiles = region16_rects(&tileRegion, &numTiles);
+
+		for (j = 0; j < numTiles; j++)
+		{
+			RECTANGLE_16 tile;
+			tile.left = tiles[j].left + r->left;
+			tile.top = tiles[j].top + r->top;
+			tile.right = tiles[j].right + r->left;
+			tile.bottom = tiles[j].bottom + r->top;
+
+			if (!region16_union_rect(invalidRegion, invalidRegion, &tile))
+			{
+				status = -1;
+				goto out;
+			}
+		}
+
+		status = 1;
+	}
+
+out:
+	region16_uninit(&tileRegion);
+	region16_uninit(&damageRegion);
+	XFree(xrects);
+	return status;
+}
+#endif
+
 static int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 {
 	int rc = 0;
 	int count;
-	int status;
-	int x, y;
-	int width, height;
+	int status = 0;
+	UINT32 index;
+	UINT32 numRects = 0;
+	BOOL use_xshm;
 	XImage* image;
+	const BYTE* pImage;
+	UINT32 nImageStep;
 	rdpShadowServer* server;
 	rdpShadowSurface* surface;
-	RECTANGLE_16 invalidRect;
+	REGION16 invalidRegion;
 	RECTANGLE_16 surfaceRect;
-	const RECTANGLE_16* extents;
+	const RECTANGLE_16* rects;
 	server = subsystem->common.server;
 	surface = server->surface;
 	count = ArrayList_Count(server->clients);
@@ -754,11 +894,16 @@ static int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 	if (count < 1)
 		return 1;
 
+	region16_init(&invalidRegion);
 	EnterCriticalSection(&surface->lock);
 	surfaceRect.left = 0;
 	surfaceRect.top = 0;
 	surfaceRect.right = surface->width;
 	surfaceRect.bottom = surface->height;
+	/* The XShm framebuffer is sized for the screen at init time */
+	use_xshm = subsystem->use_xshm &&
+	           (surface->x + surface->width <= subsystem->fb_image->width) &&
+	           (surface->y + surface->height <= subsystem->fb_image->height);
 	LeaveCriticalSection(&surface->lock);
 
 	XLockDisplay(subsystem->display);
@@ -768,17 +913,44 @@ static int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 	 */
 	XSetErrorHandler(x11_shadow_error_handler_for_capture);
 
-	if (subsystem->use_xshm)
+	if (use_xshm)
 	{
 		image = subsystem->fb_image;
-		XCopyArea(subsystem->display, subsystem->root_window, subsystem->fb_pixmap,
-		          subsystem->xshm_gc, 0, 0, subsystem->width, subsystem->height, 0, 0);
+		nImageStep = image->bytes_per_line;
+		pImage = (const BYTE*)&image->data[(surface->y * nImageStep) + (surface->x * 4)];
+#if defined(WITH_XDAMAGE) && defined(WITH_XFIXES)
 
-		EnterCriticalSection(&surface->lock);
-		status = shadow_capture_compare(surface->data, surface->scanline, surface->width,
-		                                surface->height, (BYTE*)&(image->data[surface->width * 4]),
-		                                image->bytes_per_line, &invalidRect);
-		LeaveCriticalSection(&surface->lock);
+		if (subsystem->use_xdamage && subsystem->xdamage_synced)
+		{
+			EnterCriticalSection(&surface->lock);
+			status =
+			    x11_shadow_capture_damage(subsystem, surface, pImage, nImageStep, &invalidRegion);
+			LeaveCriticalSection(&surface->lock);
+		}
+		else
+#endif
+		{
+#if defined(WITH_XDAMAGE) && defined(WITH_XFIXES)
+
+			/* Everything damaged up to now is covered by this full frame */
+			if (subsystem->use_xdamage)
+			{
+				XDamageSubtract(subsystem->display, subsystem->xdamage, None, None);
+				subsystem->xdamage_pending = FALSE;
+				subsystem->xdamage_synced = TRUE;
+			}
+
+#endif
+			XCopyArea(subsystem->display, subsystem->root_window, subsystem->fb_pixmap,
+			          subsystem->xshm_gc, surface->x, surface->y, surface->width,
+			          surface->height, surface->x, surface->y);
+			XSync(subsystem->display, False);
+			EnterCriticalSection(&surface->lock);
+			status = shadow_capture_compare_ex(surface->data, surface->scanline, surface->width,
+			                                   surface->height, pImage, nImageStep, TRUE,
+			                                   &invalidRegion);
+			LeaveCriticalSection(&surface->lock);
+		}
 	}
 	else
 	{
@@ -788,9 +960,11 @@ static int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 
 		if (image)
 		{
-			status = shadow_capture_compare(surface->data, surface->scanline, surface->width,
-			                                surface->height, (BYTE*)image->data,
-			                                image->bytes_per_line, &invalidRect);
+			pImage = (const BYTE*)image->data;
+			nImageStep = image->bytes_per_line;
+			status = shadow_capture_compare_ex(surface->data, surface->scanline, surface->width,
+			                                   surface->height, pImage, nImageStep, TRUE,
+			                                   &invalidRegion);
 		}
 		LeaveCriticalSection(&surface->lock);
 		if (!image)
@@ -808,27 +982,35 @@ static int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 	XSync(subsystem->display, False);
 	XUnlockDisplay(subsystem->display);
 
-	if (status)
+	if (status > 0)
 	{
 		BOOL empty;
 		EnterCriticalSection(&surface->lock);
-		region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion), &invalidRect);
-		region16_intersect_rect(&(surface->invalidRegion), &(surface->invalidRegion), &surfaceRect);
+		region16_intersect_rect(&invalidRegion, &invalidRegion, &surfaceRect);
+		rects = region16_rects(&invalidRegion, &numRects);
+
+		for (index = 0; index < numRects; index++)
+			region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion),
+			                    &rects[index]);
+
 		empty = region16_is_empty(&(surface->invalidRegion));
 		LeaveCriticalSection(&surface->lock);
 
 		if (!empty)
 		{
-			BOOL success;
+			BOOL success = TRUE;
 			EnterCriticalSection(&surface->lock);
-			extents = region16_extents(&(surface->invalidRegion));
-			x = extents->left;
-			y = extents->top;
-			width = extents->right - extents->left;
-			height = extents->bottom - extents->top;
-			success = freerdp_image_copy(surface->data, surface->format, surface->scanline, x, y,
-			                             width, height, (BYTE*)image->data, PIXEL_FORMAT_BGRX32,
-			                             image->bytes_per_line, x, y, NULL, FREERDP_FLIP_NONE);
+
+			/* Only the dirty tiles changed, everything else is already up to date */
+			for (index = 0; (index < numRects) && success; index++)
+			{
+				const RECTANGLE_16* rect = &rects[index];
+				success = freerdp_image_copy(
+				    surface->data, surface->format, surface->scanline, rect->left, rect->top,
+				    rect->right - rect->left, rect->bottom - rect->top, pImage, PIXEL_FORMAT_BGRX32,
+				    nImageStep, rect->left, rect->top, NULL, FREERDP_FLIP_NONE);
+			}
+
 			LeaveCriticalSection(&surface->lock);
 			if (!success)
 				goto fail_capture;
@@ -855,7 +1037,9 @@ static int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 
 	rc = 1;
 fail_capture:
-	if (!subsystem->use_xshm && image)
+	region16_uninit(&invalidRegion);
+
+	if (!use_xshm && image)
 		XDestroyImage(image);
 
 	if (rc != 1)
@@ -929,7 +1113,7 @@ static DWORD WINAPI x11_shadow_subsystem_thread(LPVOID arg)
 		{
 			XLockDisplay(subsystem->display);
 
-			if (XEventsQueued(subsystem->display, QueuedAlready))
+			while (XPending(subsystem->display))
 			{
 				XNextEvent(subsystem->display, &xevent);
 				x11_shadow_handle_xevent(subsystem, &xevent);
@@ -1249,6 +1433,16 @@ static int x11_shadow_subsystem_init(rdpShadowSubsystem* sub)
 
 	XFreeExtensionList(extensions);
 
+	/* Damage on the root window is only unreliable while windows are redirected */
+	if (subsystem->composite)
+	{
+		char name[32];
+		sprintf_s(name, sizeof(name), "_NET_WM_CM_S%d", subsystem->number);
+		subsystem->composite =
+		    XGetSelectionOwner(subsystem->display, XInternAtom(subsystem->display, name, False)) !=
+		    None;
+	}
+
 	if (subsystem->composite)
 		subsystem->use_xdamage = FALSE;
 
@@ -1326,6 +1520,10 @@ static int x11_shadow_subsystem_init(rdpShadowSubsystem* sub)
 			subsystem->use_xshm = FALSE;
 	}
 
+	/* Damage driven capture fetches the damaged areas through XShm */
+	if (!subsystem->use_xshm)
+		subsystem->use_xdamage = FALSE;
+
 	if (subsystem->use_xdamage)
 	{
 		if (x11_shadow_xdamage_init(subsystem) < 0)
@@ -1431,9 +1629,9 @@ static rdpShadowSubsystem* x11_shadow_subsystem_new(void)
 	subsystem->common.MouseEvent = x11_shadow_input_mouse_event;
 	subsystem->common.ExtendedMouseEvent = x11_shadow_input_extended_mouse_event;
 	subsystem->composite = FALSE;
-	subsystem->use_xshm = FALSE; /* temporarily disabled */
+	subsystem->use_xshm = TRUE;
 	subsystem->use_xfixes = TRUE;
-	subsystem->use_xdamage = FALSE;
+	subsystem->use_xdamage = TRUE;
 	subsystem->use_xinerama = TRUE;
 	return (rdpShadowSubsystem*)subsystem;
 }
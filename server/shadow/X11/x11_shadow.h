@@ -79,6 +79,7 @@ struct x11_shadow_subsystem
 	Pixmap fb_pixmap;
 	Window root_window;
 	XShmSegmentInfo fb_shm_info;
+	GC xshm_gc;
 
 	UINT32 cursorHotX;
 	UINT32 cursorHotY;
@@ -91,10 +92,11 @@ struct x11_shadow_subsystem
 	rdpShadowClient* lastMouseClient;
 
 #ifdef WITH_XDAMAGE
-	GC xshm_gc;
 	Damage xdamage;
 	int xdamage_notify_event;
 	XserverRegion xdamage_region;
+	BOOL xdamage_pending; /* Damage was reported since the last capture */
+	BOOL xdamage_synced;  /* The surface matches the screen outside the damage */
 #endif
 
 #ifdef WITH_XFIXES
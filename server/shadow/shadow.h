@@ -27,6 +27,7 @@
 #include "shadow_surface.h"
 #include "shadow_encoder.h"
 #include "shadow_capture.h"
+#include "shadow_encode_cache.h"
 #include "shadow_channels.h"
 #include "shadow_subsystem.h"
 #include "shadow_lobby.h"
@@ -21,16 +21,47 @@
 #endif
 
 #include <winpr/crt.h>
+#include <winpr/pool.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/log.h>
 
+#if defined(WITH_SSE2)
+#include <emmintrin.h>
+#elif defined(WITH_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "shadow_surface.h"
 
 #include "shadow_capture.h"
 
 #define TAG SERVER_TAG("shadow")
 
+#define SHADOW_CAPTURE_TILE_SIZE 64
+/* Minimum number of tile rows a thread pool work item compares */
+#define SHADOW_CAPTURE_TILE_ROWS_PER_WORK 4
+
+typedef BOOL (*pfnShadowCaptureRowEqual)(const BYTE* pData1, const BYTE* pData2, UINT32 length);
+
+typedef struct
+{
+	const BYTE* pData1;
+	UINT32 nStep1;
+	const BYTE* pData2;
+	UINT32 nStep2;
+	UINT32 nWidth;
+	UINT32 nHeight;
+	UINT32 ncol;
+	UINT32 firstRow;
+	UINT32 lastRow;
+	BYTE* dirty;
+} SHADOW_CAPTURE_COMPARE_PARAM;
+
+static INIT_ONCE shadow_capture_init_once = INIT_ONCE_STATIC_INIT;
+static pfnShadowCaptureRowEqual shadow_capture_row_equal = NULL;
+
 int shadow_capture_align_clip_rect(RECTANGLE_16* rect, RECTANGLE_16* clip)
 {
 	int dx, dy;
@@ -218,6 +249,277 @@ int shadow_capture_compare(BYTE* pData1, UINT32 nStep1, UINT32 nWidth, UINT32 nH
 	return 1;
 }
 
+static BOOL shadow_capture_row_equal_generic(const BYTE* pData1, const BYTE* pData2, UINT32 length)
+{
+	return memcmp(pData1, pData2, length) == 0;
+}
+
+#if defined(WITH_SSE2)
+static BOOL shadow_capture_row_equal_sse2(const BYTE* pData1, const BYTE* pData2, UINT32 length)
+{
+	UINT32 x = 0;
+
+	for (; x + 64 <= length; x += 64)
+	{
+		const __m128i a0 = _mm_loadu_si128((const __m128i*)&pData1[x]);
+		const __m128i a1 = _mm_loadu_si128((const __m128i*)&pData1[x + 16]);
+		const __m128i a2 = _mm_loadu_si128((const __m128i*)&pData1[x + 32]);
+		const __m128i a3 = _mm_loadu_si128((const __m128i*)&pData1[x + 48]);
+		const __m128i b0 = _mm_loadu_si128((const __m128i*)&pData2[x]);
+		const __m128i b1 = _mm_loadu_si128((const __m128i*)&pData2[x + 16]);
+		const __m128i b2 = _mm_loadu_si128((const __m128i*)&pData2[x + 32]);
+		const __m128i b3 = _mm_loadu_si128((const __m128i*)&pData2[x + 48]);
+		const __m128i e01 = _mm_and_si128(_mm_cmpeq_epi8(a0, b0), _mm_cmpeq_epi8(a1, b1));
+		const __m128i e23 = _mm_and_si128(_mm_cmpeq_epi8(a2, b2), _mm_cmpeq_epi8(a3, b3));
+
+		if (_mm_movemask_epi8(_mm_and_si128(e01, e23)) != 0xFFFF)
+			return FALSE;
+	}
+
+	for (; x + 16 <= length; x += 16)
+	{
+		const __m128i a = _mm_loadu_si128((const __m128i*)&pData1[x]);
+		const __m128i b = _mm_loadu_si128((const __m128i*)&pData2[x]);
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) != 0xFFFF)
+			return FALSE;
+	}
+
+	return memcmp(&pData1[x], &pData2[x], length - x) == 0;
+}
+#elif defined(WITH_NEON)
+static BOOL shadow_capture_row_equal_neon(const BYTE* pData1, const BYTE* pData2, UINT32 length)
+{
+	UINT32 x = 0;
+
+	for (; x + 64 <= length; x += 64)
+	{
+		const uint8x16_t d0 = veorq_u8(vld1q_u8(&pData1[x]), vld1q_u8(&pData2[x]));
+		const uint8x16_t d1 = veorq_u8(vld1q_u8(&pData1[x + 16]), vld1q_u8(&pData2[x + 16]));
+		const uint8x16_t d2 = veorq_u8(vld1q_u8(&pData1[x + 32]), vld1q_u8(&pData2[x + 32]));
+		const uint8x16_t d3 = veorq_u8(vld1q_u8(&pData1[x + 48]), vld1q_u8(&pData2[x + 48]));
+		const uint64x2_t d = vreinterpretq_u64_u8(vorrq_u8(vorrq_u8(d0, d1), vorrq_u8(d2, d3)));
+
+		if (vgetq_lane_u64(d, 0) | vgetq_lane_u64(d, 1))
+			return FALSE;
+	}
+
+	for (; x + 16 <= length; x += 16)
+	{
+		const uint64x2_t d =
+		    vreinterpretq_u64_u8(veorq_u8(vld1q_u8(&pData1[x]), vld1q_u8(&pData2[x])));
+
+		if (vgetq_lane_u64(d, 0) | vgetq_lane_u64(d, 1))
+			return FALSE;
+	}
+
+	return memcmp(&pData1[x], &pData2[x], length - x) == 0;
+}
+#endif
+
+static BOOL CALLBACK shadow_capture_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+	shadow_capture_row_equal = shadow_capture_row_equal_generic;
+#if defined(WITH_SSE2)
+
+	if (IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+		shadow_capture_row_equal = shadow_capture_row_equal_sse2;
+
+#elif defined(WITH_NEON)
+
+	if (IsProcessorFeaturePresent(PF_ARM_NEON_INSTRUCTIONS_AVAILABLE))
+		shadow_capture_row_equal = shadow_capture_row_equal_neon;
+
+#endif
+	return TRUE;
+}
+
+/**
+ * Compare a band of tile rows. The frames are walked one scanline at a time
+ * so both buffers are read sequentially, and tiles already known to be dirty
+ * are skipped on the remaining scanlines.
+ */
+static void shadow_capture_compare_rows(SHADOW_CAPTURE_COMPARE_PARAM* param)
+{
+	UINT32 tx, ty, y;
+
+	for (ty = param->firstRow; ty < param->lastRow; ty++)
+	{
+		UINT32 clean = param->ncol;
+		BYTE* dirty = &param->dirty[ty * param->ncol];
+		const UINT32 top = ty * SHADOW_CAPTURE_TILE_SIZE;
+		const UINT32 bottom = MIN(top + SHADOW_CAPTURE_TILE_SIZE, param->nHeight);
+
+		for (y = top; (y < bottom) && (clean > 0); y++)
+		{
+			const BYTE* p1 = &param->pData1[y * param->nStep1];
+			const BYTE* p2 = &param->pData2[y * param->nStep2];
+
+			for (tx = 0; tx < param->ncol; tx++)
+			{
+				const UINT32 left = tx * SHADOW_CAPTURE_TILE_SIZE;
+				const UINT32 width = MIN(SHADOW_CAPTURE_TILE_SIZE, param->nWidth - left);
+
+				if (dirty[tx])
+					continue;
+
+				if (!shadow_capture_row_equal(&p1[left * 4], &p2[left * 4], width * 4))
+				{
+					dirty[tx] = 1;
+					clean--;
+				}
+			}
+		}
+	}
+}
+
+static void CALLBACK shadow_capture_compare_work_callback(PTP_CALLBACK_INSTANCE instance,
+                                                          void* context, PTP_WORK work)
+{
+	WINPR_UNUSED(instance);
+	WINPR_UNUSED(work);
+	shadow_capture_compare_rows((SHADOW_CAPTURE_COMPARE_PARAM*)context);
+}
+
+static BOOL shadow_capture_compare_threaded(const SHADOW_CAPTURE_COMPARE_PARAM* param,
+                                            UINT32 nobjects)
+{
+	UINT32 i;
+	UINT32 waitCount = 0;
+	BOOL ret = TRUE;
+	PTP_WORK* work_objects;
+	SHADOW_CAPTURE_COMPARE_PARAM* params;
+	const UINT32 nrow = param->lastRow;
+	work_objects = (PTP_WORK*)calloc(nobjects, sizeof(PTP_WORK));
+	params = (SHADOW_CAPTURE_COMPARE_PARAM*)calloc(nobjects, sizeof(SHADOW_CAPTURE_COMPARE_PARAM));
+
+	if (!work_objects || !params)
+	{
+		free(work_objects);
+		free(params);
+		return FALSE;
+	}
+
+	for (i = 0; i < nobjects; i++)
+	{
+		params[i] = *param;
+		params[i].firstRow = (nrow * i) / nobjects;
+		params[i].lastRow = (nrow * (i + 1)) / nobjects;
+		work_objects[i] =
+		    CreateThreadpoolWork(shadow_capture_compare_work_callback, (void*)&params[i], NULL);
+
+		if (!work_objects[i])
+		{
+			WLog_ERR(TAG, "CreateThreadpoolWork failed.");
+			ret = FALSE;
+			break;
+		}
+
+		SubmitThreadpoolWork(work_objects[i]);
+		waitCount++;
+	}
+
+	for (i = 0; i < waitCount; i++)
+	{
+		WaitForThreadpoolWorkCallbacks(work_objects[i], FALSE);
+		CloseThreadpoolWork(work_objects[i]);
+	}
+
+	free(work_objects);
+	free(params);
+	return ret;
+}
+
+int shadow_capture_compare_ex(const BYTE* pData1, UINT32 nStep1, UINT32 nWidth, UINT32 nHeight,
+                              const BYTE* pData2, UINT32 nStep2, BOOL multithreaded,
+                              REGION16* region)
+{
+	int status = -1;
+	UINT32 tx, ty, nobjects = 1;
+	SHADOW_CAPTURE_COMPARE_PARAM param = { 0 };
+
+	if (!pData1 || !pData2 || !region)
+		return -1;
+
+	region16_clear(region);
+
+	if ((nWidth == 0) || (nHeight == 0))
+		return 0;
+
+	if (!InitOnceExecuteOnce(&shadow_capture_init_once, shadow_capture_init, NULL, NULL))
+		return -1;
+
+	param.pData1 = pData1;
+	param.nStep1 = nStep1;
+	param.pData2 = pData2;
+	param.nStep2 = nStep2;
+	param.nWidth = nWidth;
+	param.nHeight = nHeight;
+	param.ncol = (nWidth + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+	param.firstRow = 0;
+	param.lastRow = (nHeight + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+	param.dirty = (BYTE*)calloc(param.ncol, param.lastRow);
+
+	if (!param.dirty)
+		return -1;
+
+	if (multithreaded)
+	{
+		SYSTEM_INFO sysinfo;
+		GetNativeSystemInfo(&sysinfo);
+		nobjects = MIN(sysinfo.dwNumberOfProcessors,
+		               param.lastRow / SHADOW_CAPTURE_TILE_ROWS_PER_WORK);
+	}
+
+	if (nobjects > 1)
+	{
+		if (!shadow_capture_compare_threaded(&param, nobjects))
+			goto fail;
+	}
+	else
+		shadow_capture_compare_rows(&param);
+
+	status = 0;
+
+	/* Merge horizontal runs of dirty tiles before adding them to the region */
+	for (ty = 0; ty < param.lastRow; ty++)
+	{
+		const BYTE* dirty = &param.dirty[ty * param.ncol];
+
+		for (tx = 0; tx < param.ncol; tx++)
+		{
+			RECTANGLE_16 rect;
+
+			if (!dirty[tx])
+				continue;
+
+			rect.left = tx * SHADOW_CAPTURE_TILE_SIZE;
+			rect.top = ty * SHADOW_CAPTURE_TILE_SIZE;
+
+			while ((tx + 1 < param.ncol) && dirty[tx + 1])
+				tx++;
+
+			rect.right = MIN((tx + 1) * SHADOW_CAPTURE_TILE_SIZE, nWidth);
+			rect.bottom = MIN((ty + 1) * SHADOW_CAPTURE_TILE_SIZE, nHeight);
+
+			if (!region16_union_rect(region, region, &rect))
+			{
+				status = -1;
+				goto fail;
+			}
+
+			status = 1;
+		}
+	}
+
+fail:
+	free(param.dirty);
+	return status;
+}
+
 rdpShadowCapture* shadow_capture_new(rdpShadowServer* server)
 {
 	rdpShadowCapture* capture;
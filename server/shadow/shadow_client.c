@@ -36,6 +36,10 @@
 
 #define TAG CLIENT_TAG("shadow")
 
+/* Tiles with more distinct colors than this are treated as natural image content */
+#define SHADOW_GFX_TEXT_MAX_COLORS 128
+#define SHADOW_GFX_TILE_SIZE 64
+
 struct _SHADOW_GFX_STATUS
 {
 	BOOL gfxOpened;
@@ -168,6 +172,7 @@ static BOOL shadow_client_context_new(freerdp_peer* peer, rdpShadowClient* clien
 	client->inLobby = TRUE;
 	client->mayView = server->mayView;
 	client->mayInteract = server->mayInteract;
+	client->gfxCodecs = server->gfxCodecs;
 
 	if (!InitializeCriticalSectionAndSpinCount(&(client->lock), 4000))
 		goto fail_client_lock;
@@ -612,6 +617,20 @@ static BOOL shadow_are_caps_filtered(const rdpSettings* settings, UINT32 caps)
 	return TRUE;
 }
 
+static UINT shadow_client_rdpgfx_caps_confirm(RdpgfxServerContext* context,
+                                              const RDPGFX_CAPS_CONFIRM_PDU* capsConfirm)
+{
+	UINT rc;
+	rdpShadowClient* client = (rdpShadowClient*)context->custom;
+	rc = context->CapsConfirm(context, capsConfirm);
+
+	/* Surface commands may only be sent once a capability set was agreed on */
+	if (rc == CHANNEL_RC_OK)
+		client->gfxCapsConfirmed = TRUE;
+
+	return rc;
+}
+
 static BOOL shadow_client_caps_test_version(RdpgfxServerContext* context, BOOL h264,
                                             const RDPGFX_CAPSET* capsSets, UINT32 capsSetCount,
                                             UINT32 capsVersion, UINT* rc)
@@ -649,7 +668,7 @@ static BOOL shadow_client_caps_test_version(RdpgfxServerContext* context, BOOL h
 				}
 			}
 
-			*rc = context->CapsConfirm(context, &pdu);
+			*rc = shadow_client_rdpgfx_caps_confirm(context, &pdu);
 			return TRUE;
 		}
 	}
@@ -739,7 +758,7 @@ static UINT shadow_client_rdpgfx_caps_advertise(RdpgfxServerContext* context,
 #endif
 				}
 
-				return context->CapsConfirm(context, &pdu);
+				return shadow_client_rdpgfx_caps_confirm(context, &pdu);
 			}
 		}
 	}
@@ -763,7 +782,7 @@ static UINT shadow_client_rdpgfx_caps_advertise(RdpgfxServerContext* context,
 					settings->GfxSmallCache = (flags & RDPGFX_CAPS_FLAG_SMALL_CACHE);
 				}
 
-				return context->CapsConfirm(context, &pdu);
+				return shadow_client_rdpgfx_caps_confirm(context, &pdu);
 			}
 		}
 	}
@@ -787,7 +806,7 @@ static INLINE UINT32 rdpgfx_estimate_h264_avc420(RDPGFX_AVC420_BITMAP_STREAM* ha
  */
 static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client, const BYTE* pSrcData,
                                            int nSrcStep, int nXSrc, int nYSrc, int nWidth,
-                                           int nHeight)
+                                           int nHeight, const REGION16* invalidRegion)
 {
 	UINT error = CHANNEL_RC_OK;
 	rdpContext* context = (rdpContext*)client;
@@ -839,9 +858,12 @@ static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client, const BYTE*
 			return FALSE;
 		}
 
-		if (avc444_compress(encoder->h264, pSrcData, cmd.format, nSrcStep, nWidth, nHeight, version,
-		                    &avc444.LC, &avc444.bitstream[0].data, &avc444.bitstream[0].length,
-		                    &avc444.bitstream[1].data, &avc444.bitstream[1].length) < 0)
+		shadow_encoder_update_h264_rate(encoder);
+
+		if (avc444_compress_region(encoder->h264, pSrcData, cmd.format, nSrcStep, nWidth, nHeight,
+		                           version, invalidRegion, &avc444.LC, &avc444.bitstream[0].data,
+		                           &avc444.bitstream[0].length, &avc444.bitstream[1].data,
+		                           &avc444.bitstream[1].length) < 0)
 		{
 			WLog_ERR(TAG, "avc420_compress failed for avc444");
 			return FALSE;
@@ -885,8 +907,10 @@ static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client, const BYTE*
 			return FALSE;
 		}
 
-		if (avc420_compress(encoder->h264, pSrcData, cmd.format, nSrcStep, nWidth, nHeight,
-		                    &avc420.data, &avc420.length) < 0)
+		shadow_encoder_update_h264_rate(encoder);
+
+		if (avc420_compress_region(encoder->h264, pSrcData, cmd.format, nSrcStep, nWidth, nHeight,
+		                           invalidRegion, &avc420.data, &avc420.length) < 0)
 		{
 			WLog_ERR(TAG, "avc420_compress failed");
 			return FALSE;
@@ -918,6 +942,610 @@ static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client, const BYTE*
 	return TRUE;
 }
 
+/**
+ * Function description
+ * Count the distinct colors of a tile. Text and UI elements (anti-aliased
+ * glyphs included) stay well below the limit while photos and video exceed
+ * it within a few rows, so the scan usually terminates early.
+ *
+ * @return TRUE if the tile looks like text or UI content
+ */
+static BOOL shadow_client_gfx_is_text_tile(const BYTE* pSrcData, UINT32 nSrcStep,
+                                           const RECTANGLE_16* rect)
+{
+	UINT32 x, y;
+	UINT32 count = 0;
+	UINT32 last = 0;
+	BOOL haveLast = FALSE;
+	UINT32 colors[SHADOW_GFX_TEXT_MAX_COLORS * 2];
+	BYTE used[SHADOW_GFX_TEXT_MAX_COLORS * 2] = { 0 };
+
+	for (y = rect->top; y < rect->bottom; y++)
+	{
+		const BYTE* src = &pSrcData[(y * nSrcStep) + (rect->left * 4)];
+
+		for (x = rect->left; x < rect->right; x++)
+		{
+			UINT32 slot;
+			const UINT32 color = src[0] | (src[1] << 8) | (src[2] << 16);
+			src += 4;
+
+			if (haveLast && (color == last))
+				continue;
+
+			last = color;
+			haveLast = TRUE;
+			slot = ((UINT32)(color * 2654435761U) >> 24) % ARRAYSIZE(colors);
+
+			while (used[slot] && (colors[slot] != color))
+				slot = (slot + 1) % ARRAYSIZE(colors);
+
+			if (used[slot])
+				continue;
+
+			if (++count > SHADOW_GFX_TEXT_MAX_COLORS)
+				return FALSE;
+
+			used[slot] = 1;
+			colors[slot] = color;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Function description
+ * Pick the codec for a tile from the codecs enabled for this client.
+ * Text goes to the lossless codecs, natural images to the wavelet ones.
+ *
+ * @return FREERDP_CODEC_* flag or 0 if none of the candidates is enabled
+ */
+static UINT32 shadow_client_gfx_select_codec(UINT32 codecs, BOOL text)
+{
+	size_t x;
+	const UINT32 textOrder[] = { FREERDP_CODEC_CLEARCODEC, FREERDP_CODEC_PLANAR,
+		                         FREERDP_CODEC_PROGRESSIVE, FREERDP_CODEC_REMOTEFX };
+	const UINT32 imageOrder[] = { FREERDP_CODEC_PROGRESSIVE, FREERDP_CODEC_REMOTEFX,
+		                          FREERDP_CODEC_CLEARCODEC, FREERDP_CODEC_PLANAR };
+	const UINT32* order = text ? textOrder : imageOrder;
+
+	for (x = 0; x < ARRAYSIZE(textOrder); x++)
+	{
+		if (codecs & order[x])
+			return order[x];
+	}
+
+	return 0;
+}
+
+static BOOL shadow_client_send_gfx_command(rdpShadowClient* client, RDPGFX_SURFACE_COMMAND* cmd)
+{
+	UINT error = CHANNEL_RC_OK;
+	IFCALLRET(client->rdpgfx->SurfaceCommand, error, client->rdpgfx, cmd);
+
+	if (error)
+	{
+		WLog_ERR(TAG, "SurfaceCommand failed with error %" PRIu32 "", error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void shadow_client_gfx_set_rect(RDPGFX_SURFACE_COMMAND* cmd, const RECTANGLE_16* rect)
+{
+	cmd->left = rect->left;
+	cmd->top = rect->top;
+	cmd->right = rect->right;
+	cmd->bottom = rect->bottom;
+	cmd->width = rect->right - rect->left;
+	cmd->height = rect->bottom - rect->top;
+}
+
+/**
+ * Function description
+ * Look up the bitstream of a tile another client already encoded from the
+ * current frame.
+ * On a hit cmd->data points into the cache entry. On a miss the caller has to
+ * encode, and if *pEntry is set, publish the result with
+ * shadow_client_gfx_cache_store. *pEntry must always be released.
+ *
+ * @return TRUE if cmd->data was taken from the cache
+ */
+static BOOL shadow_client_gfx_cache_lookup(rdpShadowClient* client, UINT32 codecId,
+                                           UINT32 params, const RECTANGLE_16* tile,
+                                           RDPGFX_SURFACE_COMMAND* cmd,
+                                           SHADOW_ENCODE_CACHE_ENTRY** pEntry)
+{
+	BOOL owner = FALSE;
+	SHADOW_ENCODE_CACHE_KEY key;
+	SHADOW_ENCODE_CACHE_ENTRY* entry;
+	rdpShadowServer* server = client->server;
+	rdpShadowEncodeCache* cache = server->encodeCache;
+	*pEntry = NULL;
+
+	/* Nothing to share with a single viewer, and the lobby is drawn per client */
+	if (!cache || client->inLobby || (ArrayList_Count(server->clients) < 2))
+		return FALSE;
+
+	key.surface = server->surface;
+	key.generation = server->surface->generation;
+	key.codecId = codecId;
+	key.params = params;
+	key.rect = *tile;
+	entry = shadow_encode_cache_acquire(cache, &key, &owner);
+
+	if (!entry)
+		return FALSE;
+
+	if (owner)
+	{
+		*pEntry = entry;
+		return FALSE;
+	}
+
+	/* The owner failed to encode, do it ourselves */
+	if (!entry->data)
+	{
+		shadow_encode_cache_release(cache, entry);
+		return FALSE;
+	}
+
+	*pEntry = entry;
+	cmd->data = entry->data;
+	cmd->length = entry->length;
+	return TRUE;
+}
+
+static void shadow_client_gfx_cache_store(rdpShadowClient* client,
+                                          SHADOW_ENCODE_CACHE_ENTRY* entry,
+                                          const RDPGFX_SURFACE_COMMAND* cmd)
+{
+	if (entry)
+		shadow_encode_cache_complete(client->server->encodeCache, entry, cmd->data, cmd->length);
+}
+
+static void shadow_client_gfx_cache_release(rdpShadowClient* client,
+                                            SHADOW_ENCODE_CACHE_ENTRY* entry)
+{
+	shadow_encode_cache_release(client->server->encodeCache, entry);
+}
+
+/**
+ * Function description
+ * Encode the region with progressive, one surface command per tile.
+ * The tiles are encoded at their surface position and the decoder adds the
+ * command origin to them, so every command covers the whole surface.
+ *
+ * @return TRUE on success
+ */
+BOOL shadow_client_send_gfx_progressive(rdpShadowClient* client, const BYTE* pSrcData,
+                                        UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight,
+                                        const REGION16* region, RDPGFX_SURFACE_COMMAND* cmd)
+{
+	BOOL rc = TRUE;
+	UINT32 index;
+	UINT32 x, y;
+	UINT32 numRects = 0;
+	REGION16 tileRegion;
+	RECTANGLE_16 surfaceRect;
+	rdpShadowEncoder* encoder = client->encoder;
+	const RECTANGLE_16* rects = region16_rects(region, &numRects);
+
+	cmd->codecId = RDPGFX_CODECID_CAPROGRESSIVE;
+	surfaceRect.left = 0;
+	surfaceRect.top = 0;
+	surfaceRect.right = nWidth;
+	surfaceRect.bottom = nHeight;
+	shadow_client_gfx_set_rect(cmd, &surfaceRect);
+	region16_init(&tileRegion);
+
+	/* One surface command per tile, so the tiles can be shared between clients */
+	for (index = 0; rc && (index < numRects); index++)
+	{
+		const RECTANGLE_16* r = &rects[index];
+
+		for (y = r->top; rc && (y < r->bottom); y += SHADOW_GFX_TILE_SIZE)
+		{
+			for (x = r->left; rc && (x < r->right); x += SHADOW_GFX_TILE_SIZE)
+			{
+				SHADOW_ENCODE_CACHE_ENTRY* entry;
+				RECTANGLE_16 tile;
+				tile.left = x;
+				tile.top = y;
+				tile.right = MIN(r->right, x + SHADOW_GFX_TILE_SIZE);
+				tile.bottom = MIN(r->bottom, y + SHADOW_GFX_TILE_SIZE);
+
+				if (!shadow_client_gfx_cache_lookup(client, RDPGFX_CODECID_CAPROGRESSIVE, 0,
+				                                    &tile, cmd, &entry))
+				{
+					cmd->data = NULL;
+					cmd->length = 0;
+
+					/* The encoded data stays owned by the progressive context */
+					if (!region16_union_rect(&tileRegion, &tileRegion, &tile) ||
+					    (progressive_compress_ex(encoder->progressive, pSrcData,
+					                             nSrcStep * nHeight, cmd->format, nWidth,
+					                             nHeight, nSrcStep, &tileRegion, &cmd->data,
+					                             &cmd->length) < 0))
+					{
+						WLog_ERR(TAG, "progressive_compress_ex failed");
+						cmd->data = NULL;
+						cmd->length = 0;
+					}
+
+					region16_clear(&tileRegion);
+					shadow_client_gfx_cache_store(client, entry, cmd);
+				}
+
+				rc = (cmd->data != NULL);
+
+				if (rc)
+					rc = shadow_client_send_gfx_command(client, cmd);
+
+				shadow_client_gfx_cache_release(client, entry);
+				cmd->data = NULL;
+			}
+		}
+	}
+
+	region16_uninit(&tileRegion);
+	return rc;
+}
+
+static BOOL shadow_client_send_gfx_remotefx_tile(rdpShadowClient* client, const BYTE* pSrcData,
+                                                 UINT32 nSrcStep, const RECTANGLE_16* tile,
+                                                 RDPGFX_SURFACE_COMMAND* cmd)
+{
+	BOOL rc;
+	SHADOW_ENCODE_CACHE_ENTRY* entry;
+	rdpShadowEncoder* encoder = client->encoder;
+	wStream* s = encoder->bs;
+	shadow_client_gfx_set_rect(cmd, tile);
+
+	if (!shadow_client_gfx_cache_lookup(client, RDPGFX_CODECID_CAVIDEO, encoder->rfx->mode, tile,
+	                                    cmd, &entry))
+	{
+		RFX_RECT rect;
+		RFX_MESSAGE* message;
+		rect.x = 0;
+		rect.y = 0;
+		rect.width = cmd->width;
+		rect.height = cmd->height;
+		message = rfx_encode_message(encoder->rfx, &rect, 1,
+		                             &pSrcData[(tile->top * nSrcStep) + (tile->left * 4)],
+		                             cmd->width, cmd->height, nSrcStep);
+		cmd->data = NULL;
+		cmd->length = 0;
+
+		if (message)
+		{
+			/* Every RemoteFX surface command has to be decodable on its own */
+			encoder->rfx->state = RFX_STATE_SEND_HEADERS;
+			Stream_SetPosition(s, 0);
+
+			if (rfx_write_message(encoder->rfx, s, message))
+			{
+				cmd->data = Stream_Buffer(s);
+				cmd->length = (UINT32)Stream_GetPosition(s);
+			}
+			else
+				WLog_ERR(TAG, "rfx_write_message failed");
+
+			rfx_message_free(encoder->rfx, message);
+		}
+		else
+			WLog_ERR(TAG, "rfx_encode_message failed");
+
+		shadow_client_gfx_cache_store(client, entry, cmd);
+	}
+
+	rc = (cmd->data != NULL);
+
+	if (rc)
+		rc = shadow_client_send_gfx_command(client, cmd);
+
+	shadow_client_gfx_cache_release(client, entry);
+	cmd->data = NULL;
+	return rc;
+}
+
+static BOOL shadow_client_send_gfx_remotefx(rdpShadowClient* client, const BYTE* pSrcData,
+                                            UINT32 nSrcStep, const REGION16* region,
+                                            RDPGFX_SURFACE_COMMAND* cmd)
+{
+	UINT32 index;
+	UINT32 x, y;
+	UINT32 numRects = 0;
+	const RECTANGLE_16* rects = region16_rects(region, &numRects);
+
+	cmd->codecId = RDPGFX_CODECID_CAVIDEO;
+
+	for (index = 0; index < numRects; index++)
+	{
+		const RECTANGLE_16* r = &rects[index];
+
+		for (y = r->top; y < r->bottom; y += SHADOW_GFX_TILE_SIZE)
+		{
+			for (x = r->left; x < r->right; x += SHADOW_GFX_TILE_SIZE)
+			{
+				RECTANGLE_16 tile;
+				tile.left = x;
+				tile.top = y;
+				tile.right = MIN(r->right, x + SHADOW_GFX_TILE_SIZE);
+				tile.bottom = MIN(r->bottom, y + SHADOW_GFX_TILE_SIZE);
+
+				if (!shadow_client_send_gfx_remotefx_tile(client, pSrcData, nSrcStep, &tile, cmd))
+					return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL shadow_client_send_gfx_clear(rdpShadowClient* client, const BYTE* pSrcData,
+                                         UINT32 nSrcStep, const REGION16* region,
+                                         RDPGFX_SURFACE_COMMAND* cmd)
+{
+	BOOL rc;
+	UINT32 index;
+	UINT32 numRects = 0;
+	rdpShadowEncoder* encoder = client->encoder;
+	const RECTANGLE_16* rects = region16_rects(region, &numRects);
+
+	cmd->codecId = RDPGFX_CODECID_CLEARCODEC;
+
+	for (index = 0; index < numRects; index++)
+	{
+		const RECTANGLE_16* r = &rects[index];
+		shadow_client_gfx_set_rect(cmd, r);
+
+		if (clear_compress_ex(encoder->clear, &pSrcData[(r->top * nSrcStep) + (r->left * 4)],
+		                      cmd->format, nSrcStep, cmd->width, cmd->height, &cmd->data,
+		                      &cmd->length) < 0)
+		{
+			WLog_ERR(TAG, "clear_compress_ex failed");
+			return FALSE;
+		}
+
+		rc = shadow_client_send_gfx_command(client, cmd);
+		free(cmd->data);
+		cmd->data = NULL;
+
+		if (!rc)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL shadow_client_send_gfx_planar(rdpShadowClient* client, const BYTE* pSrcData,
+                                          UINT32 nSrcStep, const REGION16* region,
+                                          RDPGFX_SURFACE_COMMAND* cmd)
+{
+	BOOL rc;
+	UINT32 index;
+	UINT32 x, y;
+	BOOL cached;
+	UINT32 numRects = 0;
+	SHADOW_ENCODE_CACHE_ENTRY* entry;
+	rdpContext* context = (rdpContext*)client;
+	rdpSettings* settings = context->settings;
+	rdpShadowEncoder* encoder = client->encoder;
+	const RECTANGLE_16* rects = region16_rects(region, &numRects);
+
+	cmd->codecId = RDPGFX_CODECID_PLANAR;
+
+	/* The planar context is sized for maxTileWidth x maxTileHeight */
+	for (index = 0; index < numRects; index++)
+	{
+		const RECTANGLE_16* r = &rects[index];
+
+		for (y = r->top; y < r->bottom; y += encoder->maxTileHeight)
+		{
+			for (x = r->left; x < r->right; x += encoder->maxTileWidth)
+			{
+				RECTANGLE_16 tile;
+				tile.left = x;
+				tile.top = y;
+				tile.right = MIN(r->right, x + encoder->maxTileWidth);
+				tile.bottom = MIN(r->bottom, y + encoder->maxTileHeight);
+				shadow_client_gfx_set_rect(cmd, &tile);
+				cached = shadow_client_gfx_cache_lookup(client, RDPGFX_CODECID_PLANAR,
+				                                        settings->DrawAllowSkipAlpha, &tile, cmd,
+				                                        &entry);
+
+				if (!cached)
+				{
+					cmd->data = freerdp_bitmap_compress_planar(
+					    encoder->planar, &pSrcData[(y * nSrcStep) + (x * 4)], cmd->format,
+					    cmd->width, cmd->height, nSrcStep, NULL, &cmd->length);
+
+					if (!cmd->data)
+						WLog_ERR(TAG, "freerdp_bitmap_compress_planar failed");
+
+					shadow_client_gfx_cache_store(client, entry, cmd);
+				}
+
+				rc = (cmd->data != NULL);
+
+				if (rc)
+					rc = shadow_client_send_gfx_command(client, cmd);
+
+				if (!cached)
+					free(cmd->data);
+
+				shadow_client_gfx_cache_release(client, entry);
+				cmd->data = NULL;
+
+				if (!rc)
+					return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Function description
+ * Encode the invalid region for a graphics pipeline client without H.264.
+ * The region is split into the 64x64 tiles of the surface grid, every tile is
+ * classified as text or natural image and the tiles are grouped per codec.
+ * Progressive, RemoteFX and planar encode tile by tile and share the bitstreams
+ * with the other clients through the server encode cache, while ClearCodec
+ * keeps per client glyph and vbar caches and is always encoded here.
+ *
+ * @return TRUE on success
+ */
+static BOOL shadow_client_send_surface_gfx_region(rdpShadowClient* client, const BYTE* pSrcData,
+                                                  UINT32 nSrcStep, const REGION16* invalidRegion,
+                                                  UINT32 nXOffset, UINT32 nYOffset)
+{
+	BOOL ret = FALSE;
+	UINT error = CHANNEL_RC_OK;
+	UINT32 index, x, y;
+	UINT32 numRects = 0;
+	UINT32 codecs;
+	const RECTANGLE_16* rects;
+	rdpContext* context = (rdpContext*)client;
+	rdpSettings* settings = context->settings;
+	rdpShadowEncoder* encoder = client->encoder;
+	const UINT32 nWidth = settings->DesktopWidth;
+	const UINT32 nHeight = settings->DesktopHeight;
+	RDPGFX_SURFACE_COMMAND cmd = { 0 };
+	RDPGFX_START_FRAME_PDU cmdstart;
+	RDPGFX_END_FRAME_PDU cmdend;
+	REGION16 progressiveRegion;
+	REGION16 remotefxRegion;
+	REGION16 clearRegion;
+	REGION16 planarRegion;
+	SYSTEMTIME sTime;
+
+	codecs = client->gfxCodecs & (FREERDP_CODEC_PROGRESSIVE | FREERDP_CODEC_REMOTEFX |
+	                              FREERDP_CODEC_PLANAR | FREERDP_CODEC_CLEARCODEC);
+
+	/* progressive_compress_ex needs the stride to match the surface width */
+	if (nSrcStep / nWidth != 4)
+		codecs &= ~FREERDP_CODEC_PROGRESSIVE;
+
+	if (shadow_encoder_prepare(encoder, codecs) < 0)
+	{
+		WLog_ERR(TAG, "Failed to prepare encoder for gfx codecs 0x%08" PRIX32 "", codecs);
+		return FALSE;
+	}
+
+	region16_init(&progressiveRegion);
+	region16_init(&remotefxRegion);
+	region16_init(&clearRegion);
+	region16_init(&planarRegion);
+	rects = region16_rects(invalidRegion, &numRects);
+
+	for (index = 0; index < numRects; index++)
+	{
+		RECTANGLE_16 rect;
+		rect.left = rects[index].left - nXOffset;
+		rect.top = rects[index].top - nYOffset;
+		rect.right = rects[index].right - nXOffset;
+		rect.bottom = rects[index].bottom - nYOffset;
+
+		for (y = rect.top & ~(SHADOW_GFX_TILE_SIZE - 1); y < rect.bottom;
+		     y += SHADOW_GFX_TILE_SIZE)
+		{
+			for (x = rect.left & ~(SHADOW_GFX_TILE_SIZE - 1); x < rect.right;
+			     x += SHADOW_GFX_TILE_SIZE)
+			{
+				BOOL rc;
+				RECTANGLE_16 tile;
+				/* Whole grid cells, so every client encodes the same tiles */
+				tile.left = x;
+				tile.top = y;
+				tile.right = MIN(nWidth, x + SHADOW_GFX_TILE_SIZE);
+				tile.bottom = MIN(nHeight, y + SHADOW_GFX_TILE_SIZE);
+
+				switch (shadow_client_gfx_select_codec(
+				    codecs, shadow_client_gfx_is_text_tile(pSrcData, nSrcStep, &tile)))
+				{
+					case FREERDP_CODEC_PROGRESSIVE:
+						rc = region16_union_rect(&progressiveRegion, &progressiveRegion, &tile);
+						break;
+
+					case FREERDP_CODEC_REMOTEFX:
+						rc = region16_union_rect(&remotefxRegion, &remotefxRegion, &tile);
+						break;
+
+					case FREERDP_CODEC_CLEARCODEC:
+						rc = region16_union_rect(&clearRegion, &clearRegion, &tile);
+						break;
+
+					case FREERDP_CODEC_PLANAR:
+						rc = region16_union_rect(&planarRegion, &planarRegion, &tile);
+						break;
+
+					default:
+						WLog_ERR(TAG, "No gfx codec enabled for this client");
+						rc = FALSE;
+						break;
+				}
+
+				if (!rc)
+					goto out;
+			}
+		}
+	}
+
+	cmdstart.frameId = shadow_encoder_create_frame_id(encoder);
+	GetSystemTime(&sTime);
+	cmdstart.timestamp =
+	    sTime.wHour << 22 | sTime.wMinute << 16 | sTime.wSecond << 10 | sTime.wMilliseconds;
+	cmdend.frameId = cmdstart.frameId;
+	cmd.surfaceId = 0;
+	cmd.contextId = 0;
+	cmd.format = PIXEL_FORMAT_BGRX32;
+	IFCALLRET(client->rdpgfx->StartFrame, error, client->rdpgfx, &cmdstart);
+
+	if (error)
+	{
+		WLog_ERR(TAG, "StartFrame failed with error %" PRIu32 "", error);
+		goto out;
+	}
+
+	if (!region16_is_empty(&progressiveRegion) &&
+	    !shadow_client_send_gfx_progressive(client, pSrcData, nSrcStep, nWidth, nHeight,
+	                                        &progressiveRegion, &cmd))
+		goto out;
+
+	if (!region16_is_empty(&remotefxRegion) &&
+	    !shadow_client_send_gfx_remotefx(client, pSrcData, nSrcStep, &remotefxRegion, &cmd))
+		goto out;
+
+	if (!region16_is_empty(&clearRegion) &&
+	    !shadow_client_send_gfx_clear(client, pSrcData, nSrcStep, &clearRegion, &cmd))
+		goto out;
+
+	if (!region16_is_empty(&planarRegion) &&
+	    !shadow_client_send_gfx_planar(client, pSrcData, nSrcStep, &planarRegion, &cmd))
+		goto out;
+
+	IFCALLRET(client->rdpgfx->EndFrame, error, client->rdpgfx, &cmdend);
+
+	if (error)
+	{
+		WLog_ERR(TAG, "EndFrame failed with error %" PRIu32 "", error);
+		goto out;
+	}
+
+	ret = TRUE;
+out:
+	region16_uninit(&progressiveRegion);
+	region16_uninit(&remotefxRegion);
+	region16_uninit(&clearRegion);
+	region16_uninit(&planarRegion);
+	return ret;
+}
+
 /**
  * Function description
  *
@@ -1289,6 +1917,37 @@ out:
 	return ret;
 }
 
+/**
+ * Moves the invalid region of the surface to the origin of the shared sub rect
+ *
+ * @return TRUE on success
+ */
+static BOOL shadow_client_translate_region(REGION16* dst, const REGION16* src,
+                                           const rdpShadowServer* server)
+{
+	UINT32 index, numRects = 0;
+	const RECTANGLE_16* rects;
+
+	if (!server->shareSubRect)
+		return region16_copy(dst, src);
+
+	rects = region16_rects(src, &numRects);
+
+	for (index = 0; index < numRects; index++)
+	{
+		RECTANGLE_16 rect = rects[index];
+		rect.left -= server->subRect.left;
+		rect.top -= server->subRect.top;
+		rect.right -= server->subRect.left;
+		rect.bottom -= server->subRect.top;
+
+		if (!region16_union_rect(dst, dst, &rect))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
 /**
  * Function description
  *
@@ -1377,26 +2036,60 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 	// WLog_INFO(TAG, "shadow_client_send_surface_update: x: %d y: %d width: %d height: %d right: %d
 	// bottom: %d", 	nXSrc, nYSrc, nWidth, nHeight, nXSrc + nWidth, nYSrc + nHeight);
 
-	if (settings->SupportGraphicsPipeline && settings->GfxH264 && pStatus->gfxOpened)
+	if (settings->SupportGraphicsPipeline && pStatus->gfxOpened && client->gfxCapsConfirmed &&
+	    (settings->GfxH264 || client->gfxCodecs))
 	{
-		/* GFX/h264 always full screen encoded */
-		nWidth = settings->DesktopWidth;
-		nHeight = settings->DesktopHeight;
-
 		/* Create primary surface if have not */
 		if (!pStatus->gfxSurfaceCreated)
 		{
-			/* Only init surface when we have h264 supported */
 			if (!(ret = shadow_client_rdpgfx_reset_graphic(client)))
 				goto out;
 
 			if (!(ret = shadow_client_rdpgfx_new_surface(client)))
 				goto out;
 
+			/* The new surface starts out with empty ClearCodec caches */
+			if (client->encoder->clear && !(ret = clear_context_reset(client->encoder->clear)))
+				goto out;
+
+			/* and without a reference frame for H.264 */
+			if (client->encoder->h264)
+				client->encoder->h264->ForceIDR = TRUE;
+
 			pStatus->gfxSurfaceCreated = TRUE;
 		}
 
-		ret = shadow_client_send_surface_gfx(client, pSrcData, nSrcStep, 0, 0, nWidth, nHeight);
+		if (settings->GfxH264)
+		{
+			REGION16 changedRegion;
+			region16_init(&changedRegion);
+
+			/* GFX/h264 always full screen encoded, the encoder only converts what changed */
+			nWidth = settings->DesktopWidth;
+			nHeight = settings->DesktopHeight;
+
+			if (shadow_client_translate_region(&changedRegion, &invalidRegion, server))
+				ret = shadow_client_send_surface_gfx(client, pSrcData, nSrcStep, 0, 0, nWidth,
+				                                     nHeight, &changedRegion);
+			else
+				ret = FALSE;
+
+			region16_uninit(&changedRegion);
+		}
+		else
+		{
+			UINT32 nXOffset = 0;
+			UINT32 nYOffset = 0;
+
+			if (server->shareSubRect)
+			{
+				nXOffset = server->subRect.left;
+				nYOffset = server->subRect.top;
+			}
+
+			ret = shadow_client_send_surface_gfx_region(client, pSrcData, nSrcStep,
+			                                            &invalidRegion, nXOffset, nYOffset);
+		}
 	}
 	else if (settings->RemoteFxCodec || settings->NSCodec)
 	{
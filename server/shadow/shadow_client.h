@@ -20,6 +20,7 @@
 #define FREERDP_SERVER_SHADOW_CLIENT_H
 
 #include <freerdp/server/shadow.h>
+#include <freerdp/channels/rdpgfx.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -28,6 +29,10 @@ extern "C"
 
 	BOOL shadow_client_accepted(freerdp_listener* instance, freerdp_peer* client);
 
+	BOOL shadow_client_send_gfx_progressive(rdpShadowClient* client, const BYTE* pSrcData,
+	                                        UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight,
+	                                        const REGION16* region, RDPGFX_SURFACE_COMMAND* cmd);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,322 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <freerdp/log.h>
+
+#include "shadow.h"
+
+#include "shadow_encode_cache.h"
+
+#define TAG SERVER_TAG("shadow.encodecache")
+
+static UINT32 shadow_encode_cache_hash(const SHADOW_ENCODE_CACHE_KEY* key)
+{
+	UINT32 hash = 2166136261u;
+	const RECTANGLE_16* r = &key->rect;
+
+	hash = (hash ^ key->generation) * 16777619u;
+	hash = (hash ^ key->codecId) * 16777619u;
+	hash = (hash ^ key->params) * 16777619u;
+	hash = (hash ^ (((UINT32)r->left << 16) | r->top)) * 16777619u;
+	hash = (hash ^ (((UINT32)r->right << 16) | r->bottom)) * 16777619u;
+	return hash;
+}
+
+static BOOL shadow_encode_cache_entry_match(const SHADOW_ENCODE_CACHE_ENTRY* entry,
+                                            const SHADOW_ENCODE_CACHE_KEY* key, UINT32 hash)
+{
+	const RECTANGLE_16* r = &entry->key.rect;
+
+	if ((entry->hash != hash) || (entry->key.surface != key->surface) ||
+	    (entry->key.generation != key->generation) || (entry->key.codecId != key->codecId) ||
+	    (entry->key.params != key->params))
+		return FALSE;
+
+	return (r->left == key->rect.left) && (r->top == key->rect.top) &&
+	       (r->right == key->rect.right) && (r->bottom == key->rect.bottom);
+}
+
+static void shadow_encode_cache_entry_free(SHADOW_ENCODE_CACHE_ENTRY* entry)
+{
+	if (!entry)
+		return;
+
+	free(entry->data);
+	free(entry);
+}
+
+static void shadow_encode_cache_entry_unref(SHADOW_ENCODE_CACHE_ENTRY* entry)
+{
+	if (InterlockedDecrement(&entry->refCount) == 0)
+		shadow_encode_cache_entry_free(entry);
+}
+
+/* Move an entry to the most recently used end of the list */
+static void shadow_encode_cache_touch(rdpShadowEncodeCache* cache, SHADOW_ENCODE_CACHE_ENTRY* entry)
+{
+	if (cache->newest == entry)
+		return;
+
+	if (entry->older)
+		entry->older->newer = entry->newer;
+	else if (cache->oldest == entry)
+		cache->oldest = entry->newer;
+
+	if (entry->newer)
+		entry->newer->older = entry->older;
+
+	entry->newer = NULL;
+	entry->older = cache->newest;
+
+	if (cache->newest)
+		cache->newest->newer = entry;
+
+	cache->newest = entry;
+
+	if (!cache->oldest)
+		cache->oldest = entry;
+}
+
+static void shadow_encode_cache_unlink(rdpShadowEncodeCache* cache,
+                                       SHADOW_ENCODE_CACHE_ENTRY* entry)
+{
+	SHADOW_ENCODE_CACHE_ENTRY** pEntry =
+	    &cache->buckets[entry->hash % SHADOW_ENCODE_CACHE_BUCKETS];
+
+	while (*pEntry && (*pEntry != entry))
+		pEntry = &(*pEntry)->next;
+
+	if (*pEntry)
+		*pEntry = entry->next;
+
+	if (entry->older)
+		entry->older->newer = entry->newer;
+	else
+		cache->oldest = entry->newer;
+
+	if (entry->newer)
+		entry->newer->older = entry->older;
+	else
+		cache->newest = entry->older;
+
+	entry->next = NULL;
+	entry->newer = NULL;
+	entry->older = NULL;
+	entry->linked = FALSE;
+	cache->size -= sizeof(SHADOW_ENCODE_CACHE_ENTRY) + entry->length;
+	cache->count--;
+	shadow_encode_cache_entry_unref(entry);
+}
+
+static BOOL shadow_encode_cache_expired(const rdpShadowEncodeCache* cache,
+                                        const SHADOW_ENCODE_CACHE_ENTRY* entry,
+                                        const SHADOW_ENCODE_CACHE_KEY* key)
+{
+	/* Lagging clients look up older generations, so only count what lies behind */
+	if (entry->key.surface != key->surface)
+		return FALSE;
+
+	return (INT32)(key->generation - entry->key.generation) > (INT32)cache->maxAge;
+}
+
+/*
+ * Once per new frame drop the entries encoded from a frame too old for any
+ * client to still send, then the least recently used ones while the cache is
+ * over its size limit.
+ */
+static void shadow_encode_cache_evict(rdpShadowEncodeCache* cache,
+                                      const SHADOW_ENCODE_CACHE_KEY* key)
+{
+	SHADOW_ENCODE_CACHE_ENTRY* entry;
+	SHADOW_ENCODE_CACHE_ENTRY* newer;
+
+	if ((cache->surface != key->surface) || ((INT32)(key->generation - cache->generation) > 0))
+	{
+		cache->surface = key->surface;
+		cache->generation = key->generation;
+
+		for (entry = cache->oldest; entry; entry = newer)
+		{
+			newer = entry->newer;
+
+			if (shadow_encode_cache_expired(cache, entry, key))
+			{
+				shadow_encode_cache_unlink(cache, entry);
+				cache->evictions++;
+			}
+		}
+	}
+
+	while (cache->oldest && (cache->size > cache->maxSize))
+	{
+		shadow_encode_cache_unlink(cache, cache->oldest);
+		cache->evictions++;
+	}
+}
+
+/**
+ * Look up the bitstream for the given tile.
+ * If nobody has encoded it yet, a pending entry is inserted and *owner is
+ * set to TRUE: the caller must encode and call shadow_encode_cache_complete.
+ * The clients hold the surface lock while they encode, so a pending entry is
+ * normally only seen by its owner. Anyone else finding an entry without data
+ * encodes the tile on its own.
+ * Every returned entry has to be released with shadow_encode_cache_release.
+ *
+ * @return the entry or NULL on failure
+ */
+SHADOW_ENCODE_CACHE_ENTRY* shadow_encode_cache_acquire(rdpShadowEncodeCache* cache,
+                                                       const SHADOW_ENCODE_CACHE_KEY* key,
+                                                       BOOL* owner)
+{
+	UINT32 hash;
+	SHADOW_ENCODE_CACHE_ENTRY* entry;
+	SHADOW_ENCODE_CACHE_ENTRY** bucket;
+
+	if (!cache || !key || !owner)
+		return NULL;
+
+	*owner = FALSE;
+	hash = shadow_encode_cache_hash(key);
+	EnterCriticalSection(&cache->lock);
+	shadow_encode_cache_evict(cache, key);
+	bucket = &cache->buckets[hash % SHADOW_ENCODE_CACHE_BUCKETS];
+
+	for (entry = *bucket; entry; entry = entry->next)
+	{
+		if (shadow_encode_cache_entry_match(entry, key, hash))
+			break;
+	}
+
+	if (entry)
+	{
+		InterlockedIncrement(&entry->refCount);
+		shadow_encode_cache_touch(cache, entry);
+		cache->hits++;
+		LeaveCriticalSection(&cache->lock);
+		return entry;
+	}
+
+	entry = (SHADOW_ENCODE_CACHE_ENTRY*)calloc(1, sizeof(SHADOW_ENCODE_CACHE_ENTRY));
+
+	if (entry)
+	{
+		entry->key = *key;
+		entry->hash = hash;
+		entry->linked = TRUE;
+		/* One reference for the cache, one for the caller */
+		entry->refCount = 2;
+		entry->next = *bucket;
+		*bucket = entry;
+		shadow_encode_cache_touch(cache, entry);
+		cache->size += sizeof(SHADOW_ENCODE_CACHE_ENTRY);
+		cache->count++;
+		cache->misses++;
+		*owner = TRUE;
+	}
+
+	LeaveCriticalSection(&cache->lock);
+	return entry;
+}
+
+/**
+ * Store the bitstream of an entry acquired as owner.
+ * Passing NULL data marks the entry as failed, the other clients then encode
+ * on their own.
+ *
+ * @return TRUE if the data was stored
+ */
+BOOL shadow_encode_cache_complete(rdpShadowEncodeCache* cache, SHADOW_ENCODE_CACHE_ENTRY* entry,
+                                  const BYTE* data, UINT32 length)
+{
+	BYTE* copy;
+
+	if (!cache || !entry || !data || (length == 0))
+		return FALSE;
+
+	copy = (BYTE*)malloc(length);
+
+	if (!copy)
+	{
+		WLog_ERR(TAG, "Failed to allocate %" PRIu32 " bytes for encoded data", length);
+		return FALSE;
+	}
+
+	CopyMemory(copy, data, length);
+	EnterCriticalSection(&cache->lock);
+
+	if (entry->data)
+	{
+		LeaveCriticalSection(&cache->lock);
+		free(copy);
+		return FALSE;
+	}
+
+	entry->data = copy;
+	entry->length = length;
+
+	if (entry->linked)
+		cache->size += length;
+
+	LeaveCriticalSection(&cache->lock);
+	return TRUE;
+}
+
+void shadow_encode_cache_release(rdpShadowEncodeCache* cache, SHADOW_ENCODE_CACHE_ENTRY* entry)
+{
+	if (!cache || !entry)
+		return;
+
+	shadow_encode_cache_entry_unref(entry);
+}
+
+rdpShadowEncodeCache* shadow_encode_cache_new(rdpShadowServer* server)
+{
+	rdpShadowEncodeCache* cache;
+	cache = (rdpShadowEncodeCache*)calloc(1, sizeof(rdpShadowEncodeCache));
+
+	if (!cache)
+		return NULL;
+
+	if (!InitializeCriticalSectionAndSpinCount(&cache->lock, 4000))
+	{
+		free(cache);
+		return NULL;
+	}
+
+	cache->maxSize = SHADOW_ENCODE_CACHE_MAX_SIZE;
+	cache->maxAge = SHADOW_ENCODE_CACHE_MAX_AGE;
+	return cache;
+}
+
+void shadow_encode_cache_free(rdpShadowEncodeCache* cache)
+{
+	if (!cache)
+		return;
+
+	WLog_DBG(TAG, "encode cache hits: %" PRIu32 " misses: %" PRIu32 " evictions: %" PRIu32 "",
+	         cache->hits, cache->misses, cache->evictions);
+
+	while (cache->oldest)
+		shadow_encode_cache_unlink(cache, cache->oldest);
+
+	DeleteCriticalSection(&cache->lock);
+	free(cache);
+}
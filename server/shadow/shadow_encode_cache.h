@@ -0,0 +1,104 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SERVER_SHADOW_ENCODE_CACHE_H
+#define FREERDP_SERVER_SHADOW_ENCODE_CACHE_H
+
+#include <freerdp/server/shadow.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+#define SHADOW_ENCODE_CACHE_BUCKETS 1024
+#define SHADOW_ENCODE_CACHE_MAX_AGE 4
+#define SHADOW_ENCODE_CACHE_MAX_SIZE (32 * 1024 * 1024)
+
+/**
+ * Identifies one encoded tile: the surface content it was produced from,
+ * the codec, the codec parameters and the tile rectangle.
+ */
+struct _SHADOW_ENCODE_CACHE_KEY
+{
+	const rdpShadowSurface* surface;
+	UINT32 generation;
+	UINT32 codecId;
+	UINT32 params;
+	RECTANGLE_16 rect;
+};
+typedef struct _SHADOW_ENCODE_CACHE_KEY SHADOW_ENCODE_CACHE_KEY;
+
+typedef struct _SHADOW_ENCODE_CACHE_ENTRY SHADOW_ENCODE_CACHE_ENTRY;
+
+struct _SHADOW_ENCODE_CACHE_ENTRY
+{
+	SHADOW_ENCODE_CACHE_ENTRY* next; /* hash bucket chain */
+	SHADOW_ENCODE_CACHE_ENTRY* newer;
+	SHADOW_ENCODE_CACHE_ENTRY* older;
+
+	SHADOW_ENCODE_CACHE_KEY key;
+	UINT32 hash;
+	BOOL linked;
+
+	/* NULL until the owner stored the bitstream, stays NULL if it failed */
+	BYTE* data;
+	UINT32 length;
+	LONG refCount;
+};
+
+struct rdp_shadow_encode_cache
+{
+	CRITICAL_SECTION lock;
+	SHADOW_ENCODE_CACHE_ENTRY* buckets[SHADOW_ENCODE_CACHE_BUCKETS];
+
+	/* Least recently used list, the oldest entry is evicted first */
+	SHADOW_ENCODE_CACHE_ENTRY* newest;
+	SHADOW_ENCODE_CACHE_ENTRY* oldest;
+
+	/* Newest frame looked up so far */
+	const rdpShadowSurface* surface;
+	UINT32 generation;
+
+	size_t size;
+	size_t maxSize;
+	UINT32 maxAge;
+	UINT32 count;
+
+	UINT32 hits;
+	UINT32 misses;
+	UINT32 evictions;
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	SHADOW_ENCODE_CACHE_ENTRY* shadow_encode_cache_acquire(rdpShadowEncodeCache* cache,
+	                                                       const SHADOW_ENCODE_CACHE_KEY* key,
+	                                                       BOOL* owner);
+	BOOL shadow_encode_cache_complete(rdpShadowEncodeCache* cache, SHADOW_ENCODE_CACHE_ENTRY* entry,
+	                                  const BYTE* data, UINT32 length);
+	void shadow_encode_cache_release(rdpShadowEncodeCache* cache, SHADOW_ENCODE_CACHE_ENTRY* entry);
+
+	rdpShadowEncodeCache* shadow_encode_cache_new(rdpShadowServer* server);
+	void shadow_encode_cache_free(rdpShadowEncodeCache* cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SERVER_SHADOW_ENCODE_CACHE_H */
@@ -20,12 +20,19 @@
 #include "config.h"
 #endif
 
+#include <winpr/sysinfo.h>
+
 #include "shadow.h"
 
 #include "shadow_encoder.h"
 
 #define TAG CLIENT_TAG("shadow")
 
+/* H.264 rate adaptation: bitrate floor, interval between changes and RTT probes in ms */
+#define H264_RATE_MIN_BITRATE 250000
+#define H264_RATE_INTERVAL 200
+#define H264_RATE_RTT_INTERVAL 1000
+
 int shadow_encoder_preferred_fps(rdpShadowEncoder* encoder)
 {
 	/* Return preferred fps calculated according to the last
@@ -78,6 +85,81 @@ UINT32 shadow_encoder_create_frame_id(rdpShadowEncoder* encoder)
 	return frameId;
 }
 
+/**
+ * Computes the next H.264 bitrate from the state of the link.
+ * More unacknowledged frames than the round trip time explains or a round trip
+ * time well above the best one seen mean the link queues up, the bitrate is
+ * then cut by a quarter. Otherwise it recovers in steps of 1/20 of maxBitRate.
+ * The result stays between H264_RATE_MIN_BITRATE and maxBitRate.
+ *
+ * @param rtt the average round trip time in ms, 0 if unknown
+ * @param baseRtt the lowest round trip time seen in ms, 0 if unknown
+ */
+UINT32 shadow_encoder_next_h264_bitrate(UINT32 bitRate, UINT32 maxBitRate, UINT32 inFlightFrames,
+                                        UINT32 fps, UINT32 rtt, UINT32 baseRtt)
+{
+	UINT64 next = bitRate;
+	const UINT64 expectedFrames = (UINT64)rtt * fps / 1000;
+	BOOL congested = inFlightFrames > expectedFrames + 2;
+
+	if ((baseRtt > 0) && (rtt > 2ULL * baseRtt + 10))
+		congested = TRUE;
+
+	if (congested)
+		next = next / 4 * 3;
+	else
+		next += maxBitRate / 20;
+
+	return (UINT32)MAX(MIN(maxBitRate, H264_RATE_MIN_BITRATE), MIN(maxBitRate, next));
+}
+
+/**
+ * Adapts the H.264 bitrate to the link before a frame is encoded, see
+ * shadow_encoder_next_h264_bitrate. The round trip time is probed once a
+ * second if network auto-detection was negotiated with the client.
+ */
+void shadow_encoder_update_h264_rate(rdpShadowEncoder* encoder)
+{
+	UINT32 bitRate;
+	UINT32 rtt = 0;
+	UINT32 baseRtt = 0;
+	const UINT64 now = GetTickCount64();
+	rdpContext* context = (rdpContext*)encoder->client;
+	const rdpAutoDetect* autodetect = context->autodetect;
+	H264_CONTEXT* h264 = encoder->h264;
+
+	if (!h264 || (h264->RateControlMode == H264_RATECONTROL_CQP))
+		return;
+
+	if (context->settings->NetworkAutoDetect && autodetect && autodetect->RTTMeasureRequest &&
+	    (now - encoder->rttRequestTime >= H264_RATE_RTT_INTERVAL))
+	{
+		encoder->rttRequestTime = now;
+		autodetect->RTTMeasureRequest(context, encoder->rttSequenceNumber++);
+	}
+
+	if (autodetect)
+	{
+		rtt = autodetect->netCharAverageRTT;
+		baseRtt = autodetect->netCharBaseRTT;
+	}
+
+	/* Give a change one round trip to show before the next one */
+	if (now - encoder->h264RateTime < MAX(H264_RATE_INTERVAL, rtt))
+		return;
+
+	bitRate = shadow_encoder_next_h264_bitrate(h264->BitRate, encoder->server->h264BitRate,
+	                                           shadow_encoder_inflight_frames(encoder),
+	                                           (UINT32)MAX(encoder->fps, 0), rtt, baseRtt);
+
+	if (bitRate != h264->BitRate)
+	{
+		WLog_DBG(TAG, "H.264 bitrate %" PRIu32 " -> %" PRIu32 "", h264->BitRate, bitRate);
+		h264->BitRate = bitRate;
+		encoder->h264RateTime = now;
+	}
+}
+
 static int shadow_encoder_init_grid(rdpShadowEncoder* encoder)
 {
 	int i, j, k;
@@ -252,6 +334,44 @@ fail:
 	return -1;
 }
 
+static int shadow_encoder_init_clear(rdpShadowEncoder* encoder)
+{
+	if (!encoder->clear)
+		encoder->clear = clear_context_new(TRUE);
+
+	if (!encoder->clear)
+		goto fail;
+
+	if (!clear_context_reset(encoder->clear))
+		goto fail;
+
+	encoder->codecs |= FREERDP_CODEC_CLEARCODEC;
+	return 1;
+fail:
+	clear_context_free(encoder->clear);
+	encoder->clear = NULL;
+	return -1;
+}
+
+static int shadow_encoder_init_progressive(rdpShadowEncoder* encoder)
+{
+	if (!encoder->progressive)
+		encoder->progressive = progressive_context_new(TRUE);
+
+	if (!encoder->progressive)
+		goto fail;
+
+	if (!progressive_context_reset(encoder->progressive))
+		goto fail;
+
+	encoder->codecs |= FREERDP_CODEC_PROGRESSIVE;
+	return 1;
+fail:
+	progressive_context_free(encoder->progressive);
+	encoder->progressive = NULL;
+	return -1;
+}
+
 static int shadow_encoder_init(rdpShadowEncoder* encoder)
 {
 	encoder->width = encoder->server->screen->width;
@@ -329,6 +449,30 @@ static int shadow_encoder_uninit_h264(rdpShadowEncoder* encoder)
 	return 1;
 }
 
+static int shadow_encoder_uninit_clear(rdpShadowEncoder* encoder)
+{
+	if (encoder->clear)
+	{
+		clear_context_free(encoder->clear);
+		encoder->clear = NULL;
+	}
+
+	encoder->codecs &= ~FREERDP_CODEC_CLEARCODEC;
+	return 1;
+}
+
+static int shadow_encoder_uninit_progressive(rdpShadowEncoder* encoder)
+{
+	if (encoder->progressive)
+	{
+		progressive_context_free(encoder->progressive);
+		encoder->progressive = NULL;
+	}
+
+	encoder->codecs &= ~FREERDP_CODEC_PROGRESSIVE;
+	return 1;
+}
+
 static int shadow_encoder_uninit(rdpShadowEncoder* encoder)
 {
 	shadow_encoder_uninit_grid(encoder);
@@ -364,6 +508,16 @@ static int shadow_encoder_uninit(rdpShadowEncoder* encoder)
 		shadow_encoder_uninit_h264(encoder);
 	}
 
+	if (encoder->codecs & FREERDP_CODEC_CLEARCODEC)
+	{
+		shadow_encoder_uninit_clear(encoder);
+	}
+
+	if (encoder->codecs & FREERDP_CODEC_PROGRESSIVE)
+	{
+		shadow_encoder_uninit_progressive(encoder);
+	}
+
 	return 1;
 }
 
@@ -446,6 +600,24 @@ int shadow_encoder_prepare(rdpShadowEncoder* encoder, UINT32 codecs)
 			return -1;
 	}
 
+	if ((codecs & FREERDP_CODEC_CLEARCODEC) && !(encoder->codecs & FREERDP_CODEC_CLEARCODEC))
+	{
+		WLog_DBG(TAG, "initializing ClearCodec encoder");
+		status = shadow_encoder_init_clear(encoder);
+
+		if (status < 0)
+			return -1;
+	}
+
+	if ((codecs & FREERDP_CODEC_PROGRESSIVE) && !(encoder->codecs & FREERDP_CODEC_PROGRESSIVE))
+	{
+		WLog_DBG(TAG, "initializing progressive encoder");
+		status = shadow_encoder_init_progressive(encoder);
+
+		if (status < 0)
+			return -1;
+	}
+
 	return 1;
 }
 
@@ -50,6 +50,8 @@ struct rdp_shadow_encoder
 	BITMAP_PLANAR_CONTEXT* planar;
 	BITMAP_INTERLEAVED_CONTEXT* interleaved;
 	H264_CONTEXT* h264;
+	CLEAR_CONTEXT* clear;
+	PROGRESSIVE_CONTEXT* progressive;
 
 	int fps;
 	int maxFps;
@@ -57,6 +59,10 @@ struct rdp_shadow_encoder
 	UINT32 frameId;
 	UINT32 lastAckframeId;
 	UINT32 queueDepth;
+
+	UINT64 h264RateTime;
+	UINT64 rttRequestTime;
+	UINT16 rttSequenceNumber;
 };
 
 #ifdef __cplusplus
@@ -67,6 +73,10 @@ extern "C"
 	int shadow_encoder_reset(rdpShadowEncoder* encoder);
 	int shadow_encoder_prepare(rdpShadowEncoder* encoder, UINT32 codecs);
 	UINT32 shadow_encoder_create_frame_id(rdpShadowEncoder* encoder);
+	UINT32 shadow_encoder_next_h264_bitrate(UINT32 bitRate, UINT32 maxBitRate,
+	                                        UINT32 inFlightFrames, UINT32 fps, UINT32 rtt,
+	                                        UINT32 baseRtt);
+	void shadow_encoder_update_h264_rate(rdpShadowEncoder* encoder);
 
 	rdpShadowEncoder* shadow_encoder_new(rdpShadowClient* client);
 	void shadow_encoder_free(rdpShadowEncoder* encoder);
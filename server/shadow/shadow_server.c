@@ -75,6 +75,10 @@ static const COMMAND_LINE_ARGUMENT_A shadow_args[] = {
 	  "nla protocol security" },
 	{ "sec-ext", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL,
 	  "nla extended protocol security" },
+	{ "tls-kernel-offload", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL,
+	  "Let the kernel encrypt TLS records (Linux kTLS) when supported" },
+	{ "gfx-codecs", COMMAND_LINE_VALUE_REQUIRED, "[progressive][,rfx][,planar][,clear]", NULL, NULL,
+	  -1, NULL, "Codecs used on the graphics pipeline when H.264 is not available" },
 	{ "sam-file", COMMAND_LINE_VALUE_REQUIRED, "<file>", NULL, NULL, -1, NULL,
 	  "NTLM SAM file for NLA authentication" },
 	{ "version", COMMAND_LINE_VALUE_FLAG | COMMAND_LINE_PRINT_VERSION, NULL, NULL, NULL, -1, NULL,
@@ -388,10 +392,44 @@ int shadow_server_parse_command_line(rdpShadowServer* server, int argc, char** a
 		{
 			settings->ExtSecurity = arg->Value ? TRUE : FALSE;
 		}
+		CommandLineSwitchCase(arg, "tls-kernel-offload")
+		{
+			settings->TlsKernelOffload = arg->Value ? TRUE : FALSE;
+		}
 		CommandLineSwitchCase(arg, "sam-file")
 		{
 			freerdp_settings_set_string(settings, FreeRDP_NtlmSamFile, arg->Value);
 		}
+		CommandLineSwitchCase(arg, "gfx-codecs")
+		{
+			size_t i, count = 0;
+			char** p = CommandLineParseCommaSeparatedValues(arg->Value, &count);
+
+			if (!p)
+				return -1;
+
+			server->gfxCodecs = 0;
+
+			for (i = 0; i < count; i++)
+			{
+				if (_stricmp(p[i], "progressive") == 0)
+					server->gfxCodecs |= FREERDP_CODEC_PROGRESSIVE;
+				else if (_stricmp(p[i], "rfx") == 0)
+					server->gfxCodecs |= FREERDP_CODEC_REMOTEFX;
+				else if (_stricmp(p[i], "planar") == 0)
+					server->gfxCodecs |= FREERDP_CODEC_PLANAR;
+				else if (_stricmp(p[i], "clear") == 0)
+					server->gfxCodecs |= FREERDP_CODEC_CLEARCODEC;
+				else
+				{
+					WLog_ERR(TAG, "unknown gfx codec: %s", p[i]);
+					free(p);
+					return -1;
+				}
+			}
+
+			free(p);
+		}
 		CommandLineSwitchDefault(arg)
 		{
 		}
@@ -572,6 +610,14 @@ int shadow_server_start(rdpShadowServer* server)
 		return -1;
 	}
 
+	server->encodeCache = shadow_encode_cache_new(server);
+
+	if (!server->encodeCache)
+	{
+		WLog_ERR(TAG, "encode_cache_new failed");
+		return -1;
+	}
+
 	/* Bind magic:
 	 *
 	 * emtpy                 ... bind TCP all
@@ -657,6 +703,12 @@ int shadow_server_stop(rdpShadowServer* server)
 		server->capture = NULL;
 	}
 
+	if (server->encodeCache)
+	{
+		shadow_encode_cache_free(server->encodeCache);
+		server->encodeCache = NULL;
+	}
+
 	return 0;
 }
 
@@ -908,6 +960,8 @@ rdpShadowServer* shadow_server_new(void)
 	server->h264BitRate = 10000000;
 	server->h264FrameRate = 30;
 	server->h264QP = 0;
+	server->gfxCodecs = FREERDP_CODEC_PROGRESSIVE | FREERDP_CODEC_REMOTEFX | FREERDP_CODEC_PLANAR |
+	                    FREERDP_CODEC_CLEARCODEC;
 	server->authentication = FALSE;
 	server->settings = freerdp_settings_new(FREERDP_SETTINGS_SERVER_MODE);
 	return server;
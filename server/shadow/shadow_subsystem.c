@@ -275,5 +275,15 @@ int shadow_subsystem_pointer_convert_alpha_pointer_data(
 
 void shadow_subsystem_frame_update(rdpShadowSubsystem* subsystem)
 {
+	rdpShadowSurface* surface = subsystem->server ? subsystem->server->surface : NULL;
+
+	/* Clients share encoded data only within the same surface generation */
+	if (surface)
+	{
+		EnterCriticalSection(&surface->lock);
+		surface->generation++;
+		LeaveCriticalSection(&surface->lock);
+	}
+
 	shadow_multiclient_publish_and_wait(subsystem->updateEvent);
 }
@@ -95,6 +95,7 @@ BOOL shadow_surface_resize(rdpShadowSurface* surface, int x, int y, int width, i
 		surface->height = height;
 		surface->scanline = scanline;
 		surface->data = buffer;
+		surface->generation++;
 		return TRUE;
 	}
 
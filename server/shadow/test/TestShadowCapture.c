@@ -0,0 +1,205 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/print.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/server/shadow.h>
+
+#define TEST_SHADOW_TILE_SIZE 64
+#define TEST_SHADOW_ITERATIONS 100
+
+typedef struct
+{
+	const char* name;
+	UINT32 width;
+	UINT32 height;
+	/* Changed areas of the second frame, { x, y, w, h } */
+	UINT32 numChanges;
+	UINT32 changes[4][4];
+} TEST_SHADOW_FRAME_PAIR;
+
+static BYTE* test_shadow_frame_new(UINT32 width, UINT32 height, UINT32 step)
+{
+	UINT32 x, y;
+	BYTE* data = calloc(height, step);
+
+	if (!data)
+		return NULL;
+
+	/* Desktop like content: a gradient background with some window frames */
+	for (y = 0; y < height; y++)
+	{
+		UINT32* row = (UINT32*)&data[y * step];
+
+		for (x = 0; x < width; x++)
+		{
+			if (((x % 300) < 2) || ((y % 200) < 2))
+				row[x] = 0xFF202020;
+			else
+				row[x] = 0xFF000000 | ((x & 0xFF) << 16) | ((y & 0xFF) << 8) | ((x + y) & 0xFF);
+		}
+	}
+
+	return data;
+}
+
+static void test_shadow_frame_change(BYTE* data, UINT32 step, const UINT32 change[4], UINT32 seed)
+{
+	UINT32 x, y;
+
+	for (y = change[1]; y < change[1] + change[3]; y++)
+	{
+		UINT32* row = (UINT32*)&data[y * step];
+
+		for (x = change[0]; x < change[0] + change[2]; x++)
+			row[x] = ~row[x] ^ (seed * 0x010101);
+	}
+}
+
+static BOOL test_shadow_tile_expected(const TEST_SHADOW_FRAME_PAIR* pair, UINT32 tx, UINT32 ty)
+{
+	UINT32 i;
+	const UINT32 left = tx * TEST_SHADOW_TILE_SIZE;
+	const UINT32 top = ty * TEST_SHADOW_TILE_SIZE;
+
+	for (i = 0; i < pair->numChanges; i++)
+	{
+		const UINT32* c = pair->changes[i];
+
+		if ((c[0] < left + TEST_SHADOW_TILE_SIZE) && (c[0] + c[2] > left) &&
+		    (c[1] < top + TEST_SHADOW_TILE_SIZE) && (c[1] + c[3] > top))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static BOOL test_shadow_check_region(const TEST_SHADOW_FRAME_PAIR* pair, const REGION16* region)
+{
+	UINT32 tx, ty;
+
+	for (ty = 0; ty < (pair->height + TEST_SHADOW_TILE_SIZE - 1) / TEST_SHADOW_TILE_SIZE; ty++)
+	{
+		for (tx = 0; tx < (pair->width + TEST_SHADOW_TILE_SIZE - 1) / TEST_SHADOW_TILE_SIZE; tx++)
+		{
+			RECTANGLE_16 tile;
+			BOOL dirty;
+			tile.left = tx * TEST_SHADOW_TILE_SIZE;
+			tile.top = ty * TEST_SHADOW_TILE_SIZE;
+			tile.right = MIN(tile.left + TEST_SHADOW_TILE_SIZE, pair->width);
+			tile.bottom = MIN(tile.top + TEST_SHADOW_TILE_SIZE, pair->height);
+			dirty = region16_intersects_rect(region, &tile);
+
+			if (dirty != test_shadow_tile_expected(pair, tx, ty))
+			{
+				fprintf(stderr, "[%s] tile %" PRIu32 "x%" PRIu32 " expected %s\n", pair->name, tx,
+				        ty, dirty ? "clean" : "dirty");
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static UINT64 test_shadow_region_area(const REGION16* region)
+{
+	UINT32 i, count = 0;
+	UINT64 area = 0;
+	const RECTANGLE_16* rects = region16_rects(region, &count);
+
+	for (i = 0; i < count; i++)
+		area += (UINT64)(rects[i].right - rects[i].left) * (rects[i].bottom - rects[i].top);
+
+	return area;
+}
+
+static BOOL test_shadow_capture_pair(const TEST_SHADOW_FRAME_PAIR* pair, BOOL multithreaded)
+{
+	BOOL rc = FALSE;
+	UINT32 i;
+	int status;
+	/* Pad the stride the way shadow surfaces do */
+	const UINT32 step = ((pair->width + 3) & ~3) * 4 + 64;
+	BYTE* frame1 = test_shadow_frame_new(pair->width, pair->height, step);
+	BYTE* frame2 = test_shadow_frame_new(pair->width, pair->height, step);
+	const RECTANGLE_16* extents;
+	UINT64 area, boundsArea;
+	UINT64 start, elapsed;
+	REGION16 region;
+	region16_init(&region);
+
+	if (!frame1 || !frame2)
+		goto fail;
+
+	for (i = 0; i < pair->numChanges; i++)
+		test_shadow_frame_change(frame2, step, pair->changes[i], i + 1);
+
+	start = GetTickCount64();
+
+	for (i = 0; i < TEST_SHADOW_ITERATIONS; i++)
+	{
+		status = shadow_capture_compare_ex(frame1, step, pair->width, pair->height, frame2, step,
+		                                   multithreaded, &region);
+
+		if (status != (pair->numChanges ? 1 : 0))
+		{
+			fprintf(stderr, "[%s] shadow_capture_compare_ex returned %d\n", pair->name, status);
+			goto fail;
+		}
+	}
+
+	elapsed = GetTickCount64() - start;
+
+	if (!test_shadow_check_region(pair, &region))
+		goto fail;
+
+	/* Compare the dirty tile area with the single bounding rectangle of the old compare */
+	area = test_shadow_region_area(&region);
+	extents = region16_extents(&region);
+	boundsArea = (UINT64)(extents->right - extents->left) * (extents->bottom - extents->top);
+	printf("%-18s %s: %4" PRIu64 " us/compare, %7" PRIu64 " of %7" PRIu64
+	       " pixels dirty, bounding rect %7" PRIu64 "\n",
+	       pair->name, multithreaded ? "threads" : "single ",
+	       elapsed * 1000 / TEST_SHADOW_ITERATIONS, area, (UINT64)pair->width * pair->height,
+	       boundsArea);
+	rc = TRUE;
+fail:
+	region16_uninit(&region);
+	free(frame1);
+	free(frame2);
+	return rc;
+}
+
+int TestShadowCapture(int argc, char* argv[])
+{
+	UINT32 i;
+	const TEST_SHADOW_FRAME_PAIR pairs[] = {
+		{ "static desktop", 1920, 1080, 0, { { 0 } } },
+		{ "cursor and clock", 1920, 1080, 2, { { 12, 30, 2, 16 }, { 1850, 1058, 60, 16 } } },
+		{ "typing",
+		  1366,
+		  768,
+		  3,
+		  { { 400, 300, 9, 16 }, { 409, 300, 1, 16 }, { 1300, 740, 50, 20 } } },
+		{ "video window", 1920, 1080, 1, { { 640, 360, 640, 360 } } },
+		{ "full screen", 1366, 768, 1, { { 0, 0, 1366, 768 } } },
+		{ "odd size", 1023, 517, 2, { { 1022, 0, 1, 1 }, { 0, 516, 1, 1 } } },
+	};
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	for (i = 0; i < ARRAYSIZE(pairs); i++)
+	{
+		if (!test_shadow_capture_pair(&pairs[i], FALSE))
+			return -1;
+
+		if (!test_shadow_capture_pair(&pairs[i], TRUE))
+			return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,262 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+
+#include "../shadow_encode_cache.h"
+
+static void test_encode_cache_key(SHADOW_ENCODE_CACHE_KEY* key, const rdpShadowSurface* surface,
+                                  UINT32 generation, UINT16 x, UINT16 y)
+{
+	key->surface = surface;
+	key->generation = generation;
+	key->codecId = 3;
+	key->params = 0;
+	key->rect.left = x;
+	key->rect.top = y;
+	key->rect.right = x + 64;
+	key->rect.bottom = y + 64;
+}
+
+/* Acquire a tile, store data if we own it and report whether it was a hit */
+static BOOL test_encode_cache_get(rdpShadowEncodeCache* cache, const SHADOW_ENCODE_CACHE_KEY* key,
+                                  BYTE fill, BOOL* hit)
+{
+	BOOL owner = FALSE;
+	BYTE data[256];
+	SHADOW_ENCODE_CACHE_ENTRY* entry = shadow_encode_cache_acquire(cache, key, &owner);
+
+	if (!entry)
+		return FALSE;
+
+	*hit = !owner;
+
+	if (owner)
+	{
+		memset(data, fill, sizeof(data));
+
+		if (!shadow_encode_cache_complete(cache, entry, data, sizeof(data)))
+		{
+			shadow_encode_cache_release(cache, entry);
+			return FALSE;
+		}
+	}
+	else if (!entry->data || (entry->length != sizeof(data)) || (entry->data[0] != fill))
+	{
+		fprintf(stderr, "cached tile has unexpected content\n");
+		shadow_encode_cache_release(cache, entry);
+		return FALSE;
+	}
+
+	shadow_encode_cache_release(cache, entry);
+	return TRUE;
+}
+
+static BOOL test_encode_cache_expect(rdpShadowEncodeCache* cache,
+                                     const SHADOW_ENCODE_CACHE_KEY* key, BYTE fill,
+                                     BOOL expectHit, const char* what)
+{
+	BOOL hit = FALSE;
+
+	if (!test_encode_cache_get(cache, key, fill, &hit))
+	{
+		fprintf(stderr, "%s: lookup failed\n", what);
+		return FALSE;
+	}
+
+	if (hit != expectHit)
+	{
+		fprintf(stderr, "%s: expected a %s\n", what, expectHit ? "hit" : "miss");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL test_encode_cache_hit_miss(void)
+{
+	BOOL rc = FALSE;
+	rdpShadowSurface surface = { 0 };
+	SHADOW_ENCODE_CACHE_KEY key;
+	rdpShadowEncodeCache* cache = shadow_encode_cache_new(NULL);
+
+	if (!cache)
+		return FALSE;
+
+	/* Two clients with different dirty regions still share the tiles they have in common */
+	test_encode_cache_key(&key, &surface, 1, 0, 0);
+
+	if (!test_encode_cache_expect(cache, &key, 0x11, FALSE, "first client tile 0"))
+		goto out;
+
+	test_encode_cache_key(&key, &surface, 1, 64, 0);
+
+	if (!test_encode_cache_expect(cache, &key, 0x22, FALSE, "first client tile 1"))
+		goto out;
+
+	if (!test_encode_cache_expect(cache, &key, 0x22, TRUE, "second client tile 1"))
+		goto out;
+
+	test_encode_cache_key(&key, &surface, 1, 128, 0);
+
+	if (!test_encode_cache_expect(cache, &key, 0x33, FALSE, "second client tile 2"))
+		goto out;
+
+	test_encode_cache_key(&key, &surface, 1, 0, 0);
+
+	if (!test_encode_cache_expect(cache, &key, 0x11, TRUE, "second client tile 0"))
+		goto out;
+
+	/* Other codec parameters or a newer frame never match */
+	key.params = 1;
+
+	if (!test_encode_cache_expect(cache, &key, 0x44, FALSE, "other parameters"))
+		goto out;
+
+	test_encode_cache_key(&key, &surface, 2, 0, 0);
+
+	if (!test_encode_cache_expect(cache, &key, 0x55, FALSE, "next generation"))
+		goto out;
+
+	/* A client one frame behind still finds its tiles */
+	test_encode_cache_key(&key, &surface, 1, 64, 0);
+
+	if (!test_encode_cache_expect(cache, &key, 0x22, TRUE, "lagging client"))
+		goto out;
+
+	if ((cache->hits != 3) || (cache->misses != 5) || (cache->evictions != 0))
+	{
+		fprintf(stderr, "unexpected statistics: hits %" PRIu32 " misses %" PRIu32
+		                " evictions %" PRIu32 "\n",
+		        cache->hits, cache->misses, cache->evictions);
+		goto out;
+	}
+
+	rc = TRUE;
+out:
+	shadow_encode_cache_free(cache);
+	return rc;
+}
+
+static BOOL test_encode_cache_eviction(void)
+{
+	BOOL rc = FALSE;
+	UINT32 x;
+	UINT32 count;
+	SHADOW_ENCODE_CACHE_KEY key;
+	SHADOW_ENCODE_CACHE_ENTRY* entry;
+	rdpShadowSurface surface = { 0 };
+	rdpShadowEncodeCache* cache = shadow_encode_cache_new(NULL);
+
+	if (!cache)
+		return FALSE;
+
+	/* Entries too many frames behind are dropped */
+	test_encode_cache_key(&key, &surface, 10, 0, 0);
+
+	if (!test_encode_cache_expect(cache, &key, 0x10, FALSE, "old frame"))
+		goto out;
+
+	test_encode_cache_key(&key, &surface, 10 + SHADOW_ENCODE_CACHE_MAX_AGE, 64, 0);
+
+	if (!test_encode_cache_expect(cache, &key, 0x20, FALSE, "frame within age"))
+		goto out;
+
+	test_encode_cache_key(&key, &surface, 10, 0, 0);
+
+	if (!test_encode_cache_expect(cache, &key, 0x10, TRUE, "old frame within age"))
+		goto out;
+
+	test_encode_cache_key(&key, &surface, 11 + SHADOW_ENCODE_CACHE_MAX_AGE, 128, 0);
+
+	if (!test_encode_cache_expect(cache, &key, 0x30, FALSE, "frame beyond age"))
+		goto out;
+
+	if (cache->evictions != 1)
+	{
+		fprintf(stderr, "expected the old frame to be evicted\n");
+		goto out;
+	}
+
+	test_encode_cache_key(&key, &surface, 10, 0, 0);
+
+	if (!test_encode_cache_expect(cache, &key, 0x10, FALSE, "evicted frame"))
+		goto out;
+
+	/* Over the size limit the least recently used tiles go first */
+	cache->maxSize = 16 * (sizeof(SHADOW_ENCODE_CACHE_ENTRY) + 256);
+
+	for (x = 0; x < 32; x++)
+	{
+		test_encode_cache_key(&key, &surface, 20, (UINT16)(x * 64), 64);
+
+		if (!test_encode_cache_expect(cache, &key, (BYTE)x, FALSE, "fill"))
+			goto out;
+
+		/* Keep the first tile in use */
+		test_encode_cache_key(&key, &surface, 20, 0, 64);
+
+		if (!test_encode_cache_expect(cache, &key, 0, TRUE, "recently used"))
+			goto out;
+	}
+
+	count = cache->count;
+
+	if ((count > 17) || (cache->size > cache->maxSize + sizeof(SHADOW_ENCODE_CACHE_ENTRY) + 256))
+	{
+		fprintf(stderr, "cache grew to %" PRIu32 " entries\n", count);
+		goto out;
+	}
+
+	test_encode_cache_key(&key, &surface, 20, 64, 64);
+
+	if (!test_encode_cache_expect(cache, &key, 1, FALSE, "least recently used"))
+		goto out;
+
+	/* An entry evicted while a client still uses it stays valid for that client */
+	{
+		BOOL owner = FALSE;
+		test_encode_cache_key(&key, &surface, 20, 31 * 64, 64);
+		entry = shadow_encode_cache_acquire(cache, &key, &owner);
+
+		if (!entry || owner)
+			goto out;
+
+		cache->maxSize = 0;
+		test_encode_cache_key(&key, &surface, 30, 0, 0);
+
+		if (!test_encode_cache_expect(cache, &key, 0x40, FALSE, "flush"))
+		{
+			shadow_encode_cache_release(cache, entry);
+			goto out;
+		}
+
+		if (!entry->data || (entry->data[0] != 31))
+		{
+			shadow_encode_cache_release(cache, entry);
+			goto out;
+		}
+
+		shadow_encode_cache_release(cache, entry);
+	}
+
+	rc = TRUE;
+out:
+	shadow_encode_cache_free(cache);
+	return rc;
+}
+
+int TestShadowEncodeCache(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_encode_cache_hit_miss())
+		return -1;
+
+	if (!test_encode_cache_eviction())
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,87 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+
+#include "../shadow_encoder.h"
+
+/* the configured bitrate and the lowest one the encoder goes down to */
+#define TEST_RATE_MAX 10000000
+#define TEST_RATE_MIN 250000
+
+typedef struct
+{
+	const char* name;
+	UINT32 bitRate;
+	UINT32 maxBitRate;
+	UINT32 inFlightFrames;
+	UINT32 fps;
+	UINT32 rtt;
+	UINT32 baseRtt;
+	UINT32 expected;
+} TEST_RATE_STEP;
+
+static BOOL test_rate_step(const TEST_RATE_STEP* step)
+{
+	const UINT32 bitRate =
+	    shadow_encoder_next_h264_bitrate(step->bitRate, step->maxBitRate, step->inFlightFrames,
+	                                     step->fps, step->rtt, step->baseRtt);
+
+	if (bitRate != step->expected)
+	{
+		fprintf(stderr, "%s: bitrate %" PRIu32 " instead of %" PRIu32 "\n", step->name, bitRate,
+		        step->expected);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* a link without congestion recovers to the configured bitrate in 20 steps */
+static BOOL test_rate_ramp_up(void)
+{
+	UINT32 step;
+	UINT32 bitRate = TEST_RATE_MIN;
+
+	for (step = 0; step < 20; step++)
+		bitRate = shadow_encoder_next_h264_bitrate(bitRate, TEST_RATE_MAX, 1, 30, 50, 40);
+
+	if (bitRate != TEST_RATE_MAX)
+	{
+		fprintf(stderr, "ramp up: bitrate %" PRIu32 " after 20 steps\n", bitRate);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+int TestShadowEncoderRate(int argc, char* argv[])
+{
+	size_t index;
+	const TEST_RATE_STEP steps[] = {
+		/* 100ms at 30 fps explain 3 frames in flight, 2 more are tolerated */
+		{ "in flight", 8000000, TEST_RATE_MAX, 5, 30, 100, 100, 8500000 },
+		{ "queued", 8000000, TEST_RATE_MAX, 6, 30, 100, 100, 6000000 },
+		{ "no rtt", 8000000, TEST_RATE_MAX, 3, 30, 0, 0, 6000000 },
+		{ "rtt", 8000000, TEST_RATE_MAX, 0, 30, 111, 50, 6000000 },
+		{ "base rtt", 8000000, TEST_RATE_MAX, 0, 30, 110, 50, 8500000 },
+		{ "ceiling", 9800000, TEST_RATE_MAX, 0, 30, 50, 50, TEST_RATE_MAX },
+		{ "lowered", TEST_RATE_MAX, 2000000, 0, 30, 50, 50, 2000000 },
+		{ "floor", 300000, TEST_RATE_MAX, 10, 30, 50, 50, TEST_RATE_MIN },
+		{ "below floor", 300000, 100000, 0, 30, 50, 50, 100000 },
+	};
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	for (index = 0; index < ARRAYSIZE(steps); index++)
+	{
+		if (!test_rate_step(&steps[index]))
+			return -1;
+	}
+
+	if (!test_rate_ramp_up())
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,326 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/collections.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/codecs.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/gdi/gfx.h>
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/progressive.h>
+#include <freerdp/client/rdpgfx.h>
+#include <freerdp/server/rdpgfx.h>
+
+#include "../shadow_client.h"
+#include "../shadow_encoder.h"
+#include "../shadow_encode_cache.h"
+
+#define TEST_SHADOW_GFX_WIDTH 256
+#define TEST_SHADOW_GFX_HEIGHT 256
+#define TEST_SHADOW_GFX_STEP (TEST_SHADOW_GFX_WIDTH * 4)
+
+/* the color of the changed tile and of the rest of the desktop */
+#define TEST_SHADOW_GFX_TILE_COLOR 0x00C08040
+#define TEST_SHADOW_GFX_BACKGROUND 0x00000000
+
+/* A gdi graphics pipeline client the shadow commands are handed to as they are sent */
+typedef struct
+{
+	RdpgfxClientContext gfx;
+	RdpgfxServerContext server;
+	freerdp* instance;
+	void* surface;
+	BOOL pipeline;
+} TEST_SHADOW_GFX_CLIENT;
+
+static UINT test_shadow_gfx_set_surface_data(RdpgfxClientContext* context, UINT16 surfaceId,
+                                             void* pData)
+{
+	TEST_SHADOW_GFX_CLIENT* client = (TEST_SHADOW_GFX_CLIENT*)context;
+
+	if (surfaceId != 0)
+		return ERROR_INVALID_DATA;
+
+	client->surface = pData;
+	return CHANNEL_RC_OK;
+}
+
+static void* test_shadow_gfx_get_surface_data(RdpgfxClientContext* context, UINT16 surfaceId)
+{
+	TEST_SHADOW_GFX_CLIENT* client = (TEST_SHADOW_GFX_CLIENT*)context;
+
+	if (surfaceId != 0)
+		return NULL;
+
+	return client->surface;
+}
+
+static UINT test_shadow_gfx_get_surface_ids(RdpgfxClientContext* context, UINT16** ppSurfaceIds,
+                                            UINT16* count_out)
+{
+	TEST_SHADOW_GFX_CLIENT* client = (TEST_SHADOW_GFX_CLIENT*)context;
+	UINT16* ids = calloc(1, sizeof(UINT16));
+
+	if (!ids)
+		return CHANNEL_RC_NO_MEMORY;
+
+	*ppSurfaceIds = ids;
+	*count_out = client->surface ? 1 : 0;
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_shadow_gfx_surface_command(RdpgfxServerContext* context,
+                                            const RDPGFX_SURFACE_COMMAND* cmd)
+{
+	TEST_SHADOW_GFX_CLIENT* client = (TEST_SHADOW_GFX_CLIENT*)context->custom;
+	RDPGFX_START_FRAME_PDU start = { 0 };
+	RDPGFX_END_FRAME_PDU end = { 0 };
+	UINT error;
+
+	if (cmd->codecId != RDPGFX_CODECID_CAPROGRESSIVE)
+		return ERROR_INVALID_DATA;
+
+	/* The command as the server built it, with its destination rectangle */
+	if ((error = client->gfx.StartFrame(&client->gfx, &start)) != CHANNEL_RC_OK)
+		return error;
+
+	if ((error = client->gfx.SurfaceCommand(&client->gfx, cmd)) != CHANNEL_RC_OK)
+		return error;
+
+	return client->gfx.EndFrame(&client->gfx, &end);
+}
+
+static BOOL test_shadow_gfx_client_new(TEST_SHADOW_GFX_CLIENT* client)
+{
+	rdpSettings* settings;
+	RDPGFX_CREATE_SURFACE_PDU pdu = { 0 };
+
+	client->server.custom = client;
+	client->server.SurfaceCommand = test_shadow_gfx_surface_command;
+	client->gfx.SetSurfaceData = test_shadow_gfx_set_surface_data;
+	client->gfx.GetSurfaceData = test_shadow_gfx_get_surface_data;
+	client->gfx.GetSurfaceIds = test_shadow_gfx_get_surface_ids;
+	client->instance = freerdp_new();
+
+	if (!client->instance || !freerdp_context_new(client->instance))
+		return FALSE;
+
+	settings = client->instance->context->settings;
+	settings->DesktopWidth = TEST_SHADOW_GFX_WIDTH;
+	settings->DesktopHeight = TEST_SHADOW_GFX_HEIGHT;
+
+	/* What the connection sequence would set up */
+	client->instance->context->codecs = codecs_new(client->instance->context);
+
+	if (!client->instance->context->codecs ||
+	    !freerdp_client_codecs_prepare(client->instance->context->codecs, FREERDP_CODEC_ALL,
+	                                   TEST_SHADOW_GFX_WIDTH, TEST_SHADOW_GFX_HEIGHT))
+		return FALSE;
+
+	if (!gdi_init(client->instance, PIXEL_FORMAT_BGRX32))
+		return FALSE;
+
+	if (!gdi_graphics_pipeline_init(client->instance->context->gdi, &client->gfx))
+		return FALSE;
+
+	client->pipeline = TRUE;
+	pdu.surfaceId = 0;
+	pdu.width = TEST_SHADOW_GFX_WIDTH;
+	pdu.height = TEST_SHADOW_GFX_HEIGHT;
+	pdu.pixelFormat = GFX_PIXEL_FORMAT_XRGB_8888;
+	return client->gfx.CreateSurface(&client->gfx, &pdu) == CHANNEL_RC_OK;
+}
+
+static void test_shadow_gfx_client_free(TEST_SHADOW_GFX_CLIENT* client)
+{
+	freerdp* instance = client->instance;
+
+	if (!instance)
+		return;
+
+	if (instance->context)
+	{
+		if (client->pipeline)
+			gdi_graphics_pipeline_uninit(instance->context->gdi, &client->gfx);
+
+		gdi_free(instance);
+		codecs_free(instance->context->codecs);
+		instance->context->codecs = NULL;
+		freerdp_context_free(instance);
+	}
+
+	freerdp_free(instance);
+}
+
+/* The codec is lossy, a flat color has to come close */
+static BOOL test_shadow_gfx_check_pixel(TEST_SHADOW_GFX_CLIENT* client, const char* name,
+                                        UINT32 x, UINT32 y, UINT32 expected)
+{
+	size_t index;
+	BYTE actual[3];
+	BYTE wanted[3];
+	const gdiGfxSurface* surface = client->surface;
+	const UINT32 color =
+	    ReadColor(&surface->data[y * surface->scanline + x * 4], surface->format);
+	SplitColor(color, surface->format, &actual[0], &actual[1], &actual[2], NULL, NULL);
+	SplitColor(expected, PIXEL_FORMAT_BGRX32, &wanted[0], &wanted[1], &wanted[2], NULL, NULL);
+
+	for (index = 0; index < ARRAYSIZE(actual); index++)
+	{
+		if (abs(actual[index] - wanted[index]) > 8)
+		{
+			fprintf(stderr,
+			        "%s: pixel %" PRIu32 "x%" PRIu32 " is 0x%08" PRIx32 " instead of 0x%08" PRIx32
+			        "\n",
+			        name, x, y, color, expected);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+ * The tile has to land where it is on the desktop and nowhere else, the decoder
+ * adds the command origin to the tile positions of the bitstream.
+ */
+static BOOL test_shadow_gfx_check(TEST_SHADOW_GFX_CLIENT* client, const char* name,
+                                  const RECTANGLE_16* tile)
+{
+	UINT32 x, y;
+
+	for (y = 0; y < TEST_SHADOW_GFX_HEIGHT; y += 16)
+	{
+		for (x = 0; x < TEST_SHADOW_GFX_WIDTH; x += 16)
+		{
+			const BOOL inside =
+			    (x >= tile->left) && (x < tile->right) && (y >= tile->top) && (y < tile->bottom);
+
+			if (!test_shadow_gfx_check_pixel(client, name, x + 8, y + 8,
+			                                 inside ? TEST_SHADOW_GFX_TILE_COLOR
+			                                        : TEST_SHADOW_GFX_BACKGROUND))
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL test_shadow_gfx_send(rdpShadowClient* client, const BYTE* image,
+                                 const RECTANGLE_16* tile)
+{
+	BOOL rc;
+	REGION16 region;
+	RDPGFX_SURFACE_COMMAND cmd = { 0 };
+	cmd.surfaceId = 0;
+	cmd.format = PIXEL_FORMAT_BGRX32;
+	region16_init(&region);
+	rc = region16_union_rect(&region, &region, tile) &&
+	     shadow_client_send_gfx_progressive(client, image, TEST_SHADOW_GFX_STEP,
+	                                        TEST_SHADOW_GFX_WIDTH, TEST_SHADOW_GFX_HEIGHT,
+	                                        &region, &cmd);
+	region16_uninit(&region);
+	return rc;
+}
+
+/*
+ * Viewers of one desktop decode the commands the way the gdi graphics pipeline
+ * does. With more than one, the others get the tile from the encode cache.
+ */
+static BOOL test_shadow_gfx_progressive(size_t count)
+{
+	BOOL rc = FALSE;
+	UINT32 x, y;
+	size_t index;
+	BYTE* image = NULL;
+	rdpShadowServer server = { 0 };
+	rdpShadowSurface surface = { 0 };
+	rdpShadowClient clients[2] = { 0 };
+	rdpShadowEncoder encoders[2] = { 0 };
+	TEST_SHADOW_GFX_CLIENT viewers[2] = { 0 };
+	const RECTANGLE_16 tile = { 64, 128, 128, 192 };
+	const char* names[2] = { "encoded", "cached" };
+	const UINT32 misses = (count > 1) ? 1 : 0;
+
+	if (!(image = calloc(TEST_SHADOW_GFX_HEIGHT, TEST_SHADOW_GFX_STEP)))
+		goto fail;
+
+	for (y = tile.top; y < tile.bottom; y++)
+	{
+		for (x = tile.left; x < tile.right; x++)
+			WriteColor(&image[y * TEST_SHADOW_GFX_STEP + x * 4], PIXEL_FORMAT_BGRX32,
+			           TEST_SHADOW_GFX_TILE_COLOR);
+	}
+
+	surface.width = TEST_SHADOW_GFX_WIDTH;
+	surface.height = TEST_SHADOW_GFX_HEIGHT;
+	surface.generation = 1;
+	server.surface = &surface;
+
+	if (!(server.clients = ArrayList_New(FALSE)) ||
+	    !(server.encodeCache = shadow_encode_cache_new(&server)))
+		goto fail;
+
+	for (index = 0; index < count; index++)
+	{
+		if (!test_shadow_gfx_client_new(&viewers[index]))
+			goto fail;
+
+		if (!(encoders[index].progressive = progressive_context_new(TRUE)))
+			goto fail;
+
+		clients[index].server = &server;
+		clients[index].encoder = &encoders[index];
+		clients[index].rdpgfx = &viewers[index].server;
+
+		if (ArrayList_Add(server.clients, &clients[index]) < 0)
+			goto fail;
+	}
+
+	for (index = 0; index < count; index++)
+	{
+		if (!test_shadow_gfx_send(&clients[index], image, &tile))
+		{
+			fprintf(stderr, "%s: sending the tile failed\n", names[index]);
+			goto fail;
+		}
+
+		if (!test_shadow_gfx_check(&viewers[index], names[index], &tile))
+			goto fail;
+	}
+
+	if ((server.encodeCache->misses != misses) || (server.encodeCache->hits != count - 1))
+	{
+		fprintf(stderr, "encode cache: %" PRIu32 " hits %" PRIu32 " misses\n",
+		        server.encodeCache->hits, server.encodeCache->misses);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+
+	for (index = 0; index < ARRAYSIZE(clients); index++)
+	{
+		progressive_context_free(encoders[index].progressive);
+		test_shadow_gfx_client_free(&viewers[index]);
+	}
+
+	shadow_encode_cache_free(server.encodeCache);
+	ArrayList_Free(server.clients);
+	free(image);
+	return rc;
+}
+
+int TestShadowGfxProgressive(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_shadow_gfx_progressive(1) || !test_shadow_gfx_progressive(2))
+		return -1;
+
+	return 0;
+}
@@ -576,9 +576,18 @@ ULONGLONG winpr_GetTickCount64(void)
 /* If x86 */
 #ifdef _M_IX86_AMD64
 
-#if defined(__GNUC__) && defined(__AVX__)
+#if defined(__GNUC__)
 #define xgetbv(_func_, _lo_, _hi_) \
 	__asm__ __volatile__("xgetbv" : "=a"(_lo_), "=d"(_hi_) : "c"(_func_))
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define xgetbv(_func_, _lo_, _hi_)                      \
+	do                                                  \
+	{                                                   \
+		const unsigned __int64 _xcr_ = _xgetbv(_func_); \
+		_lo_ = (int)(_xcr_ & 0xFFFFFFFF);               \
+		_hi_ = (int)(_xcr_ >> 32);                      \
+	} while (0)
 #endif
 
 #define D_BIT_MMX (1 << 23)
@@ -601,6 +610,7 @@ ULONGLONG winpr_GetTickCount64(void)
 #define E_BIT_XMM (1 << 1)
 #define E_BIT_YMM (1 << 2)
 #define E_BITS_AVX (E_BIT_XMM | E_BIT_YMM)
+#define B7_BIT_AVX2 (1 << 5)
 
 static void cpuid(unsigned info, unsigned* eax, unsigned* ebx, unsigned* ecx, unsigned* edx)
 {
@@ -620,10 +630,10 @@ static void cpuid(unsigned info, unsigned* eax, unsigned* ebx, unsigned* ecx, un
 	    "xchg %%rbx, %%rsi;"
 #endif
 	    : "=a"(*eax), "=S"(*ebx), "=c"(*ecx), "=d"(*edx)
-	    : "0"(info));
+	    : "0"(info), "2"(0));
 #elif defined(_MSC_VER)
 	int a[4];
-	__cpuid(a, info);
+	__cpuidex(a, info, 0);
 	*eax = a[0];
 	*ebx = a[1];
 	*ecx = a[2];
@@ -935,18 +945,20 @@ BOOL IsProcessorFeaturePresentEx(DWORD ProcessorFeature)
 				ret = TRUE;
 
 			break;
-#if defined(__GNUC__) && defined(__AVX__)
+#if defined(__GNUC__) || defined(_MSC_VER)
 
 		case PF_EX_AVX:
+		case PF_EX_AVX2:
 		case PF_EX_FMA:
 		case PF_EX_AVX_AES:
 		case PF_EX_AVX_PCLMULQDQ:
 		{
+			int e, f;
+
 			/* Check for general AVX support */
 			if ((c & C_BITS_AVX) != C_BITS_AVX)
 				break;
 
-			int e, f;
 			xgetbv(0, e, f);
 
 			/* XGETBV enabled for applications and XMM/YMM states enabled */
@@ -958,6 +970,21 @@ BOOL IsProcessorFeaturePresentEx(DWORD ProcessorFeature)
 						ret = TRUE;
 						break;
 
+					case PF_EX_AVX2:
+					{
+						unsigned a7, b7, c7, d7;
+						cpuid(0, &a7, &b7, &c7, &d7);
+
+						if (a7 < 7)
+							break;
+
+						cpuid(7, &a7, &b7, &c7, &d7);
+
+						if (b7 & B7_BIT_AVX2)
+							ret = TRUE;
+					}
+					break;
+
 					case PF_EX_FMA:
 						if (c & C_BIT_FMA)
 							ret = TRUE;
@@ -979,7 +1006,7 @@ BOOL IsProcessorFeaturePresentEx(DWORD ProcessorFeature)
 			}
 		}
 		break;
-#endif //__AVX__
+#endif //__GNUC__ || _MSC_VER
 
 		default:
 			break;